@@ -100,10 +100,7 @@ void mp_aframe_unref_data(struct mp_aframe *frame)
     talloc_free(tmp);
 }
 
-// Return a new reference to the data in av_frame. av_frame itself is not
-// touched. Returns NULL if not representable, or if input is NULL.
-// Does not copy the timestamps.
-struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame)
+static struct mp_aframe *from_avframe(struct AVFrame *av_frame, bool move)
 {
     if (!av_frame || av_frame->width > 0 || av_frame->height > 0)
         return NULL;
@@ -114,9 +111,13 @@ struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame)
 
     struct mp_aframe *frame = mp_aframe_create();
 
-    // This also takes care of forcing refcounting.
-    if (av_frame_ref(frame->av_frame, av_frame) < 0)
-        abort();
+    if (move && av_frame->buf[0]) {
+        av_frame_move_ref(frame->av_frame, av_frame);
+    } else {
+        // This also takes care of forcing refcounting.
+        if (av_frame_ref(frame->av_frame, av_frame) < 0)
+            abort();
+    }
 
     frame->format = format;
     mp_chmap_from_lavc(&frame->chmap, frame->av_frame->channel_layout);
@@ -135,6 +136,22 @@ struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame)
     return frame;
 }
 
+// Return a new reference to the data in av_frame. av_frame itself is not
+// touched. Returns NULL if not representable, or if input is NULL.
+// Does not copy the timestamps.
+struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame)
+{
+    return from_avframe(av_frame, false);
+}
+
+// Like mp_aframe_from_avframe(), but move the references out of av_frame,
+// which avoids reallocating the buffer references and side data. av_frame is
+// reset on success, and untouched if NULL is returned.
+struct mp_aframe *mp_aframe_from_avframe_and_unref(struct AVFrame *av_frame)
+{
+    return from_avframe(av_frame, true);
+}
+
 // Return a new reference to the data in frame. Returns NULL is not
 // representable (), or if input is NULL.
 // Does not copy the timestamps.
@@ -566,10 +583,14 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     AVFrame *av_frame = frame->av_frame;
     if (av_frame->extended_data != av_frame->data)
         av_freep(&av_frame->extended_data); // sigh
-    av_frame->extended_data =
-        av_mallocz_array(planes, sizeof(av_frame->extended_data[0]));
-    if (!av_frame->extended_data)
-        abort();
+    av_frame->extended_data = av_frame->data;
+    // Only layouts with more channels need a separate plane pointer array.
+    if (planes > AV_NUM_DATA_POINTERS) {
+        av_frame->extended_data =
+            av_mallocz_array(planes, sizeof(av_frame->extended_data[0]));
+        if (!av_frame->extended_data)
+            abort();
+    }
     av_frame->buf[0] = av_buffer_pool_get(pool->avpool);
     if (!av_frame->buf[0])
         return -1;
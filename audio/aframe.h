@@ -9,6 +9,7 @@ struct AVFrame;
 struct mp_chmap;
 
 struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame);
+struct mp_aframe *mp_aframe_from_avframe_and_unref(struct AVFrame *av_frame);
 struct mp_aframe *mp_aframe_create(void);
 struct mp_aframe *mp_aframe_new_ref(struct mp_aframe *frame);
 
@@ -19,12 +19,23 @@
 #include <limits.h>
 #include <assert.h>
 
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
 #include "common/common.h"
 
+#include "aframe.h"
 #include "chmap.h"
 #include "audio_buffer.h"
 #include "format.h"
 
+// The buffered samples start at data[n] + offset * sstride. data[] points
+// either to buf[] (owned memory), or into the planes of frame (read-only,
+// referenced by mp_audio_buffer_append_frame() instead of copying). The data
+// is copied to buf[] only if the buffer needs to be modified.
 struct mp_audio_buffer {
     int format;
     struct mp_chmap channels;
@@ -32,13 +43,59 @@ struct mp_audio_buffer {
     int sstride;
     int num_planes;
     uint8_t *data[MP_NUM_CHANNELS];
+    uint8_t *buf[MP_NUM_CHANNELS];
+    uint8_t *peek[MP_NUM_CHANNELS];
+    struct mp_aframe *frame;
     int allocated;
+    int offset;
     int num_samples;
+    bool lock_memory;   // keep buf[] in RAM with mlock()
 };
 
+// Note that this works on whole pages, so unlocking may unlock unrelated
+// memory sharing the first or last page.
+static bool lock_planes(struct mp_audio_buffer *ab, bool lock)
+{
+    bool ok = true;
+#if HAVE_POSIX
+    for (int n = 0; n < ab->num_planes; n++) {
+        if (!ab->buf[n])
+            continue;
+        size_t size = (size_t)ab->sstride * ab->allocated;
+        if (lock) {
+            ok &= mlock(ab->buf[n], size) == 0;
+        } else {
+            munlock(ab->buf[n], size);
+        }
+    }
+#else
+    ok = !lock;
+#endif
+    return ok;
+}
+
+static void destroy(void *ptr)
+{
+    struct mp_audio_buffer *ab = ptr;
+    if (ab->lock_memory)
+        lock_planes(ab, false);
+    talloc_free(ab->frame);
+}
+
+// Lock the buffer memory (now and after future reallocations) into RAM, so that
+// accessing it never causes page faults. Returns false if this failed (for
+// example because of RLIMIT_MEMLOCK).
+bool mp_audio_buffer_lock_memory(struct mp_audio_buffer *ab)
+{
+    ab->lock_memory = true;
+    return lock_planes(ab, true);
+}
+
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
 {
-    return talloc_zero(talloc_ctx, struct mp_audio_buffer);
+    struct mp_audio_buffer *ab = talloc_zero(talloc_ctx, struct mp_audio_buffer);
+    talloc_set_destructor(ab, destroy);
+    return ab;
 }
 
 // Reinitialize the buffer, set a new format, drop old data.
@@ -46,12 +103,18 @@ struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
 void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
                                 const struct mp_chmap *channels, int srate)
 {
-    for (int n = 0; n < MP_NUM_CHANNELS; n++)
-        TA_FREEP(&ab->data[n]);
+    if (ab->lock_memory)
+        lock_planes(ab, false);
+    for (int n = 0; n < MP_NUM_CHANNELS; n++) {
+        TA_FREEP(&ab->buf[n]);
+        ab->data[n] = NULL;
+    }
+    TA_FREEP(&ab->frame);
     ab->format = format;
     ab->channels = *channels;
     ab->srate = srate;
     ab->allocated = 0;
+    ab->offset = 0;
     ab->num_samples = 0;
     ab->sstride = af_fmt_to_bytes(ab->format);
     ab->num_planes = 1;
@@ -62,72 +125,166 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     }
 }
 
-// Make the total size of the internal buffer at least this number of samples.
-void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
+// All integer parameters are in samples.
+// dst and src can overlap.
+static void copy_planes(struct mp_audio_buffer *ab,
+                        uint8_t **dst, int dst_offset,
+                        uint8_t **src, int src_offset, int length)
 {
+    for (int n = 0; n < ab->num_planes; n++) {
+        memmove((char *)dst[n] + dst_offset * ab->sstride,
+                (char *)src[n] + src_offset * ab->sstride,
+                length * ab->sstride);
+    }
+}
+
+// Make sure the data is in buf[], starts at offset 0, and that there is space
+// for at least this number of samples.
+static void make_writable(struct mp_audio_buffer *ab, int samples)
+{
+    samples = MPMAX(samples, ab->num_samples);
     if (samples > ab->allocated) {
+        if (ab->lock_memory)
+            lock_planes(ab, false);
         for (int n = 0; n < ab->num_planes; n++) {
-            ab->data[n] = talloc_realloc(ab, ab->data[n], char,
-                                         ab->sstride * samples);
+            ab->buf[n] = talloc_realloc(ab, ab->buf[n], uint8_t,
+                                        ab->sstride * samples);
         }
         ab->allocated = samples;
+        if (ab->lock_memory)
+            lock_planes(ab, true);
+        if (!ab->frame) {
+            for (int n = 0; n < ab->num_planes; n++)
+                ab->data[n] = ab->buf[n];
+        }
+    }
+    if (ab->frame || ab->offset) {
+        copy_planes(ab, ab->buf, 0, ab->data, ab->offset, ab->num_samples);
+        for (int n = 0; n < ab->num_planes; n++)
+            ab->data[n] = ab->buf[n];
+        ab->offset = 0;
+        TA_FREEP(&ab->frame);
     }
 }
 
-// Get number of samples that can be written without forcing a resize of the
-// internal buffer.
-int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
+// Make the total size of the internal buffer at least this number of samples.
+void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
-    return ab->allocated - ab->num_samples;
+    if (samples > ab->allocated)
+        make_writable(ab, samples);
 }
 
-// All integer parameters are in samples.
-// dst and src can overlap.
-static void copy_planes(struct mp_audio_buffer *ab,
-                        uint8_t **dst, int dst_offset,
-                        uint8_t **src, int src_offset, int length)
+// Free the unused part of the internal buffer. It's transparently reallocated
+// when appending data.
+void mp_audio_buffer_trim(struct mp_audio_buffer *ab)
 {
+    int samples = ab->frame ? 0 : ab->num_samples;
+    if (samples >= ab->allocated)
+        return;
+    if (!ab->frame && ab->offset) {
+        copy_planes(ab, ab->buf, 0, ab->data, ab->offset, ab->num_samples);
+        ab->offset = 0;
+    }
+    if (ab->lock_memory)
+        lock_planes(ab, false);
     for (int n = 0; n < ab->num_planes; n++) {
-        memmove((char *)dst[n] + dst_offset * ab->sstride,
-                (char *)src[n] + src_offset * ab->sstride,
-                length * ab->sstride);
+        if (samples) {
+            ab->buf[n] = talloc_realloc(ab, ab->buf[n], uint8_t,
+                                        ab->sstride * samples);
+        } else {
+            TA_FREEP(&ab->buf[n]);
+        }
     }
+    ab->allocated = samples;
+    if (ab->lock_memory)
+        lock_planes(ab, true);
+    if (!ab->frame) {
+        for (int n = 0; n < ab->num_planes; n++)
+            ab->data[n] = ab->buf[n];
+    }
+}
+
+// Get number of samples that can be written without forcing a resize of the
+// internal buffer.
+int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
+{
+    return ab->allocated - ab->num_samples;
 }
 
 // Append data to the end of the buffer.
 // If the buffer is not large enough, it is transparently resized.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 {
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples, (uint8_t **)ptr, 0, samples);
+    if (ab->frame || ab->offset + ab->num_samples + samples > ab->allocated)
+        make_writable(ab, ab->num_samples + samples);
+    copy_planes(ab, ab->data, ab->offset + ab->num_samples,
+                (uint8_t **)ptr, 0, samples);
     ab->num_samples += samples;
 }
 
+// Append the samples in the frame. If the buffer is empty, this only
+// references the frame's data, so the caller can read it with
+// mp_audio_buffer_peek() without any copying. The frame must have the format
+// the buffer was initialized with.
+void mp_audio_buffer_append_frame(struct mp_audio_buffer *ab,
+                                  struct mp_aframe *frame)
+{
+    int samples = mp_aframe_get_size(frame);
+    uint8_t **planes = mp_aframe_get_data_ro(frame);
+    if (ab->num_samples || !samples || !planes ||
+        mp_aframe_get_format(frame) != ab->format)
+    {
+        if (samples && planes)
+            mp_audio_buffer_append(ab, (void **)planes, samples);
+        return;
+    }
+    TA_FREEP(&ab->frame);
+    ab->frame = mp_aframe_new_ref(frame);
+    if (!ab->frame) {
+        mp_audio_buffer_append(ab, (void **)planes, samples);
+        return;
+    }
+    planes = mp_aframe_get_data_ro(ab->frame);
+    for (int n = 0; n < ab->num_planes; n++)
+        ab->data[n] = planes[n];
+    ab->offset = 0;
+    ab->num_samples = samples;
+}
+
 // Prepend silence to the start of the buffer.
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, samples, ab->data, 0, ab->num_samples);
+    if (ab->frame || ab->offset < samples) {
+        make_writable(ab, ab->num_samples + samples);
+        copy_planes(ab, ab->data, samples, ab->data, 0, ab->num_samples);
+    } else {
+        ab->offset -= samples;
+    }
     ab->num_samples += samples;
-    for (int n = 0; n < ab->num_planes; n++)
-        af_fill_silence(ab->data[n], samples * ab->sstride, ab->format);
+    for (int n = 0; n < ab->num_planes; n++) {
+        af_fill_silence(ab->data[n] + ab->offset * ab->sstride,
+                        samples * ab->sstride, ab->format);
+    }
 }
 
 void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
+    make_writable(ab, ab->num_samples + samples);
     copy_planes(ab, ab->data, ab->num_samples,
                 ab->data, ab->num_samples - samples, samples);
     ab->num_samples += samples;
 }
 
 // Get the start of the current readable buffer.
+// The returned pointer array is valid only until the next call on ab.
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
                           int *samples)
 {
-    *ptr = ab->data;
+    for (int n = 0; n < ab->num_planes; n++)
+        ab->peek[n] = ab->data[n] + ab->offset * ab->sstride;
+    *ptr = ab->peek;
     *samples = ab->num_samples;
 }
 
@@ -135,13 +292,21 @@ void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    copy_planes(ab, ab->data, 0, ab->data, samples, ab->num_samples - samples);
+    ab->offset += samples;
     ab->num_samples -= samples;
+    if (!ab->num_samples)
+        mp_audio_buffer_clear(ab);
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
     ab->num_samples = 0;
+    ab->offset = 0;
+    if (ab->frame) {
+        TA_FREEP(&ab->frame);
+        for (int n = 0; n < ab->num_planes; n++)
+            ab->data[n] = ab->buf[n];
+    }
 }
 
 // Return number of buffered audio samples
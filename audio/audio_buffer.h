@@ -18,15 +18,22 @@
 #ifndef MP_AUDIO_BUFFER_H
 #define MP_AUDIO_BUFFER_H
 
+#include <stdbool.h>
+
 struct mp_audio_buffer;
+struct mp_aframe;
 struct mp_chmap;
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx);
 void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
                                 const struct mp_chmap *channels, int srate);
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples);
+void mp_audio_buffer_trim(struct mp_audio_buffer *ab);
+bool mp_audio_buffer_lock_memory(struct mp_audio_buffer *ab);
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab);
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples);
+void mp_audio_buffer_append_frame(struct mp_audio_buffer *ab,
+                                  struct mp_aframe *frame);
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples);
 void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples);
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
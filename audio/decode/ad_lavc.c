@@ -211,7 +211,18 @@ static bool receive_frame(struct mp_filter *da, struct mp_frame *out)
 
     double out_pts = mp_pts_from_av(priv->avframe->pts, &priv->codec_timebase);
 
-    struct mp_aframe *mpframe = mp_aframe_from_avframe(priv->avframe);
+#if LIBAVCODEC_VERSION_MICRO >= 100
+    AVFrameSideData *sd =
+        av_frame_get_side_data(priv->avframe, AV_FRAME_DATA_SKIP_SAMPLES);
+    if (sd && sd->size >= 10) {
+        char *d = sd->data;
+        priv->skip_samples += AV_RL32(d + 0);
+        priv->trim_samples += AV_RL32(d + 4);
+    }
+#endif
+
+    // Take over the decoder's references, instead of creating new ones.
+    struct mp_aframe *mpframe = mp_aframe_from_avframe_and_unref(priv->avframe);
     if (!mpframe)
         return true;
 
@@ -224,16 +235,6 @@ static bool receive_frame(struct mp_filter *da, struct mp_frame *out)
 
     priv->next_pts = mp_aframe_end_pts(mpframe);
 
-#if LIBAVCODEC_VERSION_MICRO >= 100
-    AVFrameSideData *sd =
-        av_frame_get_side_data(priv->avframe, AV_FRAME_DATA_SKIP_SAMPLES);
-    if (sd && sd->size >= 10) {
-        char *d = sd->data;
-        priv->skip_samples += AV_RL32(d + 0);
-        priv->trim_samples += AV_RL32(d + 4);
-    }
-#endif
-
     if (!priv->preroll_done) {
         // Skip only if this isn't already handled by AV_FRAME_DATA_SKIP_SAMPLES.
         if (!priv->skip_samples)
@@ -254,8 +255,6 @@ static bool receive_frame(struct mp_filter *da, struct mp_frame *out)
 
     *out = MAKE_FRAME(MP_FRAME_AUDIO, mpframe);
 
-    av_frame_unref(priv->avframe);
-
     return true;
 }
 
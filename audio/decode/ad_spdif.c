@@ -35,14 +35,17 @@
 #include "filters/filter_internal.h"
 #include "options/options.h"
 
+// Maximum size of the output per packet. The largest IEC 61937 bursts are
+// TrueHD MAT frames with 61440 bytes.
 #define OUTBUF_SIZE 65536
 
 struct spdifContext {
     struct mp_log   *log;
     enum AVCodecID   codec_id;
     AVFormatContext *lavf_ctx;
+    // The muxer writes directly into the data of the output frame.
+    uint8_t         *out_buffer;
     int              out_buffer_len;
-    uint8_t          out_buffer[OUTBUF_SIZE];
     bool             need_close;
     bool             use_dts_hd;
     struct mp_aframe *fmt;
@@ -56,6 +59,10 @@ static int write_packet(void *p, uint8_t *buf, int buf_size)
 {
     struct spdifContext *ctx = p;
 
+    // Output outside of process() (e.g. the trailer) is dropped.
+    if (!ctx->out_buffer)
+        return buf_size;
+
     int buffer_left = OUTBUF_SIZE - ctx->out_buffer_len;
     if (buf_size > buffer_left) {
         MP_ERR(ctx, "spdif packet too large.\n");
@@ -304,17 +311,11 @@ static void process(struct mp_filter *da)
         if (init_filter(da, &pkt) < 0)
             goto done;
     }
-    spdif_ctx->out_buffer_len  = 0;
-    int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
-    avio_flush(spdif_ctx->lavf_ctx->pb);
-    if (ret < 0) {
-        MP_ERR(da, "spdif mux error: '%s'\n", mp_strerror(AVUNERROR(ret)));
-        goto done;
-    }
 
+    // Always allocate the maximum size, so the pool can recycle all buffers.
     out = mp_aframe_new_ref(spdif_ctx->fmt);
-    int samples = spdif_ctx->out_buffer_len / spdif_ctx->sstride;
-    if (mp_aframe_pool_allocate(spdif_ctx->pool, out, samples) < 0) {
+    int max_samples = OUTBUF_SIZE / spdif_ctx->sstride;
+    if (mp_aframe_pool_allocate(spdif_ctx->pool, out, max_samples) < 0) {
         TA_FREEP(&out);
         goto done;
     }
@@ -325,7 +326,18 @@ static void process(struct mp_filter *da)
         goto done;
     }
 
-    memcpy(data[0], spdif_ctx->out_buffer, spdif_ctx->out_buffer_len);
+    spdif_ctx->out_buffer = data[0];
+    spdif_ctx->out_buffer_len = 0;
+    int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
+    avio_flush(spdif_ctx->lavf_ctx->pb);
+    spdif_ctx->out_buffer = NULL;
+    if (ret < 0) {
+        MP_ERR(da, "spdif mux error: '%s'\n", mp_strerror(AVUNERROR(ret)));
+        TA_FREEP(&out);
+        goto done;
+    }
+
+    mp_aframe_set_size(out, spdif_ctx->out_buffer_len / spdif_ctx->sstride);
     mp_aframe_set_pts(out, pts);
 
 done:
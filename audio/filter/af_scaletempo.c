@@ -35,6 +35,12 @@
 #include <limits.h>
 #include <assert.h>
 
+#include "config.h"
+
+#if HAVE_SSE4_INTRINSICS
+#include <libavutil/cpu.h>
+#endif
+
 #include "audio/aframe.h"
 #include "audio/format.h"
 #include "common/common.h"
@@ -89,6 +95,7 @@ struct priv {
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct priv *s);
+    float (*dot_float)(const float *a, const float *b, int n);
 };
 
 static bool reinit(struct mp_filter *f);
@@ -136,6 +143,101 @@ static bool fill_queue(struct priv *s)
 
 #define UNROLL_PADDING (4 * 4)
 
+static float dot_float_c(const float *a, const float *b, int n)
+{
+    float r = 0;
+    for (int i = 0; i < n; i++)
+        r += a[i] * b[i];
+    return r;
+}
+
+// The vectorized variants sum in a different order, so the correlation
+// differs from dot_float_c() in the last bits. This doesn't matter for
+// finding the best offset.
+
+#if HAVE_SSE4_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+static float dot_float_sse2(const float *a, const float *b, int n)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+    }
+    float t[4];
+    _mm_storeu_ps(t, _mm_add_ps(s0, s1));
+    return t[0] + t[1] + t[2] + t[3] + dot_float_c(a + i, b + i, n - i);
+}
+
+#pragma GCC pop_options
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static float dot_float_avx2(const float *a, const float *b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 s = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s),
+                          _mm256_extractf128_ps(s, 1));
+    float t[4];
+    _mm_storeu_ps(t, h);
+    _mm256_zeroupper();
+    return t[0] + t[1] + t[2] + t[3] + dot_float_c(a + i, b + i, n - i);
+}
+
+#pragma GCC pop_options
+#endif
+
+#if HAVE_NEON_INTRINSICS
+#include <arm_neon.h>
+
+static float dot_float_neon(const float *a, const float *b, int n)
+{
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float t[4];
+    vst1q_f32(t, vaddq_f32(s0, s1));
+    return t[0] + t[1] + t[2] + t[3] + dot_float_c(a + i, b + i, n - i);
+}
+#endif
+
+static float (*select_dot_float(void))(const float *a, const float *b, int n)
+{
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return dot_float_avx2;
+#endif
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        return dot_float_sse2;
+#endif
+#if HAVE_NEON_INTRINSICS
+    return dot_float_neon;
+#endif
+    return dot_float_c;
+}
+
 static int best_overlap_offset_float(struct priv *s)
 {
     float best_corr = INT_MIN;
@@ -149,12 +251,9 @@ static int best_overlap_offset_float(struct priv *s)
         *ppc++ = *pw++ **po++;
 
     float *search_start = (float *)s->buf_queue + s->num_channels;
+    int len = s->samples_overlap - s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = s->dot_float(s->buf_pre_corr, search_start, len);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -477,6 +576,7 @@ static bool reinit(struct mp_filter *f)
                     *pw++ = v;
             }
             s->best_overlap_offset = best_overlap_offset_float;
+            s->dot_float = select_dot_float();
         }
     }
 
@@ -35,6 +35,12 @@
 #include "common/common.h"
 #include "common/global.h"
 
+#include "gain_simd.h"
+
+#if HAVE_SSE4_INTRINSICS
+#include <libavutil/cpu.h>
+#endif
+
 extern const struct ao_driver audio_out_oss;
 extern const struct ao_driver audio_out_audiounit;
 extern const struct ao_driver audio_out_coreaudio;
@@ -153,6 +159,7 @@ static struct ao *ao_alloc(bool probing, struct mpv_global *global,
         .wakeup_ctx = wakeup_ctx,
         .log = mp_log_new(ao, log, name),
         .def_buffer = opts->audio_buffer,
+        .low_latency = opts->audio_low_latency,
         .client_name = talloc_strdup(ao, opts->audio_client_name),
     };
     ao->priv = m_config_group_from_desc(ao, ao->log, global, &desc, name);
@@ -230,6 +237,15 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
     if (ao->device_buffer)
         MP_VERBOSE(ao, "device buffer: %d samples.\n", ao->device_buffer);
     ao->buffer = MPMAX(ao->device_buffer, ao->def_buffer * ao->samplerate);
+    if (ao->low_latency) {
+        // Don't add a soft buffer of the size of the device buffer. Pull AOs
+        // still need to be able to return a full device buffer per callback.
+        int min = MPMAX(ao->period_size * 2,
+                        AO_LOW_LATENCY_BUFFER * ao->samplerate);
+        ao->buffer = MPMIN(ao->def_buffer * ao->samplerate, min);
+        if (ao->api == &ao_api_pull)
+            ao->buffer = MPMAX(ao->buffer, ao->device_buffer);
+    }
     ao->buffer = MPMAX(ao->buffer, 1);
 
     int align = af_format_sample_alignment(ao->format);
@@ -654,25 +670,61 @@ void ao_set_gain(struct ao *ao, float gain)
     for (int n = 0; n < (num_samples); n++)                                     \
         (d)[n] = MPCLAMP(((d)[n]) * (gain), -1.0, 1.0)
 
-static void process_plane(struct ao *ao, void *data, int num_samples)
+static int gain_float_simd(float *d, int num_samples, float gain)
+{
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return gain_float_avx2(d, num_samples, gain);
+#endif
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        return gain_float_sse2(d, num_samples, gain);
+#endif
+#if HAVE_NEON_INTRINSICS
+    return gain_float_neon(d, num_samples, gain);
+#endif
+    return 0;
+}
+
+static int gain_s16_simd(int16_t *d, int num_samples, int gain)
+{
+    if (gain > INT16_MAX)
+        return 0;
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return gain_s16_avx2(d, num_samples, gain);
+#endif
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        return gain_s16_sse2(d, num_samples, gain);
+#endif
+#if HAVE_NEON_INTRINSICS
+    return gain_s16_neon(d, num_samples, gain);
+#endif
+    return 0;
+}
+
+static void gain_plane(int format, void *data, int num_samples, float gain)
 {
-    float gain = atomic_load_explicit(&ao->gain, memory_order_relaxed);
     int gi = lrint(256.0 * gain);
-    if (gi == 256)
-        return;
-    switch (af_fmt_from_planar(ao->format)) {
+    switch (format) {
     case AF_FORMAT_U8:
         MUL_GAIN_i((uint8_t *)data, num_samples, gi, 0, 128, 255);
         break;
-    case AF_FORMAT_S16:
-        MUL_GAIN_i((int16_t *)data, num_samples, gi, INT16_MIN, 0, INT16_MAX);
+    case AF_FORMAT_S16: {
+        int done = gain_s16_simd(data, num_samples, gi);
+        MUL_GAIN_i((int16_t *)data + done, num_samples - done, gi,
+                   INT16_MIN, 0, INT16_MAX);
         break;
+    }
     case AF_FORMAT_S32:
         MUL_GAIN_i((int32_t *)data, num_samples, gi, INT32_MIN, 0, INT32_MAX);
         break;
-    case AF_FORMAT_FLOAT:
-        MUL_GAIN_f((float *)data, num_samples, gain);
+    case AF_FORMAT_FLOAT: {
+        int done = gain_float_simd(data, num_samples, gain);
+        MUL_GAIN_f((float *)data + done, num_samples - done, gain);
         break;
+    }
     case AF_FORMAT_DOUBLE:
         MUL_GAIN_f((double *)data, num_samples, gain);
         break;
@@ -681,13 +733,24 @@ static void process_plane(struct ao *ao, void *data, int num_samples)
     }
 }
 
+// Return the gain, or a negative value if it's a no-op.
+static float get_gain(struct ao *ao)
+{
+    float gain = atomic_load_explicit(&ao->gain, memory_order_relaxed);
+    return lrint(256.0 * gain) == 256 ? -1 : gain;
+}
+
 void ao_post_process_data(struct ao *ao, void **data, int num_samples)
 {
+    float gain = get_gain(ao);
+    if (gain < 0)
+        return;
     bool planar = af_fmt_is_planar(ao->format);
     int planes = planar ? ao->channels.num : 1;
     int plane_samples = num_samples * (planar ? 1: ao->channels.num);
+    int format = af_fmt_from_planar(ao->format);
     for (int n = 0; n < planes; n++)
-        process_plane(ao, data[n], plane_samples);
+        gain_plane(format, data[n], plane_samples, gain);
 }
 
 static int get_conv_type(struct ao_convert_fmt *fmt)
@@ -721,7 +784,8 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
 #define SHIFT24(x) (((x)+1)*8)
 #endif
 
-static void convert_plane(int type, void *data, int num_samples)
+// gi is the fixed point gain as with MUL_GAIN_i (256 means no change).
+static void convert_plane(int type, void *data, int num_samples, int gi)
 {
     switch (type) {
     case 0:
@@ -730,7 +794,11 @@ static void convert_plane(int type, void *data, int num_samples)
     case 2: {
         int bytes = type == 1 ? 3 : 4;
         for (int s = 0; s < num_samples; s++) {
-            uint32_t val = *((uint32_t *)data + s);
+            int32_t sval = *((int32_t *)data + s);
+            if (gi != 256)
+                sval = MPCLAMP(((int64_t)sval * gi + 128) >> 8,
+                               INT32_MIN, INT32_MAX);
+            uint32_t val = sval;
             uint8_t *ptr = (uint8_t *)data + s * bytes;
             ptr[0] = val >> SHIFT24(0);
             ptr[1] = val >> SHIFT24(1);
@@ -755,5 +823,26 @@ void ao_convert_inplace(struct ao_convert_fmt *fmt, void **data, int num_samples
     int planes = planar ? fmt->channels : 1;
     int plane_samples = num_samples * (planar ? 1: fmt->channels);
     for (int n = 0; n < planes; n++)
-        convert_plane(type, data[n], plane_samples);
+        convert_plane(type, data[n], plane_samples, 256);
+}
+
+// Same as calling ao_post_process_data() and then ao_convert_inplace(), but if
+// possible, apply the gain during conversion, to touch the data only once.
+// fmt->src_fmt and fmt->channels must be the same as the AO parameters.
+void ao_post_process_convert(struct ao *ao, struct ao_convert_fmt *fmt,
+                             void **data, int num_samples)
+{
+    int type = get_conv_type(fmt);
+    if (type == 0 || af_fmt_from_planar(fmt->src_fmt) != AF_FORMAT_S32) {
+        ao_post_process_data(ao, data, num_samples);
+        ao_convert_inplace(fmt, data, num_samples);
+        return;
+    }
+    float gain = get_gain(ao);
+    int gi = gain < 0 ? 256 : lrint(256.0 * gain);
+    bool planar = af_fmt_is_planar(fmt->src_fmt);
+    int planes = planar ? fmt->channels : 1;
+    int plane_samples = num_samples * (planar ? 1: fmt->channels);
+    for (int n = 0; n < planes; n++)
+        convert_plane(type, data[n], plane_samples, gi);
 }
@@ -62,6 +62,7 @@ struct ao_alsa_opts {
     int ignore_chmap;
     int buffer_time;
     int frags;
+    int mmap;
 };
 
 #define OPT_BASE_STRUCT struct ao_alsa_opts
@@ -75,6 +76,7 @@ static const struct m_sub_options ao_alsa_conf = {
         OPT_FLAG("alsa-ignore-chmap", ignore_chmap, 0),
         OPT_INTRANGE("alsa-buffer-time", buffer_time, 0, 0, INT_MAX),
         OPT_INTRANGE("alsa-periods", frags, 0, 0, INT_MAX),
+        OPT_FLAG("alsa-mmap", mmap, 0),
         {0}
     },
     .defaults = &(const struct ao_alsa_opts) {
@@ -98,6 +100,7 @@ struct priv {
     double delay_before_pause;
     snd_pcm_uframes_t buffersize;
     snd_pcm_uframes_t outburst;
+    bool mmap;
 
     snd_output_t *output;
 
@@ -696,14 +699,32 @@ static int init_device(struct ao *ao, int mode)
     }
     dump_hw_params(ao, "HW params after rate:\n", alsa_hwparams);
 
-    snd_pcm_access_t access = af_fmt_is_planar(ao->format)
-                                    ? SND_PCM_ACCESS_RW_NONINTERLEAVED
-                                    : SND_PCM_ACCESS_RW_INTERLEAVED;
-    err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
-    if (err < 0 && af_fmt_is_planar(ao->format)) {
-        ao->format = af_fmt_from_planar(ao->format);
-        access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    err = -1;
+    if (p->opts->mmap) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                        ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                        : SND_PCM_ACCESS_MMAP_INTERLEAVED;
         err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+            if (err >= 0)
+                ao->format = af_fmt_from_planar(ao->format);
+        }
+        p->mmap = err >= 0;
+        if (!p->mmap)
+            MP_WARN(ao, "Device does not support mmap access.\n");
+    }
+    if (err < 0) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                        ? SND_PCM_ACCESS_RW_NONINTERLEAVED
+                                        : SND_PCM_ACCESS_RW_INTERLEAVED;
+        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            ao->format = af_fmt_from_planar(ao->format);
+            access = SND_PCM_ACCESS_RW_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        }
     }
     CHECK_ALSA_ERROR("Unable to set access type");
     dump_hw_params(ao, "HW params after access:\n", alsa_hwparams);
@@ -867,6 +888,7 @@ static int init_device(struct ao *ao, int mode)
     MP_VERBOSE(ao, "hw pausing supported: %s\n", p->can_pause ? "yes" : "no");
     MP_VERBOSE(ao, "buffersize: %d samples\n", (int)p->buffersize);
     MP_VERBOSE(ao, "period size: %d samples\n", (int)p->outburst);
+    MP_VERBOSE(ao, "mmap access: %s\n", p->mmap ? "yes" : "no");
 
     ao->device_buffer = p->buffersize;
     ao->period_size = p->outburst;
@@ -1102,6 +1124,67 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Copy the (already converted) samples directly into the device's ring
+// buffer. Returns the number of samples written, or an ALSA error code if none
+// could be written.
+static snd_pcm_sframes_t write_mmap(struct ao *ao, void **data, int samples)
+{
+    struct priv *p = ao->priv;
+    bool planar = af_fmt_is_planar(ao->format);
+    int sample_bytes = p->convert.dst_bits / 8;
+    if (!planar)
+        sample_bytes *= ao->channels.num;
+    int planes = planar ? ao->channels.num : 1;
+    int written = 0;
+
+    while (written < samples) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+        if (avail < 0)
+            return written ? written : avail;
+        if (avail == 0) {
+            if (written)
+                break;
+            int err = snd_pcm_wait(p->alsa, 1000);
+            if (err < 0)
+                return err;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = MPMIN(avail, samples - written);
+        int err = snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames);
+        if (err < 0)
+            return written ? written : err;
+
+        for (int n = 0; n < planes; n++) {
+            const snd_pcm_channel_area_t *a = &areas[n];
+            uint8_t *dst = (uint8_t *)a->addr;
+            dst += (a->first + offset * a->step) / 8;
+            memcpy(dst, (uint8_t *)data[n] + written * sample_bytes,
+                   frames * sample_bytes);
+        }
+
+        snd_pcm_sframes_t r = snd_pcm_mmap_commit(p->alsa, offset, frames);
+        if (r < 0)
+            return written ? written : r;
+        written += r;
+        if (r != (snd_pcm_sframes_t)frames)
+            break;
+    }
+
+    // Unlike snd_pcm_writei(), mmap writes don't start the device
+    // automatically once the start threshold is reached.
+    if (snd_pcm_state(p->alsa) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+        if (avail >= 0 && (snd_pcm_sframes_t)(p->buffersize - avail) >=
+                          (snd_pcm_sframes_t)p->outburst)
+            snd_pcm_start(p->alsa);
+    }
+
+    return written;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1114,7 +1197,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     ao_convert_inplace(&p->convert, data, samples);
 
     do {
-        if (af_fmt_is_planar(ao->format)) {
+        if (p->mmap) {
+            res = write_mmap(ao, data, samples);
+        } else if (af_fmt_is_planar(ao->format)) {
             res = snd_pcm_writen(p->alsa, data, samples);
         } else {
             res = snd_pcm_writei(p->alsa, data[0], samples);
@@ -138,6 +138,24 @@ coreaudio_error:
     return false;
 }
 
+// Request the smallest IO buffer the device supports (--audio-low-latency).
+// Note that this affects all users of the device.
+static void set_min_buffer_frame_size(struct ao *ao)
+{
+    struct priv *p = ao->priv;
+    AudioValueRange range;
+    OSStatus err = CA_GET(p->device, kAudioDevicePropertyBufferFrameSizeRange,
+                          &range);
+    CHECK_CA_WARN("could not get buffer frame size range");
+    if (err != noErr)
+        return;
+    uint32_t frames = range.mMinimum;
+    err = CA_SET(p->device, kAudioDevicePropertyBufferFrameSize, &frames);
+    CHECK_CA_WARN("could not set buffer frame size");
+    if (err == noErr)
+        MP_VERBOSE(ao, "Using buffer frame size of %u.\n", (unsigned)frames);
+}
+
 static int init(struct ao *ao)
 {
     struct priv *p = ao->priv;
@@ -157,6 +175,9 @@ static int init(struct ao *ao)
     if (!ca_init_chmap(ao, p->device))
         goto coreaudio_error;
 
+    if (ao->low_latency)
+        set_min_buffer_frame_size(ao);
+
     AudioStreamBasicDescription asbd;
     ca_fill_asbd(ao, &asbd);
 
@@ -287,6 +287,31 @@ static double get_delay(struct ao *ao)
     return p->delay / (double)p->par.rate;
 }
 
+/*
+ * wait until the device accepts more data (or until woken up)
+ */
+static int audio_wait(struct ao *ao, pthread_mutex_t *lock)
+{
+    struct priv *p = ao->priv;
+
+    while (1) {
+        int n = sio_pollfd(p->hdl, p->pfd, POLLOUT);
+        if (n <= 0)
+            return -1;
+        int r = ao_wait_poll(ao, p->pfd, n, lock);
+        if (r)
+            return r;
+        // Also makes libsndio call movecb().
+        int revents = sio_revents(p->hdl, p->pfd);
+        if (revents & POLLHUP) {
+            MP_ERR(ao, "device disconnected\n");
+            return -1;
+        }
+        if (revents & POLLOUT)
+            return 0;
+    }
+}
+
 /*
  * stop playing, keep buffers (for pause)
  */
@@ -317,5 +342,7 @@ const struct ao_driver audio_out_sndio = {
     .pause     = audio_pause,
     .resume    = audio_resume,
     .reset     = reset,
+    .wait      = audio_wait,
+    .wakeup    = ao_wakeup_poll,
     .priv_size = sizeof(struct priv),
 };
@@ -583,14 +583,19 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
     struct wasapi_state *state = ao->priv;
 
     MP_DBG(state, "IAudioClient::GetDevicePeriod\n");
-    REFERENCE_TIME devicePeriod;
+    REFERENCE_TIME devicePeriod, minPeriod;
     HRESULT hr = IAudioClient_GetDevicePeriod(state->pAudioClient,&devicePeriod,
-                                              NULL);
-    MP_VERBOSE(state, "Device period: %.2g ms\n",
-               (double) devicePeriod / 10000.0 );
+                                              &minPeriod);
+    MP_VERBOSE(state, "Device period: %.2g ms (minimum %.2g ms)\n",
+               (double) devicePeriod / 10000.0, (double) minPeriod / 10000.0);
 
     REFERENCE_TIME bufferDuration = devicePeriod;
-    if (state->share_mode == AUDCLNT_SHAREMODE_SHARED) {
+    if (ao->low_latency) {
+        // the engine period can't be changed in shared mode, but use a
+        // single period as buffer (instead of ~50ms)
+        if (state->share_mode == AUDCLNT_SHAREMODE_EXCLUSIVE && minPeriod > 0)
+            bufferDuration = minPeriod;
+    } else if (state->share_mode == AUDCLNT_SHAREMODE_SHARED) {
         // for shared mode, use integer multiple of device period close to 50ms
         bufferDuration = devicePeriod * ceil(50.0 * 10000.0 / devicePeriod);
     }
@@ -0,0 +1,146 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AO_GAIN_SIMD_H
+#define MP_AO_GAIN_SIMD_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Vectorized versions of the software gain in ao.c. Each function processes
+// a multiple of its vector width, and returns the number of samples done; the
+// caller handles the rest. The x86 variants must be selected at runtime.
+// The results are the same as with the scalar code (except for NaN input).
+
+#if HAVE_SSE4_INTRINSICS
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+static inline int gain_float_sse2(float *d, int num, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    int n = 0;
+    for (; n + 4 <= num; n += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(d + n), g);
+        _mm_storeu_ps(d + n, _mm_max_ps(_mm_min_ps(x, hi), lo));
+    }
+    return n;
+}
+
+// gain is the 8.8 fixed point gain; must be within int16_t range.
+static inline int gain_s16_sse2(int16_t *d, int num, int gain)
+{
+    // madd of the interleaved (x, 1) pairs with (gain, 128) gives
+    // x * gain + 128 as 32 bit values; packs saturates back to int16.
+    __m128i g = _mm_set1_epi32((128 << 16) | (uint16_t)gain);
+    __m128i one = _mm_set1_epi16(1);
+    int n = 0;
+    for (; n + 8 <= num; n += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(d + n));
+        __m128i l = _mm_madd_epi16(_mm_unpacklo_epi16(x, one), g);
+        __m128i h = _mm_madd_epi16(_mm_unpackhi_epi16(x, one), g);
+        l = _mm_srai_epi32(l, 8);
+        h = _mm_srai_epi32(h, 8);
+        _mm_storeu_si128((__m128i *)(d + n), _mm_packs_epi32(l, h));
+    }
+    return n;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline int gain_float_avx2(float *d, int num, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+    int n = 0;
+    for (; n + 16 <= num; n += 16) {
+        __m256 x0 = _mm256_mul_ps(_mm256_loadu_ps(d + n), g);
+        __m256 x1 = _mm256_mul_ps(_mm256_loadu_ps(d + n + 8), g);
+        _mm256_storeu_ps(d + n, _mm256_max_ps(_mm256_min_ps(x0, hi), lo));
+        _mm256_storeu_ps(d + n + 8, _mm256_max_ps(_mm256_min_ps(x1, hi), lo));
+    }
+    return n;
+}
+
+static inline int gain_s16_avx2(int16_t *d, int num, int gain)
+{
+    __m256i g = _mm256_set1_epi32((128 << 16) | (uint16_t)gain);
+    __m256i one = _mm256_set1_epi16(1);
+    int n = 0;
+    for (; n + 16 <= num; n += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(d + n));
+        // Unpack and pack both work within 128 bit lanes, so the sample
+        // order is preserved.
+        __m256i l = _mm256_madd_epi16(_mm256_unpacklo_epi16(x, one), g);
+        __m256i h = _mm256_madd_epi16(_mm256_unpackhi_epi16(x, one), g);
+        l = _mm256_srai_epi32(l, 8);
+        h = _mm256_srai_epi32(h, 8);
+        _mm256_storeu_si256((__m256i *)(d + n), _mm256_packs_epi32(l, h));
+    }
+    _mm256_zeroupper();
+    return n;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+#if HAVE_NEON_INTRINSICS
+
+#include <arm_neon.h>
+
+static inline int gain_float_neon(float *d, int num, float gain)
+{
+    float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+    int n = 0;
+    for (; n + 4 <= num; n += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(d + n), gain);
+        vst1q_f32(d + n, vmaxq_f32(vminq_f32(x, hi), lo));
+    }
+    return n;
+}
+
+static inline int gain_s16_neon(int16_t *d, int num, int gain)
+{
+    int32x4_t round = vdupq_n_s32(128);
+    int n = 0;
+    for (; n + 8 <= num; n += 8) {
+        int16x8_t x = vld1q_s16(d + n);
+        int32x4_t l = vmlal_n_s16(round, vget_low_s16(x), gain);
+        int32x4_t h = vmlal_n_s16(round, vget_high_s16(x), gain);
+        // Arithmetic shift, then saturating narrow.
+        vst1q_s16(d + n, vcombine_s16(vqmovn_s32(vshrq_n_s32(l, 8)),
+                                      vqmovn_s32(vshrq_n_s32(h, 8))));
+    }
+    return n;
+}
+
+#endif
+
+#endif
@@ -75,9 +75,16 @@ struct ao {
 
     int buffer;
     double def_buffer;
+
+    // --audio-low-latency: drivers should use the smallest period the device
+    // supports, and the soft buffer is limited to AO_LOW_LATENCY_BUFFER.
+    bool low_latency;
     void *api_priv;
 };
 
+// Maximum soft buffer with --audio-low-latency, in seconds.
+#define AO_LOW_LATENCY_BUFFER 0.005
+
 extern const struct ao_driver ao_api_push;
 extern const struct ao_driver ao_api_pull;
 
@@ -232,6 +239,8 @@ struct ao_convert_fmt {
 bool ao_can_convert_inplace(struct ao_convert_fmt *fmt);
 bool ao_need_conversion(struct ao_convert_fmt *fmt);
 void ao_convert_inplace(struct ao_convert_fmt *fmt, void **data, int num_samples);
+void ao_post_process_convert(struct ao *ao, struct ao_convert_fmt *fmt,
+                             void **data, int num_samples);
 
 int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
                            void **data, int samples, int64_t out_time_us);
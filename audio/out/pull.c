@@ -126,15 +126,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     return write_samples;
 }
 
-// Read the given amount of samples in the user-provided data buffer. Returns
-// the number of samples copied. If there is not enough data (buffer underrun
-// or EOF), return the number of samples that could be copied, and fill the
-// rest of the user-provided buffer with silence.
-// This basically assumes that the audio device doesn't care about underruns.
-// If this is called in paused mode, it will always return 0.
-// The caller should set out_time_us to the expected delay until the last sample
-// reaches the speakers, in microseconds, using mp_time_us() as reference.
-int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+// If fmt is set, convert the data as with ao_read_data_converted().
+static int read_data(struct ao *ao, void **data, int samples,
+                     int64_t out_time_us, struct ao_convert_fmt *fmt)
 {
     assert(ao->api == &ao_api_pull);
 
@@ -179,11 +173,28 @@ end:
     for (int n = 0; n < ao->num_planes; n++)
         af_fill_silence((char *)data[n] + bytes, full_bytes - bytes, ao->format);
 
-    ao_post_process_data(ao, data, samples);
+    if (fmt) {
+        ao_post_process_convert(ao, fmt, data, samples);
+    } else {
+        ao_post_process_data(ao, data, samples);
+    }
 
     return bytes / ao->sstride;
 }
 
+// Read the given amount of samples in the user-provided data buffer. Returns
+// the number of samples copied. If there is not enough data (buffer underrun
+// or EOF), return the number of samples that could be copied, and fill the
+// rest of the user-provided buffer with silence.
+// This basically assumes that the audio device doesn't care about underruns.
+// If this is called in paused mode, it will always return 0.
+// The caller should set out_time_us to the expected delay until the last sample
+// reaches the speakers, in microseconds, using mp_time_us() as reference.
+int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+{
+    return read_data(ao, data, samples, out_time_us, NULL);
+}
+
 // Same as ao_read_data(), but convert data according to *fmt.
 // fmt->src_fmt and fmt->channels must be the same as the AO parameters.
 int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
@@ -215,9 +226,8 @@ int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
     for (int n = 0; n < planes; n++)
         ndata[n] = p->convert_buffer + n * src_plane_size;
 
-    int res = ao_read_data(ao, ndata, samples, out_time_us);
+    int res = read_data(ao, ndata, samples, out_time_us, fmt);
 
-    ao_convert_inplace(fmt, ndata, samples);
     for (int n = 0; n < planes; n++)
         memcpy(data[n], ndata[n], dst_plane_size);
 
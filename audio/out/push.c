@@ -30,8 +30,10 @@
 
 #include "common/msg.h"
 #include "common/common.h"
+#include "common/trace.h"
 
 #include "input/input.h"
+#include "misc/thread_sched.h"
 
 #include "osdep/threads.h"
 #include "osdep/timer.h"
@@ -282,6 +284,7 @@ static bool realloc_silence(struct ao *ao, int samples)
 static void ao_play_data(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
+    int64_t trace = mp_trace_begin();
     int space = ao->driver->get_space(ao);
     bool play_silence = p->paused || (ao->stream_silence && !p->still_playing);
     space = MPMAX(space, 0);
@@ -349,6 +352,7 @@ static void ao_play_data(struct ao *ao)
         ao->wakeup_cb(ao->wakeup_ctx); // request more data
     MP_TRACE(ao, "in=%d flags=%d space=%d r=%d wa/pl=%d/%d needed=%d more=%d\n",
              max, flags, space, r, p->wait_on_ao, p->still_playing, needed, more);
+    mp_trace_end("ao_play_data", trace);
 }
 
 static void *playthread(void *arg)
@@ -356,6 +360,7 @@ static void *playthread(void *arg)
     struct ao *ao = arg;
     struct ao_push_state *p = ao->api_priv;
     mpthread_set_name("ao");
+    mp_thread_sched_apply(ao->global, ao->log, "ao");
     pthread_mutex_lock(&p->lock);
     while (!p->terminate) {
         bool blocked = ao->driver->initially_blocked && !p->initial_unblocked;
@@ -468,6 +473,11 @@ static int init(struct ao *ao)
     mp_audio_buffer_reinit_fmt(p->buffer, ao->format,
                                &ao->channels, ao->samplerate);
     mp_audio_buffer_preallocate_min(p->buffer, ao->buffer);
+    if (mp_thread_sched_mlock_audio(ao->global) &&
+        !mp_audio_buffer_lock_memory(p->buffer))
+    {
+        MP_WARN(ao, "Could not lock audio buffer memory.\n");
+    }
     if (pthread_create(&p->thread, NULL, playthread, ao))
         goto err;
     return 0;
@@ -38,6 +38,10 @@ struct encode_opts {
     char **vopts;
     char *acodec;
     char **aopts;
+    char *hwdevice;
+    char **vrenditions;
+    int vthreads;
+    int vthread_type;
     float voffset;
     float aoffset;
     int rawts;
@@ -48,6 +52,21 @@ struct encode_opts {
     char **remove_metadata;
 };
 
+struct encode_stream_stats {
+    char name[80];
+    int64_t frames;             // frames passed to the encoder
+    double encode_time;         // total time spent in the encoder (seconds)
+    double last_encode_time;    // time for the last frame
+    double peak_encode_time;    // maximum time for a frame
+    int queue_depth;            // frames waiting for the encoder thread
+};
+
+struct encode_stats {
+    double time;                // seconds since the muxer was opened
+    struct encode_stream_stats *streams;
+    int num_streams;
+};
+
 // interface for player core
 struct encode_lavc_context *encode_lavc_init(struct mpv_global *global);
 bool encode_lavc_free(struct encode_lavc_context *ctx);
@@ -62,5 +81,7 @@ void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
                               struct mp_tags *metadata);
 void encode_lavc_set_audio_pts(struct encode_lavc_context *ctx, double pts);
 bool encode_lavc_didfail(struct encode_lavc_context *ctx); // check if encoding failed
+bool encode_lavc_get_stats(struct encode_lavc_context *ctx, void *ta_parent,
+                           struct encode_stats *stats);
 
 #endif
@@ -65,6 +65,7 @@ struct encode_priv {
 
 struct mux_stream {
     int index;                      // index of this into p->streams[]
+    int rendition;                  // encoder_context.rendition
     char name[80];
     struct encode_lavc_context *ctx;
     enum AVMediaType codec_type;
@@ -72,6 +73,13 @@ struct mux_stream {
     AVStream *st;
     void (*on_ready)(void *ctx);    // when finishing muxer init
     void *on_ready_ctx;
+
+    // Statistics
+    int64_t frames;
+    int64_t encode_time;            // in us
+    int64_t last_encode_time;
+    int64_t peak_encode_time;
+    int queue_depth;
 };
 
 #define OPT_BASE_STRUCT struct encode_opts
@@ -84,6 +92,13 @@ const struct m_sub_options encode_config = {
         OPT_KEYVALUELIST("ovcopts", vopts, M_OPT_FIXED | M_OPT_HAVE_HELP),
         OPT_STRING("oac", acodec, M_OPT_FIXED),
         OPT_KEYVALUELIST("oacopts", aopts, M_OPT_FIXED | M_OPT_HAVE_HELP),
+        OPT_STRING("ohwdevice", hwdevice, M_OPT_FIXED),
+        OPT_STRINGLIST("ovrenditions", vrenditions, M_OPT_FIXED),
+        OPT_INTRANGE("ovthreads", vthreads, M_OPT_FIXED, 0, 256),
+        OPT_CHOICE("ovthread-type", vthread_type, M_OPT_FIXED,
+                   ({"auto", FF_THREAD_FRAME | FF_THREAD_SLICE},
+                    {"frame", FF_THREAD_FRAME},
+                    {"slice", FF_THREAD_SLICE})),
         OPT_FLOATRANGE("ovoffset", voffset, M_OPT_FIXED, -1000000.0, 1000000.0,
                        .deprecation_message = "--audio-delay (once unbroken)"),
         OPT_FLOATRANGE("oaoffset", aoffset, M_OPT_FIXED, -1000000.0, 1000000.0,
@@ -108,6 +123,7 @@ const struct m_sub_options encode_config = {
     .size = sizeof(struct encode_opts),
     .defaults = &(const struct encode_opts){
         .copy_metadata = 1,
+        .vthread_type = FF_THREAD_FRAME | FF_THREAD_SLICE,
     },
 };
 
@@ -321,19 +337,28 @@ failed:
 
 // called locked
 static struct mux_stream *find_mux_stream(struct encode_lavc_context *ctx,
-                                          enum AVMediaType codec_type)
+                                          enum AVMediaType codec_type,
+                                          int rendition)
 {
     struct encode_priv *p = ctx->priv;
 
     for (int n = 0; n < p->num_streams; n++) {
         struct mux_stream *s = p->streams[n];
-        if (s->codec_type == codec_type)
+        if (s->codec_type == codec_type && s->rendition == rendition)
             return s;
     }
 
     return NULL;
 }
 
+int encode_lavc_num_video_streams(struct encode_opts *opts)
+{
+    int num = 1;
+    for (int n = 0; opts->vrenditions && opts->vrenditions[n]; n++)
+        num++;
+    return num;
+}
+
 void encode_lavc_expect_stream(struct encode_lavc_context *ctx,
                                enum stream_type type)
 {
@@ -344,7 +369,7 @@ void encode_lavc_expect_stream(struct encode_lavc_context *ctx,
     enum AVMediaType codec_type = mp_to_av_stream_type(type);
 
     // These calls are idempotent.
-    if (find_mux_stream(ctx, codec_type))
+    if (find_mux_stream(ctx, codec_type, 0))
         goto done;
 
     if (p->header_written) {
@@ -353,14 +378,25 @@ void encode_lavc_expect_stream(struct encode_lavc_context *ctx,
         goto done;
     }
 
-    struct mux_stream *dst = talloc_ptrtype(p, dst);
-    *dst = (struct mux_stream){
-        .index = p->num_streams,
-        .ctx = ctx,
-        .codec_type = mp_to_av_stream_type(type),
-    };
-    snprintf(dst->name, sizeof(dst->name), "%s", stream_type_name(type));
-    MP_TARRAY_APPEND(p, p->streams, p->num_streams, dst);
+    // Each video rendition is a separate stream in the same muxer.
+    int num = type == STREAM_VIDEO ? encode_lavc_num_video_streams(ctx->options)
+                                   : 1;
+    for (int n = 0; n < num; n++) {
+        struct mux_stream *dst = talloc_ptrtype(p, dst);
+        *dst = (struct mux_stream){
+            .index = p->num_streams,
+            .rendition = n,
+            .ctx = ctx,
+            .codec_type = codec_type,
+        };
+        if (n) {
+            snprintf(dst->name, sizeof(dst->name), "%s (rendition %d)",
+                     stream_type_name(type), n);
+        } else {
+            snprintf(dst->name, sizeof(dst->name), "%s", stream_type_name(type));
+        }
+        MP_TARRAY_APPEND(p, p->streams, p->num_streams, dst);
+    }
 
 done:
     pthread_mutex_unlock(&ctx->lock);
@@ -377,15 +413,17 @@ void encode_lavc_stream_eof(struct encode_lavc_context *ctx,
     pthread_mutex_lock(&ctx->lock);
 
     enum AVMediaType codec_type = mp_to_av_stream_type(type);
-    struct mux_stream *dst = find_mux_stream(ctx, codec_type);
 
     // If we've reached EOF, even though the stream was selected, and we didn't
     // ever initialize it, we have a problem. We could mux some sort of dummy
     // stream (and could fail if actual data arrives later), or we bail out
     // early.
-    if (dst && !dst->st) {
-        MP_ERR(p, "No data on stream %s.\n", dst->name);
-        p->failed = true;
+    for (int n = 0; n < p->num_streams; n++) {
+        struct mux_stream *dst = p->streams[n];
+        if (dst->codec_type == codec_type && !dst->st) {
+            MP_ERR(p, "No data on stream %s.\n", dst->name);
+            p->failed = true;
+        }
     }
 
     pthread_mutex_unlock(&ctx->lock);
@@ -396,6 +434,7 @@ void encode_lavc_stream_eof(struct encode_lavc_context *ctx,
 // Can be called only once per stream. info is copied by callee as needed.
 static struct mux_stream *encode_lavc_add_stream(struct encode_lavc_context *ctx,
                                                  struct encoder_stream_info *info,
+                                                 int rendition,
                                                  void (*on_ready)(void *ctx),
                                                  void *on_ready_ctx)
 {
@@ -403,7 +442,8 @@ static struct mux_stream *encode_lavc_add_stream(struct encode_lavc_context *ctx
 
     pthread_mutex_lock(&ctx->lock);
 
-    struct mux_stream *dst = find_mux_stream(ctx, info->codecpar->codec_type);
+    struct mux_stream *dst = find_mux_stream(ctx, info->codecpar->codec_type,
+                                             rendition);
     if (!dst) {
         MP_ERR(p, "Cannot add a stream at runtime.\n");
         p->failed = true;
@@ -463,7 +503,8 @@ static void encode_lavc_add_packet(struct mux_stream *dst, AVPacket *pkt)
     switch (dst->st->codecpar->codec_type) {
     case AVMEDIA_TYPE_VIDEO:
         p->vbytes += pkt->size;
-        p->frames += 1;
+        if (!dst->rendition)
+            p->frames += 1;
         break;
     case AVMEDIA_TYPE_AUDIO:
         p->abytes += pkt->size;
@@ -755,6 +796,39 @@ bool encode_lavc_didfail(struct encode_lavc_context *ctx)
     return fail;
 }
 
+bool encode_lavc_get_stats(struct encode_lavc_context *ctx, void *ta_parent,
+                           struct encode_stats *stats)
+{
+    *stats = (struct encode_stats){0};
+    if (!ctx)
+        return false;
+
+    struct encode_priv *p = ctx->priv;
+
+    pthread_mutex_lock(&ctx->lock);
+
+    if (p->header_written)
+        stats->time = mp_time_sec() - p->t0;
+
+    stats->streams = talloc_array(ta_parent, struct encode_stream_stats,
+                                  p->num_streams);
+    for (int n = 0; n < p->num_streams; n++) {
+        struct mux_stream *s = p->streams[n];
+        stats->streams[stats->num_streams++] = (struct encode_stream_stats){
+            .frames = s->frames,
+            .encode_time = s->encode_time / 1e6,
+            .last_encode_time = s->last_encode_time / 1e6,
+            .peak_encode_time = s->peak_encode_time / 1e6,
+            .queue_depth = s->queue_depth,
+        };
+        snprintf(stats->streams[n].name, sizeof(stats->streams[n].name), "%s",
+                 s->name);
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+    return true;
+}
+
 static void encoder_destroy(void *ptr)
 {
     struct encoder_context *p = ptr;
@@ -822,6 +896,11 @@ static void encoder_2pass_prepare(struct encoder_context *p)
     char *filename = talloc_asprintf(NULL, "%s-%s-pass1.log",
                                      p->options->file,
                                      stream_type_name(p->type));
+    if (p->rendition) {
+        talloc_free(filename);
+        filename = talloc_asprintf(NULL, "%s-%s%d-pass1.log", p->options->file,
+                                   stream_type_name(p->type), p->rendition);
+    }
 
     if (p->encoder->flags & AV_CODEC_FLAG_PASS2) {
         MP_INFO(p, "Reading 2-pass log: %s\n", filename);
@@ -864,8 +943,14 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
         ? p->options->vopts
         : p->options->aopts;
 
+    if (p->type == STREAM_VIDEO) {
+        p->encoder->thread_count = p->options->vthreads;
+        p->encoder->thread_type = p->options->vthread_type;
+    }
+
     // Set these now, so the code below can read back parsed settings from it.
     mp_set_avopts(p->log, p->encoder, copts);
+    mp_set_avopts(p->log, p->encoder, p->extra_opts);
 
     encoder_2pass_prepare(p);
 
@@ -910,7 +995,7 @@ bool encoder_init_codec_and_muxer(struct encoder_context *p,
         goto fail;
 
     p->mux_stream = encode_lavc_add_stream(p->encode_lavc_ctx, &p->info,
-                                           on_ready, ctx);
+                                           p->rendition, on_ready, ctx);
     if (!p->mux_stream)
         goto fail;
 
@@ -921,9 +1006,41 @@ fail:
     return false;
 }
 
+static void encoder_update_stats(struct encoder_context *p, int64_t time)
+{
+    struct mux_stream *s = p->mux_stream;
+    if (!s)
+        return;
+
+    struct encode_lavc_context *ctx = p->encode_lavc_ctx;
+    pthread_mutex_lock(&ctx->lock);
+    s->frames += 1;
+    s->encode_time += time;
+    s->last_encode_time = time;
+    s->peak_encode_time = MPMAX(s->peak_encode_time, time);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void encoder_set_queue_depth(struct encoder_context *p, int depth)
+{
+    struct mux_stream *s = p->mux_stream;
+    if (!s)
+        return;
+
+    struct encode_lavc_context *ctx = p->encode_lavc_ctx;
+    pthread_mutex_lock(&ctx->lock);
+    s->queue_depth = depth;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 bool encoder_encode(struct encoder_context *p, AVFrame *frame)
 {
+    // Time spent in the encoder (excluding muxing).
+    int64_t encode_time = 0;
+
+    int64_t t0 = mp_time_us();
     int status = avcodec_send_frame(p->encoder, frame);
+    encode_time += mp_time_us() - t0;
     if (status < 0) {
         if (frame && status == AVERROR_EOF)
             MP_ERR(p, "new data after sending EOF to encoder\n");
@@ -934,7 +1051,9 @@ bool encoder_encode(struct encoder_context *p, AVFrame *frame)
         AVPacket packet = {0};
         av_init_packet(&packet);
 
+        t0 = mp_time_us();
         status = avcodec_receive_packet(p->encoder, &packet);
+        encode_time += mp_time_us() - t0;
         if (status == AVERROR(EAGAIN))
             break;
         if (status < 0 && status != AVERROR_EOF)
@@ -951,6 +1070,9 @@ bool encoder_encode(struct encoder_context *p, AVFrame *frame)
         encode_lavc_add_packet(p->mux_stream, &packet);
     }
 
+    if (frame)
+        encoder_update_stats(p, encode_time);
+
     return true;
 
 fail:
@@ -83,6 +83,10 @@ struct encoder_context {
     struct encode_lavc_context *encode_lavc_ctx;
 
     enum stream_type type;
+    // 0 for the main video stream, or N for the Nth --ovrenditions entry.
+    int rendition;
+    // AVOptions applied after --ovcopts/--oacopts (key/value list, or NULL).
+    char **extra_opts;
 
     // (different access restrictions before/after encoder init)
     struct encoder_stream_info info;
@@ -113,4 +117,10 @@ bool encoder_encode(struct encoder_context *p, AVFrame *frame);
 
 double encoder_get_offset(struct encoder_context *p);
 
+// Report the number of frames queued for the encoder (for statistics).
+void encoder_set_queue_depth(struct encoder_context *p, int depth);
+
+// Number of video streams encoded from the same input (1 + --ovrenditions).
+int encode_lavc_num_video_streams(struct encode_opts *opts);
+
 #endif
@@ -36,6 +36,7 @@
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
@@ -63,22 +64,33 @@ struct mp_log_root {
     FILE *stats_file;
     char *log_path;
     char *stats_path;
-    // --- must be accessed atomically
-    /* This is incremented every time the msglevels must be reloaded.
-     * (This is perhaps better than maintaining a globally accessible and
-     * synchronized mp_log tree.) */
-    atomic_ulong reload_counter;
-    // --- protected by mp_msg_lock
+    // All mp_log instances, so that their levels can be updated when the
+    // options change, instead of checking for changes on every log call.
+    struct mp_log **logs;
+    int num_logs;
+    int extra_level;    // minimum level needed by buffers and files
     bstr buffer;
+    // --- log file writer thread (started only if log_file is set)
+    pthread_t log_file_thread;
+    pthread_mutex_t log_file_lock;
+    pthread_cond_t log_file_wakeup;
+    // --- protected by log_file_lock
+    bstr log_file_buffer;       // formatted lines not written yet
+    bstr log_file_spare;        // reused as log_file_buffer after writing
+    bool log_file_terminate;
 };
 
+// Block loggers if the log file writer falls behind by this much.
+#define MAX_LOG_FILE_BACKLOG (4 * 1024 * 1024)
+
 struct mp_log {
     struct mp_log_root *root;
     const char *prefix;
     const char *verbose_prefix;
-    int level;                  // minimum log level for any outputs
+    atomic_int level;           // minimum log level for any outputs
+    // --- protected by mp_msg_lock
     int terminal_level;         // minimum log level for terminal output
-    atomic_ulong reload_counter;
+    int index;                  // in root->logs[]
     char *partial;
 };
 
@@ -93,7 +105,7 @@ struct mp_log_buffer {
 // Protects some (not all) state in mp_log_root
 static pthread_mutex_t mp_msg_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static const struct mp_log null_log = {0};
+static const struct mp_log null_log = {.level = ATOMIC_VAR_INIT(-1)};
 struct mp_log *const mp_null_log = (struct mp_log *)&null_log;
 
 static bool match_mod(const char *name, const char *mod)
@@ -105,41 +117,46 @@ static bool match_mod(const char *name, const char *mod)
     return bstr_eatstart0(&b, mod) && (bstr_eatstart0(&b, "/") || !b.len);
 }
 
-static void update_loglevel(struct mp_log *log)
+// Must be called with mp_msg_lock held. If msg_levels is set, the terminal
+// level is derived from the options again (which requires string matching).
+static void update_loglevel(struct mp_log *log, bool msg_levels)
 {
     struct mp_log_root *root = log->root;
-    pthread_mutex_lock(&mp_msg_lock);
-    log->level = MSGL_STATUS + root->verbose; // default log level
-    if (root->really_quiet)
-        log->level -= 10;
-    for (int n = 0; root->msg_levels && root->msg_levels[n * 2 + 0]; n++) {
-        if (match_mod(log->verbose_prefix, root->msg_levels[n * 2 + 0]))
-            log->level = mp_msg_find_level(root->msg_levels[n * 2 + 1]);
+    if (msg_levels) {
+        int level = MSGL_STATUS + root->verbose; // default log level
+        if (root->really_quiet)
+            level -= 10;
+        for (int n = 0; root->msg_levels && root->msg_levels[n * 2 + 0]; n++) {
+            if (match_mod(log->verbose_prefix, root->msg_levels[n * 2 + 0]))
+                level = mp_msg_find_level(root->msg_levels[n * 2 + 1]);
+        }
+        log->terminal_level = level;
     }
-    log->terminal_level = log->level;
-    for (int n = 0; n < log->root->num_buffers; n++)
-        log->level = MPMAX(log->level, log->root->buffers[n]->level);
-    if (log->root->log_file)
-        log->level = MPMAX(log->level, MSGL_DEBUG);
-    if (log->root->stats_file)
-        log->level = MPMAX(log->level, MSGL_STATS);
-    atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
-    pthread_mutex_unlock(&mp_msg_lock);
+    atomic_store(&log->level, MPMAX(log->terminal_level, root->extra_level));
+}
+
+// Must be called with mp_msg_lock held, after the options, the log buffers,
+// or the log files changed.
+static void update_all_loglevels(struct mp_log_root *root, bool msg_levels)
+{
+    root->extra_level = -1;
+    for (int n = 0; n < root->num_buffers; n++)
+        root->extra_level = MPMAX(root->extra_level, root->buffers[n]->level);
+    if (root->log_file)
+        root->extra_level = MPMAX(root->extra_level, MSGL_DEBUG);
+    if (root->stats_file)
+        root->extra_level = MPMAX(root->extra_level, MSGL_STATS);
+    for (int n = 0; n < root->num_logs; n++)
+        update_loglevel(root->logs[n], msg_levels);
 }
 
 // Return whether the message at this verbosity level would be actually printed.
 // Thread-safety: see mp_msg().
 bool mp_msg_test(struct mp_log *log, int lev)
 {
-    struct mp_log_root *root = log->root;
-    if (!root)
-        return false;
-    if (atomic_load_explicit(&log->reload_counter, memory_order_relaxed) !=
-        atomic_load_explicit(&root->reload_counter, memory_order_relaxed))
-    {
-        update_loglevel(log);
-    }
-    return lev <= log->level;
+    // The level is kept up to date by update_all_loglevels(), and is -1 for
+    // null logs.
+    return lev <= atomic_load_explicit(&log->level, memory_order_relaxed);
 }
 
 // Reposition cursor and clear lines for outputting the status line. In certain
@@ -288,11 +305,72 @@ static void write_log_file(struct mp_log *log, int lev, char *text)
     if (!root->log_file || lev > MPMAX(MSGL_DEBUG, log->terminal_level))
         return;
 
-    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
-    fflush(root->log_file);
+    pthread_mutex_lock(&root->log_file_lock);
+    while (root->log_file_buffer.len > MAX_LOG_FILE_BACKLOG)
+        pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+    bstr_xappend_asprintf(root, &root->log_file_buffer, "[%8.3f][%c][%s] %s",
+                          (mp_time_us() - MP_START_TIME) / 1e6,
+                          mp_log_levels[lev][0],
+                          log->verbose_prefix, text);
+    pthread_cond_broadcast(&root->log_file_wakeup);
+    pthread_mutex_unlock(&root->log_file_lock);
+}
+
+// Writes the log file, so that threads which log don't wait on disk I/O.
+static void *log_file_thread(void *p)
+{
+    struct mp_log_root *root = p;
+
+    mpthread_set_name("log-file");
+
+    pthread_mutex_lock(&root->log_file_lock);
+    while (1) {
+        bstr data = root->log_file_buffer;
+        if (!data.len) {
+            if (root->log_file_terminate)
+                break;
+            pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+            continue;
+        }
+        // Swap buffers, and write everything queued so far at once.
+        root->log_file_buffer = root->log_file_spare;
+        root->log_file_buffer.len = 0;
+        root->log_file_spare = (bstr){0};
+        pthread_cond_broadcast(&root->log_file_wakeup);
+        pthread_mutex_unlock(&root->log_file_lock);
+
+        fwrite(data.start, data.len, 1, root->log_file);
+        fflush(root->log_file);
+
+        pthread_mutex_lock(&root->log_file_lock);
+        root->log_file_spare = data;
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+    return NULL;
+}
+
+// Must be called with mp_msg_lock held.
+static void start_log_file_thread(struct mp_log_root *root)
+{
+    if (!root->log_file)
+        return;
+    root->log_file_terminate = false;
+    if (pthread_create(&root->log_file_thread, NULL, log_file_thread, root)) {
+        fclose(root->log_file);
+        root->log_file = NULL;
+    }
+}
+
+// Must be called with mp_msg_lock held. Writes all queued messages.
+static void stop_log_file_thread(struct mp_log_root *root)
+{
+    if (!root->log_file)
+        return;
+    pthread_mutex_lock(&root->log_file_lock);
+    root->log_file_terminate = true;
+    pthread_cond_broadcast(&root->log_file_wakeup);
+    pthread_mutex_unlock(&root->log_file_lock);
+    pthread_join(root->log_file_thread, NULL);
 }
 
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
@@ -308,14 +386,22 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
             int avail = mp_ring_available(buffer->ring) / sizeof(void *);
             if (avail < 1)
                 continue;
-            struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
+            struct mp_log_buffer_entry *entry;
             if (avail > 1) {
+                // Allocate the strings with the entry in a single block.
+                size_t prefix_len = strlen(log->verbose_prefix) + 1;
+                size_t text_len = strlen(text) + 1;
+                entry = talloc_size(NULL, sizeof(*entry) + prefix_len + text_len);
+                char *strings = (char *)(entry + 1);
+                memcpy(strings, log->verbose_prefix, prefix_len);
+                memcpy(strings + prefix_len, text, text_len);
                 *entry = (struct mp_log_buffer_entry) {
-                    .prefix = talloc_strdup(entry, log->verbose_prefix),
+                    .prefix = strings,
                     .level = lev,
-                    .text = talloc_strdup(entry, text),
+                    .text = strings + prefix_len,
                 };
             } else {
+                entry = talloc_ptrtype(NULL, entry);
                 // write overflow message to signal that messages might be lost
                 *entry = (struct mp_log_buffer_entry) {
                     .prefix = "overflow",
@@ -397,6 +483,16 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 static void destroy_log(void *ptr)
 {
     struct mp_log *log = ptr;
+    struct mp_log_root *root = log->root;
+
+    pthread_mutex_lock(&mp_msg_lock);
+    assert(root->logs[log->index] == log);
+    struct mp_log *last = root->logs[root->num_logs - 1];
+    last->index = log->index;
+    root->logs[log->index] = last;
+    root->num_logs--;
+    pthread_mutex_unlock(&mp_msg_lock);
+
     // This is not managed via talloc itself, because mp_msg calls must be
     // thread-safe, while talloc is not thread-safe.
     talloc_free(log->partial);
@@ -416,6 +512,7 @@ struct mp_log *mp_log_new(void *talloc_ctx, struct mp_log *parent,
 {
     assert(parent);
     struct mp_log *log = talloc_zero(talloc_ctx, struct mp_log);
+    atomic_store(&log->level, -1);
     if (!parent->root)
         return log; // same as null_log
     talloc_set_destructor(log, destroy_log);
@@ -443,6 +540,14 @@ struct mp_log *mp_log_new(void *talloc_ctx, struct mp_log *parent,
         log->prefix = talloc_strdup(log, parent->prefix);
         log->verbose_prefix = talloc_strdup(log, parent->verbose_prefix);
     }
+
+    struct mp_log_root *root = log->root;
+    pthread_mutex_lock(&mp_msg_lock);
+    log->index = root->num_logs;
+    MP_TARRAY_APPEND(NULL, root->logs, root->num_logs, log);
+    update_loglevel(log, true);
+    pthread_mutex_unlock(&mp_msg_lock);
+
     return log;
 }
 
@@ -453,8 +558,10 @@ void mp_msg_init(struct mpv_global *global)
     struct mp_log_root *root = talloc_zero(NULL, struct mp_log_root);
     *root = (struct mp_log_root){
         .global = global,
-        .reload_counter = ATOMIC_VAR_INIT(1),
+        .extra_level = -1,
     };
+    pthread_mutex_init(&root->log_file_lock, NULL);
+    pthread_cond_init(&root->log_file_wakeup, NULL);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -468,9 +575,13 @@ void mp_msg_init(struct mpv_global *global)
 // If there's an error, _append_ it to err_buf.
 // *current_path and *file are, rather trickily, only accessible under the
 // mp_msg_lock.
+// If is_log_file is set, the file is root->log_file, and the writer thread
+// is restarted for the new file.
 static void reopen_file(char *opt, char **current_path, FILE **file,
-                        const char *type, struct mpv_global *global)
+                        const char *type, struct mpv_global *global,
+                        bool is_log_file)
 {
+    struct mp_log_root *root = global->log->root;
     void *tmp = talloc_new(NULL);
     bool fail = false;
 
@@ -482,6 +593,8 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
 
     char *old_path = *current_path ? *current_path : "";
     if (strcmp(old_path, new_path) != 0) {
+        if (is_log_file)
+            stop_log_file_thread(root);
         if (*file)
             fclose(*file);
         *file = NULL;
@@ -491,6 +604,9 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
             *file = fopen(new_path, "wb");
             fail = !*file;
         }
+        if (is_log_file)
+            start_log_file_thread(root);
+        update_all_loglevels(root, false);
     }
 
     pthread_mutex_unlock(&mp_msg_lock);
@@ -525,14 +641,14 @@ void mp_msg_update_msglevels(struct mpv_global *global)
     m_option_type_msglevels.copy(NULL, &root->msg_levels,
                                  &global->opts->msg_levels);
 
-    atomic_fetch_add(&root->reload_counter, 1);
+    update_all_loglevels(root, true);
     pthread_mutex_unlock(&mp_msg_lock);
 
     reopen_file(opts->log_file, &root->log_path, &root->log_file,
-                "log", global);
+                "log", global, true);
 
     reopen_file(opts->dump_stats, &root->stats_path, &root->stats_file,
-                "stats", global);
+                "stats", global, false);
 }
 
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
@@ -561,11 +677,16 @@ void mp_msg_uninit(struct mpv_global *global)
     if (root->stats_file)
         fclose(root->stats_file);
     talloc_free(root->stats_path);
+    stop_log_file_thread(root);
     if (root->log_file)
         fclose(root->log_file);
     talloc_free(root->log_path);
+    pthread_mutex_destroy(&root->log_file_lock);
+    pthread_cond_destroy(&root->log_file_wakeup);
     m_option_type_msglevels.free(&root->msg_levels);
+    struct mp_log **logs = root->logs; // destroy_log() accesses it
     talloc_free(root);
+    talloc_free(logs);
     global->log = NULL;
 }
 
@@ -595,7 +716,7 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
 
     MP_TARRAY_APPEND(root, root->buffers, root->num_buffers, buffer);
 
-    atomic_fetch_add(&root->reload_counter, 1);
+    update_all_loglevels(root, false);
     pthread_mutex_unlock(&mp_msg_lock);
 
     return buffer;
@@ -628,7 +749,7 @@ found:
     }
     talloc_free(buffer);
 
-    atomic_fetch_add(&root->reload_counter, 1);
+    update_all_loglevels(root, false);
     pthread_mutex_unlock(&mp_msg_lock);
 }
 
@@ -49,32 +49,53 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
+// Recompute the links and indexes of entries[start] up to the end of the list.
+static void playlist_update_links(struct playlist *pl, int start)
+{
+    for (int n = MPMAX(start, 0); n < pl->num_entries; n++) {
+        struct playlist_entry *e = pl->entries[n];
+        e->pl_index = n;
+        e->prev = n > 0 ? pl->entries[n - 1] : NULL;
+        e->next = n + 1 < pl->num_entries ? pl->entries[n + 1] : NULL;
+    }
+    pl->first = pl->num_entries ? pl->entries[0] : NULL;
+    pl->last = pl->num_entries ? pl->entries[pl->num_entries - 1] : NULL;
+}
+
+// Insert the entries at the given position in a single step (so this is
+// O(num + entries after index), instead of that per entry).
+static void playlist_insert_at(struct playlist *pl, int index,
+                               struct playlist_entry **add, int num)
+{
+    assert(index >= 0 && index <= pl->num_entries);
+    if (!num)
+        return;
+    MP_TARRAY_GROW(pl, pl->entries, pl->num_entries + num);
+    memmove(&pl->entries[index + num], &pl->entries[index],
+            (pl->num_entries - index) * sizeof(pl->entries[0]));
+    for (int n = 0; n < num; n++) {
+        struct playlist_entry *e = add[n];
+        assert(e->pl == NULL && e->next == NULL && e->prev == NULL);
+        e->pl = pl;
+        talloc_steal(pl, e);
+        pl->entries[index + n] = e;
+    }
+    pl->num_entries += num;
+    playlist_update_links(pl, index - 1);
+}
+
 // Add entry "add" after entry "after".
 // If "after" is NULL, add as first entry.
 // Post condition: add->prev == after
 void playlist_insert(struct playlist *pl, struct playlist_entry *after,
                      struct playlist_entry *add)
 {
-    assert(pl && add->pl == NULL && add->next == NULL && add->prev == NULL);
+    assert(pl);
     if (after) {
         assert(after->pl == pl);
         assert(pl->first && pl->last);
     }
-    add->prev = after;
-    if (after) {
-        add->next = after->next;
-        after->next = add;
-    } else {
-        add->next = pl->first;
-        pl->first = add;
-    }
-    if (add->next) {
-        add->next->prev = add;
-    } else {
-        pl->last = add;
-    }
-    add->pl = pl;
-    talloc_steal(pl, add);
+    playlist_insert_at(pl, after ? after->pl_index + 1 : 0, &add, 1);
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
@@ -91,16 +112,11 @@ static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
         pl->current_was_replaced = true;
     }
 
-    if (entry->next) {
-        entry->next->prev = entry->prev;
-    } else {
-        pl->last = entry->prev;
-    }
-    if (entry->prev) {
-        entry->prev->next = entry->next;
-    } else {
-        pl->first = entry->next;
-    }
+    int index = entry->pl_index;
+    assert(pl->entries[index] == entry);
+    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, index);
+    playlist_update_links(pl, index - 1);
+
     entry->next = entry->prev = NULL;
     // xxx: we'd want to reset the talloc parent of entry
     entry->pl = NULL;
@@ -122,8 +138,9 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
 
 void playlist_clear(struct playlist *pl)
 {
-    while (pl->first)
-        playlist_remove(pl, pl->first);
+    // (From the end, so that no entries need to be moved in pl->entries.)
+    while (pl->last)
+        playlist_remove(pl, pl->last);
     assert(!pl->current);
     pl->current_was_replaced = false;
 }
@@ -150,34 +167,15 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
-static int playlist_count(struct playlist *pl)
-{
-    int c = 0;
-    for (struct playlist_entry *e = pl->first; e; e = e->next)
-        c++;
-    return c;
-}
-
 void playlist_shuffle(struct playlist *pl)
 {
-    struct playlist_entry *save_current = pl->current;
-    bool save_replaced = pl->current_was_replaced;
-    int count = playlist_count(pl);
-    struct playlist_entry **arr = talloc_array(NULL, struct playlist_entry *,
-                                               count);
-    for (int n = 0; n < count; n++) {
-        arr[n] = pl->first;
-        playlist_unlink(pl, pl->first);
-    }
+    struct playlist_entry **arr = pl->entries;
+    int count = pl->num_entries;
     for (int n = 0; n < count - 1; n++) {
         int j = (int)((double)(count - n) * rand() / (RAND_MAX + 1.0));
         MPSWAP(struct playlist_entry *, arr[n], arr[n + j]);
     }
-    for (int n = 0; n < count; n++)
-        playlist_add(pl, arr[n]);
-    talloc_free(arr);
-    pl->current = save_current;
-    pl->current_was_replaced = save_replaced;
+    playlist_update_links(pl, 0);
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -216,6 +214,28 @@ void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
     }
 }
 
+// Unlink all entries from pl, and return them as array (talloc'ed, no parent).
+static struct playlist_entry **playlist_take_entries(struct playlist *pl,
+                                                     int *num)
+{
+    struct playlist_entry **entries = pl->entries;
+    *num = pl->num_entries;
+    for (int n = 0; n < *num; n++) {
+        struct playlist_entry *e = entries[n];
+        e->next = e->prev = NULL;
+        e->pl = NULL;
+    }
+    talloc_steal(NULL, entries);
+    pl->entries = NULL;
+    pl->num_entries = 0;
+    pl->first = pl->last = NULL;
+    if (pl->current) {
+        pl->current = NULL;
+        pl->current_was_replaced = true;
+    }
+    return entries;
+}
+
 // Move all entries from source_pl to pl, appending them after the current entry
 // of pl. source_pl will be empty, and all entries have changed ownership to pl.
 void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl)
@@ -226,53 +246,41 @@ void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl)
     if (!add_after)
         add_after = pl->last;
 
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_insert(pl, add_after, e);
-        add_after = e;
-    }
+    int num;
+    struct playlist_entry **entries = playlist_take_entries(source_pl, &num);
+    playlist_insert_at(pl, add_after ? add_after->pl_index + 1 : 0, entries, num);
+    talloc_free(entries);
 }
 
 void playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
 {
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_add(pl, e);
-    }
+    int num;
+    struct playlist_entry **entries = playlist_take_entries(source_pl, &num);
+    playlist_insert_at(pl, pl->num_entries, entries, num);
+    talloc_free(entries);
 }
 
 // Return number of entries between list start and e.
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
-    struct playlist_entry *cur = pl->first;
-    int pos = 0;
-    if (!e)
+    if (!e || e->pl != pl)
         return -1;
-    while (cur && cur != e) {
-        cur = cur->next;
-        pos++;
-    }
-    return cur == e ? pos : -1;
+    return e->pl_index;
 }
 
 int playlist_entry_count(struct playlist *pl)
 {
-    return playlist_entry_to_index(pl, pl->last) + 1;
+    return pl->num_entries;
 }
 
 // Return entry for which playlist_entry_to_index() would return index.
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    struct playlist_entry *e = pl->first;
-    for (int n = 0; ; n++) {
-        if (!e || n == index)
-            return e;
-        e = e->next;
-    }
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    return pl->entries[index];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mpv_global *global)
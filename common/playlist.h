@@ -28,6 +28,8 @@ struct playlist_param {
 struct playlist_entry {
     struct playlist_entry *prev, *next;
     struct playlist *pl;
+    // Position in pl->entries[] (valid if pl is set).
+    int pl_index;
 
     char *filename;
 
@@ -64,6 +66,11 @@ struct playlist_entry {
 struct playlist {
     struct playlist_entry *first, *last;
 
+    // The same entries as the linked list, in the same order (for O(1) index
+    // lookups). Modify only with the playlist_* functions.
+    struct playlist_entry **entries;
+    int num_entries;
+
     // This provides some sort of stable iterator. If this entry is removed from
     // the playlist, current is set to the next element (or NULL), and
     // current_was_replaced is set to true.
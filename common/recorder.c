@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -25,6 +26,10 @@
 #include "common/msg.h"
 #include "demux/packet.h"
 #include "demux/stheader.h"
+#include "misc/thread_sched.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
 
 #include "recorder.h"
 
@@ -39,9 +44,31 @@
 // Keyframe flags can trigger this earlier.
 #define QUEUE_MIN_PACKETS 16
 
+struct recorder_opts {
+    int64_t queue_bytes;
+    int queue_overflow;
+};
+
+#define OPT_BASE_STRUCT struct recorder_opts
+
+const struct m_sub_options recorder_conf = {
+    .opts = (const struct m_option[]){
+        OPT_BYTE_SIZE("record-queue-bytes", queue_bytes, 0, 1024 * 1024,
+                      MPMIN(INT64_MAX, SIZE_MAX / 2)),
+        OPT_CHOICE("record-queue-overflow", queue_overflow, 0,
+                   ({"drop", 0}, {"block", 1})),
+        {0}
+    },
+    .size = sizeof(struct recorder_opts),
+    .defaults = &(const struct recorder_opts){
+        .queue_bytes = 64 * 1024 * 1024,
+    },
+};
+
 struct mp_recorder {
     struct mpv_global *global;
     struct mp_log *log;
+    struct recorder_opts *opts;
 
     struct mp_recorder_sink **streams;
     int num_streams;
@@ -59,6 +86,21 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+
+    // Write queue overflowed in drop mode; drop all input until it drained.
+    bool overflow;
+
+    // Packets are written by a separate thread, so that slow writes don't
+    // stall the caller (the decoder/playback path).
+    pthread_t thread;
+    bool thread_valid;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    AVPacket **write_queue;
+    int num_write_queue;
+    int64_t write_queue_bytes;  // sum of AVPacket.size in write_queue
+    bool thread_terminate;
 };
 
 struct mp_recorder_sink {
@@ -114,6 +156,76 @@ static int add_stream(struct mp_recorder *priv, struct sh_stream *sh)
     return 0;
 }
 
+static void *write_thread(void *p)
+{
+    struct mp_recorder *priv = p;
+    mpthread_set_name("recorder");
+    mp_thread_sched_apply(priv->global, priv->log, "recorder");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (priv->num_write_queue) {
+            AVPacket *pkt = priv->write_queue[0];
+            MP_TARRAY_REMOVE_AT(priv->write_queue, priv->num_write_queue, 0);
+            int size = pkt->size;
+            pthread_mutex_unlock(&priv->lock);
+
+            if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+                MP_ERR(priv, "Failed writing packet.\n");
+            av_packet_free(&pkt);
+
+            pthread_mutex_lock(&priv->lock);
+            priv->write_queue_bytes -= size;
+            pthread_cond_broadcast(&priv->wakeup);
+            continue;
+        }
+        if (priv->thread_terminate)
+            break;
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    }
+    pthread_mutex_unlock(&priv->lock);
+    return NULL;
+}
+
+// Wait until all queued packets were written, and stop the writer thread.
+static void stop_thread(struct mp_recorder *priv)
+{
+    if (!priv->thread_valid)
+        return;
+    pthread_mutex_lock(&priv->lock);
+    priv->thread_terminate = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+    pthread_join(priv->thread, NULL);
+    priv->thread_valid = false;
+}
+
+// Pass the packet to the writer thread. If the queue is full, this waits for
+// the thread to catch up, or drops the packet and sets priv->overflow,
+// depending on --record-queue-overflow. Takes ownership of pkt.
+static void queue_packet(struct mp_recorder *priv, AVPacket *pkt)
+{
+    pthread_mutex_lock(&priv->lock);
+    // (Always accept a packet if the queue is empty, however large it is.)
+    while (priv->num_write_queue &&
+           priv->write_queue_bytes + pkt->size > priv->opts->queue_bytes)
+    {
+        if (!priv->opts->queue_overflow) {
+            priv->overflow = true;
+            break;
+        }
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    }
+    if (!priv->overflow) {
+        MP_TARRAY_APPEND(priv, priv->write_queue, priv->num_write_queue, pkt);
+        priv->write_queue_bytes += pkt->size;
+        pthread_cond_broadcast(&priv->wakeup);
+        pkt = NULL;
+    }
+    pthread_mutex_unlock(&priv->lock);
+    av_packet_free(&pkt);
+}
+
 struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        const char *target_file,
                                        struct sh_stream **streams,
@@ -123,6 +235,9 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
+    priv->opts = mp_get_config_group(priv, global, &recorder_conf);
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -167,6 +282,12 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->opened = true;
     priv->muxing_from_start = true;
 
+    if (pthread_create(&priv->thread, NULL, write_thread, priv)) {
+        MP_ERR(priv, "Failed to create writer thread.\n");
+        goto error;
+    }
+    priv->thread_valid = true;
+
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
@@ -197,6 +318,9 @@ static void mux_packet(struct mp_recorder_sink *rst,
     struct mp_recorder *priv = rst->owner;
     struct demux_packet mpkt = *pkt;
 
+    if (priv->overflow)
+        return;
+
     double diff = priv->rebase_ts - priv->base_ts;
     mpkt.pts = PTS_ADD(mpkt.pts, diff);
     mpkt.dts = PTS_ADD(mpkt.dts, diff);
@@ -217,8 +341,7 @@ static void mux_packet(struct mp_recorder_sink *rst,
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
+    queue_packet(priv, new_packet);
 }
 
 // Write all packets that currently can be written.
@@ -290,6 +413,24 @@ static void check_restart(struct mp_recorder *priv)
         MP_WARN(priv, "Discontinuity at timestamp %f.\n", priv->rebase_ts);
 }
 
+// If the write queue overflowed, start a new segment once it has drained.
+static void check_overflow(struct mp_recorder *priv)
+{
+    if (!priv->overflow)
+        return;
+
+    if (priv->muxing) {
+        MP_WARN(priv, "Writing the output file is too slow; dropping "
+                "packets.\n");
+        mp_recorder_mark_discontinuity(priv);
+    }
+
+    pthread_mutex_lock(&priv->lock);
+    bool drained = priv->write_queue_bytes <= priv->opts->queue_bytes / 2;
+    pthread_mutex_unlock(&priv->lock);
+    priv->overflow = !drained;
+}
+
 void mp_recorder_destroy(struct mp_recorder *priv)
 {
     if (priv->opened) {
@@ -299,7 +440,11 @@ void mp_recorder_destroy(struct mp_recorder *priv)
                 continue;
             mux_packets(rst, true);
         }
+    }
+
+    stop_thread(priv);
 
+    if (priv->opened) {
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
     }
@@ -312,6 +457,10 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    for (int n = 0; n < priv->num_write_queue; n++)
+        av_packet_free(&priv->write_queue[n]);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
@@ -347,8 +496,12 @@ void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
 {
     struct mp_recorder *priv = rst->owner;
 
+    check_overflow(priv);
+
     if (!pkt) {
         rst->proper_eof = true;
+        if (priv->overflow)
+            return;
         check_restart(priv);
         mux_packets(rst, false);
         return;
@@ -364,7 +517,7 @@ void mp_recorder_feed_packet(struct mp_recorder_sink *rst,
         priv->dts_warning = true;
     }
 
-    if (rst->discont && !pkt->keyframe)
+    if (priv->overflow || (rst->discont && !pkt->keyframe))
         return;
     rst->discont = false;
 
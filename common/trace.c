@@ -0,0 +1,296 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "osdep/atomic.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+
+#include "trace.h"
+
+// The internal win32 pthread wrapper has no thread-specific data. Tracing is
+// simply never enabled there.
+#define HAVE_TRACE (!HAVE_WIN32_INTERNAL_PTHREADS)
+
+// Rings of exited threads (or replaced by a size change) are kept, so that the
+// events leading up to a stutter are still there. Only this many are kept.
+#define MAX_DEAD_RINGS 32
+
+#define MAX_NAME 32
+
+struct trace_event {
+    const char *name;
+    int64_t ts, dur;
+};
+
+struct trace_ring {
+    int tid;
+    char name[MAX_NAME];        // protected by trace_lock
+    bool dead;                  // protected by trace_lock
+    int generation;             // trace_generation at creation
+    size_t size;
+    // Written by the owner thread only.
+    uint64_t wpos;
+    // Number of events published to readers. The owner writes an event to
+    // events[wpos % size] before storing the new count, so a reader has to
+    // discard the entries which might have been overwritten while it copied.
+    atomic_ullong pos;
+    struct trace_event *events;
+};
+
+struct trace_thread {
+    int tid;
+    char name[MAX_NAME];        // protected by trace_lock
+    struct trace_ring *ring;    // current ring, only accessed by the thread
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring **trace_rings; // protected by trace_lock
+static int num_trace_rings;
+
+// Both are only changed with trace_lock held.
+static atomic_int trace_size;           // 0 means disabled
+static atomic_int trace_generation;     // incremented on size changes
+static atomic_int trace_next_tid = ATOMIC_VAR_INIT(1);
+
+#if HAVE_TRACE
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+static void thread_destructor(void *p)
+{
+    struct trace_thread *t = p;
+    pthread_mutex_lock(&trace_lock);
+    if (t->ring)
+        t->ring->dead = true;
+    pthread_mutex_unlock(&trace_lock);
+    talloc_free(t);
+}
+
+static void trace_key_init(void)
+{
+    pthread_key_create(&trace_key, thread_destructor);
+}
+
+static struct trace_thread *get_thread(void)
+{
+    pthread_once(&trace_key_once, trace_key_init);
+    struct trace_thread *t = pthread_getspecific(trace_key);
+    if (!t) {
+        t = talloc_zero(NULL, struct trace_thread);
+        t->tid = atomic_fetch_add(&trace_next_tid, 1);
+        pthread_setspecific(trace_key, t);
+    }
+    return t;
+}
+
+// Must be called with trace_lock held.
+static void free_dead_rings(void)
+{
+    int num_dead = 0;
+    for (int n = 0; n < num_trace_rings; n++)
+        num_dead += trace_rings[n]->dead;
+    // The array is in creation order, so this removes the oldest first.
+    for (int n = 0; n < num_trace_rings && num_dead > MAX_DEAD_RINGS; n++) {
+        if (trace_rings[n]->dead) {
+            talloc_free(trace_rings[n]);
+            MP_TARRAY_REMOVE_AT(trace_rings, num_trace_rings, n);
+            num_dead--;
+            n--;
+        }
+    }
+}
+
+// Replace the thread's ring with one of the current size. Returns NULL if
+// tracing is disabled.
+static struct trace_ring *new_ring(struct trace_thread *t)
+{
+    struct trace_ring *ring = NULL;
+    pthread_mutex_lock(&trace_lock);
+    if (t->ring)
+        t->ring->dead = true;
+    t->ring = NULL;
+    int size = atomic_load(&trace_size);
+    if (size > 0) {
+        ring = talloc_zero(NULL, struct trace_ring);
+        ring->tid = t->tid;
+        snprintf(ring->name, sizeof(ring->name), "%s", t->name);
+        ring->generation = atomic_load(&trace_generation);
+        ring->size = size;
+        ring->events = talloc_array(ring, struct trace_event, size);
+        MP_TARRAY_APPEND(NULL, trace_rings, num_trace_rings, ring);
+        t->ring = ring;
+    }
+    free_dead_rings();
+    pthread_mutex_unlock(&trace_lock);
+    return ring;
+}
+#endif
+
+void mp_trace_set_buffer_size(int events)
+{
+#if HAVE_TRACE
+    events = MPMAX(events, 0);
+    pthread_mutex_lock(&trace_lock);
+    if (atomic_load(&trace_size) != events) {
+        atomic_store(&trace_size, events);
+        atomic_fetch_add(&trace_generation, 1);
+    }
+    pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+void mp_trace_set_thread_name(const char *name)
+{
+#if HAVE_TRACE
+    struct trace_thread *t = get_thread();
+    pthread_mutex_lock(&trace_lock);
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    if (t->ring)
+        snprintf(t->ring->name, sizeof(t->ring->name), "%s", name);
+    pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+int64_t mp_trace_begin(void)
+{
+    if (!atomic_load_explicit(&trace_size, memory_order_relaxed))
+        return 0;
+    return mp_time_us(); // never 0
+}
+
+void mp_trace_end(const char *name, int64_t start)
+{
+#if HAVE_TRACE
+    if (!start)
+        return;
+    int64_t now = mp_time_us();
+    struct trace_thread *t = get_thread();
+    struct trace_ring *ring = t->ring;
+    if (!ring || ring->generation != atomic_load(&trace_generation)) {
+        ring = new_ring(t);
+        if (!ring)
+            return;
+    }
+    ring->events[ring->wpos % ring->size] = (struct trace_event){
+        .name = name,
+        .ts = start,
+        .dur = now - start,
+    };
+    ring->wpos += 1;
+    atomic_store(&ring->pos, ring->wpos);
+#endif
+}
+
+struct dump_ring {
+    int tid;
+    char name[MAX_NAME];
+    struct trace_event *events;
+    int num_events;
+};
+
+static void write_str(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+bool mp_trace_dump(const char *path)
+{
+    void *tmp = talloc_new(NULL);
+    struct dump_ring *rings = NULL;
+    int num_rings = 0;
+
+    // Copy the events, so that no file I/O happens while holding the lock.
+    pthread_mutex_lock(&trace_lock);
+    for (int n = 0; n < num_trace_rings; n++) {
+        struct trace_ring *ring = trace_rings[n];
+        uint64_t end = atomic_load(&ring->pos);
+        uint64_t start = end > ring->size ? end - ring->size : 0;
+        struct dump_ring d = {
+            .tid = ring->tid,
+            .events = talloc_array(tmp, struct trace_event, end - start),
+        };
+        snprintf(d.name, sizeof(d.name), "%s", ring->name);
+        for (uint64_t i = start; i < end; i++)
+            d.events[d.num_events++] = ring->events[i % ring->size];
+        // The owner may have overwritten the oldest entries in the meantime
+        // (including the one for the event it's writing right now).
+        uint64_t now = atomic_load(&ring->pos);
+        if (!ring->dead && now + 1 > start + ring->size) {
+            uint64_t skip = MPMIN(now + 1 - ring->size - start, d.num_events);
+            d.events += skip;
+            d.num_events -= skip;
+        }
+        MP_TARRAY_APPEND(tmp, rings, num_rings, d);
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        talloc_free(tmp);
+        return false;
+    }
+
+    // Chrome trace event "JSON Array Format" (also read by Perfetto).
+    // Timestamps are mp_time_us() values.
+    int num_written = 0;
+    for (int n = 0; n < num_rings; n++) {
+        struct dump_ring *d = &rings[n];
+        fputs(num_written++ ? ",\n" : "[\n", f);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":", d->tid);
+        if (d->name[0]) {
+            write_str(f, d->name);
+        } else {
+            fprintf(f, "\"thread %d\"", d->tid);
+        }
+        fputs("}}", f);
+        for (int i = 0; i < d->num_events; i++) {
+            struct trace_event *ev = &d->events[i];
+            fputs(",\n{\"name\":", f);
+            write_str(f, ev->name ? ev->name : "?");
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%"PRId64","
+                    "\"dur\":%"PRId64"}", d->tid, ev->ts, ev->dur);
+        }
+    }
+    fputs(num_written ? "\n]\n" : "[]\n", f);
+
+    bool ok = !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    talloc_free(tmp);
+    return ok;
+}
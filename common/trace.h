@@ -0,0 +1,40 @@
+#ifndef MP_TRACE_H_
+#define MP_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Lightweight event tracing (--trace-buffer). Code regions are marked with:
+//
+//      int64_t t = mp_trace_begin();
+//      ... work ...
+//      mp_trace_end("name", t);
+//
+// Each thread records completed regions into its own fixed size ring buffer,
+// so the oldest events are overwritten. The rings can be written to a file in
+// the Chrome trace event format with mp_trace_dump() at any time. If tracing
+// is disabled, mp_trace_begin() returns 0 and mp_trace_end() does nothing.
+//
+// The state is global to the process, not per mpv_global.
+
+// Set the number of events kept per thread. 0 disables tracing; events that
+// were recorded before remain available for mp_trace_dump(). Changing the
+// size discards nothing either, but starts new rings.
+void mp_trace_set_buffer_size(int events);
+
+// Set the thread name used in the dump for the calling thread. This is called
+// by mpthread_set_name().
+void mp_trace_set_thread_name(const char *name);
+
+// Returns the start time of a region, or 0 if tracing is disabled.
+int64_t mp_trace_begin(void);
+
+// Record a region that started at the given mp_trace_begin() time. name must
+// be a static string (only the pointer is stored). start==0 is ignored.
+void mp_trace_end(const char *name, int64_t start);
+
+// Write all events that are still in the rings to the given file. Returns
+// false on I/O errors.
+bool mp_trace_dump(const char *path);
+
+#endif
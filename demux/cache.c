@@ -0,0 +1,212 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "mpv_talloc.h"
+
+#include "cache.h"
+#include "packet.h"
+
+// The file is split into chunks. Packets are appended to the current chunk,
+// and a chunk can be reused once all packets in it have been released. Since
+// the packet cache prunes packets roughly in the order they were added, this
+// keeps the file size close to the amount of cached data.
+#define CHUNK_SIZE (64 * 1024 * 1024LL)
+
+struct chunk {
+    int64_t num_packets;    // packets with data in this chunk
+};
+
+struct demux_cache {
+    struct mp_log *log;
+    FILE *file;
+
+    struct chunk *chunks;
+    int num_chunks;
+    int cur_chunk;          // chunk written to
+    int64_t cur_pos;        // write position within cur_chunk
+};
+
+// On-disk packet header. Followed by data_len bytes of packet data, and then
+// num_sd times struct sd_header + side data payload.
+struct pkt_header {
+    uint32_t data_len;
+    uint32_t num_sd;
+};
+
+struct sd_header {
+    uint32_t type;
+    uint32_t size;
+};
+
+static void cache_destroy(void *ptr)
+{
+    struct demux_cache *cache = ptr;
+    if (cache->file)
+        fclose(cache->file);
+}
+
+// filename=="TMP" creates an anonymous temporary file. Returns NULL on error.
+struct demux_cache *demux_cache_create(void *ta_parent, struct mp_log *log,
+                                       const char *filename)
+{
+    bool use_anon_file = strcmp(filename, "TMP") == 0;
+    FILE *file = use_anon_file ? tmpfile() : fopen(filename, "wb+");
+    if (!file) {
+        mp_err(log, "can't open demuxer cache file '%s'\n", filename);
+        return NULL;
+    }
+
+    struct demux_cache *cache = talloc_ptrtype(ta_parent, cache);
+    talloc_set_destructor(cache, cache_destroy);
+    *cache = (struct demux_cache){
+        .log = log,
+        .file = file,
+    };
+    MP_TARRAY_APPEND(cache, cache->chunks, cache->num_chunks, (struct chunk){0});
+    return cache;
+}
+
+static size_t entry_size(struct demux_packet *dp)
+{
+    AVPacket *pkt = dp->avpacket;
+    size_t size = sizeof(struct pkt_header) + dp->len;
+    for (int n = 0; pkt && n < pkt->side_data_elems; n++)
+        size += sizeof(struct sd_header) + pkt->side_data[n].size;
+    return size;
+}
+
+static bool write_data(struct demux_cache *cache, void *data, size_t size)
+{
+    return !size || fwrite(data, size, 1, cache->file) == 1;
+}
+
+// Write the packet's data and side data to the cache. Returns the position
+// which can be passed to demux_cache_read(), or -1 on failure (in which case
+// the caller should keep the data in memory).
+int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
+{
+    size_t size = entry_size(dp);
+    if (size > CHUNK_SIZE)
+        return -1;
+
+    if (cache->cur_pos + size > CHUNK_SIZE) {
+        // Switch to the first released chunk, or append a new one.
+        int next = -1;
+        for (int n = 0; n < cache->num_chunks; n++) {
+            if (n != cache->cur_chunk && !cache->chunks[n].num_packets) {
+                next = n;
+                break;
+            }
+        }
+        if (next < 0) {
+            next = cache->num_chunks;
+            MP_TARRAY_APPEND(cache, cache->chunks, cache->num_chunks,
+                             (struct chunk){0});
+        }
+        cache->cur_chunk = next;
+        cache->cur_pos = 0;
+    }
+
+    int64_t pos = cache->cur_chunk * CHUNK_SIZE + cache->cur_pos;
+    if (fseeko(cache->file, pos, SEEK_SET))
+        goto error;
+
+    AVPacket *pkt = dp->avpacket;
+    struct pkt_header hdr = {
+        .data_len = dp->len,
+        .num_sd = pkt ? pkt->side_data_elems : 0,
+    };
+    if (!write_data(cache, &hdr, sizeof(hdr)) ||
+        !write_data(cache, dp->buffer, dp->len))
+        goto error;
+    for (int n = 0; n < hdr.num_sd; n++) {
+        struct sd_header sd = {
+            .type = pkt->side_data[n].type,
+            .size = pkt->side_data[n].size,
+        };
+        if (!write_data(cache, &sd, sizeof(sd)) ||
+            !write_data(cache, pkt->side_data[n].data, sd.size))
+            goto error;
+    }
+
+    cache->cur_pos += size;
+    cache->chunks[cache->cur_chunk].num_packets += 1;
+    return pos;
+
+error:
+    mp_err(cache->log, "failed to write to demuxer cache file\n");
+    // Don't reuse the current chunk position; its contents are undefined now.
+    cache->cur_pos = CHUNK_SIZE;
+    return -1;
+}
+
+// Read back the packet data written at pos. Returns a new packet with only the
+// data and side data set, or NULL on failure.
+struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
+{
+    struct pkt_header hdr;
+    if (fseeko(cache->file, pos, SEEK_SET) ||
+        fread(&hdr, sizeof(hdr), 1, cache->file) != 1)
+        goto error;
+
+    struct demux_packet *dp = new_demux_packet(hdr.data_len);
+    if (!dp)
+        goto error;
+    if (hdr.data_len && fread(dp->buffer, hdr.data_len, 1, cache->file) != 1)
+        goto error_free;
+
+    for (int n = 0; n < hdr.num_sd; n++) {
+        struct sd_header sd;
+        if (fread(&sd, sizeof(sd), 1, cache->file) != 1)
+            goto error_free;
+        uint8_t *data = av_packet_new_side_data(dp->avpacket, sd.type, sd.size);
+        if (!data)
+            goto error_free;
+        if (sd.size && fread(data, sd.size, 1, cache->file) != 1)
+            goto error_free;
+    }
+
+    return dp;
+
+error_free:
+    talloc_free(dp);
+error:
+    mp_err(cache->log, "failed to read from demuxer cache file\n");
+    return NULL;
+}
+
+// Mark the packet data at pos as unused.
+void demux_cache_release(struct demux_cache *cache, uint64_t pos)
+{
+    int64_t chunk = pos / CHUNK_SIZE;
+    assert(chunk < cache->num_chunks && cache->chunks[chunk].num_packets > 0);
+    cache->chunks[chunk].num_packets -= 1;
+    // Restart the current chunk if it's unused, instead of moving on.
+    if (chunk == cache->cur_chunk && !cache->chunks[chunk].num_packets)
+        cache->cur_pos = 0;
+}
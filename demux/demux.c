@@ -32,17 +32,23 @@
 #include "config.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "mpv_talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/trace.h"
+#include "misc/thread_sched.h"
 #include "osdep/atomic.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
+#include "cache.h"
+#include "probe_cache.h"
 
 // Demuxer list
 extern const struct demuxer_desc demuxer_desc_edl;
@@ -88,12 +94,18 @@ const demuxer_desc_t *const demuxer_list[] = {
 struct demux_opts {
     int64_t max_bytes;
     int64_t max_bytes_bw;
+    int64_t max_bytes_type[STREAM_TYPE_COUNT];
+    int64_t max_bytes_unselected;
     double min_secs;
+    double join_secs;
     int force_seekable;
     double min_secs_cache;
     int access_references;
     int seekable_cache;
     int create_ccs;
+    char *cache_file;
+    int max_open_segments;
+    char *probe_cache;
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -103,16 +115,29 @@ struct demux_opts {
 const struct m_sub_options demux_conf = {
     .opts = (const struct m_option[]){
         OPT_DOUBLE("demuxer-readahead-secs", min_secs, M_OPT_MIN, .min = 0),
+        OPT_DOUBLE("demuxer-cache-join-secs", join_secs, M_OPT_MIN, .min = 0),
         // (The MAX_BYTES sizes may not be accurate because the max field is
         // of double type.)
         OPT_BYTE_SIZE("demuxer-max-bytes", max_bytes, 0, 0, MAX_BYTES),
         OPT_BYTE_SIZE("demuxer-max-back-bytes", max_bytes_bw, 0, 0, MAX_BYTES),
+        OPT_BYTE_SIZE("demuxer-max-video-bytes", max_bytes_type[STREAM_VIDEO],
+                      0, 0, MAX_BYTES),
+        OPT_BYTE_SIZE("demuxer-max-audio-bytes", max_bytes_type[STREAM_AUDIO],
+                      0, 0, MAX_BYTES),
+        OPT_BYTE_SIZE("demuxer-max-sub-bytes", max_bytes_type[STREAM_SUB],
+                      0, 0, MAX_BYTES),
+        OPT_BYTE_SIZE("demuxer-max-unselected-bytes", max_bytes_unselected,
+                      0, 0, MAX_BYTES),
         OPT_FLAG("force-seekable", force_seekable, 0),
         OPT_DOUBLE("cache-secs", min_secs_cache, M_OPT_MIN, .min = 0),
         OPT_FLAG("access-references", access_references, 0),
         OPT_CHOICE("demuxer-seekable-cache", seekable_cache, 0,
                    ({"auto", -1}, {"no", 0}, {"yes", 1})),
         OPT_FLAG("sub-create-cc-track", create_ccs, 0),
+        OPT_STRING("demuxer-cache-file", cache_file, M_OPT_FILE),
+        OPT_INT("demuxer-max-open-segments", max_open_segments, M_OPT_MIN,
+                .min = 0),
+        OPT_STRING("demuxer-probe-cache", probe_cache, M_OPT_FILE),
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -120,6 +145,7 @@ const struct m_sub_options demux_conf = {
         .max_bytes = 150 * 1024 * 1024,
         .max_bytes_bw = 50 * 1024 * 1024,
         .min_secs = 1.0,
+        .join_secs = 10.0,
         .min_secs_cache = 10.0 * 60 * 60,
         .seekable_cache = -1,
         .access_references = 1,
@@ -165,8 +191,11 @@ struct demux_internal {
     bool idle;
     bool autoselect;
     double min_secs;
+    double join_secs;
     size_t max_bytes;
     size_t max_bytes_bw;
+    size_t max_bytes_type[STREAM_TYPE_COUNT]; // 0 means no limit
+    size_t max_bytes_unselected; // 0 means don't buffer unselected streams
     bool seekable_cache;
 
     // At least one decoder actually requested data since init or the last seek.
@@ -180,6 +209,8 @@ struct demux_internal {
 
     bool tracks_switched;       // thread needs to inform demuxer of this
 
+    bool need_prune;            // thread needs to call prune_old_packets()
+
     bool seeking;               // there's a seek queued
     int seek_flags;             // flags for next seek (if seeking==true)
     double seek_pts;
@@ -189,6 +220,14 @@ struct demux_internal {
     int low_level_seeks;        // number of started low level seeks
     double demux_ts;            // last demuxed DTS or PTS
 
+    // (fields for DEMUXER_CTRL_GET_PERF_STATS)
+    int64_t pruned_packets, pruned_bytes;
+    int64_t read_calls;
+    int64_t read_time_us;
+    int64_t lock_wait_us;
+    int64_t added_packets, added_bytes;
+    int64_t stream_bytes;       // copy of d_thread->stream->total_read
+
     double ts_offset;           // timestamp offset to apply to everything
 
     void (*run_fn)(void *);     // if non-NULL, function queued to be run on
@@ -198,7 +237,20 @@ struct demux_internal {
     struct demux_cached_range **ranges;
     int num_ranges;
 
+    // Incremented on every change of the seek ranges visible to the player
+    // (range added/removed/reordered, seek_start/end/is_bof/is_eof changed,
+    // ts_offset changed).
+    uint64_t seek_ranges_version;
+    // Summary of ranges[] as returned by DEMUXER_CTRL_GET_READER_STATE; lazily
+    // rebuilt if seek_ranges_export_version != seek_ranges_version.
+    struct demux_seek_range seek_ranges_export[MAX_SEEK_RANGES];
+    int num_seek_ranges_export;
+    uint64_t seek_ranges_export_version;
+
     size_t total_bytes;         // total sum of packet data buffered
+
+    // If non-NULL, packet data is stored in this file instead of memory.
+    struct demux_cache *cache;
     size_t fw_bytes;            // sum of forward packet data in current_range
 
     // Range from which decoder is reading, and to which demuxer is appending.
@@ -234,8 +286,6 @@ struct demux_cached_range {
     bool is_eof;            // set if the file ends with this range
 };
 
-#define MAX_INDEX_ENTRIES 16
-
 // A continuous list of cached packets for a single stream/range. There is one
 // for each stream and range. Also contains some state for use during demuxing
 // (keeping it across seeks makes it easier to resume demuxing).
@@ -265,13 +315,16 @@ struct demux_queue {
     bool is_bof;            // started demuxing at beginning of file
     bool is_eof;            // received true EOF here
 
-    // incomplete index to somewhat speed up seek operations
-    // the entries in index[] must be in packet queue append/removal order
-    int num_index;          // valid index[] entries
-    double index_distance;  // minimum keyframe distance to add index element
-    struct demux_packet *index[MAX_INDEX_ENTRIES];
+    // keyframe index to speed up seek operations; sorted by kf_seek_pts
+    // the entries must be in packet queue append/removal order
+    // valid entries are index[index0] ... index[index0 + num_index - 1]
+    struct demux_packet **index;
+    int index0;             // first valid entry (entries before it were pruned)
+    int num_index;          // number of valid entries
 };
 
+#define QUEUE_INDEX_ENTRY(q, i) ((q)->index[(q)->index0 + (i)])
+
 struct demux_stream {
     struct demux_internal *in;
     struct sh_stream *sh;   // ds->sh->ds == ds
@@ -287,6 +340,8 @@ struct demux_stream {
     bool eager;             // try to keep at least 1 packet queued
                             // if false, this stream is disabled, or passively
                             // read (like subtitles)
+    bool prefetch;          // not selected, but packets are buffered anyway
+                            // (never has a reader_head; separate byte budget)
     bool still_image;       // stream has still video images
     bool refreshing;        // finding old position after track switches
     bool eof;               // end of demuxed stream? (true if no more packets)
@@ -305,6 +360,8 @@ struct demux_stream {
     double bitrate;
     size_t fw_packs;        // number of packets in buffer (forward)
     size_t fw_bytes;        // total bytes of packets in buffer (forward)
+    size_t total_bytes;     // total bytes of packets in all cached ranges
+    size_t total_packs;     // number of packets in all cached ranges
     struct demux_packet *reader_head;   // points at current decoder position
     bool skip_to_keyframe;
     bool attached_picture_added;
@@ -343,6 +400,7 @@ struct mp_packet_tags {
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
+static void prune_unselected(struct demux_internal *in);
 
 #if 0
 // very expensive check for redundant cached queue state
@@ -389,7 +447,8 @@ static void check_queue_consistency(struct demux_internal *in)
                 if (!dp->next)
                     assert(queue->tail == dp);
 
-                if (next_index < queue->num_index && queue->index[next_index] == dp)
+                if (next_index < queue->num_index &&
+                    QUEUE_INDEX_ENTRY(queue, next_index) == dp)
                     next_index += 1;
             }
             if (!queue->head)
@@ -495,6 +554,7 @@ static void set_current_range(struct demux_internal *in,
                               struct demux_cached_range *range)
 {
     in->current_range = range;
+    in->seek_ranges_version++;
 
     // Move to in->ranges[in->num_ranges-1] (for LRU sorting/invariant)
     for (int n = 0; n < in->num_ranges; n++) {
@@ -507,8 +567,11 @@ static void set_current_range(struct demux_internal *in,
 }
 
 // Refresh range->seek_start/end.
-static void update_seek_ranges(struct demux_cached_range *range)
+static void update_seek_ranges(struct demux_internal *in,
+                               struct demux_cached_range *range)
 {
+    struct demux_cached_range old = *range;
+
     range->seek_start = range->seek_end = MP_NOPTS_VALUE;
     range->is_bof = true;
     range->is_eof = true;
@@ -558,6 +621,18 @@ static void update_seek_ranges(struct demux_cached_range *range)
 
     if (range->seek_start >= range->seek_end)
         range->seek_start = range->seek_end = MP_NOPTS_VALUE;
+
+    if (range->seek_start != old.seek_start || range->seek_end != old.seek_end ||
+        range->is_bof != old.is_bof || range->is_eof != old.is_eof)
+        in->seek_ranges_version++;
+}
+
+// Free a packet that is part of the packet cache.
+static void free_cached_packet(struct demux_internal *in, struct demux_packet *dp)
+{
+    if (dp->is_cached)
+        demux_cache_release(in->cache, dp->cached_data_pos);
+    talloc_free(dp);
 }
 
 // Remove queue->head from the queue. Does not update in->fw_bytes/in->fw_packs.
@@ -572,16 +647,25 @@ static void remove_head_packet(struct demux_queue *queue)
         queue->keyframe_latest = NULL;
     queue->is_bof = false;
 
-    queue->ds->in->total_bytes -= demux_packet_estimate_total_size(dp);
+    size_t bytes = demux_packet_estimate_total_size(dp);
+    queue->ds->in->total_bytes -= bytes;
+    queue->ds->total_bytes -= bytes;
+    queue->ds->total_packs -= 1;
+    queue->ds->in->pruned_bytes += bytes;
+    queue->ds->in->pruned_packets += 1;
 
-    if (queue->num_index && queue->index[0] == dp)
-        MP_TARRAY_REMOVE_AT(queue->index, queue->num_index, 0);
+    if (queue->num_index && QUEUE_INDEX_ENTRY(queue, 0) == dp) {
+        queue->index0 += 1;
+        queue->num_index -= 1;
+        if (!queue->num_index)
+            queue->index0 = 0;
+    }
 
     queue->head = dp->next;
     if (!queue->head)
         queue->tail = NULL;
 
-    talloc_free(dp);
+    free_cached_packet(queue->ds->in, dp);
 }
 
 static void clear_queue(struct demux_queue *queue)
@@ -592,9 +676,12 @@ static void clear_queue(struct demux_queue *queue)
     struct demux_packet *dp = queue->head;
     while (dp) {
         struct demux_packet *dn = dp->next;
-        in->total_bytes -= demux_packet_estimate_total_size(dp);
+        size_t bytes = demux_packet_estimate_total_size(dp);
+        in->total_bytes -= bytes;
+        ds->total_bytes -= bytes;
+        ds->total_packs -= 1;
         assert(ds->reader_head != dp);
-        talloc_free(dp);
+        free_cached_packet(in, dp);
         dp = dn;
     }
     queue->head = queue->tail = NULL;
@@ -602,8 +689,9 @@ static void clear_queue(struct demux_queue *queue)
     queue->keyframe_latest = NULL;
     queue->seek_start = queue->seek_end = queue->last_pruned = MP_NOPTS_VALUE;
 
-    queue->num_index = 0;
-    queue->index_distance = 1.0;
+    talloc_free(queue->index);
+    queue->index = NULL;
+    queue->index0 = queue->num_index = 0;
 
     queue->correct_dts = queue->correct_pos = true;
     queue->last_pos = -1;
@@ -620,7 +708,7 @@ static void clear_cached_range(struct demux_internal *in,
 {
     for (int n = 0; n < range->num_streams; n++)
         clear_queue(range->streams[n]);
-    update_seek_ranges(range);
+    update_seek_ranges(in, range);
 }
 
 // Remove ranges with no data (except in->current_range). Also remove excessive
@@ -638,6 +726,7 @@ static void free_empty_cached_ranges(struct demux_internal *in)
             if (range->seek_start == MP_NOPTS_VALUE || !in->seekable_cache) {
                 clear_cached_range(in, range);
                 MP_TARRAY_REMOVE_AT(in->ranges, in->num_ranges, n);
+                in->seek_ranges_version++;
             } else {
                 if (!worst || (range->seek_end - range->seek_start <
                                worst->seek_end - worst->seek_start))
@@ -711,6 +800,9 @@ static void update_stream_selection_state(struct demux_internal *in,
 
         s->still_image = s->sh->still_image;
         s->eager = s->selected && !s->sh->attached_picture;
+        s->prefetch = !s->selected && in->max_bytes_unselected &&
+                      (s->type == STREAM_AUDIO || s->type == STREAM_SUB) &&
+                      !s->sh->attached_picture;
         if (s->eager && !s->still_image) {
             any_av_streams |= s->type != STREAM_SUB;
             if (!master ||
@@ -745,14 +837,18 @@ static void update_stream_selection_state(struct demux_internal *in,
     for (int n = 0; n < in->num_ranges; n++) {
         struct demux_cached_range *range = in->ranges[n];
 
-        if (!ds->selected)
+        // (Keep the packets of a deselected stream if they can be used for
+        // switching back to it.)
+        if (!ds->selected && !ds->prefetch)
             clear_queue(range->streams[ds->index]);
 
-        update_seek_ranges(range);
+        update_seek_ranges(in, range);
     }
 
     free_empty_cached_ranges(in);
 
+    prune_unselected(in);
+
     wakeup_ds(ds);
 }
 
@@ -760,6 +856,8 @@ void demux_set_ts_offset(struct demuxer *demuxer, double offset)
 {
     struct demux_internal *in = demuxer->in;
     pthread_mutex_lock(&in->lock);
+    if (in->ts_offset != offset)
+        in->seek_ranges_version++;
     in->ts_offset = offset;
     pthread_mutex_unlock(&in->lock);
 }
@@ -945,6 +1043,7 @@ void free_demuxer(demuxer_t *demuxer)
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(demuxer);
+    demux_packet_pool_unref();
 }
 
 void free_demuxer_and_stream(struct demuxer *demuxer)
@@ -1043,25 +1142,29 @@ void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp)
     demux_add_packet(sh, dp);
 }
 
-// Add the keyframe to the end of the index. Not all packets are actually added.
+// Add the keyframe to the end of the index. Keyframes whose seek PTS is not
+// strictly increasing are skipped to keep the index sorted (they can still be
+// found by the linear search in find_seek_target()).
 static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp)
 {
     assert(dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE);
 
     if (queue->num_index) {
-        double prev = queue->index[queue->num_index - 1]->kf_seek_pts;
-        if (dp->kf_seek_pts < prev + queue->index_distance)
+        double prev = QUEUE_INDEX_ENTRY(queue, queue->num_index - 1)->kf_seek_pts;
+        if (dp->kf_seek_pts <= prev)
             return;
     }
 
-    if (queue->num_index == MAX_INDEX_ENTRIES) {
-        for (int n = 0; n < MAX_INDEX_ENTRIES / 2; n++)
-            queue->index[n] = queue->index[n * 2];
-        queue->num_index = MAX_INDEX_ENTRIES / 2;
-        queue->index_distance *= 2;
+    // Reclaim the space of pruned entries once they make up half the array.
+    if (queue->index0 && queue->index0 >= queue->num_index) {
+        memmove(queue->index, queue->index + queue->index0,
+                queue->num_index * sizeof(queue->index[0]));
+        queue->index0 = 0;
     }
 
-    queue->index[queue->num_index++] = dp;
+    int num = queue->index0 + queue->num_index;
+    MP_TARRAY_APPEND(queue, queue->index, num, dp);
+    queue->num_index += 1;
 }
 
 // Check whether the next range in the list is, and if it appears to overlap,
@@ -1207,8 +1310,10 @@ static void attempt_range_joining(struct demux_internal *in)
         q2->keyframe_latest = NULL;
 
         for (int i = 0; i < q2->num_index; i++)
-            add_index_entry(q1, q2->index[i]);
-        q2->num_index = 0;
+            add_index_entry(q1, QUEUE_INDEX_ENTRY(q2, i));
+        talloc_free(q2->index);
+        q2->index = NULL;
+        q2->index0 = q2->num_index = 0;
 
         recompute_buffers(ds);
         in->fw_bytes += ds->fw_bytes;
@@ -1217,7 +1322,7 @@ static void attempt_range_joining(struct demux_internal *in)
         ds->refreshing = ds->selected;
     }
 
-    update_seek_ranges(in->current_range);
+    update_seek_ranges(in, in->current_range);
 
     // Move demuxing position to after the current range.
     in->seeking = true;
@@ -1255,7 +1360,7 @@ static void adjust_seek_range_on_packet(struct demux_stream *ds,
             if (queue->keyframe_end_pts != MP_NOPTS_VALUE)
                 queue->seek_end = queue->keyframe_end_pts;
             queue->is_eof = !dp;
-            update_seek_ranges(queue->range);
+            update_seek_ranges(ds->in, queue->range);
             attempt_range_join = queue->range->seek_end > old_end;
             if (queue->keyframe_latest->kf_seek_pts != MP_NOPTS_VALUE)
                 add_index_entry(queue, queue->keyframe_latest);
@@ -1280,7 +1385,7 @@ static void adjust_seek_range_on_packet(struct demux_stream *ds,
     }
 
     if (queue->is_eof != prev_eof)
-        update_seek_ranges(queue->range);
+        update_seek_ranges(ds->in, queue->range);
 
     if (attempt_range_join)
         attempt_range_joining(ds->in);
@@ -1307,7 +1412,8 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 
     struct demux_queue *queue = ds->queue;
 
-    bool drop = !ds->selected || in->seeking || ds->sh->attached_picture;
+    bool drop = !(ds->selected || ds->prefetch) || in->seeking ||
+                ds->sh->attached_picture;
     if (!drop && ds->refreshing) {
         // Resume reading once the old position was reached (i.e. we start
         // returning packets where we left off before the refresh).
@@ -1340,15 +1446,32 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     dp->next = NULL;
     mp_packet_tags_setref(&dp->metadata, ds->tags_demux);
 
+    // Move the packet data to the cache file, keeping only the header. This
+    // has to happen before the packet size is estimated.
+    if (in->cache) {
+        int64_t pos = demux_cache_write(in->cache, dp);
+        if (pos >= 0) {
+            demux_packet_unref_contents(dp);
+            dp->is_cached = true;
+            dp->cached_data_pos = pos;
+        }
+    }
+
     // (keep in mind that even if the reader went out of data, the queue is not
     // necessarily empty due to the backbuffer)
-    if (!ds->reader_head && (!ds->skip_to_keyframe || dp->keyframe)) {
+    if (ds->selected && !ds->reader_head &&
+        (!ds->skip_to_keyframe || dp->keyframe))
+    {
         ds->reader_head = dp;
         ds->skip_to_keyframe = false;
     }
 
     size_t bytes = demux_packet_estimate_total_size(dp);
     ds->in->total_bytes += bytes;
+    ds->total_bytes += bytes;
+    ds->total_packs += 1;
+    in->added_bytes += bytes;
+    in->added_packets += 1;
     if (ds->reader_head) {
         ds->fw_packs++;
         ds->fw_bytes += bytes;
@@ -1386,6 +1509,9 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
 
     adjust_seek_range_on_packet(ds, dp);
 
+    if (ds->prefetch)
+        prune_unselected(in);
+
     // Possible update duration based on highest TS demuxed (but ignore subs).
     if (stream->type != STREAM_SUB) {
         if (dp->segmented)
@@ -1406,6 +1532,26 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Return the distance between the end of the current range and the start of
+// the closest cached range after it, or INFINITY if there is none.
+static double get_next_range_gap(struct demux_internal *in)
+{
+    struct demux_cached_range *cur = in->current_range;
+    double gap = INFINITY;
+
+    if (cur->seek_end == MP_NOPTS_VALUE)
+        return gap;
+
+    for (int n = 0; n < in->num_ranges - 1; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (range->seek_start != MP_NOPTS_VALUE &&
+            range->seek_start >= cur->seek_start)
+            gap = MPMIN(gap, MPMAX(range->seek_start - cur->seek_end, 0));
+    }
+
+    return gap;
+}
+
 // Returns true if there was "progress" (lock was released temporarily).
 static bool read_packet(struct demux_internal *in)
 {
@@ -1419,8 +1565,11 @@ static bool read_packet(struct demux_internal *in)
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
     bool read_more = false, prefetch_more = false, refresh_more = false;
+    bool join_more = false;
+    size_t fw_bytes_type[STREAM_TYPE_COUNT] = {0};
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
+        fw_bytes_type[ds->type] += ds->fw_bytes;
         read_more |= ds->eager && !ds->reader_head;
         refresh_more |= ds->refreshing;
         if (ds->eager && ds->queue->last_ts != MP_NOPTS_VALUE &&
@@ -1428,9 +1577,25 @@ static bool read_packet(struct demux_internal *in)
             ds->queue->last_ts >= ds->base_ts)
             prefetch_more |= ds->queue->last_ts - ds->base_ts < in->min_secs;
     }
-    MP_TRACE(in, "bytes=%zd, read_more=%d prefetch_more=%d, refresh_more=%d\n",
-             in->fw_bytes, read_more, prefetch_more, refresh_more);
-    if (in->fw_bytes >= in->max_bytes) {
+    // If the next cached range is close, keep reading until it can be joined
+    // with the current range, even if readahead is complete. This turns the
+    // gap into a cache hit for later seeks.
+    if (in->seekable_cache && in->join_secs > 0 && !read_more && !prefetch_more)
+        join_more = get_next_range_gap(in) <= in->join_secs;
+    MP_TRACE(in, "bytes=%zd, read_more=%d prefetch_more=%d, refresh_more=%d "
+             "join_more=%d\n", in->fw_bytes, read_more, prefetch_more,
+             refresh_more, join_more);
+    // A per-type limit only stops prefetching. If a stream is starving, keep
+    // reading (the global limit still applies), instead of signaling EOF.
+    bool type_overflow = false;
+    for (int n = 0; n < STREAM_TYPE_COUNT; n++) {
+        type_overflow |= in->max_bytes_type[n] &&
+                         fw_bytes_type[n] >= in->max_bytes_type[n];
+    }
+    if (type_overflow && !read_more)
+        return false;
+    bool overflow = in->fw_bytes >= in->max_bytes;
+    if (overflow) {
         // if we hit the limit just by prefetching, simply stop prefetching
         if (!read_more)
             return false;
@@ -1460,7 +1625,7 @@ static bool read_packet(struct demux_internal *in)
         return false;
     }
 
-    if (!read_more && !prefetch_more && !refresh_more)
+    if (!read_more && !prefetch_more && !refresh_more && !join_more)
         return false;
 
     if (in->initial_state) {
@@ -1477,12 +1642,21 @@ static bool read_packet(struct demux_internal *in)
     struct demuxer *demux = in->d_thread;
 
     bool eof = true;
+    int64_t trace = mp_trace_begin();
+    int64_t read_start = mp_time_us();
     if (demux->desc->fill_buffer && !demux_cancel_test(demux))
         eof = demux->desc->fill_buffer(demux) <= 0;
+    int64_t read_time = mp_time_us() - read_start;
     update_cache(in);
+    mp_trace_end("read_packet", trace);
 
     pthread_mutex_lock(&in->lock);
 
+    in->read_calls += 1;
+    in->read_time_us += read_time;
+    if (demux->stream)
+        in->stream_bytes = demux->stream->total_read;
+
     if (!in->seeking) {
         if (eof) {
             for (int n = 0; n < in->num_streams; n++) {
@@ -1506,81 +1680,166 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
-static void prune_old_packets(struct demux_internal *in)
+// Prune all packets from the queue's head until the next keyframe, or
+// reader_head. The queue must have at least 1 packet which can be pruned.
+static void prune_queue_head(struct demux_internal *in,
+                             struct demux_queue *queue)
 {
-    assert(in->current_range == in->ranges[in->num_ranges - 1]);
+    struct demux_stream *ds = queue->ds;
+    struct demux_cached_range *range = queue->range;
+
+    assert(queue->head && queue->head != ds->reader_head);
+
+    // Prune all packets until the next keyframe or reader_head. Keeping
+    // those packets would not help with seeking at all, so we strictly
+    // drop them.
+    // In addition, we need to find the new possibly min. seek target,
+    // which in the worst case could be inside the forward buffer. The fact
+    // that many keyframe ranges without keyframes exist (audio packets)
+    // makes this much harder.
+    if (in->seekable_cache && !queue->next_prune_target) {
+        // (Has to be _after_ queue->head to drop at least 1 packet.)
+        struct demux_packet *prev = queue->head;
+        if (queue->seek_start != MP_NOPTS_VALUE)
+            queue->last_pruned = queue->seek_start;
+        queue->seek_start = MP_NOPTS_VALUE;
+        queue->next_prune_target = queue->tail; // (prune all if none found)
+        while (prev->next) {
+            struct demux_packet *dp = prev->next;
+            // Note that the next back_pts might be above the lowest buffered
+            // packet, but it will still be only viable lowest seek target.
+            if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE) {
+                queue->seek_start = dp->kf_seek_pts;
+                queue->next_prune_target = prev;
+                break;
+            }
+            prev = prev->next;
+        }
 
-    // It's not clear what the ideal way to prune old packets is. For now, we
-    // prune the oldest packet runs, as long as the total cache amount is too
-    // big.
-    size_t max_bytes = in->seekable_cache ? in->max_bytes_bw : 0;
-    while (in->total_bytes - in->fw_bytes > max_bytes) {
-        // (Start from least recently used range.)
-        struct demux_cached_range *range = in->ranges[0];
-        double earliest_ts = MP_NOPTS_VALUE;
-        struct demux_stream *earliest_stream = NULL;
+        update_seek_ranges(in, range);
+    }
 
-        for (int n = 0; n < range->num_streams; n++) {
-            struct demux_queue *queue = range->streams[n];
-            struct demux_stream *ds = queue->ds;
-
-            if (queue->head && queue->head != ds->reader_head) {
-                struct demux_packet *dp = queue->head;
-                double ts = dp->kf_seek_pts;
-                // Note: in obscure cases, packets might have no timestamps set,
-                // in which case we still need to prune _something_.
-                bool prune_always =
-                    !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
-                if (prune_always || !earliest_stream || ts < earliest_ts) {
-                    earliest_ts = ts;
-                    earliest_stream = ds;
-                    if (prune_always)
-                        break;
-                }
+    bool done = false;
+    while (!done && queue->head && queue->head != ds->reader_head) {
+        done = queue->next_prune_target == queue->head;
+        remove_head_packet(queue);
+    }
+
+    if (range != in->current_range && range->seek_start == MP_NOPTS_VALUE)
+        free_empty_cached_ranges(in);
+}
+
+// Return the queue in the given range whose head should be pruned next, or NULL
+// if there is none. If type is not -1, consider only streams of this type.
+// Consider only streams whose ds->prefetch flag equals prefetch.
+static struct demux_queue *find_prune_queue(struct demux_internal *in,
+                                            struct demux_cached_range *range,
+                                            int type, bool prefetch)
+{
+    double earliest_ts = MP_NOPTS_VALUE;
+    struct demux_queue *earliest = NULL;
+
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        struct demux_stream *ds = queue->ds;
+
+        if ((type >= 0 && ds->type != type) || ds->prefetch != prefetch)
+            continue;
+
+        if (queue->head && queue->head != ds->reader_head) {
+            struct demux_packet *dp = queue->head;
+            double ts = dp->kf_seek_pts;
+            // Note: in obscure cases, packets might have no timestamps set,
+            // in which case we still need to prune _something_.
+            bool prune_always =
+                !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
+            if (prune_always || !earliest || ts < earliest_ts) {
+                earliest_ts = ts;
+                earliest = queue;
+                if (prune_always)
+                    break;
             }
         }
+    }
 
-        assert(earliest_stream); // incorrect accounting of buffered sizes?
-        struct demux_stream *ds = earliest_stream;
-        struct demux_queue *queue = range->streams[ds->index];
-
-        // Prune all packets until the next keyframe or reader_head. Keeping
-        // those packets would not help with seeking at all, so we strictly
-        // drop them.
-        // In addition, we need to find the new possibly min. seek target,
-        // which in the worst case could be inside the forward buffer. The fact
-        // that many keyframe ranges without keyframes exist (audio packets)
-        // makes this much harder.
-        if (in->seekable_cache && !queue->next_prune_target) {
-            // (Has to be _after_ queue->head to drop at least 1 packet.)
-            struct demux_packet *prev = queue->head;
-            if (queue->seek_start != MP_NOPTS_VALUE)
-                queue->last_pruned = queue->seek_start;
-            queue->seek_start = MP_NOPTS_VALUE;
-            queue->next_prune_target = queue->tail; // (prune all if none found)
-            while (prev->next) {
-                struct demux_packet *dp = prev->next;
-                // Note that the next back_pts might be above the lowest buffered
-                // packet, but it will still be only viable lowest seek target.
-                if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE) {
-                    queue->seek_start = dp->kf_seek_pts;
-                    queue->next_prune_target = prev;
-                    break;
-                }
-                prev = prev->next;
+    return earliest;
+}
+
+// Enforce the per stream type limits (--demuxer-max-*-bytes). These include
+// forward and backward data, but of course only backward data can be pruned.
+static void prune_type_budgets(struct demux_internal *in)
+{
+    for (int t = 0; t < STREAM_TYPE_COUNT; t++) {
+        size_t max_bytes = in->max_bytes_type[t];
+        if (!max_bytes)
+            continue;
+
+        while (1) {
+            size_t total_bytes = 0;
+            for (int n = 0; n < in->num_streams; n++) {
+                struct demux_stream *ds = in->streams[n]->ds;
+                if (ds->type == t && !ds->prefetch)
+                    total_bytes += ds->total_bytes;
             }
+            if (total_bytes <= max_bytes)
+                break;
 
-            update_seek_ranges(range);
+            // (Start from least recently used range.)
+            struct demux_queue *queue = NULL;
+            for (int n = 0; n < in->num_ranges && !queue; n++)
+                queue = find_prune_queue(in, in->ranges[n], t, false);
+            if (!queue)
+                break; // only forward data left
+            prune_queue_head(in, queue);
         }
+    }
+}
 
-        bool done = false;
-        while (!done && queue->head && queue->head != ds->reader_head) {
-            done = queue->next_prune_target == queue->head;
-            remove_head_packet(queue);
-        }
+static size_t get_unselected_bytes(struct demux_internal *in)
+{
+    size_t total_bytes = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->prefetch)
+            total_bytes += ds->total_bytes;
+    }
+    return total_bytes;
+}
+
+// Enforce --demuxer-max-unselected-bytes. Packets of unselected streams are
+// not accounted in the other limits. They have no reader position, so all of
+// them can be pruned.
+static void prune_unselected(struct demux_internal *in)
+{
+    while (get_unselected_bytes(in) > in->max_bytes_unselected) {
+        // (Start from least recently used range.)
+        struct demux_queue *queue = NULL;
+        for (int n = 0; n < in->num_ranges && !queue; n++)
+            queue = find_prune_queue(in, in->ranges[n], -1, true);
+        assert(queue);
+        prune_queue_head(in, queue);
+    }
+}
+
+static void prune_old_packets(struct demux_internal *in)
+{
+    assert(in->current_range == in->ranges[in->num_ranges - 1]);
+
+    prune_type_budgets(in);
 
-        if (range != in->current_range && range->seek_start == MP_NOPTS_VALUE)
-            free_empty_cached_ranges(in);
+    // It's not clear what the ideal way to prune old packets is. For now, we
+    // prune the oldest packet runs, as long as the total cache amount is too
+    // big.
+    size_t max_bytes = in->seekable_cache ? in->max_bytes_bw : 0;
+    while (in->total_bytes - in->fw_bytes - get_unselected_bytes(in) >
+           max_bytes)
+    {
+        // (Start from least recently used range.)
+        struct demux_queue *queue = NULL;
+        for (int n = 0; n < in->num_ranges && !queue; n++)
+            queue = find_prune_queue(in, in->ranges[n], -1, false);
+        assert(queue); // incorrect accounting of buffered sizes?
+        prune_queue_head(in, queue);
     }
 }
 
@@ -1625,11 +1884,17 @@ static void execute_seek(struct demux_internal *in)
     pthread_mutex_lock(&in->lock);
 
     in->seeking_in_progress = MP_NOPTS_VALUE;
+    if (in->d_thread->stream)
+        in->stream_bytes = in->d_thread->stream->total_read;
 }
 
 // Make demuxing progress. Return whether progress was made.
 static bool thread_work(struct demux_internal *in)
 {
+    if (in->need_prune) {
+        in->need_prune = false;
+        prune_old_packets(in);
+    }
     if (in->run_fn) {
         in->run_fn(in->run_fn_arg);
         in->run_fn = NULL;
@@ -1662,6 +1927,7 @@ static void *demux_thread(void *pctx)
 {
     struct demux_internal *in = pctx;
     mpthread_set_name("demux");
+    mp_thread_sched_apply(in->d_thread->global, in->log, "demux");
     pthread_mutex_lock(&in->lock);
     while (!in->thread_terminate) {
         if (thread_work(in))
@@ -1686,6 +1952,7 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
         pkt->stream = ds->sh->index;
         return pkt;
     }
+retry:
     if (!ds->reader_head || ds->in->blocked)
         return NULL;
     struct demux_packet *pkt = ds->reader_head;
@@ -1701,9 +1968,19 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
     ds->last_ret_dts = pkt->dts;
 
     // The returned packet is mutated etc. and will be owned by the user.
-    pkt = demux_copy_packet(pkt);
-    if (!pkt)
-        abort();
+    if (pkt->is_cached) {
+        struct demux_packet *src = pkt;
+        pkt = demux_cache_read(ds->in->cache, src->cached_data_pos);
+        if (!pkt) {
+            MP_ERR(ds->in, "dropping packet that could not be read back\n");
+            goto retry;
+        }
+        demux_packet_copy_attribs(pkt, src);
+    } else {
+        pkt = demux_copy_packet(pkt);
+        if (!pkt)
+            abort();
+    }
     pkt->next = NULL;
 
     double ts = PTS_OR_DEF(pkt->dts, pkt->pts);
@@ -1750,7 +2027,18 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
             ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
     }
 
-    prune_old_packets(ds->in);
+    // With a demuxer thread, let it prune old packets. This avoids that the
+    // reader frees whole keyframe ranges while holding the lock, which would
+    // block the demuxer thread (and other readers) for longer. The thread is
+    // woken up only once until it has done the pruning.
+    if (ds->in->threading) {
+        if (!ds->in->need_prune) {
+            ds->in->need_prune = true;
+            pthread_cond_signal(&ds->in->wakeup);
+        }
+    } else {
+        prune_old_packets(ds->in);
+    }
     return pkt;
 }
 
@@ -1763,7 +2051,9 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
     if (!ds)
         return NULL;
     struct demux_internal *in = ds->in;
+    int64_t lock_start = mp_time_us();
     pthread_mutex_lock(&in->lock);
+    in->lock_wait_us += mp_time_us() - lock_start;
     if (ds->eager) {
         const char *t = stream_type_name(ds->type);
         MP_DBG(in, "reading packet for %s\n", t);
@@ -1809,7 +2099,9 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
     if (!ds)
         return r;
     if (ds->in->threading) {
+        int64_t lock_start = mp_time_us();
         pthread_mutex_lock(&ds->in->lock);
+        ds->in->lock_wait_us += mp_time_us() - lock_start;
         *out_pkt = dequeue_packet(ds);
         if (ds->eager) {
             r = *out_pkt ? 1 : (ds->eof ? -1 : 0);
@@ -2208,8 +2500,10 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .d_thread = talloc(demuxer, struct demuxer),
         .d_user = demuxer,
         .min_secs = opts->min_secs,
+        .join_secs = opts->join_secs,
         .max_bytes = opts->max_bytes,
         .max_bytes_bw = opts->max_bytes_bw,
+        .max_bytes_unselected = opts->max_bytes_unselected,
         .initial_state = true,
         .highest_av_pts = MP_NOPTS_VALUE,
         .seeking_in_progress = MP_NOPTS_VALUE,
@@ -2217,6 +2511,13 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     };
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
+    demux_packet_pool_ref();
+
+    for (int n = 0; n < STREAM_TYPE_COUNT; n++)
+        in->max_bytes_type[n] = opts->max_bytes_type[n];
+
+    if (opts->cache_file && opts->cache_file[0])
+        in->cache = demux_cache_create(in, in->log, opts->cache_file);
 
     in->current_range = talloc_ptrtype(in, in->current_range);
     *in->current_range = (struct demux_cached_range){
@@ -2267,6 +2568,11 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         demux_update(demuxer);
         stream_control(demuxer->stream, STREAM_CTRL_SET_READAHEAD,
                        &(int){params ? params->initial_readahead : false});
+        int64_t size = stream_get_size(demuxer->stream);
+        if (in->duration > 0 && size > 0) {
+            stream_control(demuxer->stream, STREAM_CTRL_SET_BITRATE,
+                           &(double){size / in->duration});
+        }
         int seekable = opts->seekable_cache;
         if (demuxer->is_network || stream->caching) {
             in->min_secs = MPMAX(in->min_secs, opts->min_secs_cache);
@@ -2300,6 +2606,61 @@ static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
 
+// Try to open the stream with the demuxer remembered in the probe cache.
+static struct demuxer *open_from_probe_cache(struct mpv_global *global,
+                                             struct mp_log *log,
+                                             const char *cache_file,
+                                             struct stream *stream,
+                                             struct demuxer_params *params)
+{
+    struct demux_probe_entry entry;
+    if (!demux_probe_cache_lookup(log, log, cache_file, stream, &entry))
+        return NULL;
+
+    const struct demuxer_desc *desc = NULL;
+    for (int n = 0; demuxer_list[n]; n++) {
+        if (strcmp(demuxer_list[n]->name, entry.demuxer) == 0)
+            desc = demuxer_list[n];
+    }
+    if (!desc)
+        return NULL;
+
+    // Let libavformat skip its own probing too.
+    bool set_lavf_type = entry.lavf_format && !stream->lavf_type;
+    if (set_lavf_type)
+        stream->lavf_type = talloc_strdup(stream, entry.lavf_format);
+
+    struct demuxer *demuxer =
+        open_given_type(global, log, desc, stream, params, entry.check);
+
+    if (!demuxer) {
+        mp_verbose(log, "Probe cache entry is outdated.\n");
+        if (set_lavf_type)
+            TA_FREEP(&stream->lavf_type);
+    }
+    return demuxer;
+}
+
+static void add_to_probe_cache(struct mp_log *log, const char *cache_file,
+                               struct stream *stream,
+                               const struct demuxer_desc *desc,
+                               struct demuxer *demuxer, enum demux_check check)
+{
+    struct demux_probe_entry entry = {
+        .demuxer = (char *)desc->name,
+        .check = check,
+    };
+    if (strcmp(desc->name, "lavf") == 0 && demuxer->desc == desc &&
+        demuxer->filetype)
+    {
+        // AVInputFormat.name can be a list, e.g. "mov,mp4,m4a,3gp,3g2,mj2".
+        bstr name = bstr0(demuxer->filetype);
+        bstr_split_tok(name, ",", &name, &(bstr){0});
+        entry.lavf_format = bstrto0(log, name);
+    }
+    demux_probe_cache_store(log, cache_file, stream, &entry);
+}
+
 // params can be NULL
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global)
@@ -2309,10 +2670,26 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
     char *force_format = params ? params->force_format : NULL;
+    char *probe_cache = NULL;
 
     if (!force_format)
         force_format = stream->demuxer;
 
+    struct demux_opts *opts = mp_get_config_group(log, global, &demux_conf);
+    if (opts->probe_cache && opts->probe_cache[0] &&
+        !(force_format && force_format[0]) &&
+        !(params && (params->timeline || params->init_fragment.len)))
+    {
+        probe_cache = mp_get_user_path(log, global, opts->probe_cache);
+        demuxer = open_from_probe_cache(global, log, probe_cache, stream,
+                                        params);
+        if (demuxer) {
+            talloc_steal(demuxer, log);
+            log = NULL;
+            goto done;
+        }
+    }
+
     if (force_format && force_format[0]) {
         check_levels = d_request;
         if (force_format[0] == '+') {
@@ -2338,6 +2715,10 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
             if (!check_desc || desc == check_desc) {
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
+                    if (probe_cache) {
+                        add_to_probe_cache(log, probe_cache, stream, desc,
+                                           demuxer, level);
+                    }
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -2451,12 +2832,20 @@ static void switch_current_range(struct demux_internal *in,
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags)
 {
+    // Binary search for the last indexed keyframe with seek PTS <= pts, and
+    // start the linear search from there.
     struct demux_packet *start = queue->head;
-    for (int n = 0; n < queue->num_index; n++) {
-        if (queue->index[n]->kf_seek_pts > pts)
-            break;
-        start = queue->index[n];
+    int lo = 0, hi = queue->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (QUEUE_INDEX_ENTRY(queue, mid)->kf_seek_pts > pts) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
+    if (lo > 0)
+        start = QUEUE_INDEX_ENTRY(queue, lo - 1);
 
     struct demux_packet *target = NULL;
     double target_diff = MP_NOPTS_VALUE;
@@ -2556,7 +2945,9 @@ static void execute_cache_seek(struct demux_internal *in,
         struct demux_stream *ds = in->streams[n]->ds;
         struct demux_queue *queue = range->streams[n];
 
-        struct demux_packet *target = find_seek_target(queue, pts, flags);
+        // (Unselected streams with buffered packets are never read from.)
+        struct demux_packet *target =
+            ds->selected ? find_seek_target(queue, pts, flags) : NULL;
         ds->reader_head = target;
         ds->skip_to_keyframe = !target;
         if (ds->reader_head)
@@ -2760,7 +3151,7 @@ static void initiate_refresh_seek(struct demux_internal *in,
                 ds->queue->last_dts = ds->last_ret_dts;
             }
 
-            update_seek_ranges(in->current_range);
+            update_seek_ranges(in, in->current_range);
         }
 
         start_ts -= 1.0; // small offset to get correct overlap
@@ -2772,6 +3163,43 @@ static void initiate_refresh_seek(struct demux_internal *in,
     in->seek_pts = start_ts;
 }
 
+// Start reading a just selected stream from the packets that were buffered
+// while it was unselected (see ds->prefetch). This works only if they cover
+// start_ts. Returns false if a refresh seek is needed instead.
+static bool resume_prefetched(struct demux_internal *in,
+                              struct demux_stream *ds, double start_ts)
+{
+    struct demux_queue *queue = ds->queue;
+
+    if (!queue->head || start_ts == MP_NOPTS_VALUE)
+        return false;
+
+    double head_ts = PTS_OR_DEF(queue->head->pts, queue->head->dts);
+    if (head_ts == MP_NOPTS_VALUE || head_ts > start_ts)
+        return false;
+
+    // The stream was not read, so it can't be refreshed against anything.
+    // Simply continue at the first keyframe at or after start_ts.
+    struct demux_packet *dp = queue->head;
+    for (; dp; dp = dp->next) {
+        double ts = PTS_OR_DEF(dp->pts, dp->dts);
+        if (dp->keyframe && ts != MP_NOPTS_VALUE && ts >= start_ts)
+            break;
+    }
+
+    ds->reader_head = dp;
+    ds->skip_to_keyframe = !dp;
+    if (dp)
+        ds->base_ts = PTS_OR_DEF(dp->pts, dp->dts);
+
+    recompute_buffers(ds);
+    in->fw_bytes += ds->fw_bytes;
+
+    MP_VERBOSE(in, "stream %d: resuming from buffered packets at %f\n",
+               ds->index, start_ts);
+    return true;
+}
+
 // Set whether the given stream should return packets.
 // ref_pts is used only if the stream is enabled. Then it serves as approximate
 // start pts for this stream (in the worst case it is ignored).
@@ -2787,8 +3215,11 @@ void demuxer_select_track(struct demuxer *demuxer, struct sh_stream *stream,
         ds->selected = selected;
         update_stream_selection_state(in, ds);
         in->tracks_switched = true;
-        if (ds->selected && !in->initial_state)
-            initiate_refresh_seek(in, ds, MP_ADD_PTS(ref_pts, -in->ts_offset));
+        if (ds->selected && !in->initial_state) {
+            double start_ts = MP_ADD_PTS(ref_pts, -in->ts_offset);
+            if (!resume_prefetched(in, ds, start_ts))
+                initiate_refresh_seek(in, ds, start_ts);
+        }
         if (in->threading) {
             pthread_cond_signal(&in->wakeup);
         } else {
@@ -2805,16 +3236,16 @@ void demux_set_stream_autoselect(struct demuxer *demuxer, bool autoselect)
 }
 
 // This is for demuxer implementations only. demuxer_select_track() sets the
-// logical state, while this function returns the actual state (in case the
-// demuxer attempts to cache even unselected packets for track switching - this
-// will potentially be done in the future).
+// logical state, while this function returns the actual state (the demuxer
+// caches even unselected packets for track switching if
+// --demuxer-max-unselected-bytes is set).
 bool demux_stream_is_selected(struct sh_stream *stream)
 {
     if (!stream)
         return false;
     bool r = false;
     pthread_mutex_lock(&stream->ds->in->lock);
-    r = stream->ds->selected;
+    r = stream->ds->selected || stream->ds->prefetch;
     pthread_mutex_unlock(&stream->ds->in->lock);
     return r;
 }
@@ -2896,6 +3327,22 @@ void demux_disable_cache(demuxer_t *demuxer)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Drop all cached packets behind the current playback position (including
+// other seek ranges), as if --demuxer-max-back-bytes were 0 for a moment.
+void demux_trim_cache(demuxer_t *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    size_t max_bytes_bw = in->max_bytes_bw;
+    in->max_bytes_bw = 0;
+    prune_old_packets(in);
+    free_empty_cached_ranges(in);
+    in->max_bytes_bw = max_bytes_bw;
+    pthread_mutex_unlock(&in->lock);
+}
+
 // Disallow reading any packets and make readers think there is no new data
 // yet, until a seek is issued.
 void demux_block_reading(struct demuxer *demuxer, bool block)
@@ -2970,6 +3417,27 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
     return STREAM_ERROR;
 }
 
+// Rebuild the seek range summary if any range changed since the last call.
+// must be called locked
+static void update_seek_ranges_export(struct demux_internal *in)
+{
+    if (in->seek_ranges_export_version == in->seek_ranges_version)
+        return;
+
+    in->num_seek_ranges_export = 0;
+    for (int n = 0; n < MPMIN(in->num_ranges, MAX_SEEK_RANGES); n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (range->seek_start != MP_NOPTS_VALUE) {
+            in->seek_ranges_export[in->num_seek_ranges_export++] =
+                (struct demux_seek_range){
+                    .start = MP_ADD_PTS(range->seek_start, in->ts_offset),
+                    .end = MP_ADD_PTS(range->seek_end, in->ts_offset),
+                };
+        }
+    }
+    in->seek_ranges_export_version = in->seek_ranges_version;
+}
+
 // must be called locked
 static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
 {
@@ -3025,15 +3493,43 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             r->ts_duration = r->ts_end - r->ts_reader;
         if (in->seeking || !any_packets)
             r->ts_duration = 0;
-        for (int n = 0; n < MPMIN(in->num_ranges, MAX_SEEK_RANGES); n++) {
-            struct demux_cached_range *range = in->ranges[n];
-            if (range->seek_start != MP_NOPTS_VALUE) {
-                r->seek_ranges[r->num_seek_ranges++] =
-                    (struct demux_seek_range){
-                        .start = MP_ADD_PTS(range->seek_start, in->ts_offset),
-                        .end = MP_ADD_PTS(range->seek_end, in->ts_offset),
-                    };
-            }
+        update_seek_ranges_export(in);
+        r->seek_ranges_version = in->seek_ranges_version;
+        r->num_seek_ranges = in->num_seek_ranges_export;
+        memcpy(r->seek_ranges, in->seek_ranges_export,
+               r->num_seek_ranges * sizeof(r->seek_ranges[0]));
+        return CONTROL_OK;
+    }
+    case DEMUXER_CTRL_GET_PERF_STATS: {
+        struct demux_ctrl_perf_stats *r = arg;
+        *r = (struct demux_ctrl_perf_stats){
+            .num_ranges = in->num_ranges,
+            .total_bytes = in->total_bytes,
+            .fw_bytes = in->fw_bytes,
+            .pruned_packets = in->pruned_packets,
+            .pruned_bytes = in->pruned_bytes,
+            .low_level_seeks = in->low_level_seeks,
+            .read_calls = in->read_calls,
+            .read_time = in->read_time_us / 1e6,
+            .lock_wait_time = in->lock_wait_us / 1e6,
+            .added_packets = in->added_packets,
+            .added_bytes = in->added_bytes,
+            .stream_bytes = in->stream_bytes,
+            .streams = talloc_array(NULL, struct demux_stream_perf,
+                                    in->num_streams),
+            .num_streams = in->num_streams,
+        };
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            r->streams[n] = (struct demux_stream_perf){
+                .type = ds->type,
+                .index = ds->index,
+                .selected = ds->selected,
+                .fw_packets = ds->fw_packs,
+                .fw_bytes = ds->fw_bytes,
+                .total_packets = ds->total_packs,
+                .total_bytes = ds->total_bytes,
+            };
         }
         return CONTROL_OK;
     }
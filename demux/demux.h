@@ -38,6 +38,7 @@ enum demux_ctrl {
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
     DEMUXER_CTRL_REPLACE_STREAM,
+    DEMUXER_CTRL_GET_PERF_STATS, // struct demux_ctrl_perf_stats*
 };
 
 #define MAX_SEEK_RANGES 10
@@ -56,12 +57,40 @@ struct demux_ctrl_reader_state {
     double seeking; // current low level seek target, or NOPTS
     int low_level_seeks; // number of started low level seeks
     double ts_last; // approx. timestamp of demuxer position
+    // Changes whenever seek_ranges[] changes. If it's equal to the value of a
+    // previous query, seek_ranges[] is the same as returned by that query.
+    uint64_t seek_ranges_version;
     // Positions that can be seeked to without incurring the latency of a low
     // level seek.
     int num_seek_ranges;
     struct demux_seek_range seek_ranges[MAX_SEEK_RANGES];
 };
 
+struct demux_stream_perf {
+    enum stream_type type;
+    int index;              // sh_stream.index
+    bool selected;
+    int64_t fw_packets, fw_bytes;       // readahead packets
+    int64_t total_packets, total_bytes; // packets in all cached ranges
+};
+
+// Statistics for tuning the demuxer cache. Counters are accumulated since the
+// demuxer was opened.
+struct demux_ctrl_perf_stats {
+    int num_ranges;         // number of cached ranges
+    int64_t total_bytes, fw_bytes;
+    int64_t pruned_packets, pruned_bytes;
+    int low_level_seeks;
+    int64_t read_calls;     // number of demuxer fill_buffer calls
+    double read_time;       // seconds spent in fill_buffer
+    double lock_wait_time;  // seconds readers waited for the demuxer lock
+    int64_t added_packets, added_bytes; // packets added to the cache
+    int64_t stream_bytes;   // bytes read from the stream (if any)
+    // Allocated by the control; the caller has to talloc_free() it.
+    struct demux_stream_perf *streams;
+    int num_streams;
+};
+
 struct demux_ctrl_stream_ctrl {
     int ctrl;
     void *arg;
@@ -307,6 +336,7 @@ void demux_metadata_changed(demuxer_t *demuxer);
 void demux_update(demuxer_t *demuxer);
 
 void demux_disable_cache(demuxer_t *demuxer);
+void demux_trim_cache(demuxer_t *demuxer);
 
 struct sh_stream *demuxer_stream_by_demuxer_id(struct demuxer *d,
                                                enum stream_type t, int id);
@@ -30,11 +30,15 @@
 #include "common/msg.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
 #include "stream/stream.h"
 
 #define HEADER "# mpv EDL v0\n"
 
+// Maximum number of source files opened at the same time.
+#define MAX_OPEN_THREADS 4
+
 struct tl_part {
     char *filename;             // what is stream_open()ed
     double offset;              // offset into the source file
@@ -177,6 +181,62 @@ static struct demuxer *open_source(struct timeline *tl, char *filename)
     return d;
 }
 
+struct open_job {
+    struct timeline *tl;
+    char *filename;
+    struct demuxer *d;
+};
+
+static void open_source_job(void *ctx)
+{
+    struct open_job *job = ctx;
+    struct demuxer_params params = {
+        .init_fragment = job->tl->init_fragment,
+    };
+    job->d = demux_open_url(job->filename, &params, job->tl->cancel,
+                            job->tl->global);
+}
+
+// Open all files referenced by the parts concurrently, and add them to the
+// sources in the order they are referenced. Files that fail to open are left
+// to open_source(), which reports the error.
+static void open_sources(struct timeline *tl, struct tl_parts *parts)
+{
+    void *tmp = talloc_new(NULL);
+    struct open_job *jobs = NULL;
+    int num_jobs = 0;
+
+    for (int n = 0; n < parts->num_parts; n++) {
+        char *filename = parts->parts[n].filename;
+        bool found = false;
+        for (int i = 0; i < num_jobs; i++)
+            found |= strcmp(jobs[i].filename, filename) == 0;
+        if (!found) {
+            struct open_job job = {.tl = tl, .filename = filename};
+            MP_TARRAY_APPEND(tmp, jobs, num_jobs, job);
+        }
+    }
+
+    struct mp_thread_pool *pool = NULL;
+    if (num_jobs > 1)
+        pool = mp_thread_pool_create(tmp, MPMIN(num_jobs, MAX_OPEN_THREADS));
+    if (!pool)
+        goto done;
+
+    MP_VERBOSE(tl, "Opening %d source files...\n", num_jobs);
+    for (int n = 0; n < num_jobs; n++)
+        mp_thread_pool_queue(pool, open_source_job, &jobs[n]);
+    talloc_free(pool); // waits until all jobs are done
+
+    for (int n = 0; n < num_jobs; n++) {
+        if (jobs[n].d)
+            MP_TARRAY_APPEND(tl, tl->sources, tl->num_sources, jobs[n].d);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static double demuxer_chapter_time(struct demuxer *demuxer, int n)
 {
     if (n < 0 || n >= demuxer->num_chapters)
@@ -244,6 +304,9 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
         }
     }
 
+    if (!tl->dash)
+        open_sources(tl, parts);
+
     tl->parts = talloc_array_ptrtype(tl, tl->parts, parts->num_parts + 1);
     double starttime = 0;
     for (int n = 0; n < parts->num_parts; n++) {
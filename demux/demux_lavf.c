@@ -37,7 +37,10 @@
 #include <libavutil/spherical.h>
 #include <libavutil/display.h>
 #include <libavutil/opt.h>
+#include <libavutil/md5.h>
 
+#include "osdep/getpid.h"
+#include "osdep/io.h"
 #include "common/msg.h"
 #include "common/tags.h"
 #include "common/av_common.h"
@@ -47,6 +50,7 @@
 #include "stream/stream.h"
 #include "demux.h"
 #include "stheader.h"
+#include "hls_prefetch.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
@@ -79,6 +83,8 @@ struct demux_lavf_opts {
     int hacks;
     char *sub_cp;
     int rtsp_transport;
+    char *stream_info_cache;
+    int hls_prefetch;
 };
 
 const struct m_sub_options demux_lavf_conf = {
@@ -102,6 +108,9 @@ const struct m_sub_options demux_lavf_conf = {
                 {"udp", 1},
                 {"tcp", 2},
                 {"http", 3})),
+        OPT_STRING("demuxer-lavf-stream-info-cache", stream_info_cache,
+                   M_OPT_FILE),
+        OPT_INTRANGE("demuxer-lavf-hls-prefetch", hls_prefetch, 0, 0, 16),
         {0}
     },
     .size = sizeof(struct demux_lavf_opts),
@@ -210,6 +219,13 @@ typedef struct lavf_priv {
 
     struct demux_lavf_opts *opts;
     double mf_fps;
+
+    struct hls_prefetch *hls_prefetch;
+
+    // Last PIDs reported with STREAM_CTRL_DVB_SET_TRACK_PIDS.
+    int *track_pids;
+    int num_track_pids;
+    bool no_track_pids;     // stream does not support it
 } lavf_priv_t;
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -240,6 +256,12 @@ static int mp_read(void *opaque, uint8_t *buf, int size)
         ret = MPMIN(size, priv->init_fragment.len - priv->stream_pos);
         memcpy(buf, priv->init_fragment.start + priv->stream_pos, ret);
         priv->stream_pos += ret;
+    } else if (stream->is_local_file && size >= STREAM_BUFFER_SIZE) {
+        // Fill the whole request. Whatever is not in the stream buffer is read
+        // directly into buf, instead of being returned in small partial reads
+        // through the stream buffer. (Could block too long on network.)
+        ret = stream_read(stream, buf, size);
+        priv->stream_pos = priv->init_fragment.len + stream_tell(stream);
     } else {
         ret = stream_read_partial(stream, buf, size);
         priv->stream_pos = priv->init_fragment.len + stream_tell(stream);
@@ -548,6 +570,53 @@ static void select_tracks(struct demuxer *demuxer, int start)
     }
 }
 
+// Tell a DVB stream which TS PIDs are needed for the selected tracks, so it can
+// filter out the rest in the kernel.
+static void update_track_pids(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+    if (priv->no_track_pids || !matches_avinputformat_name(priv, "mpegts"))
+        return;
+
+    int *pids = NULL;
+    int num_pids = 0;
+    for (int n = 0; n < priv->num_streams; n++) {
+        struct sh_stream *sh = priv->streams[n];
+        if (sh && demux_stream_is_selected(sh))
+            MP_TARRAY_APPEND(NULL, pids, num_pids, avfc->streams[n]->id);
+    }
+    // The programs' PMT and PCR are needed too.
+    int num_tracks = num_pids;
+    for (int p = 0; p < avfc->nb_programs && num_tracks; p++) {
+        AVProgram *prog = avfc->programs[p];
+        bool used = false;
+        for (int i = 0; i < prog->nb_stream_indexes; i++) {
+            struct sh_stream *sh = priv->streams[prog->stream_index[i]];
+            used |= sh && demux_stream_is_selected(sh);
+        }
+        if (used) {
+            MP_TARRAY_APPEND(NULL, pids, num_pids, prog->pmt_pid);
+            if (prog->pcr_pid > 0)
+                MP_TARRAY_APPEND(NULL, pids, num_pids, prog->pcr_pid);
+        }
+    }
+
+    if (num_pids != priv->num_track_pids ||
+        (num_pids && memcmp(pids, priv->track_pids, num_pids * sizeof(int))))
+    {
+        struct stream_dvb_pids req = {pids, num_pids};
+        int r = stream_control(priv->stream, STREAM_CTRL_DVB_SET_TRACK_PIDS,
+                               &req);
+        priv->no_track_pids = r == STREAM_UNSUPPORTED;
+        talloc_free(priv->track_pids);
+        priv->track_pids = talloc_steal(priv, pids);
+        priv->num_track_pids = num_pids;
+    } else {
+        talloc_free(pids);
+    }
+}
+
 static void export_replaygain(demuxer_t *demuxer, struct sh_stream *sh,
                               AVStream *st)
 {
@@ -804,6 +873,286 @@ static int block_io_open(struct AVFormatContext *s, AVIOContext **pb,
     return AVERROR(EACCES);
 }
 
+static int prefetch_io_open(struct AVFormatContext *s, AVIOContext **pb,
+                            const char *url, int flags, AVDictionary **options)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    return hls_prefetch_io_open(priv->hls_prefetch, s, pb, url, flags, options);
+}
+
+static void prefetch_io_close(struct AVFormatContext *s, AVIOContext *pb)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    hls_prefetch_io_close(priv->hls_prefetch, s, pb);
+}
+
+// Persisted results of avformat_find_stream_info(). The file format is the
+// raw struct below, and is only valid for the libavformat version and build it
+// was written with (both are checked through the header).
+#define STREAM_INFO_MAGIC "mpv-lavf-stream-info\n"
+
+struct stream_info_header {
+    char magic[sizeof(STREAM_INFO_MAGIC)];
+    uint32_t lavf_version;
+    uint32_t entry_size;
+    uint32_t num_streams;
+    uint32_t key_len;           // followed by the key string
+    // Estimated by avformat_find_stream_info() for some formats (like TS).
+    int64_t duration, start_time, bit_rate;
+};
+
+struct stream_info_entry {
+    int64_t id;
+    int64_t duration, start_time; // in the stream time base
+    AVRational time_base;
+    int64_t bit_rate;
+    uint64_t channel_layout;
+    AVRational sample_aspect_ratio, avg_frame_rate, r_frame_rate;
+    int32_t codec_type, codec_id, format;
+    uint32_t codec_tag;
+    int32_t bits_per_coded_sample, bits_per_raw_sample, profile, level;
+    int32_t width, height, field_order, video_delay;
+    int32_t color_range, color_primaries, color_trc, color_space;
+    int32_t chroma_location;
+    int32_t channels, sample_rate, block_align, frame_size;
+    int32_t initial_padding, trailing_padding, seek_preroll;
+    int32_t extradata_size;     // followed by the extradata
+};
+
+// Return the cache file name and the key stored in it, or NULL.
+static char *get_stream_info_file(void *ta_parent, struct demuxer *demuxer,
+                                  char **key)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    struct stream *s = priv->stream;
+    char *dir = priv->opts->stream_info_cache;
+
+    if (!dir || !dir[0])
+        return NULL;
+    if (demuxer->params && demuxer->params->init_fragment.len)
+        return NULL;
+
+    *key = talloc_strdup(ta_parent, s->url);
+    while (s->underlying)
+        s = s->underlying;
+    if (s->is_local_file && s->path) {
+        struct stat st;
+        if (stat(s->path, &st) != 0)
+            return NULL;
+        int64_t size = st.st_size, mtime = st.st_mtime;
+        *key = talloc_asprintf_append(*key, " %"PRId64" %"PRId64, size, mtime);
+    }
+
+    uint8_t md5[16];
+    av_md5_sum(md5, *key, strlen(*key));
+    char *name = talloc_strdup(ta_parent, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+
+    char *path = mp_get_user_path(ta_parent, demuxer->global, dir);
+    return mp_path_join(ta_parent, path, name);
+}
+
+// Try to set the codec parameters of the already opened streams from the
+// cache. Return true if all streams matched and were set.
+static bool load_stream_info(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+    FILE *f = NULL;
+
+    char *key;
+    char *filename = get_stream_info_file(tmp, demuxer, &key);
+    if (!filename || !avfc->nb_streams)
+        goto done;
+    f = fopen(filename, "rb");
+    if (!f)
+        goto done;
+
+    struct stream_info_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, STREAM_INFO_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.lavf_version != LIBAVFORMAT_VERSION_INT ||
+        hdr.entry_size != sizeof(struct stream_info_entry) ||
+        hdr.num_streams != avfc->nb_streams || hdr.key_len != strlen(key))
+        goto done;
+    char *file_key = talloc_size(tmp, hdr.key_len);
+    if (fread(file_key, hdr.key_len, 1, f) != 1 ||
+        memcmp(file_key, key, hdr.key_len) != 0)
+        goto done;
+
+    struct stream_info_entry *entries =
+        talloc_array(tmp, struct stream_info_entry, hdr.num_streams);
+    uint8_t **extradata = talloc_zero_array(tmp, uint8_t *, hdr.num_streams);
+    for (int n = 0; n < hdr.num_streams; n++) {
+        struct stream_info_entry *e = &entries[n];
+        AVStream *st = avfc->streams[n];
+        if (fread(e, sizeof(*e), 1, f) != 1 || e->id != st->id ||
+            av_cmp_q(e->time_base, st->time_base) != 0 ||
+            e->extradata_size < 0 || e->extradata_size > (1 << 24))
+            goto done;
+        if (st->codecpar->codec_type != AVMEDIA_TYPE_UNKNOWN &&
+            st->codecpar->codec_type != e->codec_type)
+            goto done;
+        extradata[n] = talloc_size(tmp, e->extradata_size + 1);
+        if (e->extradata_size &&
+            fread(extradata[n], e->extradata_size, 1, f) != 1)
+            goto done;
+    }
+
+    for (int n = 0; n < hdr.num_streams; n++) {
+        struct stream_info_entry *e = &entries[n];
+        AVStream *st = avfc->streams[n];
+        AVCodecParameters *c = st->codecpar;
+        uint8_t *new_extradata = NULL;
+        if (e->extradata_size) {
+            new_extradata =
+                av_mallocz(e->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!new_extradata)
+                goto done;
+            memcpy(new_extradata, extradata[n], e->extradata_size);
+        }
+        av_freep(&c->extradata);
+        c->extradata = new_extradata;
+        c->extradata_size = e->extradata_size;
+        c->codec_type = e->codec_type;
+        c->codec_id = e->codec_id;
+        c->codec_tag = e->codec_tag;
+        c->format = e->format;
+        c->bit_rate = e->bit_rate;
+        c->bits_per_coded_sample = e->bits_per_coded_sample;
+        c->bits_per_raw_sample = e->bits_per_raw_sample;
+        c->profile = e->profile;
+        c->level = e->level;
+        c->width = e->width;
+        c->height = e->height;
+        c->sample_aspect_ratio = e->sample_aspect_ratio;
+        c->field_order = e->field_order;
+        c->color_range = e->color_range;
+        c->color_primaries = e->color_primaries;
+        c->color_trc = e->color_trc;
+        c->color_space = e->color_space;
+        c->chroma_location = e->chroma_location;
+        c->video_delay = e->video_delay;
+        c->channel_layout = e->channel_layout;
+        c->channels = e->channels;
+        c->sample_rate = e->sample_rate;
+        c->block_align = e->block_align;
+        c->frame_size = e->frame_size;
+        c->initial_padding = e->initial_padding;
+        c->trailing_padding = e->trailing_padding;
+        c->seek_preroll = e->seek_preroll;
+        st->sample_aspect_ratio = e->sample_aspect_ratio;
+        st->avg_frame_rate = e->avg_frame_rate;
+        st->r_frame_rate = e->r_frame_rate;
+        st->duration = e->duration;
+        st->start_time = e->start_time;
+    }
+    avfc->duration = hdr.duration;
+    avfc->start_time = hdr.start_time;
+    avfc->bit_rate = hdr.bit_rate;
+
+    MP_VERBOSE(demuxer, "Using cached stream info from %s\n", filename);
+    ok = true;
+
+done:
+    if (f)
+        fclose(f);
+    talloc_free(tmp);
+    return ok;
+}
+
+static void save_stream_info(struct demuxer *demuxer)
+{
+    lavf_priv_t *priv = demuxer->priv;
+    AVFormatContext *avfc = priv->avfc;
+    void *tmp = talloc_new(NULL);
+
+    char *key;
+    char *filename = get_stream_info_file(tmp, demuxer, &key);
+    if (!filename || !avfc->nb_streams)
+        goto done;
+
+    // Write a temporary file and rename it, so that concurrently running
+    // instances never read a partially written file.
+    mp_mkdirp(bstrto0(tmp, mp_dirname(filename)));
+    char *tmp_filename = talloc_asprintf(tmp, "%s.%d.tmp", filename,
+                                         mp_getpid());
+    FILE *f = fopen(tmp_filename, "wb");
+    if (!f) {
+        MP_WARN(demuxer, "Can't write stream info cache %s\n", filename);
+        goto done;
+    }
+
+    struct stream_info_header hdr = {
+        .magic = STREAM_INFO_MAGIC,
+        .lavf_version = LIBAVFORMAT_VERSION_INT,
+        .entry_size = sizeof(struct stream_info_entry),
+        .num_streams = avfc->nb_streams,
+        .key_len = strlen(key),
+        .duration = avfc->duration,
+        .start_time = avfc->start_time,
+        .bit_rate = avfc->bit_rate,
+    };
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(key, hdr.key_len, 1, f) == 1;
+    for (int n = 0; ok && n < avfc->nb_streams; n++) {
+        AVStream *st = avfc->streams[n];
+        AVCodecParameters *c = st->codecpar;
+        struct stream_info_entry e = {
+            .id = st->id,
+            .duration = st->duration,
+            .start_time = st->start_time,
+            .time_base = st->time_base,
+            .bit_rate = c->bit_rate,
+            .channel_layout = c->channel_layout,
+            .sample_aspect_ratio = c->sample_aspect_ratio,
+            .avg_frame_rate = st->avg_frame_rate,
+            .r_frame_rate = st->r_frame_rate,
+            .codec_type = c->codec_type,
+            .codec_id = c->codec_id,
+            .format = c->format,
+            .codec_tag = c->codec_tag,
+            .bits_per_coded_sample = c->bits_per_coded_sample,
+            .bits_per_raw_sample = c->bits_per_raw_sample,
+            .profile = c->profile,
+            .level = c->level,
+            .width = c->width,
+            .height = c->height,
+            .field_order = c->field_order,
+            .video_delay = c->video_delay,
+            .color_range = c->color_range,
+            .color_primaries = c->color_primaries,
+            .color_trc = c->color_trc,
+            .color_space = c->color_space,
+            .chroma_location = c->chroma_location,
+            .channels = c->channels,
+            .sample_rate = c->sample_rate,
+            .block_align = c->block_align,
+            .frame_size = c->frame_size,
+            .initial_padding = c->initial_padding,
+            .trailing_padding = c->trailing_padding,
+            .seek_preroll = c->seek_preroll,
+            .extradata_size = c->extradata_size,
+        };
+        ok = fwrite(&e, sizeof(e), 1, f) == 1 &&
+             (!e.extradata_size ||
+              fwrite(c->extradata, e.extradata_size, 1, f) == 1);
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        MP_WARN(demuxer, "Failed to write stream info cache %s\n", filename);
+        unlink(tmp_filename);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     AVFormatContext *avfc;
@@ -898,8 +1247,25 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     };
 
     avfc->opaque = demuxer;
-    if (!demuxer->access_references)
+    if (!demuxer->access_references) {
         avfc->io_open = block_io_open;
+    } else if (lavfdopts->hls_prefetch > 0 &&
+               matches_avinputformat_name(priv, "hls"))
+    {
+        priv->hls_prefetch = hls_prefetch_create(avfc, demuxer->log,
+                                                 priv->stream->cancel,
+                                                 lavfdopts->hls_prefetch);
+        if (priv->hls_prefetch) {
+            avfc->io_open = prefetch_io_open;
+            avfc->io_close = prefetch_io_close;
+            if (avfc->pb) {
+                int max = STREAM_MAX_BUFFER_SIZE;
+                bstr data = stream_peek(priv->stream, max);
+                hls_prefetch_set_main(priv->hls_prefetch, priv->filename,
+                                      data, data.len < max);
+            }
+        }
+    }
 
     mp_set_avdict(&dopts, lavfdopts->avopts);
 
@@ -921,6 +1287,8 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     }
     if (demuxer->params && demuxer->params->skip_lavf_probing)
         probeinfo = false;
+    if (probeinfo && load_stream_info(demuxer))
+        probeinfo = false;
     if (probeinfo) {
         if (avformat_find_stream_info(avfc, NULL) < 0) {
             MP_ERR(demuxer, "av_find_stream_info() failed\n");
@@ -929,6 +1297,8 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 
         MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
                    " bytes.\n", stream_tell(priv->stream));
+
+        save_stream_info(demuxer);
     }
 
     for (int i = 0; i < avfc->nb_chapters; i++) {
@@ -1101,6 +1471,7 @@ static int demux_lavf_control(demuxer_t *demuxer, int cmd, void *arg)
     case DEMUXER_CTRL_SWITCHED_TRACKS:
     {
         select_tracks(demuxer, 0);
+        update_track_pids(demuxer);
         return CONTROL_OK;
     }
     case DEMUXER_CTRL_IDENTIFY_PROGRAM:
@@ -1188,6 +1559,7 @@ static void demux_close_lavf(demuxer_t *demuxer)
     lavf_priv_t *priv = demuxer->priv;
     if (priv) {
         avformat_close_input(&priv->avfc);
+        hls_prefetch_destroy(priv->hls_prefetch);
         if (priv->pb)
             av_freep(&priv->pb->buffer);
         av_freep(&priv->pb);
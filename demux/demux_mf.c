@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -30,6 +31,7 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -38,16 +40,41 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+// Maximum number of threads for --mf-prefetch.
+#define MF_MAX_THREADS 16
+
+struct mf_read;
+
 typedef struct mf {
     struct mp_log *log;
+    struct mpv_global *global;
     struct sh_stream *sh;
     int curr_frame;
     int nr_of_files;
     char **names;
     // optional
     struct stream **streams;
+
+    // Read-ahead (if prefetch > 0).
+    int prefetch;
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Files curr_frame...curr_frame+num_reads-1, which are being read or were
+    // read by the thread pool.
+    struct mf_read **reads;
+    int num_reads;
 } mf_t;
 
+struct mf_read {
+    mf_t *mf;
+    char *filename;
+    // --- protected by mf->lock
+    bool done;
+    bool abandoned;     // not needed anymore; freed by the worker when done
+    bstr data;          // file contents, set if done (talloc'ed, no parent)
+};
+
 
 static void mf_add(mf_t *mf, const char *fname)
 {
@@ -160,6 +187,84 @@ static mf_t *open_mf_single(void *talloc_ctx, struct mp_log *log, char *filename
     return mf;
 }
 
+static void free_read(struct mf_read *r)
+{
+    talloc_free(r->data.start);
+    talloc_free(r);
+}
+
+// Runs on the thread pool. (Uses no talloc parents shared with other threads.)
+static void read_file(void *ctx)
+{
+    struct mf_read *r = ctx;
+    mf_t *mf = r->mf;
+
+    bstr data = {0};
+    struct stream *stream = stream_open(r->filename, mf->global);
+    if (stream) {
+        data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+        free_stream(stream);
+    }
+
+    pthread_mutex_lock(&mf->lock);
+    r->data = data;
+    r->done = true;
+    if (r->abandoned)
+        free_read(r);
+    pthread_cond_broadcast(&mf->wakeup);
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Discard all read-ahead (e.g. on seeks).
+static void drop_reads(mf_t *mf)
+{
+    pthread_mutex_lock(&mf->lock);
+    for (int n = 0; n < mf->num_reads; n++) {
+        struct mf_read *r = mf->reads[n];
+        if (r->done || mp_thread_pool_cancel(mf->pool, read_file, r)) {
+            free_read(r);
+        } else {
+            r->abandoned = true;
+        }
+    }
+    mf->num_reads = 0;
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Start reading the files after curr_frame, up to the prefetch limit.
+static void queue_reads(mf_t *mf)
+{
+    pthread_mutex_lock(&mf->lock);
+    while (mf->num_reads < mf->prefetch &&
+           mf->curr_frame + mf->num_reads < mf->nr_of_files)
+    {
+        struct mf_read *r = talloc_zero(NULL, struct mf_read);
+        r->mf = mf;
+        r->filename = talloc_strdup(r, mf->names[mf->curr_frame + mf->num_reads]);
+        MP_TARRAY_APPEND(mf, mf->reads, mf->num_reads, r);
+        mp_thread_pool_queue(mf->pool, read_file, r);
+    }
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Wait for the read-ahead of curr_frame and return its data.
+static bstr get_prefetched(mf_t *mf)
+{
+    queue_reads(mf);
+
+    pthread_mutex_lock(&mf->lock);
+    assert(mf->num_reads > 0);
+    struct mf_read *r = mf->reads[0];
+    while (!r->done)
+        pthread_cond_wait(&mf->wakeup, &mf->lock);
+    MP_TARRAY_REMOVE_AT(mf->reads, mf->num_reads, 0);
+    pthread_mutex_unlock(&mf->lock);
+
+    bstr data = r->data;
+    talloc_free(r);
+    return data;
+}
+
 static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
 {
     mf_t *mf = demuxer->priv;
@@ -170,6 +275,8 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
         newpos = 0;
     if (newpos >= mf->nr_of_files)
         newpos = mf->nr_of_files;
+    if (mf->pool && newpos != mf->curr_frame)
+        drop_reads(mf);
     mf->curr_frame = newpos;
 }
 
@@ -182,6 +289,24 @@ static int demux_mf_fill_buffer(demuxer_t *demuxer)
     if (mf->curr_frame >= mf->nr_of_files)
         return 0;
 
+    if (mf->pool) {
+        bstr data = get_prefetched(mf);
+        if (data.len) {
+            demux_packet_t *dp = new_demux_packet(data.len);
+            if (dp) {
+                memcpy(dp->buffer, data.start, data.len);
+                dp->pts = mf->curr_frame / mf->sh->codec->fps;
+                dp->keyframe = true;
+                demux_add_packet(mf->sh, dp);
+            }
+        } else {
+            MP_WARN(mf, "Could not read '%s'.\n", mf->names[mf->curr_frame]);
+        }
+        talloc_free(data.start);
+        mf->curr_frame++;
+        return 1;
+    }
+
     struct stream *entry_stream = NULL;
     if (mf->streams)
         entry_stream = mf->streams[mf->curr_frame];
@@ -308,8 +433,11 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
     mp_read_option_raw(demuxer->global, "mf-fps", &m_option_type_double, &mf_fps);
     mp_read_option_raw(demuxer->global, "mf-type", &m_option_type_string, &mf_type);
+    mp_read_option_raw(demuxer->global, "mf-prefetch", &m_option_type_int,
+                       &mf_prefetch);
 
     const char *codec = mp_map_mimetype_to_video_codec(demuxer->stream->mime_type);
     if (!codec || (mf_type && mf_type[0]))
@@ -337,6 +465,21 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demuxer->seekable = true;
     demuxer->duration = mf->nr_of_files / mf->sh->codec->fps;
 
+    // (Not for single files opened from demuxer->stream.)
+    if (mf_prefetch > 0 && !mf->streams && mf->nr_of_files > 1) {
+        mf->global = demuxer->global;
+        mf->prefetch = mf_prefetch;
+        pthread_mutex_init(&mf->lock, NULL);
+        pthread_cond_init(&mf->wakeup, NULL);
+        mf->pool = mp_thread_pool_create(NULL, MPMIN(mf_prefetch,
+                                                     MF_MAX_THREADS));
+        if (!mf->pool) {
+            MP_WARN(mf, "Could not create threads, disabling read-ahead.\n");
+            pthread_cond_destroy(&mf->wakeup);
+            pthread_mutex_destroy(&mf->lock);
+        }
+    }
+
     return 0;
 
 error:
@@ -345,6 +488,16 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+
+    if (mf && mf->pool) {
+        drop_reads(mf);
+        // Waits for abandoned reads, which still access mf->lock.
+        talloc_free(mf->pool);
+        mf->pool = NULL;
+        pthread_cond_destroy(&mf->wakeup);
+        pthread_mutex_destroy(&mf->lock);
+    }
 }
 
 const demuxer_desc_t demuxer_desc_mf = {
@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
@@ -46,6 +47,7 @@
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -157,6 +159,7 @@ typedef struct mkv_index {
 struct block_info {
     uint64_t duration, discardpadding;
     bool simple, keyframe, duration_known;
+    bool decoded; // content encodings were applied while reading the laces
     int64_t timecode;
     mkv_track_t *track;
     // Actual packet data.
@@ -210,6 +213,10 @@ typedef struct mkv_demuxer {
     // temporary data, and not normally larger than 0 or 1 elements.
     struct block_info *blocks;
     int num_blocks;
+
+    // Background index creation (if enabled and needed).
+    struct mp_thread_pool *bg_pool;
+    struct bg_index *bg_index;
 } mkv_demuxer_t;
 
 #define OPT_BASE_STRUCT struct demux_mkv_opts
@@ -219,6 +226,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    int background_index;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -232,6 +240,7 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_FLAG("background-index", background_index, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -247,6 +256,12 @@ const struct m_sub_options demux_mkv_conf = {
 #define RAPROPERTIES4_SIZE 56
 #define RAPROPERTIES5_SIZE 70
 
+// Maximum amount of cluster data read at once by prefetch_cluster_data().
+#define CLUSTER_READ_SIZE (1024 * 1024)
+// Refill the stream buffer only if less than this is left in it. Elements
+// larger than this are not prefetched.
+#define CLUSTER_READ_MIN 4096
+
 // Maximum number of subtitle packets that are accepted for pre-roll.
 // (Subtitle packets added before first A/V keyframe packet is found with seek.)
 #define NUM_SUB_PREROLL_PACKETS 500
@@ -1310,6 +1325,278 @@ static void read_deferred_cues(demuxer_t *demuxer)
     }
 }
 
+// Index created by scanning all clusters on a separate thread, for files
+// without cues. The worker uses its own stream, and shares nothing with the
+// demuxer except this struct. The demuxer picks up the result on the next
+// seek once the scan has finished.
+struct bg_index {
+    pthread_mutex_t lock;
+    bool done;                  // worker finished (protected by lock)
+
+    // Set on creation, read-only afterwards.
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    char *url;
+    int64_t start_pos, end_pos;
+    int64_t *tnums;
+    int num_tnums;
+
+    // Written by the worker only; owned by the demuxer after done is set.
+    bool success;
+    mkv_index_t *indexes;
+    size_t num_indexes;
+    int64_t *last_tc;           // per entry in tnums, last indexed timecode
+};
+
+static void bg_index_destroy(void *ptr)
+{
+    struct bg_index *bg = ptr;
+    pthread_mutex_destroy(&bg->lock);
+}
+
+static void bg_index_add(struct bg_index *bg, uint64_t tnum, int64_t filepos,
+                         int64_t timecode, int64_t duration)
+{
+    for (int n = 0; n < bg->num_tnums; n++) {
+        if (bg->tnums[n] == tnum) {
+            // Same rule as add_block_position().
+            if (bg->last_tc[n] >= timecode)
+                return;
+            bg->last_tc[n] = timecode;
+            MP_TARRAY_APPEND(bg, bg->indexes, bg->num_indexes, (mkv_index_t){
+                .tnum = tnum,
+                .filepos = filepos,
+                .timecode = timecode,
+                .duration = duration,
+            });
+            return;
+        }
+    }
+}
+
+// Parse the header of a Block or SimpleBlock, and skip the block data.
+static bool bg_index_read_block(stream_t *s, int64_t end, uint64_t *tnum,
+                                int16_t *time, uint8_t *flags)
+{
+    uint64_t length = ebml_read_length(s);
+    if (!length || length > 500000000 || stream_tell(s) + length > (uint64_t)end)
+        return false;
+    uint64_t endpos = stream_tell(s) + length;
+    *tnum = ebml_read_length(s);
+    if (*tnum == EBML_UINT_INVALID || stream_tell(s) + 3 > endpos)
+        return false;
+    uint8_t c1 = stream_read_char(s);
+    uint8_t c2 = stream_read_char(s);
+    *time = c1 << 8 | c2;
+    *flags = stream_read_char(s);
+    return stream_seek(s, endpos);
+}
+
+static bool bg_index_read_cluster(struct bg_index *bg, stream_t *s,
+                                  int64_t cluster_pos, int64_t end)
+{
+    uint64_t cluster_tc = 0;
+    while (stream_tell(s) < end) {
+        uint32_t id = ebml_read_id(s);
+        switch (id) {
+        case MATROSKA_ID_TIMECODE:
+            cluster_tc = ebml_read_uint(s);
+            if (cluster_tc == EBML_UINT_INVALID)
+                return false;
+            break;
+
+        case MATROSKA_ID_SIMPLEBLOCK: {
+            uint64_t tnum;
+            int16_t time;
+            uint8_t flags;
+            if (!bg_index_read_block(s, end, &tnum, &time, &flags))
+                return false;
+            if (flags & 0x80)
+                bg_index_add(bg, tnum, cluster_pos, cluster_tc + time, 0);
+            break;
+        }
+
+        case MATROSKA_ID_BLOCKGROUP: {
+            uint64_t len = ebml_read_length(s);
+            if (len == EBML_UINT_INVALID || stream_tell(s) + len > end)
+                return false;
+            int64_t group_end = stream_tell(s) + len;
+            bool have_block = false, keyframe = true;
+            uint64_t tnum = 0, duration = 0;
+            int16_t time = 0;
+            uint8_t flags;
+            while (stream_tell(s) < group_end) {
+                switch (ebml_read_id(s)) {
+                case MATROSKA_ID_BLOCK:
+                    if (!bg_index_read_block(s, group_end, &tnum, &time, &flags))
+                        return false;
+                    have_block = true;
+                    break;
+                case MATROSKA_ID_BLOCKDURATION:
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        return false;
+                    break;
+                case MATROSKA_ID_REFERENCEBLOCK:
+                    if (ebml_read_int(s) == EBML_INT_INVALID)
+                        return false;
+                    keyframe = false;
+                    break;
+                case EBML_ID_INVALID:
+                    return false;
+                default:
+                    if (ebml_read_skip(bg->log, group_end, s) != 0)
+                        return false;
+                }
+            }
+            if (have_block && keyframe)
+                bg_index_add(bg, tnum, cluster_pos, cluster_tc + time, duration);
+            break;
+        }
+
+        case EBML_ID_INVALID:
+            return false;
+
+        default:
+            if (ebml_read_skip(bg->log, end, s) != 0)
+                return false;
+        }
+        if (s->eof)
+            return false;
+    }
+    return true;
+}
+
+static void bg_index_run(void *ctx)
+{
+    struct bg_index *bg = ctx;
+
+    stream_t *s = stream_create(bg->url, STREAM_READ, bg->cancel, bg->global);
+    if (!s || !stream_seek(s, bg->start_pos))
+        goto done;
+
+    while (!mp_cancel_test(bg->cancel)) {
+        int64_t pos = stream_tell(s);
+        if (bg->end_pos > 0 && pos >= bg->end_pos) {
+            bg->success = true;
+            break;
+        }
+        uint32_t id = ebml_read_id(s);
+        if (s->eof) {
+            bg->success = true;
+            break;
+        }
+        if (id == EBML_ID_INVALID)
+            break;
+        if (id != MATROSKA_ID_CLUSTER) {
+            if (ebml_read_skip(bg->log, -1, s) != 0)
+                break;
+            continue;
+        }
+        uint64_t len = ebml_read_length(s);
+        if (len == EBML_UINT_INVALID)
+            break; // unknown-size cluster; would require full parsing
+        int64_t end = stream_tell(s) + len;
+        if (!bg_index_read_cluster(bg, s, pos, end) || !stream_seek(s, end))
+            break;
+    }
+
+    if (bg->success) {
+        MP_VERBOSE(bg, "background index done (%zu entries)\n", bg->num_indexes);
+    } else if (!mp_cancel_test(bg->cancel)) {
+        MP_VERBOSE(bg, "background index creation failed\n");
+    }
+
+done:
+    free_stream(s);
+    pthread_mutex_lock(&bg->lock);
+    bg->done = true;
+    pthread_mutex_unlock(&bg->lock);
+}
+
+static void start_bg_index(struct demuxer *demuxer, int64_t cluster_pos)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    stream_t *s = demuxer->stream;
+
+    if (!mkv_d->opts->background_index || mkv_d->index_complete ||
+        mkv_d->index_mode != 1 || !demuxer->seekable || !s->is_local_file ||
+        !mkv_d->num_tracks)
+        return;
+
+    mkv_d->bg_pool = mp_thread_pool_create(mkv_d, 1);
+    if (!mkv_d->bg_pool)
+        return;
+
+    // Freeing the pool waits for the worker before bg is freed.
+    struct bg_index *bg = talloc_ptrtype(mkv_d->bg_pool, bg);
+    *bg = (struct bg_index){
+        .global = demuxer->global,
+        .log = mp_log_new(bg, demuxer->log, "bgindex"),
+        .cancel = mp_cancel_new(bg),
+        .url = talloc_strdup(bg, s->url),
+        .start_pos = cluster_pos,
+        .end_pos = mkv_d->segment_end,
+    };
+    pthread_mutex_init(&bg->lock, NULL);
+    talloc_set_destructor(bg, bg_index_destroy);
+    bg->tnums = talloc_array(bg, int64_t, mkv_d->num_tracks);
+    bg->last_tc = talloc_array(bg, int64_t, mkv_d->num_tracks);
+    for (int n = 0; n < mkv_d->num_tracks; n++) {
+        bg->tnums[n] = mkv_d->tracks[n]->tnum;
+        bg->last_tc[n] = INT64_MIN;
+    }
+    bg->num_tnums = mkv_d->num_tracks;
+
+    mkv_d->bg_index = bg;
+    MP_VERBOSE(demuxer, "No cues, creating index in background.\n");
+    mp_thread_pool_queue(mkv_d->bg_pool, bg_index_run, bg);
+}
+
+static void stop_bg_index(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (mkv_d->bg_index)
+        mp_cancel_trigger(mkv_d->bg_index->cancel);
+    talloc_free(mkv_d->bg_pool); // waits until the worker is done
+    mkv_d->bg_pool = NULL;
+    mkv_d->bg_index = NULL;
+}
+
+// Replace the incremental index with the background index, if it's ready.
+static void poll_bg_index(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct bg_index *bg = mkv_d->bg_index;
+
+    if (!bg)
+        return;
+
+    if (mkv_d->index_complete) {
+        stop_bg_index(demuxer);
+        return;
+    }
+
+    pthread_mutex_lock(&bg->lock);
+    bool done = bg->done;
+    pthread_mutex_unlock(&bg->lock);
+    if (!done)
+        return;
+
+    if (bg->success && bg->num_indexes) {
+        talloc_free(mkv_d->indexes);
+        mkv_d->indexes = talloc_steal(mkv_d, bg->indexes);
+        mkv_d->num_indexes = bg->num_indexes;
+        mkv_d->index_has_durations = true;
+        mkv_d->index_complete = true;
+        bg->indexes = NULL;
+    }
+
+    stop_bg_index(demuxer);
+}
+
 static void add_coverart(struct demuxer *demuxer)
 {
     for (int n = 0; n < demuxer->num_attachments; n++) {
@@ -1914,7 +2201,8 @@ static void probe_x264_garbage(demuxer_t *demuxer)
             continue;
 
         bstr sblock = {block->laces[0]->data, block->laces[0]->size};
-        bstr nblock = demux_mkv_decode(demuxer->log, track, sblock, 1);
+        bstr nblock = block->decoded ? sblock
+                    : demux_mkv_decode(demuxer->log, track, sblock, 1);
 
         sh->codec->first_packet = new_demux_packet_from(nblock.start, nblock.len);
         talloc_steal(mkv_d, sh->codec->first_packet);
@@ -2123,13 +2411,35 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
         probe_last_timestamp(demuxer, start_pos);
     probe_x264_garbage(demuxer);
 
+    start_bg_index(demuxer, start_pos);
+
     return 0;
 }
 
+// If the only frame content encoding used by the track is header stripping,
+// return true and set *header to the stripped bytes. This allows prepending
+// them while reading the frame data, instead of copying it again.
+static bool get_strip_header(mkv_track_t *track, bstr *header)
+{
+    bool found = false;
+    for (int i = 0; i < track->num_encodings; i++) {
+        struct mkv_content_encoding *enc = track->encodings + i;
+        if (!(enc->scope & 1))
+            continue;
+        if (enc->comp_algo != 3 || found)
+            return false;
+        *header = (bstr){enc->comp_settings, enc->comp_settings_len};
+        found = true;
+    }
+    return found;
+}
+
 // Read the laced block data at the current stream position (until endpos as
-// indicated by the block length field) into individual buffers.
+// indicated by the block length field) into individual buffers. prefix is
+// prepended to each lace.
 static int demux_mkv_read_block_lacing(struct block_info *block, int type,
-                                       struct stream *s, uint64_t endpos)
+                                       struct stream *s, uint64_t endpos,
+                                       bstr prefix)
 {
     int laces;
     uint32_t lace_size[MAX_NUM_LACES];
@@ -2198,15 +2508,22 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
         if (stream_tell(s) + size > endpos || size > (1 << 30))
             goto error;
         int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
-        if (!buf)
-            goto error;
-        buf->size = size;
-        if (stream_read(s, buf->data, buf->size) != buf->size) {
-            av_buffer_unref(&buf);
-            goto error;
+        // Reference memory mapped file data directly if possible. (Only if the
+        // following data is zero, so it can serve as padding.)
+        AVBufferRef *buf = prefix.len ? NULL : stream_read_ref(s, size, pad);
+        if (!buf) {
+            buf = av_buffer_alloc(prefix.len + size + pad);
+            if (!buf)
+                goto error;
+            buf->size = prefix.len + size;
+            if (prefix.len)
+                memcpy(buf->data, prefix.start, prefix.len);
+            if (stream_read(s, buf->data + prefix.len, size) != size) {
+                av_buffer_unref(&buf);
+                goto error;
+            }
+            memset(buf->data + buf->size, 0, pad);
         }
-        memset(buf->data + buf->size, 0, pad);
         block->laces[block->num_laces++] = buf;
     }
 
@@ -2566,13 +2883,6 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
 
     block->filepos = stream_tell(s);
 
-    int lace_type = (header_flags >> 1) & 0x03;
-    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos))
-        goto exit;
-
-    if (block->simple)
-        block->keyframe = header_flags & 0x80;
-    block->timecode = time * mkv_d->tc_scale + mkv_d->cluster_tc;
     for (int i = 0; i < mkv_d->num_tracks; i++) {
         if (mkv_d->tracks[i]->tnum == num) {
             block->track = mkv_d->tracks[i];
@@ -2584,6 +2894,17 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
         goto exit;
     }
 
+    bstr prefix = {0};
+    block->decoded = get_strip_header(block->track, &prefix);
+
+    int lace_type = (header_flags >> 1) & 0x03;
+    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos, prefix))
+        goto exit;
+
+    if (block->simple)
+        block->keyframe = header_flags & 0x80;
+    block->timecode = time * mkv_d->tc_scale + mkv_d->cluster_tc;
+
     if (stream_tell(s) != endpos)
         goto exit;
 
@@ -2659,7 +2980,8 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
             demux_packet_t *dp = NULL;
 
             bstr block = {data->data, data->size};
-            bstr nblock = demux_mkv_decode(demuxer->log, track, block, 1);
+            bstr nblock = block_info->decoded ? block
+                        : demux_mkv_decode(demuxer->log, track, block, 1);
 
             if (block.start != nblock.start || block.len != nblock.len) {
                 // (avoidable copy of the entire data)
@@ -2785,6 +3107,92 @@ error:
     return -1;
 }
 
+// Parse an EBML variable size integer from memory. Return its size in bytes,
+// or 0 if data is too short or the value is invalid. The length marker is
+// removed if strip is set.
+static int parse_vint(bstr data, int max_size, bool strip, uint64_t *out)
+{
+    if (!data.len || !data.start[0])
+        return 0;
+    int size = 1;
+    while (!(data.start[0] & (0x80 >> (size - 1))))
+        size++;
+    if (size > max_size || size > data.len)
+        return 0;
+    uint64_t v = data.start[0];
+    if (strip)
+        v &= 0xFF >> size;
+    for (int n = 1; n < size; n++)
+        v = (v << 8) | data.start[n];
+    *out = v;
+    return size;
+}
+
+// Return how many bytes at the start of data consist of complete elements,
+// each no larger than CLUSTER_READ_MIN. *end is set if a larger element (or
+// unparseable data) follows them.
+static int64_t scan_small_elements(bstr data, bool *end)
+{
+    int64_t pos = 0;
+    *end = false;
+    while (pos < data.len) {
+        bstr rest = bstr_cut(data, pos);
+        uint64_t id, len;
+        int id_size = parse_vint(rest, 4, false, &id);
+        int len_size = id_size ? parse_vint(bstr_cut(rest, id_size), 8, true, &len)
+                               : 0;
+        if (!len_size) {
+            // Truncated header, or garbage which the normal parser handles.
+            *end = rest.len >= 12;
+            break;
+        }
+        int64_t size = id_size + len_size + MPMIN(len, CLUSTER_READ_MIN + 1);
+        if (size > CLUSTER_READ_MIN) {
+            *end = true;
+            break;
+        }
+        if (size > rest.len)
+            break;
+        pos += size;
+    }
+    return pos;
+}
+
+// Parsing a cluster consists of many small reads, and the stream layer would
+// refill its buffer in small steps for each of them. For local files, read
+// runs of small elements (such as audio blocks) in large pieces instead, so
+// that they are parsed from memory. Large blocks are not prefetched: they are
+// read directly into the packet buffer, and buffering them would only add a
+// copy. (Not done for memory mapped files, where refills are cheap.)
+static void prefetch_cluster_data(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+    stream_t *s = demuxer->stream;
+
+    if (!s->is_local_file || s->read_ref ||
+        mkv_d->cluster_end == EBML_UINT_INVALID ||
+        s->buf_len - s->buf_pos >= CLUSTER_READ_MIN)
+        return;
+
+    int64_t left = mkv_d->cluster_end - stream_tell(s);
+    if (left <= CLUSTER_READ_MIN)
+        return;
+    int64_t limit = MPMIN(left, CLUSTER_READ_SIZE);
+
+    // Grow the read-ahead while only small elements are found. Doubling it
+    // each time bounds the amount of a following large block that is read
+    // into the buffer by the size of the run of small elements before it.
+    int64_t size = MPMIN(limit, STREAM_BUFFER_SIZE);
+    while (1) {
+        bstr data = stream_peek(s, size);
+        bool end;
+        int64_t small = scan_small_elements(data, &end);
+        if (end || data.len < size || size >= limit)
+            break;
+        size = MPMIN(limit, MPMAX(small * 2, size + CLUSTER_READ_MIN));
+    }
+}
+
 static int read_next_block_into_queue(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
@@ -2793,6 +3201,7 @@ static int read_next_block_into_queue(demuxer_t *demuxer)
 
     while (1) {
         while (stream_tell(s) < mkv_d->cluster_end) {
+            prefetch_cluster_data(demuxer);
             int64_t start_filepos = stream_tell(s);
             switch (ebml_read_id(s)) {
             case MATROSKA_ID_TIMECODE: {
@@ -2937,6 +3346,7 @@ static int create_index_until(struct demuxer *demuxer, int64_t timecode)
     struct stream *s = demuxer->stream;
 
     read_deferred_cues(demuxer);
+    poll_bg_index(demuxer);
 
     if (mkv_d->index_complete)
         return 0;
@@ -3096,6 +3506,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
         stream_t *s = demuxer->stream;
 
         read_deferred_cues(demuxer);
+        poll_bg_index(demuxer);
 
         int64_t size = stream_get_size(s);
         int64_t target_filepos = size * MPCLAMP(seek_pts, 0, 1);
@@ -3229,6 +3640,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    stop_bg_index(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
@@ -17,21 +17,41 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "options/m_option.h"
 
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "stream/stream.h"
 
+// A non-lazy source file, possibly used by multiple segments. If the number of
+// open sources is limited, the least recently used ones are closed, and
+// reopened when switching to a segment using them.
+struct source {
+    char *url;
+    int tl_index;               // index into timeline.sources (owns d)
+    bool closable;              // not the main file or track layout
+    int64_t last_used;
+    // Copies of the source's codec parameters, by sh_stream index. Packets
+    // reference these instead of the source's, so that packets and decoders
+    // remain valid if the source is closed.
+    struct mp_codec_params **codecs;
+    int num_codecs;
+};
+
 struct segment {
     int index;
     double start, end;
     double d_start;
     char *url;
     bool lazy;
+    struct source *src;         // NULL if lazy
     struct demuxer *d;
     // stream_map[sh_stream.index] = index into priv.streams, where sh_stream
     // is a stream from the source d. It's used to map the streams of the
@@ -59,6 +79,11 @@ struct priv {
     int num_segments;
     struct segment *current;
 
+    struct source **sources;
+    int num_sources;
+    int max_open;               // max. open closable sources, 0 for no limit
+    int64_t use_counter;
+
     // As the demuxer user sees it.
     struct virtual_stream **streams;
     int num_streams;
@@ -175,6 +200,129 @@ static void reopen_lazy_segments(struct demuxer *demuxer)
     associate_streams(demuxer, p->current);
 }
 
+static struct demuxer *get_source_demuxer(struct demuxer *demuxer,
+                                          struct source *src)
+{
+    struct priv *p = demuxer->priv;
+    return p->tl->sources[src->tl_index];
+}
+
+static void set_source_demuxer(struct demuxer *demuxer, struct source *src,
+                               struct demuxer *d)
+{
+    struct priv *p = demuxer->priv;
+
+    p->tl->sources[src->tl_index] = d;
+    for (int n = 0; n < p->num_segments; n++) {
+        if (p->segments[n]->src == src)
+            p->segments[n]->d = d;
+    }
+}
+
+static void codec_copy_destroy(void *ptr)
+{
+    struct mp_codec_params *c = ptr;
+    avcodec_parameters_free(&c->lav_codecpar);
+}
+
+static struct mp_codec_params *copy_codec(void *ta_parent,
+                                          struct mp_codec_params *c)
+{
+    struct mp_codec_params *new = talloc_ptrtype(ta_parent, new);
+    talloc_set_destructor(new, codec_copy_destroy);
+    *new = *c;
+    new->codec = talloc_strdup(new, c->codec);
+    new->extradata = talloc_memdup(new, c->extradata, c->extradata_size);
+    new->first_packet = NULL;
+    new->replaygain_data = c->replaygain_data ?
+                           talloc_dup(new, c->replaygain_data) : NULL;
+    new->lav_codecpar = NULL;
+    if (c->lav_codecpar) {
+        new->lav_codecpar = avcodec_parameters_alloc();
+        if (new->lav_codecpar)
+            avcodec_parameters_copy(new->lav_codecpar, c->lav_codecpar);
+    }
+    return new;
+}
+
+// Return the codec parameters packets from the given segment stream use.
+static struct mp_codec_params *get_packet_codec(struct demuxer *demuxer,
+                                                struct segment *seg, int index)
+{
+    struct priv *p = demuxer->priv;
+    struct mp_codec_params *codec = demux_get_stream(seg->d, index)->codec;
+    struct source *src = seg->src;
+
+    if (!src || !src->closable || !p->max_open)
+        return codec;
+
+    while (src->num_codecs <= index)
+        MP_TARRAY_APPEND(p, src->codecs, src->num_codecs, NULL);
+    if (!src->codecs[index])
+        src->codecs[index] = copy_codec(p, codec);
+    return src->codecs[index];
+}
+
+// Close least recently used sources until the limit is satisfied.
+static void close_unused_sources(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+
+    if (!p->max_open)
+        return;
+
+    while (1) {
+        struct source *lru = NULL;
+        int num_open = 0;
+        for (int n = 0; n < p->num_sources; n++) {
+            struct source *src = p->sources[n];
+            if (!src->closable || !get_source_demuxer(demuxer, src))
+                continue;
+            num_open++;
+            if (p->current && p->current->src == src)
+                continue;
+            if (!lru || src->last_used < lru->last_used)
+                lru = src;
+        }
+        if (num_open <= p->max_open || !lru)
+            break;
+        MP_VERBOSE(demuxer, "closing source '%s'\n", lru->url);
+        free_demuxer_and_stream(get_source_demuxer(demuxer, lru));
+        set_source_demuxer(demuxer, lru, NULL);
+    }
+}
+
+static void reopen_source(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+    struct segment *seg = p->current;
+    struct source *src = seg->src;
+
+    if (!src)
+        return;
+
+    src->last_used = ++p->use_counter;
+    if (seg->d)
+        return;
+
+    MP_VERBOSE(demuxer, "reopening source '%s'\n", src->url);
+    struct demuxer_params params = {
+        .init_fragment = p->tl->init_fragment,
+    };
+    struct demuxer *d = demux_open_url(src->url, &params,
+                                       demuxer->stream->cancel, demuxer->global);
+    if (d && demux_get_num_stream(d) < seg->num_stream_map) {
+        MP_ERR(demuxer, "source '%s' changed on reopening\n", src->url);
+        free_demuxer_and_stream(d);
+        d = NULL;
+    }
+    if (!d && !demux_cancel_test(demuxer))
+        MP_ERR(demuxer, "failed to reopen source\n");
+    if (d)
+        demux_disable_cache(d);
+    set_source_demuxer(demuxer, src, d);
+}
+
 static void switch_segment(struct demuxer *demuxer, struct segment *new,
                            double start_pts, int flags, bool init)
 {
@@ -187,6 +335,8 @@ static void switch_segment(struct demuxer *demuxer, struct segment *new,
 
     p->current = new;
     reopen_lazy_segments(demuxer);
+    reopen_source(demuxer);
+    close_unused_sources(demuxer);
     if (!new->d)
         return;
     reselect_streams(demuxer);
@@ -278,7 +428,7 @@ static int d_fill_buffer(struct demuxer *demuxer)
     if (!p->dash) {
         pkt->segmented = true;
         if (!pkt->codec)
-            pkt->codec = demux_get_stream(seg->d, pkt->stream)->codec;
+            pkt->codec = get_packet_codec(demuxer, seg, pkt->stream);
         if (pkt->start == MP_NOPTS_VALUE || pkt->start < seg->start)
             pkt->start = seg->start;
         if (pkt->end == MP_NOPTS_VALUE || pkt->end > seg->end)
@@ -341,6 +491,34 @@ static void print_timeline(struct demuxer *demuxer)
         MP_VERBOSE(demuxer, "Durations and offsets are non-authoritative.\n");
 }
 
+static struct source *get_source(struct demuxer *demuxer, struct demuxer *d)
+{
+    struct priv *p = demuxer->priv;
+
+    for (int n = 0; n < p->num_sources; n++) {
+        if (get_source_demuxer(demuxer, p->sources[n]) == d)
+            return p->sources[n];
+    }
+
+    for (int n = 0; n < p->tl->num_sources; n++) {
+        if (p->tl->sources[n] == d) {
+            struct source *src = talloc_ptrtype(p, src);
+            *src = (struct source){
+                .url = talloc_strdup(src, d->stream->url),
+                .tl_index = n,
+                // Packets from nested timelines reference codec parameters
+                // owned by the nested timeline, so don't close them.
+                .closable = d != p->tl->demuxer && d != p->tl->track_layout &&
+                            strcmp(d->desc->name, "timeline") != 0,
+            };
+            MP_TARRAY_APPEND(p, p->sources, p->num_sources, src);
+            return src;
+        }
+    }
+
+    return NULL; // not owned by the timeline
+}
+
 static int d_open(struct demuxer *demuxer, enum demux_check check)
 {
     struct priv *p = demuxer->priv = talloc_zero(demuxer, struct priv);
@@ -348,6 +526,9 @@ static int d_open(struct demuxer *demuxer, enum demux_check check)
     if (!p->tl || p->tl->num_parts < 1)
         return -1;
 
+    mp_read_option_raw(demuxer->global, "demuxer-max-open-segments",
+                       &m_option_type_int, &p->max_open);
+
     p->duration = p->tl->parts[p->tl->num_parts].start;
 
     demuxer->chapters = p->tl->chapters;
@@ -402,6 +583,12 @@ static int d_open(struct demuxer *demuxer, enum demux_check check)
             .end = next->start,
         };
 
+        if (part->source) {
+            seg->src = get_source(demuxer, part->source);
+            if (seg->src)
+                seg->url = seg->src->url;
+        }
+
         associate_streams(demuxer, seg);
 
         seg->index = n;
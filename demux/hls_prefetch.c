@@ -0,0 +1,525 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "misc/thread_pool.h"
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+#include "options/path.h"
+#include "stream/stream.h"
+
+#include "hls_prefetch.h"
+
+// Playlists are read into memory completely; refuse absurdly large ones.
+#define MAX_PLAYLIST_SIZE (16 * 1024 * 1024)
+
+#define READ_SIZE (64 * 1024)
+
+struct playlist {
+    char *url;
+    char **segments;            // absolute URLs, in playlist order
+    int num_segments;
+};
+
+struct segment {
+    struct hls_prefetch *p;
+    char *url;
+    AVDictionary *opts;         // for avio_open2(), only used by the fetcher
+    atomic_bool abort;          // stop downloading (segment not needed)
+    // The following fields are protected by p->lock.
+    int refs;                   // list entry in p->segs, fetcher, reader
+    char *data;
+    int64_t len;
+    bool done;                  // download finished (or failed)
+    bool failed;
+};
+
+// AVIOContext.opaque for data read from memory.
+struct reader {
+    struct segment *seg;
+    int64_t pos;
+};
+
+struct hls_prefetch {
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    int num;
+    atomic_bool terminate;
+
+    // Original AVFormatContext callbacks.
+    int (*io_open)(struct AVFormatContext *s, AVIOContext **pb,
+                   const char *url, int flags, AVDictionary **options);
+    void (*io_close)(struct AVFormatContext *s, AVIOContext *pb);
+
+    // Only accessed by the demuxer thread.
+    struct playlist **playlists;
+    int num_playlists;
+    char **variants;            // URLs listed after #EXT-X-STREAM-INF
+    int num_variants;
+    char *main_url;             // read from the mpv stream, not io_open
+    AVIOContext **readers;      // AVIOContexts created by open_reader()
+    int num_readers;
+    struct mp_thread_pool *pool;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct segment **segs;      // fetched or being fetched, not opened yet
+    int num_segs;
+};
+
+// Resolve rel against the URL base. This covers the URL forms commonly used in
+// playlists, but doesn't normalize "../" path elements.
+static char *resolve_url(void *ta_ctx, const char *base, bstr rel)
+{
+    if (mp_split_proto(rel, NULL).len)
+        return bstrto0(ta_ctx, rel);
+
+    bstr b = bstr0(base);
+    int proto_end = bstr_find0(b, "://");
+    if (proto_end < 0)
+        return bstrto0(ta_ctx, rel);
+    if (bstr_startswith0(rel, "//"))
+        return talloc_asprintf(ta_ctx, "%.*s:%.*s", proto_end, b.start,
+                               BSTR_P(rel));
+
+    int host_end = bstrchr(bstr_cut(b, proto_end + 3), '/');
+    host_end = host_end < 0 ? b.len : proto_end + 3 + host_end;
+    if (bstr_startswith0(rel, "/"))
+        return talloc_asprintf(ta_ctx, "%.*s%.*s", host_end, b.start,
+                               BSTR_P(rel));
+
+    int query = bstrchr(b, '?');
+    bstr path = query < 0 ? b : bstr_splice(b, 0, query);
+    int dir_end = MPMAX(bstrrchr(path, '/') + 1, host_end);
+    return talloc_asprintf(ta_ctx, "%.*s%s%.*s", dir_end, b.start,
+                           dir_end == host_end ? "/" : "", BSTR_P(rel));
+}
+
+static struct playlist *find_playlist(struct hls_prefetch *p, const char *url)
+{
+    for (int n = 0; n < p->num_playlists; n++) {
+        if (strcmp(p->playlists[n]->url, url) == 0)
+            return p->playlists[n];
+    }
+    return NULL;
+}
+
+static bool is_playlist(struct hls_prefetch *p, const char *url)
+{
+    if (find_playlist(p, url) || (p->main_url && strcmp(p->main_url, url) == 0))
+        return true;
+    for (int n = 0; n < p->num_variants; n++) {
+        if (strcmp(p->variants[n], url) == 0)
+            return true;
+    }
+    bstr path = bstr0(url);
+    int query = bstrchr(path, '?');
+    if (query >= 0)
+        path = bstr_splice(path, 0, query);
+    return bstr_endswith0(path, ".m3u8") || bstr_endswith0(path, ".m3u");
+}
+
+static void parse_playlist(struct hls_prefetch *p, const char *url, bstr data)
+{
+    if (!bstr_startswith0(data, "#EXTM3U"))
+        return;
+
+    struct playlist *pl = find_playlist(p, url);
+    if (!pl) {
+        pl = talloc_zero(p, struct playlist);
+        pl->url = talloc_strdup(pl, url);
+        MP_TARRAY_APPEND(p, p->playlists, p->num_playlists, pl);
+    }
+    // (Reloads of live playlists replace the old segment list.)
+    talloc_free(pl->segments);
+    pl->segments = NULL;
+    pl->num_segments = 0;
+
+    bool variant = false, segment = false;
+    while (data.len) {
+        bstr line = bstr_strip(bstr_getline(data, &data));
+        if (!line.len)
+            continue;
+        if (bstr_startswith0(line, "#")) {
+            variant |= bstr_startswith0(line, "#EXT-X-STREAM-INF");
+            segment |= bstr_startswith0(line, "#EXTINF");
+            // Byte ranges are opened with options which select part of the
+            // file; keep it simple and don't prefetch at all.
+            if (bstr_startswith0(line, "#EXT-X-BYTERANGE")) {
+                pl->num_segments = 0;
+                return;
+            }
+            continue;
+        }
+        char *abs = resolve_url(pl, url, line);
+        if (variant) {
+            MP_TARRAY_APPEND(p, p->variants, p->num_variants,
+                             talloc_strdup(p, abs));
+            talloc_free(abs);
+        } else if (segment) {
+            MP_TARRAY_APPEND(pl, pl->segments, pl->num_segments, abs);
+        } else {
+            talloc_free(abs);
+        }
+        variant = segment = false;
+    }
+    MP_DBG(p, "Playlist '%s' has %d segments.\n", url, pl->num_segments);
+}
+
+// Must be called with p->lock held.
+static void segment_unref(struct segment *seg)
+{
+    assert(seg->refs > 0);
+    seg->refs -= 1;
+    if (!seg->refs) {
+        av_dict_free(&seg->opts);
+        talloc_free(seg);
+    }
+}
+
+static int interrupt_cb(void *ctx)
+{
+    struct segment *seg = ctx;
+    struct hls_prefetch *p = seg->p;
+    return atomic_load(&p->terminate) || atomic_load(&seg->abort) ||
+           mp_cancel_test(p->cancel);
+}
+
+// Runs on a thread pool worker.
+static void fetch_segment(void *ctx)
+{
+    struct segment *seg = ctx;
+    struct hls_prefetch *p = seg->p;
+
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    av_dict_copy(&opts, seg->opts, 0);
+    AVIOInterruptCB cb = {.callback = interrupt_cb, .opaque = seg};
+    int r = avio_open2(&pb, seg->url, AVIO_FLAG_READ, &cb, &opts);
+    av_dict_free(&opts);
+
+    uint8_t *buf = talloc_size(NULL, READ_SIZE);
+    while (r >= 0) {
+        r = avio_read(pb, buf, READ_SIZE);
+        if (r <= 0)
+            break;
+        pthread_mutex_lock(&p->lock);
+        MP_TARRAY_GROW(seg, seg->data, seg->len + r);
+        memcpy(seg->data + seg->len, buf, r);
+        seg->len += r;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+    }
+    talloc_free(buf);
+    avio_closep(&pb);
+
+    if (r < 0 && r != AVERROR_EOF && !atomic_load(&seg->abort))
+        MP_WARN(p, "Prefetching '%s' failed.\n", seg->url);
+
+    pthread_mutex_lock(&p->lock);
+    seg->done = true;
+    seg->failed = r < 0 && r != AVERROR_EOF;
+    pthread_cond_broadcast(&p->wakeup);
+    segment_unref(seg);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Must be called with p->lock held.
+static struct segment *find_segment(struct hls_prefetch *p, const char *url)
+{
+    for (int n = 0; n < p->num_segs; n++) {
+        if (strcmp(p->segs[n]->url, url) == 0)
+            return p->segs[n];
+    }
+    return NULL;
+}
+
+// Must be called with p->lock held.
+static void remove_segment(struct hls_prefetch *p, int index)
+{
+    struct segment *seg = p->segs[index];
+    MP_TARRAY_REMOVE_AT(p->segs, p->num_segs, index);
+    atomic_store(&seg->abort, true);
+    // Drop the fetcher's reference too if it didn't start yet.
+    if (p->pool && mp_thread_pool_cancel(p->pool, fetch_segment, seg))
+        segment_unref(seg);
+    segment_unref(seg);
+}
+
+// Start fetching the segments after url, if it's a segment of a known playlist.
+static void prefetch_after(struct hls_prefetch *p, const char *url,
+                           AVDictionary *opts)
+{
+    pthread_mutex_lock(&p->lock);
+    for (int n = 0; n < p->num_playlists; n++) {
+        struct playlist *pl = p->playlists[n];
+        for (int i = 0; i < pl->num_segments; i++) {
+            if (strcmp(pl->segments[i], url) != 0)
+                continue;
+            int end = MPMIN(i + 1 + p->num, pl->num_segments);
+            for (int k = i + 1; k < end; k++) {
+                if (find_segment(p, pl->segments[k]))
+                    continue;
+                // Drop the oldest segment if libavformat didn't use it (for
+                // example because it switched to another variant).
+                if (p->num_segs >= p->num * 2)
+                    remove_segment(p, 0);
+                struct segment *seg = talloc_zero(NULL, struct segment);
+                seg->p = p;
+                seg->url = talloc_strdup(seg, pl->segments[k]);
+                av_dict_copy(&seg->opts, opts, 0);
+                seg->refs = 2; // list entry + fetcher
+                MP_TARRAY_APPEND(p, p->segs, p->num_segs, seg);
+                MP_DBG(p, "Prefetching '%s'.\n", seg->url);
+                mp_thread_pool_queue(p->pool, fetch_segment, seg);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static int reader_read(void *opaque, uint8_t *buf, int size)
+{
+    struct reader *rd = opaque;
+    struct segment *seg = rd->seg;
+    struct hls_prefetch *p = seg->p;
+    int r;
+
+    pthread_mutex_lock(&p->lock);
+    while (!seg->done && rd->pos >= seg->len) {
+        if (mp_cancel_test(p->cancel)) {
+            r = AVERROR_EXIT;
+            goto done;
+        }
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+    }
+    if (rd->pos >= seg->len) {
+        r = seg->failed ? AVERROR(EIO) : AVERROR_EOF;
+        goto done;
+    }
+    r = MPMIN(size, seg->len - rd->pos);
+    memcpy(buf, seg->data + rd->pos, r);
+    rd->pos += r;
+done:
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+static int64_t reader_seek(void *opaque, int64_t pos, int whence)
+{
+    struct reader *rd = opaque;
+    struct segment *seg = rd->seg;
+    struct hls_prefetch *p = seg->p;
+    int64_t r = -1;
+
+    pthread_mutex_lock(&p->lock);
+    int64_t size = seg->done ? seg->len : -1;
+    switch (whence) {
+    case AVSEEK_SIZE:
+        r = size;
+        break;
+    case SEEK_SET:
+        r = pos;
+        break;
+    case SEEK_CUR:
+        r = rd->pos + pos;
+        break;
+    case SEEK_END:
+        r = size >= 0 ? size + pos : -1;
+        break;
+    }
+    if (r >= 0 && whence != AVSEEK_SIZE)
+        rd->pos = r;
+    pthread_mutex_unlock(&p->lock);
+    return r < 0 ? AVERROR(ENOSYS) : r;
+}
+
+// Create an AVIOContext that reads seg. Takes over the caller's reference.
+static int open_reader(struct hls_prefetch *p, struct segment *seg,
+                       AVIOContext **pb)
+{
+    struct reader *rd = talloc_zero(NULL, struct reader);
+    rd->seg = seg;
+    void *buffer = av_malloc(READ_SIZE);
+    *pb = buffer ? avio_alloc_context(buffer, READ_SIZE, 0, rd, reader_read,
+                                      NULL, reader_seek) : NULL;
+    if (!*pb) {
+        av_free(buffer);
+        talloc_free(rd);
+        pthread_mutex_lock(&p->lock);
+        segment_unref(seg);
+        pthread_mutex_unlock(&p->lock);
+        return AVERROR(ENOMEM);
+    }
+    MP_TARRAY_APPEND(p, p->readers, p->num_readers, *pb);
+    return 0;
+}
+
+// Read a playlist completely with the original io_open, and parse it.
+static int open_playlist(struct hls_prefetch *p, struct AVFormatContext *s,
+                         AVIOContext **pb, const char *url, int flags,
+                         AVDictionary **options)
+{
+    AVIOContext *in = NULL;
+    int r = p->io_open(s, &in, url, flags, options);
+    if (r < 0)
+        return r;
+
+    struct segment *seg = talloc_zero(NULL, struct segment);
+    seg->p = p;
+    seg->url = talloc_strdup(seg, url);
+    seg->refs = 1; // reader
+    while (1) {
+        MP_TARRAY_GROW(seg, seg->data, seg->len + READ_SIZE);
+        r = avio_read(in, seg->data + seg->len, READ_SIZE);
+        if (r <= 0)
+            break;
+        seg->len += r;
+        if (seg->len > MAX_PLAYLIST_SIZE) {
+            r = AVERROR_INVALIDDATA;
+            break;
+        }
+    }
+    p->io_close(s, in);
+    if (r < 0 && r != AVERROR_EOF) {
+        talloc_free(seg);
+        return r;
+    }
+    seg->done = true;
+
+    parse_playlist(p, url, (bstr){seg->data, seg->len});
+    return open_reader(p, seg, pb);
+}
+
+void hls_prefetch_set_main(struct hls_prefetch *p, const char *url,
+                           bstr data, bool complete)
+{
+    // Ignore an incomplete last line, which could be a truncated URL.
+    if (!complete) {
+        int end = bstrrchr(data, '\n');
+        data = bstr_splice(data, 0, end < 0 ? 0 : end + 1);
+    }
+    talloc_free(p->main_url);
+    p->main_url = talloc_strdup(p, url);
+    parse_playlist(p, url, data);
+}
+
+int hls_prefetch_io_open(struct hls_prefetch *p, struct AVFormatContext *s,
+                         AVIOContext **pb, const char *url, int flags,
+                         AVDictionary **options)
+{
+    if (!(flags & AVIO_FLAG_READ) || (flags & AVIO_FLAG_WRITE))
+        return p->io_open(s, pb, url, flags, options);
+
+    if (is_playlist(p, url))
+        return open_playlist(p, s, pb, url, flags, options);
+
+    // Byte range requests can't use a prefetched full segment.
+    bool ranged = options && av_dict_get(*options, "offset", NULL, 0);
+    if (!ranged)
+        prefetch_after(p, url, options ? *options : NULL);
+
+    pthread_mutex_lock(&p->lock);
+    struct segment *seg = ranged ? NULL : find_segment(p, url);
+    if (seg && seg->done && seg->failed)
+        seg = NULL;
+    if (seg) {
+        // Keep the list entry's reference for the reader.
+        for (int n = 0; n < p->num_segs; n++) {
+            if (p->segs[n] == seg) {
+                MP_TARRAY_REMOVE_AT(p->segs, p->num_segs, n);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (!seg)
+        return p->io_open(s, pb, url, flags, options);
+    MP_VERBOSE(p, "Using prefetched '%s'.\n", url);
+    return open_reader(p, seg, pb);
+}
+
+void hls_prefetch_io_close(struct hls_prefetch *p, struct AVFormatContext *s,
+                           AVIOContext *pb)
+{
+    for (int n = 0; n < p->num_readers; n++) {
+        if (p->readers[n] == pb) {
+            MP_TARRAY_REMOVE_AT(p->readers, p->num_readers, n);
+            struct reader *rd = pb->opaque;
+            pthread_mutex_lock(&p->lock);
+            atomic_store(&rd->seg->abort, true);
+            segment_unref(rd->seg);
+            pthread_mutex_unlock(&p->lock);
+            talloc_free(rd);
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+            return;
+        }
+    }
+    p->io_close(s, pb);
+}
+
+struct hls_prefetch *hls_prefetch_create(struct AVFormatContext *avfc,
+                                         struct mp_log *log,
+                                         struct mp_cancel *cancel, int num)
+{
+    struct hls_prefetch *p = talloc_zero(NULL, struct hls_prefetch);
+    p->log = mp_log_new(p, log, "hls-prefetch");
+    p->cancel = cancel;
+    p->num = num;
+    p->io_open = avfc->io_open;
+    p->io_close = avfc->io_close;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    p->pool = mp_thread_pool_create(p, num);
+    if (!p->pool) {
+        hls_prefetch_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+void hls_prefetch_destroy(struct hls_prefetch *p)
+{
+    if (!p)
+        return;
+    atomic_store(&p->terminate, true);
+    // Wait for the fetchers. (They might still hold segment references.)
+    talloc_free(p->pool);
+    p->pool = NULL;
+    while (p->num_segs)
+        remove_segment(p, 0);
+    // Readers were closed by avformat_close_input().
+    assert(!p->num_readers);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(p);
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_HLS_PREFETCH_H
+#define MP_HLS_PREFETCH_H
+
+#include <stdbool.h>
+
+#include "misc/bstr.h"
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVDictionary;
+struct mp_cancel;
+struct mp_log;
+
+// Downloads the next segments of HLS playlists in parallel, while libavformat's
+// hls demuxer is still reading the current one. This hooks into the
+// AVFormatContext.io_open/io_close callbacks: playlists opened by libavformat
+// are read completely and parsed for segment URLs, and when a segment is
+// opened, the following ones are fetched in the background. libavformat then
+// reads them from memory.
+struct hls_prefetch;
+
+// Must be called before avformat_open_input(). num is the number of segments
+// fetched ahead. The caller must set avfc->io_open/io_close to functions
+// which call hls_prefetch_io_open/hls_prefetch_io_close.
+struct hls_prefetch *hls_prefetch_create(struct AVFormatContext *avfc,
+                                         struct mp_log *log,
+                                         struct mp_cancel *cancel, int num);
+// libavformat reads the top-level playlist from AVFormatContext.pb, so it
+// never goes through io_open. Pass its contents (data, which may be only the
+// start if complete is false) and URL here before avformat_open_input().
+void hls_prefetch_set_main(struct hls_prefetch *p, const char *url,
+                           bstr data, bool complete);
+// Must be called after avformat_close_input().
+void hls_prefetch_destroy(struct hls_prefetch *p);
+
+int hls_prefetch_io_open(struct hls_prefetch *p, struct AVFormatContext *s,
+                         struct AVIOContext **pb, const char *url, int flags,
+                         struct AVDictionary **options);
+void hls_prefetch_io_close(struct hls_prefetch *p, struct AVFormatContext *s,
+                           struct AVIOContext *pb);
+
+#endif
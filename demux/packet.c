@@ -19,9 +19,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
+#include <libavutil/mem.h>
 
 #include "config.h"
 
@@ -31,6 +33,160 @@
 
 #include "packet.h"
 
+// Payloads of packets allocated by new_demux_packet() are taken from a set of
+// power-of-2 size classes, and recycled when the last reference is released.
+// The demuxer cache creates and destroys millions of packets in long sessions,
+// and this avoids that the libc allocator fragments the heap over time. Packets
+// larger than the biggest size class are allocated normally. Freed memory is
+// kept only while at least one demuxer exists.
+#define POOL_MIN_SHIFT      8                   // 256 bytes
+#define POOL_NUM_CLASSES    13                  // up to 1 MiB
+#define POOL_MAX_FREE_BYTES (32 * 1024 * 1024)  // max. unused pooled memory
+
+// Unused payload memory; the first bytes of each block are used as list link.
+struct pool_block {
+    struct pool_block *next;
+};
+
+struct pool_class {
+    struct pool_block *free_list;
+};
+
+// The address of a pool_classes[] entry is the AVBuffer opaque field, which
+// also identifies pooled buffers.
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_class pool_classes[POOL_NUM_CLASSES];
+static size_t pool_free_bytes;
+static int pool_users;
+
+static size_t pool_class_size(int c)
+{
+    return (size_t)1 << (POOL_MIN_SHIFT + c);
+}
+
+// Return the class with exactly this size, or -1.
+static int pool_class_index(size_t size)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        if (pool_class_size(c) == size)
+            return c;
+    }
+    return -1;
+}
+
+// Must be called with pool_mutex held.
+static void pool_flush(void)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        struct pool_block *b = pool_classes[c].free_list;
+        while (b) {
+            struct pool_block *next = b->next;
+            av_free(b);
+            b = next;
+        }
+        pool_classes[c].free_list = NULL;
+    }
+    pool_free_bytes = 0;
+}
+
+// Called by every demuxer instance on creation and destruction.
+void demux_packet_pool_ref(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    pool_users++;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+// Unused pooled memory is freed when the last demuxer goes away.
+void demux_packet_pool_unref(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    assert(pool_users > 0);
+    pool_users--;
+    if (!pool_users)
+        pool_flush();
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+// Can be called from any thread (whoever drops the last buffer reference).
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    struct pool_class *cls = opaque;
+    size_t size = pool_class_size(cls - pool_classes);
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_users && pool_free_bytes + size <= POOL_MAX_FREE_BYTES) {
+        struct pool_block *b = (void *)data;
+        b->next = cls->free_list;
+        cls->free_list = b;
+        pool_free_bytes += size;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    av_free(data);
+}
+
+// Allocate a buffer of at least the given size (including padding). Returns
+// NULL if the size is not pooled, or on OOM.
+static AVBufferRef *pool_buffer_alloc(size_t size)
+{
+    int c = 0;
+    while (c < POOL_NUM_CLASSES && pool_class_size(c) < size)
+        c++;
+    if (c == POOL_NUM_CLASSES)
+        return NULL;
+    struct pool_class *cls = &pool_classes[c];
+
+    pthread_mutex_lock(&pool_mutex);
+    uint8_t *data = (void *)cls->free_list;
+    if (data) {
+        cls->free_list = cls->free_list->next;
+        pool_free_bytes -= pool_class_size(c);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (!data)
+        data = av_malloc(pool_class_size(c));
+    if (!data)
+        return NULL;
+    AVBufferRef *buf = av_buffer_create(data, pool_class_size(c),
+                                        pool_buffer_free, cls, 0);
+    if (!buf)
+        pool_buffer_free(cls, data);
+    return buf;
+}
+
+// Return the size of the pooled allocation backing the packet data, or 0 if
+// the data is not from the pool.
+static size_t pool_buffer_size(AVPacket *pkt)
+{
+    if (!pkt->buf)
+        return 0;
+    int c = pool_class_index(pkt->buf->size);
+    if (c < 0 || av_buffer_get_opaque(pkt->buf) != &pool_classes[c])
+        return 0;
+    return pkt->buf->size;
+}
+
+// Like av_new_packet(), but possibly use a pooled buffer.
+static int new_pooled_packet(AVPacket *pkt, int size)
+{
+    AVBufferRef *buf = pool_buffer_alloc((size_t)size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return av_new_packet(pkt, size);
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    memset(pkt->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return 0;
+}
+
+// The AVPacket is part of the same allocation as the demux_packet, which
+// halves the number of allocations per packet.
+struct demux_packet_alloc {
+    struct demux_packet dp;
+    AVPacket avpacket;
+};
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
@@ -45,7 +201,8 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
+    struct demux_packet_alloc *alloc = talloc(NULL, struct demux_packet_alloc);
+    struct demux_packet *dp = &alloc->dp;
     talloc_set_destructor(dp, packet_destroy);
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
@@ -55,17 +212,18 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = &alloc->avpacket,
         .kf_seek_pts = MP_NOPTS_VALUE,
     };
+    *dp->avpacket = (AVPacket){0};
     av_init_packet(dp->avpacket);
     int r = -1;
     if (avpkt->data) {
         // We hope that this function won't need/access AVPacket input padding,
-        // because otherwise new_demux_packet_from() wouldn't work.
+        // because the caller might not have allocated any.
         r = av_packet_ref(dp->avpacket, avpkt);
     } else {
-        r = av_new_packet(dp->avpacket, avpkt->size);
+        r = new_pooled_packet(dp->avpacket, avpkt->size);
     }
     if (r < 0) {
         *dp->avpacket = (AVPacket){0};
@@ -93,10 +251,10 @@ struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf)
 // Input data doesn't need to be padded.
 struct demux_packet *new_demux_packet_from(void *data, size_t len)
 {
-    if (len > INT_MAX)
-        return NULL;
-    AVPacket pkt = { .data = data, .size = len };
-    return new_demux_packet_from_avpacket(&pkt);
+    struct demux_packet *dp = new_demux_packet(len);
+    if (dp)
+        memcpy(dp->buffer, data, len);
+    return dp;
 }
 
 struct demux_packet *new_demux_packet(size_t len)
@@ -114,6 +272,15 @@ void demux_packet_shorten(struct demux_packet *dp, size_t len)
     dp->len = dp->avpacket->size;
 }
 
+// Free the packet data and side data, but keep the len field and all other
+// metadata.
+void demux_packet_unref_contents(struct demux_packet *dp)
+{
+    if (dp->avpacket)
+        av_packet_unref(dp->avpacket);
+    dp->buffer = NULL;
+}
+
 void free_demux_packet(struct demux_packet *dp)
 {
     talloc_free(dp);
@@ -162,8 +329,11 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 size_t demux_packet_estimate_total_size(struct demux_packet *dp)
 {
     size_t size = ROUND_ALLOC(sizeof(struct demux_packet));
-    size += ROUND_ALLOC(dp->len);
+    // Pooled data always uses the full size class.
+    size_t pooled = dp->avpacket ? pool_buffer_size(dp->avpacket) : 0;
+    size += pooled ? pooled : ROUND_ALLOC(dp->len);
     if (dp->avpacket) {
+        // (Not a separate allocation anymore, but keep the value stable.)
         size += ROUND_ALLOC(sizeof(AVPacket));
         size += ROUND_ALLOC(sizeof(AVBufferRef));
         size += 64; // upper bound estimate on sizeof(AVBuffer)
@@ -44,7 +44,10 @@ typedef struct demux_packet {
     struct demux_packet *next;
     struct AVPacket *avpacket;   // keep the buffer allocation and sidedata
     double kf_seek_pts; // demux.c internal: seek pts for keyframe range
+    bool is_cached;     // demux.c internal: data is stored in demux_cache
+    uint64_t cached_data_pos; // demux.c internal: data position if is_cached
     struct mp_packet_tags *metadata; // timed metadata (demux.c internal)
+    int framedrop_type; // f_decoder_wrapper.c internal: for decoder threads
 } demux_packet_t;
 
 struct AVBufferRef;
@@ -54,9 +57,12 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
 struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf);
 void demux_packet_shorten(struct demux_packet *dp, size_t len);
+void demux_packet_unref_contents(struct demux_packet *dp);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet *dp);
 size_t demux_packet_estimate_total_size(struct demux_packet *dp);
+void demux_packet_pool_ref(void);
+void demux_packet_pool_unref(void);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
@@ -0,0 +1,204 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "osdep/getpid.h"
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+#include "stream/stream.h"
+
+#include "probe_cache.h"
+
+// Older entries are dropped when storing a new one.
+#define MAX_ENTRIES 1000
+#define MAX_FILE_SIZE (1024 * 1024)
+
+// Serializes accesses to the cache file from within the process. (Demuxers
+// can be opened concurrently, e.g. by demux_edl.c.)
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct line {
+    int64_t size, mtime;
+    int check;
+    bstr demuxer, lavf_format, path;
+    bstr text;                  // full line without newline
+};
+
+static bool get_file_key(struct stream *s, char **path, int64_t *size,
+                         int64_t *mtime)
+{
+    while (s->underlying)
+        s = s->underlying;
+    if (!s->is_local_file || !s->path || strchr(s->path, '\n'))
+        return false;
+    struct stat st;
+    if (stat(s->path, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    *path = s->path;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+static bool parse_line(bstr text, struct line *line)
+{
+    bstr rest = text, size, mtime, chk;
+    *line = (struct line){.text = text};
+    if (!bstr_split_tok(rest, " ", &size, &rest) ||
+        !bstr_split_tok(rest, " ", &mtime, &rest) ||
+        !bstr_split_tok(rest, " ", &chk, &rest) ||
+        !bstr_split_tok(rest, " ", &line->demuxer, &rest) ||
+        !bstr_split_tok(rest, " ", &line->lavf_format, &line->path))
+        return false;
+    bstr end;
+    line->size = bstrtoll(size, &end, 10);
+    if (end.len)
+        return false;
+    line->mtime = bstrtoll(mtime, &end, 10);
+    if (end.len)
+        return false;
+    line->check = bstrtoll(chk, &end, 10);
+    return !end.len && line->demuxer.len && line->path.len;
+}
+
+// Read all valid lines. Result is allocated in ta_parent.
+static int read_lines(void *ta_parent, const char *cache_file,
+                      struct line **lines)
+{
+    int num_lines = 0;
+    *lines = NULL;
+
+    FILE *f = fopen(cache_file, "rb");
+    if (!f)
+        return 0;
+    char *data = talloc_size(ta_parent, MAX_FILE_SIZE);
+    size_t len = fread(data, 1, MAX_FILE_SIZE, f);
+    fclose(f);
+
+    bstr buf = {data, len};
+    while (buf.len) {
+        bstr text = bstr_strip_linebreaks(bstr_getline(buf, &buf));
+        struct line line;
+        if (parse_line(text, &line))
+            MP_TARRAY_APPEND(ta_parent, *lines, num_lines, line);
+    }
+    return num_lines;
+}
+
+// Look up the file opened as stream. Return true and set *entry (allocated in
+// ta_parent) on success.
+bool demux_probe_cache_lookup(void *ta_parent, struct mp_log *log,
+                              const char *cache_file, struct stream *stream,
+                              struct demux_probe_entry *entry)
+{
+    char *path;
+    int64_t size, mtime;
+    if (!get_file_key(stream, &path, &size, &mtime))
+        return false;
+
+    void *tmp = talloc_new(NULL);
+    bool found = false;
+
+    pthread_mutex_lock(&cache_lock);
+    struct line *lines;
+    int num_lines = read_lines(tmp, cache_file, &lines);
+    pthread_mutex_unlock(&cache_lock);
+
+    // Later entries are newer.
+    for (int n = num_lines - 1; n >= 0; n--) {
+        struct line *line = &lines[n];
+        if (!bstr_equals0(line->path, path))
+            continue;
+        if (line->size == size && line->mtime == mtime) {
+            *entry = (struct demux_probe_entry){
+                .demuxer = bstrto0(ta_parent, line->demuxer),
+                .check = line->check,
+            };
+            if (!bstr_equals0(line->lavf_format, "-"))
+                entry->lavf_format = bstrto0(ta_parent, line->lavf_format);
+            found = true;
+        }
+        break;
+    }
+
+    if (found) {
+        mp_verbose(log, "Probe cache: using demuxer %s.\n", entry->demuxer);
+    } else {
+        mp_dbg(log, "Probe cache: no entry.\n");
+    }
+
+    talloc_free(tmp);
+    return found;
+}
+
+// Remember the demuxer used to open the file. Replaces previous entries for
+// the same path.
+void demux_probe_cache_store(struct mp_log *log, const char *cache_file,
+                             struct stream *stream,
+                             struct demux_probe_entry *entry)
+{
+    char *path;
+    int64_t size, mtime;
+    if (!get_file_key(stream, &path, &size, &mtime))
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    struct line *lines;
+    int num_lines = read_lines(tmp, cache_file, &lines);
+
+    int keep = 0;
+    for (int n = 0; n < num_lines; n++) {
+        if (!bstr_equals0(lines[n].path, path))
+            lines[keep++] = lines[n];
+    }
+    int first = MPMAX(keep - (MAX_ENTRIES - 1), 0);
+
+    // Write a new file and replace the old one, so that other processes
+    // never read a partially written cache.
+    char *tmp_path = talloc_asprintf(tmp, "%s.%d.tmp", cache_file, mp_getpid());
+    FILE *f = fopen(tmp_path, "wb");
+    if (f) {
+        for (int n = first; n < keep; n++)
+            fprintf(f, "%.*s\n", BSTR_P(lines[n].text));
+        fprintf(f, "%"PRId64" %"PRId64" %d %s %s %s\n", size, mtime,
+                entry->check, entry->demuxer,
+                entry->lavf_format ? entry->lavf_format : "-", path);
+    }
+    bool ok = f && !ferror(f);
+    if (f)
+        ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, cache_file) != 0) {
+        mp_warn(log, "Probe cache: can't write '%s'.\n", cache_file);
+        unlink(tmp_path);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+    talloc_free(tmp);
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_PROBE_CACHE_H
+#define MP_DEMUX_PROBE_CACHE_H
+
+#include <stdbool.h>
+
+struct mp_log;
+struct stream;
+
+// Remembers which demuxer opened a local file, keyed by path, size and mtime.
+// The cache file is a text file with one entry per line. Thread-safe.
+struct demux_probe_entry {
+    char *demuxer;          // demuxer_desc.name
+    int check;              // enum demux_check the demuxer succeeded with
+    char *lavf_format;      // AVInputFormat.name for demuxer=="lavf", or NULL
+};
+
+bool demux_probe_cache_lookup(void *ta_parent, struct mp_log *log,
+                              const char *cache_file, struct stream *stream,
+                              struct demux_probe_entry *entry);
+void demux_probe_cache_store(struct mp_log *log, const char *cache_file,
+                             struct stream *stream,
+                             struct demux_probe_entry *entry);
+
+#endif
@@ -0,0 +1,279 @@
+#include <assert.h>
+#include <pthread.h>
+
+#include "audio/aframe.h"
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "video/mp_image.h"
+
+#include "f_async_queue.h"
+#include "filter_internal.h"
+
+struct async_queue {
+    pthread_mutex_t lock;
+    int refcount;
+
+    int max_frames;
+    double max_duration;    // 0 if disabled
+    struct mp_frame *frames;
+    int num_frames;
+    double duration;        // sum of durations of queued audio frames
+    int64_t max_bytes;      // 0 if disabled
+    int64_t bytes;          // sum of sizes of queued software frames
+    int num_hw_frames;      // number of queued hardware frames
+
+    // conn[0] is the filter writing to the queue, conn[1] the one reading.
+    struct mp_filter *conn[2];
+};
+
+struct mp_async_queue {
+    struct async_queue *q;
+};
+
+static void unref_queue(struct async_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    bool last = --q->refcount == 0;
+    pthread_mutex_unlock(&q->lock);
+    if (last) {
+        for (int n = 0; n < q->num_frames; n++)
+            mp_frame_unref(&q->frames[n]);
+        pthread_mutex_destroy(&q->lock);
+        talloc_free(q);
+    }
+}
+
+static void queue_destroy(void *p)
+{
+    struct mp_async_queue *q = p;
+    unref_queue(q->q);
+}
+
+struct mp_async_queue *mp_async_queue_create(void)
+{
+    struct mp_async_queue *r = talloc_zero(NULL, struct mp_async_queue);
+    r->q = talloc_zero(NULL, struct async_queue);
+    *r->q = (struct async_queue){
+        .refcount = 1,
+        .max_frames = 1,
+    };
+    pthread_mutex_init(&r->q->lock, NULL);
+    talloc_set_destructor(r, queue_destroy);
+    return r;
+}
+
+void mp_async_queue_set_max_frames(struct mp_async_queue *queue, int max_frames)
+{
+    struct async_queue *q = queue->q;
+    pthread_mutex_lock(&q->lock);
+    q->max_frames = MPMAX(max_frames, 1);
+    if (q->conn[0])
+        mp_filter_wakeup(q->conn[0]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void mp_async_queue_set_max_duration(struct mp_async_queue *queue,
+                                     double max_duration)
+{
+    struct async_queue *q = queue->q;
+    pthread_mutex_lock(&q->lock);
+    q->max_duration = MPMAX(max_duration, 0);
+    if (q->conn[0])
+        mp_filter_wakeup(q->conn[0]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void mp_async_queue_set_max_bytes(struct mp_async_queue *queue,
+                                  int64_t max_bytes)
+{
+    struct async_queue *q = queue->q;
+    pthread_mutex_lock(&q->lock);
+    q->max_bytes = MPMAX(max_bytes, 0);
+    if (q->conn[0])
+        mp_filter_wakeup(q->conn[0]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void mp_async_queue_reset(struct mp_async_queue *queue)
+{
+    struct async_queue *q = queue->q;
+    pthread_mutex_lock(&q->lock);
+    for (int n = 0; n < q->num_frames; n++)
+        mp_frame_unref(&q->frames[n]);
+    q->num_frames = 0;
+    q->duration = 0;
+    q->bytes = 0;
+    q->num_hw_frames = 0;
+    if (q->conn[0])
+        mp_filter_wakeup(q->conn[0]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+struct priv {
+    struct async_queue *q;
+    int index;              // this filter is q->conn[index]
+};
+
+// Add (dir=1) or remove (dir=-1) the frame to/from the queue statistics.
+// must be called locked
+static void account_frame(struct async_queue *q, struct mp_frame frame, int dir)
+{
+    if (frame.type == MP_FRAME_AUDIO) {
+        struct mp_aframe *aframe = frame.data;
+        q->duration += dir * MPMAX(mp_aframe_duration(aframe), 0);
+        q->bytes += dir * (int64_t)mp_aframe_get_size(aframe) *
+                    mp_aframe_get_sstride(aframe) *
+                    mp_aframe_get_planes(aframe);
+    } else if (frame.type == MP_FRAME_VIDEO) {
+        struct mp_image *img = frame.data;
+        if (IMGFMT_IS_HWACCEL(img->imgfmt)) {
+            q->num_hw_frames += dir;
+        } else {
+            q->bytes += dir * (int64_t)MPMAX(0,
+                mp_image_get_alloc_size(img->imgfmt, img->w, img->h, 1));
+        }
+    }
+    if (!q->num_frames)
+        q->duration = q->bytes = q->num_hw_frames = 0;
+}
+
+// Duration of the queued frames. For video, this is the PTS difference between
+// the first and last queued frame. Returns -1 if unknown.
+// must be called locked
+static double queue_duration(struct async_queue *q)
+{
+    struct mp_image *first = NULL, *last = NULL;
+    for (int n = 0; n < q->num_frames && !first; n++) {
+        if (q->frames[n].type == MP_FRAME_VIDEO)
+            first = q->frames[n].data;
+    }
+    for (int n = q->num_frames - 1; n >= 0 && !last; n--) {
+        if (q->frames[n].type == MP_FRAME_VIDEO)
+            last = q->frames[n].data;
+    }
+    if (!first)
+        return q->duration;
+    if (first->pts == MP_NOPTS_VALUE || last->pts == MP_NOPTS_VALUE)
+        return -1;
+    return MPMAX(last->pts - first->pts, 0) + q->duration;
+}
+
+// must be called locked
+static bool queue_is_full(struct async_queue *q)
+{
+    if (q->max_duration <= 0 && q->max_bytes <= 0)
+        return q->num_frames >= q->max_frames;
+
+    // Hardware decoders have a limited number of surfaces.
+    if (q->num_hw_frames >= q->max_frames)
+        return true;
+    if (q->max_bytes > 0 && q->bytes >= q->max_bytes)
+        return true;
+    if (q->max_duration > 0) {
+        double duration = queue_duration(q);
+        if (duration < 0) // no timestamps
+            return q->num_frames >= q->max_frames;
+        if (duration >= q->max_duration)
+            return true;
+    }
+    return false;
+}
+
+static void write_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    struct async_queue *q = p->q;
+
+    pthread_mutex_lock(&q->lock);
+    bool full = queue_is_full(q);
+    pthread_mutex_unlock(&q->lock);
+
+    if (full || !mp_pin_out_request_data(f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+
+    pthread_mutex_lock(&q->lock);
+    MP_TARRAY_APPEND(q, q->frames, q->num_frames, frame);
+    account_frame(q, frame, 1);
+    if (q->conn[1])
+        mp_filter_wakeup(q->conn[1]);
+    pthread_mutex_unlock(&q->lock);
+
+    mp_filter_internal_mark_progress(f);
+}
+
+static void read_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    struct async_queue *q = p->q;
+
+    if (!mp_pin_in_needs_data(f->ppins[0]))
+        return;
+
+    struct mp_frame frame = MP_NO_FRAME;
+    pthread_mutex_lock(&q->lock);
+    if (q->num_frames) {
+        frame = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        account_frame(q, frame, -1);
+        if (q->conn[0])
+            mp_filter_wakeup(q->conn[0]);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (frame.type)
+        mp_pin_in_write(f->ppins[0], frame);
+}
+
+static void destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    struct async_queue *q = p->q;
+
+    pthread_mutex_lock(&q->lock);
+    q->conn[p->index] = NULL;
+    pthread_mutex_unlock(&q->lock);
+
+    unref_queue(q);
+}
+
+static const struct mp_filter_info write_filter = {
+    .name = "async_queue_in",
+    .priv_size = sizeof(struct priv),
+    .process = write_process,
+    .destroy = destroy,
+};
+
+static const struct mp_filter_info read_filter = {
+    .name = "async_queue_out",
+    .priv_size = sizeof(struct priv),
+    .process = read_process,
+    .destroy = destroy,
+};
+
+struct mp_filter *mp_async_queue_create_filter(struct mp_filter *parent,
+                                               enum mp_pin_dir dir,
+                                               struct mp_async_queue *queue)
+{
+    bool is_in = dir == MP_PIN_IN;
+    struct mp_filter *f =
+        mp_filter_create(parent, is_in ? &write_filter : &read_filter);
+    if (!f)
+        return NULL;
+
+    struct priv *p = f->priv;
+    struct async_queue *q = queue->q;
+    p->q = q;
+    p->index = is_in ? 0 : 1;
+
+    mp_filter_add_pin(f, dir, is_in ? "in" : "out");
+
+    pthread_mutex_lock(&q->lock);
+    assert(!q->conn[p->index]);
+    q->conn[p->index] = f;
+    q->refcount += 1;
+    pthread_mutex_unlock(&q->lock);
+
+    return f;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "filter.h"
+
+// A thread-safe queue of frames, which connects two filters in different
+// filter graphs (see mp_filter_root_run_thread()).
+struct mp_async_queue;
+
+// Create a queue. Free it with talloc_free(); the filters created with it keep
+// their own reference.
+struct mp_async_queue *mp_async_queue_create(void);
+
+// Set the maximum number of frames buffered in the queue (default: 1). The
+// writing filter stops reading its input while the queue is full.
+void mp_async_queue_set_max_frames(struct mp_async_queue *q, int max_frames);
+
+// Limit the queue by the duration of the queued frames in seconds instead of
+// the number of frames (0 disables it, which is the default). For video, the
+// duration is determined from the frame PTS. If this or the byte limit is set,
+// the limit set with mp_async_queue_set_max_frames() applies only to hardware
+// frames (and to video frames without PTS).
+void mp_async_queue_set_max_duration(struct mp_async_queue *q,
+                                     double max_duration);
+
+// Limit the total size of the queued software frames (0 disables it, which is
+// the default). See mp_async_queue_set_max_duration().
+void mp_async_queue_set_max_bytes(struct mp_async_queue *q, int64_t max_bytes);
+
+// Drop all queued frames. Typically used together with mp_filter_reset() on
+// the filters on both ends.
+void mp_async_queue_reset(struct mp_async_queue *q);
+
+// Create a filter for one end of the queue. With dir==MP_PIN_IN, the filter
+// has a single input pin, and appends all frames it reads to the queue. With
+// dir==MP_PIN_OUT, it has a single output pin, and returns frames taken from
+// the queue. Each end can be created only once per queue, and each end wakes
+// up the other end's filter graph when the queue state changes.
+struct mp_filter *mp_async_queue_create_filter(struct mp_filter *parent,
+                                               enum mp_pin_dir dir,
+                                               struct mp_async_queue *q);
@@ -28,6 +28,7 @@
 #include "options/options.h"
 #include "common/msg.h"
 
+#include "osdep/atomic.h"
 #include "osdep/timer.h"
 
 #include "demux/demux.h"
@@ -36,17 +37,23 @@
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
+#include "common/trace.h"
 
 #include "audio/aframe.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/image_loader.h"
 
 #include "demux/stheader.h"
 
+#include "f_async_queue.h"
 #include "f_decoder_wrapper.h"
 #include "f_demux_in.h"
 #include "filter_internal.h"
 
+// Packets queued for a decoder running on its own thread.
+#define THREAD_QUEUE_PACKETS 4
+
 struct priv {
     struct mp_filter *f;
     struct mp_log *log;
@@ -57,6 +64,20 @@ struct priv {
 
     struct mp_decoder *decoder;
 
+    // Packets are written to dec_in, and decoded frames read from dec_out.
+    // These are the decoder's pins, or the ends of the queues to the decoder
+    // thread.
+    struct mp_pin *dec_in, *dec_out;
+
+    // If the decoder runs on its own thread (--vd-queue-enable etc.), it's a
+    // child of dec_proxy, in the filter graph of dec_root. All accesses to it
+    // must be done with mp_filter_graph_lock(dec_root) held.
+    struct mp_filter *dec_root, *dec_proxy;
+    struct mp_async_queue *pkt_queue, *frame_queue;
+    struct mp_filter *pkt_sink, *frame_src; // queue ends in p->f
+    struct mp_filter *pkt_src, *frame_sink; // queue ends in dec_root
+    atomic_int bframes;         // from the decoder with each frame (or -1)
+
     // Demuxer output.
     struct mp_pin *demux;
 
@@ -91,9 +112,46 @@ struct priv {
     struct mp_frame decoded_coverart;
     int coverart_returned; // 0: no, 1: coverart frame itself, 2: EOF returned
 
+    // For public.image_cache.
+    struct mp_frame cached_image;   // found in the cache, returned next
+    struct mp_image_cache_key image_key; // key of the packet being decoded
+    bool have_image_key;
+
     struct mp_decoder_wrapper public;
 };
 
+static void lock_decoder(struct priv *p)
+{
+    if (p->dec_root)
+        mp_filter_graph_lock(p->dec_root);
+}
+
+static void unlock_decoder(struct priv *p)
+{
+    if (p->dec_root)
+        mp_filter_graph_unlock(p->dec_root);
+}
+
+static int decoder_control(struct priv *p, enum dec_ctrl cmd, void *arg)
+{
+    if (!p->decoder || !p->decoder->control)
+        return CONTROL_UNKNOWN;
+
+    // Called per frame; don't wait for the decoder thread.
+    if (p->dec_root && cmd == VDCTRL_GET_BFRAMES) {
+        int bframes = atomic_load(&p->bframes);
+        if (bframes < 0)
+            return CONTROL_UNKNOWN;
+        *(int *)arg = bframes;
+        return CONTROL_TRUE;
+    }
+
+    lock_decoder(p);
+    int r = p->decoder->control(p->decoder->f, cmd, arg);
+    unlock_decoder(p);
+    return r;
+}
+
 static void reset_decoder(struct priv *p)
 {
     p->first_packet_pdts = MP_NOPTS_VALUE;
@@ -112,9 +170,20 @@ static void reset_decoder(struct priv *p)
     p->new_segment = NULL;
     p->start = p->end = MP_NOPTS_VALUE;
     p->coverart_returned = 0;
-
-    if (p->decoder)
+    mp_frame_unref(&p->cached_image);
+    p->have_image_key = false;
+
+    if (p->dec_root) {
+        lock_decoder(p);
+        mp_async_queue_reset(p->pkt_queue);
+        mp_async_queue_reset(p->frame_queue);
+        mp_filter_reset(p->dec_proxy);
+        unlock_decoder(p);
+        mp_filter_reset(p->pkt_sink);
+        mp_filter_reset(p->frame_src);
+    } else if (p->decoder) {
         mp_filter_reset(p->decoder->f);
+    }
 }
 
 static void reset(struct mp_filter *f)
@@ -128,9 +197,7 @@ int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
                                enum dec_ctrl cmd, void *arg)
 {
     struct priv *p = d->f->priv;
-    if (p->decoder && p->decoder->control)
-        return p->decoder->control(p->decoder->f, cmd, arg);
-    return CONTROL_UNKNOWN;
+    return decoder_control(p, cmd, arg);
 }
 
 static void destroy(struct mp_filter *f)
@@ -138,11 +205,21 @@ static void destroy(struct mp_filter *f)
     struct priv *p = f->priv;
     if (p->decoder) {
         MP_VERBOSE(f, "Uninit decoder.\n");
+        lock_decoder(p);
         talloc_free(p->decoder->f);
         p->decoder = NULL;
+        unlock_decoder(p);
+    }
+    if (p->dec_root) {
+        // Stops the decoder thread.
+        talloc_free(p->dec_root);
+        p->dec_root = NULL;
     }
     reset_decoder(p);
     mp_frame_unref(&p->decoded_coverart);
+    mp_frame_unref(&p->cached_image);
+    talloc_free(p->pkt_queue);
+    talloc_free(p->frame_queue);
 }
 
 struct mp_decoder_list *video_decoder_list(void)
@@ -164,12 +241,15 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
     struct priv *p = d->f->priv;
     struct MPOpts *opts = p->opts;
 
+    lock_decoder(p);
     if (p->decoder)
         talloc_free(p->decoder->f);
     p->decoder = NULL;
+    unlock_decoder(p);
 
     reset_decoder(p);
     p->has_broken_packet_pts = -10; // needs 10 packets to reach decision
+    atomic_store(&p->bframes, -1);
 
     const struct mp_decoder_fns *driver = NULL;
     struct mp_decoder_list *list = NULL;
@@ -208,7 +288,10 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
         struct mp_decoder_entry *sel = &list->entries[n];
         MP_VERBOSE(p, "Opening decoder %s\n", sel->decoder);
 
-        p->decoder = driver->create(p->f, p->codec, sel->decoder);
+        lock_decoder(p);
+        p->decoder = driver->create(p->dec_root ? p->dec_proxy : p->f,
+                                    p->codec, sel->decoder);
+        unlock_decoder(p);
         if (p->decoder) {
             p->public.decoder_desc =
                 talloc_asprintf(p, "%s (%s)", sel->decoder, sel->desc);
@@ -222,6 +305,9 @@ bool mp_decoder_wrapper_reinit(struct mp_decoder_wrapper *d)
     if (!p->decoder) {
         MP_ERR(p, "Failed to initialize a decoder for codec '%s'.\n",
                p->codec->codec ? p->codec->codec : "<?>");
+    } else if (!p->dec_root) {
+        p->dec_in = p->decoder->f->pins[0];
+        p->dec_out = p->decoder->f->pins[1];
     }
 
     talloc_free(list);
@@ -367,7 +453,7 @@ static void process_video_frame(struct priv *p, struct mp_image *mpi)
         opts->correct_pts && mpi->pts != MP_NOPTS_VALUE && p->public.fps > 0)
     {
         int delay = -1;
-        p->decoder->control(p->decoder->f, VDCTRL_GET_BFRAMES, &delay);
+        decoder_control(p, VDCTRL_GET_BFRAMES, &delay);
         mpi->pts -= MPMAX(delay, 0) / p->public.fps;
     }
 
@@ -446,9 +532,38 @@ static bool is_new_segment(struct priv *p, struct mp_frame frame)
                               pkt->codec != p->codec);
 }
 
+// Check whether the packet was decoded before. If so, set p->cached_image, and
+// return true. Otherwise, remember the key for adding the decoded image.
+static bool lookup_cached_image(struct priv *p, struct demux_packet *packet)
+{
+    struct mp_image_cache *cache = p->public.image_cache;
+    p->have_image_key = false;
+    // Each packet of these is a single independently decoded image. Only use
+    // it if no output is pending, which guarantees the frame order.
+    if (!cache || p->header->type != STREAM_VIDEO ||
+        !(p->header->attached_picture || p->header->still_image) ||
+        p->packets_without_output || p->cached_image.type || !packet->len)
+        return false;
+
+    mp_image_cache_key(&p->image_key, packet->buffer, packet->len);
+    p->have_image_key = true;
+
+    struct mp_image *img = mp_image_cache_get(cache, &p->image_key);
+    if (!img)
+        return false;
+
+    MP_VERBOSE(p, "Using cached image.\n");
+    img->pts = packet->pts;
+    img->dts = packet->dts;
+    p->cached_image = MAKE_FRAME(MP_FRAME_VIDEO, img);
+    p->have_image_key = false;
+    mp_filter_internal_mark_progress(p->f);
+    return true;
+}
+
 static void feed_packet(struct priv *p)
 {
-    if (!p->decoder || !mp_pin_in_needs_data(p->decoder->f->pins[0]))
+    if (!p->decoder || !mp_pin_in_needs_data(p->dec_in))
         return;
 
     if (!p->packet.type && !p->new_segment) {
@@ -489,7 +604,13 @@ static void feed_packet(struct priv *p)
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
             framedrop_type = 2;
 
-        p->decoder->control(p->decoder->f, VDCTRL_SET_FRAMEDROP, &framedrop_type);
+        // With a decoder thread, packets can be queued, so the decision is
+        // passed along with the packet it was made for.
+        if (!p->dec_root) {
+            decoder_control(p, VDCTRL_SET_FRAMEDROP, &framedrop_type);
+        } else if (packet) {
+            packet->framedrop_type = framedrop_type;
+        }
     }
 
     if (p->public.recorder_sink)
@@ -508,7 +629,12 @@ static void feed_packet(struct priv *p)
     if (p->first_packet_pdts == MP_NOPTS_VALUE)
         p->first_packet_pdts = pkt_pdts;
 
-    mp_pin_in_write(p->decoder->f->pins[0], p->packet);
+    if (packet && lookup_cached_image(p, packet)) {
+        mp_frame_unref(&p->packet);
+        return;
+    }
+
+    mp_pin_in_write(p->dec_in, p->packet);
     p->packet = MP_NO_FRAME;
 
     p->packets_without_output += 1;
@@ -573,9 +699,16 @@ static void read_frame(struct priv *p)
         return;
     }
 
-    struct mp_frame frame = mp_pin_out_read(p->decoder->f->pins[1]);
-    if (!frame.type)
-        return;
+    struct mp_frame frame = p->cached_image;
+    p->cached_image = MP_NO_FRAME;
+    if (!frame.type) {
+        frame = mp_pin_out_read(p->dec_out);
+        if (!frame.type)
+            return;
+        if (p->have_image_key && frame.type == MP_FRAME_VIDEO)
+            mp_image_cache_add(p->public.image_cache, &p->image_key, frame.data);
+        p->have_image_key = false;
+    }
 
     if (p->public.attempt_framedrops) {
         int dropped = MPMAX(0, p->packets_without_output - 1);
@@ -636,6 +769,103 @@ static const struct mp_filter_info decode_wrapper_filter = {
     .destroy = destroy,
 };
 
+// Runs in the decoder thread, and passes data between the queues and the
+// decoder.
+static void dec_proxy_process(struct mp_filter *f)
+{
+    struct priv *p = *(struct priv **)f->priv;
+
+    if (!p->decoder)
+        return;
+
+    struct mp_filter *dec = p->decoder->f;
+
+    if (mp_pin_can_transfer_data(dec->pins[0], p->pkt_src->pins[0])) {
+        struct mp_frame frame = mp_pin_out_read(p->pkt_src->pins[0]);
+        if (frame.type == MP_FRAME_PACKET && p->decoder->control) {
+            struct demux_packet *pkt = frame.data;
+            p->decoder->control(dec, VDCTRL_SET_FRAMEDROP,
+                                &pkt->framedrop_type);
+        }
+        mp_pin_in_write(dec->pins[0], frame);
+    }
+
+    if (mp_pin_can_transfer_data(p->frame_sink->pins[0], dec->pins[1])) {
+        struct mp_frame frame = mp_pin_out_read(dec->pins[1]);
+        if (frame.type == MP_FRAME_VIDEO && p->decoder->control) {
+            int bframes = -1;
+            p->decoder->control(dec, VDCTRL_GET_BFRAMES, &bframes);
+            atomic_store(&p->bframes, bframes);
+        }
+        mp_pin_in_write(p->frame_sink->pins[0], frame);
+    }
+}
+
+static const struct mp_filter_info dec_proxy_filter = {
+    .name = "dec_proxy",
+    .priv_size = sizeof(struct priv *),
+    .process = dec_proxy_process,
+};
+
+// Create the filter graph the decoder runs in on a separate thread.
+static bool init_decoder_thread(struct priv *p, struct mp_filter *parent,
+                                int max_frames, const char *name)
+{
+    p->dec_root = mp_filter_create_root(p->f->global);
+    // For hwdec and DR, which are thread-safe.
+    p->dec_root->stream_info = mp_filter_find_stream_info(parent);
+
+    p->dec_proxy = mp_filter_create(p->dec_root, &dec_proxy_filter);
+    if (!p->dec_proxy)
+        goto error;
+    *(struct priv **)p->dec_proxy->priv = p;
+    p->dec_proxy->log = p->log;
+
+    p->pkt_queue = mp_async_queue_create();
+    mp_async_queue_set_max_frames(p->pkt_queue, THREAD_QUEUE_PACKETS);
+    p->frame_queue = mp_async_queue_create();
+    mp_async_queue_set_max_frames(p->frame_queue, max_frames);
+    if (p->header->type == STREAM_VIDEO) {
+        mp_async_queue_set_max_duration(p->frame_queue,
+                                        p->opts->vd_queue_max_secs);
+        mp_async_queue_set_max_bytes(p->frame_queue,
+                                     p->opts->vd_queue_max_bytes);
+    }
+    if (p->header->type == STREAM_AUDIO) {
+        mp_async_queue_set_max_duration(p->frame_queue,
+                                        p->opts->ad_queue_max_secs);
+    }
+
+    p->pkt_sink =
+        mp_async_queue_create_filter(p->f, MP_PIN_IN, p->pkt_queue);
+    p->frame_src =
+        mp_async_queue_create_filter(p->f, MP_PIN_OUT, p->frame_queue);
+    p->pkt_src =
+        mp_async_queue_create_filter(p->dec_proxy, MP_PIN_OUT, p->pkt_queue);
+    p->frame_sink =
+        mp_async_queue_create_filter(p->dec_proxy, MP_PIN_IN, p->frame_queue);
+    if (!p->pkt_sink || !p->frame_src || !p->pkt_src || !p->frame_sink)
+        goto error;
+    p->dec_in = p->pkt_sink->pins[0];
+    p->dec_out = p->frame_src->pins[0];
+
+    if (!mp_filter_root_run_thread(p->dec_root, name))
+        goto error;
+
+    return true;
+
+error:
+    MP_WARN(p, "Could not create decoder thread.\n");
+    TA_FREEP(&p->pkt_sink);
+    TA_FREEP(&p->frame_src);
+    TA_FREEP(&p->dec_root);
+    TA_FREEP(&p->pkt_queue);
+    TA_FREEP(&p->frame_queue);
+    p->dec_proxy = p->pkt_src = p->frame_sink = NULL;
+    p->dec_in = p->dec_out = NULL;
+    return false;
+}
+
 struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
                                                      struct sh_stream *src)
 {
@@ -675,19 +905,23 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         goto error;
     p->demux = demux->pins[0];
 
+    atomic_store(&p->bframes, -1);
+
+    if (p->header->type == STREAM_VIDEO && p->opts->vd_queue_enable)
+        init_decoder_thread(p, parent, p->opts->vd_queue_max_frames, "vdec");
+    if (p->header->type == STREAM_AUDIO && p->opts->ad_queue_enable)
+        init_decoder_thread(p, parent, p->opts->ad_queue_max_frames, "adec");
+
     return w;
 error:
     talloc_free(f);
     return NULL;
 }
 
-void lavc_process(struct mp_filter *f, bool *eof_flag,
-                  bool (*send)(struct mp_filter *f, struct demux_packet *pkt),
-                  bool (*receive)(struct mp_filter *f, struct mp_frame *res))
+static void lavc_process_data(struct mp_filter *f, bool *eof_flag,
+        bool (*send)(struct mp_filter *f, struct demux_packet *pkt),
+        bool (*receive)(struct mp_filter *f, struct mp_frame *res))
 {
-    if (!mp_pin_in_needs_data(f->ppins[1]))
-        return;
-
     struct mp_frame frame = {0};
     if (!receive(f, &frame)) {
         if (!*eof_flag)
@@ -721,3 +955,15 @@ void lavc_process(struct mp_filter *f, bool *eof_flag,
         mp_filter_internal_mark_progress(f);
     }
 }
+
+void lavc_process(struct mp_filter *f, bool *eof_flag,
+                  bool (*send)(struct mp_filter *f, struct demux_packet *pkt),
+                  bool (*receive)(struct mp_filter *f, struct mp_frame *res))
+{
+    if (!mp_pin_in_needs_data(f->ppins[1]))
+        return;
+
+    int64_t trace = mp_trace_begin();
+    lavc_process_data(f, eof_flag, send, receive);
+    mp_trace_end("lavc_process", trace);
+}
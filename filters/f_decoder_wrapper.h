@@ -37,6 +37,8 @@ struct mp_decoder_wrapper {
 
     // Can be set by user.
     struct mp_recorder_sink *recorder_sink;
+    // Can be set by user. Used for cover art and still images (video only).
+    struct mp_image_cache *image_cache;
 
     // --- for STREAM_VIDEO
 
@@ -76,6 +78,16 @@ enum dec_ctrl {
     VDCTRL_GET_BFRAMES,
     // framedrop mode: 0=none, 1=standard, 2=hrseek
     VDCTRL_SET_FRAMEDROP,
+    VDCTRL_GET_STATS, // struct mp_decoder_stats*
+    VDCTRL_TRIM_MEMORY, // free pooled memory not in use
+};
+
+struct mp_decoder_stats {
+    double frame_time;      // average time spent in the decoder per frame (s)
+    double load;            // fraction of wall time spent in the decoder
+    int threads;            // number of decoder threads
+    const char *thread_type; // "frame", "slice", or NULL (single thread)
+    int queued_frames;      // frames sent to the decoder but not returned yet
 };
 
 int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
@@ -108,6 +120,9 @@ extern const struct mp_decoder_fns vd_lavc;
 extern const struct mp_decoder_fns ad_lavc;
 extern const struct mp_decoder_fns ad_spdif;
 
+// Free the decoder kept open by --vd-lavc-reuse, if any.
+void vd_lavc_free_cached_decoder(void);
+
 // Convenience wrapper for lavc based decoders. eof_flag must be set to false
 // on init and resets.
 void lavc_process(struct mp_filter *f, bool *eof_flag,
@@ -1,7 +1,12 @@
+#include <pthread.h>
+
 #include <libavutil/buffer.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/mem.h>
 
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "options/options.h"
 #include "video/fmt-conversion.h"
 #include "video/hwdec.h"
 #include "video/mp_image.h"
@@ -19,9 +24,28 @@ struct priv {
     int last_upload_fmt;
     int last_sw_fmt;
 
+    // For --hwupload-async-frames. Uploads run on upload_thread, and are
+    // returned in order.
+    int async_frames;
+    struct mp_thread_pool *upload_thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct upload_job **jobs;   // queued frames, oldest first
+    int num_jobs;
+
     struct mp_hwupload public;
 };
 
+struct upload_job {
+    struct mp_filter *f;
+    // Input frame. Frames which are not uploaded are just passed through.
+    struct mp_frame in;
+    AVBufferRef *hw_pool;
+    // Set by the upload thread (protected by priv.lock).
+    bool done;
+    struct mp_image *out;       // NULL on failure
+};
+
 static bool update_format_decision(struct priv *p, int input_fmt)
 {
     struct mp_hwupload *u = &p->public;
@@ -80,38 +104,35 @@ int mp_hwupload_find_upload_format(struct mp_hwupload *u, int imgfmt)
     return p->last_upload_fmt;
 }
 
-static void process(struct mp_filter *f)
+// Check whether the frame needs to be uploaded, and prepare the frame pool.
+// Returns false on error.
+static bool prepare_upload(struct mp_filter *f, struct mp_frame frame,
+                           bool *upload)
 {
     struct priv *p = f->priv;
 
-    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
-        return;
+    *upload = false;
 
-    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
-    if (mp_frame_is_signaling(frame)) {
-        mp_pin_in_write(f->ppins[1], frame);
-        return;
-    }
+    if (mp_frame_is_signaling(frame))
+        return true;
     if (frame.type != MP_FRAME_VIDEO) {
         MP_ERR(f, "unsupported frame type\n");
-        goto error;
+        return false;
     }
     struct mp_image *src = frame.data;
 
     // As documented, just pass though HW frames.
-    if (IMGFMT_IS_HWACCEL(src->imgfmt)) {
-        mp_pin_in_write(f->ppins[1], frame);
-        return;
-    }
+    if (IMGFMT_IS_HWACCEL(src->imgfmt))
+        return true;
 
     if (src->w % 2 || src->h % 2) {
         MP_ERR(f, "non-mod 2 input frames unsupported\n");
-        goto error;
+        return false;
     }
 
     if (!update_format_decision(p, src->imgfmt)) {
         MP_ERR(f, "no hw upload format found\n");
-        goto error;
+        return false;
     }
 
     if (!mp_update_av_hw_frames_pool(&p->hw_pool, p->av_device_ctx,
@@ -119,10 +140,151 @@ static void process(struct mp_filter *f)
                                      src->w, src->h))
     {
         MP_ERR(f, "failed to create frame pool\n");
+        return false;
+    }
+
+    *upload = true;
+    return true;
+}
+
+static void upload_job_free(struct upload_job *job)
+{
+    mp_frame_unref(&job->in);
+    av_buffer_unref(&job->hw_pool);
+    talloc_free(job->out);
+    talloc_free(job);
+}
+
+// Runs on the upload thread.
+static void upload_worker(void *ctx)
+{
+    struct upload_job *job = ctx;
+    struct priv *p = job->f->priv;
+
+    struct mp_image *out = mp_av_pool_image_hw_upload(job->hw_pool,
+                                                      job->in.data);
+
+    pthread_mutex_lock(&p->lock);
+    job->out = out;
+    job->done = true;
+    pthread_cond_broadcast(&p->wakeup);
+    // Inside the lock, so the filter can't be destroyed before this.
+    mp_filter_wakeup(job->f);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void wait_jobs(struct priv *p)
+{
+    pthread_mutex_lock(&p->lock);
+    for (int n = 0; n < p->num_jobs; n++) {
+        while (!p->jobs[n]->done)
+            pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void flush_jobs(struct priv *p)
+{
+    wait_jobs(p);
+    for (int n = 0; n < p->num_jobs; n++)
+        upload_job_free(p->jobs[n]);
+    p->num_jobs = 0;
+}
+
+static void process_async(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->num_jobs && mp_pin_in_needs_data(f->ppins[1])) {
+        struct upload_job *job = p->jobs[0];
+
+        pthread_mutex_lock(&p->lock);
+        bool done = job->done;
+        pthread_mutex_unlock(&p->lock);
+
+        if (done) {
+            MP_TARRAY_REMOVE_AT(p->jobs, p->num_jobs, 0);
+            struct mp_frame out = job->in;
+            if (job->hw_pool) {
+                if (!job->out) {
+                    upload_job_free(job);
+                    goto error;
+                }
+                out = MAKE_FRAME(MP_FRAME_VIDEO, job->out);
+                job->out = NULL;
+            } else {
+                job->in = MP_NO_FRAME;
+            }
+            upload_job_free(job);
+            mp_pin_in_write(f->ppins[1], out);
+            mp_filter_internal_mark_progress(f);
+        }
+    }
+
+    // Don't read past EOF before it was passed on.
+    if (p->num_jobs &&
+        p->jobs[p->num_jobs - 1]->in.type == MP_FRAME_EOF)
+        return;
+
+    if (p->num_jobs >= p->async_frames ||
+        !mp_pin_out_request_data(f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    bool upload;
+    if (!prepare_upload(f, frame, &upload)) {
+        mp_frame_unref(&frame);
+        goto error;
+    }
+
+    struct upload_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct upload_job){
+        .f = f,
+        .in = frame,
+        .done = !upload,
+    };
+    MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+
+    if (upload) {
+        job->hw_pool = av_buffer_ref(p->hw_pool);
+        if (!job->hw_pool) {
+            job->done = true;
+        } else {
+            mp_thread_pool_queue(p->upload_thread, upload_worker, job);
+        }
+    }
+
+    mp_filter_internal_mark_progress(f);
+    return;
+
+error:
+    MP_ERR(f, "failed to upload frame\n");
+    mp_filter_internal_mark_failed(f);
+}
+
+static void process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->upload_thread) {
+        process_async(f);
+        return;
+    }
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    bool upload;
+    if (!prepare_upload(f, frame, &upload))
         goto error;
+
+    if (!upload) {
+        mp_pin_in_write(f->ppins[1], frame);
+        return;
     }
 
-    struct mp_image *dst = mp_av_pool_image_hw_upload(p->hw_pool, src);
+    struct mp_image *dst = mp_av_pool_image_hw_upload(p->hw_pool, frame.data);
     if (!dst)
         goto error;
 
@@ -137,10 +299,21 @@ error:
     mp_filter_internal_mark_failed(f);
 }
 
+static void reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    flush_jobs(p);
+}
+
 static void destroy(struct mp_filter *f)
 {
     struct priv *p = f->priv;
 
+    flush_jobs(p);
+    talloc_free(p->upload_thread);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
     av_buffer_unref(&p->hw_pool);
     av_buffer_unref(&p->av_device_ctx);
 }
@@ -149,6 +322,7 @@ static const struct mp_filter_info hwupload_filter = {
     .name = "hwupload",
     .priv_size = sizeof(struct priv),
     .process = process,
+    .reset = reset,
     .destroy = destroy,
 };
 
@@ -285,6 +459,9 @@ struct mp_hwupload *mp_hwupload_create(struct mp_filter *parent, int hw_imgfmt)
     struct mp_hwupload *u = &p->public;
     u->f = f;
 
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
     mp_filter_add_pin(f, MP_PIN_IN, "in");
     mp_filter_add_pin(f, MP_PIN_OUT, "out");
 
@@ -293,6 +470,17 @@ struct mp_hwupload *mp_hwupload_create(struct mp_filter *parent, int hw_imgfmt)
         goto error;
     }
 
+    struct MPOpts *opts = mp_get_config_group(NULL, f->global, NULL);
+    p->async_frames = opts->hwupload_async_frames;
+    talloc_free(opts);
+    if (p->async_frames > 0) {
+        p->upload_thread = mp_thread_pool_create(p, 1);
+        if (!p->upload_thread) {
+            MP_WARN(f, "failed to create upload thread\n");
+            p->async_frames = 0;
+        }
+    }
+
     return u;
 error:
     talloc_free(f);
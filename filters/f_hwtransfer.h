@@ -2,7 +2,8 @@
 
 #include "filter.h"
 
-// A filter which uploads sw frames to hw. Ignores hw frames.
+// A filter which uploads sw frames to hw. Ignores hw frames. With
+// --hwupload-async-frames, uploads run on a separate thread.
 struct mp_hwupload {
     struct mp_filter *f;
 
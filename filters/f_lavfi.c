@@ -44,6 +44,7 @@
 #include "audio/fmt-conversion.h"
 #include "video/fmt-conversion.h"
 #include "video/hwdec.h"
+#include "video/sws_utils.h"
 
 #include "f_lavfi.h"
 #include "filter.h"
@@ -65,6 +66,9 @@ struct lavfi {
     enum mp_frame_type force_type;
     bool direct_filter;
     char **direct_filter_opts;
+    // On video format changes, convert the input to the format the graph was
+    // configured with, instead of recreating the graph.
+    bool convert_formats;
 
     AVFilterGraph *graph;
     // Set to true once all inputs have been initialized, and the graph is
@@ -93,6 +97,9 @@ struct lavfi {
 
     AVFrame *tmp_frame;
 
+    // If >0, return audio output in frames of this many samples.
+    int batch_samples;
+
     // Audio timestamp emulation.
     bool emulate_audio_pts;
     double in_pts;      // last input timestamps
@@ -125,6 +132,9 @@ struct lavfi_pad {
 
     // Used to check input format changes.
     struct mp_frame in_fmt;
+
+    // For convert_formats (lazily allocated).
+    struct mp_sws_context *sws;
 };
 
 // Free the libavfilter graph (not c), reset all state.
@@ -340,7 +350,7 @@ static bool is_aformat_ok(struct mp_aframe *a, struct mp_aframe *b)
 static bool is_vformat_ok(struct mp_image *a, struct mp_image *b)
 {
     return a->imgfmt == b->imgfmt &&
-           a->w == b->w && a->h && b->h &&
+           a->w == b->w && a->h == b->h &&
            a->params.p_w == b->params.p_w && a->params.p_h == b->params.p_h &&
            a->nominal_fps == b->nominal_fps;
 }
@@ -353,6 +363,45 @@ static bool is_format_ok(struct mp_frame a, struct mp_frame b)
     return false;
 }
 
+// With convert_formats, try to make pad->pending compatible with the format
+// the graph was configured with. Returns false if the graph must be recreated.
+static bool convert_pending_input(struct lavfi *c, struct lavfi_pad *pad)
+{
+    if (!c->convert_formats || pad->type != MP_FRAME_VIDEO)
+        return false;
+
+    struct mp_image *src = pad->pending.data;
+    struct mp_image *fmt = pad->in_fmt.data;
+
+    if (src->hwctx || fmt->hwctx)
+        return false;
+
+    // libavfilter accepts aspect ratio and frame rate changes on the fly.
+    if (src->imgfmt == fmt->imgfmt && src->w == fmt->w && src->h == fmt->h)
+        return true;
+
+    if (!pad->sws) {
+        pad->sws = mp_sws_alloc(pad);
+        mp_sws_set_from_cmdline(pad->sws, c->f->global);
+    }
+
+    struct mp_image *dst = mp_image_alloc(fmt->imgfmt, fmt->w, fmt->h);
+    if (!dst)
+        return false;
+    if (mp_sws_scale(pad->sws, dst, src) < 0) {
+        talloc_free(dst);
+        return false;
+    }
+    mp_image_copy_attributes(dst, src);
+    // The image is stretched to the old size, so keep its aspect ratio.
+    dst->params.p_w = fmt->params.p_w;
+    dst->params.p_h = fmt->params.p_h;
+
+    mp_frame_unref(&pad->pending);
+    pad->pending = MAKE_FRAME(MP_FRAME_VIDEO, dst);
+    return true;
+}
+
 static void read_pad_input(struct lavfi *c, struct lavfi_pad *pad)
 {
     assert(pad->dir == MP_PIN_IN);
@@ -370,7 +419,8 @@ static void read_pad_input(struct lavfi *c, struct lavfi_pad *pad)
     }
 
     if (mp_frame_is_data(pad->pending) && pad->in_fmt.type &&
-        !is_format_ok(pad->pending, pad->in_fmt))
+        !is_format_ok(pad->pending, pad->in_fmt) &&
+        !(c->initialized && convert_pending_input(c, pad)))
     {
         if (!c->draining_recover)
             MP_VERBOSE(c, "format change on %s\n", pad->name);
@@ -667,8 +717,16 @@ static bool read_output_pads(struct lavfi *c)
         assert(pad->buffer);
 
         int r = AVERROR_EOF;
-        if (!pad->buffer_is_eof)
-            r = av_buffersink_get_frame_flags(pad->buffer, c->tmp_frame, 0);
+        if (!pad->buffer_is_eof) {
+            if (pad->type == MP_FRAME_AUDIO && c->batch_samples > 0) {
+                // Collects tiny frames into larger ones inside libavfilter,
+                // so that the following filters run less often.
+                r = av_buffersink_get_samples(pad->buffer, c->tmp_frame,
+                                              c->batch_samples);
+            } else {
+                r = av_buffersink_get_frame_flags(pad->buffer, c->tmp_frame, 0);
+            }
+        }
         if (r >= 0) {
 #if LIBAVUTIL_VERSION_MICRO >= 100
             mp_tags_copy_from_av_dictionary(pad->metadata, c->tmp_frame->metadata);
@@ -905,6 +963,8 @@ struct lavfi_user_opts {
     char **filter_opts;
 
     int fix_pts;
+    int format_change;
+    int batch_samples;
 };
 
 static struct mp_filter *lavfi_create(struct mp_filter *parent, void *options)
@@ -921,6 +981,8 @@ static struct mp_filter *lavfi_create(struct mp_filter *parent, void *options)
     if (l) {
         struct lavfi *c = l->f->priv;
         c->emulate_audio_pts = opts->fix_pts;
+        c->convert_formats = opts->format_change == 1;
+        c->batch_samples = opts->batch_samples;
     }
     talloc_free(opts);
     return l ? l->f : NULL;
@@ -1070,6 +1132,7 @@ const struct mp_user_filter_entry af_lavfi = {
             OPT_STRING("graph", graph, M_OPT_MIN, .min = 1),
             OPT_FLAG("fix-pts", fix_pts, 0),
             OPT_KEYVALUELIST("o", avopts, 0),
+            OPT_INTRANGE("batch-samples", batch_samples, 0, 0, 1 << 20),
             {0}
         },
         .priv_defaults = &(const OPT_BASE_STRUCT){
@@ -1089,6 +1152,7 @@ const struct mp_user_filter_entry af_lavfi_bridge = {
             OPT_STRING("name", filter_name, M_OPT_MIN, .min = 1),
             OPT_KEYVALUELIST("opts", filter_opts, 0),
             OPT_KEYVALUELIST("o", avopts, 0),
+            OPT_INTRANGE("batch-samples", batch_samples, 0, 0, 1 << 20),
             {0}
         },
         .priv_defaults = &(const OPT_BASE_STRUCT){
@@ -1108,6 +1172,8 @@ const struct mp_user_filter_entry vf_lavfi = {
         .options = (const m_option_t[]){
             OPT_STRING("graph", graph, M_OPT_MIN, .min = 1),
             OPT_KEYVALUELIST("o", avopts, 0),
+            OPT_CHOICE("format-change", format_change, 0,
+                       ({"recreate", 0}, {"convert", 1})),
             {0}
         },
         .priv_defaults = &(const OPT_BASE_STRUCT){
@@ -1127,6 +1193,8 @@ const struct mp_user_filter_entry vf_lavfi_bridge = {
             OPT_STRING("name", filter_name, M_OPT_MIN, .min = 1),
             OPT_KEYVALUELIST("opts", filter_opts, 0),
             OPT_KEYVALUELIST("o", avopts, 0),
+            OPT_CHOICE("format-change", format_change, 0,
+                       ({"recreate", 0}, {"convert", 1})),
             {0}
         },
         .priv_defaults = &(const OPT_BASE_STRUCT){
@@ -504,6 +504,28 @@ double mp_output_get_measured_total_delay(struct mp_output_chain *c)
     return delay;
 }
 
+int mp_output_chain_get_perf(struct mp_output_chain *c, void *ta_parent,
+                             struct mp_output_chain_perf **entries)
+{
+    struct chain *p = c->f->priv;
+
+    *entries = talloc_array(ta_parent, struct mp_output_chain_perf,
+                            p->num_all_filters);
+
+    for (int n = 0; n < p->num_all_filters; n++) {
+        struct mp_user_filter *u = p->all_filters[n];
+        struct mp_output_chain_perf *e = &(*entries)[n];
+
+        *e = (struct mp_output_chain_perf){
+            .name = u->name,
+            .label = u->label,
+        };
+        mp_filter_get_perf(u->wrapper, &e->perf);
+    }
+
+    return p->num_all_filters;
+}
+
 static bool compare_filter(struct m_obj_settings *a, struct m_obj_settings *b)
 {
     if (a == b || !a || !b)
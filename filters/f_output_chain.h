@@ -65,6 +65,18 @@ void mp_output_chain_set_ao(struct mp_output_chain *p, struct ao *ao);
 bool mp_output_chain_command(struct mp_output_chain *p, const char *target,
                              struct mp_filter_command *cmd);
 
+struct mp_output_chain_perf {
+    const char *name;       // filter name, or internal name like "convert"
+    const char *label;      // filter label, or NULL
+    struct mp_filter_perf perf; // see mp_filter_get_perf()
+};
+
+// Return the number of filters in the chain, and set *entries to an array with
+// the counters of each filter (allocated under ta_parent), in processing order.
+// The strings are valid until the filter list changes.
+int mp_output_chain_get_perf(struct mp_output_chain *p, void *ta_parent,
+                             struct mp_output_chain_perf **entries);
+
 // Perform a seek reset _and_ reset all filter failure states, so that future
 // filtering continues normally.
 void mp_output_chain_reset_harder(struct mp_output_chain *p);
@@ -56,6 +56,30 @@
 #error "config.h broken or no resampler found"
 #endif
 
+// Number of inactive resampler contexts kept around, so that switching back to
+// a previously used configuration (e.g. toggling the playback speed without
+// pitch correction) does not need to rebuild the context and its filter bank.
+#define MAX_CACHED_LAVRR 4
+
+// State of an inactive resampler context. Mirrors the corresponding fields in
+// struct priv (in_rate is the adjusted rate as used by lavrr).
+struct cached_lavrr {
+    int in_rate;
+    int in_format;
+    struct mp_chmap in_channels;
+    int out_rate;
+    int out_format;
+    struct mp_chmap out_channels;
+    bool is_resampling;
+    struct AVAudioResampleContext *avrctx;
+    struct mp_aframe *avrctx_fmt;
+    struct mp_aframe *pool_fmt;
+    struct mp_aframe *pre_out_fmt;
+    struct AVAudioResampleContext *avrctx_out;
+    int reorder_in[MP_NUM_CHANNELS];
+    int reorder_out[MP_NUM_CHANNELS];
+};
+
 struct priv {
     struct mp_log *log;
     bool is_resampling;
@@ -70,6 +94,8 @@ struct priv {
     int reorder_out[MP_NUM_CHANNELS];
     struct mp_aframe_pool *reorder_buffer;
     struct mp_aframe_pool *out_pool;
+    // Reused for the avrctx output if it has to go through avrctx_out.
+    struct mp_aframe *tmp_frame;
 
     int in_rate_user; // user input sample rate
     int in_rate;      // actual rate (used by lavr), adjusted for playback speed
@@ -85,6 +111,10 @@ struct priv {
     double cmd_speed;
     double speed;
 
+    // Inactive contexts, oldest first.
+    struct cached_lavrr cache[MAX_CACHED_LAVRR];
+    int num_cache;
+
     struct mp_swresample public;
 };
 
@@ -142,6 +172,110 @@ static void close_lavrr(struct priv *p)
     TA_FREEP(&p->pool_fmt);
 }
 
+static void free_cached_lavrr(struct cached_lavrr *c)
+{
+    if (c->avrctx)
+        avresample_close(c->avrctx);
+    avresample_free(&c->avrctx);
+    if (c->avrctx_out)
+        avresample_close(c->avrctx_out);
+    avresample_free(&c->avrctx_out);
+
+    TA_FREEP(&c->pre_out_fmt);
+    TA_FREEP(&c->avrctx_fmt);
+    TA_FREEP(&c->pool_fmt);
+}
+
+static void flush_lavrr_cache(struct priv *p)
+{
+    for (int n = 0; n < p->num_cache; n++)
+        free_cached_lavrr(&p->cache[n]);
+    p->num_cache = 0;
+}
+
+// Move the current context (if any) to the cache, instead of destroying it.
+// The caller must have drained it.
+static void stash_lavrr(struct priv *p)
+{
+    if (!p->avrctx)
+        return;
+
+    if (p->num_cache == MAX_CACHED_LAVRR) {
+        free_cached_lavrr(&p->cache[0]);
+        MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+    }
+
+    struct cached_lavrr *c = &p->cache[p->num_cache++];
+    *c = (struct cached_lavrr){
+        .in_rate = p->in_rate,
+        .in_format = p->in_format,
+        .in_channels = p->in_channels,
+        .out_rate = p->out_rate,
+        .out_format = p->out_format,
+        .out_channels = p->out_channels,
+        .is_resampling = p->is_resampling,
+        .avrctx = p->avrctx,
+        .avrctx_fmt = p->avrctx_fmt,
+        .pool_fmt = p->pool_fmt,
+        .pre_out_fmt = p->pre_out_fmt,
+        .avrctx_out = p->avrctx_out,
+    };
+    memcpy(c->reorder_in, p->reorder_in, sizeof(c->reorder_in));
+    memcpy(c->reorder_out, p->reorder_out, sizeof(c->reorder_out));
+
+    p->avrctx = p->avrctx_out = NULL;
+    p->avrctx_fmt = p->pool_fmt = p->pre_out_fmt = NULL;
+}
+
+// Discard buffered audio and return the context to its initial state.
+static bool reset_lavrr(struct priv *p)
+{
+#if HAVE_LIBSWRESAMPLE
+    // The filter bank is reused by swr_init() if the parameters didn't change.
+    swr_close(p->avrctx);
+    return swr_init(p->avrctx) >= 0;
+#else
+    while (avresample_read(p->avrctx, NULL, 1000) > 0) {}
+    return true;
+#endif
+}
+
+// Make a cached context matching the current parameters the current one.
+static bool restore_lavrr(struct priv *p)
+{
+    assert(!p->avrctx);
+
+    for (int n = p->num_cache - 1; n >= 0; n--) {
+        struct cached_lavrr *c = &p->cache[n];
+        if (c->in_rate != p->in_rate ||
+            c->in_format != p->in_format ||
+            !mp_chmap_equals(&c->in_channels, &p->in_channels) ||
+            c->out_rate != p->out_rate ||
+            c->out_format != p->out_format ||
+            !mp_chmap_equals(&c->out_channels, &p->out_channels))
+            continue;
+
+        p->is_resampling = c->is_resampling;
+        p->avrctx = c->avrctx;
+        p->avrctx_fmt = c->avrctx_fmt;
+        p->pool_fmt = c->pool_fmt;
+        p->pre_out_fmt = c->pre_out_fmt;
+        p->avrctx_out = c->avrctx_out;
+        // libswresample keeps a pointer to p->reorder_in, which is shared by
+        // all contexts. This is fine as only the current one is ever used.
+        memcpy(p->reorder_in, c->reorder_in, sizeof(p->reorder_in));
+        memcpy(p->reorder_out, c->reorder_out, sizeof(p->reorder_out));
+        MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, n);
+
+        if (!reset_lavrr(p)) {
+            close_lavrr(p);
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
 static int rate_from_speed(int rate, double speed)
 {
     return lrint(rate * speed);
@@ -196,10 +330,16 @@ static void transpose_order(int *map, int num)
 
 static bool configure_lavrr(struct priv *p, bool verbose)
 {
-    close_lavrr(p);
+    stash_lavrr(p);
 
     p->in_rate = rate_from_speed(p->in_rate_user, p->speed);
 
+    if (restore_lavrr(p)) {
+        MP_VERBOSE(p, "reusing resampler for %dHz -> %dHz\n",
+                   p->in_rate, p->out_rate);
+        return true;
+    }
+
     MP_VERBOSE(p, "%dHz %s %s -> %dHz %s %s\n",
                p->in_rate, mp_chmap_to_str(&p->in_channels),
                af_fmt_to_str(p->in_format),
@@ -363,13 +503,8 @@ static void reset(struct mp_filter *f)
 
     if (!p->avrctx)
         return;
-#if HAVE_LIBSWRESAMPLE
-    swr_close(p->avrctx);
-    if (swr_init(p->avrctx) < 0)
+    if (!reset_lavrr(p))
         close_lavrr(p);
-#else
-    while (avresample_read(p->avrctx, NULL, 1000) > 0) {}
-#endif
 }
 
 static void extra_output_conversion(struct mp_aframe *mpa)
@@ -463,7 +598,9 @@ static struct mp_frame filter_resample_output(struct priv *p,
     consume_in = MPMIN(consume_in, max_in);
 
     int samples = get_out_samples(p, consume_in);
-    out = mp_aframe_create();
+    if (!p->tmp_frame)
+        p->tmp_frame = mp_aframe_create();
+    out = p->tmp_frame;
     mp_aframe_config_copy(out, p->pool_fmt);
     if (mp_aframe_pool_allocate(p->out_pool, out, samples) < 0)
         goto error;
@@ -492,12 +629,16 @@ static struct mp_frame filter_resample_output(struct priv *p,
         int got = 0;
         if (out_samples)
             got = resample_frame(p->avrctx_out, new, out, out_samples);
-        talloc_free(out);
+        mp_aframe_reset(out); // returns the data to the pool
         out = new;
         if (got != out_samples)
             goto error;
     }
 
+    // Passed on to the next filter.
+    if (out == p->tmp_frame)
+        p->tmp_frame = NULL;
+
     extra_output_conversion(out);
 
     if (in) {
@@ -520,6 +661,10 @@ static struct mp_frame filter_resample_output(struct priv *p,
 
     return out ? MAKE_FRAME(MP_FRAME_AUDIO, out) : MP_NO_FRAME;
 error:
+    if (out && out == p->tmp_frame) {
+        mp_aframe_reset(out);
+        out = NULL;
+    }
     talloc_free(out);
     MP_ERR(p, "Error on resampling.\n");
     mp_filter_internal_mark_failed(p->public.f);
@@ -704,7 +849,9 @@ static void destroy(struct mp_filter *f)
     struct priv *p = f->priv;
 
     close_lavrr(p);
+    flush_lavrr_cache(p);
     TA_FREEP(&p->input);
+    TA_FREEP(&p->tmp_frame);
 }
 
 static const struct mp_filter_info swresample_filter = {
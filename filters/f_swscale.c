@@ -26,6 +26,7 @@
 #include <libswscale/swscale.h>
 
 #include "common/av_common.h"
+#include "common/global.h"
 #include "common/msg.h"
 
 #include "options/options.h"
@@ -141,6 +142,7 @@ struct mp_sws_filter *mp_sws_filter_create(struct mp_filter *parent)
     s->sws = mp_sws_alloc(s);
     s->sws->log = f->log;
     s->pool = mp_image_pool_new(s);
+    mp_image_pool_set_hugepages(s->pool, f->global->opts->image_hugepages);
 
     mp_sws_set_from_cmdline(s->sws, f->global);
 
@@ -1,8 +1,12 @@
 #include <pthread.h>
+#include <time.h>
 
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/trace.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "video/hwdec.h"
 
 #include "filter.h"
@@ -50,6 +54,9 @@ struct mp_pin {
     // This flag is for checking and enforcing this.
     bool within_conn;
 
+    // Set for mp_filter.ppins[] (used by the owner for its own I/O).
+    bool is_private;
+
     // This is used for the final output mp_pin in connections only.
     bool data_requested;            // true if out wants new data
     struct mp_frame data;           // possibly buffered frame (MP_FRAME_NONE if
@@ -87,6 +94,21 @@ struct filter_runner {
     // by async_lock.
     struct mp_filter **async_pending;
     int num_async_pending;
+
+    // For mp_filter_root_run_thread().
+    bool threaded;
+    pthread_t thread;
+    char *thread_name;
+    // Held by the thread while filtering, and by mp_filter_graph_lock() users.
+    pthread_mutex_t graph_lock;
+    // Protects the following fields.
+    pthread_mutex_t thread_lock;
+    pthread_cond_t thread_wakeup;
+    bool thread_work;               // needs to run mp_filter_run()
+    bool thread_terminate;
+
+    // Measure process() times (enabled by mp_filter_add_perf()).
+    bool perf_timing;
 };
 
 struct mp_filter_internal {
@@ -105,6 +127,8 @@ struct mp_filter_internal {
     bool pending;
     bool async_pending;
     bool failed;
+
+    struct mp_filter_perf perf;
 };
 
 
@@ -173,6 +197,41 @@ static void flush_async_notifications(struct filter_runner *r)
     pthread_mutex_unlock(&r->async_lock);
 }
 
+static int64_t get_thread_cpu_time(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+static void run_process(struct filter_runner *r, struct mp_filter *f)
+{
+    struct mp_filter_perf *perf = &f->in->perf;
+    int64_t frames = perf->frames_in + perf->frames_out;
+    int64_t wall = 0, cpu = 0;
+
+    if (r->perf_timing) {
+        wall = mp_time_us();
+        cpu = get_thread_cpu_time();
+    }
+
+    int64_t trace = mp_trace_begin();
+    f->in->info->process(f);
+    mp_trace_end(f->in->info->name, trace);
+
+    if (r->perf_timing) {
+        perf->process_time += mp_time_us() - wall;
+        perf->cpu_time += get_thread_cpu_time() - cpu;
+    }
+
+    perf->process_calls += 1;
+    if (perf->frames_in + perf->frames_out == frames)
+        perf->stalls += 1;
+}
+
 bool mp_filter_run(struct mp_filter *filter)
 {
     struct filter_runner *r = filter->in->runner;
@@ -183,6 +242,8 @@ bool mp_filter_run(struct mp_filter *filter)
 
     r->filtering = true;
 
+    int64_t trace = mp_trace_begin();
+
     flush_async_notifications(r);
 
     while (r->num_pending) {
@@ -191,9 +252,11 @@ bool mp_filter_run(struct mp_filter *filter)
         next->in->pending = false;
 
         if (next->in->info->process)
-            next->in->info->process(next);
+            run_process(r, next);
     }
 
+    mp_trace_end("mp_filter_run", trace);
+
     r->filtering = false;
 
     bool externals = r->external_pending;
@@ -230,6 +293,8 @@ bool mp_pin_in_write(struct mp_pin *p, struct mp_frame frame)
         return false;
     }
     assert(p->conn->data.type == MP_FRAME_NONE);
+    if (p->is_private && mp_frame_is_data(frame))
+        p->owner->in->perf.frames_out += 1;
     p->conn->data = frame;
     p->conn->data_requested = false;
     add_pending(p->conn->manual_connection);
@@ -270,6 +335,8 @@ struct mp_frame mp_pin_out_read(struct mp_pin *p)
         return MP_NO_FRAME;
     struct mp_frame res = p->data;
     p->data = MP_NO_FRAME;
+    if (p->is_private && mp_frame_is_data(res))
+        p->owner->in->perf.frames_in += 1;
     return res;
 }
 
@@ -539,6 +606,7 @@ struct mp_pin *mp_filter_add_pin(struct mp_filter *f, enum mp_pin_dir dir,
         .owner = f,
         .other = p,
         .manual_connection = f,
+        .is_private = true,
     };
 
     MP_TARRAY_GROW(f, f->pins, f->num_pins);
@@ -633,6 +701,128 @@ void mp_filter_mark_async_progress(struct mp_filter *f)
     filter_wakeup(f, true);
 }
 
+static void thread_wakeup_cb(void *ctx)
+{
+    struct filter_runner *r = ctx;
+    pthread_mutex_lock(&r->thread_lock);
+    r->thread_work = true;
+    pthread_cond_signal(&r->thread_wakeup);
+    pthread_mutex_unlock(&r->thread_lock);
+}
+
+static void *filter_thread(void *ctx)
+{
+    struct filter_runner *r = ctx;
+    mpthread_set_name(r->thread_name);
+
+    pthread_mutex_lock(&r->thread_lock);
+    while (!r->thread_terminate) {
+        if (!r->thread_work) {
+            pthread_cond_wait(&r->thread_wakeup, &r->thread_lock);
+            continue;
+        }
+        r->thread_work = false;
+        pthread_mutex_unlock(&r->thread_lock);
+
+        pthread_mutex_lock(&r->graph_lock);
+        mp_filter_run(r->root_filter);
+        pthread_mutex_unlock(&r->graph_lock);
+
+        pthread_mutex_lock(&r->thread_lock);
+    }
+    pthread_mutex_unlock(&r->thread_lock);
+
+    return NULL;
+}
+
+bool mp_filter_root_run_thread(struct mp_filter *root, const char *name)
+{
+    struct filter_runner *r = root->in->runner;
+    assert(r->root_filter == root);
+    assert(!r->threaded);
+
+    pthread_mutex_init(&r->graph_lock, NULL);
+    pthread_mutex_init(&r->thread_lock, NULL);
+    pthread_cond_init(&r->thread_wakeup, NULL);
+    r->thread_name = talloc_strdup(r, name);
+    // Process whatever was queued before.
+    r->thread_work = true;
+
+    if (pthread_create(&r->thread, NULL, filter_thread, r)) {
+        pthread_cond_destroy(&r->thread_wakeup);
+        pthread_mutex_destroy(&r->thread_lock);
+        pthread_mutex_destroy(&r->graph_lock);
+        return false;
+    }
+
+    r->threaded = true;
+    pthread_mutex_lock(&r->async_lock);
+    r->wakeup_cb = thread_wakeup_cb;
+    r->wakeup_ctx = r;
+    pthread_mutex_unlock(&r->async_lock);
+    return true;
+}
+
+static void stop_thread(struct filter_runner *r)
+{
+    pthread_mutex_lock(&r->thread_lock);
+    r->thread_terminate = true;
+    pthread_cond_signal(&r->thread_wakeup);
+    pthread_mutex_unlock(&r->thread_lock);
+    pthread_join(r->thread, NULL);
+
+    pthread_mutex_lock(&r->async_lock);
+    r->wakeup_cb = NULL;
+    pthread_mutex_unlock(&r->async_lock);
+
+    pthread_cond_destroy(&r->thread_wakeup);
+    pthread_mutex_destroy(&r->thread_lock);
+    pthread_mutex_destroy(&r->graph_lock);
+    r->threaded = false;
+}
+
+void mp_filter_graph_lock(struct mp_filter *f)
+{
+    struct filter_runner *r = f->in->runner;
+    if (r->threaded)
+        pthread_mutex_lock(&r->graph_lock);
+}
+
+void mp_filter_graph_unlock(struct mp_filter *f)
+{
+    struct filter_runner *r = f->in->runner;
+    if (!r->threaded)
+        return;
+    // The caller might have made filters pending (e.g. by writing to a pin).
+    bool work = r->num_pending > 0;
+    pthread_mutex_unlock(&r->graph_lock);
+    if (work)
+        thread_wakeup_cb(r);
+}
+
+static void add_perf_times(struct mp_filter *f, struct mp_filter_perf *perf)
+{
+    struct mp_filter_perf *fp = &f->in->perf;
+    perf->process_calls += fp->process_calls;
+    perf->process_time += fp->process_time;
+    perf->cpu_time += fp->cpu_time;
+    perf->stalls += fp->stalls;
+
+    for (int n = 0; n < f->in->num_children; n++)
+        add_perf_times(f->in->children[n], perf);
+}
+
+void mp_filter_get_perf(struct mp_filter *f, struct mp_filter_perf *perf)
+{
+    f->in->runner->perf_timing = true;
+
+    *perf = (struct mp_filter_perf){
+        .frames_in = f->in->perf.frames_in,
+        .frames_out = f->in->perf.frames_out,
+    };
+    add_perf_times(f, perf);
+}
+
 void mp_filter_free_children(struct mp_filter *f)
 {
     while(f->in->num_children)
@@ -644,6 +834,9 @@ static void filter_destructor(void *p)
     struct mp_filter *f = p;
     struct filter_runner *r = f->in->runner;
 
+    if (r->root_filter == f && r->threaded)
+        stop_thread(r);
+
     if (f->in->info->destroy)
         f->in->info->destroy(f);
 
@@ -762,6 +955,7 @@ void mp_filter_root_set_wakeup_cb(struct mp_filter *root,
                                   void (*wakeup_cb)(void *ctx), void *ctx)
 {
     struct filter_runner *r = root->in->runner;
+    assert(!r->threaded);
     pthread_mutex_lock(&r->async_lock);
     r->wakeup_cb = wakeup_cb;
     r->wakeup_ctx = ctx;
@@ -426,5 +426,37 @@ struct mp_filter *mp_filter_create_root(struct mpv_global *global);
 void mp_filter_root_set_wakeup_cb(struct mp_filter *root,
                                   void (*wakeup_cb)(void *ctx), void *ctx);
 
+// Run the filter graph of root (created with mp_filter_create_root()) on a
+// new thread. The thread calls mp_filter_run() whenever a filter in the graph
+// was woken up. From then on, filters of this graph must be accessed by other
+// threads only with mp_filter_graph_lock() held, and the wakeup callback can
+// not be set anymore. Use a mp_async_queue (f_async_queue.h) to pass frames
+// between this graph and others. The thread is stopped when root is freed.
+// Returns false if the thread could not be created (nothing changes then).
+bool mp_filter_root_run_thread(struct mp_filter *root, const char *name);
+
+// Lock/unlock the filter graph f belongs to, if it runs on its own thread
+// (no-op otherwise). This waits until the graph's thread has stopped
+// filtering. Not recursive. The graph thread is woken up on unlock if needed.
+void mp_filter_graph_lock(struct mp_filter *f);
+void mp_filter_graph_unlock(struct mp_filter *f);
+
+// Counters accumulated by a filter since its creation.
+struct mp_filter_perf {
+    int64_t process_calls;  // number of process() invocations
+    int64_t process_time;   // wall time spent in process(), in microseconds
+    int64_t cpu_time;       // thread CPU time spent in process(), in us (or 0)
+    int64_t stalls;         // process() calls which read or wrote no frame
+    int64_t frames_in;      // data frames read from the filter's input pins
+    int64_t frames_out;     // data frames written to the filter's output pins
+};
+
+// Return the counters of f. The frame counts are for f itself, while the other
+// fields are summed over f and all its children, i.e. they include the work
+// done on behalf of f. The process() times are measured only after the first
+// call to this function on any filter of the same filter graph (to avoid the
+// overhead if nobody asks for them).
+void mp_filter_get_perf(struct mp_filter *f, struct mp_filter_perf *perf);
+
 // Debugging internal stuff.
 void mp_filter_dump_states(struct mp_filter *f);
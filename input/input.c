@@ -78,6 +78,13 @@ struct cmd_bind_section {
     struct mp_rect mouse_area;  // set at runtime, if at all
     bool mouse_area_set;        // mouse_area is valid and should be tested
     struct cmd_bind_section *next;
+    // Hash table of the binds by their last key (see find_binds_for_key()).
+    // index[hash & (index_size - 1)] is the first bind in the bucket, and
+    // index_next[n] the bind after binds[n] (-1 terminates).
+    int *index;
+    int *index_next;
+    int index_size;
+    bool index_valid;           // false if binds changed since index was built
 };
 
 #define MP_MAX_SOURCES 10
@@ -87,6 +94,7 @@ struct cmd_bind_section {
 struct active_section {
     char *name;
     int flags;
+    struct cmd_bind_section *bs; // sections are never freed
 };
 
 struct cmd_queue {
@@ -374,14 +382,43 @@ static void key_buf_add(int *buf, int code)
     buf[0] = code;
 }
 
-static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
-                                                  char *section, int code)
+static unsigned int key_hash(int code)
 {
-    struct cmd_bind_section *bs = get_bind_section(ictx, bstr0(section));
+    unsigned int h = (unsigned int)code * 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
 
+static void rebuild_bind_index(struct cmd_bind_section *bs)
+{
+    int size = 16;
+    while (size < bs->num_binds * 2)
+        size *= 2;
+    bs->index = talloc_realloc(bs, bs->index, int, size);
+    bs->index_next = talloc_realloc(bs, bs->index_next, int,
+                                    MPMAX(bs->num_binds, 1));
+    bs->index_size = size;
+    for (int n = 0; n < size; n++)
+        bs->index[n] = -1;
+    // Insert in reverse, so that each bucket lists the binds in array order.
+    for (int n = bs->num_binds - 1; n >= 0; n--) {
+        struct cmd_bind *b = &bs->binds[n];
+        int slot = key_hash(b->keys[b->num_keys - 1]) & (size - 1);
+        bs->index_next[n] = bs->index[slot];
+        bs->index[slot] = n;
+    }
+    bs->index_valid = true;
+}
+
+static struct cmd_bind *find_bind_in_section(struct input_ctx *ictx,
+                                             struct cmd_bind_section *bs,
+                                             int code)
+{
     if (!bs->num_binds)
         return NULL;
 
+    if (!bs->index_valid)
+        rebuild_bind_index(bs);
+
     int keys[MP_MAX_KEY_DOWN];
     memcpy(keys, ictx->key_history, sizeof(keys));
     key_buf_add(keys, code);
@@ -394,7 +431,9 @@ static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
             break;
         if (best)
             break;
-        for (int n = 0; n < bs->num_binds; n++) {
+        // Only binds ending with code can match; they're all in one bucket.
+        int slot = key_hash(code) & (bs->index_size - 1);
+        for (int n = bs->index[slot]; n >= 0; n = bs->index_next[n]) {
             if (bs->binds[n].is_builtin == (bool)builtin) {
                 struct cmd_bind *b = &bs->binds[n];
                 // we have: keys=[key2 key1 keyX ...]
@@ -412,6 +451,13 @@ static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
     return best;
 }
 
+static struct cmd_bind *find_bind_for_key_section(struct input_ctx *ictx,
+                                                  char *section, int code)
+{
+    struct cmd_bind_section *bs = get_bind_section(ictx, bstr0(section));
+    return find_bind_in_section(ictx, bs, code);
+}
+
 static struct cmd_bind *find_any_bind_for_key(struct input_ctx *ictx,
                                               char *force_section, int code)
 {
@@ -432,7 +478,7 @@ static struct cmd_bind *find_any_bind_for_key(struct input_ctx *ictx,
     struct cmd_bind *best_bind = NULL;
     for (int i = ictx->num_active_sections - 1; i >= 0; i--) {
         struct active_section *s = &ictx->active_sections[i];
-        struct cmd_bind *bind = find_bind_for_key_section(ictx, s->name, code);
+        struct cmd_bind *bind = find_bind_in_section(ictx, s->bs, code);
         if (bind) {
             struct cmd_bind_section *bs = bind->owner;
             if (!use_mouse || (bs->mouse_area_set && test_rect(&bs->mouse_area,
@@ -551,6 +597,25 @@ static struct mp_cmd *resolve_key(struct input_ctx *ictx, int code)
     return NULL;
 }
 
+// Merge cmd into the last queued command, if both were generated by the
+// same wheel binding (scaling is additive), and the player hasn't read the
+// previous one yet. This keeps fast scrolling from piling up commands.
+static bool merge_wheel_cmd(struct input_ctx *ictx, struct mp_cmd *cmd)
+{
+    struct mp_cmd *tail = queue_peek_tail(&ictx->cmd_queue);
+    if (!tail || !tail->wheel || tail->def != cmd->def ||
+        tail->flags != cmd->flags || bstrcmp(tail->original, cmd->original) ||
+        !tail->key_name || !cmd->key_name ||
+        strcmp(tail->key_name, cmd->key_name) ||
+        strcmp(tail->input_section, cmd->input_section))
+        return false;
+    tail->scale += cmd->scale;
+    tail->scale_units += cmd->scale_units;
+    MP_TRACE(ictx, "merged '%s' (scale %f)\n", cmd->key_name, tail->scale);
+    talloc_free(cmd);
+    return true;
+}
+
 static void interpret_key(struct input_ctx *ictx, int code, double scale,
                           int scale_units)
 {
@@ -617,6 +682,9 @@ static void interpret_key(struct input_ctx *ictx, int code, double scale,
     if (mp_input_is_scalable_cmd(cmd)) {
         cmd->scale = scale;
         cmd->scale_units = scale_units;
+        cmd->wheel = MP_KEY_IS_WHEEL(code & ~MP_KEY_MODIFIER_MASK);
+        if (cmd->wheel && merge_wheel_cmd(ictx, cmd))
+            return;
         mp_input_queue_cmd(ictx, cmd);
     } else {
         // Non-scalable commands won't understand cmd->scale, so synthesize
@@ -1024,7 +1092,11 @@ void mp_input_enable_section(struct input_ctx *ictx, char *name, int flags)
             for (int n = ictx->num_active_sections; n > top; n--)
                 ictx->active_sections[n] = ictx->active_sections[n - 1];
         }
-        ictx->active_sections[top] = (struct active_section){name, flags};
+        ictx->active_sections[top] = (struct active_section){
+            .name = name,
+            .flags = flags,
+            .bs = get_bind_section(ictx, bstr0(name)),
+        };
         ictx->num_active_sections++;
     }
 
@@ -1062,7 +1134,7 @@ static bool test_mouse(struct input_ctx *ictx, int x, int y, int rej_flags)
         struct active_section *as = &ictx->active_sections[i];
         if (as->flags & rej_flags)
             continue;
-        struct cmd_bind_section *s = get_bind_section(ictx, bstr0(as->name));
+        struct cmd_bind_section *s = as->bs;
         if (s->mouse_area_set && test_rect(&s->mouse_area, x, y)) {
             res = true;
             break;
@@ -1101,6 +1173,7 @@ static void remove_binds(struct cmd_bind_section *bs, bool builtin)
             assert(bs->num_binds >= 1);
             bs->binds[n] = bs->binds[bs->num_binds - 1];
             bs->num_binds--;
+            bs->index_valid = false;
         }
     }
 }
@@ -1177,6 +1250,7 @@ static void bind_keys(struct input_ctx *ictx, bool builtin, bstr section,
         struct cmd_bind empty = {{0}};
         MP_TARRAY_APPEND(bs, bs->binds, bs->num_binds, empty);
         bind = &bs->binds[bs->num_binds - 1];
+        bs->index_valid = false;
     }
 
     bind_dealloc(bind);
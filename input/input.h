@@ -219,13 +219,23 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
-// Serialize the given mpv_event structure to JSON. Returns an allocated string.
+// Protocol state of a single IPC connection (JSON or binary framing).
+struct mp_ipc_conn;
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent);
+
+// Serialize the given mpv_event structure to the connection's format. The
+// returned data is valid until the next call on conn; len is 0 on failure.
 struct mpv_event;
-char *mp_json_encode_event(struct mpv_event *event);
+bstr mp_ipc_encode_event(struct mp_ipc_conn *conn, struct mpv_event *event);
+
+// Return whether the raw IPC input buffer "buf" contains a complete command.
+bool mp_ipc_has_command(struct mp_ipc_conn *conn, bstr buf);
 
-// Given the raw IPC input buffer "buf", remove the first newline-separated
-// command, execute it and return the result (if any) as an allocated string.
+// Given the raw IPC input buffer "buf", remove the first command, execute it
+// and return the reply (len is 0 if there is none). The returned data is
+// valid until the next call on conn. mp_ipc_has_command() must be true.
 struct mpv_handle;
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
+bstr mp_ipc_consume_next_command(struct mpv_handle *client,
+                                 struct mp_ipc_conn *conn, bstr *buf);
 
 #endif /* MPLAYER_INPUT_H */
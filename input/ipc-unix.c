@@ -28,6 +28,7 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
@@ -44,16 +45,35 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Stop reading commands and events from a client if this much output is
+// still waiting to be sent to it.
+#define MAX_OUT_QUEUE (1 * 1024 * 1024)
+
+struct client_arg;
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
 
     pthread_t thread;
-    int death_pipe[2];
+    int wakeup_pipe[2];
+    int listen_fd;
+
+    pthread_mutex_t lock;
+    bool dying;             // mp_uninit_ipc() was called
+    bool detached;          // the thread frees the context on exit
+    // Modified by the IPC thread only (under lock after startup).
+    struct client_arg **clients;
+    int num_clients;
+
+    // Only accessed by the IPC thread.
+    int client_num;
+    struct pollfd *fds;
 };
 
 struct client_arg {
+    struct mp_ipc_ctx *ctx;
     struct mp_log *log;
     struct mpv_handle *client;
 
@@ -62,170 +82,194 @@ struct client_arg {
     bool close_client_fd;
 
     bool writable;
+    bool dead;
+
+    atomic_bool wakeup;     // set by the mpv_handle wakeup callback
+
+    bstr client_msg;        // received data not processed yet
+    struct mp_ipc_conn *conn;
+    bstr out;               // data not sent yet, starting at out_pos
+    size_t out_pos;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static void wakeup_ipc_thread(struct mp_ipc_ctx *ctx)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
+    (void)write(ctx->wakeup_pipe[1], &(char){0}, 1);
+}
+
+static void client_wakeup_cb(void *p)
+{
+    struct client_arg *arg = p;
+    atomic_store(&arg->wakeup, true);
+    wakeup_ipc_thread(arg->ctx);
+}
 
-            if (errno == EBADF || errno == ENOTSOCK) {
-                client->writable = false;
-                return 0;
+static bool client_backlogged(struct client_arg *arg)
+{
+    return arg->out.len - arg->out_pos > MAX_OUT_QUEUE;
+}
+
+// Send as much of the queued output as possible without blocking.
+static void client_flush(struct client_arg *arg)
+{
+    while (arg->out_pos < arg->out.len) {
+        ssize_t rc = send(arg->client_fd, arg->out.start + arg->out_pos,
+                          arg->out.len - arg->out_pos, MSG_NOSIGNAL);
+        if (rc <= 0) {
+            if (rc < 0 && (errno == EBADF || errno == ENOTSOCK)) {
+                arg->writable = false;
+                break;
             }
 
-            if (errno == EINTR || errno == EAGAIN)
+            if (rc < 0 && errno == EINTR)
                 continue;
 
-            return rc;
+            if (rc < 0 && errno == EAGAIN) {
+                // Drop the sent part once it dominates the buffer.
+                if (arg->out_pos > arg->out.len / 2) {
+                    arg->out.len -= arg->out_pos;
+                    memmove(arg->out.start, arg->out.start + arg->out_pos,
+                            arg->out.len);
+                    arg->out_pos = 0;
+                }
+                return;
+            }
+
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+            arg->dead = true;
+            break;
         }
 
-        count -= rc;
-        buf   += rc;
+        arg->out_pos += rc;
     }
+    arg->out.len = arg->out_pos = 0;
+}
 
-    return 0;
+static void client_write(struct client_arg *arg, bstr data)
+{
+    if (!arg->writable || arg->dead)
+        return;
+    bool was_empty = arg->out_pos == arg->out.len;
+    bstr_xappend(arg, &arg->out, data);
+    if (was_empty)
+        client_flush(arg);
 }
 
-static void *client_thread(void *p)
+static void client_handle_events(struct client_arg *arg)
 {
-    pthread_detach(pthread_self());
+    while (!arg->dead && !client_backlogged(arg)) {
+        mpv_event *event = mpv_wait_event(arg->client, 0);
+
+        if (event->event_id == MPV_EVENT_NONE) {
+            atomic_store(&arg->wakeup, false);
+            // Avoid a race with the wakeup callback.
+            event = mpv_wait_event(arg->client, 0);
+            if (event->event_id == MPV_EVENT_NONE)
+                break;
+            atomic_store(&arg->wakeup, true);
+        }
 
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            arg->dead = true;
+            break;
+        }
 
-    int rc;
+        if (!arg->writable)
+            continue;
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+        bstr event_msg = mp_ipc_encode_event(arg->conn, event);
+        if (!event_msg.len) {
+            MP_ERR(arg, "Encoding error\n");
+            arg->dead = true;
+            break;
+        }
 
-    mpthread_set_name(arg->client_name);
+        client_write(arg, event_msg);
+    }
+}
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+static void client_handle_commands(struct client_arg *arg)
+{
+    while (!arg->dead && !client_backlogged(arg) &&
+           mp_ipc_has_command(arg->conn, arg->client_msg))
+    {
+        bstr reply_msg = mp_ipc_consume_next_command(arg->client, arg->conn,
+                                                     &arg->client_msg);
+        if (reply_msg.len)
+            client_write(arg, reply_msg);
     }
+}
 
-    MP_VERBOSE(arg, "Client connected\n");
+static void client_read(struct client_arg *arg)
+{
+    while (!arg->dead) {
+        char buf[4096];
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+        ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+            if (errno == EAGAIN)
+                break;
 
-    while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+            MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+            arg->dead = true;
+            break;
         }
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
-
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
-
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
-
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
-
-                if (!arg->writable)
-                    continue;
-
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
-
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
+        if (bytes == 0) {
+            MP_VERBOSE(arg, "Client disconnected\n");
+            arg->dead = true;
+            break;
         }
 
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
-
-                append.len = bytes;
-
-                bstr_xappend(NULL, &client_msg, append);
-
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
-
-                    talloc_free(reply_msg);
-                }
-            }
-        }
+        bstr_xappend(arg, &arg->client_msg, (bstr){buf, bytes});
     }
 
-done:
-    if (client_msg.len > 0)
+    client_handle_commands(arg);
+}
+
+static void client_destroy(struct client_arg *arg)
+{
+    if (arg->client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
+    mpv_set_wakeup_callback(arg->client, NULL, NULL);
     mpv_destroy(arg->client);
     talloc_free(arg);
-    return NULL;
 }
 
+// Takes over the client struct in all cases.
 static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
 {
     client->client = mp_new_client(ctx->client_api, client->client_name);
     if (!client->client)
         goto err;
 
+    client->ctx = ctx;
     client->log = mp_client_get_log(client->client);
-
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client))
+    client->client_msg = (bstr){talloc_strdup(client, ""), 0};
+    client->out = (bstr){talloc_strdup(client, ""), 0};
+    client->conn = mp_ipc_conn_create(client);
+    atomic_store(&client->wakeup, true);
+
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // mp_uninit_ipc() decides whether to join the thread based on the list.
+    pthread_mutex_lock(&ctx->lock);
+    bool dying = ctx->dying;
+    if (!dying)
+        MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
+    pthread_mutex_unlock(&ctx->lock);
+    if (dying)
         goto err;
 
+    mpv_set_wakeup_callback(client->client, client_wakeup_cb, client);
+
+    MP_VERBOSE(client, "Client connected\n");
     return;
 
 err:
@@ -294,23 +338,20 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
     ipc_start_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+// Create the listening socket. Returns -1 on failure.
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
     MP_VERBOSE(arg, "Starting IPC master\n");
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -320,7 +361,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -337,48 +378,129 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
 
-    int client_num = 0;
+    return ipc_fd;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
+
+static void ipc_ctx_destroy(struct mp_ipc_ctx *arg)
+{
+    if (arg->listen_fd >= 0)
+        close(arg->listen_fd);
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
+    pthread_mutex_destroy(&arg->lock);
+    talloc_free(arg);
+}
+
+// Serves the listening socket and all clients. Clients are not disconnected
+// by mp_uninit_ipc(), so the thread keeps running until the last is gone.
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
+
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    if (arg->path && arg->path[0])
+        arg->listen_fd = ipc_listen(arg);
 
     while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+        pthread_mutex_lock(&arg->lock);
+        bool dying = arg->dying;
+        bool done = dying && !arg->num_clients;
+        pthread_mutex_unlock(&arg->lock);
+
+        if (dying && arg->listen_fd >= 0) {
+            close(arg->listen_fd);
+            arg->listen_fd = -1;
+        }
+
+        if (done)
+            break;
+
+        int num_fds = 2 + arg->num_clients;
+        MP_TARRAY_GROW(arg, arg->fds, num_fds);
+        arg->fds[0] = (struct pollfd){.events = POLLIN, .fd = arg->wakeup_pipe[0]};
+        arg->fds[1] = (struct pollfd){.events = POLLIN, .fd = arg->listen_fd};
+        for (int n = 0; n < arg->num_clients; n++) {
+            struct client_arg *client = arg->clients[n];
+            struct pollfd *fd = &arg->fds[2 + n];
+            *fd = (struct pollfd){.fd = client->client_fd};
+            if (!client_backlogged(client))
+                fd->events |= POLLIN;
+            if (client->out_pos < client->out.len)
+                fd->events |= POLLOUT;
+        }
+
+        if (poll(arg->fds, num_fds, -1) < 0) {
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
             continue;
         }
 
-        if (fds[0].revents & POLLIN)
-            goto done;
+        if (arg->fds[0].revents & POLLIN)
+            mp_flush_wakeup_pipe(arg->wakeup_pipe[0]);
 
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
+        if (arg->fds[1].revents & POLLIN) {
+            int client_fd = accept(arg->listen_fd, NULL, NULL);
             if (client_fd < 0) {
                 MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
+                close(arg->listen_fd);
+                arg->listen_fd = -1;
+            } else {
+                ipc_start_client_json(arg, arg->client_num++, client_fd);
             }
+        }
 
-            ipc_start_client_json(arg, client_num++, client_fd);
+        // New clients are always at the end, and have no poll entry yet.
+        for (int n = 0; n < num_fds - 2; n++) {
+            struct client_arg *client = arg->clients[n];
+            int revents = arg->fds[2 + n].revents;
+            if (revents & POLLOUT)
+                client_flush(client);
+            // Resume processing of buffered commands after a backlog.
+            client_handle_commands(client);
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                client_read(client);
+        }
+
+        for (int n = arg->num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            if (atomic_load(&client->wakeup))
+                client_handle_events(client);
+            if (client->dead) {
+                pthread_mutex_lock(&arg->lock);
+                MP_TARRAY_REMOVE_AT(arg->clients, arg->num_clients, n);
+                pthread_mutex_unlock(&arg->lock);
+                client_destroy(client);
+            }
         }
     }
 
-done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
+    pthread_mutex_lock(&arg->lock);
+    bool detached = arg->detached;
+    pthread_mutex_unlock(&arg->lock);
+    if (detached)
+        ipc_ctx_destroy(arg);
 
     return NULL;
 }
@@ -393,17 +515,19 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
-        .death_pipe = {-1, -1},
+        .wakeup_pipe = {-1, -1},
+        .listen_fd  = -1,
     };
+    pthread_mutex_init(&arg->lock, NULL);
     char *input_file = mp_get_user_path(arg, global, opts->input_file);
 
+    if (mp_make_wakeup_pipe(arg->wakeup_pipe) < 0)
+        goto out;
+
     if (input_file && *input_file)
         ipc_start_client_text(arg, input_file);
 
-    if (!opts->ipc_path || !*opts->ipc_path)
-        goto out;
-
-    if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
+    if ((!opts->ipc_path || !*opts->ipc_path) && !arg->num_clients)
         goto out;
 
     if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
@@ -412,10 +536,13 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
-    if (arg->death_pipe[0] >= 0) {
-        close(arg->death_pipe[0]);
-        close(arg->death_pipe[1]);
+    while (arg->num_clients)
+        client_destroy(arg->clients[--arg->num_clients]);
+    if (arg->wakeup_pipe[0] >= 0) {
+        close(arg->wakeup_pipe[0]);
+        close(arg->wakeup_pipe[1]);
     }
+    pthread_mutex_destroy(&arg->lock);
     talloc_free(arg);
     return NULL;
 }
@@ -425,10 +552,20 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
     if (!arg)
         return;
 
-    (void)write(arg->death_pipe[1], &(char){0}, 1);
-    pthread_join(arg->thread, NULL);
+    // Joining the thread while it serves clients could deadlock, because
+    // their requests may wait on the core thread (which is calling this).
+    pthread_mutex_lock(&arg->lock);
+    arg->dying = true;
+    arg->detached = arg->num_clients > 0;
+    bool detached = arg->detached;
+    pthread_mutex_unlock(&arg->lock);
 
-    close(arg->death_pipe[0]);
-    close(arg->death_pipe[1]);
-    talloc_free(arg);
+    wakeup_ipc_thread(arg);
+
+    if (detached) {
+        pthread_detach(arg->thread);
+    } else {
+        pthread_join(arg->thread, NULL);
+        ipc_ctx_destroy(arg);
+    }
 }
@@ -166,11 +166,12 @@ static bool pipe_error_is_fatal(DWORD error)
     return true;
 }
 
-static DWORD ipc_write_str(struct client_arg *arg, const char *buf)
+static DWORD ipc_write(struct client_arg *arg, bstr data)
 {
     DWORD error = 0;
 
-    if ((error = async_write(arg->client_h, buf, strlen(buf), &arg->write_ol)))
+    if ((error = async_write(arg->client_h, data.start, data.len,
+                             &arg->write_ol)))
         goto done;
     if (!GetOverlappedResult(arg->client_h, &arg->write_ol, &(DWORD){0}, TRUE)) {
         error = GetLastError();
@@ -208,6 +209,7 @@ static void *client_thread(void *p)
     HANDLE wakeup_event = CreateEventW(NULL, TRUE, FALSE, NULL);
     OVERLAPPED ol = { .hEvent = CreateEventW(NULL, TRUE, TRUE, NULL) };
     bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    struct mp_ipc_conn *conn = mp_ipc_conn_create(NULL);
     DWORD ioerr = 0;
     DWORD r;
 
@@ -251,14 +253,13 @@ static void *client_thread(void *p)
                 if (!arg->writable)
                     continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
+                bstr event_msg = mp_ipc_encode_event(conn, event);
+                if (!event_msg.len) {
                     MP_ERR(arg, "Encoding error\n");
                     goto done;
                 }
 
-                ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                ipc_write(arg, event_msg);
             }
 
             break;
@@ -270,12 +271,11 @@ static void *client_thread(void *p)
             }
 
             bstr_xappend(NULL, &client_msg, (bstr){buf, r});
-            while (bstrchr(client_msg, '\n') != -1) {
-                char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                    NULL, &client_msg);
-                if (reply_msg && arg->writable)
-                    ipc_write_str(arg, reply_msg);
-                talloc_free(reply_msg);
+            while (mp_ipc_has_command(conn, client_msg)) {
+                bstr reply_msg = mp_ipc_consume_next_command(arg->client,
+                    conn, &client_msg);
+                if (reply_msg.len && arg->writable)
+                    ipc_write(arg, reply_msg);
             }
 
             // Begin the next read operation on the pipe
@@ -305,6 +305,8 @@ done:
 
     CloseHandle(arg->client_h);
     mpv_destroy(arg->client);
+    talloc_free(client_msg.start);
+    talloc_free(conn);
     talloc_free(arg);
     return NULL;
 }
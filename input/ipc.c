@@ -20,11 +20,56 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "player/client.h"
 
+// Binary frames: 4 byte big endian payload length, followed by the payload.
+#define FRAME_HEADER_SIZE 4
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+struct mp_ipc_conn {
+    bool msgpack;   // use binary framing
+    bstr out;       // output buffer, reused by every message
+    void *tmp;      // arena for temporary nodes, cleared after every message
+};
+
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent)
+{
+    struct mp_ipc_conn *conn = talloc_zero(ta_parent, struct mp_ipc_conn);
+    conn->out.start = talloc_strdup(conn, "");
+    conn->tmp = talloc_new_arena(conn);
+    return conn;
+}
+
+// Serialize src into conn->out, replacing the previous contents.
+static bstr encode_node(struct mp_ipc_conn *conn, bool msgpack, mpv_node *src)
+{
+    bstr *out = &conn->out;
+    out->len = 0;
+    out->start[0] = '\0';
+    if (msgpack) {
+        bstr_xappend(NULL, out, (bstr){(unsigned char[FRAME_HEADER_SIZE]){0},
+                                       FRAME_HEADER_SIZE});
+        if (msgpack_write(out, src) < 0)
+            return (bstr){0};
+        size_t size = out->len - FRAME_HEADER_SIZE;
+        for (int n = 0; n < FRAME_HEADER_SIZE; n++)
+            out->start[n] = size >> ((FRAME_HEADER_SIZE - 1 - n) * 8);
+    } else {
+        char *s = out->start;
+        if (json_write(&s, src) < 0) {
+            out->start = s;
+            return (bstr){0};
+        }
+        *out = bstr0(s);
+        bstr_xappend(NULL, out, bstr0("\n"));
+    }
+    return *out;
+}
+
 static mpv_node *mpv_node_map_get(mpv_node *src, const char *key)
 {
     if (src->format != MPV_FORMAT_NODE_MAP)
@@ -177,49 +222,39 @@ static void mpv_event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
     }
 }
 
-char *mp_json_encode_event(mpv_event *event)
+bstr mp_ipc_encode_event(struct mp_ipc_conn *conn, mpv_event *event)
 {
-    void *ta_parent = talloc_new(NULL);
+    void *ta_parent = conn->tmp;
     mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
     mpv_event_to_node(ta_parent, event, &event_node);
 
-    char *output = talloc_strdup(NULL, "");
-    json_write(&output, &event_node);
-    output = ta_talloc_strdup_append(output, "\n");
+    bstr output = encode_node(conn, conn->msgpack, &event_node);
 
-    talloc_free(ta_parent);
+    talloc_free_children(ta_parent);
 
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// msg_node is NULL if the message could not be parsed.
+static void execute_command(struct mpv_handle *client,
+                            struct mp_ipc_conn *conn, void *ta_parent,
+                            mpv_node *msg_node, mpv_node *reply_node_out)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
     mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -321,6 +356,30 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
                                   MPV_FORMAT_NODE);
+    } else if (!strcmp("observe_property_delta", cmd)) {
+        if (cmd_node->u.list->num != 3) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[2].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property(client,
+                                  cmd_node->u.list->values[1].u.int64,
+                                  cmd_node->u.list->values[2].u.string,
+                                  MPV_FORMAT_NODE);
+        if (rc >= 0) {
+            rc = mpv_set_observe_delta(client,
+                                       cmd_node->u.list->values[1].u.int64, 1);
+        }
     } else if (!strcmp("observe_property_string", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -400,6 +459,62 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             }
             rc = mpv_request_event(client, event, enable);
         }
+    } else if (!strcmp("set_ipc_format", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        // Takes effect after the reply to this command.
+        const char *format = cmd_node->u.list->values[1].u.string;
+        if (!strcmp(format, "json")) {
+            conn->msgpack = false;
+            rc = MPV_ERROR_SUCCESS;
+        } else if (!strcmp(format, "msgpack")) {
+            conn->msgpack = true;
+            rc = MPV_ERROR_SUCCESS;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        }
+    } else if (!strcmp("batch", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_NODE_ARRAY) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        mpv_node result_node;
+        rc = mpv_command_batch(client, &cmd_node->u.list->values[1],
+                               &result_node);
+        if (rc >= 0) {
+            // Use error strings, as in the normal replies.
+            mpv_node_list *list = result_node.u.list;
+            mpv_node data = {.format = MPV_FORMAT_NODE_ARRAY,
+                             .u.list = talloc_zero(ta_parent, mpv_node_list)};
+            for (int n = 0; n < list->num; n++) {
+                mpv_node *res = &list->values[n];
+                mpv_node entry = {.format = MPV_FORMAT_NODE_MAP,
+                                  .u.list = talloc_zero(ta_parent, mpv_node_list)};
+                mpv_node *err = mpv_node_map_get(res, "error");
+                mpv_node *val = mpv_node_map_get(res, "data");
+                if (val)
+                    mpv_node_map_add(ta_parent, &entry, "data", val);
+                mpv_node_map_add_string(ta_parent, &entry, "error",
+                                        mpv_error_string(err->u.int64));
+                mpv_node_array_add(ta_parent, &data, &entry);
+            }
+            mpv_node_map_add(ta_parent, &reply_node, "data", &data);
+            mpv_free_node_contents(&result_node);
+        }
     } else {
         mpv_node result_node;
 
@@ -419,42 +534,124 @@ error:
 
     mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
 
-    char *output = talloc_strdup(ta_parent, "");
-    json_write(&output, &reply_node);
-    output = ta_talloc_strdup_append(output, "\n");
+    *reply_node_out = reply_node;
+}
 
-    return output;
+// Function is allowed to modify src[n].
+static bstr json_execute_command(struct mpv_handle *client,
+                                 struct mp_ipc_conn *conn, void *ta_parent,
+                                 char *src)
+{
+    struct mp_log *log = mp_client_get_log(client);
+    bool msgpack = conn->msgpack;
+
+    mpv_node msg_node;
+    mpv_node reply_node;
+
+    int rc = json_parse(ta_parent, &msg_node, &src, 50);
+    if (rc < 0)
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+
+    execute_command(client, conn, ta_parent, rc < 0 ? NULL : &msg_node,
+                    &reply_node);
+
+    return encode_node(conn, msgpack, &reply_node);
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static bstr text_execute_command(struct mpv_handle *client, void *tmp, char *src)
 {
     mpv_command_string(client, src);
 
-    return NULL;
+    return (bstr){0};
+}
+
+// A message in binary framing is either a map (same as a JSON message), or a
+// string (a text command).
+static bstr msgpack_execute_command(struct mpv_handle *client,
+                                    struct mp_ipc_conn *conn, void *ta_parent,
+                                    bstr src)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node;
+
+    int rc = msgpack_parse(ta_parent, &msg_node, &src, 50);
+    if (rc >= 0 && src.len)
+        rc = -1; // trailing garbage
+    if (rc < 0)
+        mp_err(log, "malformed MessagePack message received\n");
+
+    if (rc >= 0 && msg_node.format == MPV_FORMAT_STRING)
+        return text_execute_command(client, ta_parent, msg_node.u.string);
+
+    execute_command(client, conn, ta_parent, rc < 0 ? NULL : &msg_node,
+                    &reply_node);
+
+    return encode_node(conn, true, &reply_node);
+}
+
+bool mp_ipc_has_command(struct mp_ipc_conn *conn, bstr buf)
+{
+    if (!conn->msgpack)
+        return bstrchr(buf, '\n') != -1;
+    if (buf.len < FRAME_HEADER_SIZE)
+        return false;
+    size_t size = 0;
+    for (int n = 0; n < FRAME_HEADER_SIZE; n++)
+        size = (size << 8) | (unsigned char)buf.start[n];
+    // Oversized frames are consumed (and rejected) as soon as the header is
+    // complete, instead of buffering them.
+    return size > MAX_FRAME_SIZE || buf.len - FRAME_HEADER_SIZE >= size;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+bstr mp_ipc_consume_next_command(struct mpv_handle *client,
+                                 struct mp_ipc_conn *conn, bstr *buf)
 {
-    void *tmp = talloc_new(NULL);
+    void *tmp = conn->tmp;
+
+    bstr reply_msg = {0};
+
+    if (conn->msgpack) {
+        size_t size = 0;
+        for (int n = 0; n < FRAME_HEADER_SIZE; n++)
+            size = (size << 8) | (unsigned char)buf->start[n];
+        if (size > MAX_FRAME_SIZE) {
+            // There is no way to resynchronize, so drop everything.
+            mp_err(mp_client_get_log(client), "IPC frame too large\n");
+            buf->len = 0;
+            talloc_free_children(tmp);
+            return reply_msg;
+        }
+        bstr frame = bstr_splice(*buf, FRAME_HEADER_SIZE,
+                                 FRAME_HEADER_SIZE + size);
+        reply_msg = msgpack_execute_command(client, conn, tmp, frame);
+        // The message was parsed into copies, so the input can be shifted
+        // in place (avoiding a new allocation per message).
+        size_t done = FRAME_HEADER_SIZE + size;
+        memmove(buf->start, buf->start + done, buf->len - done);
+        buf->len -= done;
+        talloc_free_children(tmp);
+        return reply_msg;
+    }
 
     bstr rest;
     bstr line = bstr_getline(*buf, &rest);
     char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
+    char *old_buf = buf->start;
     *buf = bstrdup(NULL, rest);
+    talloc_free(old_buf);
 
     json_skip_whitespace(&line0);
 
-    char *reply_msg = NULL;
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
     } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+        reply_msg = json_execute_command(client, conn, tmp, line0);
     } else {
         reply_msg = text_execute_command(client, tmp, line0);
     }
 
-    talloc_steal(ctx, reply_msg);
-    talloc_free(tmp);
+    talloc_free_children(tmp);
     return reply_msg;
 }
@@ -210,7 +210,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 102)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 110)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -971,6 +971,35 @@ int mpv_command_string(mpv_handle *ctx, const char *args);
 int mpv_command_async(mpv_handle *ctx, uint64_t reply_userdata,
                       const char **args);
 
+/**
+ * Run several commands and property accesses at once. This is the same as
+ * calling mpv_command_node(), mpv_get_property() or mpv_set_property() for
+ * each of them, but needs only a single round trip to the playback thread,
+ * which is much faster if there are many of them.
+ *
+ * ops is a MPV_FORMAT_NODE_ARRAY. Each element is one of:
+ *  - a MPV_FORMAT_NODE_ARRAY of the form ["get_property", name]: read the
+ *    property with MPV_FORMAT_NODE
+ *  - a MPV_FORMAT_NODE_ARRAY of the form ["set_property", name, value]: set
+ *    the property with MPV_FORMAT_NODE
+ *  - anything else is run as command, in the same format as for
+ *    mpv_command_node()
+ *
+ * The operations are run in order. A failing operation does not stop the
+ * ones after it.
+ *
+ * @param[in] ops list of operations
+ * @param[out] result On success, set to a MPV_FORMAT_NODE_ARRAY with one
+ *                    MPV_FORMAT_NODE_MAP per operation. Each map has an
+ *                    "error" entry (MPV_FORMAT_INT64, an error code), and a
+ *                    "data" entry with the property value or command result,
+ *                    if there is any. You must call mpv_free_node_contents()
+ *                    to free it.
+ * @return error code (only if ops is invalid or the core is uninitialized;
+ *         errors of the operations are returned in result)
+ */
+int mpv_command_batch(mpv_handle *ctx, mpv_node *ops, mpv_node *result);
+
 /**
  * Same as mpv_command_node(), but run it asynchronously. Basically, this
  * function is to mpv_command_node() what mpv_command_async() is to
@@ -1108,6 +1137,40 @@ char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                            const char *name, mpv_format format);
 
+/**
+ * Look up a property by name, and return an ID for it. The ID can be passed
+ * to mpv_get_resolved_property() and mpv_set_resolved_property(), which work
+ * like mpv_get_property() and mpv_set_property() with the same name, but skip
+ * looking up the property on each call. This is meant for clients which read
+ * the same properties very often.
+ *
+ * The name can include sub-property paths (like "video-params/w"). The ID
+ * stays valid until the mpv_handle is destroyed. Resolving the same name
+ * twice may or may not return the same ID.
+ *
+ * @param name The property name.
+ * @param[out] id Set to the ID (always >= 1) on success.
+ * @return error code (MPV_ERROR_PROPERTY_NOT_FOUND if there is no such
+ *         property)
+ */
+int mpv_resolve_property(mpv_handle *ctx, const char *name, int64_t *id);
+
+/**
+ * Like mpv_get_property(), but with an ID from mpv_resolve_property().
+ *
+ * @return error code (MPV_ERROR_INVALID_PARAMETER if the ID is invalid)
+ */
+int mpv_get_resolved_property(mpv_handle *ctx, int64_t id, mpv_format format,
+                              void *data);
+
+/**
+ * Like mpv_set_property(), but with an ID from mpv_resolve_property().
+ *
+ * @return error code (MPV_ERROR_INVALID_PARAMETER if the ID is invalid)
+ */
+int mpv_set_resolved_property(mpv_handle *ctx, int64_t id, mpv_format format,
+                              void *data);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -1175,6 +1238,53 @@ int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
  */
 int mpv_unobserve_property(mpv_handle *mpv, uint64_t registered_reply_userdata);
 
+/**
+ * Limit how often the properties observed with the given reply_userdata are
+ * updated. After a property value was retrieved for a change event, it is not
+ * retrieved again until interval seconds have passed. Changes in between are
+ * not lost: once the interval has passed, an event with the current value is
+ * sent (if it differs from the last one). This is useful for properties like
+ * "time-pos", which change with every video frame.
+ *
+ * The default is 0, which means no limit. Properties observed later with the
+ * same reply_userdata are not affected.
+ *
+ * @param reply_userdata ID that was passed to mpv_observe_property
+ * @param interval minimum time between updates, in seconds
+ * @return negative value is an error code, >=0 is number of properties
+ *         affected
+ */
+int mpv_set_observe_interval(mpv_handle *ctx, uint64_t reply_userdata,
+                             double interval);
+
+/**
+ * Make the property change events of properties observed with the given
+ * reply_userdata and MPV_FORMAT_NODE contain only the changes relative to the
+ * previous event. This is useful for large properties like "playlist", where
+ * usually only a few entries change.
+ *
+ * With this enabled, mpv_event_property.data is a MPV_FORMAT_NODE_MAP in one
+ * of these forms:
+ *  - "value": the full new value. This is used for the first event, if the
+ *    value is not an array or map, if its type changed, or if most of it
+ *    changed.
+ *  - for arrays, "size" (the new number of elements) and "changed", an array
+ *    of [index, value] arrays for each new or changed element. Elements with
+ *    index >= size were removed.
+ *  - for maps, "changed", a map with the new or changed entries, and
+ *    "removed", an array with the keys of removed entries.
+ * Only the top level is diffed; changed elements are always sent completely.
+ *
+ * If the property becomes unavailable, the event has MPV_FORMAT_NONE as
+ * usual, and the next event contains the full value.
+ *
+ * @param reply_userdata ID that was passed to mpv_observe_property
+ * @param flag 1 to enable, 0 to disable
+ * @return negative value is an error code, >=0 is number of properties
+ *         affected (properties observed with another format are ignored)
+ */
+int mpv_set_observe_delta(mpv_handle *ctx, uint64_t reply_userdata, int flag);
+
 typedef enum mpv_event_id {
     /**
      * Nothing happened. Happens on timeouts or sporadic wakeups.
@@ -50,6 +50,25 @@ extern "C" {
  * ------------------
  *
  * OpenGL: via MPV_RENDER_API_TYPE_OPENGL, see render_gl.h header.
+ * Software: via MPV_RENDER_API_TYPE_SW, see section "Software renderer"
+ *
+ * Software renderer
+ * -----------------
+ *
+ * MPV_RENDER_API_TYPE_SW renders video and OSD on the CPU, into memory
+ * provided with each mpv_render_context_render() call (the
+ * MPV_RENDER_PARAM_SW_* parameters, which are all mandatory). This is useful
+ * for applications which have no GPU API, or which process the video frames
+ * further on the CPU. No GPU API context needs to be current when calling the
+ * mpv_render_* functions.
+ *
+ * The video is converted by libswscale straight into the target memory, and
+ * the OSD and subtitles are blended onto it. Hardware decoding modes which
+ * do not download the frames to system memory (i.e. all but the "-copy"
+ * variants) do not work with it.
+ *
+ * Since each render call converts a complete frame, this is slow compared to
+ * the GPU renderers, especially with high resolutions.
  *
  * Threading
  * ---------
@@ -141,6 +160,10 @@ typedef enum mpv_render_param_type {
      *      It is expected that an OpenGL context is valid and "current" when
      *      calling mpv_render_* functions (unless specified otherwise). It
      *      must be the same context for the same mpv_render_context.
+     *   MPV_RENDER_API_TYPE_SW:
+     *      Software renderer, which converts and scales the video with
+     *      libswscale directly into a memory buffer provided by the API user.
+     *      See section "Software renderer".
      */
     MPV_RENDER_PARAM_API_TYPE = 1,
     /**
@@ -288,6 +311,100 @@ typedef enum mpv_render_param_type {
      * Type : struct mpv_opengl_drm_draw_surface_size*
      */
     MPV_RENDER_PARAM_DRM_DRAW_SURFACE_SIZE = 15,
+    /**
+     * Maximum number of rendered frames for which the VO does not wait for
+     * mpv_render_context_report_swap(). Valid for mpv_render_context_create()
+     * and mpv_render_context_set_parameter().
+     *
+     * Type: int*: 1 (default) to 8
+     *
+     * By default, the VO waits until the frame it just had rendered was
+     * reported as swapped before it continues with the next frame. With higher
+     * values, the next frames can be rendered while the API user still has
+     * previous frames queued for presentation (e.g. in a compositor with its
+     * own swapchain). This adds latency, but decouples mpv's video timing from
+     * the API user's render loop.
+     *
+     * This has no effect if mpv_render_context_report_swap() is never called.
+     */
+    MPV_RENDER_PARAM_MAX_PENDING_SWAPS = 16,
+    /**
+     * Return a fence for the rendering done by mpv_render_context_render().
+     * Valid for mpv_render_context_render() with MPV_RENDER_API_TYPE_OPENGL.
+     *
+     * Type: void**: the pointed to void* is set to a GLsync (as created by
+     *               glFenceSync()), or NULL if the OpenGL context has no sync
+     *               object support.
+     *
+     * The fence is signaled once the GPU finished rendering the frame, so the
+     * API user can test it with glClientWaitSync() or wait on it on the GPU
+     * with glWaitSync(), instead of synchronizing with glFinish(). The API
+     * user owns the fence and must destroy it with glDeleteSync().
+     */
+    MPV_RENDER_PARAM_OPENGL_FENCE = 17,
+    /**
+     * Return timing information about the next frame and the frames queued
+     * after it. Valid for mpv_render_context_get_info().
+     *
+     * Type: mpv_render_frame_schedule*
+     *
+     * This is an extension of MPV_RENDER_PARAM_NEXT_FRAME_INFO, which lets the
+     * API user schedule rendering ahead instead of reacting to every update
+     * callback. The timings of the following frames are estimates, and can
+     * change (e.g. with seeking, frame drops, or speed changes).
+     */
+    MPV_RENDER_PARAM_FRAME_SCHEDULE = 18,
+    /**
+     * MPV_RENDER_API_TYPE_SW only: rendering target surface size, mandatory.
+     * Valid for MPV_RENDER_API_TYPE_SW & mpv_render_context_render().
+     *
+     * Type: int[2] (e.g.: int s[2] = {w, h}; param.data = &s[0];)
+     *
+     * The video frame is transformed as with other VOs. Typically, this means
+     * the video gets scaled and black bars are added if the video size or
+     * aspect ratio mismatches with the target size.
+     */
+    MPV_RENDER_PARAM_SW_SIZE = 19,
+    /**
+     * MPV_RENDER_API_TYPE_SW only: rendering target surface pixel format,
+     * mandatory.
+     * Valid for MPV_RENDER_API_TYPE_SW & mpv_render_context_render().
+     *
+     * Type: char* (e.g.: char *f = "rgb0"; param.data = f;)
+     *
+     * Valid values are mpv image format names (as in mpv --vf=format=help)
+     * of packed RGB formats with a whole number of bytes per pixel, for
+     * example "rgb0", "bgr0", "0rgb", "0bgr", "rgb24", "bgr24", "rgba",
+     * "bgra", and "rgb565". Other formats return MPV_ERROR_UNSUPPORTED.
+     */
+    MPV_RENDER_PARAM_SW_FORMAT = 20,
+    /**
+     * MPV_RENDER_API_TYPE_SW only: rendering target surface bytes per line,
+     * mandatory.
+     * Valid for MPV_RENDER_API_TYPE_SW & mpv_render_context_render().
+     *
+     * Type: size_t*
+     *
+     * This is the number of bytes between a pixel (x, y) and (x, y + 1) on the
+     * target surface. It must be a multiple of the pixel size, and have space
+     * for the surface width as specified by MPV_RENDER_PARAM_SW_SIZE.
+     */
+    MPV_RENDER_PARAM_SW_STRIDE = 21,
+    /**
+     * MPV_RENDER_API_TYPE_SW only: rendering target surface pixel data
+     * pointer, mandatory.
+     * Valid for MPV_RENDER_API_TYPE_SW & mpv_render_context_render().
+     *
+     * Type: void*
+     *
+     * This points to the first pixel at the left/top corner (0, 0). In
+     * particular, each line y starts at (pointer + stride * y). The memory
+     * must remain valid and writable for the duration of the
+     * mpv_render_context_render() call, and is not accessed after it returns.
+     * It can be any memory, e.g. a shared memory segment or a mapped
+     * framebuffer, since mpv writes the converted video to it directly.
+     */
+    MPV_RENDER_PARAM_SW_POINTER = 22,
 } mpv_render_param_type;
 
 /**
@@ -331,6 +448,7 @@ typedef struct mpv_render_param {
  * Predefined values for MPV_RENDER_PARAM_API_TYPE.
  */
 #define MPV_RENDER_API_TYPE_OPENGL "opengl"
+#define MPV_RENDER_API_TYPE_SW "sw"
 
 /**
  * Flags used in mpv_render_frame_info.flags. Each value represents a bit in it.
@@ -404,6 +522,61 @@ typedef struct mpv_render_frame_info {
     int64_t target_time;
 } mpv_render_frame_info;
 
+/**
+ * Maximum number of entries in mpv_render_frame_schedule.frames.
+ */
+#define MPV_RENDER_FRAME_SCHEDULE_MAX 16
+
+/**
+ * Timing of a single frame in mpv_render_frame_schedule.
+ */
+typedef struct mpv_render_frame_timing {
+    /**
+     * Absolute time at which the frame is supposed to be displayed, in the
+     * same unit and base as mpv_get_time_us(). 0 if unknown, which is always
+     * the case with vsync locked video timing (see "video-sync" option). For
+     * the first entry, this is the same as mpv_render_frame_info.target_time.
+     */
+    int64_t target_time;
+    /**
+     * Estimated display duration in microseconds, or -1 if unknown.
+     */
+    int64_t duration;
+    /**
+     * With vsync locked video timing, the number of vsyncs the frame is
+     * supposed to be displayed. 0 otherwise, or if unknown.
+     */
+    int num_vsyncs;
+    /**
+     * Timestamp of the frame in the video, in seconds (like the
+     * "video-pts" property). 0 if unknown.
+     */
+    double pts;
+} mpv_render_frame_timing;
+
+/**
+ * Retrieved with MPV_RENDER_PARAM_FRAME_SCHEDULE.
+ */
+typedef struct mpv_render_frame_schedule {
+    /**
+     * Number of valid entries in frames. 0 if there is no next frame (see
+     * MPV_RENDER_FRAME_INFO_PRESENT).
+     */
+    int num_frames;
+    /**
+     * Estimated vsync interval in microseconds, or 0 if unknown.
+     */
+    int64_t vsync_interval;
+    /**
+     * frames[0] is the next frame to render, frames[1] the one after it, and
+     * so on. Repeated frames are not listed again, and redraw requests have
+     * only the first entry set. How many frames are known in advance depends
+     * on the number of frames the player queues ahead (e.g. more with the
+     * "interpolation" option).
+     */
+    mpv_render_frame_timing frames[MPV_RENDER_FRAME_SCHEDULE_MAX];
+} mpv_render_frame_schedule;
+
 /**
  * Initialize the renderer state. Depending on the backend used, this will
  * access the underlying GPU API and initialize its own objects.
@@ -139,6 +139,56 @@ typedef int64_t (*mpv_stream_cb_seek_fn)(void *cookie, int64_t offset);
  */
 typedef int64_t (*mpv_stream_cb_size_fn)(void *cookie);
 
+/**
+ * A read request passed to mpv_stream_cb_read_async_fn. The fields are set by
+ * mpv, and must not be changed by the user.
+ */
+typedef struct mpv_stream_cb_read_req {
+    /**
+     * Absolute stream position of the first byte to read.
+     */
+    int64_t offset;
+    /**
+     * Buffer to read the data into. It remains valid until the request has
+     * been completed with mpv_stream_cb_read_complete().
+     */
+    char *buf;
+    /**
+     * Size of buf.
+     */
+    uint64_t nbytes;
+    /**
+     * Internal to mpv.
+     */
+    void *internal;
+} mpv_stream_cb_read_req;
+
+/**
+ * Asynchronous read callback, which can be used instead of read_fn.
+ *
+ * The callback must not block. It should start reading the requested data
+ * (see mpv_stream_cb_read_req), and complete the request later by calling
+ * mpv_stream_cb_read_complete(), which can be done from any thread (and also
+ * from within this callback). mpv issues multiple requests for consecutive
+ * parts of the stream ahead of the current read position (up to the
+ * read_async_depth field in mpv_stream_cb_info), and they can be completed in
+ * any order. This allows pipelining the reads.
+ *
+ * Unlike with read_fn, short reads are not allowed: the whole buffer must be
+ * filled, unless the end of the stream is reached.
+ *
+ * Every request must be completed, even after mpv did a seek or stopped
+ * needing the data. The close callback is called only after all requests have
+ * been completed. The seek callback is still called on seeks (and to test
+ * seekability), but mpv doesn't depend on the stream position set by it.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param req the request
+ */
+typedef void (*mpv_stream_cb_read_async_fn)(void *cookie,
+                                            mpv_stream_cb_read_req *req);
+
 /**
  * Close callback used to implement a custom stream.
  *
@@ -164,12 +214,26 @@ typedef struct mpv_stream_cb_info {
      * Callbacks set by the user in the mpv_stream_cb_open_ro_fn callback. Some
      * of them are optional, and can be left unset.
      *
-     * The following callbacks are mandatory: read_fn, close_fn
+     * The following callbacks are mandatory: read_fn (or read_async_fn),
+     * close_fn
      */
     mpv_stream_cb_read_fn read_fn;
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+
+    /**
+     * If set, this is used instead of read_fn. (Since client API version
+     * 1.103.)
+     */
+    mpv_stream_cb_read_async_fn read_async_fn;
+
+    /**
+     * Maximum number of requests passed to read_async_fn which are not
+     * completed yet. Set to 0 to use the default (currently 4). Each request is
+     * for 256 KiB. Ignored if read_async_fn is not set.
+     */
+    int read_async_depth;
 } mpv_stream_cb_info;
 
 /**
@@ -216,6 +280,19 @@ typedef int (*mpv_stream_cb_open_ro_fn)(void *user_data, char *uri,
 int mpv_stream_cb_add_ro(mpv_handle *ctx, const char *protocol, void *user_data,
                          mpv_stream_cb_open_ro_fn open_fn);
 
+/**
+ * Complete a request passed to mpv_stream_cb_read_async_fn. After this call,
+ * the request and its buffer must not be accessed anymore. Unlike the other
+ * libmpv functions, this can be called from within the stream callbacks.
+ *
+ * @param req the request
+ * @param nbytes number of bytes read into the buffer. If this is less than the
+ *               requested size, the end of the stream is at the position after
+ *               the data (0 means the requested offset is at or after the end).
+ *               -1 signals an error, in which case mpv might retry the read.
+ */
+void mpv_stream_cb_read_complete(mpv_stream_cb_read_req *req, int64_t nbytes);
+
 #ifdef __cplusplus
 }
 #endif
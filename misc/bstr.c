@@ -22,6 +22,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <libavutil/common.h>
 
 #include "mpv_talloc.h"
@@ -308,6 +312,30 @@ int bstr_decode_utf8(struct bstr s, struct bstr *out_next)
     return codepoint;
 }
 
+// Return the number of leading ASCII bytes in s. Most text is ASCII (or
+// contains long runs of it), so checking many bytes at once is worth it.
+static size_t ascii_prefix_len(struct bstr s)
+{
+    size_t n = 0;
+#ifdef __SSE2__
+    // SSE2 is always available if the compiler assumes it (e.g. x86_64).
+    for (; n + 16 <= s.len; n += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s.start + n));
+        if (_mm_movemask_epi8(v))
+            break;
+    }
+#endif
+    for (; n + 8 <= s.len; n += 8) {
+        uint64_t w;
+        memcpy(&w, s.start + n, 8);
+        if (w & 0x8080808080808080ULL)
+            break;
+    }
+    while (n < s.len && s.start[n] < 0x80)
+        n++;
+    return n;
+}
+
 struct bstr bstr_split_utf8(struct bstr str, struct bstr *out_next)
 {
     bstr rest;
@@ -322,6 +350,11 @@ struct bstr bstr_split_utf8(struct bstr str, struct bstr *out_next)
 int bstr_validate_utf8(struct bstr s)
 {
     while (s.len) {
+        size_t ascii = ascii_prefix_len(s);
+        s.start += ascii;
+        s.len -= ascii;
+        if (!s.len)
+            break;
         if (bstr_decode_utf8(s, &s) < 0) {
             // Try to guess whether the sequence was just cut-off.
             unsigned int codepoint = (unsigned char)s.start[0];
@@ -350,6 +383,11 @@ struct bstr bstr_sanitize_utf8_latin1(void *talloc_ctx, struct bstr s)
     bstr left = s;
     unsigned char *first_ok = s.start;
     while (left.len) {
+        size_t ascii = ascii_prefix_len(left);
+        left.start += ascii;
+        left.len -= ascii;
+        if (!left.len)
+            break;
         int r = bstr_decode_utf8(left, &left);
         if (r < 0) {
             bstr_xappend(talloc_ctx, &new, (bstr){first_ok, left.start - first_ok});
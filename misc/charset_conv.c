@@ -64,14 +64,38 @@ static const char *ms_bom_guess(bstr buf)
 }
 
 #if HAVE_UCHARDET
+// For large inputs, only feed this many bytes from a few places to uchardet.
+// Detection doesn't get better with more data, but takes longer.
+#define UCHARDET_SAMPLE_SIZE (64 * 1024)
+#define UCHARDET_NUM_SAMPLES 4
+
 static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf)
 {
     uchardet_t det = uchardet_new();
     if (!det)
         return NULL;
-    if (uchardet_handle_data(det, buf.start, buf.len) != 0) {
-        uchardet_delete(det);
-        return NULL;
+    int num_samples = 1;
+    size_t sample_size = buf.len;
+    if (buf.len > UCHARDET_SAMPLE_SIZE * UCHARDET_NUM_SAMPLES) {
+        num_samples = UCHARDET_NUM_SAMPLES;
+        sample_size = UCHARDET_SAMPLE_SIZE;
+    }
+    for (int n = 0; n < num_samples; n++) {
+        size_t pos = num_samples > 1
+            ? (buf.len - sample_size) / (num_samples - 1) * n : 0;
+        bstr sample = {buf.start + pos, sample_size};
+        if (num_samples > 1) {
+            // Cut at line breaks, so that multibyte sequences stay intact.
+            int start = n > 0 ? bstrchr(sample, '\n') + 1 : 0;
+            int end = n < num_samples - 1 ? bstrrchr(sample, '\n') + 1
+                                           : sample.len;
+            if (end > start)
+                sample = bstr_splice(sample, start, end);
+        }
+        if (uchardet_handle_data(det, sample.start, sample.len) != 0) {
+            uchardet_delete(det);
+            return NULL;
+        }
     }
     uchardet_data_end(det);
     char *res = talloc_strdup(talloc_ctx, uchardet_get_charset(det));
@@ -32,6 +32,11 @@ struct mp_dispatch_queue {
     void *wakeup_ctx;
     // Time at which mp_dispatch_queue_process() should return.
     int64_t wait;
+    // Timeouts may be delayed by this much (in microseconds), see
+    // mp_dispatch_set_timer_slack().
+    int64_t timer_slack;
+    // The kernel timer slack last set for in_process_thread (-1: never).
+    int64_t applied_timer_slack;
     // Make mp_dispatch_queue_process() exit if it's idle.
     bool interrupted;
     // The target thread is in mp_dispatch_queue_process() (and either idling,
@@ -81,7 +86,9 @@ static void queue_dtor(void *p)
 struct mp_dispatch_queue *mp_dispatch_create(void *ta_parent)
 {
     struct mp_dispatch_queue *queue = talloc_ptrtype(ta_parent, queue);
-    *queue = (struct mp_dispatch_queue){0};
+    *queue = (struct mp_dispatch_queue){
+        .applied_timer_slack = -1,
+    };
     talloc_set_destructor(queue, queue_dtor);
     pthread_mutex_init(&queue->lock, NULL);
     pthread_cond_init(&queue->cond, NULL);
@@ -234,6 +241,30 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
     pthread_mutex_unlock(&queue->lock);
 }
 
+// Allow timeouts of mp_dispatch_queue_process() to fire up to slack_us
+// microseconds late. Deadlines are rounded up to a multiple of slack_us, so
+// that the wakeups of all queues using the same slack coincide, instead of
+// each queue waking up separately. On Linux, this also sets the kernel timer
+// slack of the thread which calls mp_dispatch_queue_process(), so that the
+// kernel can coalesce them with unrelated timers. slack_us==0 (the default)
+// disables coalescing, and restores the default kernel timer slack.
+void mp_dispatch_set_timer_slack(struct mp_dispatch_queue *queue,
+                                 int64_t slack_us)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->timer_slack = MPMAX(slack_us, 0);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Return the (possibly later) time at which to wake up for the deadline until.
+static int64_t coalesce_deadline(struct mp_dispatch_queue *queue, int64_t until)
+{
+    int64_t slack = queue->timer_slack;
+    if (slack <= 0 || until <= 0 || until > INT64_MAX - slack)
+        return until;
+    return (until + slack - 1) / slack * slack;
+}
+
 // Process any outstanding dispatch items in the queue. This also handles
 // suspending or locking the this thread from another thread via
 // mp_dispatch_lock().
@@ -254,6 +285,11 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 {
     pthread_mutex_lock(&queue->lock);
     queue->wait = timeout > 0 ? mp_add_timeout(mp_time_us(), timeout) : 0;
+    queue->wait = coalesce_deadline(queue, queue->wait);
+    if (queue->applied_timer_slack != queue->timer_slack) {
+        mpthread_set_timer_slack(queue->timer_slack * 1000);
+        queue->applied_timer_slack = queue->timer_slack;
+    }
     assert(!queue->in_process); // recursion not allowed
     queue->in_process = true;
     queue->in_process_thread = pthread_self();
@@ -329,6 +365,7 @@ void mp_dispatch_interrupt(struct mp_dispatch_queue *queue)
 void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until)
 {
     pthread_mutex_lock(&queue->lock);
+    until = coalesce_deadline(queue, until);
     if (queue->in_process && queue->wait > until) {
         queue->wait = until;
         pthread_cond_broadcast(&queue->cond);
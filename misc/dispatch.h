@@ -23,6 +23,8 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
 void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout);
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue);
 void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until);
+void mp_dispatch_set_timer_slack(struct mp_dispatch_queue *queue,
+                                 int64_t slack_us);
 void mp_dispatch_lock(struct mp_dispatch_queue *queue);
 void mp_dispatch_unlock(struct mp_dispatch_queue *queue);
 
@@ -37,6 +37,9 @@
  *
  * Currently, will insert \u literals for characters 0-31, '"', '\', and write
  * everything else literally.
+ *
+ * Both use strspn()/strcspn() to skip runs of uninteresting characters, which
+ * the libc usually implements with vectorized code.
  */
 
 #include <stdlib.h>
@@ -62,12 +65,7 @@ static bool eat_c(char **s, char c)
 
 static void eat_ws(char **src)
 {
-    while (1) {
-        char c = **src;
-        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
-            return;
-        *src += 1;
-    }
+    *src += strspn(*src, " \t\n\r");
 }
 
 void json_skip_whitespace(char **src)
@@ -82,13 +80,14 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -118,6 +117,10 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
         return -1; // not an array or object
     char term = is_obj ? '}' : ']';
     struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    // Most lists are small. Collect the first entries on the stack, so the
+    // final arrays can be allocated with the exact size at once.
+    struct mpv_node values[16];
+    char *keys[16];
     while (1) {
         eat_ws(src);
         if (eat_c(src, term))
@@ -125,6 +128,12 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
         if (list->num > 0 && !eat_c(src, ','))
             return -1; // missing ','
         eat_ws(src);
+        if (list->num == MP_ARRAY_SIZE(values)) {
+            list->values = talloc_memdup(list, values, sizeof(values));
+            if (is_obj)
+                list->keys = talloc_memdup(list, keys, sizeof(keys));
+        }
+        bool on_stack = list->num < MP_ARRAY_SIZE(values);
         if (is_obj) {
             struct mpv_node keynode;
             if (read_str(list, &keynode, src) < 0)
@@ -133,14 +142,22 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
             if (!eat_c(src, ':'))
                 return -1; // ':' missing
             eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
+            if (!on_stack)
+                MP_TARRAY_GROW(list, list->keys, list->num);
+            (on_stack ? keys : list->keys)[list->num] = keynode.u.string;
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+        if (!on_stack)
+            MP_TARRAY_GROW(list, list->values, list->num);
+        struct mpv_node *val = &(on_stack ? values : list->values)[list->num];
+        if (json_parse(ta_parent, val, src, max_depth) < 0)
             return -1;
         list->num++;
     }
+    if (list->num && list->num <= MP_ARRAY_SIZE(values)) {
+        list->values = talloc_memdup(list, values, list->num * sizeof(values[0]));
+        if (is_obj)
+            list->keys = talloc_memdup(list, keys, list->num * sizeof(keys[0]));
+    }
     dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
     dst->u.list = list;
     return 0;
@@ -218,20 +235,23 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 
 #define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
 
+// Characters which need to be escaped (except 0, which terminates the string).
+static const char json_special_chars[] =
+    "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+    "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+    "\"\\";
+
 static void write_json_str(bstr *b, unsigned char *str)
 {
     APPEND(b, "\"");
     while (1) {
-        unsigned char *cur = str;
-        while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
-            cur++;
+        unsigned char *cur = str + strcspn(str, json_special_chars);
+        bstr_xappend(NULL, b, (bstr){str, cur - str});
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
         bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
         str = cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
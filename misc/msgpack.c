@@ -0,0 +1,303 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack parser and writer, for the subset which maps to mpv_node.
+ *
+ * Map keys must be strings. Unsigned integers larger than INT64_MAX and
+ * extension types are rejected. "bin" is parsed as MPV_FORMAT_BYTE_ARRAY,
+ * "float 32" as MPV_FORMAT_DOUBLE.
+ *
+ * The writer always uses the shortest encoding.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <string.h>
+
+#include "common/common.h"
+
+#include "msgpack.h"
+
+static bool read_bytes(bstr *src, void *dst, size_t len)
+{
+    if (src->len < len)
+        return false;
+    memcpy(dst, src->start, len);
+    *src = bstr_cut(*src, len);
+    return true;
+}
+
+// Read a big endian unsigned integer of the given size.
+static bool read_uint(bstr *src, int size, uint64_t *out)
+{
+    uint8_t buf[8];
+    if (!read_bytes(src, buf, size))
+        return false;
+    *out = 0;
+    for (int n = 0; n < size; n++)
+        *out = (*out << 8) | buf[n];
+    return true;
+}
+
+static int read_str(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    uint64_t len)
+{
+    if (src->len < len)
+        return -1;
+    dst->format = MPV_FORMAT_STRING;
+    dst->u.string = bstrto0(ta_parent, (bstr){src->start, len});
+    *src = bstr_cut(*src, len);
+    return 0;
+}
+
+static int read_bin(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    uint64_t len)
+{
+    if (src->len < len)
+        return -1;
+    struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+    ba->data = talloc_memdup(ba, src->start, len);
+    ba->size = len;
+    dst->format = MPV_FORMAT_BYTE_ARRAY;
+    dst->u.ba = ba;
+    *src = bstr_cut(*src, len);
+    return 0;
+}
+
+static int read_sub(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    uint64_t num, bool is_obj, int max_depth)
+{
+    // Every element needs at least 1 byte; reject bogus sizes early.
+    if (num > src->len)
+        return -1;
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_obj) {
+            struct mpv_node keynode;
+            if (msgpack_parse(list, &keynode, src, max_depth) < 0 ||
+                keynode.format != MPV_FORMAT_STRING)
+                return -1; // key is not a string
+            MP_TARRAY_GROW(list, list->keys, list->num);
+            list->keys[list->num] = keynode.u.string;
+        }
+        MP_TARRAY_GROW(list, list->values, list->num);
+        if (msgpack_parse(ta_parent, &list->values[list->num], src,
+                          max_depth) < 0)
+            return -1;
+        list->num++;
+    }
+    dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    return 0;
+}
+
+/* Parse a single MessagePack object from the start of *src, and write the
+ * result into *dst. max_depth limits the recursion and tree depth.
+ * Returns:
+ *   0: success, *dst is valid, *src is advanced past the object
+ *  -1: failure (including truncated input), *dst is invalid, there may be
+ *      dead allocs under ta_parent
+ * Unlike json_parse(), all strings are copied.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    uint64_t c, v;
+    if (!read_uint(src, 1, &c))
+        return -1; // early EOF
+
+    if (c <= 0x7f) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = c;
+        return 0;
+    } else if (c >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)c;
+        return 0;
+    } else if ((c & 0xf0) == 0x80) {
+        return read_sub(ta_parent, dst, src, c & 0x0f, true, max_depth);
+    } else if ((c & 0xf0) == 0x90) {
+        return read_sub(ta_parent, dst, src, c & 0x0f, false, max_depth);
+    } else if ((c & 0xe0) == 0xa0) {
+        return read_str(ta_parent, dst, src, c & 0x1f);
+    }
+
+    switch (c) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = c == 0xc3;
+        return 0;
+    case 0xc4: case 0xc5: case 0xc6:
+        if (!read_uint(src, 1 << (c - 0xc4), &v))
+            return -1;
+        return read_bin(ta_parent, dst, src, v);
+    case 0xca: {
+        if (!read_uint(src, 4, &v))
+            return -1;
+        uint32_t i = v;
+        float f;
+        memcpy(&f, &i, sizeof(f));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = f;
+        return 0;
+    }
+    case 0xcb:
+        if (!read_uint(src, 8, &v))
+            return -1;
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &v, sizeof(double));
+        return 0;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (!read_uint(src, 1 << (c - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = v;
+        return 0;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int size = 1 << (c - 0xd0);
+        if (!read_uint(src, size, &v))
+            return -1;
+        // Sign extend.
+        if (size < 8 && (v & (1ULL << (size * 8 - 1))))
+            v |= ~0ULL << (size * 8);
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int64_t)v;
+        return 0;
+    }
+    case 0xd9: case 0xda: case 0xdb:
+        if (!read_uint(src, 1 << (c - 0xd9), &v))
+            return -1;
+        return read_str(ta_parent, dst, src, v);
+    case 0xdc: case 0xdd:
+        if (!read_uint(src, 2 << (c - 0xdc), &v))
+            return -1;
+        return read_sub(ta_parent, dst, src, v, false, max_depth);
+    case 0xde: case 0xdf:
+        if (!read_uint(src, 2 << (c - 0xde), &v))
+            return -1;
+        return read_sub(ta_parent, dst, src, v, true, max_depth);
+    }
+    return -1; // extension types, or reserved
+}
+
+// Append the tag byte c, followed by the size-byte big endian value v.
+static void write_tag(bstr *b, int c, int size, uint64_t v)
+{
+    uint8_t buf[9] = {c};
+    for (int n = 0; n < size; n++)
+        buf[1 + n] = v >> ((size - 1 - n) * 8);
+    bstr_xappend(NULL, b, (bstr){buf, 1 + size});
+}
+
+// Append a length header. fix_tag is the tag of the variant with the length
+// packed into the tag (if len <= fix_max, -1 if none), tag8 the tag of the
+// variant with 8 bit length (0 if none). The tag of the 32 bit length variant
+// always follows tag16.
+static void write_len(bstr *b, int fix_tag, int64_t fix_max, int tag8,
+                      int tag16, uint64_t len)
+{
+    if ((int64_t)len <= fix_max) {
+        write_tag(b, fix_tag | len, 0, 0);
+    } else if (tag8 && len <= UINT8_MAX) {
+        write_tag(b, tag8, 1, len);
+    } else if (len <= UINT16_MAX) {
+        write_tag(b, tag16, 2, len);
+    } else {
+        write_tag(b, tag16 + 1, 4, len);
+    }
+}
+
+static void write_str(bstr *b, const char *str)
+{
+    size_t len = strlen(str);
+    write_len(b, 0xa0, 31, 0xd9, 0xda, len);
+    bstr_xappend(NULL, b, (bstr){(unsigned char *)str, len});
+}
+
+static int msgpack_append(bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        write_tag(b, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        write_tag(b, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64: {
+        int64_t v = src->u.int64;
+        if (v >= -32 && v <= 127) {
+            write_tag(b, v & 0xff, 0, 0);
+        } else if (v >= INT8_MIN && v <= INT8_MAX) {
+            write_tag(b, 0xd0, 1, v);
+        } else if (v >= INT16_MIN && v <= INT16_MAX) {
+            write_tag(b, 0xd1, 2, v);
+        } else if (v >= INT32_MIN && v <= INT32_MAX) {
+            write_tag(b, 0xd2, 4, v);
+        } else {
+            write_tag(b, 0xd3, 8, v);
+        }
+        return 0;
+    }
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        write_tag(b, 0xcb, 8, v);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        write_str(b, src->u.string);
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        write_len(b, 0, -1, 0xc4, 0xc5, ba->size);
+        bstr_xappend(NULL, b, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
+        write_len(b, is_obj ? 0x80 : 0x90, 15, 0, is_obj ? 0xde : 0xdc,
+                  list->num);
+        for (int n = 0; n < list->num; n++) {
+            if (is_obj)
+                write_str(b, list->keys[n]);
+            if (msgpack_append(b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Write the contents of *src as MessagePack, and append it to *dst. *dst is
+ * extended as with bstr_xappend(), so an existing allocation is reused.
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_write(bstr *dst, struct mpv_node *src)
+{
+    return msgpack_append(dst, src);
+}
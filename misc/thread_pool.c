@@ -18,49 +18,167 @@
 #include <pthread.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 
 #include "thread_pool.h"
 
+// Each worker has its own queues (one per priority). Work is queued to the
+// worker that queues it, or round-robin if queued from another thread. Idle
+// workers take work from the other workers' queues ("stealing"), so nothing
+// waits behind a worker busy with a long job. Each queue has its own lock, so
+// workers rarely contend for the same lock.
+
 struct work {
     void (*fn)(void *ctx);
     void *fn_ctx;
 };
 
-struct mp_thread_pool {
-    pthread_t *threads;
-    int num_threads;
+// Ring buffer; the owner takes from the front, other workers from the back.
+struct work_queue {
+    struct work *items;
+    int alloc;              // power of 2
+    int head;
+    int num;
+};
+
+struct worker {
+    struct mp_thread_pool *pool;
+    int index;
+    pthread_t thread;
 
     pthread_mutex_t lock;
+    // --- protected by lock
+    struct work_queue queues[MP_THREAD_POOL_PRIO_COUNT];
+};
+
+struct mp_thread_pool {
+    struct worker **workers;
+    int num_workers;
+    int num_threads;        // number of workers with a running thread
+
+    pthread_mutex_t lock;   // for sleeping
     pthread_cond_t wakeup;
 
     // --- the following fields are protected by lock
     bool terminate;
-    struct work *work;
-    int num_work;
+
+    // --- the following fields are accessed atomically
+    atomic_int pending;     // number of items in all queues
+    atomic_int num_idle;    // number of workers waiting on wakeup
+    atomic_int running;
+    atomic_uint next_worker;
+    atomic_ullong completed;
+    atomic_ullong stolen;
+    atomic_ullong cancelled;
 };
 
+static void queue_push(void *ta_parent, struct work_queue *q, struct work work)
+{
+    if (q->num == q->alloc) {
+        int new_alloc = MPMAX(q->alloc * 2, 16);
+        struct work *items = talloc_array(ta_parent, struct work, new_alloc);
+        for (int n = 0; n < q->num; n++)
+            items[n] = q->items[(q->head + n) & (q->alloc - 1)];
+        talloc_free(q->items);
+        q->items = items;
+        q->alloc = new_alloc;
+        q->head = 0;
+    }
+    q->items[(q->head + q->num) & (q->alloc - 1)] = work;
+    q->num += 1;
+}
+
+static struct work queue_pop_front(struct work_queue *q)
+{
+    assert(q->num > 0);
+    struct work work = q->items[q->head];
+    q->head = (q->head + 1) & (q->alloc - 1);
+    q->num -= 1;
+    return work;
+}
+
+static struct work queue_pop_back(struct work_queue *q)
+{
+    assert(q->num > 0);
+    q->num -= 1;
+    return q->items[(q->head + q->num) & (q->alloc - 1)];
+}
+
+static bool queue_remove(struct work_queue *q, void (*fn)(void *ctx),
+                         void *fn_ctx)
+{
+    int mask = q->alloc - 1;
+    for (int n = 0; n < q->num; n++) {
+        struct work *w = &q->items[(q->head + n) & mask];
+        if (w->fn == fn && w->fn_ctx == fn_ctx) {
+            for (int i = n + 1; i < q->num; i++)
+                q->items[(q->head + i - 1) & mask] =
+                    q->items[(q->head + i) & mask];
+            q->num -= 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Take the next item from the worker's own queues, or from another worker.
+// Higher priorities are always preferred, even if this means stealing.
+static bool get_work(struct worker *w, struct work *out, bool *stolen)
+{
+    struct mp_thread_pool *pool = w->pool;
+
+    for (int prio = MP_THREAD_POOL_PRIO_COUNT - 1; prio >= 0; prio--) {
+        for (int n = 0; n < pool->num_workers; n++) {
+            struct worker *other =
+                pool->workers[(w->index + n) % pool->num_workers];
+            struct work_queue *q = &other->queues[prio];
+            pthread_mutex_lock(&other->lock);
+            bool found = q->num > 0;
+            if (found) {
+                *out = other == w ? queue_pop_front(q) : queue_pop_back(q);
+                atomic_fetch_add(&pool->pending, -1);
+            }
+            pthread_mutex_unlock(&other->lock);
+            if (found) {
+                *stolen = other != w;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void *worker_thread(void *arg)
 {
-    struct mp_thread_pool *pool = arg;
+    struct worker *w = arg;
+    struct mp_thread_pool *pool = w->pool;
 
-    pthread_mutex_lock(&pool->lock);
     while (1) {
-        while (!pool->num_work && !pool->terminate)
+        struct work work;
+        bool stolen;
+        if (get_work(w, &work, &stolen)) {
+            atomic_fetch_add(&pool->running, 1);
+            work.fn(work.fn_ctx);
+            atomic_fetch_add(&pool->running, -1);
+            atomic_fetch_add(&pool->completed, 1);
+            if (stolen)
+                atomic_fetch_add(&pool->stolen, 1);
+            continue;
+        }
+
+        // Queuers check num_idle after incrementing pending, so either they
+        // see this worker idle and signal it, or it sees the new work.
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->num_idle, 1);
+        while (atomic_load(&pool->pending) <= 0 && !pool->terminate)
             pthread_cond_wait(&pool->wakeup, &pool->lock);
+        atomic_fetch_add(&pool->num_idle, -1);
+        bool exit = pool->terminate && atomic_load(&pool->pending) <= 0;
+        pthread_mutex_unlock(&pool->lock);
 
-        if (!pool->num_work && pool->terminate)
+        if (exit)
             break;
-
-        assert(pool->num_work > 0);
-        struct work work = pool->work[pool->num_work - 1];
-        pool->num_work -= 1;
-
-        pthread_mutex_unlock(&pool->lock);
-        work.fn(work.fn_ctx);
-        pthread_mutex_lock(&pool->lock);
     }
-    assert(pool->num_work == 0);
-    pthread_mutex_unlock(&pool->lock);
 
     return NULL;
 }
@@ -75,9 +193,11 @@ static void thread_pool_dtor(void *ctx)
     pthread_mutex_unlock(&pool->lock);
 
     for (int n = 0; n < pool->num_threads; n++)
-        pthread_join(pool->threads[n], NULL);
+        pthread_join(pool->workers[n]->thread, NULL);
 
-    assert(pool->num_work == 0);
+    assert(atomic_load(&pool->pending) == 0);
+    for (int n = 0; n < pool->num_workers; n++)
+        pthread_mutex_destroy(&pool->workers[n]->lock);
     pthread_cond_destroy(&pool->wakeup);
     pthread_mutex_destroy(&pool->lock);
 }
@@ -97,29 +217,108 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
     pthread_mutex_init(&pool->lock, NULL);
     pthread_cond_init(&pool->wakeup, NULL);
 
+    // All workers must exist before the first thread starts stealing.
+    pool->workers = talloc_array(pool, struct worker *, threads);
+    for (int n = 0; n < threads; n++) {
+        struct worker *w = talloc_zero(pool, struct worker);
+        w->pool = pool;
+        w->index = n;
+        pthread_mutex_init(&w->lock, NULL);
+        pool->workers[n] = w;
+    }
+    pool->num_workers = threads;
+
     for (int n = 0; n < threads; n++) {
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, worker_thread, pool)) {
+        struct worker *w = pool->workers[n];
+        if (pthread_create(&w->thread, NULL, worker_thread, w)) {
             talloc_free(pool);
             return NULL;
         }
-        MP_TARRAY_APPEND(pool, pool->threads, pool->num_threads, thread);
+        pool->num_threads += 1;
     }
 
     return pool;
 }
 
+// Queue a function to be run on a worker thread: fn(fn_ctx), with normal
+// priority. See mp_thread_pool_queue_prio().
+void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
+                          void *fn_ctx)
+{
+    mp_thread_pool_queue_prio(pool, MP_THREAD_POOL_PRIO_NORMAL, fn, fn_ctx);
+}
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
 // If no worker thread is currently available, it's appended to a list in memory
-// with unbounded size. This function always returns immediately.
+// with unbounded size. This function always returns immediately. Items with
+// the same priority are started roughly in queue order.
 // Concurrent queue calls are allowed, as long as it does not overlap with
 // pool destruction.
-void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
-                          void *fn_ctx)
+void mp_thread_pool_queue_prio(struct mp_thread_pool *pool,
+                               enum mp_thread_pool_prio prio,
+                               void (*fn)(void *ctx), void *fn_ctx)
 {
-    pthread_mutex_lock(&pool->lock);
-    struct work work = {fn, fn_ctx};
-    MP_TARRAY_INSERT_AT(pool, pool->work, pool->num_work, 0, work);
-    pthread_cond_signal(&pool->wakeup);
-    pthread_mutex_unlock(&pool->lock);
+    assert(prio >= 0 && prio < MP_THREAD_POOL_PRIO_COUNT);
+
+    // Work queued by a work item stays on the same worker if possible.
+    struct worker *w = NULL;
+    pthread_t self = pthread_self();
+    for (int n = 0; n < pool->num_workers; n++) {
+        if (pthread_equal(pool->workers[n]->thread, self))
+            w = pool->workers[n];
+    }
+    if (!w) {
+        unsigned int next = atomic_fetch_add(&pool->next_worker, 1);
+        w = pool->workers[next % pool->num_workers];
+    }
+
+    pthread_mutex_lock(&w->lock);
+    queue_push(w, &w->queues[prio], (struct work){fn, fn_ctx});
+    pthread_mutex_unlock(&w->lock);
+
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->num_idle) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wakeup);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Remove a queued work item with the given fn and fn_ctx (of any priority),
+// if it wasn't started yet. Returns whether an item was removed. If the same
+// item was queued multiple times, only one instance is removed. The caller has
+// to synchronize with the work item itself if it's already running.
+bool mp_thread_pool_cancel(struct mp_thread_pool *pool, void (*fn)(void *ctx),
+                           void *fn_ctx)
+{
+    for (int n = 0; n < pool->num_workers; n++) {
+        struct worker *w = pool->workers[n];
+        bool found = false;
+        pthread_mutex_lock(&w->lock);
+        for (int prio = 0; prio < MP_THREAD_POOL_PRIO_COUNT && !found; prio++)
+            found = queue_remove(&w->queues[prio], fn, fn_ctx);
+        if (found)
+            atomic_fetch_add(&pool->pending, -1);
+        pthread_mutex_unlock(&w->lock);
+        if (found) {
+            atomic_fetch_add(&pool->cancelled, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return a snapshot of the pool's state. The values are not synchronized with
+// each other.
+void mp_thread_pool_get_stats(struct mp_thread_pool *pool,
+                              struct mp_thread_pool_stats *stats)
+{
+    *stats = (struct mp_thread_pool_stats){
+        .num_threads = pool->num_threads,
+        .queued = MPMAX(atomic_load(&pool->pending), 0),
+        .running = atomic_load(&pool->running),
+        .completed = atomic_load(&pool->completed),
+        .stolen = atomic_load(&pool->stolen),
+        .cancelled = atomic_load(&pool->cancelled),
+    };
 }
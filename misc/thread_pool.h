@@ -1,10 +1,38 @@
 #ifndef MPV_MP_THREAD_POOL_H
 #define MPV_MP_THREAD_POOL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 struct mp_thread_pool;
 
+// Work with a higher priority is always started before pending work with a
+// lower priority.
+enum mp_thread_pool_prio {
+    MP_THREAD_POOL_PRIO_LOW,        // background work
+    MP_THREAD_POOL_PRIO_NORMAL,     // default for mp_thread_pool_queue()
+    MP_THREAD_POOL_PRIO_HIGH,       // latency critical work
+    MP_THREAD_POOL_PRIO_COUNT
+};
+
+struct mp_thread_pool_stats {
+    int num_threads;
+    int queued;             // work items not started yet
+    int running;            // work items currently executing
+    uint64_t completed;     // total number of work items run
+    uint64_t stolen;        // completed items taken from another worker
+    uint64_t cancelled;     // items removed by mp_thread_pool_cancel()
+};
+
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads);
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx);
+void mp_thread_pool_queue_prio(struct mp_thread_pool *pool,
+                               enum mp_thread_pool_prio prio,
+                               void (*fn)(void *ctx), void *fn_ctx);
+bool mp_thread_pool_cancel(struct mp_thread_pool *pool, void (*fn)(void *ctx),
+                           void *fn_ctx);
+void mp_thread_pool_get_stats(struct mp_thread_pool *pool,
+                              struct mp_thread_pool_stats *stats);
 
 #endif
@@ -0,0 +1,165 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+
+#include "thread_sched.h"
+
+struct thread_sched_opts {
+    char **priorities;
+    char **affinity;
+    int mlock_audio;
+};
+
+#define OPT_BASE_STRUCT struct thread_sched_opts
+const struct m_sub_options thread_sched_conf = {
+    .opts = (const struct m_option[]){
+        OPT_KEYVALUELIST("thread-priorities", priorities, 0),
+        OPT_KEYVALUELIST("thread-affinity", affinity, 0),
+        OPT_FLAG("audio-buffer-mlock", mlock_audio, 0),
+        {0}
+    },
+    .size = sizeof(struct thread_sched_opts),
+};
+
+static const char *find_entry(char **list, const char *thread_class)
+{
+    for (int n = 0; list && list[n * 2 + 0]; n++) {
+        if (strcmp(list[n * 2 + 0], thread_class) == 0)
+            return list[n * 2 + 1];
+    }
+    return NULL;
+}
+
+// Parse "fifo:<prio>", "rr:<prio>", "nice:<n>" or "other".
+static void apply_priority(struct mp_log *log, const char *thread_class,
+                           const char *spec)
+{
+    bstr rest = bstr0(spec);
+    bstr name = bstr_split(rest, ":", &rest);
+    bstr_eatstart0(&rest, ":");
+    long long val = 0;
+    if (rest.len) {
+        bstr end;
+        val = bstrtoll(rest, &end, 10);
+        if (end.len)
+            goto invalid;
+    }
+
+    int r;
+    if (bstr_equals0(name, "fifo") && rest.len) {
+        r = mpthread_set_sched_policy(MPTHREAD_SCHED_FIFO, val);
+    } else if (bstr_equals0(name, "rr") && rest.len) {
+        r = mpthread_set_sched_policy(MPTHREAD_SCHED_RR, val);
+    } else if (bstr_equals0(name, "nice") && rest.len) {
+        r = mpthread_set_nice(val);
+    } else if (bstr_equals0(name, "other") && !rest.len) {
+        r = mpthread_set_sched_policy(MPTHREAD_SCHED_OTHER, 0);
+    } else {
+        goto invalid;
+    }
+    if (r) {
+        mp_warn(log, "Could not set priority '%s' for %s thread: %s\n",
+                spec, thread_class, mp_strerror(r));
+    } else {
+        mp_verbose(log, "Set priority '%s' for %s thread.\n", spec,
+                   thread_class);
+    }
+    return;
+
+invalid:
+    mp_err(log, "Invalid thread priority '%s' for %s thread.\n", spec,
+           thread_class);
+}
+
+// Parse a list of CPU numbers and ranges, like "0-2+5".
+static void apply_affinity(struct mp_log *log, const char *thread_class,
+                           const char *spec)
+{
+    int *cpus = NULL;
+    int num_cpus = 0;
+    bstr rest = bstr0(spec);
+    while (rest.len) {
+        bstr item = bstr_split(rest, "+", &rest);
+        bstr_eatstart0(&rest, "+");
+        bstr end;
+        long long first = bstrtoll(item, &end, 10);
+        long long last = first;
+        if (end.len == item.len)
+            goto invalid;
+        if (bstr_eatstart0(&end, "-")) {
+            bstr last_s = end;
+            last = bstrtoll(last_s, &end, 10);
+            if (end.len == last_s.len)
+                goto invalid;
+        }
+        if (end.len || first < 0 || last < first || last > 4095)
+            goto invalid;
+        for (long long cpu = first; cpu <= last; cpu++)
+            MP_TARRAY_APPEND(NULL, cpus, num_cpus, cpu);
+    }
+    if (!num_cpus)
+        goto invalid;
+
+    int r = mpthread_set_affinity(cpus, num_cpus);
+    if (r) {
+        mp_warn(log, "Could not set CPU affinity '%s' for %s thread: %s\n",
+                spec, thread_class, mp_strerror(r));
+    } else {
+        mp_verbose(log, "Set CPU affinity '%s' for %s thread.\n", spec,
+                   thread_class);
+    }
+    talloc_free(cpus);
+    return;
+
+invalid:
+    mp_err(log, "Invalid CPU list '%s' for %s thread.\n", spec, thread_class);
+    talloc_free(cpus);
+}
+
+void mp_thread_sched_apply(struct mpv_global *global, struct mp_log *log,
+                           const char *thread_class)
+{
+    struct thread_sched_opts *opts =
+        mp_get_config_group(NULL, global, &thread_sched_conf);
+
+    const char *prio = find_entry(opts->priorities, thread_class);
+    if (prio)
+        apply_priority(log, thread_class, prio);
+
+    const char *cpus = find_entry(opts->affinity, thread_class);
+    if (cpus)
+        apply_affinity(log, thread_class, cpus);
+
+    talloc_free(opts);
+}
+
+bool mp_thread_sched_mlock_audio(struct mpv_global *global)
+{
+    struct thread_sched_opts *opts =
+        mp_get_config_group(NULL, global, &thread_sched_conf);
+    bool r = opts->mlock_audio;
+    talloc_free(opts);
+    return r;
+}
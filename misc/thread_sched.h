@@ -0,0 +1,17 @@
+#ifndef MP_THREAD_SCHED_H_
+#define MP_THREAD_SCHED_H_
+
+#include <stdbool.h>
+
+struct mpv_global;
+struct mp_log;
+
+// Apply the --thread-priorities and --thread-affinity settings for the given
+// thread class ("ao", "vo", "demux", "cache") to the calling thread.
+void mp_thread_sched_apply(struct mpv_global *global, struct mp_log *log,
+                           const char *thread_class);
+
+// Whether --audio-buffer-mlock is enabled.
+bool mp_thread_sched_mlock_audio(struct mpv_global *global);
+
+#endif
@@ -166,6 +166,46 @@ static void config_destroy(void *p)
     }
 }
 
+// 32 bit FNV-1a
+static uint32_t opt_name_hash(struct bstr name)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < name.len; n++) {
+        h ^= name.start[n];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Index all options by name. If a name is used more than once, the first
+// option wins, as it would with a linear search.
+static void build_opts_hash(struct m_config *config)
+{
+    int size = 16;
+    while (size < config->num_opts * 2)
+        size *= 2;
+    config->opts_hash = talloc_array(config, int, size);
+    config->opts_hash_size = size;
+    for (int n = 0; n < size; n++)
+        config->opts_hash[n] = -1;
+
+    for (int n = 0; n < config->num_opts; n++) {
+        struct bstr name = bstr0(config->opts[n].name);
+        uint32_t i = opt_name_hash(name) & (size - 1);
+        bool dup = false;
+        while (config->opts_hash[i] >= 0) {
+            int other = config->opts_hash[i];
+            if (bstrcmp(bstr0(config->opts[other].name), name) == 0) {
+                dup = true;
+                break;
+            }
+            i = (i + 1) & (size - 1);
+        }
+        if (!dup)
+            config->opts_hash[i] = n;
+    }
+}
+
 struct m_config *m_config_new(void *talloc_ctx, struct mp_log *log,
                               size_t size, const void *defaults,
                               const struct m_option *options)
@@ -191,6 +231,7 @@ struct m_config *m_config_new(void *talloc_ctx, struct mp_log *log,
 
     if (options)
         add_options(config, NULL, config->optstruct, defaults, options);
+    build_opts_hash(config);
     return config;
 }
 
@@ -545,14 +586,16 @@ static void m_config_add_option(struct m_config *config,
 struct m_config_option *m_config_get_co_raw(const struct m_config *config,
                                             struct bstr name)
 {
-    if (!name.len)
+    if (!name.len || !config->opts_hash)
         return NULL;
 
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        struct bstr coname = bstr0(co->name);
-        if (bstrcmp(coname, name) == 0)
+    int mask = config->opts_hash_size - 1;
+    uint32_t i = opt_name_hash(name) & mask;
+    while (config->opts_hash[i] >= 0) {
+        struct m_config_option *co = &config->opts[config->opts_hash[i]];
+        if (bstrcmp(bstr0(co->name), name) == 0)
             return co;
+        i = (i + 1) & mask;
     }
 
     return NULL;
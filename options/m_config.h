@@ -60,6 +60,10 @@ typedef struct m_config {
     // Registered options.
     struct m_config_option *opts; // all options, even suboptions
     int num_opts;
+    // Open addressing hash table over opts[].name; entries are indexes into
+    // opts[], or -1 for unused slots. The size is a power of 2.
+    int *opts_hash;
+    int opts_hash_size;
 
     // Creation parameters
     size_t size;
@@ -37,15 +37,14 @@
 #include "common/common.h"
 
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
-                               const char *property, double f, void *ctx)
+                               const struct m_property_ref *ref,
+                               double f, void *ctx)
 {
     union m_option_value val = {0};
     struct m_option opt = {0};
     int r;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                      &opt, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_GET_CONSTRICTED_TYPE, &opt, ctx);
     if (r != M_PROPERTY_OK)
         return r;
     assert(opt.type);
@@ -53,68 +52,141 @@ static int m_property_multiply(struct mp_log *log,
     if (!opt.type->multiply)
         return M_PROPERTY_NOT_IMPLEMENTED;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET, &val, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_GET, &val, ctx);
     if (r != M_PROPERTY_OK)
         return r;
     opt.type->multiply(&opt, &val, f);
-    r = m_property_do(log, prop_list, property, M_PROPERTY_SET, &val, ctx);
+    r = m_property_do_ref(log, ref, M_PROPERTY_SET, &val, ctx);
     m_option_free(&opt, &val);
     return r;
 }
 
-struct m_property *m_property_list_find(const struct m_property *list,
-                                        const char *name)
+// 32 bit FNV-1a
+static uint32_t prop_name_hash(struct bstr name)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < name.len; n++) {
+        h ^= name.start[n];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void m_property_list_init(struct m_property_list *list, void *ta_parent,
+                          struct m_property *props, int num_props)
 {
-    for (int n = 0; list && list[n].name; n++) {
-        if (strcmp(list[n].name, name) == 0)
-            return (struct m_property *)&list[n];
+    talloc_free(list->hash);
+
+    int size = 16;
+    while (size < num_props * 2)
+        size *= 2;
+    *list = (struct m_property_list){
+        .props = props,
+        .num_props = num_props,
+        .hash = talloc_array(ta_parent, int, size),
+        .hash_size = size,
+    };
+    for (int n = 0; n < size; n++)
+        list->hash[n] = -1;
+
+    // If a name is used more than once, the first entry wins, as it would
+    // with a linear search.
+    for (int n = 0; n < num_props; n++) {
+        struct bstr name = bstr0(props[n].name);
+        uint32_t i = prop_name_hash(name) & (size - 1);
+        bool dup = false;
+        while (list->hash[i] >= 0) {
+            if (bstrcmp(bstr0(props[list->hash[i]].name), name) == 0) {
+                dup = true;
+                break;
+            }
+            i = (i + 1) & (size - 1);
+        }
+        if (!dup)
+            list->hash[i] = n;
+    }
+}
+
+static struct m_property *find_prop(const struct m_property_list *list,
+                                    struct bstr name)
+{
+    if (!list || !list->hash)
+        return NULL;
+    int mask = list->hash_size - 1;
+    uint32_t i = prop_name_hash(name) & mask;
+    while (list->hash[i] >= 0) {
+        struct m_property *prop = &list->props[list->hash[i]];
+        if (bstrcmp(bstr0(prop->name), name) == 0)
+            return prop;
+        i = (i + 1) & mask;
     }
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
-                     int action, void *arg, void *ctx)
+struct m_property *m_property_list_find(const struct m_property_list *list,
+                                        const char *name)
 {
-    struct m_property *prop;
-    struct m_property_action_arg ka;
+    return find_prop(list, bstr0(name));
+}
+
+bool m_property_resolve(const struct m_property_list *list, const char *name,
+                        struct m_property_ref *ref)
+{
+    *ref = (struct m_property_ref){ .name = name };
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        ref->prop = find_prop(list, (bstr){(char *)name, sep - name});
+        ref->key = sep + 1;
+    } else {
+        ref->prop = find_prop(list, bstr0(name));
+    }
+    return !!ref->prop;
+}
+
+static int do_action(const struct m_property_ref *ref, int action, void *arg,
+                     void *ctx)
+{
+    struct m_property_action_arg ka;
+    if (ref->key) {
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = ref->key,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
-    if (!prop)
-        return M_PROPERTY_UNKNOWN;
-    return prop->call(ctx, prop, action, arg);
+    }
+    return ref->prop->call(ctx, ref->prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_list *prop_list,
                   const char *name, int action, void *arg, void *ctx)
+{
+    struct m_property_ref ref;
+    if (!m_property_resolve(prop_list, name, &ref))
+        return M_PROPERTY_UNKNOWN;
+    return m_property_do_ref(log, &ref, action, arg, ctx);
+}
+
+int m_property_do_ref(struct mp_log *log, const struct m_property_ref *ref,
+                      int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(ref, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(ref, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -122,7 +194,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -131,48 +203,48 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do_ref(log, ref, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_MULTIPLY: {
-        return m_property_multiply(log, prop_list, name, *(double *)arg, ctx);
+        return m_property_multiply(log, ref, *(double *)arg, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                          &opt, ctx);
+        r = m_property_do_ref(log, ref, M_PROPERTY_GET_CONSTRICTED_TYPE,
+                              &opt, ctx);
         if (r <= 0)
             return r;
         assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(ref, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        if ((r = do_action(prop_list, name, action, arg, ctx)) >= 0)
+        if ((r = do_action(ref, action, arg, ctx)) >= 0)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
             return r;
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(ref, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(ref, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -189,22 +261,22 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(ref, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        int err = m_option_set_node_or_string(log, &opt, name, &val, arg);
+        int err = m_option_set_node_or_string(log, &opt, ref->name, &val, arg);
         if (err == M_OPT_UNKNOWN) {
             r = M_PROPERTY_NOT_IMPLEMENTED;
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(ref, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(ref, action, arg, ctx);
     }
 }
 
@@ -235,8 +307,8 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
-                              int action, void *arg, void *ctx)
+static int m_property_do_bstr(const struct m_property_list *prop_list,
+                              bstr name, int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
@@ -253,7 +325,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_list *prop_list, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -284,7 +356,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_list *prop_list,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -341,13 +413,13 @@ char *m_properties_expand_string(const struct m_property *prop_list,
 }
 
 void m_properties_print_help_list(struct mp_log *log,
-                                  const struct m_property *list)
+                                  const struct m_property_list *list)
 {
     int count = 0;
 
     mp_info(log, "Name\n\n");
-    for (int i = 0; list[i].name; i++) {
-        const struct m_property *p = &list[i];
+    for (int i = 0; i < list->num_props; i++) {
+        const struct m_property *p = &list->props[i];
         mp_info(log, " %s\n", p->name);
         count++;
     }
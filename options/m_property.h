@@ -135,16 +135,48 @@ struct m_property {
     bool is_option;
 };
 
-struct m_property *m_property_list_find(const struct m_property *list,
+// A property array, indexed by name.
+struct m_property_list {
+    struct m_property *props;   // terminated with a {0} item
+    int num_props;
+
+    // Internal to m_property.c: open addressing hash table over props[].name
+    int *hash;
+    int hash_size;
+};
+
+// Index the first num_props entries of props, which must stay valid and must
+// not be changed while list is used. Can be called again to update list.
+void m_property_list_init(struct m_property_list *list, void *ta_parent,
+                          struct m_property *props, int num_props);
+
+struct m_property *m_property_list_find(const struct m_property_list *list,
                                         const char *name);
 
+// A property name, resolved to the property implementation.
+struct m_property_ref {
+    const char *name;           // full name as passed to m_property_resolve()
+    struct m_property *prop;
+    const char *key;            // sub-property path after "/", or NULL
+};
+
+// Look up the property for a name of the form "prop" or "prop/sub/path".
+// ref->name and ref->key point into name, which must stay valid while ref is
+// used. Returns false if there is no such property.
+bool m_property_resolve(const struct m_property_list *list, const char *name,
+                        struct m_property_ref *ref);
+
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_list *prop_list,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Like m_property_do(), but with an already resolved property.
+int m_property_do_ref(struct mp_log *log, const struct m_property_ref *ref,
+                      int action, void *arg, void *ctx);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -153,7 +185,7 @@ bool m_property_split_path(const char *path, bstr *prefix, char **rem);
 
 // Print a list of properties.
 void m_properties_print_help_list(struct mp_log *log,
-                                  const struct m_property *list);
+                                  const struct m_property_list *list);
 
 // Expand a property string.
 // This function allows to print strings containing property values.
@@ -167,7 +199,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(const struct m_property_list *prop_list,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
@@ -41,6 +41,8 @@
 #include "video/csputils.h"
 #include "video/hwdec.h"
 #include "video/image_writer.h"
+#include "video/mp_image.h"
+#include "video/out/vo.h"
 #include "sub/osd.h"
 #include "player/core.h"
 #include "player/command.h"
@@ -60,6 +62,8 @@ extern const struct m_sub_options stream_cdda_conf;
 extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
 extern const struct m_sub_options stream_cache_conf;
+extern const struct m_sub_options stream_file_conf;
+extern const struct m_sub_options stream_libarchive_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options drm_conf;
 extern const struct m_sub_options demux_rawaudio_conf;
@@ -74,6 +78,8 @@ extern const struct m_sub_options gl_video_conf;
 extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
+extern const struct m_sub_options recorder_conf;
+extern const struct m_sub_options thread_sched_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -142,6 +148,7 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_FLAG("native-fs", native_fs, 0),
     OPT_DOUBLE("display-fps", override_display_fps, M_OPT_MIN, .min = 0),
     OPT_DOUBLERANGE("video-timing-offset", timing_offset, 0, 0.0, 1.0),
+    OPT_INTRANGE("video-queue-depth", queue_depth, 0, 1, VO_MAX_QUEUE),
 #if HAVE_X11
     OPT_CHOICE("x11-netwm", x11_netwm, 0,
                ({"auto", 0}, {"no", -1}, {"yes", 1})),
@@ -180,6 +187,7 @@ const struct m_sub_options vo_sub_opts = {
         .mmcss_profile = "Playback",
         .ontop_level = -1,
         .timing_offset = 0.050,
+        .queue_depth = 1,
     },
 };
 
@@ -219,6 +227,8 @@ const struct m_sub_options mp_subtitle_sub_opts = {
         OPT_CHOICE("sub-ass-shaper", ass_shaper, 0,
                 ({"simple", 0}, {"complex", 1})),
         OPT_FLAG("sub-ass-justify", ass_justify, 0),
+        OPT_FLAG("sub-ass-render-ahead", ass_render_ahead, 0),
+        OPT_FLAG("sub-fonts-async", sub_fonts_async, 0),
         OPT_CHOICE("sub-ass-override", ass_style_override, 0,
                 ({"no", 0}, {"yes", 1}, {"force", 3}, {"scale", 4}, {"strip", 5})),
         OPT_FLAG("sub-scale-by-window", sub_scale_by_window, 0),
@@ -351,6 +361,9 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | UPDATE_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_FLAG("startup-trace", startup_trace, 0),
+    OPT_INTRANGE("trace-buffer", trace_buffer, UPDATE_TERM, 0, 10000000),
+    OPT_STRING("benchmark-report", benchmark_report, M_OPT_FILE),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM),
     OPT_FLAG("msg-module", msg_module, UPDATE_TERM),
@@ -368,13 +381,17 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("config", load_config, M_OPT_FIXED | CONF_PRE_PARSE),
     OPT_STRING("config-dir", force_configdir,
                M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE),
+    OPT_STRING("config-snapshot", config_snapshot,
+               M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE),
     OPT_STRINGLIST("reset-on-next-file", reset_options, 0),
 
 #if HAVE_LUA || HAVE_JAVASCRIPT
     OPT_PATHLIST("scripts", script_files, M_OPT_FIXED),
     OPT_CLI_ALIAS("script", "scripts-append"),
     OPT_KEYVALUELIST("script-opts", script_opts, 0),
+    OPT_STRING("script-cache-dir", script_cache_dir, M_OPT_FILE),
     OPT_FLAG("load-scripts", auto_load_scripts, 0),
+    OPT_INTRANGE("script-threads", script_threads, 0, 0, 64),
 #endif
 #if HAVE_LUA
     OPT_FLAG("osc", lua_load_osc, UPDATE_BUILTIN_SCRIPTS),
@@ -387,6 +404,10 @@ const m_option_t mp_opts[] = {
 // ------------------------- stream options --------------------
 
     OPT_SUBSTRUCT("", stream_cache, stream_cache_conf, 0),
+    OPT_SUBSTRUCT("", stream_file_opts, stream_file_conf, 0),
+#if HAVE_LIBARCHIVE
+    OPT_SUBSTRUCT("", stream_libarchive_opts, stream_libarchive_conf, 0),
+#endif
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_SUBSTRUCT("", dvd_opts, dvd_conf, 0),
@@ -462,12 +483,14 @@ const m_option_t mp_opts[] = {
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
     OPT_FLAG("prefetch-playlist", prefetch_open, 0),
+    OPT_DOUBLE("prefetch-playlist-time", prefetch_time, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pause, 0),
     OPT_FLAG("cache-pause-initial", cache_pause_initial, 0),
     OPT_FLOAT("cache-pause-wait", cache_pause_wait, M_OPT_MIN, .min = 0),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
+    OPT_INTRANGE("mf-prefetch", mf_prefetch, 0, 0, 256),
 #if HAVE_TV
     OPT_SUBSTRUCT("tv", tv_params, tv_params_conf, 0),
 #endif /* HAVE_TV */
@@ -509,10 +532,30 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
+    OPT_FLAG("vd-queue-enable", vd_queue_enable, 0),
+    OPT_INTRANGE("vd-queue-max-frames", vd_queue_max_frames, 0, 1, 1000),
+    OPT_DOUBLE("vd-queue-max-secs", vd_queue_max_secs, M_OPT_RANGE,
+               .min = 0, .max = 60),
+    OPT_BYTE_SIZE("vd-queue-max-bytes", vd_queue_max_bytes, 0, 0,
+                  INT_MAX * (int64_t)16),
+    OPT_BYTE_SIZE("image-cache-max-bytes", image_cache_max_bytes, 0, 0,
+                  INT_MAX * (int64_t)16),
+    OPT_FLAG("ad-queue-enable", ad_queue_enable, 0),
+    OPT_INTRANGE("ad-queue-max-frames", ad_queue_max_frames, 0, 1, 1000),
+    OPT_DOUBLE("ad-queue-max-secs", ad_queue_max_secs, M_OPT_RANGE,
+               .min = 0, .max = 60),
+
     OPT_STRING_VALIDATE("hwdec", hwdec_api, M_OPT_OPTIONAL_PARAM,
                         hwdec_validate_opt),
     OPT_STRING("hwdec-codecs", hwdec_codecs, 0),
+    OPT_STRING("hwdec-probe-cache", hwdec_probe_cache, M_OPT_FILE),
     OPT_IMAGEFORMAT("hwdec-image-format", hwdec_image_format, 0, .min = -1),
+    OPT_INTRANGE("hwdec-copy-threads", hwdec_copy_threads, 0, 1, 16),
+    OPT_CHOICE("image-hugepages", image_hugepages, 0,
+               ({"no", MP_HUGEPAGES_NO},
+                {"transparent", MP_HUGEPAGES_TRANSPARENT},
+                {"explicit", MP_HUGEPAGES_EXPLICIT})),
+    OPT_INTRANGE("hwupload-async-frames", hwupload_async_frames, 0, 0, 16),
 
     // -1 means auto aspect (prefer container size until aspect change)
     //  0 means square pixels
@@ -578,6 +621,7 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_FLAG("audio-low-latency", audio_low_latency, 0),
 
     OPT_STRING("title", wintitle, 0),
     OPT_STRING("force-media-title", media_title, 0),
@@ -666,6 +710,9 @@ const m_option_t mp_opts[] = {
                ({"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1})),
     OPT_FLOAT("hr-seek-demuxer-offset", hr_seek_demuxer_offset, 0),
     OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
+    OPT_INTRANGE("video-backstep-cache", video_backstep_cache, 0, 0, 1000),
+    OPT_SIZE_BOX("video-wall", video_wall, 0),
+    OPT_FLAG("video-wall-fs", video_wall_fs, 0),
     OPT_CHOICE_OR_INT("autosync", autosync, 0, 0, 10000,
                       ({"no", -1})),
 
@@ -691,6 +738,8 @@ const m_option_t mp_opts[] = {
                ({"no",   0},
                 {"once", 1},
                 {"yes",  2})),
+    OPT_DOUBLE("memory-trim", memory_trim, M_OPT_MIN, .min = 0),
+    OPT_FLAG("memory-trim-demuxer-cache", memory_trim_demuxer_cache, 0),
 
     OPT_FLAG("input-terminal", consolecontrols, UPDATE_TERM),
 
@@ -702,6 +751,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING("screenshot-directory", screenshot_directory, M_OPT_FILE),
 
     OPT_STRING("record-file", record_file, M_OPT_FILE),
+    OPT_SUBSTRUCT("", recorder_opts, recorder_conf, 0),
 
     OPT_SUBSTRUCT("", resample_opts, resample_conf, 0),
 
@@ -709,6 +759,7 @@ const m_option_t mp_opts[] = {
 
     OPT_SUBSTRUCT("", vo, vo_sub_opts, 0),
     OPT_SUBSTRUCT("", demux_opts, demux_conf, 0),
+    OPT_SUBSTRUCT("", thread_sched_opts, thread_sched_conf, 0),
 
     OPT_SUBSTRUCT("", gl_video_opts, gl_video_conf, 0),
     OPT_SUBSTRUCT("", spirv_opts, spirv_conf, 0),
@@ -752,6 +803,7 @@ const m_option_t mp_opts[] = {
 #if HAVE_CUDA_HWACCEL
     OPT_CHOICE_OR_INT("cuda-decode-device", cuda_device, 0,
                       0, INT_MAX, ({"auto", -1})),
+    OPT_FLAG("cuda-async-copy", cuda_async_copy, 0),
 #endif
 
 #if HAVE_VAAPI
@@ -881,6 +933,9 @@ const struct MPOpts mp_default_opts = {
     .audio_driver_list = NULL,
     .audio_decoders = NULL,
     .video_decoders = NULL,
+    .vd_queue_max_frames = 2,
+    .ad_queue_max_frames = 8,
+    .image_cache_max_bytes = 64 * 1024 * 1024,
     .softvol_max = 130,
     .softvol_volume = 100,
     .softvol_mute = 0,
@@ -908,6 +963,7 @@ const struct MPOpts mp_default_opts = {
     .chapter_merge_threshold = 100,
     .chapter_seek_threshold = 5.0,
     .hr_seek_framedrop = 1,
+    .video_wall_fs = 1,
     .sync_max_video_change = 1,
     .sync_max_audio_change = 0.125,
     .sync_audio_drop_size = 0.020,
@@ -954,6 +1010,7 @@ const struct MPOpts mp_default_opts = {
 
     .hwdec_api = HAVE_RPI ? "mmal" : "no",
     .hwdec_codecs = "h264,vc1,wmv3,hevc,mpeg2video,vp9",
+    .hwdec_copy_threads = 1,
 
     .audio_output_channels = {
         .set = 1,
@@ -963,6 +1020,7 @@ const struct MPOpts mp_default_opts = {
     .index_mode = 1,
 
     .mf_fps = 1.0,
+    .mf_prefetch = 8,
 
     .display_tags = (char **)(const char*[]){
         "Artist", "Album", "Album_Artist", "Comment", "Composer",
@@ -972,6 +1030,7 @@ const struct MPOpts mp_default_opts = {
     },
 
     .cuda_device = -1,
+    .cuda_async_copy = 1,
 };
 
 #endif /* MPLAYER_CFG_MPLAYER_H */
@@ -52,6 +52,7 @@ typedef struct mp_vo_opts {
 
     double override_display_fps;
     double timing_offset;
+    int queue_depth;
 
     // vo_drm
     struct sws_opts *sws_opts;
@@ -66,7 +67,12 @@ struct mp_cache_opts {
     int seek_min;
     int back_buffer;
     char *file;
+    char *file_dir;
+    int file_dir_max;
     int file_max;
+    int connections;
+    double readahead_secs;
+    int shared;
 };
 
 // Subtitle options needed by the subtitle decoders/renderers.
@@ -104,6 +110,8 @@ struct mp_subtitle_opts {
     int ass_hinting;
     int ass_shaper;
     int ass_justify;
+    int ass_render_ahead;
+    int sub_fonts_async;
     int sub_clear_on_seek;
     int teletext_page;
 };
@@ -123,6 +131,9 @@ typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    int startup_trace;
+    int trace_buffer;
+    char *benchmark_report;
     int verbose;
     int msg_really_quiet;
     char **msg_levels;
@@ -143,6 +154,8 @@ typedef struct MPOpts {
     int lua_load_stats;
 
     int auto_load_scripts;
+    char *script_cache_dir;
+    int script_threads;
 
     struct m_obj_settings *audio_driver_list;
     char *audio_device;
@@ -161,6 +174,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_low_latency;
 
     mp_vo_opts *vo;
 
@@ -178,6 +192,14 @@ typedef struct MPOpts {
     char *audio_decoders;
     char *video_decoders;
     char *audio_spdif;
+    int vd_queue_enable;
+    int vd_queue_max_frames;
+    double vd_queue_max_secs;
+    int64_t vd_queue_max_bytes;
+    int64_t image_cache_max_bytes;
+    int ad_queue_enable;
+    int ad_queue_max_frames;
+    double ad_queue_max_secs;
 
     struct mp_subtitle_opts *subs_rend;
     struct mp_osd_render_opts *osd_rend;
@@ -205,9 +227,12 @@ typedef struct MPOpts {
     int quiet;
     int load_config;
     char *force_configdir;
+    char *config_snapshot;
     int use_filedir_conf;
     int hls_bitrate;
     struct mp_cache_opts *stream_cache;
+    struct stream_file_opts *stream_file_opts;
+    struct stream_libarchive_opts *stream_libarchive_opts;
     int chapterrange[2];
     int edition_id;
     int correct_pts;
@@ -219,6 +244,9 @@ typedef struct MPOpts {
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int video_backstep_cache;
+    struct m_geometry video_wall;
+    int video_wall_fs;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
@@ -233,6 +261,8 @@ typedef struct MPOpts {
     char *osd_status_msg;
     char *osd_msg[3];
     int player_idle_mode;
+    double memory_trim;
+    int memory_trim_demuxer_cache;
     int consolecontrols;
     int playlist_pos;
     struct m_rel_time play_start;
@@ -262,6 +292,7 @@ typedef struct MPOpts {
     char *demuxer_name;
     int demuxer_thread;
     int prefetch_open;
+    double prefetch_time;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -297,7 +328,11 @@ typedef struct MPOpts {
 
     char *hwdec_api;
     char *hwdec_codecs;
+    char *hwdec_probe_cache;
     int hwdec_image_format;
+    int hwdec_copy_threads;
+    int image_hugepages;
+    int hwupload_async_frames;
 
     int w32_priority;
 
@@ -312,6 +347,7 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
@@ -319,6 +355,8 @@ typedef struct MPOpts {
     struct demux_mkv_opts *demux_mkv;
 
     struct demux_opts *demux_opts;
+    struct recorder_opts *recorder_opts;
+    struct thread_sched_opts *thread_sched_opts;
 
     struct vd_lavc_params *vd_lavc_params;
     struct ad_lavc_params *ad_lavc_params;
@@ -349,6 +387,7 @@ typedef struct MPOpts {
     struct vaapi_opts *vaapi_opts;
 
     int cuda_device;
+    int cuda_async_copy;
 } MPOpts;
 
 struct dvd_opts {
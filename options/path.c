@@ -143,6 +143,20 @@ char **mp_find_all_config_files(void *talloc_ctx, struct mpv_global *global,
     return mp_find_all_config_files_limited(talloc_ctx, global, 64, filename);
 }
 
+char **mp_get_config_dirs(void *talloc_ctx, struct mpv_global *global)
+{
+    char **ret = talloc_array(talloc_ctx, char*, MP_ARRAY_SIZE(config_dirs) + 1);
+    int num_ret = 0;
+
+    for (int i = 0; i < MP_ARRAY_SIZE(config_dirs); i++) {
+        const char *dir = mp_get_platform_path(ret, global, config_dirs[i]);
+        if (dir)
+            ret[num_ret++] = talloc_strdup(ret, dir);
+    }
+    ret[num_ret] = NULL;
+    return ret;
+}
+
 char *mp_find_config_file(void *talloc_ctx, struct mpv_global *global,
                           const char *filename)
 {
@@ -43,6 +43,10 @@ char *mp_find_user_config_file(void *talloc_ctx, struct mpv_global *global,
 char **mp_find_all_config_files(void *talloc_ctx, struct mpv_global *global,
                                 const char *filename);
 
+// Return all config directories searched by the functions above, whether they
+// exist or not, from highest to lowest priority. The list is NULL-terminated.
+char **mp_get_config_dirs(void *talloc_ctx, struct mpv_global *global);
+
 // Normally returns a talloc_strdup'ed copy of the path, except for special
 // paths starting with '~'. Used to allow the user explicitly reference a
 // file from the user's home or mpv config directory.
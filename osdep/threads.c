@@ -21,6 +21,18 @@
 
 #include "config.h"
 
+#if HAVE_POSIX
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "common/trace.h"
+
 #include "threads.h"
 #include "timer.h"
 
@@ -36,6 +48,8 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
 
 void mpthread_set_name(const char *name)
 {
+    mp_trace_set_thread_name(name);
+
     char tname[80];
     snprintf(tname, sizeof(tname), "mpv/%s", name);
 #if HAVE_GLIBC_THREAD_NAME
@@ -49,3 +63,58 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(tname);
 #endif
 }
+
+void mpthread_set_timer_slack(int64_t ns)
+{
+#if defined(__linux__) && defined(PR_SET_TIMERSLACK)
+    prctl(PR_SET_TIMERSLACK, (unsigned long)(ns > 0 ? ns : 0));
+#endif
+}
+
+int mpthread_set_sched_policy(enum mpthread_sched_policy policy, int priority)
+{
+#if HAVE_POSIX && defined(SCHED_FIFO) && defined(SCHED_RR)
+    int pol = SCHED_OTHER;
+    if (policy == MPTHREAD_SCHED_FIFO)
+        pol = SCHED_FIFO;
+    if (policy == MPTHREAD_SCHED_RR)
+        pol = SCHED_RR;
+    struct sched_param param = {0};
+    if (pol != SCHED_OTHER) {
+        int min = sched_get_priority_min(pol), max = sched_get_priority_max(pol);
+        param.sched_priority =
+            priority < min ? min : priority > max ? max : priority;
+    }
+    return pthread_setschedparam(pthread_self(), pol, &param);
+#else
+    return ENOSYS;
+#endif
+}
+
+int mpthread_set_nice(int nice)
+{
+#ifdef __linux__
+    // On Linux, this affects only the given thread.
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice))
+        return errno;
+    return 0;
+#else
+    return ENOSYS;
+#endif
+}
+
+int mpthread_set_affinity(const int *cpus, int num_cpus)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int n = 0; n < num_cpus; n++) {
+        if (cpus[n] < 0 || cpus[n] >= CPU_SETSIZE)
+            return EINVAL;
+        CPU_SET(cpus[n], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return ENOSYS;
+#endif
+}
@@ -10,4 +10,23 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 // Set thread name (for debuggers).
 void mpthread_set_name(const char *name);
 
+// Set how late the kernel may wake up the calling thread after a timeout,
+// which lets it coalesce wakeups. 0 restores the default. Does nothing if the
+// OS doesn't support it.
+void mpthread_set_timer_slack(int64_t ns);
+
+enum mpthread_sched_policy {
+    MPTHREAD_SCHED_OTHER,   // normal time sharing
+    MPTHREAD_SCHED_FIFO,    // realtime, run until blocking
+    MPTHREAD_SCHED_RR,      // realtime, round robin
+};
+
+// Set the scheduling policy of the calling thread. priority is ignored for
+// MPTHREAD_SCHED_OTHER. All of these return 0 on success, or an errno value.
+int mpthread_set_sched_policy(enum mpthread_sched_policy policy, int priority);
+// Set the nice value of the calling thread only (not the process).
+int mpthread_set_nice(int nice);
+// Restrict the calling thread to the given CPU numbers.
+int mpthread_set_affinity(const int *cpus, int num_cpus);
+
 #endif
@@ -360,6 +360,7 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_core_cb,
                              mpctx, mpctx->encode_lavc_ctx, out_rate,
                              out_format, out_channels);
+    mp_startup_mark(mpctx, "ao-init");
     ao_c->ao = mpctx->ao;
 
     int ao_rate = 0;
@@ -717,9 +718,9 @@ static bool copy_output(struct MPContext *mpctx, struct ao_chain *ao_c,
             return true;
         }
 
-        uint8_t **data = mp_aframe_get_data_ro(ao_c->output_frame);
-        mp_audio_buffer_append(outbuf, (void **)data,
-                               mp_aframe_get_size(ao_c->output_frame));
+        // Usually references the frame if outbuf was empty, instead of
+        // copying it.
+        mp_audio_buffer_append_frame(outbuf, ao_c->output_frame);
         TA_FREEP(&ao_c->output_frame);
     }
     return true;
@@ -0,0 +1,192 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/resource.h>
+#endif
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "filters/filter.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "options/m_property.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/timer.h"
+
+#include "command.h"
+#include "core.h"
+
+// --benchmark-report state.
+struct mp_benchmark {
+    struct mpv_node files;      // MPV_FORMAT_NODE_ARRAY, one map per file
+    int64_t start_time;         // mp_time_us() of the current file's start
+    int64_t playback_time;      // mp_time_us() of its playback start, or 0
+};
+
+// Properties copied into the report for each file (if available).
+static const char *const file_props[] = {
+    "current-vo", "current-ao", "hwdec-current", "video-codec", "audio-codec",
+    "video-params", "audio-params", "duration", "decoder-frame-drop-count",
+    "frame-drop-count", "vo-delayed-frame-count", "mistimed-frame-count",
+    "filter-perf", "vo-passes",
+};
+
+static struct mp_benchmark *get_benchmark(struct MPContext *mpctx)
+{
+    char *file = mpctx->opts->benchmark_report;
+    if (!file || !file[0])
+        return NULL;
+    if (!mpctx->benchmark) {
+        struct mp_benchmark *b = talloc_zero(mpctx, struct mp_benchmark);
+        node_init(&b->files, MPV_FORMAT_NODE_ARRAY, NULL);
+        talloc_steal(b, b->files.u.list);
+        mpctx->benchmark = b;
+    }
+    return mpctx->benchmark;
+}
+
+// Add the value of the given property to the map dst, if it's available.
+static void add_property(struct MPContext *mpctx, struct mpv_node *dst,
+                         const char *name)
+{
+    struct mpv_node val;
+    if (mp_property_do(name, M_PROPERTY_GET_NODE, &val, mpctx) != M_PROPERTY_OK)
+        return;
+    // The values are allocated without parent; chain them to dst.
+    void *ta_parent = dst->u.list;
+    switch (val.format) {
+    case MPV_FORMAT_STRING:     talloc_steal(ta_parent, val.u.string); break;
+    case MPV_FORMAT_NODE_MAP:
+    case MPV_FORMAT_NODE_ARRAY: talloc_steal(ta_parent, val.u.list); break;
+    case MPV_FORMAT_BYTE_ARRAY: talloc_steal(ta_parent, val.u.ba); break;
+    }
+    *node_map_add(dst, name, MPV_FORMAT_NONE) = val;
+}
+
+// Called after the filter root of a new file was created.
+void mp_benchmark_start_file(struct MPContext *mpctx)
+{
+    struct mp_benchmark *b = get_benchmark(mpctx);
+    if (!b)
+        return;
+    b->start_time = mp_time_us();
+    b->playback_time = 0;
+    mpctx->frames_queued = 0;
+    // Enables measuring of the filter process() times.
+    struct mp_filter_perf perf;
+    mp_filter_get_perf(mpctx->filter_root, &perf);
+}
+
+// Called when all decoders were initialized and playback is about to start.
+void mp_benchmark_start_playback(struct MPContext *mpctx)
+{
+    struct mp_benchmark *b = get_benchmark(mpctx);
+    if (!b)
+        return;
+    b->playback_time = mp_time_us();
+}
+
+// Called on the end of a file, before the decoders are destroyed.
+void mp_benchmark_end_file(struct MPContext *mpctx)
+{
+    struct mp_benchmark *b = get_benchmark(mpctx);
+    if (!b || !b->start_time)
+        return;
+
+    int64_t now = mp_time_us();
+    struct mpv_node *f = node_array_add(&b->files, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(f, "filename", mpctx->filename);
+    node_map_add_double(f, "total-time", (now - b->start_time) / 1e6);
+    if (b->playback_time) {
+        double time = (now - b->playback_time) / 1e6;
+        node_map_add_double(f, "load-time",
+                            (b->playback_time - b->start_time) / 1e6);
+        node_map_add_double(f, "playback-time", time);
+        node_map_add_int64(f, "frames", mpctx->frames_queued);
+        if (time > 0)
+            node_map_add_double(f, "fps", mpctx->frames_queued / time);
+    }
+    for (int n = 0; n < MP_ARRAY_SIZE(file_props); n++)
+        add_property(mpctx, f, file_props[n]);
+
+    b->start_time = 0;
+}
+
+// Write the report to the --benchmark-report file. Called on exit.
+void mp_benchmark_write_report(struct MPContext *mpctx)
+{
+    struct mp_benchmark *b = mpctx->benchmark;
+    if (!b)
+        return;
+
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_string(&root, "version", mpv_version);
+    node_map_add_flag(&root, "untimed", mpctx->opts->untimed);
+    add_property(mpctx, &root, "startup-trace");
+#if HAVE_POSIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        int64_t rss = usage.ru_maxrss;  // bytes
+#else
+        int64_t rss = usage.ru_maxrss * (int64_t)1024; // KiB
+#endif
+        node_map_add_int64(&root, "peak-rss", rss);
+        struct timeval u = usage.ru_utime, s = usage.ru_stime;
+        node_map_add_double(&root, "user-cpu-time", u.tv_sec + u.tv_usec / 1e6);
+        node_map_add_double(&root, "system-cpu-time",
+                            s.tv_sec + s.tv_usec / 1e6);
+    }
+#endif
+    talloc_steal(root.u.list, b->files.u.list);
+    *node_map_add(&root, "files", MPV_FORMAT_NONE) = b->files;
+
+    char *text = talloc_strdup(NULL, "");
+    json_write_pretty(&text, &root);
+    text = talloc_strdup_append(text, "\n");
+
+    char *file = mpctx->opts->benchmark_report;
+    if (file && strcmp(file, "-") == 0) {
+        fputs(text, stdout);
+        fflush(stdout);
+    } else if (file && file[0]) {
+        char *path = mp_get_user_path(text, mpctx->global, file);
+        FILE *fp = fopen(path, "wb");
+        bool ok = fp && fputs(text, fp) >= 0;
+        if (fp)
+            ok = fclose(fp) == 0 && ok;
+        if (ok) {
+            MP_VERBOSE(mpctx, "Wrote benchmark report to %s\n", path);
+        } else {
+            MP_ERR(mpctx, "Could not write benchmark report to %s\n", path);
+        }
+    }
+
+    talloc_free(text);
+    talloc_free(root.u.list);
+    TA_FREEP(&mpctx->benchmark);
+}
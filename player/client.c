@@ -31,12 +31,14 @@
 #include "input/cmd.h"
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
+#include "misc/node.h"
 #include "misc/rendezvous.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/m_property.h"
 #include "options/path.h"
 #include "options/parse_configfile.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "osdep/io.h"
@@ -75,10 +77,30 @@ struct mp_client_api {
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
 
+    // Incremented on every property change notification. Property values
+    // retrieved for observers are shared between them while it stays the same.
+    uint64_t property_gen;
+    struct cached_property **cached_props;
+    int num_cached_props;
+
+    // Number of change notifications per event ID, and per property ID (as
+    // returned by mp_get_property_id()). See mp_client_property_version().
+    uint64_t event_gens[64];
+    uint64_t *prop_gens;
+    int num_prop_gens;
+
     struct mpv_render_context *render_context;
     struct mpv_opengl_cb_context *gl_cb_ctx;
 };
 
+struct cached_property {
+    char *name;
+    mpv_format format;
+    uint64_t gen;           // mp_client_api.property_gen at retrieval
+    int status;             // getproperty_request.status
+    union m_option_value value;
+};
+
 struct observe_property {
     char *name;
     int id;                 // ==mp_get_property_id(name)
@@ -91,9 +113,18 @@ struct observe_property {
     bool dead;              // property unobserved while retrieving value
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
+    int64_t interval;       // see mpv_set_observe_interval()
+    int64_t last_update;    // time the value was last retrieved
+    bool delta;             // see mpv_set_observe_delta()
+    struct mpv_node delta_node; // references user_value
     struct mpv_handle *client;
 };
 
+struct event_slot {
+    atomic_uint seq;        // position + 1 if the event can be read
+    mpv_event event;
+};
+
 struct mpv_handle {
     // -- immmutable
     char name[MAX_CLIENT_NAME];
@@ -118,22 +149,36 @@ struct mpv_handle {
 
     // -- protected by lock
 
-    uint64_t event_mask;
     bool queued_wakeup;
     int suspend_count;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
-    int first_event;        // events[first_event] is the first readable event
-    int num_events;         // number of readable events
-    int reserved_events;    // number of entries reserved for replies
-    bool choked;            // recovering from queue overflow
+    // -- atomic, written by any thread without holding lock
+
+    atomic_ullong event_mask;
+    atomic_ullong pending_property_events; // event mask for properties
+
+    // Event ring buffer. Events are appended without taking lock, so that
+    // sending events never waits for the client. Only mpv_wait_event() (with
+    // lock held) and the destructor read from it.
+    struct event_slot *events; // ringbuffer of max_events entries
+    int max_events;         // allocated number of entries (power of 2)
+    atomic_uint write_pos;  // position of the next event appended
+    unsigned read_pos;      // position of the next event read (under lock)
+    atomic_int used_events; // number of queued events + reserved_events
+    atomic_int reserved_events; // number of entries reserved for replies
+    atomic_bool choked;     // recovering from queue overflow
+
+    // -- protected by lock
+
+    struct m_property_ref **resolved_props; // see mpv_resolve_property()
+    int num_resolved_props;
 
     struct observe_property **properties;
     int num_properties;
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
-    uint64_t property_event_masks; // or-ed together event masks of all properties
+    atomic_ullong property_event_masks; // event masks of all properties or-ed
+    int64_t observe_deadline; // next end of an observe interval, or 0
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     bool is_weak;           // can not keep core alive on its own
@@ -141,6 +186,7 @@ struct mpv_handle {
 };
 
 static bool gen_log_message_event(struct mpv_handle *ctx);
+static bool read_event(struct mpv_handle *ctx, struct mpv_event *event);
 static bool gen_property_change_event(struct mpv_handle *ctx);
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask);
 
@@ -238,7 +284,7 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         return NULL;
     }
 
-    int num_events = 1000;
+    int num_events = 1024;
 
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
     *client = (struct mpv_handle){
@@ -246,11 +292,14 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .mpctx = clients->mpctx,
         .clients = clients,
         .cur_event = talloc_zero(client, struct mpv_event),
-        .events = talloc_array(client, mpv_event, num_events),
+        .events = talloc_zero_array(client, struct event_slot, num_events),
         .max_events = num_events,
-        .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
+        // exclude internal events
+        .event_mask = ATOMIC_VAR_INIT((1ULL << INTERNAL_EVENT_BASE) - 1),
         .wakeup_pipe = {-1, -1},
     };
+    for (int n = 0; n < num_events; n++)
+        atomic_store(&client->events[n].seq, n);
     pthread_mutex_init(&client->lock, NULL);
     pthread_mutex_init(&client->wakeup_lock, NULL);
     pthread_cond_init(&client->wakeup, NULL);
@@ -365,7 +414,7 @@ static void unlock_core(mpv_handle *ctx)
 void mpv_wait_async_requests(mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->lock);
-    while (ctx->reserved_events || ctx->properties_updating)
+    while (atomic_load(&ctx->reserved_events) || ctx->properties_updating)
         wait_wakeup(ctx, INT64_MAX);
     pthread_mutex_unlock(&ctx->lock);
 }
@@ -401,11 +450,9 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
-            while (ctx->num_events) {
-                talloc_free(ctx->events[ctx->first_event].data);
-                ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-                ctx->num_events--;
-            }
+            struct mpv_event ev;
+            while (read_event(ctx, &ev))
+                talloc_free(ev.data);
             mp_msg_log_buffer_destroy(ctx->messages);
             pthread_cond_destroy(&ctx->wakeup);
             pthread_mutex_destroy(&ctx->wakeup_lock);
@@ -609,56 +656,93 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Take an entry of the ring buffer for an event or a reservation. Fails if the
+// ring buffer is full.
+static bool claim_event_entry(struct mpv_handle *ctx)
+{
+    int used = atomic_load(&ctx->used_events);
+    while (used < ctx->max_events) {
+        if (atomic_compare_exchange_strong(&ctx->used_events, &used, used + 1))
+            return true;
+    }
+    return false;
+}
+
+// Write an event into a claimed entry. Can be called by multiple threads at
+// once. Positions are handed out in order, but the reader waits for each
+// position to be written, so events from different threads may be delayed
+// until the ones before them are written.
+static void write_event(struct mpv_handle *ctx, struct mpv_event event)
+{
+    unsigned pos = atomic_fetch_add(&ctx->write_pos, 1);
+    struct event_slot *slot = &ctx->events[pos & (ctx->max_events - 1)];
+    // The claimed entry guarantees that the reader is done with the slot.
+    assert(atomic_load(&slot->seq) == pos);
+    slot->event = event;
+    atomic_store(&slot->seq, pos + 1);
+    if (event.event_id == MPV_EVENT_SHUTDOWN)
+        atomic_fetch_and(&ctx->event_mask, ~(1ULL << MPV_EVENT_SHUTDOWN));
+    wakeup_client(ctx);
+}
+
+// Called with ctx->lock held (or on destruction).
+static bool read_event(struct mpv_handle *ctx, struct mpv_event *event)
+{
+    unsigned pos = ctx->read_pos;
+    struct event_slot *slot = &ctx->events[pos & (ctx->max_events - 1)];
+    if (atomic_load(&slot->seq) != pos + 1)
+        return false;
+    *event = slot->event;
+    atomic_store(&slot->seq, pos + ctx->max_events);
+    ctx->read_pos = pos + 1;
+    atomic_fetch_add(&ctx->used_events, -1);
+    return true;
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
 // Returns an error code if the buffer is full.
 static int reserve_reply(struct mpv_handle *ctx)
 {
-    int res = MPV_ERROR_EVENT_QUEUE_FULL;
-    pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
-        ctx->reserved_events++;
-        res = 0;
-    }
-    pthread_mutex_unlock(&ctx->lock);
-    return res;
+    if (atomic_load(&ctx->choked) || !claim_event_entry(ctx))
+        return MPV_ERROR_EVENT_QUEUE_FULL;
+    atomic_fetch_add(&ctx->reserved_events, 1);
+    return 0;
 }
 
 static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
+    if (!claim_event_entry(ctx))
         return -1;
     if (copy)
         dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
-    wakeup_client(ctx);
-    if (event.event_id == MPV_EVENT_SHUTDOWN)
-        ctx->event_mask &= ctx->event_mask & ~(1ULL << MPV_EVENT_SHUTDOWN);
+    write_event(ctx, event);
     return 0;
 }
 
+// Called with mp_client_api.lock held. Does not take ctx->lock.
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
-    pthread_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
-    if (ctx->property_event_masks & mask)
-        notify_property_events(ctx, mask);
+    if (atomic_load(&ctx->property_event_masks) & mask) {
+        // Applied by mpv_wait_event() on the client's thread.
+        ctx->clients->property_gen++;
+        atomic_fetch_or(&ctx->pending_property_events, mask);
+        wakeup_client(ctx);
+    }
     int r;
-    if (!(ctx->event_mask & mask)) {
+    if (!(atomic_load(&ctx->event_mask) & mask)) {
         r = 0;
-    } else if (ctx->choked) {
+    } else if (atomic_load(&ctx->choked)) {
         r = -1;
     } else {
         r = append_event(ctx, *event, copy);
         if (r < 0) {
             MP_ERR(ctx, "Too many events queued.\n");
-            ctx->choked = true;
+            atomic_store(&ctx->choked, true);
         }
     }
-    pthread_mutex_unlock(&ctx->lock);
     return r;
 }
 
@@ -668,13 +752,10 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
                        struct mpv_event *event)
 {
     event->reply_userdata = userdata;
-    pthread_mutex_lock(&ctx->lock);
     // If this fails, reserve_reply() probably wasn't called.
-    assert(ctx->reserved_events > 0);
-    ctx->reserved_events--;
-    if (append_event(ctx, *event, false) < 0)
-        abort(); // not reached
-    pthread_mutex_unlock(&ctx->lock);
+    int reserved = atomic_fetch_add(&ctx->reserved_events, -1);
+    assert(reserved > 0);
+    write_event(ctx, *event);
 }
 
 static void status_reply(struct mpv_handle *ctx, int event,
@@ -699,7 +780,8 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
         for (int n = 0; n < clients->num_clients; n++) {
             struct mpv_handle *ctx = clients->clients[n];
             pthread_mutex_lock(&ctx->lock);
-            clients->event_masks |= ctx->event_mask | ctx->property_event_masks;
+            clients->event_masks |= atomic_load(&ctx->event_mask) |
+                                    atomic_load(&ctx->property_event_masks);
             pthread_mutex_unlock(&ctx->lock);
         }
     }
@@ -716,6 +798,9 @@ void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data)
 
     pthread_mutex_lock(&clients->lock);
 
+    if (event >= 0 && event < MP_ARRAY_SIZE(clients->event_gens))
+        clients->event_gens[event]++;
+
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_event event_data = {
             .event_id = event,
@@ -787,7 +872,11 @@ int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable)
     assert(event < (int)INTERNAL_EVENT_BASE); // excluded above; they have no name
     pthread_mutex_lock(&ctx->lock);
     uint64_t bit = 1ULL << event;
-    ctx->event_mask = enable ? ctx->event_mask | bit : ctx->event_mask & ~bit;
+    if (enable) {
+        atomic_fetch_or(&ctx->event_mask, bit);
+    } else {
+        atomic_fetch_and(&ctx->event_mask, ~bit);
+    }
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return 0;
@@ -814,9 +903,14 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
     while (1) {
         if (ctx->queued_wakeup)
             deadline = 0;
+        uint64_t pending = atomic_exchange(&ctx->pending_property_events, 0);
+        if (pending)
+            notify_property_events(ctx, pending);
         // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
+        if (atomic_load(&ctx->choked) &&
+            ctx->read_pos == atomic_load(&ctx->write_pos))
+        {
+            atomic_store(&ctx->choked, false);
             event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
             break;
         }
@@ -825,10 +919,7 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
             MP_ERR(ctx, "attempting to wait while core is suspended");
             break;
         }
-        if (ctx->num_events) {
-            *event = ctx->events[ctx->first_event];
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
+        if (read_event(ctx, event)) {
             talloc_steal(event, event->data);
             break;
         }
@@ -838,9 +929,15 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         // Pop item from message queue, and return as event.
         if (gen_log_message_event(ctx))
             break;
-        int r = wait_wakeup(ctx, deadline);
-        if (r == ETIMEDOUT)
-            break;
+        int64_t wait_until = deadline;
+        if (ctx->observe_deadline && ctx->observe_deadline < wait_until)
+            wait_until = ctx->observe_deadline;
+        int r = wait_wakeup(ctx, wait_until);
+        if (r == ETIMEDOUT) {
+            if (wait_until == deadline)
+                break;
+            ctx->observe_deadline = 0;
+        }
     }
     ctx->queued_wakeup = false;
 
@@ -1126,9 +1223,18 @@ static int translate_property_error(int errc)
     }
 }
 
+// Use the already resolved property if ref is set.
+static int property_do(const char *name, const struct m_property_ref *ref,
+                       int action, void *val, struct MPContext *mpctx)
+{
+    return ref ? mp_property_do_ref(ref, action, val, mpctx)
+               : mp_property_do(name, action, val, mpctx);
+}
+
 struct setproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_ref *ref;
     int format;
     void *data;
     int status;
@@ -1151,7 +1257,8 @@ static void setproperty_fn(void *arg)
         node = &tmp;
     }
 
-    int err = mp_property_do(req->name, M_PROPERTY_SET_NODE, node, req->mpctx);
+    int err = property_do(req->name, req->ref, M_PROPERTY_SET_NODE, node,
+                          req->mpctx);
 
     req->status = translate_property_error(err);
 
@@ -1229,6 +1336,7 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_ref *ref;
     mpv_format format;
     void *data;
     int status;
@@ -1254,11 +1362,13 @@ static void getproperty_fn(void *arg)
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = property_do(req->name, req->ref, M_PROPERTY_PRINT, data,
+                          req->mpctx);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = property_do(req->name, req->ref, M_PROPERTY_GET_STRING, &s,
+                          req->mpctx);
         if (err == M_PROPERTY_OK)
             *(char **)data = s;
         break;
@@ -1268,13 +1378,14 @@ static void getproperty_fn(void *arg)
     case MPV_FORMAT_INT64:
     case MPV_FORMAT_DOUBLE: {
         struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
+        err = property_do(req->name, req->ref, M_PROPERTY_GET_NODE, &node,
+                          req->mpctx);
         if (err == M_PROPERTY_NOT_IMPLEMENTED) {
             // Go through explicit string conversion. Same reasoning as on the
             // GET code path.
             char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
+            err = property_do(req->name, req->ref, M_PROPERTY_GET_STRING, &s,
+                              req->mpctx);
             if (err != M_PROPERTY_OK)
                 break;
             node.format = MPV_FORMAT_STRING;
@@ -1336,6 +1447,230 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     return req.status;
 }
 
+int mpv_resolve_property(mpv_handle *ctx, const char *name, int64_t *id)
+{
+    struct m_property_ref *ref = talloc_ptrtype(NULL, ref);
+    char *name_copy = talloc_strdup(ref, name);
+    if (!mp_property_resolve(ctx->mpctx, name_copy, ref)) {
+        talloc_free(ref);
+        return MPV_ERROR_PROPERTY_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    MP_TARRAY_APPEND(ctx, ctx->resolved_props, ctx->num_resolved_props,
+                     talloc_steal(ctx, ref));
+    *id = ctx->num_resolved_props;
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static const struct m_property_ref *get_resolved_property(mpv_handle *ctx,
+                                                          int64_t id)
+{
+    const struct m_property_ref *ref = NULL;
+    pthread_mutex_lock(&ctx->lock);
+    if (id >= 1 && id <= ctx->num_resolved_props)
+        ref = ctx->resolved_props[id - 1];
+    pthread_mutex_unlock(&ctx->lock);
+    return ref;
+}
+
+int mpv_get_resolved_property(mpv_handle *ctx, int64_t id, mpv_format format,
+                              void *data)
+{
+    const struct m_property_ref *ref = get_resolved_property(ctx, id);
+    if (!ref)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!data)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (!get_mp_type_get(format))
+        return MPV_ERROR_PROPERTY_FORMAT;
+
+    struct getproperty_request req = {
+        .mpctx = ctx->mpctx,
+        .name = ref->name,
+        .ref = ref,
+        .format = format,
+        .data = data,
+    };
+    run_locked(ctx, getproperty_fn, &req);
+    return req.status;
+}
+
+int mpv_set_resolved_property(mpv_handle *ctx, int64_t id, mpv_format format,
+                              void *data)
+{
+    const struct m_property_ref *ref = get_resolved_property(ctx, id);
+    if (!ref)
+        return MPV_ERROR_INVALID_PARAMETER;
+    // Before initialization, this goes through the option code path.
+    if (!ctx->mpctx->initialized)
+        return mpv_set_property(ctx, ref->name, format, data);
+    if (!get_mp_type(format))
+        return MPV_ERROR_PROPERTY_FORMAT;
+
+    struct setproperty_request req = {
+        .mpctx = ctx->mpctx,
+        .name = ref->name,
+        .ref = ref,
+        .format = format,
+        .data = data,
+    };
+    run_locked(ctx, setproperty_fn, &req);
+    return req.status;
+}
+
+enum batch_op_type {
+    BATCH_COMMAND,
+    BATCH_GET_PROPERTY,
+    BATCH_SET_PROPERTY,
+};
+
+struct batch_op {
+    enum batch_op_type type;
+    const char *name;       // for properties
+    mpv_node *value;        // for BATCH_SET_PROPERTY
+    struct mp_cmd *cmd;     // for BATCH_COMMAND (NULL if parsing failed)
+    int status;
+    mpv_node data;
+};
+
+struct batch_request {
+    struct MPContext *mpctx;
+    struct batch_op *ops;
+    int num_ops;
+};
+
+static void batch_fn(void *arg)
+{
+    struct batch_request *req = arg;
+    for (int n = 0; n < req->num_ops; n++) {
+        struct batch_op *op = &req->ops[n];
+        switch (op->type) {
+        case BATCH_COMMAND: {
+            if (!op->cmd)
+                break;
+            int r = run_command(req->mpctx, op->cmd, &op->data);
+            op->status = r >= 0 ? 0 : MPV_ERROR_COMMAND;
+            TA_FREEP(&op->cmd);
+            break;
+        }
+        case BATCH_GET_PROPERTY: {
+            struct getproperty_request preq = {
+                .mpctx = req->mpctx,
+                .name = op->name,
+                .format = MPV_FORMAT_NODE,
+                .data = &op->data,
+            };
+            getproperty_fn(&preq);
+            op->status = preq.status;
+            break;
+        }
+        case BATCH_SET_PROPERTY: {
+            struct setproperty_request preq = {
+                .mpctx = req->mpctx,
+                .name = op->name,
+                .format = MPV_FORMAT_NODE,
+                .data = op->value,
+            };
+            setproperty_fn(&preq);
+            op->status = preq.status;
+            break;
+        }
+        }
+    }
+}
+
+// Check for the pseudo commands ["get_property", name] and
+// ["set_property", name, value].
+static void parse_batch_op(mpv_handle *ctx, mpv_node *node, struct batch_op *op)
+{
+    *op = (struct batch_op){ .status = MPV_ERROR_INVALID_PARAMETER };
+    if (node->format == MPV_FORMAT_NODE_ARRAY && node->u.list->num >= 2 &&
+        node->u.list->values[0].format == MPV_FORMAT_STRING &&
+        node->u.list->values[1].format == MPV_FORMAT_STRING)
+    {
+        const char *cmd = node->u.list->values[0].u.string;
+        int num = node->u.list->num;
+        if (strcmp(cmd, "get_property") == 0) {
+            if (num == 2) {
+                op->type = BATCH_GET_PROPERTY;
+                op->name = node->u.list->values[1].u.string;
+            }
+            return;
+        }
+        if (strcmp(cmd, "set_property") == 0) {
+            if (num == 3) {
+                op->type = BATCH_SET_PROPERTY;
+                op->name = node->u.list->values[1].u.string;
+                op->value = &node->u.list->values[2];
+            }
+            return;
+        }
+    }
+    op->type = BATCH_COMMAND;
+    op->cmd = mp_input_parse_cmd_node(ctx->log, node);
+    if (op->cmd) {
+        op->cmd->sender = ctx->name;
+        if (mp_input_is_abort_cmd(op->cmd))
+            mp_abort_playback_async(ctx->mpctx);
+    }
+}
+
+// Move the allocation of src into the node list of dst, which must be a map.
+static void node_map_add_steal(struct mpv_node *dst, const char *key,
+                               struct mpv_node *src)
+{
+    struct mpv_node *entry = node_map_add(dst, key, MPV_FORMAT_NONE);
+    *entry = *src;
+    switch (src->format) {
+    case MPV_FORMAT_STRING:
+        talloc_steal(dst->u.list, src->u.string);
+        break;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP:
+        talloc_steal(dst->u.list, src->u.list);
+        break;
+    case MPV_FORMAT_BYTE_ARRAY:
+        talloc_steal(dst->u.list, src->u.ba);
+        break;
+    }
+}
+
+int mpv_command_batch(mpv_handle *ctx, mpv_node *ops, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!ops || ops->format != MPV_FORMAT_NODE_ARRAY || !result)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct batch_request req = {
+        .mpctx = ctx->mpctx,
+        .num_ops = ops->u.list->num,
+    };
+    req.ops = talloc_zero_array(NULL, struct batch_op, req.num_ops);
+    for (int n = 0; n < req.num_ops; n++)
+        parse_batch_op(ctx, &ops->u.list->values[n], &req.ops[n]);
+
+    run_locked(ctx, batch_fn, &req);
+
+    node_init(result, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < req.num_ops; n++) {
+        struct batch_op *op = &req.ops[n];
+        struct mpv_node *entry = node_array_add(result, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(entry, "error", op->status);
+        if (op->status >= 0 && op->data.format != MPV_FORMAT_NONE)
+            node_map_add_steal(entry, "data", &op->data);
+        else
+            mpv_free_node_contents(&op->data);
+        talloc_free(op->cmd);
+    }
+    talloc_free(req.ops);
+    return 0;
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -1377,6 +1712,7 @@ static void property_free(void *p)
         m_option_free(type, &prop->new_value);
         m_option_free(type, &prop->user_value);
     }
+    talloc_free(prop->delta_node.u.list);
 }
 
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
@@ -1402,7 +1738,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .need_new_value = true,
     };
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
-    ctx->property_event_masks |= prop->event_mask;
+    atomic_fetch_or(&ctx->property_event_masks, prop->event_mask);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1412,7 +1748,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     pthread_mutex_lock(&ctx->lock);
-    ctx->property_event_masks = 0;
+    uint64_t masks = 0;
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
         struct observe_property *prop = ctx->properties[n];
@@ -1430,14 +1766,77 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
             count++;
         }
         if (!prop->dead)
-            ctx->property_event_masks |= prop->event_mask;
+            masks |= prop->event_mask;
     }
+    atomic_store(&ctx->property_event_masks, masks);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return count;
 }
 
+int mpv_set_observe_interval(mpv_handle *ctx, uint64_t reply_userdata,
+                             double interval)
+{
+    if (!(interval >= 0))
+        return MPV_ERROR_INVALID_PARAMETER;
+    pthread_mutex_lock(&ctx->lock);
+    int count = 0;
+    for (int n = 0; n < ctx->num_properties; n++) {
+        struct observe_property *prop = ctx->properties[n];
+        if (prop->reply_id == reply_userdata) {
+            prop->interval = MPMIN(interval, 1e6) * 1e6;
+            count++;
+        }
+    }
+    ctx->lowest_changed = 0;
+    wakeup_client(ctx);
+    pthread_mutex_unlock(&ctx->lock);
+    return count;
+}
+
+int mpv_set_observe_delta(mpv_handle *ctx, uint64_t reply_userdata, int flag)
+{
+    pthread_mutex_lock(&ctx->lock);
+    int count = 0;
+    for (int n = 0; n < ctx->num_properties; n++) {
+        struct observe_property *prop = ctx->properties[n];
+        if (prop->reply_id == reply_userdata &&
+            prop->format == MPV_FORMAT_NODE)
+        {
+            prop->delta = flag;
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return count;
+}
+
+// Wake up clients whose delayed property updates are due, and make the
+// playloop wake up for the next one.
+void mp_client_update_observe_timers(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    int64_t now = mp_time_us();
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *client = clients->clients[n];
+        pthread_mutex_lock(&client->lock);
+        if (client->observe_deadline) {
+            if (now >= client->observe_deadline) {
+                client->observe_deadline = 0;
+                client->lowest_changed = 0;
+                wakeup_client(client);
+            } else {
+                mp_set_timeout(mpctx, (client->observe_deadline - now) / 1e6);
+            }
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    pthread_mutex_unlock(&clients->lock);
+}
+
 static void mark_property_changed(struct mpv_handle *client, int index)
 {
     struct observe_property *prop = client->properties[index];
@@ -1454,6 +1853,19 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 
     pthread_mutex_lock(&clients->lock);
 
+    clients->property_gen++;
+
+    if (id >= 0) {
+        if (id >= clients->num_prop_gens) {
+            int num = id + 1;
+            MP_TARRAY_GROW(clients, clients->prop_gens, num);
+            for (int n = clients->num_prop_gens; n < num; n++)
+                clients->prop_gens[n] = 0;
+            clients->num_prop_gens = num;
+        }
+        clients->prop_gens[id]++;
+    }
+
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_handle *client = clients->clients[n];
         pthread_mutex_lock(&client->lock);
@@ -1469,6 +1881,32 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
     pthread_mutex_unlock(&clients->lock);
 }
 
+// Return a number that changes whenever a change notification for the given
+// property is sent, using the same mechanism as mpv_observe_property(). So if
+// the value is unchanged, the property value is unchanged too (as far as the
+// property supports change notifications). Must be called before retrieving
+// the property value. Returns 0 if the property is unknown.
+uint64_t mp_client_property_version(struct mpv_handle *ctx, const char *name)
+{
+    struct mp_client_api *clients = ctx->clients;
+    int id = mp_get_property_id(ctx->mpctx, name);
+    if (id < 0)
+        return 0;
+    uint64_t mask = mp_get_property_event_mask(name);
+
+    pthread_mutex_lock(&clients->lock);
+    uint64_t version = 1;
+    if (id < clients->num_prop_gens)
+        version += clients->prop_gens[id];
+    for (int n = 0; n < MP_ARRAY_SIZE(clients->event_gens); n++) {
+        if (mask & (1ULL << n))
+            version += clients->event_gens[n];
+    }
+    pthread_mutex_unlock(&clients->lock);
+
+    return version;
+}
+
 // Mark properties as changed in reaction to specific events.
 // Called with ctx->lock held.
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
@@ -1481,28 +1919,91 @@ static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
         wakeup_client(ctx);
 }
 
-static void update_prop(void *p)
+static void cached_property_free(void *p)
 {
-    struct observe_property *prop = p;
-    struct mpv_handle *ctx = prop->client;
+    struct cached_property *c = p;
+    if (c->name)
+        m_option_free(get_mp_type_get(c->format), &c->value);
+}
 
+// Retrieve the value for an observed property. If another observer already
+// got it since the last property change notification, copy its value instead.
+// Called on the playback thread, without locks held.
+static int get_observed_value(struct observe_property *prop, void *val)
+{
+    struct mp_client_api *clients = prop->client->clients;
     const struct m_option *type = get_mp_type_get(prop->format);
-    union m_option_value val = {0};
+
+    pthread_mutex_lock(&clients->lock);
+    uint64_t gen = clients->property_gen;
+    for (int n = 0; n < clients->num_cached_props; n++) {
+        struct cached_property *c = clients->cached_props[n];
+        if (c->gen == gen && c->format == prop->format &&
+            strcmp(c->name, prop->name) == 0)
+        {
+            int status = c->status;
+            if (status >= 0)
+                m_option_copy(type, val, &c->value);
+            pthread_mutex_unlock(&clients->lock);
+            return status;
+        }
+    }
+    pthread_mutex_unlock(&clients->lock);
 
     struct getproperty_request req = {
-        .mpctx = ctx->mpctx,
+        .mpctx = clients->mpctx,
         .name = prop->name,
         .format = prop->format,
-        .data = &val,
+        .data = val,
     };
-
     getproperty_fn(&req);
 
+    pthread_mutex_lock(&clients->lock);
+    // Reuse an entry from an older generation, if possible.
+    struct cached_property *c = NULL;
+    for (int n = 0; n < clients->num_cached_props; n++) {
+        if (clients->cached_props[n]->gen != clients->property_gen) {
+            c = clients->cached_props[n];
+            break;
+        }
+    }
+    if (!c) {
+        c = talloc_zero(clients, struct cached_property);
+        talloc_set_destructor(c, cached_property_free);
+        MP_TARRAY_APPEND(clients, clients->cached_props,
+                         clients->num_cached_props, c);
+    }
+    if (c->name)
+        m_option_free(get_mp_type_get(c->format), &c->value);
+    talloc_free(c->name);
+    *c = (struct cached_property){
+        .name = talloc_strdup(c, prop->name),
+        .format = prop->format,
+        .gen = gen,
+        .status = req.status,
+    };
+    if (req.status >= 0)
+        m_option_copy(type, &c->value, val);
+    pthread_mutex_unlock(&clients->lock);
+
+    return req.status;
+}
+
+static void update_prop(void *p)
+{
+    struct observe_property *prop = p;
+    struct mpv_handle *ctx = prop->client;
+
+    const struct m_option *type = get_mp_type_get(prop->format);
+    union m_option_value val = {0};
+
+    int status = get_observed_value(prop, &val);
+
     pthread_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
     prop->updating = false;
     m_option_free(type, &prop->new_value);
-    prop->new_value_valid = req.status >= 0;
+    prop->new_value_valid = status >= 0;
     if (prop->new_value_valid)
         memcpy(&prop->new_value, &val, type->type->size);
     if (prop->user_value_valid != prop->new_value_valid) {
@@ -1517,18 +2018,101 @@ static void update_prop(void *p)
     pthread_mutex_unlock(&ctx->lock);
 }
 
+// Set dst to the update from old (NULL if none) to new, as described for
+// mpv_set_observe_delta(). dst references new (except for removed keys).
+static void make_node_delta(struct mpv_node *dst, struct mpv_node *old,
+                            struct mpv_node *new)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+
+    bool is_obj = new->format == MPV_FORMAT_NODE_MAP;
+    if (!old || old->format != new->format ||
+        (!is_obj && new->format != MPV_FORMAT_NODE_ARRAY))
+        goto full;
+
+    struct mpv_node_list *old_list = old->u.list, *new_list = new->u.list;
+    struct mpv_node changed, removed;
+    node_init(&changed, is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY,
+              dst);
+    node_init(&removed, MPV_FORMAT_NODE_ARRAY, dst);
+    int num_changed = 0;
+
+    for (int n = 0; n < new_list->num; n++) {
+        struct mpv_node *val = &new_list->values[n];
+        struct mpv_node *prev = NULL;
+        if (is_obj) {
+            prev = node_map_get(old, new_list->keys[n]);
+        } else if (n < old_list->num) {
+            prev = &old_list->values[n];
+        }
+        if (prev && compare_value(prev, val, MPV_FORMAT_NODE))
+            continue;
+        num_changed++;
+        if (is_obj) {
+            *node_map_add(&changed, new_list->keys[n], MPV_FORMAT_NONE) = *val;
+        } else {
+            struct mpv_node *pair =
+                node_array_add(&changed, MPV_FORMAT_NODE_ARRAY);
+            node_array_add(pair, MPV_FORMAT_INT64)->u.int64 = n;
+            *node_array_add(pair, MPV_FORMAT_NONE) = *val;
+        }
+    }
+
+    if (is_obj) {
+        for (int n = 0; n < old_list->num; n++) {
+            if (node_map_get(new, old_list->keys[n]))
+                continue;
+            num_changed++;
+            struct mpv_node *key = node_array_add(&removed, MPV_FORMAT_NONE);
+            key->format = MPV_FORMAT_STRING;
+            key->u.string = talloc_strdup(removed.u.list, old_list->keys[n]);
+        }
+    }
+
+    // Not worth it if most of the value changed.
+    if (num_changed * 2 > new_list->num && num_changed > 1)
+        goto full;
+
+    if (is_obj) {
+        *node_map_add(dst, "changed", MPV_FORMAT_NONE) = changed;
+        *node_map_add(dst, "removed", MPV_FORMAT_NONE) = removed;
+    } else {
+        node_map_add_int64(dst, "size", new_list->num);
+        *node_map_add(dst, "changed", MPV_FORMAT_NONE) = changed;
+    }
+    return;
+
+full:
+    talloc_free(dst->u.list);
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    *node_map_add(dst, "value", MPV_FORMAT_NONE) = *new;
+}
+
 // Set ctx->cur_event to a generated property change event, if there is any
 // outstanding property.
 static bool gen_property_change_event(struct mpv_handle *ctx)
 {
     if (!ctx->mpctx->initialized)
         return false;
+    int64_t now = mp_time_us();
     int start = ctx->lowest_changed;
     ctx->lowest_changed = ctx->num_properties;
     for (int n = start; n < ctx->num_properties; n++) {
         struct observe_property *prop = ctx->properties[n];
         if ((prop->changed || prop->updating) && n < ctx->lowest_changed)
             ctx->lowest_changed = n;
+        if (prop->changed && (prop->need_new_value || !prop->format)) {
+            // Starting a new update; delay it if it's too soon.
+            int64_t next = prop->last_update + prop->interval;
+            if (prop->interval > 0 && now < next) {
+                if (!ctx->observe_deadline || next < ctx->observe_deadline) {
+                    ctx->observe_deadline = next;
+                    mp_wakeup_core(ctx->mpctx);
+                }
+                continue;
+            }
+            prop->last_update = now;
+        }
         if (prop->changed) {
             bool get_value = prop->need_new_value;
             prop->need_new_value = false;
@@ -1539,6 +2123,9 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
                 mp_dispatch_enqueue(ctx->mpctx->dispatch, update_prop, prop);
             } else {
                 const struct m_option *type = get_mp_type_get(prop->format);
+                union m_option_value old = prop->user_value;
+                bool old_valid = prop->user_value_valid;
+                prop->user_value = (union m_option_value){0};
                 prop->user_value_valid = prop->new_value_valid;
                 if (prop->new_value_valid)
                     m_option_copy(type, &prop->user_value, &prop->new_value);
@@ -1548,6 +2135,15 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
                 };
                 if (prop->user_value_valid)
                     ctx->cur_property_event.data = &prop->user_value;
+                if (prop->user_value_valid && prop->delta) {
+                    talloc_free(prop->delta_node.u.list);
+                    make_node_delta(&prop->delta_node,
+                                    old_valid ? (void *)&old : NULL,
+                                    (void *)&prop->user_value);
+                    ctx->cur_property_event.data = &prop->delta_node;
+                }
+                if (type)
+                    m_option_free(type, &old);
                 *ctx->cur_event = (struct mpv_event){
                     .event_id = MPV_EVENT_PROPERTY_CHANGE,
                     .reply_userdata = prop->reply_id,
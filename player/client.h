@@ -30,6 +30,8 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 bool mp_client_event_is_registered(struct MPContext *mpctx, int event);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+uint64_t mp_client_property_version(struct mpv_handle *ctx, const char *name);
+void mp_client_update_observe_timers(struct MPContext *mpctx);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 void mp_client_set_weak(struct mpv_handle *ctx);
@@ -34,9 +34,11 @@
 #include "client.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
+#include "common/encode.h"
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "filters/f_decoder_wrapper.h"
+#include "filters/f_output_chain.h"
 #include "command.h"
 #include "osdep/timer.h"
 #include "common/common.h"
@@ -46,6 +48,7 @@
 #include "demux/demux.h"
 #include "demux/stheader.h"
 #include "common/playlist.h"
+#include "common/trace.h"
 #include "sub/osd.h"
 #include "sub/dec_sub.h"
 #include "options/m_option.h"
@@ -74,6 +77,7 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    struct m_property_list property_index; // indexes properties
 
     bool is_idle;
 
@@ -90,6 +94,7 @@ struct command_ctx {
     // bitmap list can be manipulated without additional synchronization.
     struct sub_bitmaps overlay_osd[2];
     int overlay_osd_current;
+    bool overlay_repack[2]; // overlay_osd[n] needs to be packed from scratch
     struct bitmap_packer *overlay_packer;
 
     struct hook_handler **hooks;
@@ -107,6 +112,13 @@ struct command_ctx {
 struct overlay {
     struct mp_image *source;
     int x, y;
+    // Memory the image was read from, kept for overlay-update.
+    void *map;              // mmap() result, or NULL for raw memory addresses
+    size_t map_size;
+    const uint8_t *src;
+    int src_stride;
+    // Area not yet copied to cmd->overlay_osd[n].packed (empty if x0>=x1).
+    struct mp_rect dirty[2];
 };
 
 struct hook_handler {
@@ -374,11 +386,13 @@ int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flag
     struct command_ctx *cmd = mpctx->command_ctx;
     const char *name = co->name;
 
+    mp_set_playback_dirty(mpctx);
+
     // Skip going through mp_property_generic_option (typically), because the
     // property implementation is trivial, and can break some obscure features
     // like --profile and --include if non-trivial flags are involved (which
     // the bridge would drop).
-    struct m_property *prop = m_property_list_find(cmd->properties, name);
+    struct m_property *prop = m_property_list_find(&cmd->property_index, name);
     if (prop && prop->is_option)
         goto direct_option;
 
@@ -1178,6 +1192,31 @@ static int get_edition_entry(int item, int action, void *arg, void *ctx)
     return m_property_read_sub(props, action, arg);
 }
 
+static int get_startup_phase_entry(int item, int action, void *arg, void *ctx)
+{
+    struct MPContext *mpctx = ctx;
+    struct mp_startup_phase *p = &mpctx->startup_phases[item];
+    int64_t prev = item > 0 ? mpctx->startup_phases[item - 1].time
+                            : MP_START_TIME;
+
+    struct m_sub_property props[] = {
+        {"phase",       SUB_PROP_STR(p->name)},
+        {"time",        SUB_PROP_DOUBLE((p->time - MP_START_TIME) / 1e6)},
+        {"duration",    SUB_PROP_DOUBLE((p->time - prev) / 1e6)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_startup_trace(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    return m_property_read_list(action, arg, mpctx->num_startup_phases,
+                                get_startup_phase_entry, mpctx);
+}
+
 static int property_list_editions(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
@@ -1782,6 +1821,102 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     return M_PROPERTY_OK;
 }
 
+static int mp_property_demuxer_cache_perf(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct demux_ctrl_perf_stats s = {0};
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_PERF_STATS, &s) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    node_map_add_int64(r, "ranges", s.num_ranges);
+    node_map_add_int64(r, "total-bytes", s.total_bytes);
+    node_map_add_int64(r, "fw-bytes", s.fw_bytes);
+    node_map_add_int64(r, "pruned-packets", s.pruned_packets);
+    node_map_add_int64(r, "pruned-bytes", s.pruned_bytes);
+    node_map_add_int64(r, "low-level-seeks", s.low_level_seeks);
+    node_map_add_int64(r, "read-calls", s.read_calls);
+    node_map_add_double(r, "read-time", s.read_time);
+    node_map_add_double(r, "lock-wait-time", s.lock_wait_time);
+    node_map_add_int64(r, "added-packets", s.added_packets);
+    if (s.added_packets > 0)
+        node_map_add_int64(r, "avg-packet-bytes", s.added_bytes / s.added_packets);
+    node_map_add_int64(r, "stream-bytes", s.stream_bytes);
+
+    struct mpv_node *streams = node_map_add(r, "streams", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < s.num_streams; n++) {
+        struct demux_stream_perf *st = &s.streams[n];
+        struct mpv_node *sub = node_array_add(streams, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(sub, "type", stream_type_name(st->type));
+        node_map_add_int64(sub, "index", st->index);
+        node_map_add_flag(sub, "selected", st->selected);
+        node_map_add_int64(sub, "fw-packets", st->fw_packets);
+        node_map_add_int64(sub, "fw-bytes", st->fw_bytes);
+        node_map_add_int64(sub, "total-packets", st->total_packets);
+        node_map_add_int64(sub, "total-bytes", st->total_bytes);
+    }
+    talloc_free(s.streams);
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_encode_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->encode_lavc_ctx)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct encode_stats s;
+    if (!encode_lavc_get_stats(mpctx->encode_lavc_ctx, NULL, &s))
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    node_map_add_double(r, "time", s.time);
+
+    struct mpv_node *streams = node_map_add(r, "streams", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < s.num_streams; n++) {
+        struct encode_stream_stats *st = &s.streams[n];
+        struct mpv_node *sub = node_array_add(streams, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(sub, "name", st->name);
+        node_map_add_int64(sub, "frames", st->frames);
+        if (s.time > 0)
+            node_map_add_double(sub, "fps", st->frames / s.time);
+        if (st->frames > 0) {
+            node_map_add_double(sub, "avg-encode-time",
+                                st->encode_time / st->frames);
+        }
+        node_map_add_double(sub, "last-encode-time", st->last_encode_time);
+        node_map_add_double(sub, "peak-encode-time", st->peak_encode_time);
+        node_map_add_int64(sub, "queue-depth", st->queue_depth);
+    }
+    talloc_free(s.streams);
+
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_demuxer_start_time(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -2035,6 +2170,16 @@ static int mp_property_ao(void *ctx, struct m_property *p, int action, void *arg
                                     mpctx->ao ? ao_get_name(mpctx->ao) : NULL);
 }
 
+/// Output latency: buffered audio, plus device latency (RO)
+static int mp_property_ao_latency(void *ctx, struct m_property *p,
+                                  int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, ao_get_delay(mpctx->ao));
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -2597,6 +2742,82 @@ static int mp_property_video_codec(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, c);
 }
 
+static int mp_property_video_dec_stats(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct mp_decoder_stats st;
+    if (!track || !track->dec ||
+        mp_decoder_wrapper_control(track->dec, VDCTRL_GET_STATS, &st) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"frame-time",      SUB_PROP_DOUBLE(st.frame_time)},
+        {"load",            SUB_PROP_DOUBLE(st.load)},
+        {"threads",         SUB_PROP_INT(st.threads)},
+        {"thread-type",     SUB_PROP_STR(st.thread_type),
+                            .unavailable = !st.thread_type},
+        {"queued-frames",   SUB_PROP_INT(st.queued_frames)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static void add_filter_perf(struct mpv_node *node, struct mp_output_chain *c)
+{
+    struct mp_output_chain_perf *entries;
+    int num = mp_output_chain_get_perf(c, NULL, &entries);
+
+    for (int n = 0; n < num; n++) {
+        struct mp_output_chain_perf *e = &entries[n];
+        struct mpv_node *sub = node_array_add(node, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(sub, "name", e->name);
+        if (e->label)
+            node_map_add_string(sub, "label", e->label);
+        node_map_add_int64(sub, "process-calls", e->perf.process_calls);
+        node_map_add_double(sub, "process-time", e->perf.process_time / 1e6);
+        node_map_add_double(sub, "cpu-time", e->perf.cpu_time / 1e6);
+        node_map_add_int64(sub, "stalls", e->perf.stalls);
+        node_map_add_int64(sub, "frames-in", e->perf.frames_in);
+        node_map_add_int64(sub, "frames-out", e->perf.frames_out);
+    }
+
+    talloc_free(entries);
+}
+
+static int mp_property_filter_perf(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    if (!vo_c && !ao_c)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    if (vo_c) {
+        struct mpv_node *list = node_map_add(r, "video", MPV_FORMAT_NODE_ARRAY);
+        add_filter_perf(list, vo_c->filter);
+    }
+    if (ao_c) {
+        struct mpv_node *list = node_map_add(r, "audio", MPV_FORMAT_NODE_ARRAY);
+        add_filter_perf(list, ao_c->filter);
+    }
+
+    return M_PROPERTY_OK;
+}
+
 static int property_imgparams(struct mp_image_params p, int action, void *arg)
 {
     if (!p.imgfmt)
@@ -2921,6 +3142,116 @@ out:
     return ret;
 }
 
+static int mp_property_vo_memory(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+    int ret = M_PROPERTY_UNAVAILABLE;
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0 ||
+        !data->mem.num_slabs)
+        goto out;
+
+    struct mp_gpu_mem_stats *mem = &data->mem;
+    uint64_t free_bytes = mem->allocated - mem->used;
+    double frag = free_bytes ? 1.0 - mem->largest_free / (double)free_bytes : 0;
+
+    switch (action) {
+    case M_PROPERTY_PRINT:
+        *(char **)arg = talloc_asprintf(NULL,
+                "%d slabs, %"PRIu64" KiB used, %"PRIu64" KiB free "
+                "(%.0f%% fragmented)", mem->num_slabs, mem->used / 1024,
+                free_bytes / 1024, frag * 100);
+        ret = M_PROPERTY_OK;
+        goto out;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(&node, "slabs", mem->num_slabs);
+        node_map_add_int64(&node, "allocated", mem->allocated);
+        node_map_add_int64(&node, "used", mem->used);
+        node_map_add_int64(&node, "free", free_bytes);
+        node_map_add_int64(&node, "largest-free", mem->largest_free);
+        node_map_add_double(&node, "fragmentation", frag);
+        *(struct mpv_node *)arg = node;
+        ret = M_PROPERTY_OK;
+        goto out;
+    }
+    }
+
+    ret = M_PROPERTY_NOT_IMPLEMENTED;
+
+out:
+    talloc_free(data);
+    return ret;
+}
+
+static int mp_property_vo_timing(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_PRINT: {
+        struct vo_timing_stats st;
+        vo_get_timing_stats(mpctx->video_out, &st);
+        *(char **)arg = talloc_asprintf(NULL,
+                "%"PRId64" presents, %"PRId64" missed vsyncs, render latency "
+                "last %dus avg %dus peak %dus, input latency last %dus avg %dus "
+                "peak %dus", st.num_samples, st.missed_vsyncs,
+                (int)(st.latency_last / 1000), (int)(st.latency_avg / 1000),
+                (int)(st.latency_peak / 1000),
+                (int)(st.input_latency_last / 1000),
+                (int)(st.input_latency_avg / 1000),
+                (int)(st.input_latency_peak / 1000));
+        return M_PROPERTY_OK;
+    }
+    case M_PROPERTY_GET: {
+        struct vo_timing_stats st;
+        vo_get_timing_stats(mpctx->video_out, &st);
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_double(&node, "vsync-interval", st.vsync_interval);
+        node_map_add_double(&node, "vsync-jitter", st.vsync_jitter);
+        node_map_add_int64(&node, "samples", st.num_samples);
+        node_map_add_double(&node, "bin-width", VO_TIMING_BIN_WIDTH);
+        struct mpv_node *hist =
+            node_map_add(&node, "present-intervals", MPV_FORMAT_NODE_ARRAY);
+        for (int n = 0; n < VO_TIMING_BINS; n++)
+            node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = st.hist[n];
+        node_map_add_int64(&node, "missed-vsyncs", st.missed_vsyncs);
+        node_map_add_int64(&node, "delayed-frames", st.delayed_count);
+        node_map_add_int64(&node, "dropped-frames", st.drop_count);
+        struct mpv_node *lat =
+            node_map_add(&node, "render-latency", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(lat, "last", st.latency_last);
+        node_map_add_int64(lat, "avg", st.latency_avg);
+        node_map_add_int64(lat, "peak", st.latency_peak);
+        struct mpv_node *ilat =
+            node_map_add(&node, "input-latency", MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(ilat, "last", st.input_latency_last);
+        node_map_add_int64(ilat, "avg", st.input_latency_avg);
+        node_map_add_int64(ilat, "peak", st.input_latency_peak);
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3896,6 +4227,7 @@ static const struct m_property mp_properties_base[] = {
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
     {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"demuxer-cache-perf", mp_property_demuxer_cache_perf},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"demuxer-via-network", mp_property_demuxer_is_network},
@@ -3907,6 +4239,7 @@ static const struct m_property mp_properties_base[] = {
     {"chapter-list", mp_property_list_chapters},
     {"track-list", property_list_tracks},
     {"edition-list", property_list_editions},
+    {"startup-trace", mp_property_startup_trace},
     {"disc-title-list", mp_property_list_disc_titles},
 
     {"playlist", mp_property_playlist},
@@ -3920,6 +4253,7 @@ static const struct m_property mp_properties_base[] = {
     {"mute", mp_property_mute},
     {"ao-volume", mp_property_ao_volume},
     {"ao-mute", mp_property_ao_mute},
+    {"ao-latency", mp_property_ao_latency},
     {"audio-delay", mp_property_audio_delay},
     {"audio-codec-name", mp_property_audio_codec_name},
     {"audio-codec", mp_property_audio_codec},
@@ -3942,6 +4276,8 @@ static const struct m_property mp_properties_base[] = {
     {"video-format", mp_property_video_format},
     {"video-frame-info", mp_property_video_frame_info},
     {"video-codec", mp_property_video_codec},
+    {"video-dec-stats", mp_property_video_dec_stats},
+    {"filter-perf", mp_property_filter_perf},
     M_PROPERTY_ALIAS("dwidth", "video-out-params/dw"),
     M_PROPERTY_ALIAS("dheight", "video-out-params/dh"),
     M_PROPERTY_ALIAS("width", "video-params/w"),
@@ -3949,6 +4285,8 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
+    {"vo-memory", mp_property_vo_memory},
+    {"vo-timing", mp_property_vo_timing},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
@@ -4021,6 +4359,7 @@ static const struct m_property mp_properties_base[] = {
     {"protocol-list", mp_property_protocols},
     {"decoder-list", mp_property_decoders},
     {"encoder-list", mp_property_encoders},
+    {"encode-stats", mp_property_encode_stats},
     {"demuxer-lavf-list", mp_property_lavf_demuxers},
 
     {"mpv-version", mp_property_version},
@@ -4067,7 +4406,7 @@ static const char *const *const mp_event_property_change[] = {
       "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
       "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
       "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
-      "frame-drop-count", "video-frame-info"),
+      "frame-drop-count", "video-frame-info", "video-dec-stats"),
     E(MP_EVENT_DURATION_UPDATE, "duration"),
     E(MPV_EVENT_VIDEO_RECONFIG, "video-out-params", "video-params",
       "video-format", "video-codec", "video-bitrate", "dwidth", "dheight",
@@ -4162,22 +4501,38 @@ static bool is_property_set(int action, void *val)
     }
 }
 
-static int mp_property_do_silent(const char *name, int action, void *val,
-                                 struct MPContext *ctx)
+bool mp_property_resolve(struct MPContext *ctx, const char *name,
+                         struct m_property_ref *ref)
+{
+    struct command_ctx *cmd = ctx->command_ctx;
+    return m_property_resolve(&cmd->property_index, name, ref);
+}
+
+static int mp_property_do_ref_silent(const struct m_property_ref *ref,
+                                     int action, void *val,
+                                     struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
     cmd->silence_option_deprecations += 1;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do_ref(ctx->log, ref, action, val, ctx);
     cmd->silence_option_deprecations -= 1;
     if (r == M_PROPERTY_OK && is_property_set(action, val))
-        mp_notify_property(ctx, (char *)name);
+        mp_notify_property(ctx, ref->name);
     return r;
 }
 
-int mp_property_do(const char *name, int action, void *val,
-                   struct MPContext *ctx)
+static int mp_property_do_silent(const char *name, int action, void *val,
+                                 struct MPContext *ctx)
+{
+    struct m_property_ref ref;
+    if (!mp_property_resolve(ctx, name, &ref))
+        return M_PROPERTY_UNKNOWN;
+    return mp_property_do_ref_silent(&ref, action, val, ctx);
+}
+
+static void log_property_set(struct MPContext *ctx, const char *name,
+                             int action, void *val, int r)
 {
-    int r = mp_property_do_silent(name, action, val, ctx);
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
         void *data = val;
@@ -4195,13 +4550,32 @@ int mp_property_do(const char *name, int action, void *val,
                    name, t ? "=" : "", t ? t : "", r);
         talloc_free(t);
     }
+}
+
+int mp_property_do(const char *name, int action, void *val,
+                   struct MPContext *ctx)
+{
+    if (is_property_set(action, val))
+        mp_set_playback_dirty(ctx);
+    int r = mp_property_do_silent(name, action, val, ctx);
+    log_property_set(ctx, name, action, val, r);
+    return r;
+}
+
+int mp_property_do_ref(const struct m_property_ref *ref, int action, void *val,
+                       struct MPContext *ctx)
+{
+    if (is_property_set(action, val))
+        mp_set_playback_dirty(ctx);
+    int r = mp_property_do_ref_silent(ref, action, val, ctx);
+    log_property_set(ctx, ref->name, action, val, r);
     return r;
 }
 
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(&ctx->property_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4228,7 +4602,7 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    m_properties_print_help_list(mpctx->log, ctx->properties);
+    m_properties_print_help_list(mpctx->log, &ctx->property_index);
 }
 
 /* List of default ways to show a property on OSD.
@@ -4486,10 +4860,38 @@ static void recreate_overlays(struct MPContext *mpctx)
     struct command_ctx *cmd = mpctx->command_ctx;
     int overlay_next = !cmd->overlay_osd_current;
     struct sub_bitmaps *new = &cmd->overlay_osd[overlay_next];
+
+    bool valid = false;
+
+    if (!cmd->overlay_repack[overlay_next]) {
+        // Only overlay-update was used since this was last packed; copy only
+        // the changed pixels.
+        int part = 0;
+        for (int n = 0; n < cmd->num_overlays; n++) {
+            struct overlay *o = &cmd->overlays[n];
+            if (!o->source)
+                continue;
+            struct sub_bitmap *b = &new->parts[part++];
+            struct mp_rect *d = &o->dirty[overlay_next];
+            if (d->x0 < d->x1 && d->y0 < d->y1) {
+                struct mp_image *s = o->source;
+                memcpy_pic((uint8_t *)b->bitmap + d->y0 * b->stride + d->x0 * 4,
+                           s->planes[0] + d->y0 * s->stride[0] + d->x0 * 4,
+                           (d->x1 - d->x0) * 4, d->y1 - d->y0,
+                           b->stride, s->stride[0]);
+            }
+            *d = (struct mp_rect){0};
+        }
+        assert(part == new->num_parts);
+        valid = true;
+        goto done;
+    }
+
     new->format = SUBBITMAP_RGBA;
     new->change_id = 1;
 
-    bool valid = false;
+    for (int n = 0; n < cmd->num_overlays; n++)
+        cmd->overlays[n].dirty[overlay_next] = (struct mp_rect){0};
 
     new->num_parts = 0;
     for (int n = 0; n < cmd->num_overlays; n++) {
@@ -4560,6 +4962,7 @@ done:
         new->format = SUBBITMAP_EMPTY;
         new->num_parts = 0;
     }
+    cmd->overlay_repack[overlay_next] = !valid;
 
     osd_set_external2(mpctx->osd, new);
     mp_wakeup_core(mpctx);
@@ -4580,8 +4983,13 @@ static void replace_overlay(struct MPContext *mpctx, int id, struct overlay *new
     struct overlay *ptr = &cmd->overlays[id];
 
     talloc_free(ptr->source);
+    if (ptr->map)
+        munmap(ptr->map, ptr->map_size);
     *ptr = *new;
 
+    for (int n = 0; n < 2; n++)
+        cmd->overlay_repack[n] = true;
+
     recreate_overlays(mpctx);
 }
 
@@ -4632,7 +5040,7 @@ static void cmd_overlay_add(void *pcmd)
     } else {
         fd = open(file, O_RDONLY | O_BINARY | O_CLOEXEC);
     }
-    int map_size = 0;
+    size_t map_size = 0;
     if (fd >= 0) {
         map_size = offset + h * stride;
         void *m = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
@@ -4648,8 +5056,10 @@ static void cmd_overlay_add(void *pcmd)
     }
     memcpy_pic(overlay.source->planes[0], (char *)p + offset, w * 4, h,
                overlay.source->stride[0], stride);
-    if (map_size)
-        munmap(p, map_size);
+    overlay.map = map_size ? p : NULL;
+    overlay.map_size = map_size;
+    overlay.src = (uint8_t *)p + offset;
+    overlay.src_stride = stride;
 
     replace_overlay(mpctx, id, &overlay);
     return;
@@ -4657,6 +5067,48 @@ error:
     cmd->success = false;
 }
 
+static void cmd_overlay_update(void *pcmd)
+{
+    struct mp_cmd_ctx *cmd = pcmd;
+    struct MPContext *mpctx = cmd->mpctx;
+    struct command_ctx *cmdctx = mpctx->command_ctx;
+    int id = cmd->args[0].v.i, x = cmd->args[1].v.i, y = cmd->args[2].v.i;
+    int w = cmd->args[3].v.i, h = cmd->args[4].v.i;
+
+    struct overlay *o = id >= 0 && id < cmdctx->num_overlays
+                      ? &cmdctx->overlays[id] : NULL;
+    if (!o || !o->source) {
+        MP_ERR(mpctx, "overlay-update: no overlay with id %d\n", id);
+        cmd->success = false;
+        return;
+    }
+    struct mp_image *s = o->source;
+
+    struct mp_rect rc = {
+        MPCLAMP(x, 0, s->w),
+        MPCLAMP(y, 0, s->h),
+        w < 0 ? s->w : MPCLAMP(x + (int64_t)w, 0, s->w),
+        h < 0 ? s->h : MPCLAMP(y + (int64_t)h, 0, s->h),
+    };
+    if (rc.x0 >= rc.x1 || rc.y0 >= rc.y1)
+        return;
+
+    memcpy_pic(s->planes[0] + rc.y0 * s->stride[0] + rc.x0 * 4,
+               o->src + rc.y0 * (ptrdiff_t)o->src_stride + rc.x0 * 4,
+               (rc.x1 - rc.x0) * 4, rc.y1 - rc.y0, s->stride[0], o->src_stride);
+
+    for (int n = 0; n < 2; n++) {
+        struct mp_rect *d = &o->dirty[n];
+        if (d->x0 < d->x1 && d->y0 < d->y1) {
+            mp_rect_union(d, &rc);
+        } else {
+            *d = rc;
+        }
+    }
+
+    recreate_overlays(mpctx);
+}
+
 static void cmd_overlay_remove(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -4830,6 +5282,8 @@ static void cmd_cycle_values(void *p)
 
 int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *res)
 {
+    mp_set_playback_dirty(mpctx);
+
     struct mpv_node dummy_node = {0};
     struct mp_cmd_ctx *ctx = &(struct mp_cmd_ctx){
         .mpctx = mpctx,
@@ -5534,6 +5988,61 @@ static void cmd_screenshot_raw(void *p)
     talloc_steal(ba, img);
 }
 
+static void cmd_thumbnail_raw(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    struct mpv_node *res = cmd->result;
+    void *tmp = talloc_new(NULL);
+
+    double *pts = NULL;
+    int num_pts = 0;
+    bstr list = bstr0(cmd->args[1].v.s);
+    while (list.len) {
+        bstr item, rest;
+        bstr_split_tok(list, ",", &item, &rest);
+        item = bstr_strip(item);
+        bstr end;
+        double t = bstrtod(item, &end);
+        if (!item.len || end.len || !isfinite(t)) {
+            MP_ERR(mpctx, "Invalid timestamp list: %s\n", cmd->args[1].v.s);
+            cmd->success = false;
+            goto done;
+        }
+        MP_TARRAY_APPEND(tmp, pts, num_pts, t);
+        list = rest;
+    }
+
+    struct mp_image **imgs = screenshot_get_thumbnails(mpctx, cmd->args[0].v.s,
+                                                       pts, num_pts,
+                                                       cmd->args[2].v.i,
+                                                       cmd->args[3].v.i);
+    talloc_steal(tmp, imgs);
+
+    node_init(res, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < num_pts; n++) {
+        struct mp_image *img = imgs[n];
+        struct mpv_node *e = node_array_add(res, MPV_FORMAT_NODE_MAP);
+        node_map_add_double(e, "time", pts[n]);
+        if (!img)
+            continue;
+        node_map_add_int64(e, "w", img->w);
+        node_map_add_int64(e, "h", img->h);
+        node_map_add_int64(e, "stride", img->stride[0]);
+        node_map_add_string(e, "format", "bgr0");
+        struct mpv_byte_array *ba =
+            node_map_add(e, "data", MPV_FORMAT_BYTE_ARRAY)->u.ba;
+        *ba = (struct mpv_byte_array){
+            .data = img->planes[0],
+            .size = img->stride[0] * img->h,
+        };
+        talloc_steal(ba, img);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static void cmd_run(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -5722,6 +6231,21 @@ static void cmd_write_watch_later_config(void *p)
     mp_write_watch_later_conf(mpctx);
 }
 
+static void cmd_dump_trace(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    char *path = mp_get_user_path(NULL, mpctx->global, cmd->args[0].v.s);
+    if (mp_trace_dump(path)) {
+        MP_INFO(mpctx, "Wrote trace to %s\n", path);
+    } else {
+        MP_ERR(mpctx, "Could not write trace to %s\n", path);
+        cmd->success = false;
+    }
+    talloc_free(path);
+}
+
 static void cmd_hook_add(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -5934,6 +6458,12 @@ const struct mp_cmd_def mp_cmds[] = {
                         {"window", 1},
                         {"subtitles", 2})),
     }},
+    { "thumbnail-raw", cmd_thumbnail_raw, {
+        ARG_STRING,
+        ARG_STRING,
+        OARG_INT(-1),
+        OARG_INT(-1),
+    }},
     { "loadfile", cmd_loadfile, {
         ARG_STRING,
         OARG_CHOICE(0, ({"replace", 0},
@@ -6014,9 +6544,13 @@ const struct mp_cmd_def mp_cmds[] = {
         { ARG_INT, ARG_INT, ARG_INT, ARG_STRING, ARG_INT, ARG_STRING, ARG_INT,
             ARG_INT, ARG_INT }},
     { "overlay-remove", cmd_overlay_remove, { ARG_INT } },
+    { "overlay-update", cmd_overlay_update,
+        { ARG_INT, OARG_INT(0), OARG_INT(0), OARG_INT(-1), OARG_INT(-1) }},
 
     { "write-watch-later-config", cmd_write_watch_later_config },
 
+    { "dump-trace", cmd_dump_trace, { ARG_STRING } },
+
     { "hook-add", cmd_hook_add, { ARG_STRING, ARG_INT, ARG_INT } },
     { "hook-ack", cmd_hook_ack, { ARG_INT } },
 
@@ -6078,6 +6612,7 @@ void command_init(struct MPContext *mpctx)
     ctx->properties =
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
+    m_property_list_init(&ctx->property_index, ctx, ctx->properties, num_base);
 
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
@@ -6100,11 +6635,14 @@ void command_init(struct MPContext *mpctx)
         }
 
         // The option might be covered by a manual property already.
-        if (m_property_list_find(ctx->properties, prop.name))
+        // (Option names are unique, so checking the base list is enough.)
+        if (m_property_list_find(&ctx->property_index, prop.name))
             continue;
 
         ctx->properties[count++] = prop;
     }
+
+    m_property_list_init(&ctx->property_index, ctx, ctx->properties, count);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -16,11 +16,13 @@
  */
 
 #include <stddef.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <libavutil/md5.h>
 
@@ -45,15 +47,207 @@
 #include "core.h"
 #include "command.h"
 
-static void load_all_cfgfiles(struct MPContext *mpctx, char *section,
+// The --config-snapshot file stores the contents of all config files loaded
+// by mp_parse_cfgfiles(), so that the next start needs to read only a single
+// file instead of searching and reading all config files. It's a text header
+// (one entry per line), followed by the raw file contents:
+//
+//   mpv-config-snapshot 1 <encoding mode: 0|1>
+//   dir <mtime> <path>                  (all config dirs; mtime=-1: missing)
+//   file <mtime> <size> <section|-> <path>
+//   <size bytes of file contents> "\n" (after each "file" line)
+//   end
+//
+// The snapshot is used only if all mtimes and sizes are unchanged. Adding or
+// removing a config file changes the mtime of its directory. Files loaded
+// with the "include" option are always read from disk.
+#define SNAPSHOT_HEADER "mpv-config-snapshot 1"
+
+struct cfg_snapshot {
+    bool recording;
+    bool failed;        // don't write the recorded snapshot
+    time_t start_time;
+    bstr out;
+};
+
+static int64_t get_mtime(const char *path, int64_t *size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    if (size)
+        *size = st.st_size;
+    return st.st_mtime;
+}
+
+static void snapshot_add_stamp(struct cfg_snapshot *snap, int64_t mtime)
+{
+    // The mtime has only 1 second resolution; if the file was modified in the
+    // same second, a later change might not be noticed.
+    if (mtime >= snap->start_time)
+        snap->failed = true;
+}
+
+static void snapshot_record_dirs(struct MPContext *mpctx,
+                                 struct cfg_snapshot *snap)
+{
+    char **dirs = mp_get_config_dirs(NULL, mpctx->global);
+    for (int n = 0; dirs[n]; n++) {
+        int64_t mtime = get_mtime(dirs[n], NULL);
+        snapshot_add_stamp(snap, mtime);
+        bstr_xappend_asprintf(snap, &snap->out, "dir %"PRId64" %s\n",
+                              mtime, dirs[n]);
+    }
+    talloc_free(dirs);
+}
+
+static void load_all_cfgfiles(struct MPContext *mpctx,
+                              struct cfg_snapshot *snap, char *section,
                               char *filename)
 {
     char **cf = mp_find_all_config_files(NULL, mpctx->global, filename);
-    for (int i = 0; cf && cf[i]; i++)
-        m_config_parse_config_file(mpctx->mconfig, cf[i], section, 0);
+    for (int i = 0; cf && cf[i]; i++) {
+        if (!snap->recording || snap->failed) {
+            m_config_parse_config_file(mpctx->mconfig, cf[i], section, 0);
+            continue;
+        }
+        int64_t size = 0;
+        int64_t mtime = get_mtime(cf[i], &size);
+        snapshot_add_stamp(snap, mtime);
+        MP_VERBOSE(mpctx, "Reading config file %s\n", cf[i]);
+        bstr data = stream_read_file(cf[i], NULL, mpctx->global, 1000000000);
+        if (!data.start || data.len != size || strchr(cf[i], '\n') ||
+            (section && strchr(section, ' ')))
+        {
+            snap->failed = true;
+        } else {
+            bstr_xappend_asprintf(snap, &snap->out,
+                                  "file %"PRId64" %"PRId64" %s %s\n",
+                                  mtime, size, section ? section : "-", cf[i]);
+            bstr_xappend(snap, &snap->out, data);
+            bstr_xappend(snap, &snap->out, bstr0("\n"));
+        }
+        if (data.start) {
+            m_config_parse(mpctx->mconfig, cf[i], data, section,
+                           M_SETOPT_FROM_CONFIG_FILE);
+        }
+        talloc_free(data.start);
+    }
     talloc_free(cf);
 }
 
+static bool snapshot_get_int(bstr *line, int64_t *out)
+{
+    bstr rest;
+    *out = bstrtoll(*line, &rest, 10);
+    if (rest.start == line->start || !bstr_eatstart0(&rest, " "))
+        return false;
+    *line = rest;
+    return true;
+}
+
+// Check whether the snapshot data is complete and up to date, and if parse
+// is true, apply it.
+static bool snapshot_apply(struct MPContext *mpctx, bstr data, bool encoding,
+                           bool parse)
+{
+    char header[40];
+    snprintf(header, sizeof(header), "%s %d", SNAPSHOT_HEADER, encoding);
+    if (!bstr_equals0(bstr_strip_linebreaks(bstr_getline(data, &data)), header))
+        return false;
+
+    char **dirs = mp_get_config_dirs(NULL, mpctx->global);
+    bool ok = false;
+    int num_dirs = 0;
+    while (1) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        int64_t mtime, size;
+        if (bstr_equals0(line, "end")) {
+            ok = parse || !dirs[num_dirs];
+            break;
+        } else if (bstr_eatstart0(&line, "dir ")) {
+            if (parse)
+                continue;
+            if (!snapshot_get_int(&line, &mtime) || !dirs[num_dirs] ||
+                !bstr_equals0(line, dirs[num_dirs]) ||
+                get_mtime(dirs[num_dirs], NULL) != mtime)
+                break;
+            num_dirs++;
+        } else if (bstr_eatstart0(&line, "file ")) {
+            if (!snapshot_get_int(&line, &mtime) ||
+                !snapshot_get_int(&line, &size) || size < 0 ||
+                data.len < size + 1)
+                break;
+            bstr section, path;
+            if (!bstr_split_tok(line, " ", &section, &path))
+                break;
+            char *path0 = bstrto0(NULL, path);
+            bstr contents = bstr_splice(data, 0, size);
+            data = bstr_cut(data, size + 1);
+            if (parse) {
+                char *section0 = bstr_equals0(section, "-") ? NULL
+                               : bstrto0(path0, section);
+                MP_VERBOSE(mpctx, "Reading config file %s (from snapshot)\n",
+                           path0);
+                m_config_parse(mpctx->mconfig, path0, contents, section0,
+                               M_SETOPT_FROM_CONFIG_FILE);
+            } else {
+                int64_t cur_size = -1;
+                if (get_mtime(path0, &cur_size) != mtime || cur_size != size) {
+                    talloc_free(path0);
+                    break;
+                }
+            }
+            talloc_free(path0);
+        } else {
+            break;
+        }
+    }
+    talloc_free(dirs);
+    return ok;
+}
+
+static bool snapshot_load(struct MPContext *mpctx, const char *file,
+                          bool encoding)
+{
+    bstr data = stream_read_file(file, NULL, mpctx->global, 1000000000);
+    if (!data.start)
+        return false;
+    bool ok = snapshot_apply(mpctx, data, encoding, false);
+    if (ok) {
+        MP_VERBOSE(mpctx, "Using config snapshot '%s'\n", file);
+        snapshot_apply(mpctx, data, encoding, true);
+    } else {
+        MP_VERBOSE(mpctx, "Config snapshot '%s' is out of date.\n", file);
+    }
+    talloc_free(data.start);
+    return ok;
+}
+
+static void snapshot_write(struct MPContext *mpctx, struct cfg_snapshot *snap,
+                           const char *file)
+{
+    if (snap->failed) {
+        MP_VERBOSE(mpctx, "Not writing config snapshot.\n");
+        return;
+    }
+    bstr_xappend(snap, &snap->out, bstr0("end\n"));
+
+    // Write a temporary file and rename it, so that concurrently started
+    // instances never see a partially written snapshot.
+    char *tmp = talloc_asprintf(snap, "%s.%lld.tmp", file, (long long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f && fwrite(snap->out.start, snap->out.len, 1, f) == 1;
+    if (f)
+        ok = fclose(f) == 0 && ok;
+    if (ok)
+        ok = rename(tmp, file) == 0;
+    if (!ok) {
+        MP_WARN(mpctx, "Could not write config snapshot '%s'.\n", file);
+        unlink(tmp);
+    }
+}
+
 // This name is used in builtin.conf to force encoding defaults (like ao/vo).
 #define SECT_ENCODE "encoding"
 
@@ -74,9 +268,28 @@ void mp_parse_cfgfiles(struct MPContext *mpctx)
     if (encoding)
         section = "playback-default";
 
-    load_all_cfgfiles(mpctx, NULL, "encoding-profiles.conf");
+    struct cfg_snapshot *snap = talloc_zero(NULL, struct cfg_snapshot);
+    char *snap_file = mp_get_user_path(snap, mpctx->global,
+                                       opts->config_snapshot);
+    if (snap_file && snap_file[0] && opts->load_config) {
+        if (snapshot_load(mpctx, snap_file, encoding))
+            goto done;
+        snap->recording = true;
+        snap->start_time = time(NULL);
+        bstr_xappend_asprintf(snap, &snap->out, "%s %d\n", SNAPSHOT_HEADER,
+                              encoding);
+        snapshot_record_dirs(mpctx, snap);
+    }
+
+    load_all_cfgfiles(mpctx, snap, NULL, "encoding-profiles.conf");
+
+    load_all_cfgfiles(mpctx, snap, section, "mpv.conf|config");
+
+    if (snap->recording)
+        snapshot_write(mpctx, snap, snap_file);
 
-    load_all_cfgfiles(mpctx, section, "mpv.conf|config");
+done:
+    talloc_free(snap);
 
     if (encoding)
         m_config_set_profile(conf, SECT_ENCODE, 0);
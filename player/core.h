@@ -213,6 +213,11 @@ struct ao_chain {
  * The main purpose of distinguishing these states is proper reinitialization
  * of A/V sync.
  */
+struct mp_startup_phase {
+    const char *name;
+    int64_t time;       // mp_time_us()
+};
+
 enum playback_status {
     // code may compare status values numerically
     STATUS_SYNCING,     // seeking for a position to resume
@@ -318,6 +323,12 @@ typedef struct MPContext {
     struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
     int num_next_frames;
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
+    // Last frames sent to the VO (oldest first), for --video-backstep-cache.
+    struct mp_image **backstep_frames;
+    int num_backstep_frames;
+    // Number of frames the displayed frame is behind the newest cached frame.
+    // If >0, the decoder is not at the displayed position.
+    int backstep_pos;
 
     enum playback_status video_status, audio_status;
     bool restart_complete;
@@ -379,8 +390,13 @@ typedef struct MPContext {
 
     double last_idle_tick;
     double next_cache_update;
+    uint64_t cache_seek_ranges_version;
 
     double sleeptime;      // number of seconds to sleep before next iteration
+    int64_t sleep_deadline; // absolute time of the earliest mp_set_timeout()
+    // Set if the playback state might have changed, so that the next playloop
+    // iteration can't skip updating playback (see run_playloop()).
+    atomic_bool playback_dirty;
 
     double mouse_timer;
     unsigned int mouse_event_ts;
@@ -389,6 +405,19 @@ typedef struct MPContext {
     // used to prevent hanging in some error cases
     double start_timestamp;
 
+    // Time at which each startup phase was finished (see mp_startup_mark()).
+    struct mp_startup_phase *startup_phases;
+    int num_startup_phases;
+    bool startup_trace_done;
+
+    // Decoded cover art and still images (--image-cache-max-bytes).
+    struct mp_image_cache *image_cache;
+
+    // --benchmark-report state (benchmark.c), NULL if unused.
+    struct mp_benchmark *benchmark;
+    // Number of video frames sent to the VO since the current file started.
+    int64_t frames_queued;
+
     // Timestamp from the last time some timing functions read the
     // current time, in microseconds.
     // Used to turn a new time value to a delta from last time.
@@ -410,6 +439,11 @@ typedef struct MPContext {
     bool playback_active;   // not paused, restarting, loading, unloading
     bool in_playloop;
 
+    // --memory-trim: mp_time_sec() since paused or idle (0 if playing), and
+    // whether memory was already trimmed since then.
+    double memory_trim_time;
+    bool memory_trimmed;
+
     // step this many frames, then pause
     int step_frames;
     // Counted down each frame, stop playback if 0 is reached. (-1 = disable)
@@ -430,6 +464,8 @@ typedef struct MPContext {
 
     struct screenshot_ctx *screenshot_ctx;
     struct command_ctx *command_ctx;
+    struct script_pool *script_pool;
+    struct external_files_cache *external_files_cache;
     struct encode_lavc_context *encode_lavc_ctx;
 
     struct mp_ipc_ctx *ipc_ctx;
@@ -535,6 +571,14 @@ void update_window_title(struct MPContext *mpctx, bool force);
 void error_on_track(struct MPContext *mpctx, struct track *track);
 int stream_dump(struct MPContext *mpctx, const char *source_filename);
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track);
+void mp_startup_mark(struct MPContext *mpctx, const char *phase);
+void mp_startup_trace_finish(struct MPContext *mpctx);
+
+// benchmark.c
+void mp_benchmark_start_file(struct MPContext *mpctx);
+void mp_benchmark_start_playback(struct MPContext *mpctx);
+void mp_benchmark_end_file(struct MPContext *mpctx);
+void mp_benchmark_write_report(struct MPContext *mpctx);
 
 // osd.c
 void set_osd_bar(struct MPContext *mpctx, int type,
@@ -549,6 +593,7 @@ void set_osd_bar_chapters(struct MPContext *mpctx, int type);
 // playloop.c
 void mp_wait_events(struct MPContext *mpctx);
 void mp_set_timeout(struct MPContext *mpctx, double sleeptime);
+void mp_set_playback_dirty(struct MPContext *mpctx);
 void mp_wakeup_core(struct MPContext *mpctx);
 void mp_wakeup_core_cb(void *ctx);
 void mp_process_input(struct MPContext *mpctx);
@@ -584,10 +629,23 @@ struct mp_scripting {
     const char *name;       // e.g. "lua script"
     const char *file_ext;   // e.g. "lua"
     int (*load)(struct mpv_handle *client, const char *filename);
+    // Optional, for running scripts on the shared --script-threads instead
+    // of a thread per script. start() loads the script (NULL on failure).
+    // step() processes all pending events without blocking, and returns the
+    // time in seconds after which it must be called again if no new events
+    // arrive, or one of MP_SCRIPT_*. run() runs the normal blocking event
+    // loop. destroy() frees the script state.
+    void *(*start)(struct mpv_handle *client, const char *filename);
+    double (*step)(void *state);
+    void (*run)(void *state);
+    void (*destroy)(void *state);
 };
+#define MP_SCRIPT_DONE (-1.0)           // script terminated
+#define MP_SCRIPT_NEEDS_THREAD (-2.0)   // script needs run() on its own thread
 void mp_load_scripts(struct MPContext *mpctx);
 void mp_load_builtin_scripts(struct MPContext *mpctx);
 int mp_load_user_script(struct MPContext *mpctx, const char *fname);
+void mp_script_pool_destroy(struct MPContext *mpctx);
 
 // sub.c
 void reset_subtitle_state(struct MPContext *mpctx);
@@ -608,6 +666,8 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track);
 int reinit_video_filters(struct MPContext *mpctx);
 void write_video(struct MPContext *mpctx);
 void mp_force_video_refresh(struct MPContext *mpctx);
+bool mp_backstep_cache_step(struct MPContext *mpctx, int dir);
+void mp_backstep_cache_resume(struct MPContext *mpctx);
 void uninit_video_out(struct MPContext *mpctx);
 void uninit_video_chain(struct MPContext *mpctx);
 double calc_average_frame_duration(struct MPContext *mpctx);
@@ -20,6 +20,8 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "osdep/io.h"
 
@@ -28,6 +30,7 @@
 #include "common/msg.h"
 #include "misc/ctype.h"
 #include "misc/charset_conv.h"
+#include "misc/thread_pool.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "external_files.h"
@@ -104,9 +107,114 @@ static struct bstr guess_lang_from_filename(struct bstr name)
     return (struct bstr){name.start + i + 1, n};
 }
 
+// Directory contents, with the names converted to UTF-8.
+struct dir_listing {
+    char *path;
+    time_t mtime;       // directory mtime when it was listed
+    time_t list_time;   // time the listing was started
+    bstr *names;
+    int num_names;
+};
+
+// Remembers the contents of the last few directories scanned, which makes
+// advancing in a playlist of files in the same directory much cheaper on
+// slow (network) filesystems.
+struct external_files_cache {
+    struct dir_listing **entries; // least recently used first
+    int num_entries;
+};
+
+#define MAX_CACHED_DIRS 16
+
+struct scan_job {
+    char *path;
+    struct mp_log *log;
+    struct dir_listing *cached; // owned by the cache
+    struct dir_listing *result; // cached, a new listing, or NULL on failure
+};
+
+struct external_files_cache *external_files_cache_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct external_files_cache);
+}
+
+static int cache_find(struct external_files_cache *cache, const char *path)
+{
+    for (int n = 0; cache && n < cache->num_entries; n++) {
+        if (strcmp(cache->entries[n]->path, path) == 0)
+            return n;
+    }
+    return -1;
+}
+
+// Replace the cached listing for job->path with job->result.
+static void cache_update(struct external_files_cache *cache,
+                         struct scan_job *job)
+{
+    int idx = cache_find(cache, job->path);
+    if (idx >= 0) {
+        struct dir_listing *old = cache->entries[idx];
+        MP_TARRAY_REMOVE_AT(cache->entries, cache->num_entries, idx);
+        if (old != job->result)
+            talloc_free(old);
+    }
+    if (!job->result)
+        return;
+    if (cache->num_entries >= MAX_CACHED_DIRS) {
+        talloc_free(cache->entries[0]);
+        MP_TARRAY_REMOVE_AT(cache->entries, cache->num_entries, 0);
+    }
+    talloc_steal(cache, job->result);
+    MP_TARRAY_APPEND(cache, cache->entries, cache->num_entries, job->result);
+}
+
+// Runs on a worker thread. Must not access anything but the job.
+static void scan_dir(void *ptr)
+{
+    struct scan_job *job = ptr;
+
+    struct stat st;
+    if (stat(job->path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return;
+
+    // The mtime has only 1 second resolution; if the directory was modified
+    // in the same second it was listed, the listing is possibly incomplete.
+    struct dir_listing *c = job->cached;
+    if (c && c->mtime == st.st_mtime && c->list_time > c->mtime) {
+        job->result = c;
+        return;
+    }
+
+    struct dir_listing *list = talloc_zero(NULL, struct dir_listing);
+    list->path = talloc_strdup(list, job->path);
+    list->mtime = st.st_mtime;
+    list->list_time = time(NULL);
+
+    DIR *d = opendir(job->path);
+    if (!d) {
+        talloc_free(list);
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct bstr den = bstr0(de->d_name);
+        struct bstr dename = mp_iconv_to_utf8(job->log, den,
+                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
+        if (den.start != dename.start) {
+            talloc_steal(list, dename.start);
+        } else {
+            dename = bstrdup(list, den);
+        }
+        MP_TARRAY_APPEND(list, list->names, list->num_names, dename);
+    }
+    closedir(d);
+
+    job->result = list;
+}
+
 static void append_dir_subtitles(struct mpv_global *global,
                                  struct subfn **slist, int *nsub,
-                                 struct bstr path, const char *fname,
+                                 struct dir_listing *list, const char *fname,
                                  int limit_fuzziness, int limit_type)
 {
     void *tmpmem = talloc_new(NULL);
@@ -123,30 +231,18 @@ static void append_dir_subtitles(struct mpv_global *global,
     if (f_fbname.start != f_fname.start)
         talloc_steal(tmpmem, f_fname.start);
 
-    char *path0 = bstrdup0(tmpmem, path);
-
-    if (mp_is_url(bstr0(path0)))
-        goto out;
+    struct bstr path = bstr0(list->path);
 
-    DIR *d = opendir(path0);
-    if (!d)
-        goto out;
     mp_verbose(log, "Loading external files in %.*s\n", BSTR_P(path));
-    struct dirent *de;
-    while ((de = readdir(d))) {
+    for (int i = 0; i < list->num_names; i++) {
         void *tmpmem2 = talloc_new(tmpmem);
-        struct bstr den = bstr0(de->d_name);
-        struct bstr dename = mp_iconv_to_utf8(log, den,
-                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
+        struct bstr dename = list->names[i];
         // retrieve various parts of the filename
         struct bstr tmp_fname_noext = bstrdup(tmpmem2, bstr_strip_ext(dename));
         bstr_lower(tmp_fname_noext);
         struct bstr tmp_fname_ext = bstr_get_ext(dename);
         struct bstr tmp_fname_trim = bstr_strip(tmp_fname_noext);
 
-        if (den.start != dename.start)
-            talloc_steal(tmpmem2, dename.start);
-
         // check what it is (most likely)
         int type = test_ext(tmp_fname_ext);
         char **langs = NULL;
@@ -195,8 +291,8 @@ static void append_dir_subtitles(struct mpv_global *global,
             }
         }
 
-        mp_dbg(log, "Potential external file: \"%s\"  Priority: %d\n",
-               de->d_name, prio);
+        mp_dbg(log, "Potential external file: \"%.*s\"  Priority: %d\n",
+               BSTR_P(dename), prio);
 
         if (prio) {
             prio += prio;
@@ -220,9 +316,7 @@ static void append_dir_subtitles(struct mpv_global *global,
     next_sub:
         talloc_free(tmpmem2);
     }
-    closedir(d);
 
- out:
     talloc_free(tmpmem);
 }
 
@@ -253,51 +347,130 @@ static void filter_subidx(struct subfn **slist, int *nsub)
     }
 }
 
-static void load_paths(struct mpv_global *global, struct subfn **slist,
-                       int *nsubs, const char *fname, char **paths,
+struct scan {
+    int job;
+    int limit_fuzziness;
+    int limit_type;
+};
+
+struct scan_list {
+    struct scan_job *jobs;
+    int num_jobs;
+    struct scan *scans;
+    int num_scans;
+};
+
+static void add_scan(struct scan_list *l, struct mp_log *log, char *path,
+                     int limit_fuzziness, int limit_type)
+{
+    if (mp_is_url(bstr0(path)))
+        return;
+    int job = -1;
+    for (int n = 0; n < l->num_jobs; n++) {
+        if (strcmp(l->jobs[n].path, path) == 0)
+            job = n;
+    }
+    if (job < 0) {
+        struct scan_job j = {.path = talloc_strdup(l, path), .log = log};
+        MP_TARRAY_APPEND(l, l->jobs, l->num_jobs, j);
+        job = l->num_jobs - 1;
+    }
+    struct scan s = {job, limit_fuzziness, limit_type};
+    MP_TARRAY_APPEND(l, l->scans, l->num_scans, s);
+}
+
+static void load_paths(struct mpv_global *global, struct scan_list *l,
+                       struct mp_log *log, const char *fname, char **paths,
                        char *cfg_path, int type)
 {
     for (int i = 0; paths && paths[i]; i++) {
         char *expanded_path = mp_get_user_path(NULL, global, paths[i]);
         char *path = mp_path_join_bstr(
-            *slist, mp_dirname(fname),
+            l, mp_dirname(fname),
             bstr0(expanded_path ? expanded_path : paths[i]));
-        append_dir_subtitles(global, slist, nsubs, bstr0(path),
-                             fname, 0, type);
+        add_scan(l, log, path, 0, type);
         talloc_free(expanded_path);
     }
 
     // Load subtitles in ~/.mpv/sub (or similar) limiting sub fuzziness
     char *mp_subdir = mp_find_config_file(NULL, global, cfg_path);
-    if (mp_subdir) {
-        append_dir_subtitles(global, slist, nsubs, bstr0(mp_subdir), fname, 1,
-                             type);
-    }
+    if (mp_subdir)
+        add_scan(l, log, mp_subdir, 1, type);
     talloc_free(mp_subdir);
 }
 
+// List all directories. Directories on network filesystems can take a while
+// even just to stat(), so this is done concurrently.
+static void run_scan_jobs(struct scan_list *l)
+{
+    struct mp_thread_pool *pool = NULL;
+    if (l->num_jobs > 1)
+        pool = mp_thread_pool_create(NULL, MPMIN(l->num_jobs, 4));
+    for (int n = 0; n < l->num_jobs; n++) {
+        if (pool) {
+            mp_thread_pool_queue(pool, scan_dir, &l->jobs[n]);
+        } else {
+            scan_dir(&l->jobs[n]);
+        }
+    }
+    talloc_free(pool); // waits until all jobs are done
+}
+
 // Return a list of subtitles and audio files found, sorted by priority.
 // Last element is terminated with a fname==NULL entry.
-struct subfn *find_external_files(struct mpv_global *global, const char *fname)
+// cache can be NULL. Otherwise, directory listings are reused for as long as
+// the directory's mtime does not change.
+struct subfn *find_external_files(struct mpv_global *global, const char *fname,
+                                  struct external_files_cache *cache)
 {
     struct MPOpts *opts = global->opts;
     struct subfn *slist = talloc_array_ptrtype(NULL, slist, 1);
     int n = 0;
 
+    struct scan_list *l = talloc_zero(NULL, struct scan_list);
+    struct mp_log *log = mp_log_new(l, global->log, "find_files");
+
     // Load subtitles from current media directory
-    append_dir_subtitles(global, &slist, &n, mp_dirname(fname), fname, 0, -1);
+    add_scan(l, log, bstrdup0(l, mp_dirname(fname)), 0, -1);
 
     // Load subtitles in dirs specified by sub-paths option
     if (opts->sub_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->sub_paths, "sub",
+        load_paths(global, l, log, fname, opts->sub_paths, "sub",
                    STREAM_SUB);
     }
 
     if (opts->audiofile_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->audiofile_paths, "audio",
+        load_paths(global, l, log, fname, opts->audiofile_paths, "audio",
                    STREAM_AUDIO);
     }
 
+    for (int i = 0; i < l->num_jobs; i++) {
+        int idx = cache_find(cache, l->jobs[i].path);
+        l->jobs[i].cached = idx >= 0 ? cache->entries[idx] : NULL;
+    }
+
+    run_scan_jobs(l);
+
+    for (int i = 0; i < l->num_jobs; i++) {
+        struct scan_job *job = &l->jobs[i];
+        if (cache) {
+            cache_update(cache, job);
+        } else if (job->result) {
+            talloc_steal(l, job->result);
+        }
+    }
+
+    for (int i = 0; i < l->num_scans; i++) {
+        struct scan *s = &l->scans[i];
+        struct dir_listing *list = l->jobs[s->job].result;
+        if (list) {
+            append_dir_subtitles(global, &slist, &n, list, fname,
+                                 s->limit_fuzziness, s->limit_type);
+        }
+    }
+
+    talloc_free(l);
+
     // Sort by name for filter_subidx()
     qsort(slist, n, sizeof(*slist), compare_sub_filename);
 
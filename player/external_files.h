@@ -28,7 +28,11 @@ struct subfn {
 };
 
 struct mpv_global;
-struct subfn *find_external_files(struct mpv_global *global, const char *fname);
+struct external_files_cache;
+struct external_files_cache *external_files_cache_create(void *ta_parent);
+
+struct subfn *find_external_files(struct mpv_global *global, const char *fname,
+                                  struct external_files_cache *cache);
 
 bool mp_might_be_subtitle_file(const char *filename);
 
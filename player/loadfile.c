@@ -673,7 +673,10 @@ void autoload_external_files(struct MPContext *mpctx)
                                     &stream_filename) > 0)
             base_filename = talloc_steal(tmp, stream_filename);
     }
-    struct subfn *list = find_external_files(mpctx->global, base_filename);
+    if (!mpctx->external_files_cache)
+        mpctx->external_files_cache = external_files_cache_create(mpctx);
+    struct subfn *list = find_external_files(mpctx->global, base_filename,
+                                             mpctx->external_files_cache);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -1142,6 +1145,7 @@ static void play_current_file(struct MPContext *mpctx)
     double playback_start = -1e100;
 
     mp_notify(mpctx, MPV_EVENT_START_FILE, NULL);
+    mp_startup_mark(mpctx, "start-file");
 
     mp_cancel_reset(mpctx->playback_abort);
 
@@ -1164,6 +1168,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->seek = (struct seek_params){ 0 };
     mpctx->filter_root = mp_filter_create_root(mpctx->global);
     mp_filter_root_set_wakeup_cb(mpctx->filter_root, mp_wakeup_core_cb, mpctx);
+    mp_benchmark_start_file(mpctx);
 
     reset_playback_state(mpctx);
 
@@ -1230,6 +1235,7 @@ static void play_current_file(struct MPContext *mpctx)
     }
     if (!mpctx->demuxer || mpctx->stop_play)
         goto terminate_playback;
+    mp_startup_mark(mpctx, "demuxer-open");
 
     if (mpctx->demuxer->playlist) {
         struct playlist *pl = mpctx->demuxer->playlist;
@@ -1258,6 +1264,7 @@ static void play_current_file(struct MPContext *mpctx)
     open_external_files(mpctx, opts->sub_name, STREAM_SUB);
     open_external_files(mpctx, opts->external_files, STREAM_TYPE_COUNT);
     autoload_external_files(mpctx);
+    mp_startup_mark(mpctx, "external-files");
 
     check_previous_track_selection(mpctx);
 
@@ -1304,6 +1311,7 @@ static void play_current_file(struct MPContext *mpctx)
     reinit_video_chain(mpctx);
     reinit_audio_chain(mpctx);
     reinit_sub_all(mpctx);
+    mp_startup_mark(mpctx, "decoders-init");
 
     if (mpctx->encode_lavc_ctx) {
         if (mpctx->vo_chain)
@@ -1331,6 +1339,7 @@ static void play_current_file(struct MPContext *mpctx)
     MP_VERBOSE(mpctx, "Starting playback...\n");
 
     mpctx->playback_initialized = true;
+    mp_benchmark_start_playback(mpctx);
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
     update_screensaver_state(mpctx);
 
@@ -1386,6 +1395,8 @@ terminate_playback:
 
     close_recorder(mpctx);
 
+    mp_benchmark_end_file(mpctx);
+
     // time to uninit all, except global stuff:
     reinit_complex_filters(mpctx, true);
     uninit_audio_chain(mpctx);
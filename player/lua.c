@@ -22,12 +22,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <limits.h>
 #include <math.h>
 
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include <libavutil/md5.h>
+
 #include "osdep/io.h"
 
 #include "mpv_talloc.h"
@@ -84,6 +87,11 @@ struct script_ctx {
     struct mp_log *log;
     struct mpv_handle *client;
     struct MPContext *mpctx;
+    char *cache_dir;        // --script-cache-dir (NULL if disabled)
+    bool step_mode;         // don't run mp_event_loop() after loading
+    bool load_failed;
+    bool run_step;          // call_event_fn(): mp_event_step() instead of loop
+    double step_result;
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -191,11 +199,118 @@ static int check_error(lua_State *L, int err)
 
 static void add_functions(struct script_ctx *ctx);
 
+static bstr read_whole_file(void *talloc_ctx, const char *fname)
+{
+    bstr res = {0};
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return res;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        if (size >= 0 && size < INT_MAX && fseek(f, 0, SEEK_SET) == 0) {
+            res.start = talloc_size(talloc_ctx, size + 1);
+            res.len = fread(res.start, 1, size, f);
+            res.start[res.len] = '\0';
+            if (res.len != size) {
+                talloc_free(res.start);
+                res = (bstr){0};
+            }
+        }
+    }
+    fclose(f);
+    return res;
+}
+
+struct dump_ctx {
+    void *ta_parent;
+    bstr code;
+};
+
+static int dump_writer(lua_State *L, const void *p, size_t size, void *ud)
+{
+    struct dump_ctx *d = ud;
+    bstr_xappend(d->ta_parent, &d->code, (bstr){(unsigned char *)p, size});
+    return 0;
+}
+
+// Like luaL_loadbuffer(), but store the compiled bytecode in --script-cache-dir
+// and load it from there next time. The cache entry is named after the hash of
+// the source, so changed scripts are compiled again.
+static int load_buffer_cached(lua_State *L, bstr source, const char *chunkname)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    if (!ctx->cache_dir)
+        return luaL_loadbuffer(L, source.start, source.len, chunkname);
+
+    void *tmp = talloc_new(NULL);
+
+    // The bytecode also contains the chunk name (used in error messages).
+    bstr key = {0};
+    bstr_xappend_asprintf(tmp, &key, "%s\n%s\n", LUA_RELEASE, chunkname);
+    bstr_xappend(tmp, &key, source);
+    uint8_t md5[16];
+    av_md5_sum(md5, key.start, key.len);
+    char name[40];
+    for (int n = 0; n < 16; n++)
+        snprintf(name + n * 2, 3, "%02X", md5[n]);
+    snprintf(name + 32, sizeof(name) - 32, ".luac");
+    char *path = mp_path_join(tmp, ctx->cache_dir, name);
+
+    bstr code = read_whole_file(tmp, path);
+    if (code.len) {
+        // Lua checks the header for version and ABI compatibility.
+        if (luaL_loadbuffer(L, code.start, code.len, chunkname) == 0) {
+            MP_DBG(ctx, "loaded %s from %s\n", chunkname, path);
+            talloc_free(tmp);
+            return 0;
+        }
+        MP_VERBOSE(ctx, "invalid cached bytecode %s\n", path);
+        lua_pop(L, 1);
+    }
+
+    int r = luaL_loadbuffer(L, source.start, source.len, chunkname);
+    if (r == 0) {
+        struct dump_ctx out = {.ta_parent = tmp};
+        lua_dump(L, dump_writer, &out);
+        char *tmp_path = talloc_asprintf(tmp, "%s.%d.tmp", path, mp_getpid());
+        mp_mkdirp(ctx->cache_dir);
+        FILE *f = fopen(tmp_path, "wb");
+        bool ok = f && fwrite(out.code.start, out.code.len, 1, f) == 1;
+        if (f)
+            ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp_path, path) != 0) {
+            MP_VERBOSE(ctx, "could not write %s\n", path);
+            unlink(tmp_path);
+        }
+    }
+
+    talloc_free(tmp);
+    return r;
+}
+
 static void load_file(lua_State *L, const char *fname)
 {
     struct script_ctx *ctx = get_ctx(L);
     MP_DBG(ctx, "loading file %s\n", fname);
-    int r = luaL_loadfile(L, fname);
+    int r;
+    if (ctx->cache_dir) {
+        void *tmp = talloc_new(NULL);
+        bstr source = read_whole_file(tmp, fname);
+        if (!source.start) {
+            talloc_free(tmp);
+            luaL_error(L, "cannot read %s", fname);
+        }
+        // Like luaL_loadfile(), skip a "#!" line, but keep line numbers.
+        if (bstr_startswith0(source, "#")) {
+            int nl = bstrchr(source, '\n');
+            source = nl < 0 ? (bstr){0} : bstr_cut(source, nl);
+        }
+        char *chunkname = talloc_asprintf(tmp, "@%s", fname);
+        r = load_buffer_cached(L, source, chunkname);
+        talloc_free(tmp);
+    } else {
+        r = luaL_loadfile(L, fname);
+    }
     if (r)
         lua_error(L);
     lua_call(L, 0, 0);
@@ -209,7 +324,7 @@ static int load_builtin(lua_State *L)
     for (int n = 0; builtin_lua_scripts[n][0]; n++) {
         if (strcmp(name, builtin_lua_scripts[n][0]) == 0) {
             const char *script = builtin_lua_scripts[n][1];
-            if (luaL_loadbuffer(L, script, strlen(script), dispname))
+            if (load_buffer_cached(L, bstr0(script), dispname))
                 lua_error(L);
             lua_call(L, 0, 1);
             return 1;
@@ -262,6 +377,9 @@ static int load_scripts(lua_State *L)
         load_file(L, fname);
     }
 
+    if (ctx->step_mode)
+        return 0;
+
     lua_getglobal(L, "mp_event_loop"); // fn
     if (lua_isnil(L, -1))
         luaL_error(L, "no event loop function\n");
@@ -328,6 +446,10 @@ static int run_lua(lua_State *L)
     lua_setfield(L, LUA_REGISTRYINDEX, "ARRAY"); // mp table
     lua_setfield(L, -2, "ARRAY"); // mp
 
+    // used by script_get_property_cached()
+    lua_newtable(L); // mp table
+    lua_setfield(L, LUA_REGISTRYINDEX, "PROPCACHE"); // mp
+
     lua_pop(L, 1); // -
 
     assert(lua_gettop(L) == 0);
@@ -354,15 +476,24 @@ static int run_lua(lua_State *L)
     if (lua_pcall(L, 0, 0, -2)) { // errf [error]
         const char *e = lua_tostring(L, -1);
         MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+        ctx->load_failed = true;
     }
 
     return 0;
 }
 
-static int load_lua(struct mpv_handle *client, const char *fname)
+static void destroy_lua(void *p)
+{
+    struct script_ctx *ctx = p;
+    if (ctx->state)
+        lua_close(ctx->state);
+    talloc_free(ctx);
+}
+
+static struct script_ctx *create_lua(struct mpv_handle *client,
+                                     const char *fname, bool step_mode)
 {
     struct MPContext *mpctx = mp_client_get_core(client);
-    int r = -1;
 
     struct script_ctx *ctx = talloc_ptrtype(NULL, ctx);
     *ctx = (struct script_ctx) {
@@ -371,8 +502,15 @@ static int load_lua(struct mpv_handle *client, const char *fname)
         .name = mpv_client_name(client),
         .log = mp_client_get_log(client),
         .filename = fname,
+        .step_mode = step_mode,
     };
 
+    char *cache_dir =
+        mpv_get_property_string(client, "options/script-cache-dir");
+    if (cache_dir && cache_dir[0])
+        ctx->cache_dir = mp_get_user_path(ctx, mpctx->global, cache_dir);
+    mpv_free(cache_dir);
+
     if (LUA_VERSION_NUM != 501 && LUA_VERSION_NUM != 502) {
         MP_FATAL(ctx, "Only Lua 5.1 and 5.2 are supported.\n");
         goto error_out;
@@ -392,13 +530,80 @@ static int load_lua(struct mpv_handle *client, const char *fname)
         goto error_out;
     }
 
-    r = 0;
+    return ctx;
 
 error_out:
-    if (ctx->state)
-        lua_close(ctx->state);
-    talloc_free(ctx);
-    return r;
+    destroy_lua(ctx);
+    return NULL;
+}
+
+static int load_lua(struct mpv_handle *client, const char *fname)
+{
+    struct script_ctx *ctx = create_lua(client, fname, false);
+    if (!ctx)
+        return -1;
+    destroy_lua(ctx);
+    return 0;
+}
+
+static void *start_lua(struct mpv_handle *client, const char *fname)
+{
+    struct script_ctx *ctx = create_lua(client, fname, true);
+    if (ctx && ctx->load_failed) {
+        destroy_lua(ctx);
+        ctx = NULL;
+    }
+    return ctx;
+}
+
+// Call mp_event_step() or mp_event_loop(), and set ctx->step_result to the
+// result as expected by mp_scripting.step.
+static int call_event_fn(lua_State *L)
+{
+    struct script_ctx *ctx = lua_touserdata(L, -1);
+    lua_pop(L, 1); // -
+
+    ctx->step_result = MP_SCRIPT_DONE;
+
+    lua_pushcfunction(L, error_handler); // errf
+    const char *fn = ctx->run_step ? "mp_event_step" : "mp_event_loop";
+    lua_getglobal(L, fn); // errf fn
+    if (lua_pcall(L, 0, 1, -2)) { // errf [error]
+        const char *e = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", e ? e : "(unknown)");
+    } else if (lua_isnumber(L, -1)) { // errf res
+        ctx->step_result = MPMAX(lua_tonumber(L, -1), 0);
+    } else if (lua_isboolean(L, -1) && !lua_toboolean(L, -1)) {
+        ctx->step_result = MP_SCRIPT_NEEDS_THREAD;
+    }
+    lua_settop(L, 0); // -
+
+    return 0;
+}
+
+static double run_event_fn(struct script_ctx *ctx, bool step)
+{
+    lua_State *L = ctx->state;
+    ctx->run_step = step;
+    if (mp_cpcall(L, call_event_fn, ctx)) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING) // avoid allocation
+            err = lua_tostring(L, -1);
+        MP_FATAL(ctx, "Lua error: %s\n", err);
+        lua_settop(L, 0);
+        return MP_SCRIPT_DONE;
+    }
+    return ctx->step_result;
+}
+
+static double step_lua(void *p)
+{
+    return run_event_fn(p, true);
+}
+
+static void run_lua_loop(void *p)
+{
+    run_event_fn(p, false);
 }
 
 static int check_loglevel(lua_State *L, int arg)
@@ -914,6 +1119,67 @@ static int script_get_property_native(lua_State *L)
     return 2;
 }
 
+// Like script_get_property_native(), but return the previously returned value
+// (the same table) if no change notification for the property was sent since.
+static int script_get_property_cached(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    const char *name = luaL_checkstring(L, 1);
+    mp_lua_optarg(L, 2);
+    lua_settop(L, 2); // name def
+
+    uint64_t version = mp_client_property_version(ctx->client, name);
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "PROPCACHE"); // name def cache
+    lua_getfield(L, -1, name); // name def cache entry
+    if (version && lua_istable(L, -1)) {
+        lua_rawgeti(L, -1, 1); // name def cache entry version
+        bool hit = lua_tonumber(L, -1) == (lua_Number)version;
+        lua_pop(L, 1); // name def cache entry
+        if (hit) {
+            lua_rawgeti(L, -1, 3); // name def cache entry err
+            if (lua_isnil(L, -1)) {
+                lua_rawgeti(L, -2, 2); // name def cache entry nil value
+                return 1;
+            }
+            lua_pushvalue(L, 2); // name def cache entry err def
+            lua_insert(L, -2); // name def cache entry def err
+            return 2;
+        }
+    }
+    lua_pop(L, 1); // name def cache
+
+    void *tmp = mp_lua_PITA(L); // name def cache tmp
+
+    mpv_node node;
+    int err = mpv_get_property(ctx->client, name, MPV_FORMAT_NODE, &node);
+
+    lua_createtable(L, 3, 0); // name def cache tmp entry
+    lua_pushnumber(L, version); // name def cache tmp entry version
+    lua_rawseti(L, -2, 1); // name def cache tmp entry
+    if (err >= 0) {
+        auto_free_node(tmp, &node);
+        pushnode(L, &node); // name def cache tmp entry value
+        talloc_free_children(tmp);
+        lua_rawseti(L, -2, 2); // name def cache tmp entry
+    } else {
+        lua_pushstring(L, mpv_error_string(err)); // name def cache tmp entry err
+        lua_rawseti(L, -2, 3); // name def cache tmp entry
+    }
+    if (version) {
+        lua_pushvalue(L, -1); // name def cache tmp entry entry
+        lua_setfield(L, 3, name); // name def cache tmp entry
+    }
+
+    if (err >= 0) {
+        lua_rawgeti(L, -1, 2); // name def cache tmp entry value
+        return 1;
+    }
+    lua_pushvalue(L, 2); // name def cache tmp entry def
+    lua_rawgeti(L, -2, 3); // name def cache tmp entry def err
+    return 2;
+}
+
 static mpv_format check_property_format(lua_State *L, int arg)
 {
     if (lua_isnil(L, arg))
@@ -1342,6 +1608,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_property_bool),
     FN_ENTRY(get_property_number),
     FN_ENTRY(get_property_native),
+    FN_ENTRY(get_property_cached),
     FN_ENTRY(set_property),
     FN_ENTRY(set_property_bool),
     FN_ENTRY(set_property_number),
@@ -1411,4 +1678,8 @@ const struct mp_scripting mp_scripting_lua = {
     .name = "lua script",
     .file_ext = "lua",
     .load = load_lua,
+    .start = start_lua,
+    .step = step_lua,
+    .run = run_lua_loop,
+    .destroy = destroy_lua,
 };
@@ -448,10 +448,12 @@ _G.print = mp.msg.info
 package.loaded["mp"] = mp
 package.loaded["mp.msg"] = mp.msg
 
-_G.mp_event_loop = function()
+local function mp_event_loop()
     mp.dispatch_events(true)
 end
 
+_G.mp_event_loop = mp_event_loop
+
 local function call_event_handlers(e)
     local handlers = event_handlers[e.event]
     if handlers then
@@ -496,6 +498,30 @@ function mp.dispatch_events(allow_wait)
     end
 end
 
+-- Called by the player instead of mp_event_loop() if scripts share threads
+-- (--script-threads). Process all pending events and timers without waiting,
+-- and return the time after which this must be called again if no new events
+-- arrive. Returns nil if the script exited, and false if the script replaced
+-- mp_event_loop() (then it's run on its own thread).
+_G.mp_event_step = function()
+    if _G.mp_event_loop ~= mp_event_loop then
+        return false
+    end
+    while mp.keep_running do
+        local e = mp.wait_event(0)
+        if e.event == "none" then
+            local wait = process_timers() or 1e20
+            for _, handler in ipairs(idle_handlers) do
+                handler()
+            end
+            mp.resume_all()
+            return wait
+        end
+        call_event_handlers(e)
+    end
+    return nil
+end
+
 -- additional helpers
 
 function mp.osd_message(text, duration)
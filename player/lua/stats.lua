@@ -18,6 +18,7 @@ local o = {
     key_page_1 = "1",
     key_page_2 = "2",
     key_page_3 = "3",
+    key_page_4 = "4",
 
     duration = 4,
     redraw_delay = 1,                -- acts as duration in the toggling case
@@ -599,6 +600,112 @@ local function vo_stats()
 end
 
 
+-- Returns an ASS string with demuxer cache stats
+local function cache_stats()
+    local stats = {}
+    eval_ass_formatting()
+    add_header(stats)
+
+    local c = mp.get_property_native("demuxer-cache-perf")
+    if not c then
+        append(stats, "unavailable", {prefix="Demuxer cache:", nl="", indent=""})
+        return table.concat(stats)
+    end
+
+    append(stats, "", {prefix="Demuxer cache:", nl="", indent=""})
+    append(stats, utils.format_bytes_humanized(c["total-bytes"]), {prefix="Total:"})
+    append(stats, utils.format_bytes_humanized(c["fw-bytes"]), {prefix="Readahead:"})
+    append(stats, c["ranges"], {prefix="Ranges:"})
+    append(stats, c["pruned-packets"], {prefix="Pruned:", suffix=" packets"})
+    append(stats, utils.format_bytes_humanized(c["pruned-bytes"]),
+           {prefix="(", suffix=")", nl="", indent=" ", prefix_sep="",
+            no_prefix_markup=true})
+    append(stats, c["low-level-seeks"], {prefix="Low level seeks:"})
+    append(stats, c["read-calls"], {prefix="Reads:"})
+    append(stats, format("%.3f s", c["read-time"]), {prefix="Read time:"})
+    append(stats, format("%.3f s", c["lock-wait-time"]), {prefix="Lock wait time:"})
+    if c["avg-packet-bytes"] then
+        append(stats, utils.format_bytes_humanized(c["avg-packet-bytes"]),
+               {prefix="Avg. packet size:"})
+    end
+
+    for _, st in ipairs(c["streams"]) do
+        if st["selected"] then
+            append(stats, "", {prefix=st["type"] .. " " .. st["index"] .. ":"})
+            append(stats, st["fw-packets"], {prefix="Readahead:", suffix=" packets",
+                   nl="", indent=o.prefix_sep})
+            append(stats, utils.format_bytes_humanized(st["fw-bytes"]),
+                   {prefix="(", suffix=")", nl="", indent=" ", prefix_sep="",
+                    no_prefix_markup=true})
+            append(stats, st["total-packets"], {prefix="Total:", suffix=" packets",
+                   nl="", indent=o.prefix_sep})
+            append(stats, utils.format_bytes_humanized(st["total-bytes"]),
+                   {prefix="(", suffix=")", nl="", indent=" ", prefix_sep="",
+                    no_prefix_markup=true})
+        end
+    end
+
+    return table.concat(stats)
+end
+
+
+-- Returns an ASS string with display timing stats
+local function display_stats()
+    local stats = {}
+    eval_ass_formatting()
+    add_header(stats)
+
+    local t = mp.get_property_native("vo-timing")
+    if not t then
+        append(stats, "unavailable", {prefix="Display timing:", nl="", indent=""})
+        return table.concat(stats)
+    end
+
+    append(stats, "", {prefix="Display timing:", nl="", indent=""})
+    if t["vsync-interval"] > 0 then
+        append(stats, format("%.3f ms", t["vsync-interval"] * 1e3),
+               {prefix="Vsync interval:"})
+    end
+    append(stats, format("%.3f", t["vsync-jitter"]), {prefix="Vsync jitter:"})
+    append(stats, t["samples"], {prefix="Presents:"})
+    append(stats, t["missed-vsyncs"], {prefix="Missed vsyncs:"})
+    append(stats, t["delayed-frames"], {prefix="Delayed frames:"})
+    append(stats, t["dropped-frames"], {prefix="Dropped frames:"})
+
+    local lat = t["render-latency"]
+    append(stats, format("%.2f ms", lat["last"] / 1e6), {prefix="Render latency:"})
+    append(stats, format("%.2f ms", lat["avg"] / 1e6),
+           {prefix="avg", nl="", indent=o.prefix_sep})
+    append(stats, format("%.2f ms", lat["peak"] / 1e6),
+           {prefix="peak", nl="", indent=o.prefix_sep})
+
+    local hist, samples = t["present-intervals"], t["samples"]
+    if samples < 1 then
+        return table.concat(stats)
+    end
+
+    append(stats, "", {prefix="Present intervals (vsyncs):"})
+    local hmax = 0
+    for _, v in ipairs(hist) do
+        hmax = max(hmax, v)
+    end
+    if o.use_ass then
+        stats[#stats+1] = generate_graph(hist, #hist, #hist, hmax, nil, 0.9, 1)
+    end
+    local width = t["bin-width"]
+    for n, v in ipairs(hist) do
+        if v > 0 then
+            local range = n < #hist and format("%.3f-%.3f", (n - 1) * width, n * width)
+                          or format(">= %.3f", (n - 1) * width)
+            append(stats, format("%d (%.1f%%)", v, v / samples * 100),
+                   {prefix=range .. ":"})
+        end
+    end
+
+    return table.concat(stats)
+end
+
+
 -- Returns an ASS string with stats about filters/profiles/shaders
 local function filter_stats()
     return "coming soon"
@@ -610,7 +717,8 @@ curr_page = o.key_page_1
 pages = {
     [o.key_page_1] = { f = default_stats, desc = "Default" },
     [o.key_page_2] = { f = vo_stats, desc = "Extended Frame Timings" },
-    --[o.key_page_3] = { f = filter_stats, desc = "Dummy" },
+    [o.key_page_3] = { f = cache_stats, desc = "Demuxer Cache" },
+    [o.key_page_4] = { f = display_stats, desc = "Display Timing" },
 }
 
 
@@ -47,6 +47,7 @@
 #include "options/parse_configfile.h"
 #include "options/parse_commandline.h"
 #include "common/playlist.h"
+#include "common/trace.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "input/input.h"
@@ -56,6 +57,7 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/out/vo.h"
+#include "video/image_loader.h"
 
 #include "core.h"
 #include "client.h"
@@ -118,6 +120,8 @@ void mp_update_logging(struct MPContext *mpctx, bool preinit)
 
     mp_msg_update_msglevels(mpctx->global);
 
+    mp_trace_set_buffer_size(mpctx->opts->trace_buffer);
+
     bool enable = mpctx->opts->use_terminal;
     bool enabled = cas_terminal_owner(mpctx, mpctx);
     if (enable != enabled) {
@@ -156,13 +160,17 @@ void mp_print_version(struct mp_log *log, int always)
 
 void mp_destroy(struct MPContext *mpctx)
 {
+    mp_benchmark_write_report(mpctx);
+
     mp_shutdown_clients(mpctx);
+    mp_script_pool_destroy(mpctx);
 
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
+    vd_lavc_free_cached_decoder();
 
     // If it's still set here, it's an error.
     encode_lavc_free(mpctx->encode_lavc_ctx);
@@ -279,7 +287,11 @@ struct MPContext *mp_create(void)
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
+        .sleep_deadline = INT64_MAX,
+        .playback_dirty = ATOMIC_VAR_INIT(true),
+        .image_cache = mp_image_cache_create(NULL),
     };
+    talloc_steal(mpctx, mpctx->image_cache);
 
     pthread_mutex_init(&mpctx->lock, NULL);
 
@@ -351,12 +363,14 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mp_print_version(mpctx->log, false);
 
     mp_parse_cfgfiles(mpctx);
+    mp_startup_mark(mpctx, "config-files");
 
     if (options) {
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
                                                mpctx->global, options);
         if (r < 0)
             return r == M_OPT_EXIT ? 1 : -1;
+        mp_startup_mark(mpctx, "command-line");
     }
 
     if (opts->operation_mode == 1) {
@@ -368,6 +382,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mp_get_resume_defaults(mpctx);
 
     mp_input_load_config(mpctx->input);
+    mp_startup_mark(mpctx, "input-config");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -425,12 +440,16 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     MP_WARN(mpctx, "There will be no OSD and no text subtitles.\n");
 #endif
 
+    mp_startup_mark(mpctx, "core-init");
+
     mp_load_scripts(mpctx);
+    mp_startup_mark(mpctx, "scripts");
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
 
     MP_STATS(mpctx, "end init");
+    mp_startup_mark(mpctx, "initialized");
 
     return 0;
 }
@@ -335,6 +335,34 @@ int stream_dump(struct MPContext *mpctx, const char *source_filename)
     return ok ? 0 : -1;
 }
 
+// Record the time at which a startup phase ended. Phases are recorded until
+// playback of the first file starts. phase must be a static string.
+void mp_startup_mark(struct MPContext *mpctx, const char *phase)
+{
+    if (mpctx->startup_trace_done)
+        return;
+    struct mp_startup_phase p = {phase, mp_time_us()};
+    MP_TARRAY_APPEND(mpctx, mpctx->startup_phases, mpctx->num_startup_phases, p);
+}
+
+// Stop recording startup phases, and print a summary.
+void mp_startup_trace_finish(struct MPContext *mpctx)
+{
+    if (mpctx->startup_trace_done)
+        return;
+    mpctx->startup_trace_done = true;
+
+    int msgl = mpctx->opts->startup_trace ? MSGL_INFO : MSGL_V;
+    MP_MSG(mpctx, msgl, "Startup times (ms since process start):\n");
+    int64_t prev = MP_START_TIME;
+    for (int n = 0; n < mpctx->num_startup_phases; n++) {
+        struct mp_startup_phase *p = &mpctx->startup_phases[n];
+        MP_MSG(mpctx, msgl, "  %-20s %9.3f (+%.3f)\n", p->name,
+               (p->time - MP_START_TIME) / 1e3, (p->time - prev) / 1e3);
+        prev = p->time;
+    }
+}
+
 void merge_playlist_files(struct playlist *pl)
 {
     if (!pl->first)
@@ -22,6 +22,10 @@
 #include <assert.h>
 
 #include "config.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include "mpv_talloc.h"
 
 #include "common/msg.h"
@@ -29,6 +33,7 @@
 #include "common/common.h"
 #include "common/encode.h"
 #include "common/recorder.h"
+#include "common/trace.h"
 #include "filters/f_decoder_wrapper.h"
 #include "options/m_config.h"
 #include "options/m_property.h"
@@ -39,6 +44,7 @@
 #include "osdep/terminal.h"
 #include "osdep/timer.h"
 
+#include "audio/audio_buffer.h"
 #include "audio/out/ao.h"
 #include "demux/demux.h"
 #include "stream/stream.h"
@@ -57,9 +63,20 @@ void mp_wait_events(struct MPContext *mpctx)
     if (sleeping)
         MP_STATS(mpctx, "start sleep");
 
+    // Nothing is time critical while paused or idle (only OSD, cache and
+    // similar updates), so let these wakeups be batched with other timers.
+    bool relaxed = mpctx->paused || !mpctx->playback_initialized;
+    mp_dispatch_set_timer_slack(mpctx->dispatch, relaxed ? 5000 : 0);
+
     mp_dispatch_queue_process(mpctx->dispatch, mpctx->sleeptime);
 
+    // Assume timeouts are for the playback state, unless they're known to be
+    // for something else.
+    if (mp_time_us() >= mpctx->sleep_deadline)
+        mp_set_playback_dirty(mpctx);
+
     mpctx->sleeptime = INFINITY;
+    mpctx->sleep_deadline = INT64_MAX;
 
     if (sleeping)
         MP_STATS(mpctx, "end sleep");
@@ -73,15 +90,25 @@ void mp_set_timeout(struct MPContext *mpctx, double sleeptime)
     if (mpctx->sleeptime > sleeptime) {
         mpctx->sleeptime = sleeptime;
         int64_t abstime = mp_add_timeout(mp_time_us(), sleeptime);
+        mpctx->sleep_deadline = MPMIN(mpctx->sleep_deadline, abstime);
         mp_dispatch_adjust_timeout(mpctx->dispatch, abstime);
     }
 }
 
+// Make the next playloop iteration update the playback state. Implied by
+// mp_wakeup_core(), commands and property writes. This can be called from any
+// thread, but only makes sense if the core is woken up as well.
+void mp_set_playback_dirty(struct MPContext *mpctx)
+{
+    atomic_store(&mpctx->playback_dirty, true);
+}
+
 // Cause the playloop to run. This can be called from any thread. If called
 // from within the playloop itself, it will be run immediately again, instead
 // of going to sleep in the next mp_wait_events().
 void mp_wakeup_core(struct MPContext *mpctx)
 {
+    mp_set_playback_dirty(mpctx);
     mp_dispatch_interrupt(mpctx->dispatch);
 }
 
@@ -100,6 +127,8 @@ void mp_process_input(struct MPContext *mpctx)
         mp_cmd_t *cmd = mp_input_read_cmd(mpctx->input);
         if (!cmd)
             break;
+        if (mpctx->video_out)
+            vo_mark_input(mpctx->video_out);
         run_command(mpctx, cmd, NULL);
         mp_cmd_free(cmd);
     }
@@ -114,6 +143,67 @@ double get_relative_time(struct MPContext *mpctx)
     return delta * 0.000001;
 }
 
+// Release memory that is not needed while paused or idle. Everything is
+// allocated again on demand when playback resumes.
+static void trim_memory(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    MP_VERBOSE(mpctx, "Trimming memory after %.1f seconds of inactivity.\n",
+               opts->memory_trim);
+
+    if (mpctx->video_out)
+        vo_control(mpctx->video_out, VOCTRL_TRIM_MEMORY, NULL);
+
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        if (track->dec)
+            mp_decoder_wrapper_control(track->dec, VDCTRL_TRIM_MEMORY, NULL);
+        if (opts->memory_trim_demuxer_cache && track->demuxer)
+            demux_trim_cache(track->demuxer);
+    }
+
+    if (mpctx->ao_chain)
+        mp_audio_buffer_trim(mpctx->ao_chain->ao_buffer);
+
+    // Frame backstepping falls back to seeking.
+    for (int n = 0; n < mpctx->num_backstep_frames; n++)
+        talloc_free(mpctx->backstep_frames[n]);
+    mpctx->num_backstep_frames = 0;
+    mpctx->backstep_pos = 0;
+
+#ifdef __GLIBC__
+    // Return the freed memory to the OS; glibc keeps it around otherwise.
+    malloc_trim(0);
+#endif
+}
+
+static void handle_memory_trim(struct MPContext *mpctx)
+{
+    double timeout = mpctx->opts->memory_trim;
+    bool inactive = mpctx->paused || !mpctx->playing;
+    if (!inactive || timeout <= 0) {
+        mpctx->memory_trim_time = 0;
+        mpctx->memory_trimmed = false;
+        return;
+    }
+
+    double now = mp_time_sec();
+    if (!mpctx->memory_trim_time)
+        mpctx->memory_trim_time = now;
+    if (mpctx->memory_trimmed)
+        return;
+
+    double remaining = mpctx->memory_trim_time + timeout - now;
+    if (remaining > 0) {
+        mp_set_timeout(mpctx, remaining);
+        return;
+    }
+
+    trim_memory(mpctx);
+    mpctx->memory_trimmed = true;
+}
+
 void update_core_idle_state(struct MPContext *mpctx)
 {
     bool eof = mpctx->video_status == STATUS_EOF &&
@@ -166,6 +256,7 @@ void set_pause_state(struct MPContext *mpctx, bool user_pause)
             mpctx->time_frame -= get_relative_time(mpctx);
         } else {
             (void)get_relative_time(mpctx); // ignore time that passed during pause
+            mp_backstep_cache_resume(mpctx);
         }
     }
 
@@ -194,6 +285,9 @@ void add_step_frame(struct MPContext *mpctx, int dir)
 {
     if (!mpctx->vo_chain)
         return;
+    // Only step through the cache if paused, e.g. not while frame stepping.
+    if (mpctx->paused && !mpctx->step_frames && mp_backstep_cache_step(mpctx, dir))
+        return;
     if (dir > 0) {
         mpctx->step_frames += 1;
         set_pause_state(mpctx, false);
@@ -671,6 +765,13 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
             mp_set_timeout(mpctx, mpctx->next_cache_update - now);
     }
 
+    // Seek ranges can change while the cache is idle (e.g. on pruning). While
+    // busy, the periodic update above already covers it.
+    if (mpctx->cache_seek_ranges_version != s.seek_ranges_version) {
+        mpctx->cache_seek_ranges_version = s.seek_ranges_version;
+        force_update |= !busy;
+    }
+
     if (mpctx->cache_buffer != cache_buffer) {
         if ((mpctx->cache_buffer == 100) != (cache_buffer == 100)) {
             if (cache_buffer < 100) {
@@ -689,7 +790,17 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
         force_update = true;
     }
 
-    if (s.eof && !busy)
+    // Normally prefetch once the current file was fully read. Optionally
+    // start earlier, when only a few seconds are left to play.
+    bool near_end = false;
+    if (opts->prefetch_time > 0) {
+        double len = get_time_length(mpctx);
+        double pos = get_playback_time(mpctx);
+        near_end = len > 0 && pos != MP_NOPTS_VALUE &&
+                   len - pos <= opts->prefetch_time * opts->playback_speed;
+    }
+
+    if ((s.eof && !busy) || near_end)
         prefetch_next(mpctx);
 
     if (force_update)
@@ -1036,6 +1147,10 @@ static void handle_playback_restart(struct MPContext *mpctx)
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
         update_core_idle_state(mpctx);
+        if (!mpctx->startup_trace_done) {
+            mp_startup_mark(mpctx, "playback-start");
+            mp_startup_trace_finish(mpctx);
+        }
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
                 char *msg =
@@ -1086,23 +1201,33 @@ void run_playloop(struct MPContext *mpctx)
         return;
     }
 
+    // Traced in two parts, so the time spent waiting is not included.
+    int64_t trace = mp_trace_begin();
+
     update_demuxer_properties(mpctx);
 
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     handle_command_updates(mpctx);
+    mp_client_update_observe_timers(mpctx);
 
     if (mpctx->lavfi && mp_filter_has_failed(mpctx->lavfi))
         mpctx->stop_play = AT_END_OF_FILE;
 
-    fill_audio_out_buffers(mpctx);
-    write_video(mpctx);
+    // While paused, most wakeups are for client API requests (like polling
+    // property values), which don't affect audio/video output.
+    bool idle = mpctx->paused && mpctx->restart_complete &&
+                !mpctx->seek.type && !mpctx->step_frames;
+    if (atomic_exchange(&mpctx->playback_dirty, false) || !idle) {
+        fill_audio_out_buffers(mpctx);
+        write_video(mpctx);
 
-    handle_delayed_audio_seek(mpctx);
+        handle_delayed_audio_seek(mpctx);
 
-    handle_playback_restart(mpctx);
+        handle_playback_restart(mpctx);
 
-    handle_playback_time(mpctx);
+        handle_playback_time(mpctx);
+    }
 
     handle_dummy_ticks(mpctx);
 
@@ -1120,14 +1245,20 @@ void run_playloop(struct MPContext *mpctx)
 
     update_core_idle_state(mpctx);
 
-    if (mpctx->stop_play)
+    handle_memory_trim(mpctx);
+
+    if (mpctx->stop_play) {
+        mp_trace_end("run_playloop", trace);
         return;
+    }
 
     handle_osd_redraw(mpctx);
 
     if (mp_filter_run(mpctx->filter_root))
         mp_wakeup_core(mpctx);
+    mp_trace_end("run_playloop", trace);
     mp_wait_events(mpctx);
+    trace = mp_trace_begin();
 
     handle_pause_on_low_cache(mpctx);
 
@@ -1138,6 +1269,8 @@ void run_playloop(struct MPContext *mpctx)
     handle_force_window(mpctx, false);
 
     execute_queued_seek(mpctx);
+
+    mp_trace_end("run_playloop", trace);
 }
 
 void mp_idle(struct MPContext *mpctx)
@@ -1146,10 +1279,12 @@ void mp_idle(struct MPContext *mpctx)
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
+    mp_client_update_observe_timers(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     update_osd_msg(mpctx);
     handle_osd_redraw(mpctx);
+    handle_memory_trim(mpctx);
 }
 
 // Waiting for the slave master to send us a new file to play.
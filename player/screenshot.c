@@ -19,6 +19,8 @@
 #include <string.h>
 #include <time.h>
 
+#include <libavutil/cpu.h>
+
 #include "config.h"
 
 #include "osdep/io.h"
@@ -31,15 +33,24 @@
 #include "misc/dispatch.h"
 #include "misc/thread_pool.h"
 #include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
 #include "options/path.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
 #include "video/out/vo.h"
 #include "video/image_writer.h"
+#include "video/sws_utils.h"
+#include "stream/stream.h"
 #include "sub/osd.h"
 
 #include "video/csputils.h"
 
+// Upper bound for the number of threads writing screenshots.
+#define MAX_THREADS 16
+
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
@@ -53,6 +64,11 @@ typedef struct screenshot_ctx {
     int frameno;
 
     struct mp_thread_pool *thread_pool;
+    int num_threads;
+    // Files queued for async writing, which possibly don't exist yet. Access
+    // requires the core lock.
+    char **pending_files;
+    int num_pending_files;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -122,6 +138,12 @@ static void write_screenshot_thread(void *arg)
 
     if (item->on_thread) {
         mp_dispatch_lock(item->mpctx->dispatch);
+        for (int n = 0; n < ctx->num_pending_files; n++) {
+            if (ctx->pending_files[n] == item->filename) {
+                MP_TARRAY_REMOVE_AT(ctx->pending_files, ctx->num_pending_files, n);
+                break;
+            }
+        }
         screenshot_msg(ctx, MSGL_V, "Screenshot writing done.");
         item->mpctx->outstanding_async -= 1;
         mp_wakeup_core(item->mpctx);
@@ -147,11 +169,19 @@ static void write_screenshot(struct MPContext *mpctx, struct mp_image *img,
     };
 
     if (async) {
-        if (!ctx->thread_pool)
-            ctx->thread_pool = mp_thread_pool_create(ctx, 1);
-        if (ctx->thread_pool) {
+        if (!ctx->thread_pool) {
+            ctx->num_threads = MPCLAMP(av_cpu_count(), 1, MAX_THREADS);
+            ctx->thread_pool = mp_thread_pool_create(ctx, ctx->num_threads);
+        }
+        // Bound the memory used by queued images. If too many are queued,
+        // write synchronously, which throttles e.g. "screenshot each-frame".
+        if (ctx->thread_pool &&
+            ctx->num_pending_files < ctx->num_threads * 2)
+        {
             item->on_thread = true;
             mpctx->outstanding_async += 1;
+            MP_TARRAY_APPEND(ctx, ctx->pending_files, ctx->num_pending_files,
+                             (char *)item->filename);
             mp_thread_pool_queue(ctx->thread_pool, write_screenshot_thread, item);
             item = NULL;
         }
@@ -334,6 +364,15 @@ error_exit:
     return NULL;
 }
 
+static bool file_exists(screenshot_ctx *ctx, const char *fname)
+{
+    for (int n = 0; n < ctx->num_pending_files; n++) {
+        if (strcmp(ctx->pending_files[n], fname) == 0)
+            return true;
+    }
+    return mp_path_exists(fname);
+}
+
 static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
 {
     int sequence = 0;
@@ -368,7 +407,7 @@ static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
             mp_mkdirp(full_dir);
         }
 
-        if (!mp_path_exists(fname))
+        if (!file_exists(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -503,6 +542,140 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     talloc_free(image);
 }
 
+// Scale img to fit into a w*h box (keeping the display aspect), and convert
+// it to BGR0.
+static struct mp_image *scale_thumbnail(struct mp_image *img, int w, int h,
+                                        struct mp_log *log)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (d_w < 1 || d_h < 1)
+        return NULL;
+    if (w <= 0 && h <= 0) {
+        w = d_w;
+        h = d_h;
+    } else if (w <= 0 || (h > 0 && (int64_t)h * d_w < (int64_t)w * d_h)) {
+        w = MPMAX(1, (int)((int64_t)h * d_w / d_h));
+    } else {
+        h = MPMAX(1, (int)((int64_t)w * d_h / d_w));
+    }
+
+    struct mp_image_params p = {
+        .imgfmt = IMGFMT_BGR0,
+        .w = w,
+        .h = h,
+        .p_w = 1,
+        .p_h = 1,
+    };
+    mp_image_params_guess_csp(&p);
+
+    struct mp_image *dst = mp_image_alloc(p.imgfmt, p.w, p.h);
+    if (!dst) {
+        mp_err(log, "Out of memory.\n");
+        return NULL;
+    }
+    mp_image_copy_attributes(dst, img);
+    dst->params = p;
+
+    if (mp_image_swscale(dst, img, mp_sws_fast_flags) < 0) {
+        mp_err(log, "Error when scaling thumbnail.\n");
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+// Decode the first frame the decoder outputs after a seek. Since the seek
+// goes to a keyframe, and the first frame after it is returned, no further
+// packets than needed for this frame are decoded.
+static struct mp_image *decode_first_frame(struct mp_filter *root,
+                                           struct mp_decoder_wrapper *dec,
+                                           struct mp_cancel *cancel)
+{
+    struct mp_pin *pin = dec->f->pins[0];
+    while (!mp_cancel_test(cancel)) {
+        if (!mp_pin_out_request_data(pin)) {
+            if (!mp_filter_run(root) && !mp_pin_out_has_data(pin))
+                return NULL; // graph is stuck (should not happen)
+            continue;
+        }
+        struct mp_frame frame = mp_pin_out_read(pin);
+        if (frame.type == MP_FRAME_VIDEO)
+            return frame.data;
+        bool eof = frame.type == MP_FRAME_EOF;
+        mp_frame_unref(&frame);
+        if (eof)
+            return NULL;
+    }
+    return NULL;
+}
+
+struct mp_image **screenshot_get_thumbnails(struct MPContext *mpctx,
+                                            const char *url, double *pts,
+                                            int num_pts, int w, int h)
+{
+    struct mp_log *log = mpctx->log;
+    struct mp_image **res = talloc_zero_array(NULL, struct mp_image *, num_pts);
+
+    struct demuxer_params params = {0};
+    struct demuxer *demuxer =
+        demux_open_url(url, &params, mpctx->playback_abort, mpctx->global);
+    if (!demuxer) {
+        MP_ERR(mpctx, "Thumbnails: could not open '%s'.\n", url);
+        goto done;
+    }
+    if (mpctx->opts->rebase_start_time)
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh || !demuxer->seekable) {
+        MP_ERR(mpctx, "Thumbnails: no seekable video stream in '%s'.\n", url);
+        goto done;
+    }
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    struct mp_filter *root = mp_filter_create_root(mpctx->global);
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec) {
+        talloc_free(root);
+        goto done;
+    }
+
+    for (int n = 0; n < num_pts; n++) {
+        if (mp_cancel_test(mpctx->playback_abort))
+            break;
+        mp_filter_reset(root);
+        // No SEEK_HR: this lands on the keyframe before the target, which
+        // is the frame we return.
+        demux_seek(demuxer, pts[n], 0);
+        struct mp_image *img =
+            decode_first_frame(root, dec, mpctx->playback_abort);
+        if (img && (img->fmt.flags & MP_IMGFLAG_HWACCEL)) {
+            struct mp_image *nimg = mp_image_hw_download(img, NULL);
+            talloc_free(img);
+            img = nimg;
+        }
+        if (img)
+            res[n] = talloc_steal(res, scale_thumbnail(img, w, h, log));
+        talloc_free(img);
+        if (!res[n])
+            MP_WARN(mpctx, "Thumbnails: no frame at %f.\n", pts[n]);
+    }
+
+    talloc_free(root);
+
+done:
+    free_demuxer_and_stream(demuxer);
+    return res;
+}
+
 void screenshot_flip(struct MPContext *mpctx)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
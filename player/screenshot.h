@@ -42,6 +42,15 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
 // mode is the same as in screenshot_request()
 struct mp_image *screenshot_get_rgb(struct MPContext *mpctx, int mode);
 
+// Open url separately from playback, and decode a frame for each timestamp in
+// pts[]. Only the keyframe preceding each timestamp is decoded. The images are
+// scaled to fit into w*h (if either is <= 0, it is derived from the aspect
+// ratio), and converted to BGR0. Returns an array with num_pts entries, each
+// NULL on failure (free the array with talloc_free()). Blocks until done.
+struct mp_image **screenshot_get_thumbnails(struct MPContext *mpctx,
+                                            const char *url, double *pts,
+                                            int num_pts, int w, int h);
+
 // Called by the playback core code when a new frame is displayed.
 void screenshot_flip(struct MPContext *mpctx);
 
@@ -27,6 +27,7 @@
 
 #include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -100,6 +101,230 @@ static void *script_thread(void *p)
     return NULL;
 }
 
+// Shared threads for --script-threads. Each script is run by at most one
+// thread at a time, and only if it has new events, or a timer expired.
+struct script_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t *threads;
+    int num_threads;
+    struct pooled_script **scripts;
+    int num_scripts;
+    bool terminate;
+};
+
+struct pooled_script {
+    struct script_pool *pool;
+    struct thread_arg *arg;
+    void *state;            // NULL if not loaded yet
+    // Protected by pool->lock.
+    bool running;           // currently run by a pool thread
+    bool wakeup;            // new events might be available
+    double deadline;        // mp_time_sec() at which it must be run again
+};
+
+static void destroy_pooled_script(struct pooled_script *s)
+{
+    mpv_set_wakeup_callback(s->arg->client, NULL, NULL);
+    if (s->state)
+        s->arg->backend->destroy(s->state);
+    mpv_destroy(s->arg->client);
+    talloc_free(s);
+}
+
+static void *pooled_script_thread(void *p)
+{
+    pthread_detach(pthread_self());
+
+    struct pooled_script *s = p;
+
+    char name[90];
+    snprintf(name, sizeof(name), "%s (%s)", s->arg->backend->name,
+             mpv_client_name(s->arg->client));
+    mpthread_set_name(name);
+
+    s->arg->backend->run(s->state);
+
+    destroy_pooled_script(s);
+    return NULL;
+}
+
+// Script was removed from the pool. Called without lock.
+static void finish_pooled_script(struct pooled_script *s, double res)
+{
+    if (res == MP_SCRIPT_NEEDS_THREAD) {
+        MP_VERBOSE(s->arg, "Script has its own event loop, moving it to a "
+                   "separate thread.\n");
+        // Not part of the pool anymore; must not access it.
+        mpv_set_wakeup_callback(s->arg->client, NULL, NULL);
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pooled_script_thread, s) == 0)
+            return;
+        MP_ERR(s->arg, "Could not create script thread.\n");
+    }
+    destroy_pooled_script(s);
+}
+
+// Called without lock.
+static double step_pooled_script(struct pooled_script *s)
+{
+    const struct mp_scripting *backend = s->arg->backend;
+    if (!s->state) {
+        s->state = backend->start(s->arg->client, s->arg->fname);
+        if (!s->state) {
+            MP_ERR(s->arg, "Could not load %s %s\n", backend->name,
+                   s->arg->fname);
+            return MP_SCRIPT_DONE;
+        }
+    }
+    return backend->step(s->state);
+}
+
+static void *script_pool_thread(void *p)
+{
+    struct script_pool *pool = p;
+    mpthread_set_name("script pool");
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        double now = mp_time_sec();
+        double wait_until = INFINITY;
+        struct pooled_script *s = NULL;
+        int index = -1;
+        for (int n = 0; n < pool->num_scripts; n++) {
+            struct pooled_script *c = pool->scripts[n];
+            if (c->running)
+                continue;
+            if (c->wakeup || c->deadline <= now) {
+                s = c;
+                index = n;
+                break;
+            }
+            wait_until = MPMIN(wait_until, c->deadline);
+        }
+
+        if (s) {
+            // Move it to the end, so other scripts get a chance first.
+            MP_TARRAY_REMOVE_AT(pool->scripts, pool->num_scripts, index);
+            MP_TARRAY_APPEND(pool, pool->scripts, pool->num_scripts, s);
+            s->running = true;
+            s->wakeup = false;
+            pthread_mutex_unlock(&pool->lock);
+
+            double res = step_pooled_script(s);
+
+            pthread_mutex_lock(&pool->lock);
+            s->running = false;
+            if (res >= 0) {
+                s->deadline = mp_time_sec() + res;
+                continue;
+            }
+            for (int n = 0; n < pool->num_scripts; n++) {
+                if (pool->scripts[n] == s) {
+                    MP_TARRAY_REMOVE_AT(pool->scripts, pool->num_scripts, n);
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&pool->lock);
+            finish_pooled_script(s, res);
+            pthread_mutex_lock(&pool->lock);
+            continue;
+        }
+
+        if (pool->terminate && !pool->num_scripts)
+            break;
+
+        if (wait_until == INFINITY) {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        } else {
+            int64_t end = mp_add_timeout(mp_time_us(), wait_until - now);
+            struct timespec ts = mp_time_us_to_timespec(end);
+            pthread_cond_timedwait(&pool->wakeup, &pool->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Called by the client API whenever new events are queued. Can be called from
+// any thread.
+static void wakeup_pooled_script(void *p)
+{
+    struct pooled_script *s = p;
+    struct script_pool *pool = s->pool;
+    pthread_mutex_lock(&pool->lock);
+    s->wakeup = true;
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static struct script_pool *get_script_pool(struct MPContext *mpctx)
+{
+    if (mpctx->script_pool)
+        return mpctx->script_pool;
+
+    struct script_pool *pool = talloc_zero(NULL, struct script_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    int num = mpctx->opts->script_threads;
+    pool->threads = talloc_array(pool, pthread_t, num);
+    for (int n = 0; n < num; n++) {
+        if (pthread_create(&pool->threads[n], NULL, script_pool_thread, pool))
+            break;
+        pool->num_threads++;
+    }
+    mpctx->script_pool = pool;
+    if (!pool->num_threads) {
+        mp_script_pool_destroy(mpctx);
+        return NULL;
+    }
+    MP_VERBOSE(mpctx, "Running scripts on %d shared threads.\n",
+               pool->num_threads);
+    return pool;
+}
+
+// Must be called after all clients were destroyed.
+void mp_script_pool_destroy(struct MPContext *mpctx)
+{
+    struct script_pool *pool = mpctx->script_pool;
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->terminate = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int n = 0; n < pool->num_threads; n++)
+        pthread_join(pool->threads[n], NULL);
+
+    assert(!pool->num_scripts);
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+    talloc_free(pool);
+    mpctx->script_pool = NULL;
+}
+
+static bool add_pooled_script(struct MPContext *mpctx, struct thread_arg *arg)
+{
+    struct script_pool *pool = get_script_pool(mpctx);
+    if (!pool)
+        return false;
+
+    struct pooled_script *s = talloc_zero(NULL, struct pooled_script);
+    s->pool = pool;
+    s->arg = talloc_steal(s, arg);
+    s->wakeup = true;
+
+    pthread_mutex_lock(&pool->lock);
+    MP_TARRAY_APPEND(pool, pool->scripts, pool->num_scripts, s);
+    pthread_mutex_unlock(&pool->lock);
+
+    // This also triggers the first run.
+    mpv_set_wakeup_callback(arg->client, wakeup_pooled_script, s);
+    return true;
+}
+
 static int mp_load_script(struct MPContext *mpctx, const char *fname)
 {
     char *ext = mp_splitext(fname, NULL);
@@ -136,6 +361,10 @@ static int mp_load_script(struct MPContext *mpctx, const char *fname)
 
     MP_DBG(arg, "Loading %s %s...\n", backend->name, fname);
 
+    if (mpctx->opts->script_threads > 0 && backend->start &&
+        add_pooled_script(mpctx, arg))
+        return 0;
+
     pthread_t thread;
     if (pthread_create(&thread, NULL, script_thread, arg)) {
         mpv_destroy(arg->client);
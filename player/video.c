@@ -39,6 +39,7 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/hwdec.h"
+#include "video/image_loader.h"
 #include "filters/f_decoder_wrapper.h"
 #include "video/out/vo.h"
 
@@ -103,6 +104,11 @@ void reset_video_state(struct MPContext *mpctx)
     mpctx->num_next_frames = 0;
     mp_image_unrefp(&mpctx->saved_frame);
 
+    for (int n = 0; n < mpctx->num_backstep_frames; n++)
+        talloc_free(mpctx->backstep_frames[n]);
+    mpctx->num_backstep_frames = 0;
+    mpctx->backstep_pos = 0;
+
     mpctx->delay = 0;
     mpctx->time_frame = 0;
     mpctx->video_pts = MP_NOPTS_VALUE;
@@ -181,6 +187,10 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     if (!track->dec)
         goto err_out;
 
+    mp_image_cache_set_max_bytes(mpctx->image_cache,
+                                 mpctx->opts->image_cache_max_bytes);
+    track->dec->image_cache = mpctx->image_cache;
+
     if (!mp_decoder_wrapper_reinit(track->dec))
         goto err_out;
 
@@ -225,13 +235,35 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
             .wakeup_cb = mp_wakeup_core_cb,
             .wakeup_ctx = mpctx,
         };
+        struct m_geometry *wall = &mpctx->opts->video_wall;
+        if (wall->wh_valid && !wall->w_per && !wall->h_per &&
+            wall->w * wall->h > 1 && !mpctx->encode_lavc_ctx)
+        {
+            ex.wall = (struct vo_wall_tile){
+                .cols = wall->w,
+                .rows = wall->h,
+                .fullscreen = mpctx->opts->video_wall_fs,
+            };
+        }
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        mp_startup_mark(mpctx, "vo-init");
         if (!mpctx->video_out) {
             MP_FATAL(mpctx, "Error opening/initializing "
                     "the selected video_out (--vo) device.\n");
             mpctx->error_playing = MPV_ERROR_VO_INIT_FAILED;
             goto err_out;
         }
+        // The other tiles are fed by the primary VO (see vo_add_mirror()).
+        for (int n = 1; n < ex.wall.cols * ex.wall.rows; n++) {
+            struct vo_extra mex = ex;
+            mex.wall.index = n;
+            struct vo *mirror = init_best_video_out(mpctx->global, &mex);
+            if (!mirror) {
+                MP_ERR(mpctx, "Could not create VO for video wall tile %d.\n", n);
+                continue;
+            }
+            vo_add_mirror(mpctx->video_out, mirror);
+        }
         mpctx->mouse_cursor_visible = true;
     }
 
@@ -304,6 +336,78 @@ void mp_force_video_refresh(struct MPContext *mpctx)
     }
 }
 
+// Keep a reference to a frame sent to the VO, for mp_backstep_cache_step().
+static void backstep_cache_add(struct MPContext *mpctx, struct mp_image *img)
+{
+    // +1 for the currently displayed frame.
+    int max = mpctx->opts->video_backstep_cache + 1;
+    // Hardware decoded frames are not kept, as they'd hold on to surfaces from
+    // the decoder's (often fixed size) pool.
+    if (max < 2 || IMGFMT_IS_HWACCEL(img->imgfmt) || mpctx->vo_chain->is_coverart)
+        return;
+
+    if (mpctx->num_backstep_frames >= max) {
+        talloc_free(mpctx->backstep_frames[0]);
+        MP_TARRAY_REMOVE_AT(mpctx->backstep_frames, mpctx->num_backstep_frames, 0);
+    }
+    struct mp_image *ref = mp_image_new_ref(img);
+    if (ref) {
+        MP_TARRAY_APPEND(mpctx, mpctx->backstep_frames,
+                         mpctx->num_backstep_frames, ref);
+    }
+}
+
+// Display the frame dir frames away from the displayed one, if it's in the
+// backstep cache. The decoder is not touched. Returns false if the frame is
+// not available (or can't be displayed right now); the caller should seek.
+bool mp_backstep_cache_step(struct MPContext *mpctx, int dir)
+{
+    struct vo *vo = mpctx->video_out;
+    int pos = mpctx->backstep_pos - dir;
+
+    if (!mpctx->vo_chain || !vo || !vo->params || mpctx->hrseek_active ||
+        mpctx->video_status < STATUS_PLAYING || pos < 0 ||
+        pos >= mpctx->num_backstep_frames || !vo_is_ready_for_frame(vo, -1))
+        return false;
+
+    struct mp_image *img =
+        mpctx->backstep_frames[mpctx->num_backstep_frames - 1 - pos];
+    if (!mp_image_params_equal(&img->params, vo->params))
+        return false;
+
+    struct vo_frame dummy = {
+        .pts = mp_time_us(),
+        .duration = -1,
+        .still = true,
+        .num_frames = 1,
+        .num_vsyncs = 1,
+        .frames = {img},
+    };
+    vo_queue_frame(vo, vo_frame_ref(&dummy));
+
+    MP_VERBOSE(mpctx, "Showing cached frame %d frames back.\n", pos);
+    mpctx->backstep_pos = pos;
+    mpctx->video_pts = img->pts;
+    mpctx->playback_pts = img->pts;
+    update_subtitles(mpctx, img->pts);
+    mpctx->osd_force_update = true;
+    update_osd_msg(mpctx);
+    mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+    mp_wakeup_core(mpctx);
+    return true;
+}
+
+// Called when playback is resumed. If a cached frame is displayed, the decoder
+// is still after the newest cached frame, so continue from the displayed frame
+// with a precise seek.
+void mp_backstep_cache_resume(struct MPContext *mpctx)
+{
+    if (mpctx->backstep_pos > 0) {
+        queue_seek(mpctx, MPSEEK_ABSOLUTE, mpctx->video_pts, MPSEEK_VERY_EXACT, 0);
+        mpctx->backstep_pos = 0;
+    }
+}
+
 static void check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -1142,6 +1246,7 @@ void write_video(struct MPContext *mpctx)
 
     mpctx->video_pts = mpctx->next_frames[0]->pts;
     mpctx->last_vo_pts = mpctx->video_pts;
+    backstep_cache_add(mpctx, mpctx->next_frames[0]);
     mpctx->last_frame_duration =
         mpctx->next_frames[0]->pkt_duration / mpctx->video_speed;
 
@@ -1153,6 +1258,7 @@ void write_video(struct MPContext *mpctx)
     update_osd_msg(mpctx);
 
     vo_queue_frame(vo, frame);
+    mpctx->frames_queued++;
 
     check_framedrop(mpctx, vo_c);
 
@@ -1160,6 +1266,8 @@ void write_video(struct MPContext *mpctx)
     if (mpctx->num_next_frames >= 1)
         handle_new_frame(mpctx);
 
+    if (!mpctx->shown_vframes)
+        mp_startup_mark(mpctx, "first-video-frame");
     mpctx->shown_vframes++;
     if (mpctx->video_status < STATUS_PLAYING) {
         mpctx->video_status = STATUS_READY;
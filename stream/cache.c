@@ -32,6 +32,12 @@
 // the cache is active.
 #define CACHE_UPDATE_CONTROLS_TIME 2.0
 
+// Size of the byte ranges requested with --cache-connections.
+#define FETCH_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Maximum amount of data requested at once by a fetcher thread.
+#define FETCH_READ_SIZE (64 * 1024)
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,12 +55,15 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 
 #include "common/msg.h"
 #include "common/tags.h"
+#include "misc/thread_sched.h"
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 #include "common/common.h"
@@ -73,7 +82,12 @@ const struct m_sub_options stream_cache_conf = {
         OPT_INTRANGE("cache-seek-min", seek_min, 0, 0, 0x7fffffff),
         OPT_INTRANGE("cache-backbuffer", back_buffer, 0, 0, 0x7fffffff),
         OPT_STRING("cache-file", file, M_OPT_FILE),
+        OPT_STRING("cache-file-dir", file_dir, M_OPT_FILE),
+        OPT_INTRANGE("cache-file-dir-size", file_dir_max, 0, 0, 0x7fffffff),
         OPT_INTRANGE("cache-file-size", file_max, 0, 0, 0x7fffffff),
+        OPT_INTRANGE("cache-connections", connections, 0, 1, 16),
+        OPT_DOUBLE("cache-readahead-secs", readahead_secs, M_OPT_MIN, .min = 0),
+        OPT_FLAG("cache-shared", shared, 0),
         {0}
     },
     .size = sizeof(struct mp_cache_opts),
@@ -84,9 +98,28 @@ const struct m_sub_options stream_cache_conf = {
         .seek_min = 500,
         .back_buffer = 10000,
         .file_max = 1024 * 1024,
+        .file_dir_max = 4 * 1024 * 1024,
+        .connections = 1,
     },
 };
 
+struct priv;
+
+// A separate connection which downloads byte ranges (chunks) for the cache.
+struct fetcher {
+    struct priv *s;
+    pthread_t thread;
+    stream_t *stream;       // owned by the fetcher thread
+    unsigned char *data;    // FETCH_CHUNK_SIZE bytes
+    // The following fields are protected by priv.mutex. Only the fetcher
+    // thread writes data[len...] while the chunk is assigned.
+    int64_t pos;            // start pos of the assigned chunk, or -1 if none
+    int64_t len;            // bytes downloaded so far
+    bool done;              // finished (fetcher thread is idle)
+    bool failed;            // done because of an error
+    bool abort;             // cache thread doesn't need the chunk anymore
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
@@ -100,6 +133,7 @@ struct priv {
     int64_t buffer_size;    // size of the allocated buffer memory
     int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
+    double readahead_secs;  // --cache-readahead-secs
     bool seekable;          // underlying stream is seekable
 
     struct mp_log *log;
@@ -122,14 +156,23 @@ struct priv {
                             // to the byte at max_filepos (must be wrapped by
                             // buffer_size)
 
+    // Copies of max_filepos and offset, written by the cache thread with the
+    // mutex held. The main thread reads them without locking (read_lockless()).
+    mp_atomic_int64 avail_filepos;
+    mp_atomic_int64 avail_offset;
+
     bool idle;              // cache thread has stopped reading
     int64_t reads;          // number of actual read attempts performed
     int64_t speed_start;    // start time (us) for calculating download speed
     int64_t speed_amount;   // bytes read since speed_start
     double speed;
+    double bitrate;         // bytes per second of playback (0 if unknown)
 
     bool enable_readahead;  // actively read beyond read() position
-    int64_t read_filepos;   // client read position (mirrors cache->pos)
+    // client read position (mirrors cache->pos). Written by the main thread
+    // only, and read by the cache thread without locking if the main thread
+    // reads with read_lockless().
+    mp_atomic_int64 read_filepos;
     int64_t read_min;       // file position until which the thread should
                             // read even if readahead is disabled
 
@@ -148,6 +191,15 @@ struct priv {
     struct mp_tags *stream_metadata;
     double start_pts;
     bool has_avseek;
+
+    // --cache-connections (if num_fetchers > 0)
+    struct fetcher *fetchers;
+    int num_fetchers;
+    pthread_cond_t fetch_wakeup; // wakes up fetcher threads
+    struct mp_cancel *fetch_cancel;
+    char *fetch_url;
+    bool fetch_failed;      // fall back to reading from s->stream
+    bool fetch_terminate;
 };
 
 enum {
@@ -182,12 +234,20 @@ static bool cache_wakeup_and_wait(struct priv *s, double *retry_time)
     return !mp_cancel_test(s->cache->cancel);
 }
 
+// Make newly written data visible to read_lockless(). The mutex must be held.
+static void publish_ringbuffer(struct priv *s)
+{
+    atomic_store(&s->avail_offset, s->offset);
+    atomic_store(&s->avail_filepos, s->max_filepos);
+}
+
 // Runs in the cache thread
 static void cache_drop_contents(struct priv *s)
 {
-    s->offset = s->min_filepos = s->max_filepos = s->read_filepos;
+    s->offset = s->min_filepos = s->max_filepos = atomic_load(&s->read_filepos);
     s->eof = false;
     s->start_pts = MP_NOPTS_VALUE;
+    publish_ringbuffer(s);
 }
 
 static void update_speed(struct priv *s)
@@ -234,6 +294,34 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
     return read;
 }
 
+// Runs in the main thread. Copy at most dst_size bytes from read_filepos and
+// advance it, without locking the mutex. Returns the number of bytes read, which
+// is 0 if no new data is available yet.
+// This works because read_filepos is written only by the main thread, and the
+// cache thread never overwrites data between read_filepos and avail_filepos.
+// Buffer reallocation and cache flushes happen only while the main thread is
+// blocked in cache_control() or cache_seek().
+static int read_lockless(struct priv *s, unsigned char *dst, int dst_size)
+{
+    int64_t pos = atomic_load(&s->read_filepos);
+    int64_t offset = atomic_load(&s->avail_offset);
+    int64_t len = MPMIN(atomic_load(&s->avail_filepos) - pos, dst_size);
+    if (len <= 0)
+        return 0;
+
+    // offset changes by buffer_size on wrap-around, which doesn't matter here.
+    int64_t bpos = (pos - offset) % s->buffer_size;
+    if (bpos < 0)
+        bpos += s->buffer_size;
+
+    int64_t part = MPMIN(len, s->buffer_size - bpos);
+    memcpy(dst, &s->buffer[bpos], part);
+    memcpy(dst + part, &s->buffer[0], len - part);
+
+    atomic_store(&s->read_filepos, pos + len);
+    return len;
+}
+
 // Whether a seek will be needed to get to the position. This honors seek_limit,
 // which is a heuristic to prevent dropping the cache with small forward seeks.
 // This helps in situations where waiting for network a bit longer would quickly
@@ -244,9 +332,14 @@ static bool needs_seek(struct priv *s, int64_t pos)
     return pos < s->min_filepos || pos > s->max_filepos + s->seek_limit;
 }
 
+static bool fetching(struct priv *s)
+{
+    return s->num_fetchers && !s->fetch_failed;
+}
+
 static bool cache_update_stream_position(struct priv *s)
 {
-    int64_t read = s->read_filepos;
+    int64_t read = atomic_load(&s->read_filepos);
 
     s->read_seek_failed = false;
 
@@ -257,6 +350,10 @@ static bool cache_update_stream_position(struct priv *s)
         cache_drop_contents(s);
     }
 
+    // (The fetchers request data at arbitrary positions anyway.)
+    if (fetching(s))
+        return true;
+
     if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
         MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
                    stream_tell(s->stream), s->max_filepos);
@@ -269,10 +366,152 @@ static bool cache_update_stream_position(struct priv *s)
     return stream_tell(s->stream) == s->max_filepos;
 }
 
+static void *fetch_thread(void *arg)
+{
+    struct fetcher *f = arg;
+    struct priv *s = f->s;
+    mpthread_set_name("cache-fetch");
+    mp_thread_sched_apply(s->stream->global, s->log, "cache");
+
+    pthread_mutex_lock(&s->mutex);
+    while (!s->fetch_terminate) {
+        if (f->pos < 0 || f->done) {
+            pthread_cond_wait(&s->fetch_wakeup, &s->mutex);
+            continue;
+        }
+
+        int64_t pos = f->pos + f->len;
+        int64_t end = MPMIN(f->pos + FETCH_CHUNK_SIZE, s->stream_size);
+        if (f->abort || pos >= end) {
+            f->done = true;
+            pthread_cond_broadcast(&s->wakeup);
+            continue;
+        }
+        unsigned char *dst = f->data + f->len;
+        pthread_mutex_unlock(&s->mutex);
+
+        // Seeking means issuing a new range request.
+        if (!f->stream) {
+            f->stream = stream_create(s->fetch_url, STREAM_READ,
+                                      s->fetch_cancel, s->stream->global);
+        }
+        int len = 0;
+        if (f->stream && (stream_tell(f->stream) == pos ||
+                          stream_seek(f->stream, pos)))
+        {
+            len = stream_read_partial(f->stream, dst,
+                                      MPMIN(end - pos, FETCH_READ_SIZE));
+        }
+
+        pthread_mutex_lock(&s->mutex);
+        if (len > 0) {
+            f->len += len;
+        } else {
+            f->failed = f->done = true;
+        }
+        pthread_cond_broadcast(&s->wakeup);
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    free_stream(f->stream);
+    return NULL;
+}
+
+// Return the fetcher whose chunk contains pos, or NULL.
+static struct fetcher *find_fetcher(struct priv *s, int64_t pos)
+{
+    for (int n = 0; n < s->num_fetchers; n++) {
+        struct fetcher *f = &s->fetchers[n];
+        if (f->pos >= 0 && !f->abort && pos >= f->pos &&
+            pos < f->pos + FETCH_CHUNK_SIZE)
+            return f;
+    }
+    return NULL;
+}
+
+// Runs in the cache thread. Assign the chunks between max_filepos and limit
+// to idle fetchers, and copy at most space bytes of downloaded data at
+// max_filepos to dst. Returns the number of bytes copied, 0 if there is no
+// data yet, -1 on EOF, or -2 if downloading failed.
+static int fetch_fill(struct priv *s, unsigned char *dst, int64_t space,
+                      int64_t limit)
+{
+    int64_t start = s->max_filepos;
+    limit = MPMIN(limit, s->stream_size);
+
+    if (start >= s->stream_size)
+        return -1;
+
+    // Drop chunks which can't be used without a seek.
+    for (int n = 0; n < s->num_fetchers; n++) {
+        struct fetcher *f = &s->fetchers[n];
+        if (f->pos >= 0 && (f->pos + FETCH_CHUNK_SIZE <= start ||
+                            f->pos >= start + s->buffer_size))
+        {
+            f->abort = true;
+            if (f->done)
+                f->pos = -1;
+        }
+    }
+
+    // Each chunk starts where the previous one ends (and the first one at
+    // start), so that no data before start is downloaded after seeks.
+    bool wakeup = false;
+    int64_t pos = start;
+    while (pos < limit) {
+        struct fetcher *f = find_fetcher(s, pos);
+        if (f) {
+            pos = f->pos + FETCH_CHUNK_SIZE;
+            continue;
+        }
+        for (int n = 0; n < s->num_fetchers; n++) {
+            if (s->fetchers[n].pos < 0) {
+                f = &s->fetchers[n];
+                break;
+            }
+        }
+        if (!f)
+            break; // all busy
+        *f = (struct fetcher){
+            .s = s,
+            .thread = f->thread,
+            .stream = f->stream,
+            .data = f->data,
+            .pos = pos,
+        };
+        wakeup = true;
+        pos += FETCH_CHUNK_SIZE;
+    }
+    if (wakeup)
+        pthread_cond_broadcast(&s->fetch_wakeup);
+
+    struct fetcher *f = find_fetcher(s, start);
+    if (f) {
+        if (start < f->pos + f->len) {
+            int64_t len = MPMIN(space, f->pos + f->len - start);
+            memcpy(dst, f->data + (start - f->pos), len);
+            return len;
+        }
+        if (f->failed)
+            return -2;
+    }
+    return 0;
+}
+
+// Maximum readahead (in bytes) implied by --cache-readahead-secs, or -1 if
+// unlimited. If the download is slower than playback, this is never reached,
+// and the cache keeps reading as fast as possible.
+static int64_t readahead_limit(struct priv *s)
+{
+    if (s->readahead_secs <= 0 || s->bitrate <= 0)
+        return -1;
+    return MPMAX(s->bitrate * s->readahead_secs, FILL_LIMIT);
+}
+
 // Runs in the cache thread.
 static void cache_fill(struct priv *s)
 {
-    int64_t read = s->read_filepos;
+    int64_t read = atomic_load(&s->read_filepos);
     bool read_attempted = false;
     int len = 0;
 
@@ -298,6 +537,12 @@ static void cache_fill(struct priv *s)
     // number of buffer bytes that are valid and can be read
     int64_t newb = FFMAX(s->max_filepos - read, 0);
 
+    // pause prefetching while the readahead covers enough playback time (the
+    // reader wakes us up again as it consumes data)
+    int64_t limit = readahead_limit(s);
+    if (limit >= 0 && newb >= limit && s->read_min <= s->max_filepos)
+        goto done;
+
     // max. number of bytes that can be written (starting from max_filepos)
     int64_t space = s->buffer_size - (newb + back);
 
@@ -309,6 +554,9 @@ static void cache_fill(struct priv *s)
     if (space < FILL_LIMIT)
         goto done;
 
+    // how far the fetchers may download ahead
+    int64_t fetch_limit = s->max_filepos + space;
+
     // limit to end of buffer (without wrapping)
     if (pos + space >= s->buffer_size)
         space = s->buffer_size - pos;
@@ -321,10 +569,28 @@ static void cache_fill(struct priv *s)
     if (s->min_filepos < (read - back2))
         s->min_filepos = read - back2;
 
-    // The read call might take a long time and block, so drop the lock.
-    pthread_mutex_unlock(&s->mutex);
-    len = stream_read_partial(s->stream, &s->buffer[pos], space);
-    pthread_mutex_lock(&s->mutex);
+    if (fetching(s)) {
+        len = fetch_fill(s, &s->buffer[pos], space, fetch_limit);
+        if (len == 0) {
+            // Wait until a fetcher made progress.
+            struct timespec ts = mp_rel_time_to_timespec(CACHE_WAIT_TIME);
+            pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
+            s->idle = false;
+            return;
+        }
+        if (len == -2) {
+            MP_WARN(s, "Parallel download failed, using a single "
+                    "connection.\n");
+            s->fetch_failed = true;
+            goto done;
+        }
+        len = MPMAX(len, 0);
+    } else {
+        // The read call might take a long time and block, so drop the lock.
+        pthread_mutex_unlock(&s->mutex);
+        len = stream_read_partial(s->stream, &s->buffer[pos], space);
+        pthread_mutex_lock(&s->mutex);
+    }
 
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
@@ -338,6 +604,7 @@ static void cache_fill(struct priv *s)
     if (pos + len == s->buffer_size)
         s->offset += s->buffer_size; // wrap...
     s->speed_amount += len;
+    publish_ringbuffer(s);
 
     read_attempted = true;
 
@@ -347,7 +614,7 @@ done: ;
     if (read_attempted)
         s->eof = len <= 0;
     if (!prev_eof && s->eof) {
-        s->eof_pos = stream_tell(s->stream);
+        s->eof_pos = fetching(s) ? s->max_filepos : stream_tell(s->stream);
         MP_VERBOSE(s, "EOF reached.\n");
     }
     s->idle = s->eof || !read_attempted;
@@ -384,24 +651,25 @@ static int resize_cache(struct priv *s, int64_t size)
     if (s->buffer) {
         // Copy & free the old ringbuffer data.
         // If the buffer is too small, prefer to copy these regions:
+        int64_t read = atomic_load(&s->read_filepos);
         // 1. Data starting from read_filepos, until cache end
-        size_t read_1 = read_buffer(s, buffer, buffer_size, s->read_filepos);
+        size_t read_1 = read_buffer(s, buffer, buffer_size, read);
         // 2. then data from before read_filepos until cache start
         //    (this one needs to be copied to the end of the ringbuffer)
         size_t read_2 = 0;
-        if (s->min_filepos < s->read_filepos) {
+        if (s->min_filepos < read) {
             size_t copy_len = buffer_size - read_1;
-            copy_len = MPMIN(copy_len, s->read_filepos - s->min_filepos);
+            copy_len = MPMIN(copy_len, read - s->min_filepos);
             assert(copy_len + read_1 <= buffer_size);
             read_2 = read_buffer(s, buffer + buffer_size - copy_len, copy_len,
-                                 s->read_filepos - copy_len);
+                                 read - copy_len);
             // This shouldn't happen, unless copy_len was computed incorrectly.
             assert(read_2 == copy_len);
         }
         // Set it up such that read_1 is at buffer pos 0, and read_2 wraps
         // around below it, so that it is located at the end of the buffer.
-        s->min_filepos = s->read_filepos - read_2;
-        s->max_filepos = s->read_filepos + read_1;
+        s->min_filepos = read - read_2;
+        s->max_filepos = read + read_1;
         s->offset = s->max_filepos - read_1;
     } else {
         cache_drop_contents(s);
@@ -411,6 +679,7 @@ static int resize_cache(struct priv *s, int64_t size)
 
     s->buffer_size = buffer_size;
     s->buffer = buffer;
+    publish_ringbuffer(s);
     s->idle = false;
     s->eof = false;
 
@@ -455,7 +724,7 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_GET_CACHE_INFO:
         *(struct stream_cache_info *)arg = (struct stream_cache_info) {
             .size = s->buffer_size - s->back_size,
-            .fill = s->max_filepos - s->read_filepos,
+            .fill = s->max_filepos - atomic_load(&s->read_filepos),
             .idle = s->idle,
             .speed = llrint(s->speed),
         };
@@ -464,6 +733,14 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
         s->enable_readahead = *(int *)arg;
         pthread_cond_signal(&s->wakeup);
         return STREAM_OK;
+    case STREAM_CTRL_SET_BITRATE:
+        s->bitrate = *(double *)arg;
+        if (readahead_limit(s) >= 0) {
+            MP_VERBOSE(s, "Limiting readahead to %lld KiB.\n",
+                       (long long)(readahead_limit(s) / 1024));
+        }
+        pthread_cond_signal(&s->wakeup);
+        return STREAM_OK;
     case STREAM_CTRL_GET_TIME_LENGTH:
         *(double *)arg = s->stream_time_length;
         return s->stream_time_length ? STREAM_OK : STREAM_UNSUPPORTED;
@@ -533,8 +810,8 @@ static void cache_execute_control(struct priv *s)
                "returned error, this is not allowed!\n");
     } else if (pos_changed || (ok && control_needs_flush(s->control))) {
         MP_VERBOSE(s, "Dropping cache due to control()\n");
-        s->read_filepos = stream_tell(s->stream);
-        s->read_min = s->read_filepos;
+        atomic_store(&s->read_filepos, stream_tell(s->stream));
+        s->read_min = stream_tell(s->stream);
         s->control_flush = true;
         cache_drop_contents(s);
     }
@@ -548,6 +825,7 @@ static void *cache_thread(void *arg)
 {
     struct priv *s = arg;
     mpthread_set_name("cache");
+    mp_thread_sched_apply(s->stream->global, s->log, "cache");
     pthread_mutex_lock(&s->mutex);
     update_cached_controls(s);
     double last = mp_time_sec();
@@ -580,27 +858,57 @@ static void *cache_thread(void *arg)
     return NULL;
 }
 
+// Runs in the main thread, with the mutex held.
+static void wakeup_after_read(struct priv *s, int readb)
+{
+    if (!s->eof) {
+        // wakeup the cache thread, possibly make it read more data ahead
+        // this is throttled to reduce excessive wakeups during normal reading
+        // (using the amount of bytes after which the cache thread most likely
+        // can actually read new data)
+        s->bytes_until_wakeup -= readb;
+        if (s->bytes_until_wakeup <= 0) {
+            s->bytes_until_wakeup = MPMAX(FILL_LIMIT, s->stream->read_chunk);
+            pthread_cond_signal(&s->wakeup);
+        }
+    }
+}
+
 static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
 {
     struct priv *s = cache->priv;
     assert(s->cache_thread_running);
 
-    pthread_mutex_lock(&s->mutex);
-
-    if (cache->pos != s->read_filepos)
+    if (cache->pos != atomic_load(&s->read_filepos))
         MP_ERR(s, "!!! read_filepos differs !!! report this bug...\n");
 
-    int readb = 0;
+    // Return already buffered data without waiting for the cache thread to
+    // release the mutex. (read_min is not updated here; it matters only if
+    // readahead is disabled, and then the slow path below will update it.)
+    int readb = read_lockless(s, buffer, max_len);
+    if (readb > 0) {
+        s->bytes_until_wakeup -= readb;
+        if (s->bytes_until_wakeup <= 0) {
+            pthread_mutex_lock(&s->mutex);
+            wakeup_after_read(s, 0);
+            pthread_mutex_unlock(&s->mutex);
+        }
+        return readb;
+    }
+
+    pthread_mutex_lock(&s->mutex);
+
     if (max_len > 0) {
         double retry_time = 0;
         int64_t retry = s->reads - 1; // try at least 1 read on EOF
         while (1) {
-            s->read_min = s->read_filepos + max_len + 64 * 1024;
-            readb = read_buffer(s, buffer, max_len, s->read_filepos);
-            s->read_filepos += readb;
+            int64_t read = atomic_load(&s->read_filepos);
+            s->read_min = read + max_len + 64 * 1024;
+            readb = read_buffer(s, buffer, max_len, read);
+            atomic_store(&s->read_filepos, read + readb);
             if (readb > 0)
                 break;
-            if (s->eof && s->read_filepos >= s->max_filepos && s->reads >= retry)
+            if (s->eof && read >= s->max_filepos && s->reads >= retry)
                 break;
             s->idle = false;
             if (!cache_wakeup_and_wait(s, &retry_time))
@@ -613,17 +921,7 @@ static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
         }
     }
 
-    if (!s->eof) {
-        // wakeup the cache thread, possibly make it read more data ahead
-        // this is throttled to reduce excessive wakeups during normal reading
-        // (using the amount of bytes after which the cache thread most likely
-        // can actually read new data)
-        s->bytes_until_wakeup -= readb;
-        if (s->bytes_until_wakeup <= 0) {
-            s->bytes_until_wakeup = MPMAX(FILL_LIMIT, s->stream->read_chunk);
-            pthread_cond_signal(&s->wakeup);
-        }
-    }
+    wakeup_after_read(s, readb);
     pthread_mutex_unlock(&s->mutex);
     return readb;
 }
@@ -638,7 +936,7 @@ static int cache_seek(stream_t *cache, int64_t pos)
 
     MP_DBG(s, "request seek: %" PRId64 " <= to=%" PRId64
            " (cur=%" PRId64 ") <= %" PRId64 "  \n",
-           s->min_filepos, pos, s->read_filepos, s->max_filepos);
+           s->min_filepos, pos, atomic_load(&s->read_filepos), s->max_filepos);
 
     if (!s->seekable && pos > s->max_filepos) {
         MP_ERR(s, "Attempting to seek past cached data in unseekable stream.\n");
@@ -647,7 +945,8 @@ static int cache_seek(stream_t *cache, int64_t pos)
         MP_ERR(s, "Attempting to seek before cached data in unseekable stream.\n");
         r = 0;
     } else {
-        cache->pos = s->read_filepos = s->read_min = pos;
+        cache->pos = s->read_min = pos;
+        atomic_store(&s->read_filepos, pos);
         // Is this seek likely to cause a stream-level seek?
         // If it is, wait until that is complete and return its result.
         // This check is not quite exact - if the reader thread is blocked in
@@ -704,7 +1003,7 @@ static int cache_control(stream_t *cache, int cmd, void *arg)
     r = s->control_res;
     if (s->control_flush) {
         stream_drop_buffers(cache);
-        cache->pos = s->read_filepos;
+        cache->pos = atomic_load(&s->read_filepos);
     }
 
 done:
@@ -723,12 +1022,51 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_unlock(&s->mutex);
         pthread_join(s->cache_thread, NULL);
     }
+    if (s->num_fetchers) {
+        pthread_mutex_lock(&s->mutex);
+        s->fetch_terminate = true;
+        pthread_cond_broadcast(&s->fetch_wakeup);
+        pthread_mutex_unlock(&s->mutex);
+        mp_cancel_trigger(s->fetch_cancel);
+        for (int n = 0; n < s->num_fetchers; n++)
+            pthread_join(s->fetchers[n].thread, NULL);
+        pthread_cond_destroy(&s->fetch_wakeup);
+    }
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
     free(s->buffer);
     talloc_free(s);
 }
 
+// Start the threads for --cache-connections, if applicable to the stream.
+static void init_fetchers(struct priv *s, int connections)
+{
+    bstr proto = mp_split_proto(bstr0(s->stream->url), &(bstr){0});
+    if (connections < 2 || !s->seekable || s->stream_size <= 0 ||
+        (bstrcasecmp0(proto, "http") != 0 && bstrcasecmp0(proto, "https") != 0))
+        return;
+
+    pthread_cond_init(&s->fetch_wakeup, NULL);
+    s->fetch_cancel = mp_cancel_new(s);
+    s->fetch_url = talloc_strdup(s, s->stream->url);
+    s->fetchers = talloc_zero_array(s, struct fetcher, connections);
+    for (int n = 0; n < connections; n++) {
+        struct fetcher *f = &s->fetchers[n];
+        *f = (struct fetcher){
+            .s = s,
+            .pos = -1,
+            .data = talloc_size(s, FETCH_CHUNK_SIZE),
+        };
+        if (pthread_create(&f->thread, NULL, fetch_thread, f))
+            break;
+        s->num_fetchers++;
+    }
+    if (!s->num_fetchers)
+        pthread_cond_destroy(&s->fetch_wakeup);
+
+    MP_VERBOSE(s, "Downloading with %d connections.\n", s->num_fetchers);
+}
+
 // return 1 on success, 0 if the cache is disabled/not needed, and -1 on error
 // or if the cache is disabled
 int stream_cache_init(stream_t *cache, stream_t *stream,
@@ -747,6 +1085,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     s->speed_start = mp_time_us();
 
     s->seek_limit = opts->seek_min * 1024ULL;
+    s->readahead_secs = opts->readahead_secs;
     s->back_size = opts->back_buffer * 1024ULL;
 
     s->stream_size = stream_get_size(stream);
@@ -775,6 +1114,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     s->seekable = stream->seekable;
 
+    init_fetchers(s, opts->connections);
+
     if (pthread_create(&s->cache_thread, NULL, cache_thread, s) != 0) {
         MP_ERR(s, "Starting cache thread failed.\n");
         return -1;
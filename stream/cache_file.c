@@ -16,7 +16,20 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <libavutil/md5.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/file.h>
+#endif
 
 #include "osdep/io.h"
 
@@ -24,18 +37,34 @@
 #include "common/msg.h"
 
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// Header of the block_bits file written with --cache-file-dir. It's followed
+// by key_len bytes of the key, and then the block_bits array.
+struct bits_header {
+    char magic[8];
+    uint32_t block_size;
+    uint32_t key_len;
+    int64_t size;
+    int64_t bits_size;
+};
+
+#define BITS_MAGIC "mpvcach1"
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
+    size_t bits_size;       // allocated size of block_bits
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
+    char *bits_file;        // if non-NULL, persistent cache (--cache-file-dir)
+    char *key;
 };
 
 static bool test_bit(struct priv *p, int64_t pos)
@@ -112,42 +141,265 @@ static int control(stream_t *s, int cmd, void *arg)
     return stream_control(p->original, cmd, arg);
 }
 
+// Write block_bits for persistent caches. The cache file must have been
+// closed (flushed) before, so that the bits never refer to unwritten data.
+static void save_bits(stream_t *s)
+{
+    struct priv *p = s->priv;
+
+    FILE *f = fopen(p->bits_file, "wb");
+    if (!f) {
+        MP_WARN(s, "can't write '%s'\n", p->bits_file);
+        return;
+    }
+    struct bits_header hdr = {
+        .magic = BITS_MAGIC,
+        .block_size = BLOCK_SIZE,
+        .key_len = strlen(p->key),
+        .size = p->size,
+        .bits_size = p->bits_size,
+    };
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(p->key, hdr.key_len, 1, f) == 1 &&
+              fwrite(p->block_bits, p->bits_size, 1, f) == 1;
+    if (fclose(f) != 0 || !ok) {
+        MP_WARN(s, "can't write '%s'\n", p->bits_file);
+        unlink(p->bits_file);
+    }
+}
+
+// Load block_bits for persistent caches, if they match the current stream.
+static void load_bits(stream_t *s)
+{
+    struct priv *p = s->priv;
+
+    FILE *f = fopen(p->bits_file, "rb");
+    if (!f)
+        return;
+    struct bits_header hdr;
+    char *key = NULL;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, BITS_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.block_size != BLOCK_SIZE || hdr.size != p->size ||
+        hdr.bits_size != p->bits_size || hdr.key_len != strlen(p->key))
+        goto done;
+    key = talloc_size(NULL, hdr.key_len);
+    if (fread(key, hdr.key_len, 1, f) != 1 ||
+        memcmp(key, p->key, hdr.key_len) != 0)
+        goto done;
+    if (fread(p->block_bits, p->bits_size, 1, f) != 1) {
+        memset(p->block_bits, 0, p->bits_size);
+        goto done;
+    }
+    MP_VERBOSE(s, "reusing cache file data from '%s'\n", p->bits_file);
+done:
+    talloc_free(key);
+    fclose(f);
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    bool flushed = p->cache_file && fflush(p->cache_file) == 0;
+    // Write the bits while still holding the lock on the cache file.
+    if (flushed && p->bits_file)
+        save_bits(s);
     if (p->cache_file)
         fclose(p->cache_file);
     talloc_free(p);
 }
 
+// Lock a persistent cache file, so that two mpv instances never use the same
+// file. The lock is released when the file is closed. Returns false if another
+// process holds it.
+static bool lock_file(int fd)
+{
+#if HAVE_POSIX
+    return flock(fd, LOCK_EX | LOCK_NB) == 0;
+#else
+    return true;
+#endif
+}
+
+struct dir_entry {
+    char *path;
+    int64_t size;
+    int64_t mtime;
+};
+
+static int cmp_dir_entry(const void *a, const void *b)
+{
+    const struct dir_entry *e1 = a, *e2 = b;
+    return e1->mtime < e2->mtime ? -1 : (e1->mtime > e2->mtime ? 1 : 0);
+}
+
+// Whether name is a cache file name as created by open_persistent_file().
+static bool is_cache_name(const char *name)
+{
+    if (strlen(name) != 32)
+        return false;
+    for (int n = 0; n < 32; n++) {
+        if (!strchr("0123456789ABCDEF", name[n]))
+            return false;
+    }
+    return true;
+}
+
+// Delete the least recently modified cache files in dir (except the file
+// named keep), until the other files take up at most max_size bytes. Files in
+// use by other mpv instances are skipped.
+static void prune_cache_dir(stream_t *cache, char *dir, const char *keep,
+                            int64_t max_size)
+{
+    void *tmp = talloc_new(NULL);
+    struct dir_entry *entries = NULL;
+    int num_entries = 0;
+    int64_t total = 0;
+
+    DIR *d = opendir(dir);
+    if (!d)
+        goto done;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (!is_cache_name(de->d_name) || strcmp(de->d_name, keep) == 0)
+            continue;
+        char *path = mp_path_join(tmp, dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) || !S_ISREG(st.st_mode))
+            continue;
+        struct dir_entry e = {path, st.st_size, st.st_mtime};
+        MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+        total += e.size;
+    }
+    closedir(d);
+
+    qsort(entries, num_entries, sizeof(entries[0]), cmp_dir_entry);
+
+    for (int n = 0; n < num_entries && total > max_size; n++) {
+        struct dir_entry *e = &entries[n];
+        int fd = open(e->path, O_RDWR | O_BINARY);
+        if (fd < 0)
+            continue;
+        // Delete it while holding the lock. A process which opened it
+        // just before can still use it, but its data is not kept.
+        if (lock_file(fd)) {
+            unlink(talloc_asprintf(tmp, "%s.bits", e->path));
+            if (unlink(e->path) == 0) {
+                MP_VERBOSE(cache, "removed old cache file '%s'\n", e->path);
+                total -= e->size;
+            }
+        }
+        close(fd);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Open the cache file in --cache-file-dir for the stream. The file is named by
+// a hash of the URL and the stream size. Returns NULL if not possible.
+static FILE *open_persistent_file(stream_t *cache, stream_t *stream,
+                                  struct mp_cache_opts *opts, struct priv *p)
+{
+    int64_t size = stream_get_size(stream);
+    if (size <= 0 || !stream->url || stream->is_local_file) {
+        MP_VERBOSE(cache, "not using --cache-file-dir for this stream\n");
+        return NULL;
+    }
+
+    p->key = talloc_asprintf(p, "%s %"PRId64, stream->url, size);
+    uint8_t md5[16];
+    av_md5_sum(md5, p->key, strlen(p->key));
+    char *name = talloc_strdup(p, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+
+    char *dir = mp_get_user_path(p, stream->global, opts->file_dir);
+    mp_mkdirp(dir);
+    char *filename = mp_path_join(p, dir, name);
+    p->bits_file = talloc_asprintf(p, "%s.bits", filename);
+
+    // Make room for this file before adding it.
+    int64_t dir_max = opts->file_dir_max * 1024LL;
+    prune_cache_dir(cache, dir, name,
+                    MPMAX(dir_max - MPMIN(size, p->max_size), 0));
+
+    // (Existing data is used only if the bits file matches.)
+    FILE *file = fopen(filename, "rb+");
+    bool existed = file;
+    if (!file)
+        file = fopen(filename, "wb+");
+    if (!file) {
+        MP_ERR(cache, "can't open cache file '%s'\n", filename);
+        return NULL;
+    }
+    if (!lock_file(fileno(file))) {
+        MP_VERBOSE(cache, "cache file '%s' is in use by another process\n",
+                   filename);
+        fclose(file);
+        return NULL;
+    }
+    // A bits file without data file is left over from a pruned file.
+    if (!existed)
+        unlink(p->bits_file);
+    p->size = size;
+    return file;
+}
+
 // return 1 on success, 0 if disabled, -1 on error
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts)
 {
-    if (!opts->file || !opts->file[0] || opts->file_max < 1)
+    bool persistent = opts->file_dir && opts->file_dir[0];
+    if ((!opts->file || !opts->file[0]) && !persistent)
+        return 0;
+    if (opts->file_max < 1)
         return 0;
 
     if (!stream->seekable) {
+        if (persistent) {
+            MP_VERBOSE(cache, "can't cache unseekable stream\n");
+            return 0;
+        }
         MP_ERR(cache, "can't cache unseekable stream\n");
         return -1;
     }
 
-    bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->original = stream;
+    p->max_size = opts->file_max * 1024LL;
+
+    FILE *file = NULL;
+    if (persistent) {
+        file = open_persistent_file(cache, stream, opts, p);
+        if (!file) {
+            talloc_free(p);
+            return 0;
+        }
+    } else {
+        bool use_anon_file = strcmp(opts->file, "TMP") == 0;
+        file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+        if (!file)
+            MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+    }
     if (!file) {
-        MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+        talloc_free(p);
         return -1;
     }
 
-    struct priv *p = talloc_zero(NULL, struct priv);
-
     cache->priv = p;
-    p->original = stream;
     p->cache_file = file;
-    p->max_size = opts->file_max * 1024LL;
 
     // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
+    p->bits_size = (p->max_size / BLOCK_SIZE + 1) / 8 + 1;
+    p->block_bits = talloc_zero_size(p, p->bits_size);
+
+    if (p->bits_file) {
+        p->size = MPMIN(p->max_size, p->size);
+        load_bits(cache);
+        // (If the process crashes, the file contents are unknown.)
+        unlink(p->bits_file);
+    }
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
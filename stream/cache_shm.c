@@ -0,0 +1,516 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// --cache-shared: a ring buffer in a POSIX shared memory segment, named by a
+// hash of the URL. One of the attached processes (the "writer") reads from its
+// connection to the source and appends to the ring. All processes, including
+// the writer, read from the ring at their own position. The other processes
+// close their own connection. If the writer exits or stalls, a reader opens a
+// new connection and takes over.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <libavutil/md5.h>
+
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/options.h"
+
+#include "stream.h"
+
+#define SHM_MAGIC "mpvshm01"
+
+// Maximum number of processes attached to one segment.
+#define MAX_CLIENTS 32
+
+// Space reserved for struct shm_header; the ring data follows it.
+#define HEADER_SIZE 4096
+
+// Time a reader waits for the writer before it gives up on it, and reads from
+// its own connection.
+#define WRITER_STALL_TIME 2.0
+
+// Time to wait for another process to finish initializing a new segment.
+#define ATTACH_WAIT_TIME 1.0
+
+struct shm_header {
+    char magic[8];
+    atomic_bool ready;          // set by the creator after initialization
+    int64_t size;               // size of the ring data after the header
+
+    // Everything below is protected by the (robust, process-shared) lock.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // broadcast on new data and writer changes
+    bool dead;                  // segment is being unlinked; don't attach
+    pid_t pids[MAX_CLIENTS];    // attached processes, 0 for free slots
+    int writer;                 // slot of the process filling the ring, or -1
+    int64_t write_pos;          // total number of bytes written to the ring
+    bool eof;                   // writer reached the end of the stream
+};
+
+struct priv {
+    struct mp_log *log;
+    struct shm_header *hdr;
+    unsigned char *data;        // hdr->size bytes
+    size_t map_size;
+    char *name;                 // shm_open() name
+    char *url;                  // for reconnecting when taking over
+    int slot;                   // our index into hdr->pids
+    stream_t *original;         // connection to the source (only when writer)
+    int64_t read_pos;           // position in the ring's byte stream
+    bool broken;                // lock unusable, segment must not be touched
+};
+
+// If the process holding the lock died, or on timeouts, check for processes
+// which exited without detaching.
+static void prune_clients(struct priv *p)
+{
+    struct shm_header *h = p->hdr;
+    for (int n = 0; n < MAX_CLIENTS; n++) {
+        if (h->pids[n] && kill(h->pids[n], 0) && errno == ESRCH) {
+            h->pids[n] = 0;
+            if (h->writer == n)
+                h->writer = -1;
+        }
+    }
+}
+
+// Called with the result of locking the mutex (pthread_mutex_lock or
+// pthread_cond_timedwait). Returns whether we hold the lock.
+static bool check_lock(struct priv *p, int r)
+{
+    if (r == EOWNERDEAD) {
+        // The previous owner died. The header fields are only updated after
+        // the ring data was copied, so the only stale state is its slot.
+        pthread_mutex_consistent(&p->hdr->lock);
+        prune_clients(p);
+        return true;
+    }
+    if (r == 0 || r == ETIMEDOUT)
+        return true;
+    // Most likely ENOTRECOVERABLE. Nobody can use the segment anymore; make
+    // sure new processes create a new one.
+    MP_ERR(p, "Shared cache lock is unusable (%s), giving up.\n",
+           mp_strerror(r));
+    shm_unlink(p->name);
+    p->broken = true;
+    return false;
+}
+
+// Returns false if the lock couldn't be acquired. The segment is unusable then.
+static bool lock_shm(struct priv *p)
+{
+    return !p->broken && check_lock(p, pthread_mutex_lock(&p->hdr->lock));
+}
+
+static void unlock_shm(struct priv *p)
+{
+    if (!p->broken)
+        pthread_mutex_unlock(&p->hdr->lock);
+}
+
+// Copy len bytes at ring position pos from or to the ring buffer.
+static void copy_ring(struct priv *p, unsigned char *buf, int64_t pos, int len,
+                      bool to_ring)
+{
+    int64_t size = p->hdr->size;
+    int64_t bpos = pos % size;
+    int64_t part = MPMIN(len, size - bpos);
+    if (to_ring) {
+        memcpy(p->data + bpos, buf, part);
+        memcpy(p->data, buf + part, len - part);
+    } else {
+        memcpy(buf, p->data + bpos, part);
+        memcpy(buf + part, p->data, len - part);
+    }
+}
+
+// Drop our connection to the source, with the lock held. Returns false if the
+// lock couldn't be reacquired.
+static bool drop_connection(stream_t *s)
+{
+    struct priv *p = s->priv;
+    stream_t *original = p->original;
+    p->original = NULL;
+    unlock_shm(p);
+    free_stream(original);
+    return lock_shm(p);
+}
+
+// Become the writer, with the lock held. Returns false if no connection could
+// be opened.
+static bool take_over(stream_t *s, bool steal)
+{
+    struct priv *p = s->priv;
+    struct shm_header *h = p->hdr;
+
+    if (!p->original) {
+        unlock_shm(p);
+        stream_t *original = stream_create(p->url, STREAM_READ, s->cancel,
+                                           s->global);
+        if (!lock_shm(p)) {
+            free_stream(original);
+            return false;
+        }
+        if (!original)
+            return false;
+        p->original = original;
+        // Someone else might have been quicker.
+        if (h->writer >= 0 && !steal)
+            return true;
+    }
+    MP_VERBOSE(s, "Filling shared cache from this process.\n");
+    h->writer = p->slot;
+    pthread_cond_broadcast(&h->wakeup);
+    return true;
+}
+
+static int fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct shm_header *h = p->hdr;
+    int res = -1;
+    int64_t wait_pos = -1;
+    double wait_start = 0;
+
+    if (!lock_shm(p))
+        return -1;
+    while (!mp_cancel_test(s->cancel)) {
+        if (h->writer != p->slot && p->original) {
+            MP_VERBOSE(s, "Another process fills the shared cache now.\n");
+            if (!drop_connection(s))
+                break;
+            continue;
+        }
+
+        int64_t oldest = MPMAX(h->write_pos - h->size, 0);
+        if (p->read_pos < oldest) {
+            MP_WARN(s, "Shared cache overrun, skipping %"PRId64" bytes.\n",
+                    oldest - p->read_pos);
+            p->read_pos = oldest;
+        }
+
+        if (p->read_pos < h->write_pos) {
+            res = MPMIN(max_len, h->write_pos - p->read_pos);
+            copy_ring(p, buffer, p->read_pos, res, false);
+            p->read_pos += res;
+            break;
+        }
+
+        if (h->eof) {
+            res = 0;
+            break;
+        }
+
+        if (h->writer == p->slot) {
+            // Read into the caller's buffer first, so that readers never see
+            // partially overwritten old data.
+            stream_t *original = p->original;
+            unlock_shm(p);
+            int len = stream_read_partial(original, buffer, max_len);
+            if (!lock_shm(p))
+                break;
+            if (h->writer != p->slot)
+                continue; // data is discarded, as it would leave a gap
+            if (len <= 0) {
+                if (mp_cancel_test(s->cancel))
+                    break;
+                h->eof = true;
+                res = 0;
+            } else {
+                copy_ring(p, buffer, h->write_pos, len, true);
+                h->write_pos += len;
+                p->read_pos = h->write_pos;
+                res = len;
+            }
+            pthread_cond_broadcast(&h->wakeup);
+            break;
+        }
+
+        double now = mp_time_sec();
+        if (wait_pos != h->write_pos) {
+            wait_pos = h->write_pos;
+            wait_start = now;
+        }
+        bool stalled = now - wait_start >= WRITER_STALL_TIME;
+        if (h->writer < 0 || stalled) {
+            if (stalled)
+                MP_WARN(s, "Shared cache writer stalled, reconnecting.\n");
+            if (!take_over(s, stalled))
+                break;
+            wait_pos = -1;
+            continue;
+        }
+
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        int r = pthread_cond_timedwait(&h->wakeup, &h->lock, &ts);
+        if (!check_lock(p, r))
+            break;
+        if (r == ETIMEDOUT)
+            prune_clients(p);
+    }
+    unlock_shm(p);
+    return res;
+}
+
+static int seek(stream_t *s, int64_t newpos)
+{
+    return newpos == s->pos;
+}
+
+static int control(stream_t *s, int cmd, void *arg)
+{
+    struct priv *p = s->priv;
+    if (!p->original)
+        return STREAM_UNSUPPORTED;
+    return stream_control(p->original, cmd, arg);
+}
+
+static void detach(struct priv *p)
+{
+    struct shm_header *h = p->hdr;
+    if (!lock_shm(p))
+        return;
+    h->pids[p->slot] = 0;
+    if (h->writer == p->slot)
+        h->writer = -1;
+    prune_clients(p);
+    bool last = true;
+    for (int n = 0; n < MAX_CLIENTS; n++)
+        last &= !h->pids[n];
+    if (last) {
+        h->dead = true;
+        shm_unlink(p->name);
+    }
+    pthread_cond_broadcast(&h->wakeup);
+    unlock_shm(p);
+}
+
+static void s_close(stream_t *s)
+{
+    struct priv *p = s->priv;
+    detach(p);
+    munmap(p->hdr, p->map_size);
+    free_stream(p->original);
+    talloc_free(p);
+}
+
+static bool init_header(struct shm_header *h, int64_t size)
+{
+    memcpy(h->magic, SHM_MAGIC, sizeof(h->magic));
+    h->size = size;
+    h->writer = -1;
+
+    bool ok = true;
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    ok &= !pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    ok &= !pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    ok &= !pthread_mutex_init(&h->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    ok &= !pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    ok &= !pthread_cond_init(&h->wakeup, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    atomic_store(&h->ready, ok);
+    return ok;
+}
+
+// Map the segment created by another process. Returns NULL on failure.
+static struct shm_header *map_existing(stream_t *cache, int fd, size_t *size)
+{
+    double deadline = mp_time_sec() + ATTACH_WAIT_TIME;
+    struct stat st;
+    while (fstat(fd, &st) == 0 && st.st_size <= HEADER_SIZE) {
+        if (mp_time_sec() > deadline)
+            return NULL;
+        mp_sleep_us(10000);
+    }
+    *size = st.st_size;
+    struct shm_header *h =
+        mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED)
+        return NULL;
+    while (!atomic_load(&h->ready) && mp_time_sec() < deadline)
+        mp_sleep_us(10000);
+    if (!atomic_load(&h->ready) ||
+        memcmp(h->magic, SHM_MAGIC, sizeof(h->magic)) != 0 ||
+        h->size != *size - HEADER_SIZE)
+    {
+        MP_ERR(cache, "Shared cache segment is incompatible.\n");
+        munmap(h, *size);
+        return NULL;
+    }
+    return h;
+}
+
+// Open or create the segment and add this process to it. On success, p->hdr,
+// p->slot etc. are set, and *created says whether we are the first user.
+// Returns 1 on success, 0 if the segment's stream already ended (don't use
+// it), -1 on error.
+static int attach(stream_t *cache, struct priv *p, int64_t size, bool *created)
+{
+    for (int retry = 0; retry < 3; retry++) {
+        int fd = shm_open(p->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        *created = fd >= 0;
+        if (!*created) {
+            if (errno != EEXIST)
+                break;
+            fd = shm_open(p->name, O_RDWR, 0);
+            if (fd < 0 && errno == ENOENT)
+                continue; // was just unlinked
+            if (fd < 0)
+                break;
+        }
+
+        struct shm_header *h = NULL;
+        if (*created) {
+            p->map_size = HEADER_SIZE + size;
+            if (ftruncate(fd, p->map_size) == 0) {
+                h = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd, 0);
+                if (h == MAP_FAILED)
+                    h = NULL;
+            }
+            if (h && !init_header(h, size)) {
+                munmap(h, p->map_size);
+                h = NULL;
+            }
+            if (!h)
+                shm_unlink(p->name);
+        } else {
+            h = map_existing(cache, fd, &p->map_size);
+        }
+        close(fd);
+        if (!h)
+            break;
+
+        p->hdr = h;
+        p->data = (unsigned char *)h + HEADER_SIZE;
+        if (!lock_shm(p)) {
+            munmap(h, p->map_size);
+            p->hdr = NULL;
+            return -1;
+        }
+        prune_clients(p);
+        p->slot = -1;
+        for (int n = 0; n < MAX_CLIENTS; n++) {
+            if (!h->pids[n]) {
+                p->slot = n;
+                break;
+            }
+        }
+        // The EOF flag stays set until the segment is gone, and a new process
+        // would only get the end of the old stream. Use our own connection.
+        bool eof = h->eof;
+        bool ok = !h->dead && !eof && p->slot >= 0;
+        if (ok) {
+            h->pids[p->slot] = getpid();
+            // Join the stream at the oldest data still in the ring.
+            p->read_pos = MPMAX(h->write_pos - h->size, 0);
+        }
+        unlock_shm(p);
+        if (ok)
+            return 1;
+        munmap(h, p->map_size);
+        p->hdr = NULL;
+        if (eof) {
+            MP_VERBOSE(cache, "Shared cache already reached the end of the "
+                       "stream, not using it.\n");
+            return 0;
+        }
+        if (p->slot < 0) {
+            MP_ERR(cache, "Too many processes using the shared cache.\n");
+            return -1;
+        }
+    }
+    MP_ERR(cache, "Could not open shared cache segment '%s': %s\n", p->name,
+           mp_strerror(errno));
+    return -1;
+}
+
+// return 1 on success, 0 if disabled, -1 on error
+// On success, the cache takes ownership of stream (and might close it).
+int stream_shm_cache_init(stream_t *cache, stream_t *stream,
+                          struct mp_cache_opts *opts)
+{
+    if (!opts->shared)
+        return 0;
+
+    // Seekable streams would make the processes fight over the position.
+    if (stream->seekable || !stream->url || stream->is_local_file) {
+        MP_VERBOSE(cache, "Shared cache is used for unseekable network "
+                   "streams only.\n");
+        return 0;
+    }
+
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->log = cache->log;
+    p->url = talloc_strdup(p, stream->url);
+
+    uint8_t md5[16];
+    av_md5_sum(md5, p->url, strlen(p->url));
+    p->name = talloc_asprintf(p, "/mpv-cache-%d-", (int)getuid());
+    for (int i = 0; i < 16; i++)
+        p->name = talloc_asprintf_append(p->name, "%02X", md5[i]);
+
+    int64_t size = MPMAX(opts->size, 1024) * 1024LL;
+    bool created;
+    int r = attach(cache, p, size, &created);
+    if (r < 1) {
+        talloc_free(p);
+        return r;
+    }
+
+    cache->priv = p;
+    cache->seekable = false;
+    cache->seek = seek;
+    cache->fill_buffer = fill_buffer;
+    cache->control = control;
+    cache->close = s_close;
+
+    // (If locking fails, fill_buffer() will return errors.)
+    if (lock_shm(p) && p->hdr->writer < 0) {
+        p->hdr->writer = p->slot;
+        p->original = stream;
+        stream = NULL;
+    }
+    unlock_shm(p);
+
+    if (stream) {
+        MP_VERBOSE(cache, "Reading from shared cache of another process.\n");
+        free_stream(stream);
+    } else {
+        MP_VERBOSE(cache, "%s shared cache.\n", created ? "Created" : "Filling");
+    }
+    return 1;
+}
@@ -28,6 +28,8 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "osdep/io.h"
 
@@ -37,6 +39,18 @@
 
 #define MAX_COOKIES 20
 
+// The last cookie file converted to the lavf format. Every network stream
+// opened with --cookies requests the cookies, so this avoids reading and
+// parsing the (possibly large) file again for each of them.
+struct cookie_jar {
+    char *filename;
+    int64_t size, mtime;
+    char *lavf;
+};
+
+static pthread_mutex_t jar_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cookie_jar *jar;
+
 typedef struct cookie_list_type {
     char *name;
     char *value;
@@ -156,15 +170,10 @@ static struct cookie_list_type *load_cookies_from(void *ctx,
     return list;
 }
 
-// Return a cookies string as expected by lavf (libavformat/http.c). The format
-// is like a Set-Cookie header (http://curl.haxx.se/rfc/cookie_spec.html),
-// separated by newlines.
-char *cookies_lavf(void *talloc_ctx, struct mp_log *log, char *file)
+static char *build_lavf(void *talloc_ctx, struct mp_log *log, char *file)
 {
     void *tmp = talloc_new(NULL);
-    struct cookie_list_type *list = NULL;
-    if (file && file[0])
-        list = load_cookies_from(tmp, log, file);
+    struct cookie_list_type *list = load_cookies_from(tmp, log, file);
 
     char *res = talloc_strdup(talloc_ctx, "");
 
@@ -178,3 +187,33 @@ char *cookies_lavf(void *talloc_ctx, struct mp_log *log, char *file)
     talloc_free(tmp);
     return res;
 }
+
+// Return a cookies string as expected by lavf (libavformat/http.c). The format
+// is like a Set-Cookie header (http://curl.haxx.se/rfc/cookie_spec.html),
+// separated by newlines. Thread-safe.
+char *cookies_lavf(void *talloc_ctx, struct mp_log *log, char *file)
+{
+    if (!file || !file[0])
+        return talloc_strdup(talloc_ctx, "");
+
+    struct stat st;
+    if (stat(file, &st) != 0)
+        return build_lavf(talloc_ctx, log, file); // fails and logs the error
+
+    pthread_mutex_lock(&jar_lock);
+    if (!jar || strcmp(jar->filename, file) != 0 || jar->size != st.st_size ||
+        jar->mtime != st.st_mtime)
+    {
+        talloc_free(jar);
+        jar = talloc_zero(NULL, struct cookie_jar);
+        jar->filename = talloc_strdup(jar, file);
+        jar->size = st.st_size;
+        jar->mtime = st.st_mtime;
+        jar->lavf = build_lavf(jar, log, file);
+    } else {
+        mp_verbose(log, "Using cached cookie file: %s\n", file);
+    }
+    char *res = talloc_strdup(talloc_ctx, jar->lavf);
+    pthread_mutex_unlock(&jar_lock);
+    return res;
+}
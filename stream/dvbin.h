@@ -107,6 +107,7 @@ typedef struct {
     int fe_fd;
     int dvr_fd;
     int demux_fd[3], demux_fds[DMX_FILTER_SIZE], demux_fds_cnt;
+    int demux_pids[DMX_FILTER_SIZE]; // PID filtered by each demux_fds entry
 
     int is_on;
     int retry;
@@ -127,6 +128,8 @@ typedef struct {
     char *cfg_file;
 
     int cfg_full_transponder;
+    int cfg_mux_services;
+    int cfg_track_filter;
 } dvb_priv_t;
 
 
@@ -25,6 +25,7 @@
 #include <strings.h>
 #include <assert.h>
 
+#include <libavutil/buffer.h>
 #include <libavutil/common.h>
 #include "osdep/atomic.h"
 #include "osdep/io.h"
@@ -355,6 +356,7 @@ static int stream_read_unbuffered(stream_t *s, void *buf, int len)
     // When reading succeeded we are obviously not at eof.
     s->eof = 0;
     s->pos += res;
+    s->total_read += res;
     return res;
 }
 
@@ -383,8 +385,12 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
     assert(buf_size >= 0);
     if (s->buf_pos == s->buf_len && buf_size > 0) {
         s->buf_pos = s->buf_len = 0;
-        // Do a direct read, but only if there's no sector alignment requirement
+        // Do a direct read if the size can be aligned to the sector size.
         // Also, small reads will be more efficient with buffering & copying
+        if (s->sector_size && buf_size >= s->sector_size) {
+            return stream_read_unbuffered(s, buf,
+                                          buf_size / s->sector_size * s->sector_size);
+        }
         if (!s->sector_size && buf_size >= STREAM_BUFFER_SIZE)
             return stream_read_unbuffered(s, buf, buf_size);
         if (!stream_fill_buffer(s))
@@ -447,6 +453,30 @@ struct bstr stream_peek(stream_t *s, int len)
                   .len = FFMIN(len, s->buf_len - s->buf_pos)};
 }
 
+// Read len bytes without copying them, if the stream supports this (currently
+// memory mapped files only). The returned buffer's data and size fields are set
+// to the read data. The data is followed by at least pad zero bytes, as
+// libavcodec requires for packet data. Since these are the following stream
+// data, which can't be overwritten, this fails if they're not zero already.
+// The data must not be written to.
+// Returns NULL if not supported or possible, without changing the position.
+struct AVBufferRef *stream_read_ref(stream_t *s, int len, int pad)
+{
+    if (!s->read_ref || len < 0)
+        return NULL;
+    int64_t pos = stream_tell(s);
+    struct AVBufferRef *ref = s->read_ref(s, pos, len, pad);
+    for (int n = 0; ref && n < pad; n++) {
+        if (ref->data[len + n])
+            av_buffer_unref(&ref);
+    }
+    if (ref && !stream_seek(s, pos + len))
+        av_buffer_unref(&ref);
+    if (ref)
+        s->total_read += len;
+    return ref;
+}
+
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
 {
     int rd;
@@ -661,6 +691,16 @@ static int stream_enable_cache(stream_t **stream, struct mp_cache_opts *opts)
     if (use_opts.size < 1)
         return 0;
 
+#if HAVE_POSIX_SHM
+    stream_t *scache = open_cache(orig, "shared-cache");
+    scache->underlying = NULL; // owned by the shared cache on success
+    if (stream_shm_cache_init(scache, orig, &use_opts) > 0) {
+        orig = *stream = scache;
+    } else {
+        free_stream(scache);
+    }
+#endif
+
     stream_t *fcache = open_cache(orig, "file-cache");
     if (stream_file_cache_init(fcache, orig, &use_opts) <= 0) {
         fcache->underlying = NULL; // don't free original stream
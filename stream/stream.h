@@ -56,6 +56,7 @@ enum stream_ctrl {
     STREAM_CTRL_GET_CACHE_INFO,
     STREAM_CTRL_SET_CACHE_SIZE,
     STREAM_CTRL_SET_READAHEAD,
+    STREAM_CTRL_SET_BITRATE,            // double* (bytes per second)
 
     // stream_memory.c
     STREAM_CTRL_SET_CONTENTS,
@@ -84,6 +85,7 @@ enum stream_ctrl {
     STREAM_CTRL_DVB_SET_CHANNEL_NAME,
     STREAM_CTRL_DVB_GET_CHANNEL_NAME,
     STREAM_CTRL_DVB_STEP_CHANNEL,
+    STREAM_CTRL_DVB_SET_TRACK_PIDS,
 
     // Optical discs
     STREAM_CTRL_GET_TIME_LENGTH,
@@ -123,6 +125,12 @@ struct stream_dvd_info_req {
     int num_subs;
 };
 
+// for STREAM_CTRL_DVB_SET_TRACK_PIDS
+struct stream_dvb_pids {
+    int *pids;    // TS PIDs of the selected tracks and their programs
+    int num_pids; // 0 if nothing is selected
+};
+
 // for STREAM_CTRL_SET_TV_COLORS
 #define TV_COLOR_BRIGHTNESS     1
 #define TV_COLOR_HUE            2
@@ -162,11 +170,17 @@ typedef struct stream {
     int (*control)(struct stream *s, int cmd, void *arg);
     // Close
     void (*close)(struct stream *s);
+    // Optional: return a new reference to len bytes at pos without copying
+    // them, followed by at least pad readable bytes (which stream_read_ref()
+    // checks for being zero).
+    struct AVBufferRef *(*read_ref)(struct stream *s, int64_t pos, int len,
+                                    int pad);
 
     int sector_size; // sector size (seek will be aligned on this size if non 0)
     int read_chunk; // maximum amount of data to read at once to limit latency
     unsigned int buf_pos, buf_len;
     int64_t pos;
+    int64_t total_read; // number of bytes read from the source (statistics)
     int eof;
     int mode; //STREAM_READ or STREAM_WRITE
     void *priv; // used for DVD, TV, RTSP etc
@@ -206,6 +220,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
                       struct mp_cache_opts *opts);
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts);
+int stream_shm_cache_init(stream_t *cache, stream_t *stream,
+                          struct mp_cache_opts *opts);
 
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
 
@@ -234,6 +250,8 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, char *mem, int total);
 int stream_read_partial(stream_t *s, char *buf, int buf_size);
 struct bstr stream_peek(stream_t *s, int len);
+struct AVBufferRef;
+struct AVBufferRef *stream_read_ref(stream_t *s, int len, int pad);
 void stream_drop_buffers(stream_t *s);
 int64_t stream_get_size(stream_t *s);
 
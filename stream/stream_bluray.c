@@ -52,6 +52,10 @@
 
 #define BLURAY_SECTOR_SIZE     6144
 
+// Read this many sectors at once. With the cache, this is done ahead of time
+// on the cache thread, which hides the seek latency of slow drives.
+#define BLURAY_READ_SECTORS    32
+
 #define BLURAY_DEFAULT_ANGLE      0
 #define BLURAY_DEFAULT_CHAPTER    0
 #define BLURAY_PLAYLIST_TITLE    -3
@@ -455,6 +459,8 @@ static int bluray_stream_open_internal(stream_t *s)
     s->close       = bluray_stream_close;
     s->control     = bluray_stream_control;
     s->sector_size = BLURAY_SECTOR_SIZE;
+    s->read_chunk  = BLURAY_SECTOR_SIZE * BLURAY_READ_SECTORS;
+    s->streaming   = true; // enable the cache by default
     s->priv        = b;
     s->demuxer     = "+disc";
 
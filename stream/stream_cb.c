@@ -6,8 +6,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include "osdep/io.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -18,8 +21,32 @@
 #include "player/client.h"
 #include "libmpv/stream_cb.h"
 
+// Size and alignment of the requests with read_async_fn.
+#define ASYNC_REQ_SIZE (256 * 1024)
+#define DEFAULT_ASYNC_DEPTH 4
+
+enum {
+    REQ_UNUSED,
+    REQ_PENDING,                // passed to read_async_fn, not completed yet
+    REQ_DONE,
+};
+
+struct async_req {
+    struct priv *p;
+    mpv_stream_cb_read_req req; // req.internal points to this struct
+    int state;                  // protected by priv.lock
+    int64_t len;                // bytes read (if REQ_DONE)
+};
+
 struct priv {
     mpv_stream_cb_info info;
+
+    // Used with read_async_fn only.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct async_req *reqs;
+    int num_reqs;
+    int64_t size;               // known stream size, or -1
 };
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -28,6 +55,116 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
 }
 
+void mpv_stream_cb_read_complete(mpv_stream_cb_read_req *req, int64_t nbytes)
+{
+    struct async_req *r = req->internal;
+    struct priv *p = r->p;
+
+    pthread_mutex_lock(&p->lock);
+    assert(r->state == REQ_PENDING);
+    r->len = MPMIN(nbytes, (int64_t)req->nbytes);
+    r->state = REQ_DONE;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static struct async_req *find_req(struct priv *p, int64_t pos)
+{
+    for (int n = 0; n < p->num_reqs; n++) {
+        struct async_req *r = &p->reqs[n];
+        if (r->state != REQ_UNUSED && r->req.offset == pos)
+            return r;
+    }
+    return NULL;
+}
+
+// Issue requests for the data starting at start, as far as there are free
+// requests. Requests for data before start (or too far after it) are reused.
+// Must be called with the lock held, which is temporarily released.
+static void queue_reads(struct priv *p, int64_t start)
+{
+    int64_t end = start + p->num_reqs * (int64_t)ASYNC_REQ_SIZE;
+    if (p->size >= 0)
+        end = MPMIN(end, MPMAX(p->size, start + 1));
+
+    for (int64_t pos = start; pos < end; pos += ASYNC_REQ_SIZE) {
+        if (find_req(p, pos))
+            continue;
+
+        struct async_req *r = NULL;
+        for (int n = 0; n < p->num_reqs; n++) {
+            struct async_req *c = &p->reqs[n];
+            if (c->state == REQ_UNUSED ||
+                (c->state == REQ_DONE &&
+                 (c->req.offset < start || c->req.offset >= end)))
+            {
+                r = c;
+                break;
+            }
+        }
+        if (!r)
+            break; // all requests busy
+
+        r->state = REQ_PENDING;
+        r->req.offset = pos;
+        r->len = 0;
+        // The user can complete the request from within the callback.
+        pthread_mutex_unlock(&p->lock);
+        p->info.read_async_fn(p->info.cookie, &r->req);
+        pthread_mutex_lock(&p->lock);
+    }
+}
+
+static int async_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int64_t start = s->pos / ASYNC_REQ_SIZE * ASYNC_REQ_SIZE;
+    int len = -1;
+
+    pthread_mutex_lock(&p->lock);
+    struct async_req *r;
+    while (1) {
+        queue_reads(p, start);
+        r = find_req(p, start);
+        if (r && r->state == REQ_DONE)
+            break;
+        if (mp_cancel_test(s->cancel))
+            goto done;
+        // Wait for the request, or for any request to become reusable.
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+    }
+    if (r->len < 0) {
+        r->state = REQ_UNUSED; // retry on the next read
+        goto done;
+    }
+    int offset = s->pos - start;
+    len = MPCLAMP(r->len - offset, 0, max_len);
+    memcpy(buffer, r->req.buf + offset, len);
+done:
+    pthread_mutex_unlock(&p->lock);
+    return len;
+}
+
+static void init_async(stream_t *s)
+{
+    struct priv *p = s->priv;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    p->num_reqs = p->info.read_async_depth > 0 ? p->info.read_async_depth
+                                               : DEFAULT_ASYNC_DEPTH;
+    p->reqs = talloc_zero_array(p, struct async_req, p->num_reqs);
+    for (int n = 0; n < p->num_reqs; n++) {
+        struct async_req *r = &p->reqs[n];
+        r->p = p;
+        r->req.buf = talloc_size(p->reqs, ASYNC_REQ_SIZE);
+        r->req.nbytes = ASYNC_REQ_SIZE;
+        r->req.internal = r;
+    }
+    p->size = p->info.size_fn ? p->info.size_fn(p->info.cookie) : -1;
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
@@ -55,12 +192,25 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->reqs) {
+        // The buffers must remain valid until all requests are completed.
+        pthread_mutex_lock(&p->lock);
+        for (int n = 0; n < p->num_reqs; n++) {
+            while (p->reqs[n].state == REQ_PENDING)
+                pthread_cond_wait(&p->wakeup, &p->lock);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
     p->info.close_fn(p->info.cookie);
+    if (p->reqs) {
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+    }
 }
 
 static int open_cb(stream_t *stream)
 {
-    struct priv *p = talloc_ptrtype(stream, p);
+    struct priv *p = talloc_zero(stream, struct priv);
     stream->priv = p;
 
     bstr bproto = mp_split_proto(bstr0(stream->url), NULL);
@@ -81,7 +231,7 @@ static int open_cb(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    if (!info.read_fn || !info.close_fn) {
+    if (!(info.read_fn || info.read_async_fn) || !info.close_fn) {
         MP_FATAL(stream, "required read_fn or close_fn callbacks not set.\n");
         return STREAM_ERROR;
     }
@@ -94,6 +244,10 @@ static int open_cb(stream_t *stream)
     }
     stream->fast_skip = true;
     stream->fill_buffer = fill_buffer;
+    if (p->info.read_async_fn) {
+        init_async(stream);
+        stream->fill_buffer = async_fill_buffer;
+    }
     stream->control = control;
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
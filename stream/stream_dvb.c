@@ -77,6 +77,8 @@ const struct m_sub_options stream_dvb_conf = {
         OPT_INTRANGE("timeout", cfg_timeout, 0, 1, 30),
         OPT_STRING("file", cfg_file, M_OPT_FILE),
         OPT_FLAG("full-transponder", cfg_full_transponder, 0),
+        OPT_FLAG("mux-services", cfg_mux_services, 0),
+        OPT_FLAG("track-filter", cfg_track_filter, 0),
         {0}
     },
     .size = sizeof(dvb_priv_t),
@@ -760,6 +762,117 @@ static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
     return pos;
 }
 
+static bool same_mux(dvb_channel_t *a, dvb_channel_t *b)
+{
+    return a->freq == b->freq && a->frontend == b->frontend &&
+           a->delsys == b->delsys && a->pol == b->pol &&
+           a->stream_id == b->stream_id;
+}
+
+// Add pid to the pids array of *cnt entries, unless it's already in it.
+// Returns false if the array is full.
+static bool add_pid(int *pids, int *cnt, int pid)
+{
+    for (int i = 0; i < *cnt; i++) {
+        if (pids[i] == pid)
+            return true;
+    }
+    if (*cnt >= DMX_FILTER_SIZE)
+        return false;
+    pids[(*cnt)++] = pid;
+    return true;
+}
+
+// Collect the PIDs of the channel, and with --dvbin-mux-services also those of
+// all other channels on the same multiplex, into pids (DMX_FILTER_SIZE
+// entries). Resolves missing PMT-PIDs, so the frontend must be tuned already.
+// Returns the number of PIDs.
+static int dvb_get_mux_pids(stream_t *stream, unsigned int adapter,
+                            dvb_channel_t *channel, int *pids)
+{
+    dvb_priv_t *priv = stream->priv;
+    dvb_channels_list_t *list = priv->state->adapters[adapter].list;
+    int cnt = 0;
+
+    for (int n = 0; n < list->NUM_CHANNELS; n++) {
+        dvb_channel_t *c = &list->channels[n];
+        if (c != channel && !(priv->cfg_mux_services && same_mux(c, channel)))
+            continue;
+        for (int i = 0; i < c->pids_cnt; i++) {
+            if (c->pids[i] == -1 && c->service_id != -1) {
+                /* We need the PMT-PID in addition.
+                   If it has not yet beem resolved, do it now. */
+                MP_VERBOSE(stream, "DVB_SET_CHANNEL: PMT-PID for service %d "
+                           "not resolved yet, parsing PAT...\n",
+                           c->service_id);
+                c->pids[i] = dvb_get_pmt_pid(priv, adapter, c->service_id);
+                MP_VERBOSE(stream, "DVB_SET_CHANNEL: Found PMT-PID: %d\n",
+                           c->pids[i]);
+            }
+            if (c->pids[i] == -1) {
+                // In case PMT was not resolved, skip it here.
+                MP_ERR(stream, "DVB_SET_CHANNEL: PMT-PID not found, "
+                               "teletext-decoding may fail.\n");
+                continue;
+            }
+            if (c->pids[i] == 8192 || !add_pid(pids, &cnt, c->pids[i])) {
+                if (c->pids[i] != 8192) {
+                    MP_VERBOSE(stream, "Too many PIDs, passing the full "
+                               "transponder.\n");
+                }
+                pids[0] = 8192;
+                return 1;
+            }
+        }
+    }
+    return cnt;
+}
+
+// Set the demux filters to pass exactly the given PIDs. Filters for PIDs which
+// are passed already are kept, so that their data is not interrupted.
+static bool dvb_apply_pids(stream_t *stream, int *pids, int cnt)
+{
+    dvb_priv_t *priv = stream->priv;
+    dvb_state_t *state = priv->state;
+    int old_cnt = state->demux_fds_cnt;
+
+    int slots[DMX_FILTER_SIZE];
+    bool placed[DMX_FILTER_SIZE] = {0};
+    for (int i = 0; i < cnt; i++) {
+        slots[i] = -1;
+        for (int j = 0; j < cnt && i < old_cnt; j++) {
+            if (!placed[j] && state->demux_pids[i] == pids[j]) {
+                slots[i] = pids[j];
+                placed[j] = true;
+                break;
+            }
+        }
+    }
+    int next = 0;
+    for (int j = 0; j < cnt; j++) {
+        if (placed[j])
+            continue;
+        while (slots[next] != -1)
+            next++;
+        slots[next] = pids[j];
+    }
+
+    if (!dvb_fix_demuxes(priv, cnt))
+        return false;
+    for (int i = 0; i < cnt; i++) {
+        if (i < old_cnt && state->demux_pids[i] == slots[i])
+            continue;
+        if (i < old_cnt)
+            ioctl(state->demux_fds[i], DMX_STOP);
+        state->demux_pids[i] = -1;
+        if (!dvb_set_ts_filt(priv, state->demux_fds[i], slots[i],
+                             DMX_PES_OTHER))
+            return false;
+        state->demux_pids[i] = slots[i];
+    }
+    return true;
+}
+
 int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
 {
     dvb_channels_list_t *new_list;
@@ -768,7 +881,6 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
     char buf[4096];
     dvb_state_t *state = (dvb_state_t *) priv->state;
     int devno;
-    int i;
 
     if (adapter >= state->adapters_count) {
         MP_ERR(stream, "dvb_set_channel: INVALID internal ADAPTER NUMBER: %d vs %d, abort\n",
@@ -795,19 +907,15 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
         if (state->cur_adapter != adapter ||
             state->cur_frontend != channel->frontend) {
             dvbin_close(stream);
-            if (!dvb_open_devices(priv, devno, channel->frontend, channel->pids_cnt)) {
+            if (!dvb_open_devices(priv, devno, channel->frontend, 0)) {
                 MP_ERR(stream, "DVB_SET_CHANNEL, COULDN'T OPEN DEVICES OF "
                        "ADAPTER: %d, EXIT\n", devno);
                 return 0;
             }
-        } else {
-            // close all demux_fds with pos > pids required for the new channel
-            // or open other demux_fds if we have too few
-            if (!dvb_fix_demuxes(priv, channel->pids_cnt))
-                return 0;
         }
     } else {
-        if (!dvb_open_devices(priv, devno, channel->frontend, channel->pids_cnt)) {
+        // The demux filters are opened after tuning (dvb_apply_pids()).
+        if (!dvb_open_devices(priv, devno, channel->frontend, 0)) {
             MP_ERR(stream, "DVB_SET_CHANNEL2, COULDN'T OPEN DEVICES OF "
                    "ADAPTER: %d, EXIT\n", devno);
             return 0;
@@ -836,34 +944,11 @@ int dvb_set_channel(stream_t *stream, unsigned int adapter, unsigned int n)
     state->cur_adapter = adapter;
     state->cur_frontend = channel->frontend;
 
-    if (channel->service_id != -1) {
-        /* We need the PMT-PID in addition.
-           If it has not yet beem resolved, do it now. */
-        for (i = 0; i < channel->pids_cnt; i++) {
-            if (channel->pids[i] == -1) {
-                MP_VERBOSE(stream, "DVB_SET_CHANNEL: PMT-PID for service %d "
-                           "not resolved yet, parsing PAT...\n",
-                           channel->service_id);
-                int pmt_pid = dvb_get_pmt_pid(priv, adapter, channel->service_id);
-                MP_VERBOSE(stream, "DVB_SET_CHANNEL: Found PMT-PID: %d\n",
-                           pmt_pid);
-                channel->pids[i] = pmt_pid;
-            }
-        }
-    }
-
     // sets demux filters and restart the stream
-    for (i = 0; i < channel->pids_cnt; i++) {
-        if (channel->pids[i] == -1) {
-            // In case PMT was not resolved, skip it here.
-            MP_ERR(stream, "DVB_SET_CHANNEL: PMT-PID not found, "
-                           "teletext-decoding may fail.\n");
-        } else {
-            if (!dvb_set_ts_filt(priv, state->demux_fds[i], channel->pids[i],
-                                 DMX_PES_OTHER))
-                return 0;
-        }
-    }
+    int pids[DMX_FILTER_SIZE];
+    int pids_cnt = dvb_get_mux_pids(stream, adapter, channel, pids);
+    if (!dvb_apply_pids(stream, pids, pids_cnt))
+        return 0;
 
     return 1;
 }
@@ -961,6 +1046,26 @@ static int dvbin_stream_control(struct stream *s, int cmd, void *arg)
         *(char **)arg = talloc_strdup(NULL, progname);
         return STREAM_OK;
     }
+    case STREAM_CTRL_DVB_SET_TRACK_PIDS: {
+        if (!priv->cfg_track_filter || !state->is_on)
+            return STREAM_UNSUPPORTED;
+        struct stream_dvb_pids *req = arg;
+        int pids[DMX_FILTER_SIZE];
+        int cnt = 0;
+        // PAT and SDT, to keep seeing the programs and their names.
+        add_pid(pids, &cnt, 0x0000);
+        add_pid(pids, &cnt, 0x0011);
+        bool ok = req->num_pids > 0;
+        for (int n = 0; n < req->num_pids; n++)
+            ok &= add_pid(pids, &cnt, req->pids[n]);
+        if (!ok) {
+            // Nothing selected, or too many PIDs: pass the whole channel.
+            cnt = dvb_get_mux_pids(s, state->cur_adapter,
+                                   &list->channels[list->current], pids);
+        }
+        MP_VERBOSE(s, "Passing %d PIDs for the selected tracks.\n", cnt);
+        return dvb_apply_pids(s, pids, cnt) ? STREAM_OK : STREAM_ERROR;
+    }
     case STREAM_CTRL_GET_METADATA: {
         struct mp_tags *metadata = talloc_zero(NULL, struct mp_tags);
         char *progname = list->channels[list->current].name;
@@ -25,16 +25,25 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
 #endif
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#include <libavutil/buffer.h>
+
 #include "osdep/io.h"
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -57,6 +66,27 @@
 #endif
 #endif
 
+struct stream_file_opts {
+    int use_mmap;
+    int async_depth;
+    int64_t block_size;
+    int direct_io;
+};
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const struct m_option[]){
+        OPT_FLAG("stream-file-mmap", use_mmap, 0),
+        OPT_INTRANGE("stream-file-async-reads", async_depth, 0, 0, 64),
+        OPT_BYTE_SIZE("stream-file-block-size", block_size, 0, 0,
+                      64 * 1024 * 1024),
+        OPT_FLAG("stream-file-direct-io", direct_io, 0),
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+};
+
 struct priv {
     int fd;
     bool close;
@@ -64,24 +94,400 @@ struct priv {
     bool regular_file;
     bool appending;
     int64_t orig_size;
+
+    // mmap mode: the whole file is mapped, and read from the mapping
+    AVBufferRef *map_buf;
+    unsigned char *map;
+    int64_t map_size;
+    int64_t page_size;
+    bool readahead;             // STREAM_CTRL_SET_READAHEAD state
+    int64_t advised_start;      // range of the last MADV_WILLNEED hint
+    int64_t advised_end;
+
+    // if non-NULL, data before orig_size is read with async reads
+    struct async_reader *async;
+
+    // --stream-file-block-size: if non-NULL (and async reads are not used),
+    // data before orig_size is read in aligned blocks of block_size
+    char *block;                // contains the file data at block_pos
+    int64_t block_pos;
+    int block_len;              // valid bytes in block
+    int block_size;
+    bool direct_io;             // O_DIRECT is set on fd
+};
+
+enum {
+    BLOCK_UNUSED,
+    BLOCK_PENDING,              // read queued or running on a worker thread
+    BLOCK_DONE,
+};
+
+struct async_block {
+    struct async_reader *ar;
+    // All fields are protected by ar->lock. While BLOCK_PENDING, only the
+    // worker thread accesses data, and pos is not changed.
+    int state;
+    int64_t pos;                // file offset (multiple of ar->block_size)
+    int len;                    // bytes read (if BLOCK_DONE)
+    char *data;
+};
+
+struct async_reader {
+    int fd;
+    int block_size;
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct async_block *blocks;
+    int num_blocks;
 };
 
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
 #define RETRY_TIMEOUT 0.2
 #define MAX_RETRIES 10
 
+// Amount of data after the read position the kernel is asked to read ahead
+// in mmap mode.
+#define MMAP_READAHEAD (4 * 1024 * 1024)
+
+// Size and alignment of the reads done with --stream-file-async-reads, unless
+// --stream-file-block-size is set.
+#define ASYNC_BLOCK_SIZE (512 * 1024)
+
+// Alignment of block sizes and buffers used for block reads. (O_DIRECT requires
+// alignment to the logical block size of the device, which is usually less.)
+#define BLOCK_ALIGN 4096
+
+static char *alloc_aligned(void *ta_parent, int size)
+{
+    char *mem = talloc_size(ta_parent, size + BLOCK_ALIGN);
+    return (char *)MP_ALIGN_UP((uintptr_t)mem, BLOCK_ALIGN);
+}
+
 static int64_t get_size(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->map)
+        return p->map_size;
     off_t size = lseek(p->fd, 0, SEEK_END);
     lseek(p->fd, s->pos, SEEK_SET);
     return size == (off_t)-1 ? -1 : size;
 }
 
+#if HAVE_POSIX
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    int64_t *size = opaque;
+    munmap(data, *size);
+    talloc_free(size);
+}
+
+// Map the whole file. Returns success; on failure, normal reads are used.
+static bool map_file(stream_t *s, int64_t size)
+{
+    struct priv *p = s->priv;
+
+    if (size <= 0 || (uint64_t)size > SIZE_MAX / 2)
+        return false;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (map == MAP_FAILED) {
+        MP_VERBOSE(s, "mmap() failed: %s\n", mp_strerror(errno));
+        return false;
+    }
+
+    int64_t *opaque = talloc_ptrtype(NULL, opaque);
+    *opaque = size;
+    // (The size field is informational only, and the real size can exceed it.)
+    p->map_buf = av_buffer_create(map, MPMIN(size, INT_MAX), unmap_file,
+                                  opaque, AV_BUFFER_FLAG_READONLY);
+    if (!p->map_buf) {
+        unmap_file(opaque, map);
+        return false;
+    }
+
+    p->map = map;
+    p->map_size = size;
+    p->page_size = MPMAX(sysconf(_SC_PAGESIZE), 1);
+    p->readahead = true;
+    madvise(map, size, MADV_SEQUENTIAL);
+    MP_VERBOSE(s, "Using memory mapped file.\n");
+    return true;
+}
+
+// Ask the kernel to read ahead the mapped file data after pos, unless this was
+// done recently enough.
+static void advise_readahead(struct priv *p, int64_t pos)
+{
+    if (!p->readahead || (pos >= p->advised_start &&
+                          pos + MMAP_READAHEAD / 2 <= p->advised_end))
+        return;
+    int64_t start = MPMIN(pos, p->map_size) / p->page_size * p->page_size;
+    int64_t end = MPMIN(pos + MMAP_READAHEAD, p->map_size);
+    if (end > start)
+        madvise(p->map + start, end - start, MADV_WILLNEED);
+    p->advised_start = start;
+    p->advised_end = end;
+}
+#else
+static bool map_file(stream_t *s, int64_t size)
+{
+    return false;
+}
+
+static void advise_readahead(struct priv *p, int64_t pos)
+{
+}
+#endif
+
+// Return a new reference to len bytes of the mapping at pos, which must be
+// followed by at least pad bytes of file data.
+static AVBufferRef *read_ref(stream_t *s, int64_t pos, int len, int pad)
+{
+    struct priv *p = s->priv;
+
+    if (pos < 0 || len < 0 || pad < 0 || pos + len + pad > p->map_size)
+        return NULL;
+
+    AVBufferRef *ref = av_buffer_ref(p->map_buf);
+    if (!ref)
+        return NULL;
+    ref->data = p->map + pos;
+    ref->size = len;
+    advise_readahead(p, pos + len);
+    return ref;
+}
+
+#if HAVE_POSIX
+// Read up to size bytes at pos, and return the number of bytes read. Errors
+// are treated as EOF, like in fill_buffer(). (pread() doesn't use the file
+// position, so reads can run concurrently.)
+static int read_at(int fd, char *buf, int size, int64_t pos)
+{
+    int len = 0;
+    while (len < size) {
+        ssize_t r = pread(fd, buf + len, size - len, pos + len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        // (With O_DIRECT, reading on after a short read fails anyway.)
+        if (r <= 0)
+            break;
+        len += r;
+    }
+    return len;
+}
+
+static void read_block_fn(void *ctx)
+{
+    struct async_block *b = ctx;
+    struct async_reader *ar = b->ar;
+
+    int len = read_at(ar->fd, b->data, ar->block_size, b->pos);
+
+    pthread_mutex_lock(&ar->lock);
+    b->len = len;
+    b->state = BLOCK_DONE;
+    pthread_cond_broadcast(&ar->wakeup);
+    pthread_mutex_unlock(&ar->lock);
+}
+
+static struct async_block *find_block(struct async_reader *ar, int64_t pos)
+{
+    for (int n = 0; n < ar->num_blocks; n++) {
+        struct async_block *b = &ar->blocks[n];
+        if (b->state != BLOCK_UNUSED && b->pos == pos)
+            return b;
+    }
+    return NULL;
+}
+
+// Queue reads for the blocks starting at start, as far as there are free
+// blocks. Blocks before start (or too far after it) are reused.
+static void queue_reads(struct async_reader *ar, int64_t start, int64_t size)
+{
+    int64_t end = start + ar->num_blocks * (int64_t)ar->block_size;
+
+    for (int64_t pos = start; pos < MPMIN(end, size); pos += ar->block_size) {
+        if (find_block(ar, pos))
+            continue;
+
+        struct async_block *b = NULL;
+        for (int n = 0; n < ar->num_blocks; n++) {
+            struct async_block *c = &ar->blocks[n];
+            if (c->state == BLOCK_UNUSED ||
+                (c->state == BLOCK_DONE && (c->pos < start || c->pos >= end)))
+            {
+                b = c;
+                break;
+            }
+        }
+        if (!b)
+            break; // all blocks busy
+
+        b->state = BLOCK_PENDING;
+        b->pos = pos;
+        b->len = 0;
+        mp_thread_pool_queue(ar->pool, read_block_fn, b);
+    }
+}
+
+static int async_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct async_reader *ar = p->async;
+    int64_t start = s->pos / ar->block_size * ar->block_size;
+
+    pthread_mutex_lock(&ar->lock);
+    struct async_block *b;
+    while (1) {
+        queue_reads(ar, start, p->orig_size);
+        b = find_block(ar, start);
+        if (b && b->state == BLOCK_DONE)
+            break;
+        // Wait for the block, or for any block to become reusable.
+        pthread_cond_wait(&ar->wakeup, &ar->lock);
+    }
+    int offset = s->pos - start;
+    int len = MPCLAMP(b->len - offset, 0, max_len);
+    memcpy(buffer, b->data + offset, len);
+    pthread_mutex_unlock(&ar->lock);
+
+    return len;
+}
+
+static void async_destroy(void *ptr)
+{
+    struct async_reader *ar = ptr;
+    // Wait for the pending reads. (Must happen before the blocks are freed.)
+    talloc_free(ar->pool);
+    pthread_cond_destroy(&ar->wakeup);
+    pthread_mutex_destroy(&ar->lock);
+}
+
+static bool init_async(stream_t *s, int depth, int block_size)
+{
+    struct priv *p = s->priv;
+
+    struct async_reader *ar = talloc_zero(s, struct async_reader);
+    pthread_mutex_init(&ar->lock, NULL);
+    pthread_cond_init(&ar->wakeup, NULL);
+    talloc_set_destructor(ar, async_destroy);
+    ar->fd = p->fd;
+    ar->block_size = block_size;
+    // (One more block for the data the stream is currently reading from.)
+    ar->num_blocks = depth + 1;
+    ar->blocks = talloc_zero_array(ar, struct async_block, ar->num_blocks);
+    for (int n = 0; n < ar->num_blocks; n++) {
+        ar->blocks[n].ar = ar;
+        ar->blocks[n].data = alloc_aligned(ar, block_size);
+    }
+    ar->pool = mp_thread_pool_create(NULL, depth);
+    if (!ar->pool) {
+        talloc_free(ar);
+        return false;
+    }
+
+    p->async = ar;
+    MP_VERBOSE(s, "Using %d async reads of %d KiB.\n", depth, block_size / 1024);
+    return true;
+}
+
+static int block_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    int64_t start = s->pos / p->block_size * p->block_size;
+    int offset = s->pos - start;
+
+    // (Also reread the block if it was incomplete, e.g. due to a read error.)
+    if (start != p->block_pos || offset >= p->block_len) {
+        p->block_pos = start;
+        p->block_len = read_at(p->fd, p->block, p->block_size, start);
+    }
+
+    int len = MPCLAMP(p->block_len - offset, 0, max_len);
+    memcpy(buffer, p->block + offset, len);
+    return len;
+}
+
+static void init_block_reads(stream_t *s, int block_size)
+{
+    struct priv *p = s->priv;
+    p->block = alloc_aligned(p, block_size);
+    p->block_size = block_size;
+    p->block_pos = -1;
+    MP_VERBOSE(s, "Reading in blocks of %d KiB.\n", block_size / 1024);
+}
+#else
+static int async_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    abort();
+}
+
+static bool init_async(stream_t *s, int depth, int block_size)
+{
+    return false;
+}
+
+static int block_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    abort();
+}
+
+static void init_block_reads(stream_t *s, int block_size)
+{
+}
+#endif
+
+// Bypass the OS page cache. Only used with aligned block reads.
+static bool enable_direct_io(stream_t *s)
+{
+#if defined(O_DIRECT) && !defined(__MINGW32__)
+    struct priv *p = s->priv;
+    int flags = fcntl(p->fd, F_GETFL);
+    if (flags != -1 && fcntl(p->fd, F_SETFL, flags | O_DIRECT) != -1)
+        return true;
+    MP_WARN(s, "Direct I/O not available: %s\n", mp_strerror(errno));
+#else
+    MP_WARN(s, "Direct I/O is not supported on this platform.\n");
+#endif
+    return false;
+}
+
+static void disable_direct_io(stream_t *s)
+{
+#if defined(O_DIRECT) && !defined(__MINGW32__)
+    struct priv *p = s->priv;
+    if (p->direct_io)
+        fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) & ~(unsigned)O_DIRECT);
+    p->direct_io = false;
+#endif
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
 
+    if (p->async || p->block) {
+        if (s->pos < p->orig_size) {
+            return p->async ? async_fill_buffer(s, buffer, max_len)
+                            : block_fill_buffer(s, buffer, max_len);
+        }
+        // Data appended after opening is read normally. The async/block reads
+        // didn't use the file position, so set it to the right place. Normal
+        // reads into the stream buffer can't satisfy O_DIRECT requirements.
+        disable_direct_io(s);
+        lseek(p->fd, s->pos, SEEK_SET);
+    }
+
+    if (p->map) {
+        if (s->pos >= p->map_size)
+            return 0;
+        int len = MPMIN(p->map_size - s->pos, max_len);
+        memcpy(buffer, p->map + s->pos, len);
+        advise_readahead(p, s->pos + len);
+        return len;
+    }
+
 #ifndef __MINGW32__
     if (p->use_poll) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
@@ -136,11 +542,14 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->map)
+        return 1; // fill_buffer() reads at s->pos
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
 static int control(stream_t *s, int cmd, void *arg)
 {
+    struct priv *p = s->priv;
     switch (cmd) {
     case STREAM_CTRL_GET_SIZE: {
         int64_t size = get_size(s);
@@ -150,6 +559,13 @@ static int control(stream_t *s, int cmd, void *arg)
         }
         break;
     }
+    case STREAM_CTRL_SET_READAHEAD:
+        if (!p->map)
+            break;
+        p->readahead = *(int *)arg;
+        if (p->readahead)
+            advise_readahead(p, stream_tell(s));
+        return 1;
     }
     return STREAM_UNSUPPORTED;
 }
@@ -157,6 +573,9 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    talloc_free(p->async);
+    // (The mapping stays valid until all references are released.)
+    av_buffer_unref(&p->map_buf);
     if (p->close)
         close(p->fd);
 }
@@ -360,6 +779,29 @@ static int open_f(stream_t *stream)
 
     p->orig_size = get_size(stream);
 
+    struct stream_file_opts *opts =
+        mp_get_config_group(stream, stream->global, &stream_file_conf);
+    // Files which are appended to can't be mapped in a reasonable way.
+    if (opts->use_mmap && !write && p->regular_file && !p->appending &&
+        map_file(stream, p->orig_size))
+        stream->read_ref = read_ref;
+
+    int block_size = MP_ALIGN_UP(opts->block_size, BLOCK_ALIGN);
+    if (opts->direct_io && !block_size)
+        block_size = ASYNC_BLOCK_SIZE;
+    if (!write && p->regular_file && !p->map) {
+        if (opts->direct_io)
+            p->direct_io = enable_direct_io(stream);
+        if (opts->async_depth) {
+            init_async(stream, opts->async_depth,
+                       block_size ? block_size : ASYNC_BLOCK_SIZE);
+        }
+        if (!p->async && block_size)
+            init_block_reads(stream, block_size);
+        if (!p->async && !p->block)
+            disable_direct_io(stream);
+    }
+
     return STREAM_OK;
 }
 
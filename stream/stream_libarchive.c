@@ -20,6 +20,8 @@
 
 #include "misc/bstr.h"
 #include "common/common.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "stream.h"
 
 #include "stream_libarchive.h"
@@ -345,12 +347,44 @@ bool mp_archive_next_entry(struct mp_archive *mpa)
     return success;
 }
 
+struct stream_libarchive_opts {
+    int checkpoints;
+};
+
+#define OPT_BASE_STRUCT struct stream_libarchive_opts
+
+const struct m_sub_options stream_libarchive_conf = {
+    .opts = (const struct m_option[]){
+        OPT_INTRANGE("archive-checkpoints", checkpoints, 0, 0, 16),
+        {0}
+    },
+    .size = sizeof(struct stream_libarchive_opts),
+    .defaults = &(const struct stream_libarchive_opts){
+        .checkpoints = 2,
+    },
+};
+
+// libarchive can't seek in most formats, and can't copy the decompressor state
+// either. So a reader that was left at pos is kept around, and a later seek to
+// a position after it can resume from there, instead of decompressing from the
+// start of the entry again.
+struct checkpoint {
+    struct mp_archive *mpa;
+    struct stream *src;     // owned, separate from other readers
+    int64_t pos;
+};
+
 struct priv {
     struct mp_archive *mpa;
     bool broken_seek;
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    char *base_url;
+    // Oldest first. Up to max_checkpoints.
+    struct checkpoint *checkpoints;
+    int num_checkpoints;
+    int max_checkpoints;
 };
 
 static int reopen_archive(stream_t *s)
@@ -380,6 +414,72 @@ static int reopen_archive(stream_t *s)
     return STREAM_ERROR;
 }
 
+static void free_checkpoint(struct checkpoint *c)
+{
+    mp_archive_free(c->mpa);
+    free_stream(c->src);
+}
+
+// Switch to another reader for a seek to pos: the checkpoint closest before pos
+// (if it's further than the current position), or a newly opened one if pos is
+// before the current position. The current reader becomes a checkpoint.
+static int switch_reader(stream_t *s, int64_t pos)
+{
+    struct priv *p = s->priv;
+
+    int best = -1;
+    int64_t best_pos = pos < s->pos ? 0 : s->pos;
+    for (int n = 0; n < p->num_checkpoints; n++) {
+        struct checkpoint *c = &p->checkpoints[n];
+        if (c->pos <= pos && c->pos > best_pos) {
+            best = n;
+            best_pos = c->pos;
+        }
+    }
+    if (best < 0 && pos >= s->pos)
+        return STREAM_OK;
+
+    struct checkpoint next = {0};
+    if (best >= 0) {
+        next = p->checkpoints[best];
+        MP_TARRAY_REMOVE_AT(p->checkpoints, p->num_checkpoints, best);
+    }
+
+    struct checkpoint cur = {p->mpa, p->src, s->pos};
+    if (p->mpa && s->pos > 0 && p->max_checkpoints > 0) {
+        if (p->num_checkpoints >= p->max_checkpoints) {
+            free_checkpoint(&p->checkpoints[0]);
+            MP_TARRAY_REMOVE_AT(p->checkpoints, p->num_checkpoints, 0);
+        }
+        MP_TARRAY_APPEND(p, p->checkpoints, p->num_checkpoints, cur);
+        p->mpa = NULL;
+        p->src = NULL;
+    } else if (best >= 0) {
+        free_checkpoint(&cur);
+        p->mpa = NULL;
+        p->src = NULL;
+    }
+
+    if (best >= 0) {
+        MP_VERBOSE(s, "resuming archive reader at %"PRId64"\n", next.pos);
+        p->mpa = next.mpa;
+        p->src = next.src;
+        s->pos = next.pos;
+        return STREAM_OK;
+    }
+
+    MP_VERBOSE(s, "trying to reopen archive for performing seek\n");
+    if (!p->src) {
+        p->src = stream_create(p->base_url, STREAM_READ | STREAM_SAFE_ONLY,
+                               s->cancel, s->global);
+        if (!p->src)
+            return STREAM_ERROR;
+    }
+    int r = reopen_archive(s);
+    s->pos = 0;
+    return r;
+}
+
 static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -411,16 +511,12 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
         p->broken_seek = true;
         if (reopen_archive(s) < STREAM_OK)
             return -1;
-    }
-    // libarchive can't seek in most formats.
-    if (newpos < s->pos) {
-        // Hack seeking backwards into working by reopening the archive and
-        // starting over.
-        MP_VERBOSE(s, "trying to reopen archive for performing seek\n");
-        if (reopen_archive(s) < STREAM_OK)
-            return -1;
         s->pos = 0;
     }
+    // libarchive can't seek in most formats. Hack seeking backwards into
+    // working by starting over, or from a checkpoint.
+    if (switch_reader(s, newpos) < STREAM_OK)
+        return -1;
     if (newpos > s->pos) {
         // For seeking forwards, just keep reading data (there's no libarchive
         // skip function either).
@@ -460,6 +556,9 @@ static void archive_entry_close(stream_t *s)
     struct priv *p = s->priv;
     mp_archive_free(p->mpa);
     free_stream(p->src);
+    for (int n = 0; n < p->num_checkpoints; n++)
+        free_checkpoint(&p->checkpoints[n]);
+    p->num_checkpoints = 0;
 }
 
 static int archive_entry_control(stream_t *s, int cmd, void *arg)
@@ -467,7 +566,7 @@ static int archive_entry_control(stream_t *s, int cmd, void *arg)
     struct priv *p = s->priv;
     switch (cmd) {
     case STREAM_CTRL_GET_BASE_FILENAME:
-        *(char **)arg = talloc_strdup(NULL, p->src->url);
+        *(char **)arg = talloc_strdup(NULL, p->base_url);
         return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (p->entry_size < 0)
@@ -491,6 +590,11 @@ static int archive_entry_open(stream_t *stream)
     *name++ = '\0';
     p->entry_name = name;
     mp_url_unescape_inplace(base);
+    p->base_url = base;
+
+    struct stream_libarchive_opts *opts =
+        mp_get_config_group(p, stream->global, &stream_libarchive_conf);
+    p->max_checkpoints = opts->checkpoints;
 
     p->src = stream_create(base, STREAM_READ | STREAM_SAFE_ONLY,
                            stream->cancel, stream->global);
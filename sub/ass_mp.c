@@ -23,6 +23,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <ass/ass.h>
 #include <ass/ass_types.h>
@@ -31,6 +32,8 @@
 #include "common/global.h"
 #include "common/msg.h"
 #include "options/path.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
 #include "ass_mp.h"
 #include "img_convert.h"
 #include "osd.h"
@@ -86,21 +89,81 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
     style->Italic = opts->italic;
 }
 
+struct mp_ass_font_loader {
+    ASS_Renderer *renderer;
+    struct mp_log *log;
+    char *default_font;
+    char *family;
+    char *config;
+    pthread_t thread;
+    atomic_bool ready;
+};
+
+static struct mp_ass_font_loader *font_loader_alloc(ASS_Renderer *priv,
+                                                    struct osd_style_opts *opts,
+                                                    struct mpv_global *global,
+                                                    struct mp_log *log)
+{
+    struct mp_ass_font_loader *l = talloc_zero(NULL, struct mp_ass_font_loader);
+    l->renderer = priv;
+    l->log = log;
+    l->default_font = mp_find_config_file(l, global, "subfont.ttf");
+    l->family = talloc_strdup(l, opts->font);
+    l->config = mp_find_config_file(l, global, "fonts.conf");
+
+    if (l->default_font && !mp_path_exists(l->default_font))
+        l->default_font = NULL;
+    return l;
+}
+
+static void load_fonts(struct mp_ass_font_loader *l)
+{
+    mp_verbose(l->log, "Setting up fonts...\n");
+    ass_set_fonts(l->renderer, l->default_font, l->family, 1, l->config, 1);
+    mp_verbose(l->log, "Done.\n");
+    atomic_store(&l->ready, true);
+}
+
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log)
 {
-    void *tmp = talloc_new(NULL);
-    char *default_font = mp_find_config_file(tmp, global, "subfont.ttf");
-    char *config       = mp_find_config_file(tmp, global, "fonts.conf");
+    struct mp_ass_font_loader *l = font_loader_alloc(priv, opts, global, log);
+    load_fonts(l);
+    talloc_free(l);
+}
+
+static void *font_loader_thread(void *p)
+{
+    mpthread_set_name("ass/fonts");
+    load_fonts(p);
+    return NULL;
+}
 
-    if (default_font && !mp_path_exists(default_font))
-        default_font = NULL;
+struct mp_ass_font_loader *mp_ass_configure_fonts_async(ASS_Renderer *priv,
+                                    struct osd_style_opts *opts,
+                                    struct mpv_global *global,
+                                    struct mp_log *log)
+{
+    struct mp_ass_font_loader *l = font_loader_alloc(priv, opts, global, log);
+    if (pthread_create(&l->thread, NULL, font_loader_thread, l)) {
+        load_fonts(l);
+        talloc_free(l);
+        return NULL;
+    }
+    return l;
+}
 
-    mp_verbose(log, "Setting up fonts...\n");
-    ass_set_fonts(priv, default_font, opts->font, 1, config, 1);
-    mp_verbose(log, "Done.\n");
+bool mp_ass_font_loader_ready(struct mp_ass_font_loader *l)
+{
+    return !l || atomic_load(&l->ready);
+}
 
-    talloc_free(tmp);
+void mp_ass_font_loader_free(struct mp_ass_font_loader *l)
+{
+    if (!l)
+        return;
+    pthread_join(l->thread, NULL);
+    talloc_free(l);
 }
 
 static const int map_ass_level[] = {
@@ -185,6 +248,17 @@ static void draw_ass_rgba(unsigned char *src, int src_w, int src_h,
     }
 }
 
+// A bitmap in mp_ass_packer.atlas.
+struct atlas_entry {
+    uint64_t id;
+    int w, h;
+    struct pos pos;
+    unsigned last_used;
+};
+
+// Don't grow the atlas beyond this.
+#define MAX_ATLAS_SIZE 16384
+
 struct mp_ass_packer {
     struct sub_bitmap *cached_parts; // only for the array memory
     struct mp_image *cached_img;
@@ -192,6 +266,14 @@ struct mp_ass_packer {
     bool cached_subs_valid;
     struct sub_bitmap rgba_imgs[MP_SUB_BB_LIST_MAX];
     struct bitmap_packer *packer;
+    // For SUBBITMAP_LIBASS. Bitmaps stay in the atlas (at the same position)
+    // across calls, so only new bitmaps need to be copied.
+    struct mp_image *atlas;
+    struct inc_packer *atlas_packer;
+    struct atlas_entry *entries;
+    int num_entries;
+    unsigned gen;
+    struct sub_bitmap *src_parts; // only for the array memory
 };
 
 // Free with talloc_free().
@@ -199,6 +281,7 @@ struct mp_ass_packer *mp_ass_packer_alloc(void *ta_parent)
 {
     struct mp_ass_packer *p = talloc_zero(ta_parent, struct mp_ass_packer);
     p->packer = talloc_zero(p, struct bitmap_packer);
+    p->atlas_packer = talloc_zero(p, struct inc_packer);
     return p;
 }
 
@@ -242,23 +325,136 @@ static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
     return true;
 }
 
-static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
+static void reset_atlas(struct mp_ass_packer *p)
+{
+    p->num_entries = 0;
+    inc_packer_reset(p->atlas_packer);
+}
+
+static bool realloc_atlas(struct mp_ass_packer *p, int w, int h)
 {
-    if (!pack(p, res, IMGFMT_Y8))
+    talloc_free(p->atlas);
+    p->atlas = mp_image_alloc(IMGFMT_Y8, w, h);
+    if (!p->atlas)
         return false;
+    talloc_steal(p, p->atlas);
+    p->atlas_packer->w = w;
+    p->atlas_packer->h = h;
+    reset_atlas(p);
+    return true;
+}
+
+// Remove all bitmaps not used by the current sub_bitmaps.
+static void evict_entries(struct mp_ass_packer *p)
+{
+    int keep = 0;
+    for (int n = 0; n < p->num_entries; n++) {
+        struct atlas_entry *e = &p->entries[n];
+        if (e->last_used == p->gen) {
+            p->entries[keep++] = *e;
+        } else {
+            inc_packer_remove(p->atlas_packer, e->pos, e->w, e->h);
+        }
+    }
+    p->num_entries = keep;
+}
+
+// Point all parts to their copy in the atlas, and copy the ones which are not
+// in it yet. Returns false if the atlas is too small.
+static bool place_bitmaps(struct mp_ass_packer *p, struct sub_bitmaps *res,
+                          struct sub_bitmap *src)
+{
+    res->packed_w = res->packed_h = 0;
 
     for (int n = 0; n < res->num_parts; n++) {
         struct sub_bitmap *b = &res->parts[n];
+        struct sub_bitmap *s = &src[n];
+
+        struct atlas_entry *e = NULL;
+        for (int i = 0; i < p->num_entries; i++) {
+            struct atlas_entry *c = &p->entries[i];
+            if (c->id == s->id && c->w == s->w && c->h == s->h) {
+                e = c;
+                break;
+            }
+        }
+        if (!e) {
+            struct pos pos;
+            if (!inc_packer_insert(p->atlas_packer, s->w, s->h, &pos)) {
+                evict_entries(p);
+                if (!inc_packer_insert(p->atlas_packer, s->w, s->h, &pos))
+                    return false;
+            }
+            uint8_t *dst = (uint8_t *)p->atlas->planes[0] +
+                           pos.y * p->atlas->stride[0] + pos.x;
+            memcpy_pic(dst, s->bitmap, s->w, s->h, p->atlas->stride[0],
+                       s->stride);
+            MP_TARRAY_APPEND(p, p->entries, p->num_entries,
+                             (struct atlas_entry){s->id, s->w, s->h, pos});
+            e = &p->entries[p->num_entries - 1];
+        }
+        e->last_used = p->gen;
+
+        b->src_x = e->pos.x;
+        b->src_y = e->pos.y;
+        b->stride = p->atlas->stride[0];
+        b->bitmap = (uint8_t *)p->atlas->planes[0] +
+                    b->src_y * b->stride + b->src_x;
+        res->packed_w = MPMAX(res->packed_w, b->src_x + b->w);
+        res->packed_h = MPMAX(res->packed_h, b->src_y + b->h);
+    }
+    return true;
+}
 
-        int stride = res->packed->stride[0];
-        void *pdata =
-            (uint8_t *)res->packed->planes[0] + b->src_y * stride + b->src_x;
-        memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
+// Unlike pack_rgba(), this keeps the bitmaps in an atlas image across calls.
+// If it runs full, bitmaps which are not visible anymore are removed. If that's
+// not enough, it's repacked with only the current bitmaps (and enlarged, if
+// that's still not enough).
+static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
+{
+    if (!res->num_parts)
+        return false;
 
-        b->bitmap = pdata;
-        b->stride = stride;
+    p->gen++;
+
+    // place_bitmaps() overwrites the bitmap pointers, but may need to start
+    // over with the original ones.
+    MP_TARRAY_GROW(p, p->src_parts, res->num_parts);
+    struct sub_bitmap *src = p->src_parts;
+    memcpy(src, res->parts, res->num_parts * sizeof(src[0]));
+
+    bool ok = p->atlas && place_bitmaps(p, res, src);
+    if (!ok) {
+        int w = p->atlas ? p->atlas->w : 256;
+        int h = p->atlas ? p->atlas->h : 256;
+        for (int n = 0; n < res->num_parts; n++) {
+            while (w < src[n].w)
+                w *= 2;
+            while (h < src[n].h)
+                h *= 2;
+        }
+        if (!p->atlas || w != p->atlas->w || h != p->atlas->h) {
+            ok = w <= MAX_ATLAS_SIZE && h <= MAX_ATLAS_SIZE &&
+                 realloc_atlas(p, w, h);
+        } else {
+            reset_atlas(p);
+            ok = true;
+        }
+        while (ok && !place_bitmaps(p, res, src)) {
+            if (w <= h) {
+                w *= 2;
+            } else {
+                h *= 2;
+            }
+            ok = w <= MAX_ATLAS_SIZE && h <= MAX_ATLAS_SIZE &&
+                 realloc_atlas(p, w, h);
+        }
     }
 
+    if (!ok)
+        return false;
+
+    res->packed = p->atlas;
     return true;
 }
 
@@ -290,6 +486,7 @@ static bool pack_rgba(struct mp_ass_packer *p, struct sub_bitmaps *res)
         b->y = bb.y0;
         b->w = b->dw = bb.x1 - bb.x0;
         b->h = b->dh = bb.y1 - bb.y0;
+        b->id = 0;
         b->stride = imgs.packed->stride[0];
         b->bitmap = (uint8_t *)imgs.packed->planes[0] +
                     b->stride * b->src_y + b->src_x * 4;
@@ -319,7 +516,8 @@ static bool pack_rgba(struct mp_ass_packer *p, struct sub_bitmaps *res)
 // Pack the contents of image_lists[0] to image_lists[num_image_lists-1] into
 // a single image, and make *out point to it. *out is completely overwritten.
 // If libass reported any change, image_lists_changed must be set (it then
-// repacks all images). preferred_osd_format can be set to a desired
+// repacks all images; for SUBBITMAP_LIBASS, only bitmaps which are new
+// compared to previous calls are copied). preferred_osd_format can be set to a desired
 // sub_bitmap_format. Currently, only SUBBITMAP_LIBASS is supported.
 void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
                         int num_image_lists, bool image_lists_changed,
@@ -358,6 +556,7 @@ void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
             b->dh = b->h = img->h;
             b->x = img->dst_x;
             b->y = img->dst_y;
+            b->id = mp_sub_bitmap_hash(b, 1);
             res.num_parts++;
         }
     }
@@ -47,6 +47,20 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
 
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log);
+
+// Like mp_ass_configure_fonts(), but runs the font setup (which can take very
+// long if fontconfig needs to rebuild its cache) on a separate thread. The
+// renderer must not be used until mp_ass_font_loader_ready() returns true, and
+// nothing must add fonts to its ASS_Library until then.
+struct mp_ass_font_loader;
+struct mp_ass_font_loader *mp_ass_configure_fonts_async(ASS_Renderer *priv,
+                                    struct osd_style_opts *opts,
+                                    struct mpv_global *global,
+                                    struct mp_log *log);
+bool mp_ass_font_loader_ready(struct mp_ass_font_loader *l);
+// Wait until the fonts are set up, and free l. l can be NULL.
+void mp_ass_font_loader_free(struct mp_ass_font_loader *l);
+
 ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log);
 
 struct sub_bitmaps;
@@ -142,6 +142,7 @@ static struct sd *init_decoder(struct dec_sub *sub)
             .driver = driver,
             .attachments = sub->attachments,
             .codec = sub->codec,
+            .lock = &sub->lock,
             .preload_ok = true,
         };
 
@@ -401,8 +402,11 @@ int sub_control(struct dec_sub *sub, enum sd_ctrl cmd, void *arg)
 void sub_update_opts(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
-    if (m_config_cache_update(sub->opts_cache))
+    if (m_config_cache_update(sub->opts_cache)) {
         update_subtitle_speed(sub);
+        if (sub->sd->driver->control)
+            sub->sd->driver->control(sub->sd, SD_CTRL_UPDATE_OPTS, NULL);
+    }
     pthread_mutex_unlock(&sub->lock);
 }
 
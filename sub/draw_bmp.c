@@ -23,9 +23,11 @@
 
 #include <libswscale/swscale.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 
 #include "common/common.h"
 #include "draw_bmp.h"
+#include "draw_bmp_simd.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
@@ -39,6 +41,9 @@ const bool mp_draw_sub_formats[SUBBITMAP_COUNT] = {
 
 struct sub_cache {
     struct mp_image *i, *a;
+    // sub_bitmap fields the scaled images were created from
+    uint64_t id;
+    int w, h, dw, dh;
 };
 
 struct part {
@@ -55,6 +60,7 @@ struct mp_draw_sub_cache
     struct part *parts[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    uint8_t *chroma_alpha; // for draw_ass_420p()
 };
 
 
@@ -66,9 +72,44 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
 
 #define CONDITIONAL 1
 
+// The SIMD functions return the number of pixels done.
+static int blend_const_u8_simd(uint8_t *dst, const uint8_t *a, int mul, int c,
+                               int w)
+{
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return blend_const_u8_avx2(dst, a, mul, c, w);
+#endif
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        return blend_const_u8_sse2(dst, a, mul, c, w);
+#endif
+#if HAVE_NEON_INTRINSICS
+    return blend_const_u8_neon(dst, a, mul, c, w);
+#endif
+    return 0;
+}
+
+static int blend_src_u8_simd(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *a, int w)
+{
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        return blend_src_u8_avx2(dst, src, a, w);
+#endif
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        return blend_src_u8_sse2(dst, src, a, w);
+#endif
+#if HAVE_NEON_INTRINSICS
+    return blend_src_u8_neon(dst, src, a, w);
+#endif
+    return 0;
+}
+
 #define BLEND_CONST_ALPHA(TYPE)                                                 \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         srcap *= srcamul; /* now 0..65025 */                                    \
@@ -85,9 +126,11 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x0 = 0;
         if (bytes == 2) {
             BLEND_CONST_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            x0 = blend_const_u8_simd(dst_rp, srca_r, srcamul, srcp, w);
             BLEND_CONST_ALPHA(uint8_t)
         }
     }
@@ -95,7 +138,7 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
 
 #define BLEND_SRC_ALPHA(TYPE)                                                   \
     TYPE *dst_r = dst_rp, *src_r = src_rp;                                      \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
@@ -110,9 +153,11 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         void *src_rp = (uint8_t *)src + src_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x0 = 0;
         if (bytes == 2) {
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            x0 = blend_src_u8_simd(dst_rp, src_rp, srca_r, w);
             BLEND_SRC_ALPHA(uint8_t)
         }
     }
@@ -120,7 +165,7 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
 
 #define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint16_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
         dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
     }
@@ -133,9 +178,12 @@ static void blend_src_dst_mul(void *dst, int dst_stride,
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        int x0 = 0;
         if (dst_bytes == 2) {
             BLEND_SRC_DST_MUL(uint16_t, 65025)
         } else if (dst_bytes == 1) {
+            // Same as blend_const_alpha() with srcp = 255.
+            x0 = blend_const_u8_simd(dst_rp, src_r, srcmul, 255, w);
             BLEND_SRC_DST_MUL(uint8_t, 255)
         }
     }
@@ -241,26 +289,62 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
                               sba->stride[0], 255, dst.w, dst.h, bytes);
         }
 
-        part->imgs[i].i = talloc_steal(part, sbi);
-        part->imgs[i].a = talloc_steal(part, sba);
+        part->imgs[i] = (struct sub_cache){
+            .i = talloc_steal(part, sbi),
+            .a = talloc_steal(part, sba),
+            .id = sb->id,
+            .w = sb->w, .h = sb->h,
+            .dw = sb->dw, .dh = sb->dh,
+        };
     }
 }
 
-static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+struct ass_conv {
+    bool need_conv;
+    struct mp_cmat rgb2yuv;
+    int texture_bits;
+};
+
+static void init_ass_conv(struct ass_conv *conv, struct mp_image *img, int bits)
 {
     struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
-    mp_csp_set_image_params(&cspar, &temp->params);
+    mp_csp_set_image_params(&cspar, &img->params);
     cspar.levels_out = MP_CSP_LEVELS_PC; // RGB (libass.color)
     cspar.input_bits = bits;
     cspar.texture_bits = (bits + 7) / 8 * 8;
 
-    struct mp_cmat yuv2rgb, rgb2yuv;
-    bool need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
-    if (need_conv) {
+    conv->texture_bits = cspar.texture_bits;
+    conv->need_conv = img->fmt.flags & MP_IMGFLAG_YUV;
+    if (conv->need_conv) {
+        struct mp_cmat yuv2rgb;
         mp_get_csp_matrix(&cspar, &yuv2rgb);
-        mp_invert_cmat(&rgb2yuv, &yuv2rgb);
+        mp_invert_cmat(&conv->rgb2yuv, &yuv2rgb);
+    }
+}
+
+// Return the alpha multiplier, and the color in the image's format in out.
+static int get_ass_color(struct ass_conv *conv, struct sub_bitmap *sb,
+                         int out[3])
+{
+    int r = (sb->libass.color >> 24) & 0xFF;
+    int g = (sb->libass.color >> 16) & 0xFF;
+    int b = (sb->libass.color >> 8) & 0xFF;
+    if (conv->need_conv) {
+        int rgb[3] = {r, g, b};
+        mp_map_fixp_color(&conv->rgb2yuv, 8, rgb, conv->texture_bits, out);
+    } else {
+        out[0] = g;
+        out[1] = b;
+        out[2] = r;
     }
+    return 255 - (sb->libass.color & 0xFF);
+}
+
+static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
+                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+{
+    struct ass_conv conv;
+    init_ass_conv(&conv, temp, bits);
 
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
@@ -270,19 +354,8 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
             continue;
 
-        int r = (sb->libass.color >> 24) & 0xFF;
-        int g = (sb->libass.color >> 16) & 0xFF;
-        int b = (sb->libass.color >> 8) & 0xFF;
-        int a = 255 - (sb->libass.color & 0xFF);
         int color_yuv[3];
-        if (need_conv) {
-            int rgb[3] = {r, g, b};
-            mp_map_fixp_color(&rgb2yuv, 8, rgb, cspar.texture_bits, color_yuv);
-        } else {
-            color_yuv[0] = g;
-            color_yuv[1] = b;
-            color_yuv[2] = r;
-        }
+        int a = get_ass_color(&conv, sb, color_yuv);
 
         int bytes = (bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
@@ -297,6 +370,77 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+// Sum of the alpha values at x and x + 1 in a bitmap row (which may be NULL),
+// where values outside of [x0, x1) count as 0.
+static int sum_alpha2(uint8_t *row, int x, int x0, int x1)
+{
+    if (!row)
+        return 0;
+    int sum = 0;
+    if (x >= x0)
+        sum += row[x];
+    if (x + 1 < x1)
+        sum += row[x + 1];
+    return sum;
+}
+
+// Draw libass bitmaps directly onto a 8 bit 4:2:0 image. Luma is blended at
+// full resolution. Chroma is blended with the average alpha of each 2x2 block,
+// which is the same as blending at full resolution and averaging afterwards
+// (minus rounding), but avoids converting the area to 4:4:4 and back.
+static void draw_ass_420p(struct mp_draw_sub_cache *cache,
+                          struct mp_image *dst, struct sub_bitmaps *sbs)
+{
+    struct ass_conv conv;
+    init_ass_conv(&conv, dst, 8);
+
+    for (int i = 0; i < sbs->num_parts; ++i) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+
+        struct mp_rect rc = {sb->x, sb->y, sb->x + sb->dw, sb->y + sb->dh};
+        if (!mp_rect_intersection(&rc, &(struct mp_rect){0, 0, dst->w, dst->h}))
+            continue;
+
+        int color_yuv[3];
+        int a = get_ass_color(&conv, sb, color_yuv);
+
+        uint8_t *alpha_p = (uint8_t *)sb->bitmap +
+                           (rc.y0 - sb->y) * sb->stride + (rc.x0 - sb->x);
+        blend_const_alpha(dst->planes[0] + rc.y0 * dst->stride[0] + rc.x0,
+                          dst->stride[0], color_yuv[0], alpha_p, sb->stride, a,
+                          rc.x1 - rc.x0, rc.y1 - rc.y0, 1);
+
+        // Chroma pixels touched by rc, and their average alpha.
+        struct mp_rect crc = {rc.x0 >> 1, rc.y0 >> 1,
+                              (rc.x1 + 1) >> 1, (rc.y1 + 1) >> 1};
+        int cw = crc.x1 - crc.x0, ch = crc.y1 - crc.y0;
+        MP_TARRAY_GROW(cache, cache->chroma_alpha, cw * ch);
+        // Bitmap coordinates of rc.
+        int bx0 = rc.x0 - sb->x, bx1 = rc.x1 - sb->x;
+        int by0 = rc.y0 - sb->y, by1 = rc.y1 - sb->y;
+        for (int y = 0; y < ch; y++) {
+            int by = (crc.y0 + y) * 2 - sb->y;
+            uint8_t *r0 = by >= by0 ? (uint8_t *)sb->bitmap + by * sb->stride
+                                    : NULL;
+            uint8_t *r1 = by + 1 < by1 ? (uint8_t *)sb->bitmap +
+                                         (by + 1) * sb->stride : NULL;
+            uint8_t *out = cache->chroma_alpha + y * cw;
+            for (int x = 0; x < cw; x++) {
+                int bx = (crc.x0 + x) * 2 - sb->x;
+                int sum = sum_alpha2(r0, bx, bx0, bx1) +
+                          sum_alpha2(r1, bx, bx0, bx1);
+                out[x] = (sum + 2) >> 2;
+            }
+        }
+
+        for (int p = 1; p < 3; p++) {
+            blend_const_alpha(dst->planes[p] + crc.y0 * dst->stride[p] + crc.x0,
+                              dst->stride[p], color_yuv[p], cache->chroma_alpha,
+                              cw, a, cw, ch, 1);
+        }
+    }
+}
+
 static void get_swscale_alignment(const struct mp_image *img, int *out_xstep,
                                   int *out_ystep)
 {
@@ -355,6 +499,33 @@ static void get_closest_y444_format(int imgfmt, int *out_format, int *out_bits)
     *out_bits = mp_imgfmt_get_desc(*out_format).component_bits;
 }
 
+// Move the scaled images of bitmaps which are still present from old to part.
+static void reuse_cached_imgs(struct part *part, struct part *old,
+                              struct sub_bitmaps *sbs)
+{
+    int next = 0;
+    for (int i = 0; i < part->num_imgs; i++) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+        if (!sb->id)
+            continue;
+        // Bitmaps usually keep their order, so start after the last match.
+        for (int n = 0; n < old->num_imgs; n++) {
+            int j = (next + n) % old->num_imgs;
+            struct sub_cache *c = &old->imgs[j];
+            if (c->i && c->id == sb->id && c->w == sb->w && c->h == sb->h &&
+                c->dw == sb->dw && c->dh == sb->dh)
+            {
+                part->imgs[i] = *c;
+                talloc_steal(part, c->i);
+                talloc_steal(part, c->a);
+                *c = (struct sub_cache){0};
+                next = j + 1;
+                break;
+            }
+        }
+    }
+}
+
 static struct part *get_cache(struct mp_draw_sub_cache *cache,
                               struct sub_bitmaps *sbs, struct mp_image *format)
 {
@@ -362,15 +533,18 @@ static struct part *get_cache(struct mp_draw_sub_cache *cache,
 
     bool use_cache = sbs->format == SUBBITMAP_RGBA;
     if (use_cache) {
+        struct part *old = NULL;
         part = cache->parts[sbs->render_index];
         if (part) {
-            if (part->change_id != sbs->change_id
-                || part->imgfmt != format->imgfmt
+            if (part->imgfmt != format->imgfmt
                 || part->colorspace != format->params.color.space
                 || part->levels != format->params.color.levels)
             {
                 talloc_free(part);
                 part = NULL;
+            } else if (part->change_id != sbs->change_id) {
+                old = part;
+                part = NULL;
             }
         }
         if (!part) {
@@ -384,6 +558,9 @@ static struct part *get_cache(struct mp_draw_sub_cache *cache,
             };
             part->imgs = talloc_zero_array(part, struct sub_cache,
                                            part->num_imgs);
+            if (old)
+                reuse_cached_imgs(part, old, sbs);
+            talloc_free(old);
         }
         assert(part->num_imgs == sbs->num_parts);
         cache->parts[sbs->render_index] = part;
@@ -504,6 +681,11 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     if (!cache_)
         cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
 
+    if (sbs->format == SUBBITMAP_LIBASS && dst->imgfmt == IMGFMT_420P) {
+        draw_ass_420p(cache_, dst, sbs);
+        goto done;
+    }
+
     int format, bits;
     get_closest_y444_format(dst->imgfmt, &format, &bits);
 
@@ -531,6 +713,7 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
         chroma_down(&dst_region, temp);
     }
 
+done:
     if (cache) {
         *cache = cache_;
     } else {
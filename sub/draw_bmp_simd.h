@@ -0,0 +1,280 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DRAW_BMP_SIMD_H
+#define MP_DRAW_BMP_SIMD_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Vectorized versions of the 8 bit blending loops in draw_bmp.c. Each function
+// processes a multiple of its vector width, and returns the number of pixels
+// done; the caller handles the rest. The results are bit-exact with the
+// scalar code. The x86 variants must be selected at runtime.
+//
+//  blend_const_u8: dst = (c * w + dst * (65025 - w) + 32512) / 65025
+//                  with w = a * mul
+//  blend_src_u8:   dst = (src * a + dst * (255 - a) + 127) / 255
+//
+// The divisions are done as multiplication with a rounded up reciprocal:
+//  n / 65025 == (n * BLEND_RCP_65025) >> 40  for n < 2^24
+//  n / 255   == (n * 0x8081) >> 23           for n < 2^16
+
+#define BLEND_RCP_65025 16909061
+
+#if HAVE_SSE4_INTRINSICS
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+// n: 4 x uint32
+static inline __m128i blend_div65025_sse2(__m128i n)
+{
+    __m128i rcp = _mm_set1_epi32(BLEND_RCP_65025);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(n, rcp), 40);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(n, 32), rcp), 40);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// a, d: 8 x uint16 (values 0..255); returns 8 x uint16
+static inline __m128i blend_const8_sse2(__m128i a, __m128i d, __m128i mul,
+                                        __m128i c)
+{
+    __m128i w = _mm_mullo_epi16(a, mul);
+    __m128i iw = _mm_sub_epi16(_mm_set1_epi16((int16_t)65025), w);
+    // 16x16->32 bit unsigned products
+    __m128i cw_l = _mm_mullo_epi16(w, c), cw_h = _mm_mulhi_epu16(w, c);
+    __m128i dw_l = _mm_mullo_epi16(iw, d), dw_h = _mm_mulhi_epu16(iw, d);
+    __m128i rnd = _mm_set1_epi32(32512);
+    __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(cw_l, cw_h),
+                               _mm_unpacklo_epi16(dw_l, dw_h));
+    __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(cw_l, cw_h),
+                               _mm_unpackhi_epi16(dw_l, dw_h));
+    lo = blend_div65025_sse2(_mm_add_epi32(lo, rnd));
+    hi = blend_div65025_sse2(_mm_add_epi32(hi, rnd));
+    return _mm_packs_epi32(lo, hi);
+}
+
+static inline int blend_const_u8_sse2(uint8_t *dst, const uint8_t *a, int mul,
+                                      int c, int w)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i vmul = _mm_set1_epi16(mul), vc = _mm_set1_epi16(c);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i av = _mm_loadu_si128((const __m128i *)(a + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(av, zero)) == 0xFFFF)
+            continue;
+        __m128i dv = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_const8_sse2(_mm_unpacklo_epi8(av, zero),
+                                       _mm_unpacklo_epi8(dv, zero), vmul, vc);
+        __m128i hi = blend_const8_sse2(_mm_unpackhi_epi8(av, zero),
+                                       _mm_unpackhi_epi8(dv, zero), vmul, vc);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+// s, d, a: 8 x uint16 (values 0..255); returns 8 x uint16
+static inline __m128i blend_src8_sse2(__m128i s, __m128i d, __m128i a)
+{
+    __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    __m128i n = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia));
+    n = _mm_add_epi16(n, _mm_set1_epi16(127));
+    n = _mm_mulhi_epu16(n, _mm_set1_epi16((int16_t)0x8081));
+    return _mm_srli_epi16(n, 7);
+}
+
+static inline int blend_src_u8_sse2(uint8_t *dst, const uint8_t *src,
+                                    const uint8_t *a, int w)
+{
+    __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i av = _mm_loadu_si128((const __m128i *)(a + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(av, zero)) == 0xFFFF)
+            continue;
+        __m128i sv = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i dv = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_src8_sse2(_mm_unpacklo_epi8(sv, zero),
+                                     _mm_unpacklo_epi8(dv, zero),
+                                     _mm_unpacklo_epi8(av, zero));
+        __m128i hi = blend_src8_sse2(_mm_unpackhi_epi8(sv, zero),
+                                     _mm_unpackhi_epi8(dv, zero),
+                                     _mm_unpackhi_epi8(av, zero));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline __m256i blend_div65025_avx2(__m256i n)
+{
+    __m256i rcp = _mm256_set1_epi32(BLEND_RCP_65025);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(n, rcp), 40);
+    __m256i odd = _mm256_srli_epi64(
+        _mm256_mul_epu32(_mm256_srli_epi64(n, 32), rcp), 40);
+    return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+// 16 pixels as uint16; unpack and pack work within 128 bit lanes, so the
+// pixel order is preserved.
+static inline __m256i blend_const16_avx2(__m256i a, __m256i d, __m256i mul,
+                                         __m256i c)
+{
+    __m256i w = _mm256_mullo_epi16(a, mul);
+    __m256i iw = _mm256_sub_epi16(_mm256_set1_epi16((int16_t)65025), w);
+    __m256i cw_l = _mm256_mullo_epi16(w, c), cw_h = _mm256_mulhi_epu16(w, c);
+    __m256i dw_l = _mm256_mullo_epi16(iw, d), dw_h = _mm256_mulhi_epu16(iw, d);
+    __m256i rnd = _mm256_set1_epi32(32512);
+    __m256i lo = _mm256_add_epi32(_mm256_unpacklo_epi16(cw_l, cw_h),
+                                  _mm256_unpacklo_epi16(dw_l, dw_h));
+    __m256i hi = _mm256_add_epi32(_mm256_unpackhi_epi16(cw_l, cw_h),
+                                  _mm256_unpackhi_epi16(dw_l, dw_h));
+    lo = blend_div65025_avx2(_mm256_add_epi32(lo, rnd));
+    hi = blend_div65025_avx2(_mm256_add_epi32(hi, rnd));
+    return _mm256_packs_epi32(lo, hi);
+}
+
+static inline __m128i blend_pack16_avx2(__m256i x)
+{
+    return _mm_packus_epi16(_mm256_castsi256_si128(x),
+                            _mm256_extracti128_si256(x, 1));
+}
+
+static inline int blend_const_u8_avx2(uint8_t *dst, const uint8_t *a, int mul,
+                                      int c, int w)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m256i vmul = _mm256_set1_epi16(mul), vc = _mm256_set1_epi16(c);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i av = _mm_loadu_si128((const __m128i *)(a + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(av, zero)) == 0xFFFF)
+            continue;
+        __m128i dv = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m256i r = blend_const16_avx2(_mm256_cvtepu8_epi16(av),
+                                       _mm256_cvtepu8_epi16(dv), vmul, vc);
+        _mm_storeu_si128((__m128i *)(dst + x), blend_pack16_avx2(r));
+    }
+    _mm256_zeroupper();
+    return x;
+}
+
+static inline int blend_src_u8_avx2(uint8_t *dst, const uint8_t *src,
+                                    const uint8_t *a, int w)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m256i c255 = _mm256_set1_epi16(255), rnd = _mm256_set1_epi16(127);
+    __m256i rcp = _mm256_set1_epi16((int16_t)0x8081);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i av = _mm_loadu_si128((const __m128i *)(a + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(av, zero)) == 0xFFFF)
+            continue;
+        __m256i a16 = _mm256_cvtepu8_epi16(av);
+        __m256i s16 = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128((const __m128i *)(src + x)));
+        __m256i d16 = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128((const __m128i *)(dst + x)));
+        __m256i n = _mm256_add_epi16(
+            _mm256_mullo_epi16(s16, a16),
+            _mm256_mullo_epi16(d16, _mm256_sub_epi16(c255, a16)));
+        n = _mm256_add_epi16(n, rnd);
+        n = _mm256_srli_epi16(_mm256_mulhi_epu16(n, rcp), 7);
+        _mm_storeu_si128((__m128i *)(dst + x), blend_pack16_avx2(n));
+    }
+    _mm256_zeroupper();
+    return x;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+#if HAVE_NEON_INTRINSICS
+
+#include <arm_neon.h>
+
+static inline uint32x4_t blend_div65025_neon(uint32x4_t n)
+{
+    // The 64 bit products are narrowed to bits 32..63, then shifted by 8.
+    uint64x2_t lo = vmull_n_u32(vget_low_u32(n), BLEND_RCP_65025);
+    uint64x2_t hi = vmull_n_u32(vget_high_u32(n), BLEND_RCP_65025);
+    return vshrq_n_u32(vcombine_u32(vshrn_n_u64(lo, 32),
+                                    vshrn_n_u64(hi, 32)), 8);
+}
+
+static inline int blend_const_u8_neon(uint8_t *dst, const uint8_t *a, int mul,
+                                      int c, int w)
+{
+    uint8x8_t vmul = vdup_n_u8(mul);
+    uint16x8_t vmax = vdupq_n_u16(65025);
+    uint32x4_t rnd = vdupq_n_u32(32512);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t av = vld1_u8(a + x);
+        if (!vget_lane_u64(vreinterpret_u64_u8(av), 0))
+            continue;
+        uint16x8_t wt = vmull_u8(av, vmul);
+        uint16x8_t iw = vsubq_u16(vmax, wt);
+        uint16x8_t d = vmovl_u8(vld1_u8(dst + x));
+        uint32x4_t lo = vmlal_n_u16(rnd, vget_low_u16(wt), c);
+        uint32x4_t hi = vmlal_n_u16(rnd, vget_high_u16(wt), c);
+        lo = vmlal_u16(lo, vget_low_u16(iw), vget_low_u16(d));
+        hi = vmlal_u16(hi, vget_high_u16(iw), vget_high_u16(d));
+        uint16x8_t r = vcombine_u16(vmovn_u32(blend_div65025_neon(lo)),
+                                    vmovn_u32(blend_div65025_neon(hi)));
+        vst1_u8(dst + x, vmovn_u16(r));
+    }
+    return x;
+}
+
+static inline int blend_src_u8_neon(uint8_t *dst, const uint8_t *src,
+                                    const uint8_t *a, int w)
+{
+    uint8x8_t c255 = vdup_n_u8(255);
+    uint16x8_t rnd = vdupq_n_u16(127);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t av = vld1_u8(a + x);
+        if (!vget_lane_u64(vreinterpret_u64_u8(av), 0))
+            continue;
+        uint16x8_t n = vmull_u8(vld1_u8(src + x), av);
+        n = vmlal_u8(n, vld1_u8(dst + x), vsub_u8(c255, av));
+        n = vaddq_u16(n, rnd);
+        uint16x4_t lo = vshrn_n_u32(vmull_n_u16(vget_low_u16(n), 0x8081), 16);
+        uint16x4_t hi = vshrn_n_u32(vmull_n_u16(vget_high_u16(n), 0x8081), 16);
+        vst1_u8(dst + x, vmovn_u16(vshrq_n_u16(vcombine_u16(lo, hi), 7)));
+    }
+    return x;
+}
+
+#endif
+
+#endif
@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
@@ -26,25 +27,115 @@
 #include "common/common.h"
 #include "img_convert.h"
 #include "osd.h"
-#include "video/img_format.h"
-#include "video/mp_image.h"
-#include "video/sws_utils.h"
 
+// Fixed point precision of the blur kernel weights.
+#define BLUR_BITS 16
+
+// Same kernel as libswscale's sws_getGaussianVec(gblur, 3.0), which was used
+// before. Returns the number of taps, which is always odd.
+static int gauss_kernel(void *ta_parent, double gblur, int **out_weights)
+{
+    int len = (int)(gblur * 3.0 + 0.5) | 1;
+    double *c = talloc_array(NULL, double, len);
+    double sum = 0;
+    for (int n = 0; n < len; n++) {
+        double dist = n - (len - 1) * 0.5;
+        c[n] = exp(-dist * dist / (2 * gblur * gblur));
+        sum += c[n];
+    }
+    int *weights = talloc_array(ta_parent, int, len);
+    int total = 0;
+    for (int n = 0; n < len; n++) {
+        weights[n] = lrint(c[n] / sum * (1 << BLUR_BITS));
+        total += weights[n];
+    }
+    // Make the weights sum up to exactly 1.0.
+    weights[len / 2] += (1 << BLUR_BITS) - total;
+    talloc_free(c);
+    *out_weights = weights;
+    return len;
+}
+
+// Separable gaussian blur of premultiplied BGRA. Values outside of the bitmap
+// are taken from the nearest edge pixel. Since all channels are filtered with
+// the same weights, the result is still valid premultiplied alpha.
 void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur)
 {
-    struct mp_image *tmp1 = mp_image_alloc(IMGFMT_BGRA, d->w, d->h);
-    if (tmp1) { // on OOM, skip region
-        struct mp_image s = {0};
-        mp_image_setfmt(&s, IMGFMT_BGRA);
-        mp_image_set_size(&s, d->w, d->h);
-        s.stride[0] = d->stride;
-        s.planes[0] = d->bitmap;
+    if (!(gblur > 0) || d->w < 1 || d->h < 1)
+        return;
 
-        mp_image_copy(tmp1, &s);
+    void *tmp = talloc_new(NULL);
+    int *wt;
+    int taps = gauss_kernel(tmp, gblur, &wt);
+    if (taps < 3) {
+        talloc_free(tmp);
+        return;
+    }
+
+    int r = taps / 2;
+    int w = d->w, h = d->h, rowlen = w * 4;
+    uint8_t *src = d->bitmap;
+    uint8_t *hbuf = talloc_array(tmp, uint8_t, rowlen * h);
+    uint32_t *acc = talloc_array(tmp, uint32_t, rowlen);
 
-        mp_image_sw_blur_scale(&s, tmp1, gblur);
+    // Horizontal pass into hbuf.
+    for (int y = 0; y < h; y++) {
+        const uint8_t *in = src + y * d->stride;
+        uint8_t *out = hbuf + y * rowlen;
+        for (int x = 0; x < w; x++) {
+            uint32_t sum[4] = {0};
+            if (x >= r && x + r < w) {
+                const uint8_t *p = in + (x - r) * 4;
+                for (int k = 0; k < taps; k++, p += 4) {
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += p[c] * wt[k];
+                }
+            } else {
+                for (int k = 0; k < taps; k++) {
+                    const uint8_t *p = in + MPCLAMP(x + k - r, 0, w - 1) * 4;
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += p[c] * wt[k];
+                }
+            }
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (sum[c] + (1 << (BLUR_BITS - 1))) >> BLUR_BITS;
+        }
+    }
+
+    // Vertical pass back into the bitmap. This processes whole rows at once,
+    // which is cache friendly and lets the compiler vectorize the loops.
+    for (int y = 0; y < h; y++) {
+        memset(acc, 0, rowlen * sizeof(acc[0]));
+        for (int k = 0; k < taps; k++) {
+            const uint8_t *in = hbuf + MPCLAMP(y + k - r, 0, h - 1) * rowlen;
+            uint32_t f = wt[k];
+            for (int i = 0; i < rowlen; i++)
+                acc[i] += in[i] * f;
+        }
+        uint8_t *out = src + y * d->stride;
+        for (int i = 0; i < rowlen; i++)
+            out[i] = (acc[i] + (1 << (BLUR_BITS - 1))) >> BLUR_BITS;
+    }
+
+    talloc_free(tmp);
+}
+
+uint64_t mp_sub_bitmap_hash(struct sub_bitmap *b, int bpp)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ ((uint64_t)b->w << 32 | b->h);
+    for (int y = 0; y < b->h; y++) {
+        const uint8_t *line = (uint8_t *)b->bitmap + y * b->stride;
+        int len = b->w * bpp, x = 0;
+        for (; x + 8 <= len; x += 8) {
+            uint64_t v;
+            memcpy(&v, line + x, 8);
+            h = (h ^ v) * 0x100000001b3ULL;
+            h ^= h >> 29;
+        }
+        for (; x < len; x++)
+            h = (h ^ line[x]) * 0x100000001b3ULL;
     }
-    talloc_free(tmp1);
+    return h ? h : 1;
 }
 
 bool mp_sub_bitmaps_bb(struct sub_bitmaps *imgs, struct mp_rect *out_bb)
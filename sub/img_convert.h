@@ -2,6 +2,7 @@
 #define MPLAYER_SUB_IMG_CONVERT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct sub_bitmaps;
 struct sub_bitmap;
@@ -10,6 +11,10 @@ struct mp_rect;
 // Sub postprocessing
 void mp_blur_rgba_sub_bitmap(struct sub_bitmap *d, double gblur);
 
+// Hash of the bitmap contents, for use as sub_bitmap.id. bpp is the number of
+// bytes per pixel. Never returns 0.
+uint64_t mp_sub_bitmap_hash(struct sub_bitmap *b, int bpp);
+
 bool mp_sub_bitmaps_bb(struct sub_bitmaps *imgs, struct mp_rect *out_bb);
 
 // Intentionally limit the maximum number of bounding rects to something low.
@@ -405,6 +405,7 @@ void osd_changed(struct osd_state *osd)
 {
     pthread_mutex_lock(&osd->lock);
     osd->objs[OSDTYPE_OSD]->osd_changed = true;
+    osd->objs[OSDTYPE_OSD]->ass.dirty = true; // style may differ
     osd->want_redraw_notification = true;
     // Done here for a lack of a better place.
     m_config_cache_update(osd->opts_cache);
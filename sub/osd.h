@@ -50,6 +50,12 @@ struct sub_bitmap {
     struct {
         uint32_t color;
     } libass;
+
+    // Identifies the bitmap contents (bitmap/w/h, but not the position or
+    // libass.color). Bitmaps with the same id have the same contents, also
+    // across sub_bitmaps with different change_ids, so consumers can reuse
+    // their conversion or upload of it. 0 if unknown.
+    uint64_t id;
 };
 
 struct sub_bitmaps {
@@ -50,17 +50,19 @@ static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
     if (ass->render)
         return;
 
-    ass->log = mp_log_new(NULL, osd->log, "libass");
-    ass->library = mp_ass_init(osd->global, ass->log);
-    ass_add_font(ass->library, "mpv-osd-symbols", (void *)osd_font_pfb,
-                 sizeof(osd_font_pfb) - 1);
+    if (!osd->ass_library) {
+        osd->ass_log = mp_log_new(NULL, osd->log, "libass");
+        osd->ass_library = mp_ass_init(osd->global, osd->ass_log);
+        ass_add_font(osd->ass_library, "mpv-osd-symbols", (void *)osd_font_pfb,
+                     sizeof(osd_font_pfb) - 1);
+    }
 
-    ass->render = ass_renderer_init(ass->library);
+    ass->render = ass_renderer_init(osd->ass_library);
     if (!ass->render)
         abort();
 
     mp_ass_configure_fonts(ass->render, osd->opts->osd_style,
-                           osd->global, ass->log);
+                           osd->global, osd->ass_log);
     ass_set_aspect_ratio(ass->render, 1.0, 1.0);
 }
 
@@ -72,11 +74,8 @@ static void destroy_ass_renderer(struct ass_state *ass)
     if (ass->render)
         ass_renderer_done(ass->render);
     ass->render = NULL;
-    if (ass->library)
-        ass_library_done(ass->library);
-    ass->library = NULL;
-    talloc_free(ass->log);
-    ass->log = NULL;
+    ass->rendered = false;
+    ass->imgs = NULL;
 }
 
 static void destroy_external(struct osd_external *ext)
@@ -94,6 +93,11 @@ void osd_destroy_backend(struct osd_state *osd)
             destroy_external(&obj->externals[i]);
         obj->num_externals = 0;
     }
+    if (osd->ass_library)
+        ass_library_done(osd->ass_library);
+    osd->ass_library = NULL;
+    talloc_free(osd->ass_log);
+    osd->ass_log = NULL;
 }
 
 static void update_playres(struct ass_state *ass, struct mp_osd_res *vo_res)
@@ -111,8 +115,10 @@ static void update_playres(struct ass_state *ass, struct mp_osd_res *vo_res)
 
     // Force libass to clear its internal cache - it doesn't check for
     // PlayRes changes itself.
-    if (old_res_x != track->PlayResX || old_res_y != track->PlayResY)
+    if (old_res_x != track->PlayResX || old_res_y != track->PlayResY) {
         ass_set_frame_size(ass->render, 1, 1);
+        ass->dirty = true;
+    }
 }
 
 static void create_ass_track(struct osd_state *osd, struct osd_object *obj,
@@ -122,7 +128,7 @@ static void create_ass_track(struct osd_state *osd, struct osd_object *obj,
 
     ASS_Track *track = ass->track;
     if (!track)
-        track = ass->track = ass_new_track(ass->library);
+        track = ass->track = ass_new_track(osd->ass_library);
 
     track->track_type = TRACK_TYPE_ASS;
     track->Timer = 100.;
@@ -160,25 +166,55 @@ static ASS_Style *get_style(struct ass_state *ass, char *name)
     return style;
 }
 
-static ASS_Event *add_osd_ass_event(ASS_Track *track, const char *style,
+// The OSD tracks are rebuilt with begin_events(), a sequence of
+// add_osd_ass_event() calls, and end_events(). Events which are the same as
+// in the previous update are kept as they are, and if nothing changed at
+// all, the track is not rendered again.
+static void begin_events(struct ass_state *ass)
+{
+    ass->num_events = 0;
+}
+
+static ASS_Event *add_osd_ass_event(struct ass_state *ass, const char *style,
                                     const char *text)
 {
-    int n = ass_alloc_event(track);
+    ASS_Track *track = ass->track;
+    int sid = find_style(track, style, 0);
+    int n = ass->num_events++;
+    if (n < track->n_events) {
+        ASS_Event *event = track->events + n;
+        if (event->Style == sid &&
+            strcmp(event->Text ? event->Text : "", text ? text : "") == 0)
+            return event;
+        free(event->Text);
+        event->Text = NULL;
+    } else {
+        n = ass_alloc_event(track);
+        assert(n == ass->num_events - 1);
+    }
     ASS_Event *event = track->events + n;
     event->Start = 0;
     event->Duration = 100;
-    event->Style = find_style(track, style, 0);
+    event->Style = sid;
     event->ReadOrder = n;
     assert(event->Text == NULL);
     if (text)
         event->Text = strdup(text);
+    ass->dirty = true;
     return event;
 }
 
-static void clear_ass(struct ass_state *ass)
+static void end_events(struct ass_state *ass)
 {
-    if (ass->track)
-        ass_flush_events(ass->track);
+    ASS_Track *track = ass->track;
+    if (!track)
+        return;
+    if (ass->num_events < track->n_events) {
+        for (int n = ass->num_events; n < track->n_events; n++)
+            ass_free_event(track, n);
+        track->n_events = ass->num_events;
+        ass->dirty = true;
+    }
 }
 
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
@@ -222,12 +258,12 @@ static void mangle_ass(bstr *dst, const char *in)
     }
 }
 
-static ASS_Event *add_osd_ass_event_escaped(ASS_Track *track, const char *style,
-                                            const char *text)
+static ASS_Event *add_osd_ass_event_escaped(struct ass_state *ass,
+                                            const char *style, const char *text)
 {
     bstr buf = {0};
     mangle_ass(&buf, text);
-    ASS_Event *e = add_osd_ass_event(track, style, buf.start);
+    ASS_Event *e = add_osd_ass_event(ass, style, buf.start);
     talloc_free(buf.start);
     return e;
 }
@@ -258,7 +294,7 @@ static void update_osd_text(struct osd_state *osd, struct osd_object *obj)
         return;
 
     prepare_osd_ass(osd, obj);
-    add_osd_ass_event_escaped(obj->ass.track, "OSD", obj->text);
+    add_osd_ass_event_escaped(&obj->ass, "OSD", obj->text);
 }
 
 void osd_get_text_size(struct osd_state *osd, int *out_screen_h, int *out_font_h)
@@ -390,7 +426,7 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     float px, py, width, height, border;
     get_osd_bar_box(osd, obj, &px, &py, &width, &height, &border);
 
-    ASS_Track *track = obj->ass.track;
+    struct ass_state *ass = &obj->ass;
 
     float sx = px - border * 2 - height / 4; // includes additional spacing
     float sy = py + height / 2;
@@ -407,7 +443,7 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
         bstr_xappend(NULL, &buf, bstr0("{\\r}"));
     }
 
-    add_osd_ass_event(track, "progbar", buf.start);
+    add_osd_ass_event(ass, "progbar", buf.start);
     talloc_free(buf.start);
 
     struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
@@ -417,7 +453,7 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     float pos = obj->progbar_state.value * width - border / 2;
     ass_draw_rect_cw(d, 0, 0, pos, height);
     ass_draw_stop(d);
-    add_osd_ass_event(track, "progbar", d->text);
+    add_osd_ass_event(ass, "progbar", d->text);
     ass_draw_reset(d);
 
     // position marker
@@ -427,7 +463,7 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     ass_draw_move_to(d, pos + border / 2, 0);
     ass_draw_line_to(d, pos + border / 2, height);
     ass_draw_stop(d);
-    add_osd_ass_event(track, "progbar", d->text);
+    add_osd_ass_event(ass, "progbar", d->text);
     ass_draw_reset(d);
 
     d->text = talloc_asprintf_append(d->text, "{\\pos(%f,%f)}", px, py);
@@ -456,21 +492,23 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
     }
 
     ass_draw_stop(d);
-    add_osd_ass_event(track, "progbar", d->text);
+    add_osd_ass_event(ass, "progbar", d->text);
     ass_draw_reset(d);
 }
 
 static void update_osd(struct osd_state *osd, struct osd_object *obj)
 {
     obj->osd_changed = false;
-    clear_ass(&obj->ass);
+    begin_events(&obj->ass);
     update_osd_text(osd, obj);
     update_progbar(osd, obj);
+    end_events(&obj->ass);
 }
 
 static void update_external(struct osd_state *osd, struct osd_object *obj,
                             struct osd_external *ext)
 {
+    ext->text_changed = false;
     bstr t = bstr0(ext->text);
     if (!t.len)
         return;
@@ -478,7 +516,7 @@ static void update_external(struct osd_state *osd, struct osd_object *obj,
     ext->ass.res_y = ext->res_y;
     create_ass_track(osd, obj, &ext->ass);
 
-    clear_ass(&ext->ass);
+    begin_events(&ext->ass);
 
     int resy = ext->ass.track->PlayResY;
     mp_ass_set_style(get_style(&ext->ass, "OSD"), resy, osd->opts->osd_style);
@@ -492,10 +530,12 @@ static void update_external(struct osd_state *osd, struct osd_object *obj,
         bstr_split_tok(t, "\n", &line, &t);
         if (line.len) {
             char *tmp = bstrdup0(NULL, line);
-            add_osd_ass_event(ext->ass.track, "OSD", tmp);
+            add_osd_ass_event(&ext->ass, "OSD", tmp);
             talloc_free(tmp);
         }
     }
+
+    end_events(&ext->ass);
 }
 
 void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
@@ -535,8 +575,9 @@ void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
         entry->text = talloc_strdup(NULL, text);
         entry->res_x = res_x;
         entry->res_y = res_y;
-        update_external(osd, obj, entry);
-        obj->changed = true;
+        // Deferred to osd_object_get_bitmaps(), so that scripts updating
+        // the text faster than the VO draws don't cause useless work.
+        entry->text_changed = true;
         osd->want_redraw_notification = true;
     }
 
@@ -554,12 +595,27 @@ static void append_ass(struct ass_state *ass, struct mp_osd_res *res,
 
     update_playres(ass, res);
 
+    // The images returned by the last ass_render_frame() call stay valid
+    // until the next call, so they can be reused if nothing changed.
+    if (ass->rendered && !ass->dirty && ass->render_res.w == res->w &&
+        ass->render_res.h == res->h &&
+        ass->render_res.display_par == res->display_par)
+    {
+        *img_list = ass->imgs;
+        return;
+    }
+
     ass_set_frame_size(ass->render, res->w, res->h);
     ass_set_aspect_ratio(ass->render, res->display_par, 1.0);
 
     int ass_changed;
     *img_list = ass_render_frame(ass->render, ass->track, 0, &ass_changed);
     *changed |= ass_changed;
+
+    ass->imgs = *img_list;
+    ass->render_res = *res;
+    ass->rendered = true;
+    ass->dirty = false;
 }
 
 void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
@@ -568,6 +624,11 @@ void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
     if (obj->type == OSDTYPE_OSD && obj->osd_changed)
         update_osd(osd, obj);
 
+    for (int n = 0; n < obj->num_externals; n++) {
+        if (obj->externals[n].text_changed)
+            update_external(osd, obj, &obj->externals[n]);
+    }
+
     if (!obj->ass_packer)
         obj->ass_packer = mp_ass_packer_alloc(obj);
 
@@ -18,11 +18,16 @@ enum mp_osdtype {
 };
 
 struct ass_state {
-    struct mp_log *log;
     struct ass_track *track;
     struct ass_renderer *render;
-    struct ass_library *library;
     int res_x, res_y;
+
+    // Internally used by osd_libass.c
+    int num_events;         // events set since begin_events()
+    bool dirty;             // track changed since the last render
+    bool rendered;          // imgs is from the last render with render_res
+    struct mp_osd_res render_res;
+    struct ass_image *imgs;
 };
 
 struct osd_object {
@@ -59,6 +64,7 @@ struct osd_external {
     void *id;
     char *text;
     int res_x, res_y;
+    bool text_changed;      // update_external() pending
     struct ass_state ass;
 };
 
@@ -79,6 +85,11 @@ struct osd_state {
     struct mp_log *log;
 
     struct mp_draw_sub_cache *draw_cache;
+
+    // Internally used by osd_libass.c. Shared by all OSD renderers, which are
+    // only used with the lock held.
+    struct ass_library *ass_library;
+    struct mp_log *ass_log;
 };
 
 // defined in osd_libass.c and osd_dummy.c
@@ -1,6 +1,8 @@
 #ifndef MPLAYER_SD_H
 #define MPLAYER_SD_H
 
+#include <pthread.h>
+
 #include "dec_sub.h"
 #include "demux/packet.h"
 
@@ -20,6 +22,11 @@ struct sd {
     struct attachment_list *attachments;
     struct mp_codec_params *codec;
 
+    // Held by dec_sub.c while calling any sd_functions callback (except
+    // uninit). Decoders which access their state from their own threads must
+    // lock it too.
+    pthread_mutex_t *lock;
+
     // Set to false as soon as the decoder discards old subtitle events.
     // (only needed if sd_functions.accept_packets_in_advance == false)
     bool preload_ok;
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
@@ -30,32 +31,96 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "osdep/threads.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
 #include "sd.h"
 
+// A rendered and packed subtitle frame, and the parameters it was rendered
+// with.
+struct ass_frame {
+    struct mp_ass_packer *packer;
+    struct sub_bitmap *bs;
+    struct sub_bitmaps res;
+    bool valid;         // can be returned if the parameters below match
+    long long ts;
+    struct mp_osd_res dim;
+    int format;
+    int content_id;     // sd_ass_priv.render_id at the time of rendering
+};
+
+struct index_entry {
+    long long t;        // Start or end of the event, depending on the array
+    long long end;      // only for event_index.by_start
+    int ev;             // index into ASS_Track.events
+};
+
+// Time index over the events of sd_ass_priv.ass_track, rebuilt on demand
+// after the events change.
+struct event_index {
+    bool valid;
+    int num;
+    // Sorted by (Start, ev). Also an implicit search tree (the root of a range
+    // is its middle element) for interval queries: max_end[n] is the maximum
+    // end time of the subtree rooted at by_start[n].
+    struct index_entry *by_start;
+    long long *max_end;
+    struct index_entry *by_end; // sorted by (end, ev)
+    int *res;           // result array of index_query()
+    int num_res;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
+    struct mp_ass_font_loader *font_loader; // --sub-fonts-async
     struct ass_track *ass_track;
     struct ass_track *shadow_track; // for --sub-ass=no rendering
     bool is_converted;
     struct lavc_conv *converter;
     bool on_top;
-    struct mp_ass_packer *packer;
-    struct sub_bitmap *bs;
+    struct ass_frame frames[2];
+    int cur_frame;      // index of the frame last returned by get_bitmaps; the
+                        // render thread uses the other one
+    int render_id;      // incremented each time libass reports a change
+    int returned_id;    // content_id/format of the frame last returned
+    int returned_format;
     char last_text[500];
     struct mp_image_params video_params;
     struct mp_image_params last_params;
     int64_t *seen_packets;
     int num_seen_packets;
     bool duration_unknown;
+    struct event_index index;
+    // --sub-ass-render-ahead. The render thread uses the same ASS_Renderer,
+    // and accesses everything with sd->lock held.
+    bool render_ahead;
+    pthread_t render_thread;
+    pthread_cond_t render_wakeup;
+    bool render_exit;
+    bool ahead_pending; // render the frame below into the non-current slot
+    double ahead_pts;
+    struct mp_osd_res ahead_dim;
+    int ahead_format;
+    double last_pts;
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void *render_thread(void *arg);
+
+// Drop all pre-rendered frames. Called when the result of rendering a given
+// timestamp could have changed.
+static void invalidate_frames(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    for (int n = 0; n < MP_ARRAY_SIZE(ctx->frames); n++)
+        ctx->frames[n].valid = false;
+    ctx->ahead_pending = false;
+    ctx->last_pts = MP_NOPTS_VALUE;
+}
 
 // Add default styles, if the track does not have any styles yet.
 // Apply style overrides if the user provides any.
@@ -135,15 +200,39 @@ static void enable_output(struct sd *sd, bool enable)
     struct sd_ass_priv *ctx = sd->priv;
     if (enable == !!ctx->ass_renderer)
         return;
+    invalidate_frames(sd);
     if (ctx->ass_renderer) {
+        mp_ass_font_loader_free(ctx->font_loader);
+        ctx->font_loader = NULL;
         ass_renderer_done(ctx->ass_renderer);
         ctx->ass_renderer = NULL;
     } else {
         ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
 
-        mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
-                               sd->global, sd->log);
+        // Embedded fonts were already added to the library in init().
+        if (sd->opts->sub_fonts_async) {
+            ctx->font_loader =
+                mp_ass_configure_fonts_async(ctx->ass_renderer,
+                                             sd->opts->sub_style,
+                                             sd->global, sd->log);
+        } else {
+            mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
+                                   sd->global, sd->log);
+        }
+    }
+}
+
+// Return the renderer, or NULL if it's disabled or still loading fonts.
+static ASS_Renderer *get_renderer(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    if (ctx->font_loader) {
+        if (!mp_ass_font_loader_ready(ctx->font_loader))
+            return NULL;
+        mp_ass_font_loader_free(ctx->font_loader);
+        ctx->font_loader = NULL;
     }
+    return ctx->ass_renderer;
 }
 
 static int init(struct sd *sd)
@@ -196,7 +285,18 @@ static int init(struct sd *sd)
 
     enable_output(sd, true);
 
-    ctx->packer = mp_ass_packer_alloc(ctx);
+    for (int n = 0; n < MP_ARRAY_SIZE(ctx->frames); n++)
+        ctx->frames[n].packer = mp_ass_packer_alloc(ctx);
+    ctx->last_pts = MP_NOPTS_VALUE;
+
+    if (opts->ass_render_ahead && sd->lock) {
+        pthread_cond_init(&ctx->render_wakeup, NULL);
+        if (pthread_create(&ctx->render_thread, NULL, render_thread, sd)) {
+            pthread_cond_destroy(&ctx->render_wakeup);
+        } else {
+            ctx->render_ahead = true;
+        }
+    }
 
     return 0;
 }
@@ -230,6 +330,8 @@ static void decode(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
+    invalidate_frames(sd);
+    ctx->index.valid = false;
     if (ctx->converter) {
         if (!sd->opts->sub_clear_on_seek && packet->pos >= 0 &&
             check_packet_seen(sd, packet->pos))
@@ -360,6 +462,137 @@ static bool has_overrides(char *s)
 
 #define END(ev) ((ev)->Start + (ev)->Duration)
 
+static int compare_index_entry(const void *pa, const void *pb)
+{
+    const struct index_entry *a = pa, *b = pb;
+    if (a->t != b->t)
+        return a->t < b->t ? -1 : 1;
+    return a->ev - b->ev;
+}
+
+static long long build_tree(struct event_index *ix, int lo, int hi)
+{
+    if (lo >= hi)
+        return LLONG_MIN;
+    int mid = lo + (hi - lo) / 2;
+    long long m = ix->by_start[mid].end;
+    m = MPMAX(m, build_tree(ix, lo, mid));
+    m = MPMAX(m, build_tree(ix, mid + 1, hi));
+    ix->max_end[mid] = m;
+    return m;
+}
+
+static struct event_index *get_index(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct event_index *ix = &ctx->index;
+    ASS_Track *track = ctx->ass_track;
+
+    if (ix->valid && ix->num == track->n_events)
+        return ix;
+
+    ix->num = track->n_events;
+    MP_TARRAY_GROW(ctx, ix->by_start, ix->num);
+    MP_TARRAY_GROW(ctx, ix->by_end, ix->num);
+    MP_TARRAY_GROW(ctx, ix->max_end, ix->num);
+    for (int n = 0; n < ix->num; n++) {
+        ASS_Event *event = &track->events[n];
+        ix->by_start[n] = (struct index_entry){event->Start, END(event), n};
+        ix->by_end[n] = (struct index_entry){END(event), END(event), n};
+    }
+    qsort(ix->by_start, ix->num, sizeof(ix->by_start[0]), compare_index_entry);
+    qsort(ix->by_end, ix->num, sizeof(ix->by_end[0]), compare_index_entry);
+    build_tree(ix, 0, ix->num);
+    ix->valid = true;
+    return ix;
+}
+
+// Return the index of the first entry with entry.t >= t.
+static int lower_bound(struct index_entry *list, int num, long long t)
+{
+    int a = 0, b = num;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (list[mid].t < t) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    return a;
+}
+
+static void query_tree(struct sd *sd, struct event_index *ix, int lo, int hi,
+                       long long start, long long end)
+{
+    if (lo >= hi || ix->max_end[lo + (hi - lo) / 2] < end)
+        return;
+    int mid = lo + (hi - lo) / 2;
+    query_tree(sd, ix, lo, mid, start, end);
+    if (ix->by_start[mid].t > start)
+        return;
+    if (ix->by_start[mid].end >= end)
+        MP_TARRAY_APPEND(sd->priv, ix->res, ix->num_res, ix->by_start[mid].ev);
+    query_tree(sd, ix, mid + 1, hi, start, end);
+}
+
+static int compare_int(const void *pa, const void *pb)
+{
+    return *(const int *)pa - *(const int *)pb;
+}
+
+// Find all events with Start <= start and end >= end. Returns the number of
+// events, and sets *out to their indexes in increasing order. The result stays
+// valid until the next call or until the events change.
+static int index_query(struct sd *sd, long long start, long long end, int **out)
+{
+    struct event_index *ix = get_index(sd);
+    ix->num_res = 0;
+    query_tree(sd, ix, 0, ix->num, start, end);
+    qsort(ix->res, ix->num_res, sizeof(ix->res[0]), compare_int);
+    *out = ix->res;
+    return ix->num_res;
+}
+
+// Same as ass_step_sub(), but uses the index.
+static long long step_sub(struct sd *sd, long long now, int movement)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct event_index *ix = get_index(sd);
+    int best = -1;
+    long long target = now;
+    int direction = (movement > 0 ? 1 : -1) * !!movement;
+
+    if (ix->num == 0)
+        return 0;
+
+    do {
+        struct index_entry *closest = NULL;
+        if (direction < 0) {
+            // Latest end before target (first event in case of ties).
+            int i = lower_bound(ix->by_end, ix->num, target) - 1;
+            if (i >= 0)
+                closest = &ix->by_end[lower_bound(ix->by_end, i, ix->by_end[i].t)];
+        } else if (direction > 0) {
+            // Earliest start after target (first event in case of ties).
+            int i = lower_bound(ix->by_start, ix->num, target + 1);
+            if (i < ix->num)
+                closest = &ix->by_start[i];
+        } else {
+            // Latest start before target (last event in case of ties).
+            int i = lower_bound(ix->by_start, ix->num, target) - 1;
+            if (i >= 0)
+                closest = &ix->by_start[i];
+        }
+        target = (closest ? closest->t : now) + direction;
+        movement -= direction;
+        if (closest)
+            best = closest->ev;
+    } while (movement);
+
+    return best >= 0 ? ctx->ass_track->events[best].Start - now : 0;
+}
+
 static long long find_timestamp(struct sd *sd, double pts)
 {
     struct sd_ass_priv *priv = sd->priv;
@@ -377,19 +610,11 @@ static long long find_timestamp(struct sd *sd, double pts)
     int keep = SUB_GAP_KEEP * 1000;
 
     // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
-
+    int *found;
+    int n_ev = index_query(sd, ts + threshold, ts - threshold, &found);
     if (n_ev != 2)
-        return ts;
+        return ts; // give up on multiple overlaps (probably complex subs)
+    ASS_Event *ev[2] = {&track->events[found[0]], &track->events[found[1]]};
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -425,8 +650,16 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
-static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
-                        double pts, struct sub_bitmaps *res)
+static bool frame_matches(struct ass_frame *frame, long long ts,
+                          struct mp_osd_res dim, int format)
+{
+    return frame->valid && frame->ts == ts && frame->format == format &&
+           osd_res_equals(frame->dim, dim);
+}
+
+// Render and pack the subtitles at ts into frame.
+static void render_frame(struct sd *sd, struct ass_frame *frame,
+                         struct mp_osd_res dim, int format, long long ts)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct mp_subtitle_opts *opts = sd->opts;
@@ -436,9 +669,6 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
     ASS_Renderer *renderer = ctx->ass_renderer;
 
-    if (pts == MP_NOPTS_VALUE || !renderer)
-        return;
-
     double scale = dim.display_par;
     if (!converted && (!opts->ass_style_override ||
                        opts->ass_vsfilter_aspect_compat))
@@ -457,9 +687,78 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     } else {
         ass_set_storage_size(renderer, 0, 0);
     }
+
+    int changed;
+    ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
+    // "changed" is relative to the previous ass_render_frame() call, which
+    // might have rendered into the other frame.
+    if (changed)
+        ctx->render_id++;
+    struct sub_bitmaps *res = &frame->res;
+    mp_ass_packer_pack(frame->packer, &imgs, 1,
+                       frame->content_id != ctx->render_id, format, res);
+    frame->content_id = ctx->render_id;
+
+    if (!converted && res->num_parts > 0) {
+        // mangle_colors() modifies the color field, so copy the thing.
+        MP_TARRAY_GROW(ctx, frame->bs, res->num_parts);
+        memcpy(frame->bs, res->parts, sizeof(frame->bs[0]) * res->num_parts);
+        res->parts = frame->bs;
+
+        mangle_colors(sd, res);
+    }
+
+    frame->valid = true;
+    frame->ts = ts;
+    frame->dim = dim;
+    frame->format = format;
+}
+
+// Renders the predicted next frame while the current one is displayed.
+static void *render_thread(void *arg)
+{
+    struct sd *sd = arg;
+    struct sd_ass_priv *ctx = sd->priv;
+
+    mpthread_set_name("sub/ass");
+
+    pthread_mutex_lock(sd->lock);
+    while (!ctx->render_exit) {
+        if (!ctx->ahead_pending) {
+            pthread_cond_wait(&ctx->render_wakeup, sd->lock);
+            continue;
+        }
+        ctx->ahead_pending = false;
+        if (!get_renderer(sd))
+            continue;
+        long long ts = find_timestamp(sd, ctx->ahead_pts);
+        struct ass_frame *cur = &ctx->frames[ctx->cur_frame];
+        struct ass_frame *next = &ctx->frames[!ctx->cur_frame];
+        if (frame_matches(cur, ts, ctx->ahead_dim, ctx->ahead_format) ||
+            frame_matches(next, ts, ctx->ahead_dim, ctx->ahead_format))
+            continue;
+        render_frame(sd, next, ctx->ahead_dim, ctx->ahead_format, ts);
+    }
+    pthread_mutex_unlock(sd->lock);
+    return NULL;
+}
+
+static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
+                        double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct mp_subtitle_opts *opts = sd->opts;
+    bool no_ass = !opts->ass_enabled || ctx->on_top ||
+                  opts->ass_style_override == 5;
+    ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
+
+    if (pts == MP_NOPTS_VALUE || !get_renderer(sd))
+        return;
+
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
+        ctx->index.valid = false;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -467,17 +766,40 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     if (no_ass)
         fill_plaintext(sd, pts);
 
-    int changed;
-    ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
-    mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
-
-    if (!converted && res->num_parts > 0) {
-        // mangle_colors() modifies the color field, so copy the thing.
-        MP_TARRAY_GROW(ctx, ctx->bs, res->num_parts);
-        memcpy(ctx->bs, res->parts, sizeof(ctx->bs[0]) * res->num_parts);
-        res->parts = ctx->bs;
+    // The plaintext and unknown duration cases modify the track on every
+    // call, so they can't be rendered ahead.
+    bool ahead = ctx->render_ahead && !no_ass && !ctx->duration_unknown;
 
-        mangle_colors(sd, res);
+    struct ass_frame *frame = NULL;
+    for (int n = 0; n < MP_ARRAY_SIZE(ctx->frames); n++) {
+        if (ahead && frame_matches(&ctx->frames[n], ts, dim, format))
+            frame = &ctx->frames[n];
+    }
+    if (!frame) {
+        frame = &ctx->frames[ctx->cur_frame];
+        render_frame(sd, frame, dim, format, ts);
+    }
+    ctx->cur_frame = frame - ctx->frames;
+
+    *res = frame->res;
+    res->change_id = frame->content_id != ctx->returned_id ||
+                     frame->res.format != ctx->returned_format ||
+                     frame->res.change_id;
+    ctx->returned_id = frame->content_id;
+    ctx->returned_format = frame->res.format;
+
+    if (ahead) {
+        // Assume the next frame is displayed after the same interval. Large
+        // steps are probably seeks or frame stepping.
+        double step = pts - ctx->last_pts;
+        if (ctx->last_pts != MP_NOPTS_VALUE && step > 0 && step < 1.0) {
+            ctx->ahead_pts = pts + step;
+            ctx->ahead_dim = dim;
+            ctx->ahead_format = format;
+            ctx->ahead_pending = true;
+            pthread_cond_signal(&ctx->render_wakeup);
+        }
+        ctx->last_pts = pts;
     }
 }
 
@@ -564,17 +886,17 @@ static char *get_text(struct sd *sd, double pts)
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    int *found;
+    int num_found = index_query(sd, ipts, ipts + 1, &found);
+    for (int i = 0; i < num_found; ++i) {
+        ASS_Event *event = track->events + found[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
@@ -629,8 +951,10 @@ static void fill_plaintext(struct sd *sd, double pts)
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    invalidate_frames(sd);
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
+        ctx->index.valid = false;
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -642,6 +966,15 @@ static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    if (ctx->render_ahead) {
+        pthread_mutex_lock(sd->lock);
+        ctx->render_exit = true;
+        pthread_cond_signal(&ctx->render_wakeup);
+        pthread_mutex_unlock(sd->lock);
+        pthread_join(ctx->render_thread, NULL);
+        pthread_cond_destroy(&ctx->render_wakeup);
+    }
+
     if (ctx->converter)
         lavc_conv_uninit(ctx->converter);
     ass_free_track(ctx->ass_track);
@@ -657,7 +990,7 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
         long long ts = llrint(a[0] * 1000.0);
-        long long res = ass_step_sub(ctx->ass_track, ts, a[1]);
+        long long res = step_sub(sd, ts, a[1]);
         if (!res)
             return false;
         a[0] += res / 1000.0;
@@ -665,9 +998,14 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     }
     case SD_CTRL_SET_VIDEO_PARAMS:
         ctx->video_params = *(struct mp_image_params *)arg;
+        invalidate_frames(sd);
         return CONTROL_OK;
     case SD_CTRL_SET_TOP:
         ctx->on_top = *(bool *)arg;
+        invalidate_frames(sd);
+        return CONTROL_OK;
+    case SD_CTRL_UPDATE_OPTS:
+        invalidate_frames(sd);
         return CONTROL_OK;
     default:
         return CONTROL_UNKNOWN;
@@ -161,6 +161,43 @@ static void convert_pal(uint32_t *colors, size_t count, bool gray)
     }
 }
 
+// ID of the converted bitmap, computed from the source data and the options
+// which affect the conversion.
+static uint64_t rect_id(struct mp_subtitle_opts *opts, struct AVSubtitleRect *r)
+{
+    struct sub_bitmap src = {
+        .bitmap = r->data[0], .stride = r->linesize[0], .w = r->w, .h = r->h,
+    };
+    struct sub_bitmap pal = {
+        .bitmap = r->data[1], .w = r->nb_colors, .h = 1,
+    };
+    uint32_t gauss;
+    memcpy(&gauss, &opts->sub_gauss, sizeof(gauss));
+    uint64_t id = mp_sub_bitmap_hash(&src, 1) ^
+                  mp_sub_bitmap_hash(&pal, 4) * 0x9e3779b97f4a7c15ULL ^
+                  ((uint64_t)gauss << 1 | !!opts->sub_gray);
+    return id ? id : 1;
+}
+
+// Find an already converted bitmap with the given ID in the other subs. PGS
+// in particular often repeats the same objects in consecutive display sets.
+static struct sub_bitmap *find_converted(struct sd_lavc_priv *priv,
+                                         struct sub *sub, uint64_t id,
+                                         int w, int h)
+{
+    for (int n = 0; n < MAX_QUEUE; n++) {
+        struct sub *other = &priv->subs[n];
+        if (other == sub || !other->valid)
+            continue;
+        for (int i = 0; i < other->count; i++) {
+            struct sub_bitmap *b = &other->inbitmaps[i];
+            if (b->id == id && b->w == w && b->h == h)
+                return b;
+        }
+    }
+    return NULL;
+}
+
 // Initialize sub from sub->avsub.
 static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 {
@@ -254,23 +291,34 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
 
         assert(r->nb_colors > 0);
         assert(r->nb_colors <= 256);
-        uint32_t pal[256] = {0};
-        memcpy(pal, data[1], r->nb_colors * 4);
-        convert_pal(pal, 256, opts->sub_gray);
-
-        for (int y = -padding; y < b->h + padding; y++) {
-            uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
-            int start = 0;
-            for (int x = -padding; x < 0; x++)
-                out[x] = 0;
-            if (y >= 0 && y < b->h) {
-                uint8_t *in = data[0] + y * linesize[0];
-                for (int x = 0; x < b->w; x++)
-                    *out++ = pal[*in++];
-                start = b->w;
+        uint64_t id = rect_id(opts, r);
+        struct sub_bitmap *cached =
+            find_converted(priv, sub, id, b->w + extend * 2, b->h + extend * 2);
+        if (cached) {
+            // Same contents, including the transparent padding.
+            memcpy_pic((char *)b->bitmap - padding * b->stride - padding * 4,
+                       (char *)cached->bitmap - cached->stride - 4,
+                       (b->w + padding * 2) * 4, b->h + padding * 2,
+                       b->stride, cached->stride);
+        } else {
+            uint32_t pal[256] = {0};
+            memcpy(pal, data[1], r->nb_colors * 4);
+            convert_pal(pal, 256, opts->sub_gray);
+
+            for (int y = -padding; y < b->h + padding; y++) {
+                uint32_t *out = (uint32_t*)((char*)b->bitmap + y * b->stride);
+                int start = 0;
+                for (int x = -padding; x < 0; x++)
+                    out[x] = 0;
+                if (y >= 0 && y < b->h) {
+                    uint8_t *in = data[0] + y * linesize[0];
+                    for (int x = 0; x < b->w; x++)
+                        *out++ = pal[*in++];
+                    start = b->w;
+                }
+                for (int x = start; x < b->w + padding; x++)
+                    *out++ = 0;
             }
-            for (int x = start; x < b->w + padding; x++)
-                *out++ = 0;
         }
 
         b->bitmap = (char*)b->bitmap - extend * b->stride - extend * 4;
@@ -281,8 +329,10 @@ static void read_sub_bitmaps(struct sd *sd, struct sub *sub)
         b->w += extend * 2;
         b->h += extend * 2;
 
-        if (apply_blur)
+        if (apply_blur && !cached)
             mp_blur_rgba_sub_bitmap(b, opts->sub_gauss);
+
+        b->id = id;
     }
 }
 
@@ -60,15 +60,38 @@ union aligned_header {
 #define MAX_ALLOC (((size_t)-1) - sizeof(union aligned_header))
 
 // Needed for non-leaf allocations, or extended features such as destructors.
+// Allocations from an arena always have one.
 struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    struct ta_arena *arena;    // arena this is allocated from (or is)
 };
 
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+// The user data of an arena allocation returned by ta_new_arena().
+struct ta_arena {
+    struct ta_arena_block *blocks;  // most recent block first
+    char *pos, *end;                // free space in blocks
+    size_t block_size;              // size of the next block
+    // Whether freeing the arena must walk the tree: set if there are
+    // destructors, or children that need to be freed separately.
+    bool need_walk;
+};
+
+struct ta_arena_block {
+    struct ta_arena_block *next;
+};
+
+#define ARENA_BLOCK_HEADER \
+    ((sizeof(struct ta_arena_block) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+#define ARENA_EXT_SIZE \
+    ((sizeof(struct ta_ext_header) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+#define ARENA_MIN_BLOCK (4 * 1024)
+#define ARENA_MAX_BLOCK (256 * 1024)
+
 static void ta_dbg_add(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
@@ -80,6 +103,117 @@ static struct ta_header *get_header(void *ptr)
     return h;
 }
 
+static bool is_arena_root(struct ta_header *h)
+{
+    return h->ext && h->ext->arena == PTR_FROM_HEADER(h);
+}
+
+// Whether h was allocated from an arena (and is not an arena itself).
+static bool is_arena_member(struct ta_header *h)
+{
+    return h->ext && h->ext->arena && !is_arena_root(h);
+}
+
+static bool arena_walk_needed(struct ta_arena *arena);
+
+// Return size bytes (rounded up to MIN_ALIGN) of memory from the arena.
+static void *arena_alloc(struct ta_arena *arena, size_t size)
+{
+    size = (size + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1);
+    if (size > (size_t)(arena->end - arena->pos)) {
+        size_t block_size = arena->block_size;
+        if (size > block_size / 4) {
+            // Put big allocations into their own block, and keep using the
+            // current one.
+            struct ta_arena_block *b = malloc(ARENA_BLOCK_HEADER + size);
+            if (!b)
+                return NULL;
+            if (arena->blocks) {
+                b->next = arena->blocks->next;
+                arena->blocks->next = b;
+            } else {
+                b->next = NULL;
+                arena->blocks = b;
+            }
+            return (char *)b + ARENA_BLOCK_HEADER;
+        }
+        struct ta_arena_block *b = malloc(ARENA_BLOCK_HEADER + block_size);
+        if (!b)
+            return NULL;
+        b->next = arena->blocks;
+        arena->blocks = b;
+        arena->pos = (char *)b + ARENA_BLOCK_HEADER;
+        arena->end = arena->pos + block_size;
+        if (block_size < ARENA_MAX_BLOCK)
+            arena->block_size = block_size * 2;
+    }
+    void *res = arena->pos;
+    arena->pos += size;
+    return res;
+}
+
+// Release all memory, but keep the most recent block for reuse if keep is set.
+static void arena_reset(struct ta_arena *arena, bool keep)
+{
+    struct ta_arena_block *b = arena->blocks;
+    if (keep && arena->end) {
+        // The first block is the one pos/end point into.
+        b = b->next;
+        arena->blocks->next = NULL;
+        arena->pos = (char *)arena->blocks + ARENA_BLOCK_HEADER;
+    } else {
+        arena->blocks = NULL;
+        arena->pos = arena->end = NULL;
+    }
+    while (b) {
+        struct ta_arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    arena->need_walk = false;
+}
+
+static void init_ext_header(struct ta_ext_header *eh, struct ta_header *h)
+{
+    *eh = (struct ta_ext_header) {
+        .header = h,
+        .children = {
+            .next = &eh->children,
+            .prev = &eh->children,
+            // Needed by ta_find_parent():
+            .size = CHILDREN_SENTINEL,
+            .ext = eh,
+        },
+    };
+}
+
+// Allocate a header with size bytes of user data from the arena, including an
+// extended header. The header is not linked to a parent yet.
+static struct ta_header *arena_alloc_header(struct ta_arena *arena, size_t size)
+{
+    if (size >= MAX_ALLOC - ARENA_EXT_SIZE)
+        return NULL;
+    char *mem = arena_alloc(arena, ARENA_EXT_SIZE +
+                                   sizeof(union aligned_header) + size);
+    if (!mem)
+        return NULL;
+    struct ta_ext_header *eh = (void *)mem;
+    struct ta_header *h = (void *)(mem + ARENA_EXT_SIZE);
+    *h = (struct ta_header) {.size = size};
+    init_ext_header(eh, h);
+    eh->arena = arena;
+    h->ext = eh;
+    ta_dbg_add(h);
+    return h;
+}
+
+// Return the arena new children of ta_parent are allocated from, or NULL.
+static struct ta_arena *get_parent_arena(void *ta_parent)
+{
+    struct ta_header *h = get_header(ta_parent);
+    return h && h->ext ? h->ext->arena : NULL;
+}
+
 static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
@@ -89,16 +223,7 @@ static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
         h->ext = malloc(sizeof(struct ta_ext_header));
         if (!h->ext)
             return NULL;
-        *h->ext = (struct ta_ext_header) {
-            .header = h,
-            .children = {
-                .next = &h->ext->children,
-                .prev = &h->ext->children,
-                // Needed by ta_find_parent():
-                .size = CHILDREN_SENTINEL,
-                .ext = h->ext,
-            },
-        };
+        init_ext_header(h->ext, h);
     }
     return h->ext;
 }
@@ -111,6 +236,8 @@ static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
  * Warning: if ta_parent is a direct or indirect child of ptr, things will go
  *          wrong. The function will apparently succeed, but creates circular
  *          parent links, which are not allowed.
+ *
+ * Allocations from an arena can't be moved out of it (see ta_new_arena()).
  */
 bool ta_set_parent(void *ptr, void *ta_parent)
 {
@@ -120,6 +247,13 @@ bool ta_set_parent(void *ptr, void *ta_parent)
     struct ta_ext_header *parent_eh = get_or_alloc_ext_header(ta_parent);
     if (ta_parent && !parent_eh) // do nothing on OOM
         return false;
+    struct ta_arena *arena = parent_eh ? parent_eh->arena : NULL;
+    if (is_arena_member(ch)) {
+        assert(arena == ch->ext->arena);
+    } else if (arena) {
+        // Foreign allocation, which must be freed separately.
+        arena->need_walk = true;
+    }
     // Unlink from previous parent
     if (ch->next) {
         ch->next->prev = ch->prev;
@@ -146,6 +280,15 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    struct ta_arena *arena = get_parent_arena(ta_parent);
+    if (arena) {
+        struct ta_header *h = arena_alloc_header(arena, size);
+        if (!h)
+            return NULL;
+        void *ptr = PTR_FROM_HEADER(h);
+        ta_set_parent(ptr, ta_parent); // can't fail
+        return ptr;
+    }
     struct ta_header *h = malloc(sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -166,6 +309,12 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
+    if (get_parent_arena(ta_parent)) {
+        void *ptr = ta_alloc_size(ta_parent, size);
+        if (ptr)
+            memset(ptr, 0, size);
+        return ptr;
+    }
     struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
     if (!h)
         return NULL;
@@ -205,11 +354,37 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
     struct ta_header *old_h = h;
     if (h->size == size)
         return ptr;
-    ta_dbg_remove(h);
-    h = realloc(h, sizeof(union aligned_header) + size);
-    ta_dbg_add(h ? h : old_h);
-    if (!h)
-        return NULL;
+    if (is_arena_member(h)) {
+        struct ta_arena *arena = h->ext->arena;
+        char *old_end = (char *)ptr +
+            ((h->size + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1));
+        if (size < h->size) {
+            h->size = size;
+            return ptr;
+        }
+        if (old_end == arena->pos &&
+            size <= (size_t)(arena->end - (char *)ptr))
+        {
+            // Last allocation in the current block: grow it in place.
+            arena->pos = (char *)ptr +
+                ((size + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1));
+            h->size = size;
+            return ptr;
+        }
+        // The old memory is released together with the arena.
+        h = arena_alloc(arena, sizeof(union aligned_header) + size);
+        if (!h)
+            return NULL;
+        memcpy(h, old_h, sizeof(union aligned_header) + old_h->size);
+        ta_dbg_remove(old_h);
+        ta_dbg_add(h);
+    } else {
+        ta_dbg_remove(h);
+        h = realloc(h, sizeof(union aligned_header) + size);
+        ta_dbg_add(h ? h : old_h);
+        if (!h)
+            return NULL;
+    }
     h->size = size;
     if (h != old_h) {
         if (h->next) {
@@ -246,6 +421,17 @@ void ta_free_children(void *ptr)
     struct ta_ext_header *eh = h ? h->ext : NULL;
     if (!eh)
         return;
+    if (is_arena_root(h)) {
+        struct ta_arena *arena = ptr;
+        if (!arena_walk_needed(arena)) {
+            // Nothing to do per allocation; drop them all at once.
+            eh->children.next = eh->children.prev = &eh->children;
+        }
+        while (eh->children.next != &eh->children)
+            ta_free(PTR_FROM_HEADER(eh->children.next));
+        arena_reset(arena, true);
+        return;
+    }
     while (eh->children.next != &eh->children)
         ta_free(PTR_FROM_HEADER(eh->children.next));
 }
@@ -266,6 +452,10 @@ void ta_free(void *ptr)
         h->prev->next = h->next;
     }
     ta_dbg_remove(h);
+    if (is_arena_member(h))
+        return; // memory is released with the arena
+    if (is_arena_root(h))
+        arena_reset(ptr, false);
     free(h->ext);
     free(h);
 }
@@ -288,9 +478,39 @@ bool ta_set_destructor(void *ptr, void (*destructor)(void *))
     if (!eh)
         return false;
     eh->destructor = destructor;
+    if (destructor && eh->arena)
+        eh->arena->need_walk = true;
     return true;
 }
 
+/* Create an arena, which is a TA allocation that serves all its direct and
+ * indirect children from large memory blocks, instead of using malloc() for
+ * each of them. Freeing individual children doesn't release their memory;
+ * it is released at once when the arena is freed, or when ta_free_children()
+ * is called on it (which keeps one block around for reuse). This is meant as
+ * parent for many small, short-lived allocations. The arena itself has
+ * ta_parent as parent.
+ *
+ * Children of the arena must not be moved out of it with ta_set_parent().
+ * Moving other allocations into the arena works, but makes freeing slower,
+ * just like destructors do.
+ *
+ * Returns NULL on OOM.
+ */
+void *ta_new_arena(void *ta_parent)
+{
+    // Not allocated from the parent's arena, if there is any.
+    struct ta_arena *arena = ta_zalloc_size(NULL, sizeof(struct ta_arena));
+    struct ta_ext_header *eh = get_or_alloc_ext_header(arena);
+    if (!eh || !ta_set_parent(arena, ta_parent)) {
+        ta_free(arena);
+        return NULL;
+    }
+    eh->arena = arena;
+    arena->block_size = ARENA_MIN_BLOCK;
+    return arena;
+}
+
 /* Return the ptr's parent allocation, or NULL if there isn't any.
  *
  * Warning: this has O(N) runtime complexity with N sibling allocations!
@@ -399,6 +619,12 @@ static void print_leak_report(void)
     pthread_mutex_unlock(&ta_dbg_mutex);
 }
 
+static bool arena_walk_needed(struct ta_arena *arena)
+{
+    // Allocations must be removed from the leak list.
+    return arena->need_walk || enable_leak_check;
+}
+
 void ta_enable_leak_report(void)
 {
     pthread_mutex_lock(&ta_dbg_mutex);
@@ -439,6 +665,11 @@ static void ta_dbg_add(struct ta_header *h){}
 static void ta_dbg_check_header(struct ta_header *h){}
 static void ta_dbg_remove(struct ta_header *h){}
 
+static bool arena_walk_needed(struct ta_arena *arena)
+{
+    return arena->need_walk;
+}
+
 void ta_enable_leak_report(void){}
 void *ta_dbg_set_loc(void *ptr, const char *loc){return ptr;}
 void *ta_dbg_mark_as_string(void *ptr){return ptr;}
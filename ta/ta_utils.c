@@ -44,8 +44,6 @@ size_t ta_calc_prealloc_elems(size_t nextidx)
     return (nextidx + 1) * 2;
 }
 
-static void dummy_dtor(void *p){}
-
 /* Create an empty (size 0) TA allocation, which is prepared in a way such that
  * using it as parent with ta_set_parent() always succeed. Calling
  * ta_set_destructor() on it will always succeed as well.
@@ -54,7 +52,7 @@ void *ta_new_context(void *ta_parent)
 {
     void *new = ta_alloc_size(ta_parent, 0);
     // Force it to allocate an extended header.
-    if (!ta_set_destructor(new, dummy_dtor)) {
+    if (!ta_set_destructor(new, NULL)) {
         ta_free(new);
         new = NULL;
     }
@@ -0,0 +1,141 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/out/ao.h"
+#include "audio/out/internal.h"
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+
+#define SAMPLES 4096
+#define CHANNELS 2
+
+// --- ao_post_process_data() (software volume)
+
+struct gain_priv {
+    struct ao *ao;
+    void *data[1];
+};
+
+static bool setup_gain(struct bench_state *st, int format)
+{
+    struct gain_priv *p = talloc_zero(st, struct gain_priv);
+    // Only the fields used by ao_post_process_data() are set.
+    p->ao = talloc_zero(p, struct ao);
+    p->ao->format = format;
+    mp_chmap_from_channels(&p->ao->channels, CHANNELS);
+    // Amplify, so that the samples get clipped after a few iterations, instead
+    // of decaying into denormals.
+    atomic_store(&p->ao->gain, 1.25f);
+    int bytes = SAMPLES * CHANNELS * af_fmt_to_bytes(format);
+    p->data[0] = talloc_size(p, bytes);
+    for (int n = 0; n < SAMPLES * CHANNELS; n++) {
+        double v = sin(n * 0.01) * 0.5;
+        if (format == AF_FORMAT_FLOAT) {
+            ((float *)p->data[0])[n] = v;
+        } else {
+            ((int16_t *)p->data[0])[n] = v * INT16_MAX;
+        }
+    }
+    st->priv = p;
+    st->bytes = bytes;
+    return true;
+}
+
+static bool setup_gain_float(struct bench_state *st)
+{
+    return setup_gain(st, AF_FORMAT_FLOAT);
+}
+
+static bool setup_gain_s16(struct bench_state *st)
+{
+    return setup_gain(st, AF_FORMAT_S16);
+}
+
+static void run_gain(void *priv)
+{
+    struct gain_priv *p = priv;
+    ao_post_process_data(p->ao, p->data, SAMPLES);
+}
+
+// --- af_scaletempo
+
+struct scaletempo_priv {
+    struct mp_filter *root;
+    struct mp_filter *f;
+    struct mp_aframe *frame;
+};
+
+static bool setup_scaletempo(struct bench_state *st)
+{
+    struct scaletempo_priv *p = talloc_zero(st, struct scaletempo_priv);
+    p->root = mp_filter_create_root(st->global);
+    talloc_steal(p, p->root);
+
+    const struct m_obj_desc *desc = &af_scaletempo.desc;
+    void *opts = talloc_memdup(NULL, (void *)desc->priv_defaults,
+                               desc->priv_size);
+    p->f = af_scaletempo.create(p->root, opts);
+    if (!p->f)
+        return false;
+    struct mp_filter_command cmd = {
+        .type = MP_FILTER_COMMAND_SET_SPEED,
+        .speed = 1.5,
+    };
+    mp_filter_command(p->f, &cmd);
+
+    p->frame = talloc_steal(p, mp_aframe_create());
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, CHANNELS);
+    mp_aframe_set_format(p->frame, AF_FORMAT_FLOAT);
+    mp_aframe_set_chmap(p->frame, &chmap);
+    mp_aframe_set_rate(p->frame, 48000);
+    struct mp_aframe_pool *pool = mp_aframe_pool_create(p);
+    if (mp_aframe_pool_allocate(pool, p->frame, SAMPLES) < 0)
+        return false;
+    float *data = (float *)mp_aframe_get_data_rw(p->frame)[0];
+    for (int n = 0; n < SAMPLES * CHANNELS; n++)
+        data[n] = sin(n * 0.01) * 0.5;
+    mp_aframe_set_pts(p->frame, 0);
+
+    st->priv = p;
+    st->bytes = SAMPLES * CHANNELS * sizeof(float);
+    return true;
+}
+
+// Feed one frame, and read all output it produces.
+static void run_scaletempo(void *priv)
+{
+    struct scaletempo_priv *p = priv;
+    struct mp_pin *in = p->f->pins[0];
+    struct mp_pin *out = p->f->pins[1];
+    bool fed = false;
+    while (1) {
+        if (mp_pin_out_request_data(out)) {
+            struct mp_frame frame = mp_pin_out_read(out);
+            mp_frame_unref(&frame);
+            continue;
+        }
+        if (!fed && mp_pin_in_needs_data(in)) {
+            struct mp_aframe *frame = mp_aframe_new_ref(p->frame);
+            mp_pin_in_write(in, MAKE_FRAME(MP_FRAME_AUDIO, frame));
+            fed = true;
+            continue;
+        }
+        if (!mp_filter_run(p->root))
+            break;
+    }
+}
+
+const struct bench bench_audio[] = {
+    {"ao_post_process_data-float", setup_gain_float, run_gain},
+    {"ao_post_process_data-s16", setup_gain_s16, run_gain},
+    {"af_scaletempo-1.5x", setup_scaletempo, run_scaletempo},
+    {0}
+};
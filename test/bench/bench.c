@@ -0,0 +1,184 @@
+/*
+ * Microbenchmarks for some performance critical functions.
+ *
+ * Usage: bench [-t seconds] [-r repetitions] [-l] [name...]
+ *
+ * Runs all benchmarks whose name contains one of the given names (or all if
+ * none are given). Each benchmark is first run until its timing is stable
+ * enough to determine how many iterations fit into the given time (-t), then
+ * it is measured -r times. The median and the fastest time per operation are
+ * printed. The cycle counts use the CPU timestamp counter, which on modern CPUs
+ * runs at a constant rate independent of the actual clock.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+static uint64_t read_cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#define BENCH_HAVE_TSC 0
+static uint64_t read_cycles(void)
+{
+    return 0;
+}
+#endif
+
+static const struct bench *const bench_lists[] = {
+    bench_audio,
+    bench_misc,
+    bench_video,
+};
+
+struct measurement {
+    double ns;          // per operation
+    double cycles;      // per operation
+};
+
+static struct measurement run_batch(const struct bench *b, void *priv,
+                                    int64_t iters)
+{
+    int64_t t0 = mp_time_us();
+    uint64_t c0 = read_cycles();
+    for (int64_t n = 0; n < iters; n++)
+        b->run(priv);
+    uint64_t c1 = read_cycles();
+    int64_t t1 = mp_time_us();
+    return (struct measurement){
+        .ns = (t1 - t0) * 1000.0 / iters,
+        .cycles = (double)(c1 - c0) / iters,
+    };
+}
+
+static int cmp_measurement(const void *a, const void *b)
+{
+    double ta = ((const struct measurement *)a)->ns;
+    double tb = ((const struct measurement *)b)->ns;
+    return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+static void run_bench(struct mpv_global *global, struct m_config *config,
+                      const struct bench *b, double min_time, int reps)
+{
+    struct bench_state *st = talloc_zero(NULL, struct bench_state);
+    st->global = global;
+    st->config = config;
+
+    if (!b->setup(st)) {
+        printf("%-32s (skipped)\n", b->name);
+        talloc_free(st);
+        return;
+    }
+
+    // Warm up (caches, lazy initialization, CPU clock) and find the number of
+    // iterations which takes about min_time. Double until a batch takes at
+    // least 1/10 of that, so the timer resolution doesn't matter much.
+    int64_t iters = 1;
+    double batch_ns;
+    while (1) {
+        batch_ns = run_batch(b, st->priv, iters).ns * iters;
+        if (batch_ns >= min_time * 1e8 || iters >= (INT64_MAX / 4))
+            break;
+        iters *= 2;
+    }
+    iters = MPMAX(1, iters * (min_time * 1e9 / MPMAX(batch_ns, 1)));
+
+    struct measurement *res = talloc_array(st, struct measurement, reps);
+    for (int n = 0; n < reps; n++)
+        res[n] = run_batch(b, st->priv, iters);
+    qsort(res, reps, sizeof(res[0]), cmp_measurement);
+    struct measurement med = res[reps / 2];
+
+    printf("%-32s %12.1f %12.1f", b->name, med.ns, res[0].ns);
+    if (BENCH_HAVE_TSC) {
+        printf(" %12.1f", med.cycles);
+    } else {
+        printf(" %12s", "-");
+    }
+    if (st->bytes > 0 && med.ns > 0) {
+        printf(" %10.1f", st->bytes / med.ns * 1e9 / (1024 * 1024));
+    } else {
+        printf(" %10s", "-");
+    }
+    printf(" %10"PRId64"\n", iters);
+    fflush(stdout);
+
+    talloc_free(st);
+}
+
+static bool match_name(const char *name, char **filters, int num_filters)
+{
+    if (!num_filters)
+        return true;
+    for (int n = 0; n < num_filters; n++) {
+        if (strstr(name, filters[n]))
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    double min_time = 0.1;
+    int reps = 5;
+    bool list = false;
+    char **filters = NULL;
+    int num_filters = 0;
+
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "-t") == 0 && n + 1 < argc) {
+            min_time = atof(argv[++n]);
+        } else if (strcmp(argv[n], "-r") == 0 && n + 1 < argc) {
+            reps = atoi(argv[++n]);
+        } else if (strcmp(argv[n], "-l") == 0) {
+            list = true;
+        } else if (argv[n][0] == '-') {
+            fprintf(stderr, "Usage: %s [-t seconds] [-r repetitions] [-l] "
+                    "[name...]\n", argv[0]);
+            return 2;
+        } else {
+            MP_TARRAY_APPEND(NULL, filters, num_filters, argv[n]);
+        }
+    }
+    if (min_time <= 0 || reps < 1) {
+        fprintf(stderr, "Invalid -t or -r value.\n");
+        return 2;
+    }
+
+    if (list) {
+        for (int l = 0; l < MP_ARRAY_SIZE(bench_lists); l++) {
+            for (const struct bench *b = bench_lists[l]; b->name; b++)
+                printf("%s\n", b->name);
+        }
+        talloc_free(filters);
+        return 0;
+    }
+
+    struct bench_env *env = bench_env_create();
+
+    printf("%-32s %12s %12s %12s %10s %10s\n", "benchmark", "ns/op",
+           "min ns/op", "cycles/op", "MiB/s", "iters");
+    for (int l = 0; l < MP_ARRAY_SIZE(bench_lists); l++) {
+        for (const struct bench *b = bench_lists[l]; b->name; b++) {
+            if (match_name(b->name, filters, num_filters))
+                run_bench(env->global, env->config, b, min_time, reps);
+        }
+    }
+
+    bench_env_destroy(env);
+    talloc_free(filters);
+    return 0;
+}
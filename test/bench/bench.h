@@ -0,0 +1,46 @@
+#ifndef MP_BENCH_H
+#define MP_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mpv_global;
+struct m_config;
+
+struct bench_state {
+    // A mpv_global with the default player options (like mpctx->global).
+    struct mpv_global *global;
+    struct m_config *config;
+    // Set by bench.setup; the benchmark's private data.
+    void *priv;
+    // Optionally set by bench.setup: bytes processed by each bench.run call.
+    // If set, the throughput is printed.
+    int64_t bytes;
+};
+
+struct bench {
+    const char *name;
+    // Called once before measuring. Allocates the benchmark's data as talloc
+    // children of st (freed after the benchmark), and sets st->priv. Return
+    // false to skip the benchmark (e.g. if something is unsupported).
+    bool (*setup)(struct bench_state *st);
+    // Perform one operation. This is called many times, and must not leak.
+    void (*run)(void *priv);
+};
+
+// Global state for programs using player internals.
+struct bench_env {
+    struct mpv_global *global;
+    struct m_config *config;    // default player options (like mpctx->mconfig)
+};
+
+// Initialize the timer, the log and the option tree, like mp_create() does.
+struct bench_env *bench_env_create(void);
+void bench_env_destroy(struct bench_env *env);
+
+// Lists of benchmarks, each terminated with {0}.
+extern const struct bench bench_audio[];
+extern const struct bench bench_misc[];
+extern const struct bench bench_video[];
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Demuxer seek latency benchmark.
+ *
+ * Usage: demux_seek [-n seeks] [-s seed] file...
+ *
+ * Opens each file with the demuxer thread enabled, and seeks to -n random
+ * positions. The time from demux_seek() until the first packet is returned is
+ * measured for each seek. The same positions are then seeked to a second time
+ * ("warm" pass). This is done once with --demuxer-seekable-cache=no, and once
+ * with =yes, so the second pass shows the effect of the demuxer packet cache.
+ * (The stream cache is disabled, so bytes read are what the demuxer requested.)
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "common/common.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+#include "options/m_config.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+
+struct pass_stats {
+    int64_t *latency;       // us, per seek
+    int num_latency;
+    int failed;             // seeks which returned no packet
+    int64_t stream_bytes;
+    int low_level_seeks;
+};
+
+static uint64_t next_rand(uint64_t *state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *)a, vb = *(const int64_t *)b;
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+static double percentile_ms(struct pass_stats *p, double q)
+{
+    if (!p->num_latency)
+        return 0;
+    int idx = MPCLAMP((int)(q * p->num_latency), 0, p->num_latency - 1);
+    return p->latency[idx] / 1000.0;
+}
+
+static void get_perf_stats(struct demuxer *d, struct demux_ctrl_perf_stats *s)
+{
+    *s = (struct demux_ctrl_perf_stats){0};
+    demux_control(d, DEMUXER_CTRL_GET_PERF_STATS, s);
+    talloc_free(s->streams);
+    s->streams = NULL;
+}
+
+static void run_pass(struct demuxer *d, struct sh_stream *sh, double *pos,
+                     int num_pos, struct pass_stats *res)
+{
+    struct demux_ctrl_perf_stats s0, s1;
+    get_perf_stats(d, &s0);
+
+    res->latency = talloc_array(res, int64_t, num_pos);
+    for (int n = 0; n < num_pos; n++) {
+        int64_t t0 = mp_time_us();
+        demux_seek(d, pos[n], 0);
+        struct demux_packet *pkt = demux_read_packet(sh);
+        int64_t t1 = mp_time_us();
+        if (!pkt) {
+            res->failed++;
+            continue;
+        }
+        talloc_free(pkt);
+        res->latency[res->num_latency++] = t1 - t0;
+    }
+    qsort(res->latency, res->num_latency, sizeof(res->latency[0]), cmp_int64);
+
+    get_perf_stats(d, &s1);
+    res->stream_bytes = s1.stream_bytes - s0.stream_bytes;
+    res->low_level_seeks = s1.low_level_seeks - s0.low_level_seeks;
+}
+
+static void print_pass(const char *mode, const char *pass,
+                       struct pass_stats *p)
+{
+    printf("%-8s %-6s %10.2f %10.2f %10.2f %8d %14"PRId64" %7d\n", mode, pass,
+           percentile_ms(p, 0.5), percentile_ms(p, 0.99),
+           percentile_ms(p, 1.0), p->low_level_seeks, p->stream_bytes,
+           p->failed);
+    fflush(stdout);
+}
+
+// Returns false if the file could not be opened.
+static bool bench_file(struct bench_env *env, const char *file, bool cached,
+                       int num_seeks, uint64_t seed)
+{
+    m_config_set_option_cli(env->config, bstr0("demuxer-seekable-cache"),
+                            bstr0(cached ? "yes" : "no"), 0);
+
+    void *tmp = talloc_new(NULL);
+    struct mp_cancel *cancel = mp_cancel_new(tmp);
+    struct demuxer_params params = {
+        .disable_cache = true,
+    };
+    struct demuxer *d = demux_open_url(file, &params, cancel, env->global);
+    if (!d) {
+        talloc_free(tmp);
+        return false;
+    }
+
+    // Prefer video packets, since they determine when playback can resume.
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(d); n++) {
+        struct sh_stream *s = demux_get_stream(d, n);
+        demuxer_select_track(d, s, MP_NOPTS_VALUE, true);
+        if (!sh || (s->type == STREAM_VIDEO && sh->type != STREAM_VIDEO))
+            sh = s;
+    }
+
+    bool ok = sh && d->seekable && d->duration > 0;
+    if (ok) {
+        demux_start_thread(d);
+
+        double *pos = talloc_array(tmp, double, num_seeks);
+        for (int n = 0; n < num_seeks; n++) {
+            uint64_t r = next_rand(&seed) >> 11; // 53 bits
+            pos[n] = d->start_time + r / (double)(1ULL << 53) * d->duration;
+        }
+
+        const char *mode = cached ? "cached" : "uncached";
+        struct pass_stats *cold = talloc_zero(tmp, struct pass_stats);
+        run_pass(d, sh, pos, num_seeks, cold);
+        print_pass(mode, "cold", cold);
+        struct pass_stats *warm = talloc_zero(tmp, struct pass_stats);
+        run_pass(d, sh, pos, num_seeks, warm);
+        print_pass(mode, "warm", warm);
+    } else {
+        printf("(not seekable or unknown duration)\n");
+    }
+
+    free_demuxer_and_stream(d);
+    talloc_free(tmp);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int num_seeks = 100;
+    uint64_t seed = 1;
+    char **files = NULL;
+    int num_files = 0;
+
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "-n") == 0 && n + 1 < argc) {
+            num_seeks = atoi(argv[++n]);
+        } else if (strcmp(argv[n], "-s") == 0 && n + 1 < argc) {
+            seed = strtoull(argv[++n], NULL, 0);
+        } else if (argv[n][0] == '-') {
+            num_files = 0; // print usage
+            break;
+        } else {
+            MP_TARRAY_APPEND(NULL, files, num_files, argv[n]);
+        }
+    }
+    if (!num_files || num_seeks < 1) {
+        fprintf(stderr, "Usage: %s [-n seeks] [-s seed] file...\n", argv[0]);
+        talloc_free(files);
+        return 2;
+    }
+    if (!seed)
+        seed = 1; // xorshift state must not be 0
+
+    struct bench_env *env = bench_env_create();
+
+    int ret = 0;
+    for (int n = 0; n < num_files; n++) {
+        printf("%s (%d seeks)\n", files[n], num_seeks);
+        printf("%-8s %-6s %10s %10s %10s %8s %14s %7s\n", "mode", "pass",
+               "p50 ms", "p99 ms", "max ms", "ll-seeks", "stream bytes",
+               "failed");
+        for (int c = 0; c < 2; c++) {
+            if (!bench_file(env, files[n], c, num_seeks, seed)) {
+                fprintf(stderr, "Could not open %s\n", files[n]);
+                ret = 1;
+                break;
+            }
+        }
+    }
+
+    bench_env_destroy(env);
+    talloc_free(files);
+    return ret;
+}
@@ -0,0 +1,37 @@
+#include "bench.h"
+
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "mpv_talloc.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+
+struct bench_env *bench_env_create(void)
+{
+    mp_time_init();
+
+    struct bench_env *env = talloc_zero(NULL, struct bench_env);
+    struct mpv_global *global = talloc_zero(env, struct mpv_global);
+    mp_msg_init(global);
+    struct m_config *config = m_config_new(global, global->log,
+                                           sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    config->global = global;
+    m_config_create_shadow(config);
+    global->opts = config->optstruct;
+
+    env->global = global;
+    env->config = config;
+    return env;
+}
+
+void bench_env_destroy(struct bench_env *env)
+{
+    if (!env)
+        return;
+    talloc_free(env->config);
+    mp_msg_uninit(env->global);
+    talloc_free(env);
+}
@@ -0,0 +1,465 @@
+/*
+ * Offscreen benchmark for the gpu renderer.
+ *
+ * Usage: gpu [-n renders] [-s WxH] [-l] [name...]
+ *
+ * Creates a surfaceless EGL context (no window system required), and renders
+ * synthetic frames with gl_video_render_frame() into an offscreen texture, for
+ * all combinations of test sources and option profiles whose "source/profile"
+ * name contains one of the given names (or all if none are given). The
+ * display is simulated as 60 Hz, with 24 fps video. After a warmup, the GPU
+ * time of each pass is averaged over the last -n rendered frames, separately
+ * for fresh frames and for redraws (e.g. interpolated vsyncs).
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "bench.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+#include "options/m_config.h"
+#include "video/csputils.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/out/gpu/ra.h"
+#include "video/out/gpu/video.h"
+#include "video/out/opengl/common.h"
+#include "video/out/opengl/context.h"
+#include "video/out/opengl/egl_helpers.h"
+#include "video/out/opengl/ra_gl.h"
+#include "video/out/vo.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#define WARMUP_RENDERS 60
+#define SOURCE_FPS 24
+#define DISPLAY_FPS 60
+
+struct source {
+    const char *name;
+    int imgfmt;
+    int w, h;
+    bool hdr;   // BT.2020 primaries, PQ transfer
+};
+
+static const struct source sources[] = {
+    {"1080p-420p", IMGFMT_420P, 1920, 1080},
+    {"2160p-420p", IMGFMT_420P, 3840, 2160},
+    {"2160p-p010-pq", IMGFMT_P010, 3840, 2160, true},
+    {"720p-rgb0", IMGFMT_RGB0, 1280, 720},
+};
+
+struct profile {
+    const char *name;
+    const char *opts[10];   // "name=value", NULL terminated
+};
+
+static const struct profile profiles[] = {
+    {"default"},
+    // Same as the builtin gpu-hq profile (etc/builtin.conf).
+    {"gpu-hq", {"scale=spline36", "cscale=spline36", "dscale=mitchell",
+                "dither-depth=auto", "correct-downscaling=yes",
+                "linear-downscaling=yes", "sigmoid-upscaling=yes",
+                "deband=yes"}},
+    {"ewa", {"scale=ewa_lanczossharp", "cscale=ewa_lanczossharp",
+             "dscale=ewa_lanczossharp"}},
+    {"deband", {"deband=yes", "deband-iterations=4"}},
+    {"tone-mapping", {"tone-mapping=hable", "hdr-compute-peak=yes"}},
+    {"interpolation", {"interpolation=yes", "tscale=mitchell"}},
+};
+
+struct gpu_ctx {
+    struct mp_log *log;
+    EGLDisplay display;
+    EGLContext context;
+    GL *gl;
+    struct ra *ra;
+};
+
+// Needed by ra_gl_ctx_test_version() (only log and global are set).
+static struct ra_ctx *create_dummy_ra_ctx(void *ta_parent,
+                                          struct bench_env *env)
+{
+    struct ra_ctx *ctx = talloc_zero(ta_parent, struct ra_ctx);
+    ctx->global = env->global;
+    ctx->log = mp_log_new(ctx, env->global->log, "gpu");
+    return ctx;
+}
+
+static EGLDisplay get_surfaceless_display(void)
+{
+    const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (exts && strstr(exts, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay =
+            (void *)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (GetPlatformDisplay)
+            return GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                      EGL_DEFAULT_DISPLAY, NULL);
+    }
+    // Works with EGL_KHR_surfaceless_context on most drivers anyway.
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static void gpu_uninit(struct gpu_ctx *p)
+{
+    ra_free(&p->ra);
+    if (p->display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        if (p->context != EGL_NO_CONTEXT)
+            eglDestroyContext(p->display, p->context);
+        eglTerminate(p->display);
+    }
+    talloc_free(p);
+}
+
+static struct gpu_ctx *gpu_init(struct bench_env *env)
+{
+    struct gpu_ctx *p = talloc_zero(NULL, struct gpu_ctx);
+    struct ra_ctx *ctx = create_dummy_ra_ctx(p, env);
+    p->log = ctx->log;
+    p->context = EGL_NO_CONTEXT;
+
+    p->display = get_surfaceless_display();
+    if (p->display == EGL_NO_DISPLAY || !eglInitialize(p->display, NULL, NULL)) {
+        MP_FATAL(p, "Could not initialize EGL.\n");
+        p->display = EGL_NO_DISPLAY;
+        goto error;
+    }
+    const char *exts = eglQueryString(p->display, EGL_EXTENSIONS);
+    if (!exts || !strstr(exts, "EGL_KHR_surfaceless_context")) {
+        MP_FATAL(p, "EGL_KHR_surfaceless_context not supported.\n");
+        goto error;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        MP_FATAL(p, "Could not bind OpenGL API.\n");
+        goto error;
+    }
+    // No surface is ever created, so accept any surface type.
+    EGLint attributes[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(p->display, attributes, &config, 1, &num_configs) ||
+        num_configs < 1)
+    {
+        MP_FATAL(p, "Could not choose EGLConfig.\n");
+        goto error;
+    }
+
+    for (int n = 0; mpgl_preferred_gl_versions[n]; n++) {
+        int ver = mpgl_preferred_gl_versions[n];
+        if (ver < 320 || !ra_gl_ctx_test_version(ctx, ver, false))
+            continue;
+        EGLint attrs[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, MPGL_VER_GET_MAJOR(ver),
+            EGL_CONTEXT_MINOR_VERSION_KHR, MPGL_VER_GET_MINOR(ver),
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+                EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE
+        };
+        p->context = eglCreateContext(p->display, config, EGL_NO_CONTEXT, attrs);
+        if (p->context != EGL_NO_CONTEXT)
+            break;
+    }
+    if (p->context == EGL_NO_CONTEXT) {
+        MP_FATAL(p, "Could not create OpenGL context.\n");
+        goto error;
+    }
+    if (!eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        p->context))
+    {
+        MP_FATAL(p, "Could not make context current.\n");
+        goto error;
+    }
+
+    p->gl = talloc_zero(p, GL);
+    mpegl_load_functions(p->gl, p->log);
+    if (!p->gl->version) {
+        MP_FATAL(p, "OpenGL not initialized.\n");
+        goto error;
+    }
+    if (p->gl->mpgl_caps & MPGL_CAP_SW)
+        MP_WARN(p, "Suspected software renderer.\n");
+
+    p->ra = ra_create_gl(p->gl, p->log);
+    if (!p->ra || !p->ra->fns->timer_create) {
+        MP_FATAL(p, "Could not create RA, or no GPU timer support.\n");
+        goto error;
+    }
+    MP_INFO(p, "GL_RENDERER: %s\n", (const char *)p->gl->GetString(GL_RENDERER));
+    return p;
+
+error:
+    gpu_uninit(p);
+    return NULL;
+}
+
+static struct mp_image *create_source_image(const struct source *src)
+{
+    struct mp_image *img = mp_image_alloc(src->imgfmt, src->w, src->h);
+    if (!img)
+        return NULL;
+    if (src->hdr) {
+        img->params.color = (struct mp_colorspace){
+            .space = MP_CSP_BT_2020_NC,
+            .levels = MP_CSP_LEVELS_TV,
+            .primaries = MP_CSP_PRIM_BT_2020,
+            .gamma = MP_CSP_TRC_PQ,
+        };
+    }
+    mp_image_params_guess_csp(&img->params);
+    mp_image_clear(img, 0, 0, img->w, img->h);
+    // Some structure, so that scalers and deband have something to work on.
+    for (int y = 0; y < img->h; y++) {
+        uint8_t *line = img->planes[0] + y * img->stride[0];
+        int bytes = mp_image_plane_w(img, 0) * img->fmt.bpp[0] / 8;
+        for (int x = 0; x < bytes; x++)
+            line[x] = (x * 3 + y * 5 + ((x / 64) ^ (y / 64)) * 40) & 0xFF;
+    }
+    return img;
+}
+
+// Accumulated per-pass timings.
+struct pass_result {
+    char *desc;
+    double avg_us, peak_us;
+    int samples;
+};
+
+// Average over the most recent max_samples samples of each pass.
+static void get_pass_results(void *ta_parent, struct mp_frame_perf *perf,
+                             int max_samples, struct pass_result **out,
+                             int *num_out)
+{
+    for (int n = 0; n < perf->count; n++) {
+        struct mp_pass_perf *pp = &perf->perf[n];
+        int count = MPMIN(pp->count, max_samples);
+        if (count <= 0)
+            continue;
+        uint64_t sum = 0, peak = 0;
+        for (int i = pp->count - count; i < pp->count; i++) {
+            sum += pp->samples[i];
+            peak = MPMAX(peak, pp->samples[i]);
+        }
+        struct pass_result r = {
+            .desc = talloc_strdup(ta_parent, perf->desc[n]),
+            .avg_us = sum / 1000.0 / count,
+            .peak_us = peak / 1000.0,
+            .samples = count,
+        };
+        MP_TARRAY_APPEND(ta_parent, *out, *num_out, r);
+    }
+}
+
+static void print_passes(const char *type, struct pass_result *res, int num)
+{
+    double total = 0;
+    for (int n = 0; n < num; n++) {
+        printf("  %-7s %-40s %10.1f %10.1f %8d\n", type, res[n].desc,
+               res[n].avg_us, res[n].peak_us, res[n].samples);
+        total += res[n].avg_us;
+    }
+    if (num)
+        printf("  %-7s %-40s %10.1f\n", type, "(total)", total);
+}
+
+static bool apply_profile(struct bench_env *env, const struct profile *prof)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(prof->opts) && prof->opts[n]; n++) {
+        bstr val = bstr0(prof->opts[n]);
+        bstr name;
+        if (!bstr_split_tok(val, "=", &name, &val))
+            abort();
+        if (m_config_set_option_cli(env->config, name, val,
+                                    M_SETOPT_BACKUP) < 0)
+            return false;
+    }
+    return true;
+}
+
+static void run_case(struct bench_env *env, struct gpu_ctx *gpu,
+                     const struct source *src, const struct profile *prof,
+                     int out_w, int out_h, int renders)
+{
+    printf("%s/%s\n", src->name, prof->name);
+    fflush(stdout);
+
+    void *tmp = talloc_new(NULL);
+    struct gl_video *renderer = NULL;
+    struct ra_tex *target = NULL;
+    struct mp_image *img = NULL;
+
+    if (!apply_profile(env, prof)) {
+        printf("  (invalid options)\n");
+        goto done;
+    }
+
+    renderer = gl_video_init(gpu->ra, gpu->log, env->global);
+    if (!gl_video_check_format(renderer, src->imgfmt)) {
+        printf("  (format not supported)\n");
+        goto done;
+    }
+    img = create_source_image(src);
+    target = ra_tex_create(gpu->ra, &(struct ra_tex_params){
+        .dimensions = 2,
+        .w = out_w, .h = out_h, .d = 1,
+        .format = ra_find_unorm_format(gpu->ra, 1, 4),
+        .render_dst = true,
+        .blit_dst = gpu->ra->caps & RA_CAP_BLIT,
+    });
+    if (!img || !target) {
+        printf("  (allocation failed)\n");
+        goto done;
+    }
+    gl_video_set_fb_depth(renderer, 8);
+    gl_video_config(renderer, &img->params);
+    struct mp_rect src_rc = {0, 0, src->w, src->h};
+    struct mp_rect dst_rc = {0, 0, out_w, out_h};
+    struct mp_osd_res osd = {.w = out_w, .h = out_h, .display_par = 1};
+    gl_video_resize(renderer, &src_rc, &dst_rc, &osd);
+
+    for (int n = 0; n < WARMUP_RENDERS + renders; n++) {
+        double t = n / (double)DISPLAY_FPS;
+        int64_t frame = (int64_t)(t * SOURCE_FPS);
+        struct vo_frame vf = {
+            .duration = 1e6 / SOURCE_FPS,
+            .vsync_interval = 1.0 / DISPLAY_FPS,
+            .vsync_offset = t - frame / (double)SOURCE_FPS,
+            .ideal_frame_duration = 1.0 / SOURCE_FPS,
+            .num_vsyncs = 1,
+            .display_synced = true,
+            .num_frames = 4,
+            .frame_id = frame + 1,
+        };
+        for (int i = 0; i < vf.num_frames; i++) {
+            vf.frames[i] = mp_image_new_ref(img);
+            vf.frames[i]->pts = (frame + i) / (double)SOURCE_FPS;
+        }
+        vf.current = vf.frames[0];
+        gl_video_render_frame(renderer, &vf, (struct ra_fbo){.tex = target}, 0);
+        // Don't queue up an unbounded amount of work (like a swapchain).
+        gpu->gl->Finish();
+        for (int i = 0; i < vf.num_frames; i++)
+            talloc_free(vf.frames[i]);
+    }
+
+    struct voctrl_performance_data perf;
+    gl_video_perfdata(renderer, &perf);
+    struct pass_result *res = NULL;
+    int num_res = 0;
+    get_pass_results(tmp, &perf.fresh, renders, &res, &num_res);
+    print_passes("fresh", res, num_res);
+    num_res = 0;
+    get_pass_results(tmp, &perf.redraw, renders, &res, &num_res);
+    print_passes("redraw", res, num_res);
+
+done:
+    ra_tex_free(gpu->ra, &target);
+    gl_video_uninit(renderer);
+    talloc_free(img);
+    m_config_restore_backups(env->config);
+    talloc_free(tmp);
+    fflush(stdout);
+}
+
+static bool match_name(const char *name, char **filters, int num_filters)
+{
+    if (!num_filters)
+        return true;
+    for (int n = 0; n < num_filters; n++) {
+        if (strstr(name, filters[n]))
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int renders = 240;
+    int out_w = 1920, out_h = 1080;
+    bool list = false;
+    char **filters = NULL;
+    int num_filters = 0;
+
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "-n") == 0 && n + 1 < argc) {
+            renders = atoi(argv[++n]);
+        } else if (strcmp(argv[n], "-s") == 0 && n + 1 < argc) {
+            if (sscanf(argv[++n], "%dx%d", &out_w, &out_h) != 2)
+                out_w = 0;
+        } else if (strcmp(argv[n], "-l") == 0) {
+            list = true;
+        } else if (argv[n][0] == '-') {
+            fprintf(stderr, "Usage: %s [-n renders] [-s WxH] [-l] [name...]\n",
+                    argv[0]);
+            return 2;
+        } else {
+            MP_TARRAY_APPEND(NULL, filters, num_filters, argv[n]);
+        }
+    }
+    if (renders < 1 || renders > VO_PERF_SAMPLE_COUNT || out_w < 1 || out_h < 1)
+    {
+        fprintf(stderr, "Invalid -n (1-%d) or -s value.\n",
+                VO_PERF_SAMPLE_COUNT);
+        return 2;
+    }
+
+    if (list) {
+        for (int s = 0; s < MP_ARRAY_SIZE(sources); s++) {
+            for (int p = 0; p < MP_ARRAY_SIZE(profiles); p++)
+                printf("%s/%s\n", sources[s].name, profiles[p].name);
+        }
+        talloc_free(filters);
+        return 0;
+    }
+
+    struct bench_env *env = bench_env_create();
+    struct gpu_ctx *gpu = gpu_init(env);
+    if (!gpu) {
+        bench_env_destroy(env);
+        talloc_free(filters);
+        return 1;
+    }
+
+    printf("output %dx%d, %d fps video on %d Hz display\n", out_w, out_h,
+           SOURCE_FPS, DISPLAY_FPS);
+    printf("  %-7s %-40s %10s %10s %8s\n", "frame", "pass", "avg us",
+           "peak us", "samples");
+    for (int s = 0; s < MP_ARRAY_SIZE(sources); s++) {
+        for (int p = 0; p < MP_ARRAY_SIZE(profiles); p++) {
+            char *name = talloc_asprintf(NULL, "%s/%s", sources[s].name,
+                                         profiles[p].name);
+            if (match_name(name, filters, num_filters)) {
+                run_case(env, gpu, &sources[s], &profiles[p], out_w, out_h,
+                         renders);
+            }
+            talloc_free(name);
+        }
+    }
+
+    gpu_uninit(gpu);
+    bench_env_destroy(env);
+    talloc_free(filters);
+    return 0;
+}
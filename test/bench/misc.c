@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "common/common.h"
+#include "libmpv/client.h"
+#include "misc/bstr.h"
+#include "misc/json.h"
+#include "misc/ring.h"
+#include "mpv_talloc.h"
+#include "options/m_config.h"
+#include "video/out/bitmap_packer.h"
+
+// --- json_parse()
+
+struct json_priv {
+    const char *text;
+    int len;
+    char *buf;      // json_parse() mutates its input
+    void *ta_ctx;
+};
+
+static bool setup_json(struct bench_state *st, const char *text)
+{
+    struct json_priv *p = talloc_zero(st, struct json_priv);
+    p->text = text;
+    p->len = strlen(text) + 1;
+    p->buf = talloc_size(p, p->len);
+    p->ta_ctx = talloc_new(p);
+    st->priv = p;
+    st->bytes = p->len;
+    return true;
+}
+
+// A typical IPC request.
+static bool setup_json_small(struct bench_state *st)
+{
+    return setup_json(st,
+        "{\"command\": [\"set_property\", \"pause\", true], \"request_id\": 42}");
+}
+
+// Something like a property change event for track-list.
+static bool setup_json_large(struct bench_state *st)
+{
+    char *text = talloc_strdup(st, "{\"event\":\"property-change\",\"id\":1,"
+                                   "\"name\":\"track-list\",\"data\":[");
+    for (int n = 0; n < 32; n++) {
+        text = talloc_asprintf_append(text,
+            "%s{\"id\":%d,\"type\":\"%s\",\"src-id\":%d,\"title\":\"Track "
+            "number %d\",\"lang\":\"eng\",\"albumart\":false,\"default\":%s,"
+            "\"forced\":false,\"external\":false,\"selected\":%s,"
+            "\"ff-index\":%d,\"codec\":\"%s\",\"demux-w\":1920,"
+            "\"demux-h\":1080,\"demux-fps\":23.976024,\"demux-par\":1.0}",
+            n ? "," : "", n + 1, n ? "sub" : "video", n, n + 1,
+            n < 2 ? "true" : "false", n < 2 ? "true" : "false", n,
+            n ? "subrip" : "h264");
+    }
+    text = talloc_strdup_append(text, "],\"error\":\"success\"}");
+    return setup_json(st, text);
+}
+
+static void run_json_parse(void *priv)
+{
+    struct json_priv *p = priv;
+    memcpy(p->buf, p->text, p->len);
+    char *src = p->buf;
+    struct mpv_node res;
+    if (json_parse(p->ta_ctx, &res, &src, 50) < 0)
+        abort();
+    talloc_free_children(p->ta_ctx);
+}
+
+// --- mp_ring
+
+#define RING_CHUNK 4096
+
+struct ring_priv {
+    struct mp_ring *ring;
+    unsigned char *buf;
+};
+
+static bool setup_ring(struct bench_state *st)
+{
+    struct ring_priv *p = talloc_zero(st, struct ring_priv);
+    p->ring = mp_ring_new(p, 16 * RING_CHUNK);
+    p->buf = talloc_zero_size(p, RING_CHUNK);
+    // Make the reads and writes wrap around the buffer end at some point.
+    mp_ring_write(p->ring, p->buf, RING_CHUNK / 3);
+    st->priv = p;
+    st->bytes = RING_CHUNK;
+    return true;
+}
+
+static void run_ring(void *priv)
+{
+    struct ring_priv *p = priv;
+    mp_ring_write(p->ring, p->buf, RING_CHUNK);
+    mp_ring_read(p->ring, p->buf, RING_CHUNK);
+}
+
+// --- talloc
+
+static bool setup_ta(struct bench_state *st)
+{
+    st->priv = st;
+    return true;
+}
+
+// Allocation pattern similar to building a small tree with strings.
+static void run_ta_alloc(void *priv)
+{
+    void *ctx = talloc_new(NULL);
+    for (int n = 0; n < 16; n++) {
+        char **node = talloc_zero_array(ctx, char *, 4);
+        for (int i = 0; i < 4; i++)
+            node[i] = talloc_strdup(node, "some string");
+    }
+    talloc_free(ctx);
+}
+
+static void run_ta_array_append(void *priv)
+{
+    void *ctx = talloc_new(NULL);
+    int *arr = NULL;
+    int num = 0;
+    for (int n = 0; n < 256; n++)
+        MP_TARRAY_APPEND(ctx, arr, num, n);
+    talloc_free(ctx);
+}
+
+// --- m_config_get_co_raw()
+
+struct co_priv {
+    struct m_config *config;
+    int idx;
+};
+
+static const char *const co_names[] = {
+    "vo", "pause", "volume", "sub-font-size", "video-sync", "cache",
+    "demuxer-max-bytes", "audio-file-auto", "osd-level", "hwdec",
+    "script-opts", "screenshot-format", "input-ar-delay", "keep-open",
+};
+
+static bool setup_co(struct bench_state *st)
+{
+    struct co_priv *p = talloc_zero(st, struct co_priv);
+    p->config = st->config;
+    st->priv = p;
+    return true;
+}
+
+static void run_co_raw(void *priv)
+{
+    struct co_priv *p = priv;
+    const char *name = co_names[p->idx];
+    p->idx = (p->idx + 1) % MP_ARRAY_SIZE(co_names);
+    m_config_get_co_raw(p->config, bstr0(name));
+}
+
+// --- bitmap_packer
+
+#define PACKER_RECTS 200
+
+struct packer_priv {
+    struct bitmap_packer *packer;
+    struct inc_packer *inc;
+    struct pos sizes[PACKER_RECTS];
+    struct pos pos[PACKER_RECTS];
+};
+
+static bool setup_packer(struct bench_state *st)
+{
+    struct packer_priv *p = talloc_zero(st, struct packer_priv);
+    p->packer = talloc_zero(p, struct bitmap_packer);
+    p->packer->w_max = p->packer->h_max = 4096;
+    // Glyph-like sizes (deterministic pseudo random numbers).
+    unsigned int r = 1;
+    for (int n = 0; n < PACKER_RECTS; n++) {
+        r = r * 1103515245 + 12345;
+        p->sizes[n] = (struct pos){8 + (r >> 16) % 40, 20 + (r >> 8) % 24};
+    }
+    p->inc = talloc_zero(p, struct inc_packer);
+    *p->inc = (struct inc_packer){.w = 1024, .h = 1024, .padding = 1};
+    inc_packer_reset(p->inc);
+    st->priv = p;
+    return true;
+}
+
+static void run_packer(void *priv)
+{
+    struct packer_priv *p = priv;
+    struct bitmap_packer *packer = p->packer;
+    packer_reset(packer);
+    packer_set_size(packer, PACKER_RECTS);
+    packer->padding = 1;
+    memcpy(packer->in, p->sizes, sizeof(p->sizes));
+    if (packer_pack(packer) < 0)
+        abort();
+}
+
+static void run_inc_packer(void *priv)
+{
+    struct packer_priv *p = priv;
+    for (int n = 0; n < PACKER_RECTS; n++) {
+        struct pos size = p->sizes[n];
+        if (!inc_packer_insert(p->inc, size.x, size.y, &p->pos[n]))
+            abort();
+    }
+    // Remove every other one, and insert them again (fragmentation).
+    for (int n = 0; n < PACKER_RECTS; n += 2)
+        inc_packer_remove(p->inc, p->pos[n], p->sizes[n].x, p->sizes[n].y);
+    for (int n = 0; n < PACKER_RECTS; n += 2) {
+        struct pos size = p->sizes[n];
+        if (!inc_packer_insert(p->inc, size.x, size.y, &p->pos[n]))
+            abort();
+    }
+    inc_packer_reset(p->inc);
+}
+
+const struct bench bench_misc[] = {
+    {"json_parse-small", setup_json_small, run_json_parse},
+    {"json_parse-large", setup_json_large, run_json_parse},
+    {"mp_ring-write-read", setup_ring, run_ring},
+    {"ta-alloc-tree", setup_ta, run_ta_alloc},
+    {"ta-array-append", setup_ta, run_ta_array_append},
+    {"m_config_get_co_raw", setup_co, run_co_raw},
+    {"bitmap_packer-pack", setup_packer, run_packer},
+    {"inc_packer-insert-remove", setup_packer, run_inc_packer},
+    {0}
+};
@@ -0,0 +1,160 @@
+#include <libswscale/swscale.h>
+
+#include "bench.h"
+
+#include "mpv_talloc.h"
+#include "sub/draw_bmp.h"
+#include "sub/osd.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+// --- mp_draw_sub_bitmaps()
+
+#define GLYPHS 60
+#define GLYPH_W 28
+#define GLYPH_H 40
+
+struct draw_priv {
+    struct mp_image *dst;
+    struct sub_bitmaps sbs;
+    struct mp_draw_sub_cache *cache;
+};
+
+static struct mp_image *alloc_test_image(void *ta_parent, int imgfmt,
+                                         int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(imgfmt, w, h);
+    if (!img)
+        return NULL;
+    mp_image_params_guess_csp(&img->params);
+    mp_image_clear(img, 0, 0, w, h);
+    return talloc_steal(ta_parent, img);
+}
+
+static void run_draw(void *priv)
+{
+    struct draw_priv *p = priv;
+    mp_draw_sub_bitmaps(&p->cache, p->dst, &p->sbs);
+}
+
+static void init_draw_cache(struct draw_priv *p)
+{
+    // The cache is allocated on first use, without talloc parent.
+    run_draw(p);
+    talloc_steal(p, p->cache);
+}
+
+// One line of text, as rendered by libass (one bitmap per glyph).
+static bool setup_draw_ass(struct bench_state *st)
+{
+    struct draw_priv *p = talloc_zero(st, struct draw_priv);
+    p->dst = alloc_test_image(p, IMGFMT_420P, 1920, 1080);
+    if (!p->dst)
+        return false;
+    uint8_t *bitmap = talloc_size(p, GLYPH_W * GLYPH_H);
+    for (int y = 0; y < GLYPH_H; y++) {
+        for (int x = 0; x < GLYPH_W; x++)
+            bitmap[y * GLYPH_W + x] = (x * 37 + y * 11) & 0xFF;
+    }
+    p->sbs = (struct sub_bitmaps){
+        .format = SUBBITMAP_LIBASS,
+        .parts = talloc_zero_array(p, struct sub_bitmap, GLYPHS),
+        .num_parts = GLYPHS,
+        .change_id = 1,
+    };
+    for (int n = 0; n < GLYPHS; n++) {
+        p->sbs.parts[n] = (struct sub_bitmap){
+            .bitmap = bitmap,
+            .stride = GLYPH_W,
+            .w = GLYPH_W, .h = GLYPH_H,
+            .dw = GLYPH_W, .dh = GLYPH_H,
+            .x = 60 + n * (GLYPH_W + 2), .y = 950,
+            .libass.color = 0xFFFFFF00,
+        };
+    }
+    init_draw_cache(p);
+    st->priv = p;
+    st->bytes = GLYPHS * GLYPH_W * GLYPH_H;
+    return true;
+}
+
+// A large RGBA bitmap, like a rendered OSC.
+static bool setup_draw_rgba(struct bench_state *st)
+{
+    struct draw_priv *p = talloc_zero(st, struct draw_priv);
+    p->dst = alloc_test_image(p, IMGFMT_420P, 1920, 1080);
+    struct mp_image *src = alloc_test_image(p, IMGFMT_BGRA, 1280, 200);
+    if (!p->dst || !src)
+        return false;
+    for (int y = 0; y < src->h; y++) {
+        uint32_t *line = (uint32_t *)(src->planes[0] + y * src->stride[0]);
+        for (int x = 0; x < src->w; x++) {
+            unsigned a = (x + y) & 0xFF, c = a / 2;
+            line[x] = (a << 24) | (c << 16) | (c << 8) | c; // premultiplied
+        }
+    }
+    p->sbs = (struct sub_bitmaps){
+        .format = SUBBITMAP_RGBA,
+        .parts = talloc_zero(p, struct sub_bitmap),
+        .num_parts = 1,
+        .change_id = 1,
+    };
+    p->sbs.parts[0] = (struct sub_bitmap){
+        .bitmap = src->planes[0],
+        .stride = src->stride[0],
+        .w = src->w, .h = src->h,
+        .dw = src->w, .dh = src->h,
+        .x = 320, .y = 860,
+    };
+    init_draw_cache(p);
+    st->priv = p;
+    st->bytes = src->w * src->h * 4;
+    return true;
+}
+
+// --- mp_image_swscale()
+
+struct sws_priv {
+    struct mp_image *src, *dst;
+};
+
+static bool setup_sws(struct bench_state *st, int dst_fmt, int w, int h)
+{
+    struct sws_priv *p = talloc_zero(st, struct sws_priv);
+    p->src = alloc_test_image(p, IMGFMT_420P, 1920, 1080);
+    p->dst = alloc_test_image(p, dst_fmt, w, h);
+    if (!p->src || !p->dst)
+        return false;
+    for (int y = 0; y < p->src->h; y++) {
+        for (int x = 0; x < p->src->w; x++)
+            p->src->planes[0][y * p->src->stride[0] + x] = (x ^ y) & 0xFF;
+    }
+    st->priv = p;
+    st->bytes = 1920 * 1080 * 3 / 2;
+    return true;
+}
+
+static bool setup_sws_bgr0(struct bench_state *st)
+{
+    return setup_sws(st, IMGFMT_BGR0, 1920, 1080);
+}
+
+static bool setup_sws_downscale(struct bench_state *st)
+{
+    return setup_sws(st, IMGFMT_420P, 1280, 720);
+}
+
+static void run_sws(void *priv)
+{
+    struct sws_priv *p = priv;
+    mp_image_swscale(p->dst, p->src, SWS_BILINEAR);
+}
+
+const struct bench bench_video[] = {
+    {"draw_bmp-libass-420p", setup_draw_ass, run_draw},
+    {"draw_bmp-rgba-420p", setup_draw_rgba, run_draw},
+    {"mp_image_swscale-420p-bgr0", setup_sws_bgr0, run_sws},
+    {"mp_image_swscale-downscale", setup_sws_downscale, run_sws},
+    {0}
+};
@@ -0,0 +1,130 @@
+#include "test_helpers.h"
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "video/out/bitmap_packer.h"
+
+#define MAX_RECTS 256
+
+struct rect {
+    struct pos pos;
+    int w, h;
+};
+
+// Simple LCG, so that failures are reproducible.
+static unsigned int rand_next(unsigned int *state, unsigned int max)
+{
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) % max;
+}
+
+// The rectangle plus the padding after it must be inside the packer, and must
+// not touch the padded area of any other rectangle.
+static void check_rect(struct inc_packer *p, struct rect *rects, int num_rects,
+                       struct rect r)
+{
+    assert_true(r.pos.x >= p->padding);
+    assert_true(r.pos.y >= p->padding);
+    assert_true(r.pos.x + r.w + p->padding <= p->w);
+    assert_true(r.pos.y + r.h + p->padding <= p->h);
+
+    for (int n = 0; n < num_rects; n++) {
+        struct rect o = rects[n];
+        bool disjoint = r.pos.x + r.w + p->padding <= o.pos.x ||
+                        o.pos.x + o.w + p->padding <= r.pos.x ||
+                        r.pos.y + r.h + p->padding <= o.pos.y ||
+                        o.pos.y + o.h + p->padding <= r.pos.y;
+        assert_true(disjoint);
+    }
+}
+
+static void run_random(int w, int h, int padding, int max_size)
+{
+    struct inc_packer *p = talloc_zero(NULL, struct inc_packer);
+    *p = (struct inc_packer){.w = w, .h = h, .padding = padding};
+    inc_packer_reset(p);
+
+    struct rect rects[MAX_RECTS];
+    int num_rects = 0;
+    int num_inserted = 0;
+    unsigned int state = w ^ (h << 8) ^ (padding << 16);
+
+    for (int i = 0; i < 20000; i++) {
+        if (num_rects == MAX_RECTS || (num_rects && rand_next(&state, 3) == 0)) {
+            int n = rand_next(&state, num_rects);
+            struct rect r = rects[n];
+            inc_packer_remove(p, r.pos, r.w, r.h);
+            MP_TARRAY_REMOVE_AT(rects, num_rects, n);
+            continue;
+        }
+        struct rect r = {
+            .w = 1 + rand_next(&state, max_size),
+            .h = 1 + rand_next(&state, max_size),
+        };
+        if (!inc_packer_insert(p, r.w, r.h, &r.pos))
+            continue;
+        check_rect(p, rects, num_rects, r);
+        rects[num_rects++] = r;
+        num_inserted++;
+    }
+
+    // Make sure the test actually exercised the packer.
+    assert_true(num_inserted > 1000);
+
+    // After a reset, the whole area is available again.
+    inc_packer_reset(p);
+    struct pos pos;
+    assert_true(inc_packer_insert(p, w - 2 * padding, h - 2 * padding, &pos));
+    assert_int_equal(pos.x, padding);
+    assert_int_equal(pos.y, padding);
+    assert_false(inc_packer_insert(p, 1, 1, &pos));
+
+    talloc_free(p);
+}
+
+static void test_inc_packer_random(void **state) {
+    run_random(256, 256, 0, 40);
+}
+
+static void test_inc_packer_random_padding(void **state) {
+    run_random(256, 256, 1, 40);
+    run_random(512, 128, 2, 64);
+}
+
+static void test_inc_packer_remove_reuse(void **state) {
+    struct inc_packer *p = talloc_zero(NULL, struct inc_packer);
+    *p = (struct inc_packer){.w = 64, .h = 64, .padding = 1};
+    inc_packer_reset(p);
+
+    struct pos a, b;
+    assert_true(inc_packer_insert(p, 62, 62, &a));
+    assert_false(inc_packer_insert(p, 1, 1, &b));
+    inc_packer_remove(p, a, 62, 62);
+    assert_true(inc_packer_insert(p, 30, 62, &a));
+    assert_true(inc_packer_insert(p, 31, 62, &b));
+    assert_true(b.x >= a.x + 30 + 1 || a.x >= b.x + 31 + 1);
+
+    talloc_free(p);
+}
+
+static void test_inc_packer_invalid(void **state) {
+    struct inc_packer *p = talloc_zero(NULL, struct inc_packer);
+    *p = (struct inc_packer){.w = 64, .h = 64, .padding = 1};
+    inc_packer_reset(p);
+
+    struct pos pos;
+    assert_false(inc_packer_insert(p, 0, 10, &pos));
+    assert_false(inc_packer_insert(p, 10, 0, &pos));
+    assert_false(inc_packer_insert(p, 63, 10, &pos));
+
+    talloc_free(p);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_inc_packer_random),
+        cmocka_unit_test(test_inc_packer_random_padding),
+        cmocka_unit_test(test_inc_packer_remove_reuse),
+        cmocka_unit_test(test_inc_packer_invalid),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -24,8 +24,10 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 #include <libavutil/common.h>
 #include <libavcodec/avcodec.h>
 
@@ -599,6 +601,78 @@ void mp_get_cms_matrix(struct mp_csp_primaries src, struct mp_csp_primaries dest
     mp_mul_matrix3x3(m, tmp);
 }
 
+// Matrices which depend only on the primaries. They are constant, so they are
+// computed once for all enum mp_csp_prim values, instead of on every shader
+// (re)generation.
+struct prim_matrices {
+    float rgb2xyz[3][3];
+    float xyz2rgb[3][3];
+    // Indexed by destination primaries, MP_INTENT_RELATIVE_COLORIMETRIC.
+    float cms[MP_CSP_PRIM_COUNT][3][3];
+};
+
+static pthread_once_t prim_matrices_once = PTHREAD_ONCE_INIT;
+static struct prim_matrices prim_matrices[MP_CSP_PRIM_COUNT];
+
+static void init_prim_matrices(void)
+{
+    for (int s = 0; s < MP_CSP_PRIM_COUNT; s++) {
+        struct prim_matrices *pm = &prim_matrices[s];
+        struct mp_csp_primaries prim = mp_get_csp_primaries(s);
+        mp_get_rgb2xyz_matrix(prim, pm->rgb2xyz);
+        memcpy(pm->xyz2rgb, pm->rgb2xyz, sizeof(pm->xyz2rgb));
+        mp_invert_matrix3x3(pm->xyz2rgb);
+        for (int d = 0; d < MP_CSP_PRIM_COUNT; d++) {
+            mp_get_cms_matrix(prim, mp_get_csp_primaries(d),
+                              MP_INTENT_RELATIVE_COLORIMETRIC, pm->cms[d]);
+        }
+    }
+}
+
+static const struct prim_matrices *get_prim_matrices(enum mp_csp_prim prim)
+{
+    pthread_once(&prim_matrices_once, init_prim_matrices);
+    if (prim < 0 || prim >= MP_CSP_PRIM_COUNT)
+        prim = MP_CSP_PRIM_AUTO;
+    return &prim_matrices[prim];
+}
+
+// Same as mp_get_rgb2xyz_matrix(mp_get_csp_primaries(prim), m), but cached.
+void mp_get_csp_rgb2xyz_matrix(enum mp_csp_prim prim, float m[3][3])
+{
+    memcpy(m, get_prim_matrices(prim)->rgb2xyz, sizeof(float[3][3]));
+}
+
+// Same as mp_get_cms_matrix() with mp_get_csp_primaries() for src and dest,
+// but cached for the common intents.
+void mp_get_csp_cms_matrix(enum mp_csp_prim src, enum mp_csp_prim dest,
+                           enum mp_render_intent intent, float m[3][3])
+{
+    if (intent == MP_INTENT_PERCEPTUAL)
+        intent = MP_INTENT_RELATIVE_COLORIMETRIC;
+
+    switch (intent) {
+    case MP_INTENT_RELATIVE_COLORIMETRIC: {
+        if (dest < 0 || dest >= MP_CSP_PRIM_COUNT)
+            dest = MP_CSP_PRIM_AUTO;
+        memcpy(m, get_prim_matrices(src)->cms[dest], sizeof(float[3][3]));
+        break;
+    }
+    case MP_INTENT_ABSOLUTE_COLORIMETRIC: {
+        // RGBd<-XYZd * XYZs<-RGBs, no chromatic adaptation
+        memcpy(m, get_prim_matrices(dest)->xyz2rgb, sizeof(float[3][3]));
+        float tmp[3][3];
+        memcpy(tmp, get_prim_matrices(src)->rgb2xyz, sizeof(tmp));
+        mp_mul_matrix3x3(m, tmp);
+        break;
+    }
+    default:
+        memset(m, 0, sizeof(float[3][3]));
+        mp_get_cms_matrix(mp_get_csp_primaries(src), mp_get_csp_primaries(dest),
+                          intent, m);
+    }
+}
+
 // get the coefficients of an SMPTE 428-1 xyz -> rgb conversion matrix
 // intent = the rendering intent used to convert to the target primaries
 static void mp_get_xyz2rgb_coeffs(struct mp_csp_params *params,
@@ -606,8 +680,8 @@ static void mp_get_xyz2rgb_coeffs(struct mp_csp_params *params,
 {
     struct mp_csp_primaries prim = mp_get_csp_primaries(params->color.primaries);
     float brightness = params->brightness;
-    mp_get_rgb2xyz_matrix(prim, m->m);
-    mp_invert_matrix3x3(m->m);
+    memcpy(m->m, get_prim_matrices(params->color.primaries)->xyz2rgb,
+           sizeof(m->m));
 
     // All non-absolute mappings want to map source white to target white
     if (intent != MP_INTENT_ABSOLUTE_COLORIMETRIC) {
@@ -793,6 +867,25 @@ void mp_get_csp_matrix(struct mp_csp_params *params, struct mp_cmat *m)
     }
 }
 
+// Return whether mp_get_csp_matrix() returns the same matrix for both a and b.
+// Fields which don't influence the matrix (like gamma or the HDR metadata) are
+// ignored, so callers can use this to skip recomputing it for each frame.
+bool mp_csp_params_matrix_equal(const struct mp_csp_params *a,
+                                const struct mp_csp_params *b)
+{
+    return a->color.space == b->color.space &&
+           a->color.levels == b->color.levels &&
+           a->color.primaries == b->color.primaries &&
+           a->levels_out == b->levels_out &&
+           a->brightness == b->brightness &&
+           a->contrast == b->contrast &&
+           a->hue == b->hue &&
+           a->saturation == b->saturation &&
+           a->gray == b->gray &&
+           a->texture_bits == b->texture_bits &&
+           a->input_bits == b->input_bits;
+}
+
 // Set colorspace related fields in p from f. Don't touch other fields.
 void mp_csp_set_image_params(struct mp_csp_params *params,
                              const struct mp_image_params *imgparams)
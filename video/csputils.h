@@ -176,6 +176,8 @@ void mp_csp_set_image_params(struct mp_csp_params *params,
                              const struct mp_image_params *imgparams);
 
 bool mp_colorspace_equal(struct mp_colorspace c1, struct mp_colorspace c2);
+bool mp_csp_params_matrix_equal(const struct mp_csp_params *a,
+                                const struct mp_csp_params *b);
 
 enum mp_chroma_location {
     MP_CHROMA_AUTO,
@@ -273,6 +275,9 @@ struct mp_cmat {
 void mp_get_rgb2xyz_matrix(struct mp_csp_primaries space, float m[3][3]);
 void mp_get_cms_matrix(struct mp_csp_primaries src, struct mp_csp_primaries dest,
                        enum mp_render_intent intent, float cms_matrix[3][3]);
+void mp_get_csp_rgb2xyz_matrix(enum mp_csp_prim prim, float m[3][3]);
+void mp_get_csp_cms_matrix(enum mp_csp_prim src, enum mp_csp_prim dest,
+                           enum mp_render_intent intent, float cms_matrix[3][3]);
 
 double mp_get_csp_mul(enum mp_csp csp, int input_bits, int texture_bits);
 void mp_get_csp_matrix(struct mp_csp_params *params, struct mp_cmat *out);
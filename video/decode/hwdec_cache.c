@@ -0,0 +1,176 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+
+#include "hwdec_cache.h"
+
+// Older entries are dropped when storing a new one.
+#define MAX_ENTRIES 200
+#define MAX_FILE_SIZE (64 * 1024)
+
+// Serializes accesses to the cache file from within the process. (There can
+// be multiple decoders, e.g. with --lavfi-complex.)
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct line {
+    bstr key, method;
+    bstr text;                  // full line without newline
+};
+
+// Read all valid lines. Result is allocated in ta_parent.
+static int read_lines(void *ta_parent, const char *cache_file,
+                      struct line **lines)
+{
+    int num_lines = 0;
+    *lines = NULL;
+
+    FILE *f = fopen(cache_file, "rb");
+    if (!f)
+        return 0;
+    char *data = talloc_size(ta_parent, MAX_FILE_SIZE);
+    size_t len = fread(data, 1, MAX_FILE_SIZE, f);
+    fclose(f);
+
+    bstr buf = {data, len};
+    while (buf.len) {
+        bstr text = bstr_strip_linebreaks(bstr_getline(buf, &buf));
+        struct line line = {.text = text};
+        if (bstr_split_tok(text, " ", &line.key, &line.method) &&
+            line.key.len && line.method.len)
+            MP_TARRAY_APPEND(ta_parent, *lines, num_lines, line);
+    }
+    return num_lines;
+}
+
+// Identify the GPU, so that the cache doesn't get confused if the same config
+// dir is used on another machine, or the GPU is replaced. (The cached method
+// failing is not fatal, but would cost a probing round.)
+static void append_gpu_id(char **key)
+{
+#ifdef __linux__
+    static const char *const files[] = {
+        "/sys/class/drm/renderD128/device/vendor",
+        "/sys/class/drm/renderD128/device/device",
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(files); n++) {
+        char buf[32] = {0};
+        FILE *f = fopen(files[n], "rb");
+        if (f) {
+            if (!fgets(buf, sizeof(buf), f))
+                buf[0] = '\0';
+            fclose(f);
+        }
+        bstr id = bstr_strip(bstr0(buf));
+        *key = talloc_asprintf_append(*key, ":%.*s", BSTR_P(id));
+    }
+#endif
+}
+
+// Return the cache key for decoding the given codec (mp_codec_params.codec)
+// and profile (FF_PROFILE_*) with the given VO (NULL if none).
+char *hwdec_cache_get_key(void *ta_parent, const char *codec, int profile,
+                          const char *vo)
+{
+    char *key = talloc_asprintf(ta_parent, "%s:%d:%s", codec, profile,
+                                vo ? vo : "-");
+    append_gpu_id(&key);
+    for (char *s = key; s[0]; s++) {
+        if (s[0] == ' ' || s[0] == '\n' || s[0] == '\r')
+            s[0] = '_';
+    }
+    return key;
+}
+
+// Return the method (hwdec_info.method_name) remembered for key, or NULL.
+char *hwdec_cache_lookup(void *ta_parent, struct mp_log *log,
+                         const char *cache_file, const char *key)
+{
+    void *tmp = talloc_new(NULL);
+    char *res = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    struct line *lines;
+    int num_lines = read_lines(tmp, cache_file, &lines);
+    pthread_mutex_unlock(&cache_lock);
+
+    // Later entries are newer.
+    for (int n = num_lines - 1; n >= 0; n--) {
+        if (bstr_equals0(lines[n].key, key)) {
+            res = bstrto0(ta_parent, lines[n].method);
+            break;
+        }
+    }
+
+    if (res) {
+        mp_verbose(log, "Hwdec cache: trying %s first.\n", res);
+    } else {
+        mp_dbg(log, "Hwdec cache: no entry for %s.\n", key);
+    }
+
+    talloc_free(tmp);
+    return res;
+}
+
+// Remember the method which worked for key. Replaces previous entries for the
+// same key.
+void hwdec_cache_store(struct mp_log *log, const char *cache_file,
+                       const char *key, const char *method)
+{
+    void *tmp = talloc_new(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    struct line *lines;
+    int num_lines = read_lines(tmp, cache_file, &lines);
+
+    int keep = 0;
+    for (int n = 0; n < num_lines; n++) {
+        if (!bstr_equals0(lines[n].key, key))
+            lines[keep++] = lines[n];
+    }
+    if (!method && keep == num_lines)
+        goto done; // nothing to remove
+    int first = MPMAX(keep - (MAX_ENTRIES - 1), 0);
+
+    FILE *f = fopen(cache_file, "wb");
+    if (!f) {
+        mp_warn(log, "Hwdec cache: can't write '%s'.\n", cache_file);
+        goto done;
+    }
+    for (int n = first; n < keep; n++)
+        fprintf(f, "%.*s\n", BSTR_P(lines[n].text));
+    if (method)
+        fprintf(f, "%s %s\n", key, method);
+    fclose(f);
+
+    mp_verbose(log, "Hwdec cache: %s %s.\n", method ? "remembering" : "forgetting",
+               method ? method : key);
+
+done:
+    pthread_mutex_unlock(&cache_lock);
+    talloc_free(tmp);
+}
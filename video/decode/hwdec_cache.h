@@ -0,0 +1,35 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_HWDEC_CACHE_H
+#define MP_HWDEC_CACHE_H
+
+struct mp_log;
+
+// Remembers which hwdec method worked with --hwdec=auto, keyed by codec,
+// profile, VO and GPU. The cache file is a text file with one entry per line.
+// Thread-safe.
+
+char *hwdec_cache_get_key(void *ta_parent, const char *codec, int profile,
+                          const char *vo);
+char *hwdec_cache_lookup(void *ta_parent, struct mp_log *log,
+                         const char *cache_file, const char *key);
+// method==NULL removes the entry.
+void hwdec_cache_store(struct mp_log *log, const char *cache_file,
+                       const char *key, const char *method);
+
+#endif
@@ -32,11 +32,14 @@
 #include "common/global.h"
 #include "common/msg.h"
 #include "options/options.h"
+#include "options/path.h"
 #include "misc/bstr.h"
+#include "osdep/timer.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
 
 #include "video/fmt-conversion.h"
+#include "video/decode/hwdec_cache.h"
 
 #include "filters/f_decoder_wrapper.h"
 #include "filters/filter_internal.h"
@@ -55,6 +58,7 @@
 
 static void init_avctx(struct mp_filter *vd);
 static void uninit_avctx(struct mp_filter *vd);
+static bool decode_frame(struct mp_filter *vd);
 
 static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
@@ -68,6 +72,9 @@ static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
 // interpolation, this value has to be increased too.
 #define HWDEC_EXTRA_SURFACES 6
 
+// --vd-lavc-thread-type=adaptive decides after this many frames.
+#define ADAPTIVE_THREAD_FRAMES 30
+
 #define OPT_BASE_STRUCT struct vd_lavc_params
 
 struct vd_lavc_params {
@@ -78,12 +85,15 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int thread_type;
     int bitexact;
     int old_x264;
     int check_hw_profile;
     int software_fallback;
     char **avopts;
     int dr;
+    int reuse;
+    int64_t pool_max_bytes;
 };
 
 static const struct m_opt_choice_alternatives discard_names[] = {
@@ -108,6 +118,8 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INT("threads", threads, M_OPT_MIN, .min = 0),
+        OPT_CHOICE("thread-type", thread_type, 0,
+                   ({"auto", 0}, {"frame", 1}, {"slice", 2}, {"adaptive", 3})),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("assume-old-x264", old_x264, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
@@ -115,6 +127,8 @@ const struct m_sub_options vd_lavc_conf = {
                           ({"no", INT_MAX}, {"yes", 1})),
         OPT_KEYVALUELIST("o", avopts, 0),
         OPT_FLAG("dr", dr, 0),
+        OPT_FLAG("reuse", reuse, 0),
+        OPT_BYTE_SIZE("pool-max-bytes", pool_max_bytes, 0, 0, INT64_MAX / 2),
         {0}
     },
     .size = sizeof(struct vd_lavc_params),
@@ -161,6 +175,10 @@ typedef struct lavc_ctx {
     bool hwdec_requested;
     bool hwdec_failed;
     bool hwdec_notified;
+    // --hwdec-probe-cache path and key, if used
+    char *hwdec_cache_file;
+    char *hwdec_cache_key;
+    bool hwdec_cached;      // the hwdec in use was taken from the cache
 
     bool intra_only;
     int framedrop_flags;
@@ -190,6 +208,22 @@ typedef struct lavc_ctx {
 
     AVBufferRef *cached_hw_frames_ctx;
 
+    // Describes the settings avctx was opened with, if it can be reused.
+    char *reuse_key;
+
+    // FF_THREAD_* flags to request, 0 for the libavcodec default.
+    int thread_type;
+    int adaptive_frames;        // frames decoded while deciding (or -1)
+    bool switch_to_frame_threads; // on the next keyframe
+
+    // Statistics (VDCTRL_GET_STATS).
+    double frame_time;          // average, in seconds
+    int64_t cur_frame_time;     // time spent in libavcodec for the next frame
+    int64_t busy_time;          // time spent in libavcodec since load_start
+    int64_t load_start;
+    double load;
+    int queued_frames;          // sent packets without frame yet
+
     // --- The following fields are protected by dr_lock.
     pthread_mutex_t dr_lock;
     bool dr_failed;
@@ -418,6 +452,10 @@ static void select_and_set_hwdec(struct mp_filter *vd)
     bool hwdec_auto_copy = bstr_equals0(opt, "auto-copy");
     bool hwdec_auto = hwdec_auto_all || hwdec_auto_copy;
 
+    TA_FREEP(&ctx->hwdec_cache_file);
+    TA_FREEP(&ctx->hwdec_cache_key);
+    ctx->hwdec_cached = false;
+
     if (!hwdec_requested) {
         MP_VERBOSE(vd, "No hardware decoding requested.\n");
     } else if (!hwdec_codec_allowed(vd, codec)) {
@@ -430,6 +468,33 @@ static void select_and_set_hwdec(struct mp_filter *vd)
 
         ctx->hwdec_requested = true;
 
+        // Try the method which worked last time first. If it fails, the
+        // others are probed in the normal order.
+        char *cached = NULL;
+        if (hwdec_auto && ctx->opts->hwdec_probe_cache &&
+            ctx->opts->hwdec_probe_cache[0])
+        {
+            struct AVCodecParameters *par = ctx->codec->lav_codecpar;
+            ctx->hwdec_cache_file = mp_get_user_path(ctx, vd->global,
+                                                     ctx->opts->hwdec_probe_cache);
+            ctx->hwdec_cache_key = hwdec_cache_get_key(ctx, codec,
+                par ? par->profile : FF_PROFILE_UNKNOWN,
+                ctx->vo ? ctx->vo->driver->name : NULL);
+            cached = hwdec_cache_lookup(ctx, vd->log, ctx->hwdec_cache_file,
+                                        ctx->hwdec_cache_key);
+        }
+        for (int n = 0; cached && n < num_hwdecs; n++) {
+            struct hwdec_info hwdec = hwdecs[n];
+            const char *hw_codec = mp_codec_from_av_codec_id(hwdec.codec->id);
+            if (hw_codec && strcmp(hw_codec, codec) == 0 &&
+                strcmp(hwdec.method_name, cached) == 0)
+            {
+                MP_TARRAY_REMOVE_AT(hwdecs, num_hwdecs, n);
+                MP_TARRAY_INSERT_AT(NULL, hwdecs, num_hwdecs, 0, hwdec);
+                break;
+            }
+        }
+
         for (int n = 0; n < num_hwdecs; n++) {
             struct hwdec_info *hwdec = &hwdecs[n];
 
@@ -479,6 +544,10 @@ static void select_and_set_hwdec(struct mp_filter *vd)
 
         talloc_free(hwdecs);
 
+        ctx->hwdec_cached = cached && ctx->use_hwdec &&
+                            strcmp(ctx->hwdec.method_name, cached) == 0;
+        talloc_free(cached);
+
         if (!ctx->use_hwdec)
             MP_VERBOSE(vd, "No hardware decoding available for this codec.\n");
     }
@@ -516,11 +585,149 @@ int hwdec_validate_opt(struct mp_log *log, const m_option_t *opt,
     return 0;
 }
 
+// A software decoder that was closed with --vd-lavc-reuse, kept open for the
+// next file. Only one is kept (per process), since each can own many threads.
+struct cached_avctx {
+    AVCodecContext *avctx;
+    AVCodecParameters *par;     // what the avctx was opened with
+    char *key;                  // vd_ffmpeg_ctx.reuse_key
+    enum AVDiscard skip_frame;
+};
+
+static pthread_mutex_t cached_avctx_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cached_avctx *cached_avctx;
+
+static void free_cached_avctx(struct cached_avctx *c)
+{
+    if (c) {
+        avcodec_free_context(&c->avctx);
+        avcodec_parameters_free(&c->par);
+        talloc_free(c);
+    }
+}
+
+// Everything that matters for avcodec_open2() and the avctx fields set before.
+static char *get_reuse_key(void *ta_ctx, struct mp_filter *vd,
+                           const AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct vd_lavc_params *p = ctx->opts->vd_lavc_params;
+    char *key = talloc_asprintf(ta_ctx, "%s %d %d %d %d %d %d %d %d %d %d %d",
+        codec->name, p->threads, ctx->thread_type, p->fast, p->show_all,
+        p->skip_loop_filter,
+        p->skip_idct, p->skip_frame, p->bitexact, p->old_x264,
+        ctx->vo && p->dr, ctx->opts->image_hugepages);
+    for (int n = 0; p->avopts && p->avopts[n]; n++)
+        key = talloc_asprintf_append(key, " %s", p->avopts[n]);
+    return key;
+}
+
+static bool codec_params_equal(AVCodecParameters *a, AVCodecParameters *b)
+{
+    return a->codec_type == b->codec_type &&
+           a->codec_id == b->codec_id &&
+           a->codec_tag == b->codec_tag &&
+           a->extradata_size == b->extradata_size &&
+           (!a->extradata_size ||
+            memcmp(a->extradata, b->extradata, a->extradata_size) == 0) &&
+           a->format == b->format &&
+           a->bits_per_coded_sample == b->bits_per_coded_sample &&
+           a->bits_per_raw_sample == b->bits_per_raw_sample &&
+           a->profile == b->profile &&
+           a->level == b->level &&
+           a->width == b->width &&
+           a->height == b->height &&
+           av_cmp_q(a->sample_aspect_ratio, b->sample_aspect_ratio) == 0 &&
+           a->field_order == b->field_order &&
+           a->color_range == b->color_range &&
+           a->color_primaries == b->color_primaries &&
+           a->color_trc == b->color_trc &&
+           a->color_space == b->color_space &&
+           a->chroma_location == b->chroma_location &&
+           a->video_delay == b->video_delay;
+}
+
+// Take the cached decoder, if it was opened with the same parameters as this
+// one would be.
+static AVCodecContext *get_cached_avctx(struct mp_filter *vd,
+                                        const AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *avctx = NULL;
+
+    AVCodecParameters *par = mp_codec_params_to_av(ctx->codec);
+    if (!par)
+        return NULL;
+
+    pthread_mutex_lock(&cached_avctx_lock);
+    struct cached_avctx *c = cached_avctx;
+    cached_avctx = NULL;
+    pthread_mutex_unlock(&cached_avctx_lock);
+
+    if (c && c->avctx->codec == codec && strcmp(c->key, ctx->reuse_key) == 0 &&
+        codec_params_equal(c->par, par))
+    {
+        avctx = c->avctx;
+        c->avctx = NULL;
+        avctx->skip_frame = c->skip_frame;
+        MP_VERBOSE(vd, "Reusing decoder of the previous file.\n");
+    }
+
+    // A non-matching decoder is unlikely to become useful later.
+    free_cached_avctx(c);
+    avcodec_parameters_free(&par);
+    return avctx;
+}
+
+// Keep the decoder open for the next file instead of freeing it.
+static void cache_avctx(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (!ctx->reuse_key || !ctx->avctx || !avcodec_is_open(ctx->avctx))
+        return;
+
+    struct cached_avctx *c = talloc_zero(NULL, struct cached_avctx);
+    c->par = mp_codec_params_to_av(ctx->codec);
+    if (!c->par) {
+        talloc_free(c);
+        return;
+    }
+    avcodec_flush_buffers(ctx->avctx);
+    c->avctx = ctx->avctx;
+    c->key = talloc_steal(c, ctx->reuse_key);
+    c->skip_frame = ctx->skip_frame;
+    ctx->avctx = NULL;
+    ctx->reuse_key = NULL;
+
+    pthread_mutex_lock(&cached_avctx_lock);
+    struct cached_avctx *old = cached_avctx;
+    cached_avctx = c;
+    pthread_mutex_unlock(&cached_avctx_lock);
+
+    free_cached_avctx(old);
+}
+
+void vd_lavc_free_cached_decoder(void)
+{
+    pthread_mutex_lock(&cached_avctx_lock);
+    struct cached_avctx *c = cached_avctx;
+    cached_avctx = NULL;
+    pthread_mutex_unlock(&cached_avctx_lock);
+
+    free_cached_avctx(c);
+}
+
 static void force_fallback(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
 
     uninit_avctx(vd);
+    if (ctx->hwdec_cached) {
+        hwdec_cache_store(vd->log, ctx->hwdec_cache_file, ctx->hwdec_cache_key,
+                          NULL);
+        ctx->hwdec_cached = false;
+    }
     int lev = ctx->hwdec_notified ? MSGL_WARN : MSGL_V;
     mp_msg(vd->log, lev, "Falling back to software decoding.\n");
     init_avctx(vd);
@@ -540,6 +747,48 @@ static void reinit(struct mp_filter *vd)
         force_fallback(vd);
 }
 
+// Sometimes, the first packet contains information required for correct
+// decoding of the rest of the stream. The only currently known case is the
+// x264 build number (encoded in a SEI element), needed to enable a
+// workaround for broken 4:4:4 streams produced by older x264 versions.
+static void decode_first_packet(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct mp_codec_params *c = ctx->codec;
+
+    if (ctx->avctx->codec_id == AV_CODEC_ID_H264 && c->first_packet) {
+        AVPacket avpkt;
+        mp_set_av_packet(&avpkt, c->first_packet, &ctx->codec_timebase);
+        avcodec_send_packet(ctx->avctx, &avpkt);
+        avcodec_receive_frame(ctx->avctx, ctx->pic);
+        av_frame_unref(ctx->pic);
+        avcodec_flush_buffers(ctx->avctx);
+    }
+}
+
+// Set up a decoder returned by get_cached_avctx(). It was flushed already, and
+// only the fields which refer to the previous file need to be updated.
+static bool init_cached_avctx(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *avctx = ctx->avctx;
+
+#if LIBAVCODEC_VERSION_MICRO >= 100
+    avctx->pkt_timebase = ctx->codec_timebase;
+#endif
+    if (avctx->get_buffer2 == get_buffer2_direct)
+        avctx->opaque = vd;
+
+    ctx->pic = av_frame_alloc();
+    if (!ctx->pic)
+        return false;
+
+    ctx->skip_frame = avctx->skip_frame;
+
+    decode_first_packet(vd);
+    return true;
+}
+
 static void init_avctx(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -569,6 +818,24 @@ static void init_avctx(struct mp_filter *vd)
 
     ctx->hwdec_failed = false;
     ctx->hwdec_request_reinit = false;
+    ctx->adaptive_frames = lavc_param->thread_type == 3 ? 0 : -1;
+    ctx->switch_to_frame_threads = false;
+    ctx->frame_time = 0;
+    ctx->cur_frame_time = 0;
+    ctx->busy_time = 0;
+    ctx->load_start = mp_time_us();
+    ctx->load = 0;
+
+    if (!ctx->use_hwdec && lavc_param->reuse) {
+        ctx->reuse_key = get_reuse_key(ctx, vd, lavc_codec);
+        ctx->avctx = get_cached_avctx(vd, lavc_codec);
+        if (ctx->avctx) {
+            if (!init_cached_avctx(vd))
+                goto error;
+            return;
+        }
+    }
+
     ctx->avctx = avcodec_alloc_context3(lavc_codec);
     AVCodecContext *avctx = ctx->avctx;
     if (!ctx->avctx)
@@ -611,9 +878,19 @@ static void init_avctx(struct mp_filter *vd)
         ctx->hw_probing = true;
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        int type = ctx->thread_type;
+        if (type == FF_THREAD_SLICE && lavc_param->thread_type == 3 &&
+            !(lavc_codec->capabilities & AV_CODEC_CAP_SLICE_THREADS))
+            type = FF_THREAD_FRAME;
+        if (type)
+            avctx->thread_type = type;
     }
 
-    if (!ctx->use_hwdec && ctx->vo && lavc_param->dr) {
+    // With --image-hugepages, the DR code path is used to allocate the frames
+    // ourselves if there is no VO to allocate them.
+    if (!ctx->use_hwdec && ((ctx->vo && lavc_param->dr) ||
+                            ctx->opts->image_hugepages))
+    {
         avctx->opaque = vd;
         avctx->get_buffer2 = get_buffer2_direct;
         avctx->thread_safe_callbacks = 1;
@@ -646,18 +923,7 @@ static void init_avctx(struct mp_filter *vd)
     if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
         goto error;
 
-    // Sometimes, the first packet contains information required for correct
-    // decoding of the rest of the stream. The only currently known case is the
-    // x264 build number (encoded in a SEI element), needed to enable a
-    // workaround for broken 4:4:4 streams produced by older x264 versions.
-    if (lavc_codec->id == AV_CODEC_ID_H264 && c->first_packet) {
-        AVPacket avpkt;
-        mp_set_av_packet(&avpkt, c->first_packet, &ctx->codec_timebase);
-        avcodec_send_packet(avctx, &avpkt);
-        avcodec_receive_frame(avctx, ctx->pic);
-        av_frame_unref(ctx->pic);
-        avcodec_flush_buffers(ctx->avctx);
-    }
+    decode_first_packet(vd);
 
     return;
 
@@ -674,6 +940,8 @@ static void reset_avctx(struct mp_filter *vd)
         avcodec_flush_buffers(ctx->avctx);
     ctx->flushing = false;
     ctx->hwdec_request_reinit = false;
+    ctx->cur_frame_time = 0;
+    ctx->queued_frames = 0;
 }
 
 static void flush_all(struct mp_filter *vd)
@@ -701,9 +969,10 @@ static void uninit_avctx(struct mp_filter *vd)
 
     flush_all(vd);
     av_frame_free(&ctx->pic);
-    av_buffer_unref(&ctx->cached_hw_frames_ctx);
 
     avcodec_free_context(&ctx->avctx);
+    hwdec_devices_release_frames(ctx->hwdec_devs, &ctx->cached_hw_frames_ctx);
+    TA_FREEP(&ctx->reuse_key);
 
     av_buffer_unref(&ctx->hwdec_dev);
 
@@ -760,17 +1029,19 @@ static int init_generic_hwaccel(struct mp_filter *vd, enum AVPixelFormat hw_fmt)
             new_fctx->width             != old_fctx->width ||
             new_fctx->height            != old_fctx->height ||
             new_fctx->initial_pool_size != old_fctx->initial_pool_size)
-            av_buffer_unref(&ctx->cached_hw_frames_ctx);
+            hwdec_devices_release_frames(ctx->hwdec_devs,
+                                         &ctx->cached_hw_frames_ctx);
     }
 
+    // If not, the device might still have a pool from an earlier decoder,
+    // e.g. from before a resolution switch.
     if (!ctx->cached_hw_frames_ctx) {
-        if (av_hwframe_ctx_init(new_frames_ctx) < 0) {
+        ctx->cached_hw_frames_ctx =
+            hwdec_devices_acquire_frames(ctx->hwdec_devs, new_frames_ctx);
+        if (!ctx->cached_hw_frames_ctx) {
             MP_ERR(ctx, "Failed to allocate hw frames.\n");
             goto error;
         }
-
-        ctx->cached_hw_frames_ctx = new_frames_ctx;
-        new_frames_ctx = NULL;
     }
 
     ctx->avctx->hw_frames_ctx = av_buffer_ref(ctx->cached_hw_frames_ctx);
@@ -782,7 +1053,7 @@ static int init_generic_hwaccel(struct mp_filter *vd, enum AVPixelFormat hw_fmt)
 
 error:
     av_buffer_unref(&new_frames_ctx);
-    av_buffer_unref(&ctx->cached_hw_frames_ctx);
+    hwdec_devices_release_frames(ctx->hwdec_devs, &ctx->cached_hw_frames_ctx);
     return -1;
 }
 
@@ -852,11 +1123,14 @@ static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
         goto fallback;
 
     // (For simplicity, we realloc on any parameter change, instead of trying
-    // to be clever.)
+    // to be clever. With a pool size limit, the pool keeps images of other
+    // sizes and formats itself, so only alignment changes need a realloc.)
     if (stride_align != p->dr_stride_align || w != p->dr_w || h != p->dr_h ||
         imgfmt != p->dr_imgfmt)
     {
-        mp_image_pool_clear(p->dr_pool);
+        if (stride_align != p->dr_stride_align ||
+            !p->opts->vd_lavc_params->pool_max_bytes)
+            mp_image_pool_clear(p->dr_pool);
         p->dr_imgfmt = imgfmt;
         p->dr_w = w;
         p->dr_h = h;
@@ -868,7 +1142,17 @@ static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
     struct mp_image *img = mp_image_pool_get_no_alloc(p->dr_pool, imgfmt, w, h);
     if (!img) {
         MP_DBG(p, "Allocating new DR image...\n");
-        img = vo_get_image(p->vo, imgfmt, w, h, stride_align);
+        if (p->vo && p->opts->vd_lavc_params->dr) {
+            img = vo_get_image(p->vo, imgfmt, w, h, stride_align);
+        } else {
+            img = mp_image_alloc_hugepages(imgfmt, w, h, stride_align,
+                                           p->opts->image_hugepages);
+            // This is expected for small frames; don't disable DR for them.
+            if (!img) {
+                pthread_mutex_unlock(&p->dr_lock);
+                return avcodec_default_get_buffer2(avctx, pic, flags);
+            }
+        }
         if (!img) {
             MP_DBG(p, "...failed..\n");
             goto fallback;
@@ -948,11 +1232,90 @@ static void handle_err(struct mp_filter *vd)
     }
 }
 
+static void add_busy_time(struct mp_filter *vd, int64_t start)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    int64_t now = mp_time_us();
+    ctx->cur_frame_time += now - start;
+    ctx->busy_time += now - start;
+    if (now - ctx->load_start >= 1000000) {
+        ctx->load = ctx->busy_time / (double)(now - ctx->load_start);
+        ctx->busy_time = 0;
+        ctx->load_start = now;
+    }
+}
+
+static void update_frame_stats(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    double t = ctx->cur_frame_time / 1e6;
+    ctx->frame_time = ctx->frame_time ? ctx->frame_time * 0.9 + t * 0.1 : t;
+    ctx->cur_frame_time = 0;
+    ctx->queued_frames = MPMAX(ctx->queued_frames - 1, 0);
+
+    // With --vd-lavc-thread-type=adaptive, decoding starts with slice threads,
+    // which add no latency. Switch to frame threads if that is too slow.
+    if (ctx->adaptive_frames < 0)
+        return;
+    if (ctx->avctx->active_thread_type != FF_THREAD_SLICE) {
+        ctx->adaptive_frames = -1;
+        return;
+    }
+    if (++ctx->adaptive_frames < ADAPTIVE_THREAD_FRAMES)
+        return;
+    ctx->adaptive_frames = -1;
+    double fps = ctx->codec->fps > 0 ? ctx->codec->fps : 25;
+    MP_VERBOSE(vd, "Slice threading: %f ms per frame.\n", ctx->frame_time * 1e3);
+    if (ctx->frame_time > 0.8 / fps)
+        ctx->switch_to_frame_threads = true;
+}
+
+// Reopen the decoder with frame threading. Call this before sending a
+// keyframe. The frames still buffered in the old decoder are output first.
+static void switch_to_frame_threads(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    MP_VERBOSE(vd, "Switching to frame threading.\n");
+    ctx->switch_to_frame_threads = false;
+
+    // Drain the old decoder. decode_frame() keeps returning true without
+    // output if decoding can't continue (e.g. after a hwdec failure), so stop
+    // as soon as no new frame is returned.
+    avcodec_send_packet(ctx->avctx, NULL);
+    while (1) {
+        int num_queue = ctx->num_delay_queue;
+        if (!decode_frame(vd) || ctx->num_delay_queue == num_queue)
+            break;
+    }
+
+    struct mp_image **queue = ctx->delay_queue;
+    int num_queue = ctx->num_delay_queue;
+    ctx->delay_queue = NULL;
+    ctx->num_delay_queue = 0;
+
+    uninit_avctx(vd);
+    ctx->thread_type = FF_THREAD_FRAME;
+    init_avctx(vd);
+    // Don't start deciding again.
+    ctx->adaptive_frames = -1;
+
+    ctx->delay_queue = queue;
+    ctx->num_delay_queue = num_queue;
+}
+
 static bool do_send_packet(struct mp_filter *vd, struct demux_packet *pkt)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
     AVCodecContext *avctx = ctx->avctx;
 
+    if (ctx->switch_to_frame_threads && pkt && pkt->keyframe) {
+        switch_to_frame_threads(vd);
+        avctx = ctx->avctx;
+    }
+
     if (!prepare_decoding(vd))
         return false;
 
@@ -962,10 +1325,15 @@ static bool do_send_packet(struct mp_filter *vd, struct demux_packet *pkt)
     AVPacket avpkt;
     mp_set_av_packet(&avpkt, pkt, &ctx->codec_timebase);
 
+    int64_t start = mp_time_us();
     int ret = avcodec_send_packet(avctx, pkt ? &avpkt : NULL);
+    add_busy_time(vd, start);
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
         return false;
 
+    if (pkt && ret >= 0)
+        ctx->queued_frames += 1;
+
     if (ctx->hw_probing && ctx->num_sent_packets < 32) {
         pkt = pkt ? demux_copy_packet(pkt) : NULL;
         MP_TARRAY_APPEND(ctx, ctx->sent_packets, ctx->num_sent_packets, pkt);
@@ -1006,7 +1374,9 @@ static bool decode_frame(struct mp_filter *vd)
     if (!prepare_decoding(vd))
         return true;
 
+    int64_t start = mp_time_us();
     int ret = avcodec_receive_frame(avctx, ctx->pic);
+    add_busy_time(vd, start);
     if (ret == AVERROR_EOF) {
         // If flushing was initialized earlier and has ended now, make it start
         // over in case we get new packets at some point in the future. This
@@ -1024,6 +1394,8 @@ static bool decode_frame(struct mp_filter *vd)
 
     ctx->hwdec_fail_count = 0;
 
+    update_frame_stats(vd);
+
     struct mp_image *mpi = mp_image_from_av_frame(ctx->pic);
     if (!mpi) {
         av_frame_unref(ctx->pic);
@@ -1095,6 +1467,11 @@ static bool receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         if (ctx->use_hwdec) {
             MP_INFO(vd, "Using hardware decoding (%s).\n",
                     ctx->hwdec.method_name);
+            if (ctx->hwdec_cache_key && !ctx->hwdec_cached) {
+                hwdec_cache_store(vd->log, ctx->hwdec_cache_file,
+                                  ctx->hwdec_cache_key, ctx->hwdec.method_name);
+                ctx->hwdec_cached = true;
+            }
         } else {
             MP_VERBOSE(vd, "Using software decoding.\n");
         }
@@ -1141,6 +1518,32 @@ static int control(struct mp_filter *vd, enum dec_ctrl cmd, void *arg)
     case VDCTRL_REINIT:
         reinit(vd);
         return CONTROL_TRUE;
+    case VDCTRL_TRIM_MEMORY:
+        // Images still referenced by the decoder are freed once released.
+        mp_image_pool_trim(ctx->dr_pool);
+        mp_image_pool_trim(ctx->hwdec_swpool);
+        return CONTROL_TRUE;
+    case VDCTRL_GET_STATS: {
+        AVCodecContext *avctx = ctx->avctx;
+        if (!avctx)
+            break;
+        struct mp_decoder_stats *st = arg;
+        *st = (struct mp_decoder_stats){
+            .frame_time = ctx->frame_time,
+            .load = ctx->load,
+            .threads = avctx->thread_count,
+            // Frames skipped by the decoder are never returned, so this is
+            // only an estimate for queued_frames.
+            .queued_frames = MPMIN(ctx->queued_frames,
+                                   avctx->thread_count + avctx->has_b_frames) +
+                             ctx->num_delay_queue,
+        };
+        if (avctx->active_thread_type == FF_THREAD_FRAME)
+            st->thread_type = "frame";
+        if (avctx->active_thread_type == FF_THREAD_SLICE)
+            st->thread_type = "slice";
+        return CONTROL_TRUE;
+    }
     }
     return CONTROL_UNKNOWN;
 }
@@ -1166,6 +1569,8 @@ static void destroy(struct mp_filter *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
 
+    flush_all(vd);
+    cache_avctx(vd);
     uninit_avctx(vd);
 
     pthread_mutex_destroy(&ctx->dr_lock);
@@ -1198,7 +1603,17 @@ static struct mp_decoder *create(struct mp_filter *parent,
     ctx->codec = codec;
     ctx->decoder = talloc_strdup(ctx, decoder);
     ctx->hwdec_swpool = mp_image_pool_new(ctx);
+    mp_image_pool_set_copy_threads(ctx->hwdec_swpool,
+                                   ctx->opts->hwdec_copy_threads);
+    mp_image_pool_set_hugepages(ctx->hwdec_swpool, ctx->opts->image_hugepages);
     ctx->dr_pool = mp_image_pool_new(ctx);
+    int64_t pool_max_bytes = ctx->opts->vd_lavc_params->pool_max_bytes;
+    mp_image_pool_set_max_bytes(ctx->hwdec_swpool, pool_max_bytes);
+    mp_image_pool_set_max_bytes(ctx->dr_pool, pool_max_bytes);
+
+    static const int thread_types[] = {0, FF_THREAD_FRAME, FF_THREAD_SLICE,
+                                       FF_THREAD_SLICE};
+    ctx->thread_type = thread_types[ctx->opts->vd_lavc_params->thread_type];
 
     ctx->public.f = vd;
     ctx->public.control = control;
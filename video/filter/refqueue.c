@@ -43,14 +43,30 @@ struct mp_refqueue {
     bool second_field; // current frame has to output a second field yet
     bool eof;
 
-    // Queue of input frames, used to determine past/current/future frames.
-    // queue[0] is the newest frame, queue[num_queue - 1] the oldest.
-    struct mp_image **queue;
+    // Ring buffer of input frames, used to determine past/current/future
+    // frames. The n-th input frame is stored in ring[n % ring_size], so
+    // adding and removing frames never moves the others. Frames are mostly
+    // accessed with queue_get(), where index 0 is the newest frame, and
+    // num_queue - 1 the oldest.
+    struct mp_image **ring;
+    int ring_size;
+    int64_t num_added;  // number of frames added since the last flush
     int num_queue;
-    // queue[pos] is the current frame, unless pos is an invalid index.
+    // queue_get(pos) is the current frame, unless pos is an invalid index.
     int pos;
 };
 
+static struct mp_image **queue_slot(struct mp_refqueue *q, int i)
+{
+    assert(i >= 0 && i < q->num_queue);
+    return &q->ring[(q->num_added - 1 - i) % q->ring_size];
+}
+
+static struct mp_image *queue_get(struct mp_refqueue *q, int i)
+{
+    return *queue_slot(q, i);
+}
+
 static bool mp_refqueue_has_output(struct mp_refqueue *q);
 
 static void refqueue_dtor(void *p)
@@ -104,7 +120,7 @@ bool mp_refqueue_should_deint(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q) || !(q->flags & MP_MODE_DEINT))
         return false;
 
-    return (q->queue[q->pos]->fields & MP_IMGFIELD_INTERLACED) ||
+    return (queue_get(q, q->pos)->fields & MP_IMGFIELD_INTERLACED) ||
            !(q->flags & MP_MODE_INTERLACED_ONLY);
 }
 
@@ -115,7 +131,7 @@ bool mp_refqueue_is_top_field(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q))
         return false;
 
-    return !!(q->queue[q->pos]->fields & MP_IMGFIELD_TOP_FIRST) ^ q->second_field;
+    return !!(queue_get(q, q->pos)->fields & MP_IMGFIELD_TOP_FIRST) ^ q->second_field;
 }
 
 // Whether top-field-first mode is enabled.
@@ -124,15 +140,16 @@ bool mp_refqueue_top_field_first(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q))
         return false;
 
-    return q->queue[q->pos]->fields & MP_IMGFIELD_TOP_FIRST;
+    return queue_get(q, q->pos)->fields & MP_IMGFIELD_TOP_FIRST;
 }
 
 // Discard all state.
 void mp_refqueue_flush(struct mp_refqueue *q)
 {
     for (int n = 0; n < q->num_queue; n++)
-        talloc_free(q->queue[n]);
+        talloc_free(queue_get(q, n));
     q->num_queue = 0;
+    q->num_added = 0;
     q->pos = -1;
     q->second_field = false;
     q->eof = false;
@@ -143,7 +160,22 @@ static void mp_refqueue_add_input(struct mp_refqueue *q, struct mp_image *img)
 {
     assert(img);
 
-    MP_TARRAY_INSERT_AT(q, q->queue, q->num_queue, 0, img);
+    if (q->num_queue == q->ring_size) {
+        // Grow, and move the frames to their slots in the new ring. This
+        // happens only for the first frames after setting the refs.
+        int new_size = MPMAX(q->ring_size * 2,
+                             q->needed_past_frames + q->needed_future_frames + 2);
+        struct mp_image **ring = talloc_zero_array(q, struct mp_image *, new_size);
+        for (int n = 0; n < q->num_queue; n++)
+            ring[(q->num_added - 1 - n) % new_size] = queue_get(q, n);
+        talloc_free(q->ring);
+        q->ring = ring;
+        q->ring_size = new_size;
+    }
+
+    q->num_added++;
+    q->num_queue++;
+    *queue_slot(q, 0) = img;
     q->pos++;
 
     assert(q->pos >= 0 && q->pos < q->num_queue);
@@ -174,8 +206,8 @@ static bool output_next_field(struct mp_refqueue *q)
     if (q->pos == 0)
         return false;
 
-    double pts = q->queue[q->pos]->pts;
-    double next_pts = q->queue[q->pos - 1]->pts;
+    double pts = queue_get(q, q->pos)->pts;
+    double next_pts = queue_get(q, q->pos - 1)->pts;
     if (pts == MP_NOPTS_VALUE || next_pts == MP_NOPTS_VALUE)
         return false;
 
@@ -183,7 +215,7 @@ static bool output_next_field(struct mp_refqueue *q)
     if (frametime <= 0.0 || frametime >= 1.0)
         return false;
 
-    q->queue[q->pos]->pts = pts + frametime / 2;
+    queue_get(q, q->pos)->pts = pts + frametime / 2;
     q->second_field = true;
     return true;
 }
@@ -202,7 +234,9 @@ static void mp_refqueue_next(struct mp_refqueue *q)
     // Discard unneeded past frames.
     while (q->num_queue - (q->pos + 1) > q->needed_past_frames) {
         assert(q->num_queue > 0);
-        talloc_free(q->queue[q->num_queue - 1]);
+        struct mp_image **slot = queue_slot(q, q->num_queue - 1);
+        talloc_free(*slot);
+        *slot = NULL;
         q->num_queue--;
     }
 
@@ -227,7 +261,7 @@ static void mp_refqueue_next_field(struct mp_refqueue *q)
 struct mp_image *mp_refqueue_get(struct mp_refqueue *q, int pos)
 {
     int i = q->pos - pos;
-    return i >= 0 && i < q->num_queue ? q->queue[i] : NULL;
+    return i >= 0 && i < q->num_queue ? queue_get(q, i) : NULL;
 }
 
 // Same as mp_refqueue_get(), but return the frame which contains a field
@@ -242,6 +276,25 @@ struct mp_image *mp_refqueue_get_field(struct mp_refqueue *q, int pos)
     return mp_refqueue_get(q, frame);
 }
 
+// Like mp_refqueue_get_field(), but return a new reference to a view of the
+// field itself: the frame's lines of that field's parity, with doubled strides
+// and half the height (see mp_image_select_field()). Nothing is copied. Only
+// works with software formats. Caller has to free the returned image. Returns
+// NULL if unavailable.
+struct mp_image *mp_refqueue_get_field_view(struct mp_refqueue *q, int pos)
+{
+    struct mp_image *frame = mp_refqueue_get_field(q, pos);
+    if (!frame || (frame->fmt.flags & MP_IMGFLAG_HWACCEL))
+        return NULL;
+    struct mp_image *field = mp_image_new_ref(frame);
+    if (!field)
+        return NULL;
+    // Fields alternate in parity, starting from the current field.
+    bool top = mp_refqueue_is_top_field(q) ^ (pos & 1);
+    mp_image_select_field(field, !top);
+    return field;
+}
+
 bool mp_refqueue_is_second_field(struct mp_refqueue *q)
 {
     return mp_refqueue_has_output(q) && q->second_field;
@@ -339,6 +392,49 @@ bool mp_refqueue_can_output(struct mp_refqueue *q)
     return false;
 }
 
+// Like mp_refqueue_can_output(), but doesn't require that the output pin needs
+// data. This can be used to filter frames ahead of time (the caller has to
+// queue them). Returns false on EOF and format changes; the caller must output
+// all queued frames, and then call mp_refqueue_can_output() to handle them.
+// If this returns true, you must call mp_refqueue_next_output() after
+// rendering the frame.
+bool mp_refqueue_can_output_ahead(struct mp_refqueue *q)
+{
+    if (mp_refqueue_has_output(q))
+        return true;
+
+    if (q->next || q->eof)
+        return false;
+
+    struct mp_frame frame = mp_pin_out_read(q->in);
+    if (frame.type == MP_FRAME_NONE)
+        return false;
+
+    struct mp_image *img = frame.type == MP_FRAME_VIDEO ? frame.data : NULL;
+    if (!img || !q->in_format || !!q->in_format->hwctx != !!img->hwctx ||
+        (img->hwctx && img->hwctx->data != q->in_format->hwctx->data) ||
+        !mp_image_params_equal(&q->in_format->params, &img->params))
+    {
+        mp_pin_out_unread(q->in, frame);
+        return false;
+    }
+
+    mp_refqueue_add_input(q, img);
+
+    if (mp_refqueue_has_output(q))
+        return true;
+
+    mp_pin_out_request_data(q->in);
+    return false;
+}
+
+// Advance to the next output, after a frame for mp_refqueue_can_output_ahead()
+// was rendered.
+void mp_refqueue_next_output(struct mp_refqueue *q)
+{
+    mp_refqueue_next_field(q);
+}
+
 // (Accepts NULL for generic errors.)
 void mp_refqueue_write_out_pin(struct mp_refqueue *q, struct mp_image *mpi)
 {
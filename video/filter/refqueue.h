@@ -20,6 +20,8 @@ struct mp_image *mp_refqueue_get(struct mp_refqueue *q, int pos);
 struct mp_image *mp_refqueue_execute_reinit(struct mp_refqueue *q);
 bool mp_refqueue_can_output(struct mp_refqueue *q);
 void mp_refqueue_write_out_pin(struct mp_refqueue *q, struct mp_image *mpi);
+bool mp_refqueue_can_output_ahead(struct mp_refqueue *q);
+void mp_refqueue_next_output(struct mp_refqueue *q);
 
 struct mp_image *mp_refqueue_get_format(struct mp_refqueue *q);
 
@@ -35,5 +37,6 @@ bool mp_refqueue_is_top_field(struct mp_refqueue *q);
 bool mp_refqueue_top_field_first(struct mp_refqueue *q);
 bool mp_refqueue_is_second_field(struct mp_refqueue *q);
 struct mp_image *mp_refqueue_get_field(struct mp_refqueue *q, int pos);
+struct mp_image *mp_refqueue_get_field_view(struct mp_refqueue *q, int pos);
 
 #endif
@@ -42,6 +42,29 @@
 #define D3D11_VIDEO_PROCESSOR_PROCESSOR_CAPS_INVERSE_TELECINE 0x10
 #define D3D11_VIDEO_PROCESSOR_PROCESSOR_CAPS_FRAME_RATE_CONVERSION 0x20
 
+// Number of output surfaces allocated as slices of a single texture array.
+// Further surfaces (if more frames are in flight) are separate textures.
+#define OUT_ARRAY_SIZE 8
+
+// Maximum number of input/output views kept around. Decoders use a fixed set
+// of surfaces, so this is normally never reached.
+#define MAX_CACHED_VIEWS 64
+
+// Video processor views, created once per surface and reused for each frame.
+// tex is referenced, so that it can't be freed and replaced by a different
+// texture at the same address while the view is cached.
+struct in_view {
+    ID3D11Texture2D *tex;
+    int subindex;
+    ID3D11VideoProcessorInputView *view;
+};
+
+struct out_view {
+    ID3D11Texture2D *tex;
+    int subindex;
+    ID3D11VideoProcessorOutputView *view;
+};
+
 struct opts {
     int deint_enabled;
     int interlaced_only;
@@ -72,6 +95,14 @@ struct priv {
     int c_w, c_h;
 
     struct mp_image_pool *pool;
+    ID3D11Texture2D *out_array; // for the first OUT_ARRAY_SIZE pool surfaces
+    int out_array_used;
+
+    // Views for the current vp_enum.
+    struct in_view *in_views;
+    int num_in_views;
+    struct out_view *out_views;
+    int num_out_views;
 
     struct mp_refqueue *queue;
 };
@@ -90,6 +121,7 @@ static struct mp_image *alloc_pool(void *pctx, int fmt, int w, int h)
     HRESULT hr;
 
     ID3D11Texture2D *texture = NULL;
+    int subindex = 0;
     D3D11_TEXTURE2D_DESC texdesc = {
         .Width = w,
         .Height = h,
@@ -101,9 +133,29 @@ static struct mp_image *alloc_pool(void *pctx, int fmt, int w, int h)
         .BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE,
         .MiscFlags = p->out_shared ? D3D11_RESOURCE_MISC_SHARED : 0,
     };
-    hr = ID3D11Device_CreateTexture2D(p->vo_dev, &texdesc, NULL, &texture);
-    if (FAILED(hr))
-        return NULL;
+
+    // Shared textures are for interops that can't handle arrays anyway.
+    if (!p->out_shared && p->out_array_used < OUT_ARRAY_SIZE) {
+        if (!p->out_array) {
+            D3D11_TEXTURE2D_DESC arraydesc = texdesc;
+            arraydesc.ArraySize = OUT_ARRAY_SIZE;
+            hr = ID3D11Device_CreateTexture2D(p->vo_dev, &arraydesc, NULL,
+                                              &p->out_array);
+            if (FAILED(hr))
+                p->out_array = NULL;
+        }
+        if (p->out_array) {
+            texture = p->out_array;
+            ID3D11Texture2D_AddRef(texture);
+            subindex = p->out_array_used++;
+        }
+    }
+
+    if (!texture) {
+        hr = ID3D11Device_CreateTexture2D(p->vo_dev, &texdesc, NULL, &texture);
+        if (FAILED(hr))
+            return NULL;
+    }
 
     struct mp_image *mpi = mp_image_new_custom_ref(NULL, texture, release_tex);
     if (!mpi)
@@ -114,11 +166,117 @@ static struct mp_image *alloc_pool(void *pctx, int fmt, int w, int h)
     mpi->params.hw_subfmt = p->out_params.hw_subfmt;
 
     mpi->planes[0] = (void *)texture;
-    mpi->planes[1] = (void *)(intptr_t)0;
+    mpi->planes[1] = (void *)(intptr_t)subindex;
 
     return mpi;
 }
 
+static void clear_pool(struct mp_filter *vf)
+{
+    struct priv *p = vf->priv;
+
+    if (p->pool)
+        mp_image_pool_clear(p->pool);
+    // (Images still in use downstream hold their own references.)
+    if (p->out_array)
+        ID3D11Texture2D_Release(p->out_array);
+    p->out_array = NULL;
+    p->out_array_used = 0;
+}
+
+static void clear_views(struct mp_filter *vf)
+{
+    struct priv *p = vf->priv;
+
+    for (int n = 0; n < p->num_in_views; n++) {
+        ID3D11VideoProcessorInputView_Release(p->in_views[n].view);
+        ID3D11Texture2D_Release(p->in_views[n].tex);
+    }
+    p->num_in_views = 0;
+
+    for (int n = 0; n < p->num_out_views; n++) {
+        ID3D11VideoProcessorOutputView_Release(p->out_views[n].view);
+        ID3D11Texture2D_Release(p->out_views[n].tex);
+    }
+    p->num_out_views = 0;
+}
+
+static ID3D11VideoProcessorInputView *get_in_view(struct mp_filter *vf,
+                                                  ID3D11Texture2D *tex,
+                                                  int subindex)
+{
+    struct priv *p = vf->priv;
+
+    for (int n = 0; n < p->num_in_views; n++) {
+        struct in_view *v = &p->in_views[n];
+        if (v->tex == tex && v->subindex == subindex)
+            return v->view;
+    }
+
+    if (p->num_in_views >= MAX_CACHED_VIEWS)
+        clear_views(vf);
+
+    D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC indesc = {
+        .ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D,
+        .Texture2D = {
+            .ArraySlice = subindex,
+        },
+    };
+    ID3D11VideoProcessorInputView *view = NULL;
+    HRESULT hr = ID3D11VideoDevice_CreateVideoProcessorInputView(p->video_dev,
+                                                (ID3D11Resource *)tex,
+                                                p->vp_enum, &indesc, &view);
+    if (FAILED(hr)) {
+        MP_ERR(vf, "Could not create ID3D11VideoProcessorInputView\n");
+        return NULL;
+    }
+
+    ID3D11Texture2D_AddRef(tex);
+    MP_TARRAY_APPEND(p, p->in_views, p->num_in_views,
+                     (struct in_view){tex, subindex, view});
+    return view;
+}
+
+static ID3D11VideoProcessorOutputView *get_out_view(struct mp_filter *vf,
+                                                    ID3D11Texture2D *tex,
+                                                    int subindex)
+{
+    struct priv *p = vf->priv;
+
+    for (int n = 0; n < p->num_out_views; n++) {
+        struct out_view *v = &p->out_views[n];
+        if (v->tex == tex && v->subindex == subindex)
+            return v->view;
+    }
+
+    if (p->num_out_views >= MAX_CACHED_VIEWS)
+        clear_views(vf);
+
+    D3D11_TEXTURE2D_DESC texdesc;
+    ID3D11Texture2D_GetDesc(tex, &texdesc);
+    D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC outdesc = {
+        .ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D,
+    };
+    if (texdesc.ArraySize > 1) {
+        outdesc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2DARRAY;
+        outdesc.Texture2DArray.FirstArraySlice = subindex;
+        outdesc.Texture2DArray.ArraySize = 1;
+    }
+    ID3D11VideoProcessorOutputView *view = NULL;
+    HRESULT hr = ID3D11VideoDevice_CreateVideoProcessorOutputView(p->video_dev,
+                                                (ID3D11Resource *)tex,
+                                                p->vp_enum, &outdesc, &view);
+    if (FAILED(hr)) {
+        MP_ERR(vf, "Could not create ID3D11VideoProcessorOutputView\n");
+        return NULL;
+    }
+
+    ID3D11Texture2D_AddRef(tex);
+    MP_TARRAY_APPEND(p, p->out_views, p->num_out_views,
+                     (struct out_view){tex, subindex, view});
+    return view;
+}
+
 static void flush_frames(struct mp_filter *vf)
 {
     struct priv *p = vf->priv;
@@ -129,6 +287,9 @@ static void destroy_video_proc(struct mp_filter *vf)
 {
     struct priv *p = vf->priv;
 
+    // The views were created for p->vp_enum.
+    clear_views(vf);
+
     if (p->video_proc)
         ID3D11VideoProcessor_Release(p->video_proc);
     p->video_proc = NULL;
@@ -248,8 +409,6 @@ static struct mp_image *render(struct mp_filter *vf)
     struct priv *p = vf->priv;
     int res = -1;
     HRESULT hr;
-    ID3D11VideoProcessorInputView *in_view = NULL;
-    ID3D11VideoProcessorOutputView *out_view = NULL;
     struct mp_image *in = NULL, *out = NULL;
     out = mp_image_pool_get(p->pool, IMGFMT_D3D11, p->params.w, p->params.h);
     if (!out) {
@@ -258,6 +417,7 @@ static struct mp_image *render(struct mp_filter *vf)
     }
 
     ID3D11Texture2D *d3d_out_tex = (void *)out->planes[0];
+    int d3d_out_subindex = (intptr_t)out->planes[1];
 
     in = mp_refqueue_get(p->queue, 0);
     if (!in)
@@ -300,32 +460,12 @@ static struct mp_image *render(struct mp_filter *vf)
                                                           p->video_proc,
                                                           0, d3d_frame_format);
 
-    D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC indesc = {
-        .ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D,
-        .Texture2D = {
-            .ArraySlice = d3d_subindex,
-        },
-    };
-    hr = ID3D11VideoDevice_CreateVideoProcessorInputView(p->video_dev,
-                                                         (ID3D11Resource *)d3d_tex,
-                                                         p->vp_enum, &indesc,
-                                                         &in_view);
-    if (FAILED(hr)) {
-        MP_ERR(vf, "Could not create ID3D11VideoProcessorInputView\n");
-        goto cleanup;
-    }
-
-    D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC outdesc = {
-        .ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D,
-    };
-    hr = ID3D11VideoDevice_CreateVideoProcessorOutputView(p->video_dev,
-                                                          (ID3D11Resource *)d3d_out_tex,
-                                                          p->vp_enum, &outdesc,
-                                                          &out_view);
-    if (FAILED(hr)) {
-        MP_ERR(vf, "Could not create ID3D11VideoProcessorOutputView\n");
+    ID3D11VideoProcessorInputView *in_view =
+        get_in_view(vf, d3d_tex, d3d_subindex);
+    ID3D11VideoProcessorOutputView *out_view =
+        get_out_view(vf, d3d_out_tex, d3d_out_subindex);
+    if (!in_view || !out_view)
         goto cleanup;
-    }
 
     D3D11_VIDEO_PROCESSOR_STREAM stream = {
         .Enable = TRUE,
@@ -341,10 +481,6 @@ static struct mp_image *render(struct mp_filter *vf)
 
     res = 0;
 cleanup:
-    if (in_view)
-        ID3D11VideoProcessorInputView_Release(in_view);
-    if (out_view)
-        ID3D11VideoProcessorOutputView_Release(out_view);
     if (res < 0)
         TA_FREEP(&out);
     return out;
@@ -365,7 +501,7 @@ static void vf_d3d11vpp_process(struct mp_filter *vf)
 
     struct mp_image *in_fmt = mp_refqueue_execute_reinit(p->queue);
     if (in_fmt) {
-        mp_image_pool_clear(p->pool);
+        clear_pool(vf);
 
         destroy_video_proc(vf);
 
@@ -412,6 +548,7 @@ static void uninit(struct mp_filter *vf)
 
     flush_frames(vf);
     talloc_free(p->queue);
+    clear_pool(vf);
     talloc_free(p->pool);
 
     if (p->video_ctx)
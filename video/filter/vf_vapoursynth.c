@@ -47,6 +47,7 @@ struct vapoursynth_opts {
     char *file;
     int maxbuffer;
     int maxrequests;
+    int maxoutput;
 
     const struct script_driver *drv;
 };
@@ -88,7 +89,8 @@ struct priv {
     double out_pts;             // pts corresponding to first requested/ready frame
     struct mp_image **requested;// frame callback results (can point to dummy_img)
                                 // requested[0] is the frame to return first
-    int max_requests;           // upper bound for requested[] array
+    int num_slots;              // size of requested[] array
+    int max_requests;           // max. number of requests in progress
     bool failed;                // frame callback returned with an error
     bool shutdown;              // ask node to return
     bool eof;                   // drain remaining data
@@ -103,6 +105,7 @@ static const struct mp_image dummy_img;
 static const struct mp_image dummy_img_eof;
 
 static void destroy_vs(struct priv *p);
+static int num_requested(struct priv *p);
 static int reinit_vs(struct priv *p, struct mp_image *input);
 
 struct script_driver {
@@ -275,7 +278,7 @@ static void VS_CC vs_frame_done(void *userData, const VSFrameRef *f, int n,
     pthread_mutex_lock(&p->lock);
 
     // If these assertions fail, n is an unrequested frame (or filtered twice).
-    assert(n >= p->out_frameno && n < p->out_frameno + p->max_requests);
+    assert(n >= p->out_frameno && n < p->out_frameno + p->num_slots);
     int index = n - p->out_frameno;
     MP_TRACE(p, "filtered frame %d (%d)\n", n, index);
     assert(p->requested[index] == &dummy_img);
@@ -403,10 +406,14 @@ static void vf_vapoursynth_process(struct mp_filter *f)
 
         mp_pin_in_write(f->ppins[1], MAKE_FRAME(MP_FRAME_VIDEO, out));
 
-        for (int n = 0; n < p->max_requests - 1; n++)
+        for (int n = 0; n < p->num_slots - 1; n++)
             p->requested[n] = p->requested[n + 1];
-        p->requested[p->max_requests - 1] = NULL;
+        p->requested[p->num_slots - 1] = NULL;
         p->out_frameno++;
+
+        // Frames can finish out of order, so more might be ready already.
+        if (p->requested[0] && p->requested[0] != &dummy_img)
+            mp_filter_internal_mark_progress(f);
     }
 
     // This happens on EOF draining and format changes.
@@ -421,9 +428,12 @@ static void vf_vapoursynth_process(struct mp_filter *f)
 
     // Don't request frames if we haven't sent any input yet.
     if (p->frames_sent && p->out_node) {
-        // Request new future frames as far as possible.
-        for (int n = 0; n < p->max_requests; n++) {
+        // Request new future frames as far as possible. Finished frames that
+        // wait for output don't count against the concurrency limit.
+        int active = num_requested(p);
+        for (int n = 0; n < p->num_slots && active < p->max_requests; n++) {
             if (!p->requested[n]) {
+                active++;
                 // Note: this assumes getFrameAsync() will never call
                 //       infiltGetFrame (if it does, we would deadlock)
                 p->requested[n] = (struct mp_image *)&dummy_img;
@@ -529,17 +539,25 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
                 mp_filter_wakeup(p->f);
             }
         } else {
-            struct mp_image *img = p->buffered[frameno - p->in_frameno];
-            ret = alloc_vs_frame(p, &img->params);
-            if (!ret) {
+            // Copy without holding the lock, so that the main thread can
+            // queue input and return finished frames meanwhile. The new
+            // reference keeps the image alive if it's drained from buffered.
+            struct mp_image *img =
+                mp_image_new_ref(p->buffered[frameno - p->in_frameno]);
+            pthread_mutex_unlock(&p->lock);
+            if (img)
+                ret = alloc_vs_frame(p, &img->params);
+            if (ret) {
+                struct mp_image vsframe = map_vs_frame(p, ret, true);
+                mp_image_copy(&vsframe, img);
+                int res = 1e6;
+                int dur = img->pkt_duration * res + 0.5;
+                set_vs_frame_props(p, ret, img, dur, res);
+            } else {
                 p->vsapi->setFilterError("Could not allocate VS frame", frameCtx);
-                break;
             }
-            struct mp_image vsframe = map_vs_frame(p, ret, true);
-            mp_image_copy(&vsframe, img);
-            int res = 1e6;
-            int dur = img->pkt_duration * res + 0.5;
-            set_vs_frame_props(p, ret, img, dur, res);
+            talloc_free(img);
+            pthread_mutex_lock(&p->lock);
             break;
         }
         pthread_cond_wait(&p->wakeup, &p->lock);
@@ -564,7 +582,7 @@ static void VS_CC infiltFree(void *instanceData, VSCore *core, const VSAPI *vsap
 static int num_requested(struct priv *p)
 {
     int r = 0;
-    for (int n = 0; n < p->max_requests; n++)
+    for (int n = 0; n < p->num_slots; n++)
         r += p->requested[n] == &dummy_img;
     return r;
 }
@@ -602,7 +620,7 @@ static void destroy_vs(struct priv *p)
     p->eof = false;
     p->frames_sent = 0;
     // Kill filtered images that weren't returned yet
-    for (int n = 0; n < p->max_requests; n++) {
+    for (int n = 0; n < p->num_slots; n++) {
         if (p->requested[n] != &dummy_img_eof)
             mp_image_unrefp(&p->requested[n]);
         p->requested[n] = NULL;
@@ -765,10 +783,12 @@ static struct mp_filter *vf_vapoursynth_create(struct mp_filter *parent,
     p->max_requests = p->opts->maxrequests;
     if (p->max_requests < 0)
         p->max_requests = av_cpu_count();
-    MP_VERBOSE(p, "using %d concurrent requests.\n", p->max_requests);
-    int maxbuffer = p->opts->maxbuffer * p->max_requests;
+    p->num_slots = p->max_requests + p->opts->maxoutput;
+    MP_VERBOSE(p, "using %d concurrent requests, %d output frames.\n",
+               p->max_requests, p->opts->maxoutput);
+    int maxbuffer = p->opts->maxbuffer * p->num_slots;
     p->buffered = talloc_array(p, struct mp_image *, maxbuffer);
-    p->requested = talloc_zero_array(p, struct mp_image *, p->max_requests);
+    p->requested = talloc_zero_array(p, struct mp_image *, p->num_slots);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
@@ -805,6 +825,7 @@ static const m_option_t vf_opts_fields[] = {
     OPT_INTRANGE("buffered-frames", maxbuffer, 0, 1, 9999, OPTDEF_INT(4)),
     OPT_CHOICE_OR_INT("concurrent-frames", maxrequests, 0, 1, 99,
                       ({"auto", -1}), OPTDEF_INT(-1)),
+    OPT_INTRANGE("output-frames", maxoutput, 0, 0, 999, OPTDEF_INT(0)),
     {0}
 };
 
@@ -54,6 +54,7 @@ struct opts {
     int deint_type;
     int interlaced_only;
     int reversal_bug;
+    int queue_depth;
 };
 
 struct priv {
@@ -70,6 +71,11 @@ struct priv {
     AVBufferRef *hw_pool;
 
     struct mp_refqueue *queue;
+
+    // Frames rendered ahead of time, oldest first. The VPP work for them runs
+    // on the GPU while the previous frames are displayed.
+    struct mp_image **out_queue;
+    int num_out_queue;
 };
 
 static void add_surfaces(struct priv *p, struct surface_refs *refs, int dir)
@@ -100,6 +106,9 @@ static void flush_frames(struct mp_filter *f)
 {
     struct priv *p = f->priv;
     mp_refqueue_flush(p->queue);
+    for (int n = 0; n < p->num_out_queue; n++)
+        talloc_free(p->out_queue[n]);
+    p->num_out_queue = 0;
 }
 
 static void update_pipeline(struct mp_filter *vf)
@@ -261,6 +270,7 @@ static struct mp_image *render(struct mp_filter *vf)
 
     int dir = p->opts->reversal_bug ? -1 : 1;
 
+    p->pipe.forward.num_surfaces = p->pipe.backward.num_surfaces = 0;
     add_surfaces(p, &p->pipe.forward, 1 * dir);
     param->forward_references = p->pipe.forward.surfaces;
     param->num_forward_references = p->pipe.forward.num_surfaces;
@@ -293,6 +303,18 @@ cleanup:
     return NULL;
 }
 
+static struct mp_image *get_output(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (!p->pipe.num_filters || !mp_refqueue_should_deint(p->queue)) {
+        // no filtering
+        struct mp_image *in = mp_refqueue_get(p->queue, 0);
+        return mp_image_new_ref(in);
+    }
+    return render(f);
+}
+
 static void vf_vavpp_process(struct mp_filter *f)
 {
     struct priv *p = f->priv;
@@ -301,15 +323,28 @@ static void vf_vavpp_process(struct mp_filter *f)
 
     mp_refqueue_execute_reinit(p->queue);
 
-    if (!mp_refqueue_can_output(p->queue))
-        return;
+    if (p->num_out_queue) {
+        if (mp_pin_in_needs_data(f->ppins[1])) {
+            struct mp_image *img = p->out_queue[0];
+            MP_TARRAY_REMOVE_AT(p->out_queue, p->num_out_queue, 0);
+            mp_pin_in_write(f->ppins[1], MAKE_FRAME(MP_FRAME_VIDEO, img));
+        }
+    } else if (mp_refqueue_can_output(p->queue)) {
+        mp_refqueue_write_out_pin(p->queue, get_output(f));
+    }
 
-    if (!p->pipe.num_filters || !mp_refqueue_should_deint(p->queue)) {
-        // no filtering
-        struct mp_image *in = mp_refqueue_get(p->queue, 0);
-        mp_refqueue_write_out_pin(p->queue, mp_image_new_ref(in));
-    } else {
-        mp_refqueue_write_out_pin(p->queue, render(f));
+    // Keep up to queue_depth frames in flight (including the one that was
+    // just output), so VPP runs in parallel with decoding and rendering.
+    while (p->num_out_queue + 1 < p->opts->queue_depth &&
+           mp_refqueue_can_output_ahead(p->queue))
+    {
+        struct mp_image *img = get_output(f);
+        if (!img) {
+            mp_refqueue_write_out_pin(p->queue, NULL);
+            break;
+        }
+        MP_TARRAY_APPEND(p, p->out_queue, p->num_out_queue, img);
+        mp_refqueue_next_output(p->queue);
     }
 }
 
@@ -482,6 +517,7 @@ static const m_option_t vf_opts_fields[] = {
                 {"motion-compensated", 5})),
     OPT_FLAG("interlaced-only", interlaced_only, 0),
     OPT_FLAG("reversal-bug", reversal_bug, 0),
+    OPT_INTRANGE("queue-depth", queue_depth, 0, 1, 8),
     {0}
 };
 
@@ -494,6 +530,7 @@ const struct mp_user_filter_entry vf_vavpp = {
             .deint_type = -1,
             .interlaced_only = 0,
             .reversal_bug = 1,
+            .queue_depth = 3,
         },
         .options = vf_opts_fields,
     },
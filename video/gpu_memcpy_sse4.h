@@ -0,0 +1,89 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_GPU_MEMCPY_SSE4_H
+#define MP_GPU_MEMCPY_SSE4_H
+
+#include <stdint.h>
+#include <string.h>
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#include <smmintrin.h>
+
+// Copy memory from uncacheable write-combined (USWC) memory, such as mapped
+// hardware decoder surfaces. Normal loads from such memory are very slow, but
+// streaming loads fetch whole cache lines at once. Requires SSE4.1, which the
+// caller must check at runtime.
+static inline void *gpu_memcpy(void *restrict d, const void *restrict s,
+                               size_t size)
+{
+    uint8_t *dst = d;
+    const uint8_t *src = s;
+
+    // Streaming loads require 16 byte aligned source addresses.
+    size_t head = (16 - ((uintptr_t)src & 15)) & 15;
+    if (head > size)
+        head = size;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    size_t blocks = size / 64;
+    __m128i *s128 = (__m128i *)src;
+
+    _mm_sfence();
+
+    if (((uintptr_t)dst & 15) == 0) {
+        __m128i *d128 = (__m128i *)dst;
+        for (size_t n = 0; n < blocks; n++) {
+            __m128i x0 = _mm_stream_load_si128(s128 + 0);
+            __m128i x1 = _mm_stream_load_si128(s128 + 1);
+            __m128i x2 = _mm_stream_load_si128(s128 + 2);
+            __m128i x3 = _mm_stream_load_si128(s128 + 3);
+            _mm_store_si128(d128 + 0, x0);
+            _mm_store_si128(d128 + 1, x1);
+            _mm_store_si128(d128 + 2, x2);
+            _mm_store_si128(d128 + 3, x3);
+            s128 += 4;
+            d128 += 4;
+        }
+    } else {
+        __m128i *d128 = (__m128i *)dst;
+        for (size_t n = 0; n < blocks; n++) {
+            __m128i x0 = _mm_stream_load_si128(s128 + 0);
+            __m128i x1 = _mm_stream_load_si128(s128 + 1);
+            __m128i x2 = _mm_stream_load_si128(s128 + 2);
+            __m128i x3 = _mm_stream_load_si128(s128 + 3);
+            _mm_storeu_si128(d128 + 0, x0);
+            _mm_storeu_si128(d128 + 1, x1);
+            _mm_storeu_si128(d128 + 2, x2);
+            _mm_storeu_si128(d128 + 3, x3);
+            s128 += 4;
+            d128 += 4;
+        }
+    }
+
+    memcpy(dst + blocks * 64, src + blocks * 64, size % 64);
+
+    return d;
+}
+
+#pragma GCC pop_options
+
+#endif
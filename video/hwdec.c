@@ -7,12 +7,24 @@
 
 #include "hwdec.h"
 
+// Number of unused hw frames pools kept per hwdec_devices.
+#define MAX_IDLE_FRAMES 4
+
+struct cached_frames {
+    struct AVBufferRef *frames; // AVHWFramesContext*
+    bool in_use;                // acquired by a decoder
+};
+
 struct mp_hwdec_devices {
     pthread_mutex_t lock;
 
     struct mp_hwdec_ctx **hwctxs;
     int num_hwctxs;
 
+    // Least recently released first.
+    struct cached_frames *frames;
+    int num_frames;
+
     void (*load_api)(void *ctx);
     void *load_api_ctx;
 };
@@ -30,6 +42,8 @@ void hwdec_devices_destroy(struct mp_hwdec_devices *devs)
         return;
     assert(!devs->num_hwctxs); // must have been hwdec_devices_remove()ed
     assert(!devs->load_api); // must have been unset
+    for (int n = 0; n < devs->num_frames; n++)
+        av_buffer_unref(&devs->frames[n].frames);
     pthread_mutex_destroy(&devs->lock);
     talloc_free(devs);
 }
@@ -91,7 +105,115 @@ void hwdec_devices_remove(struct mp_hwdec_devices *devs, struct mp_hwdec_ctx *ct
             break;
         }
     }
+    // The pools must not outlive the device's owner. (Pools in use are owned
+    // by decoders, which must have been destroyed at this point.)
+    for (int n = devs->num_frames - 1; n >= 0; n--) {
+        struct cached_frames *e = &devs->frames[n];
+        AVHWFramesContext *fctx = (void *)e->frames->data;
+        if (ctx->av_device_ref &&
+            fctx->device_ref->data == ctx->av_device_ref->data)
+        {
+            assert(!e->in_use);
+            av_buffer_unref(&e->frames);
+            MP_TARRAY_REMOVE_AT(devs->frames, devs->num_frames, n);
+        }
+    }
+    pthread_mutex_unlock(&devs->lock);
+}
+
+static bool frames_params_equal(AVHWFramesContext *a, AVHWFramesContext *b)
+{
+    return a->device_ref->data  == b->device_ref->data &&
+           a->format            == b->format &&
+           a->sw_format         == b->sw_format &&
+           a->width             == b->width &&
+           a->height            == b->height &&
+           a->initial_pool_size == b->initial_pool_size;
+}
+
+// Must be called with devs->lock held.
+static bool has_device(struct mp_hwdec_devices *devs, AVBufferRef *device_ref)
+{
+    for (int n = 0; n < devs->num_hwctxs; n++) {
+        AVBufferRef *ref = devs->hwctxs[n]->av_device_ref;
+        if (ref && ref->data == device_ref->data)
+            return true;
+    }
+    return false;
+}
+
+struct AVBufferRef *hwdec_devices_acquire_frames(struct mp_hwdec_devices *devs,
+                                                 struct AVBufferRef *params)
+{
+    AVHWFramesContext *fctx = (void *)params->data;
+    AVBufferRef *res = NULL;
+
+    if (devs) {
+        pthread_mutex_lock(&devs->lock);
+        for (int n = 0; n < devs->num_frames; n++) {
+            struct cached_frames *e = &devs->frames[n];
+            if (!e->in_use &&
+                frames_params_equal((void *)e->frames->data, fctx))
+            {
+                res = av_buffer_ref(e->frames);
+                e->in_use = !!res;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&devs->lock);
+        if (res)
+            return res;
+    }
+
+    if (av_hwframe_ctx_init(params) < 0)
+        return NULL;
+    res = av_buffer_ref(params);
+    if (!res || !devs)
+        return res;
+
+    pthread_mutex_lock(&devs->lock);
+    if (has_device(devs, fctx->device_ref)) {
+        struct cached_frames e = {av_buffer_ref(params), true};
+        if (e.frames)
+            MP_TARRAY_APPEND(devs, devs->frames, devs->num_frames, e);
+    }
     pthread_mutex_unlock(&devs->lock);
+    return res;
+}
+
+void hwdec_devices_release_frames(struct mp_hwdec_devices *devs,
+                                  struct AVBufferRef **frames)
+{
+    if (!*frames)
+        return;
+
+    if (devs) {
+        pthread_mutex_lock(&devs->lock);
+        for (int n = 0; n < devs->num_frames; n++) {
+            struct cached_frames e = devs->frames[n];
+            if (e.frames->data == (*frames)->data) {
+                // Move to the end of the LRU list.
+                e.in_use = false;
+                MP_TARRAY_REMOVE_AT(devs->frames, devs->num_frames, n);
+                MP_TARRAY_APPEND(devs, devs->frames, devs->num_frames, e);
+                break;
+            }
+        }
+        int idle = 0;
+        for (int n = 0; n < devs->num_frames; n++)
+            idle += !devs->frames[n].in_use;
+        for (int n = 0; n < devs->num_frames && idle > MAX_IDLE_FRAMES; n++) {
+            if (!devs->frames[n].in_use) {
+                av_buffer_unref(&devs->frames[n].frames);
+                MP_TARRAY_REMOVE_AT(devs->frames, devs->num_frames, n);
+                n--;
+                idle--;
+            }
+        }
+        pthread_mutex_unlock(&devs->lock);
+    }
+
+    av_buffer_unref(frames);
 }
 
 void hwdec_devices_set_loader(struct mp_hwdec_devices *devs,
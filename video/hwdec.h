@@ -37,6 +37,20 @@ struct AVBufferRef *hwdec_devices_get_lavc(struct mp_hwdec_devices *devs,
 struct mp_hwdec_ctx *hwdec_devices_get_by_lavc(struct mp_hwdec_devices *devs,
                                                int av_hwdevice_type);
 
+// Return an initialized AVHWFramesContext with the parameters of params (an
+// AVHWFramesContext that was allocated, but not initialized yet). A pool
+// released earlier is reused if the device, formats, size and pool size
+// match, otherwise params is initialized and returned. Pools on devices added
+// to devs are kept after release, and the least recently used ones are freed.
+// devs can be NULL. Returns a new reference, or NULL on failure.
+struct AVBufferRef *hwdec_devices_acquire_frames(struct mp_hwdec_devices *devs,
+                                                 struct AVBufferRef *params);
+
+// Release a pool returned by hwdec_devices_acquire_frames(), and unref and
+// clear *frames. (This is a no-op if *frames is NULL.)
+void hwdec_devices_release_frames(struct mp_hwdec_devices *devs,
+                                  struct AVBufferRef **frames);
+
 // For code which still strictly assumes there is 1 (or none) device.
 struct mp_hwdec_ctx *hwdec_devices_get_first(struct mp_hwdec_devices *devs);
 
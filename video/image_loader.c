@@ -1,6 +1,11 @@
+#include <pthread.h>
+#include <string.h>
+
 #include <libavcodec/avcodec.h>
+#include <libavutil/md5.h>
 
 #include "common/common.h"
+#include "mpv_talloc.h"
 #include "mp_image.h"
 #include "image_writer.h"
 
@@ -46,3 +51,121 @@ struct mp_image *load_image_png_buf(void *buffer, size_t buffer_size, int imgfmt
     avcodec_free_context(&avctx);
     return res;
 }
+
+struct cache_entry {
+    struct mp_image_cache_key key;
+    struct mp_image *img;
+    int64_t bytes;
+};
+
+struct mp_image_cache {
+    pthread_mutex_t lock;
+    int64_t max_bytes;
+    int64_t bytes;
+    // (sorted by least recent use: index 0 is least recently used)
+    struct cache_entry *entries;
+    int num_entries;
+};
+
+static void remove_entry(struct mp_image_cache *c, int n)
+{
+    c->bytes -= c->entries[n].bytes;
+    talloc_free(c->entries[n].img);
+    MP_TARRAY_REMOVE_AT(c->entries, c->num_entries, n);
+}
+
+// must be called locked
+static void prune_cache(struct mp_image_cache *c)
+{
+    while (c->num_entries && c->bytes > c->max_bytes)
+        remove_entry(c, 0);
+}
+
+static void cache_destroy(void *p)
+{
+    struct mp_image_cache *c = p;
+    while (c->num_entries)
+        remove_entry(c, 0);
+    pthread_mutex_destroy(&c->lock);
+}
+
+struct mp_image_cache *mp_image_cache_create(void *ta_parent)
+{
+    struct mp_image_cache *c = talloc_zero(ta_parent, struct mp_image_cache);
+    pthread_mutex_init(&c->lock, NULL);
+    talloc_set_destructor(c, cache_destroy);
+    return c;
+}
+
+void mp_image_cache_set_max_bytes(struct mp_image_cache *c, int64_t max_bytes)
+{
+    pthread_mutex_lock(&c->lock);
+    c->max_bytes = MPMAX(max_bytes, 0);
+    prune_cache(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mp_image_cache_key(struct mp_image_cache_key *key, const void *data,
+                        size_t size)
+{
+    *key = (struct mp_image_cache_key){.size = size};
+    av_md5_sum(key->hash, data, size);
+}
+
+// must be called locked
+static int find_entry(struct mp_image_cache *c, struct mp_image_cache_key *key)
+{
+    for (int n = c->num_entries - 1; n >= 0; n--) {
+        struct mp_image_cache_key *k = &c->entries[n].key;
+        if (k->size == key->size && memcmp(k->hash, key->hash, 16) == 0)
+            return n;
+    }
+    return -1;
+}
+
+struct mp_image *mp_image_cache_get(struct mp_image_cache *c,
+                                    struct mp_image_cache_key *key)
+{
+    struct mp_image *res = NULL;
+    pthread_mutex_lock(&c->lock);
+    int n = find_entry(c, key);
+    if (n >= 0) {
+        struct cache_entry e = c->entries[n];
+        MP_TARRAY_REMOVE_AT(c->entries, c->num_entries, n);
+        MP_TARRAY_APPEND(c, c->entries, c->num_entries, e);
+        res = mp_image_new_ref(e.img);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return res;
+}
+
+void mp_image_cache_add(struct mp_image_cache *c,
+                        struct mp_image_cache_key *key, struct mp_image *img)
+{
+    if (IMGFMT_IS_HWACCEL(img->imgfmt))
+        return;
+
+    int64_t bytes = mp_image_get_alloc_size(img->imgfmt, img->w, img->h, 1);
+
+    pthread_mutex_lock(&c->lock);
+    bool ok = bytes > 0 && bytes <= c->max_bytes && find_entry(c, key) < 0;
+    pthread_mutex_unlock(&c->lock);
+    if (!ok)
+        return;
+
+    // Copy it, so the cache doesn't keep e.g. VO (DR) or decoder buffers.
+    struct mp_image *copy = mp_image_new_copy(img);
+    if (!copy)
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    if (find_entry(c, key) < 0) {
+        struct cache_entry e = {.key = *key, .img = copy, .bytes = bytes};
+        MP_TARRAY_APPEND(c, c->entries, c->num_entries, e);
+        c->bytes += bytes;
+        copy = NULL;
+        prune_cache(c);
+    }
+    pthread_mutex_unlock(&c->lock);
+    talloc_free(copy);
+}
@@ -2,8 +2,38 @@
 #define MP_IMAGE_LOADER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct mp_image;
 struct mp_image *load_image_png_buf(void *buffer, size_t buffer_size, int imgfmt);
 
+// Thread-safe LRU cache of decoded images, keyed by the hash of the encoded
+// data. Used to avoid decoding the same images again (e.g. cover art of
+// multiple files in a music playlist).
+struct mp_image_cache;
+
+struct mp_image_cache_key {
+    uint8_t hash[16];
+    size_t size;
+};
+
+// Free with talloc_free().
+struct mp_image_cache *mp_image_cache_create(void *ta_parent);
+
+// Set the maximum total size of the cached images (0 disables the cache).
+// Images larger than this are not cached.
+void mp_image_cache_set_max_bytes(struct mp_image_cache *c, int64_t max_bytes);
+
+// Compute the cache key for the given encoded image data.
+void mp_image_cache_key(struct mp_image_cache_key *key, const void *data,
+                        size_t size);
+
+// Return a new reference to the cached image, or NULL if not found.
+struct mp_image *mp_image_cache_get(struct mp_image_cache *c,
+                                    struct mp_image_cache_key *key);
+
+// Add a copy of the image (hardware images are not cached).
+void mp_image_cache_add(struct mp_image_cache *c,
+                        struct mp_image_cache_key *key, struct mp_image *img);
+
 #endif
@@ -18,9 +18,11 @@
 #include <limits.h>
 #include <pthread.h>
 #include <assert.h>
+#include <stdlib.h>
 
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/bswap.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/rational.h>
@@ -40,6 +42,14 @@
 #include "sws_utils.h"
 #include "fmt-conversion.h"
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#if HAVE_SSE4_INTRINSICS
+#include "gpu_memcpy_sse4.h"
+#endif
+
 const struct m_opt_choice_alternatives mp_spherical_names[] = {
     {"auto",        MP_SPHERICAL_AUTO},
     {"none",        MP_SPHERICAL_NONE},
@@ -190,6 +200,90 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     return true;
 }
 
+#if HAVE_POSIX && defined(MAP_ANONYMOUS)
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+struct huge_mapping {
+    void *base;
+    size_t size;
+};
+
+static void free_huge_mapping(void *opaque, uint8_t *data)
+{
+    struct huge_mapping *m = opaque;
+    munmap(m->base, m->size);
+    free(m);
+}
+
+// Allocate an image backed by huge pages (mode is a MP_HUGEPAGES_* value). The
+// memory is not touched, so on NUMA systems, the kernel places the pages on
+// the node of the thread that first writes it (the decoder or filter filling
+// it). Returns NULL if huge pages are not used for this image (disabled, or
+// the image is smaller than a huge page); the caller should fall back to a
+// normal allocation then.
+struct mp_image *mp_image_alloc_hugepages(int imgfmt, int w, int h,
+                                          int stride_align, int mode)
+{
+    if (mode == MP_HUGEPAGES_NO)
+        return NULL;
+
+    stride_align = MPMAX(stride_align, SWS_MIN_BYTE_ALIGN);
+    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (size < HUGE_PAGE_SIZE)
+        return NULL;
+    size_t map_size = MP_ALIGN_UP((size_t)size, HUGE_PAGE_SIZE);
+    if (map_size > INT_MAX)
+        return NULL;
+
+    struct huge_mapping m = {.base = MAP_FAILED};
+    uint8_t *data = NULL;
+#ifdef MAP_HUGETLB
+    if (mode == MP_HUGEPAGES_EXPLICIT) {
+        // Fails if no huge pages are reserved (/proc/sys/vm/nr_hugepages).
+        m.size = map_size;
+        m.base = mmap(NULL, m.size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        data = m.base;
+    }
+#endif
+    if (m.base == MAP_FAILED) {
+        // Overallocate, so the buffer can start on a huge page boundary.
+        m.size = map_size + HUGE_PAGE_SIZE;
+        m.base = mmap(NULL, m.size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m.base == MAP_FAILED)
+            return NULL;
+        data = (uint8_t *)MP_ALIGN_UP((uintptr_t)m.base, HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+        madvise(data, map_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    struct huge_mapping *pm = malloc(sizeof(*pm));
+    struct mp_image *mpi = NULL;
+    if (pm) {
+        *pm = m;
+        mpi = mp_image_from_buffer(imgfmt, w, h, stride_align, data, map_size,
+                                   pm, free_huge_mapping);
+    }
+    if (!mpi) {
+        munmap(m.base, m.size);
+        free(pm);
+    }
+    return mpi;
+}
+
+#else
+
+struct mp_image *mp_image_alloc_hugepages(int imgfmt, int w, int h,
+                                          int stride_align, int mode)
+{
+    return NULL;
+}
+
+#endif
+
 void mp_image_setfmt(struct mp_image *mpi, int out_fmt)
 {
     struct mp_image_params params = mpi->params;
@@ -487,6 +581,19 @@ void mp_image_copy(struct mp_image *dst, struct mp_image *src)
     mp_image_copy_cb(dst, src, memcpy);
 }
 
+// Like mp_image_copy(), but faster if src is in uncacheable memory, such as
+// mapped hardware surfaces.
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE4) {
+        mp_image_copy_cb(dst, src, gpu_memcpy);
+        return;
+    }
+#endif
+    mp_image_copy(dst, src);
+}
+
 static enum mp_csp mp_image_params_get_forced_csp(struct mp_image_params *params)
 {
     int imgfmt = params->hw_subfmt ? params->hw_subfmt : params->imgfmt;
@@ -598,6 +705,23 @@ void mp_image_vflip(struct mp_image *img)
     }
 }
 
+// Turn img into a view of the top or bottom field, by skipping every other
+// line (no data is copied). The height is rounded down to the alignment, and
+// the pixel aspect ratio is adjusted. Not possible with hwaccel formats.
+void mp_image_select_field(struct mp_image *img, bool bottom)
+{
+    assert(!(img->fmt.flags & MP_IMGFLAG_HWACCEL));
+    for (int p = 0; p < img->num_planes; p++) {
+        if (bottom)
+            img->planes[p] += img->stride[p];
+        img->stride[p] *= 2;
+    }
+    if (img->params.p_w > 0 && img->params.p_h > 0)
+        img->params.p_h *= 2;
+    img->fields = 0;
+    mp_image_set_size(img, img->w, MP_ALIGN_DOWN(img->h / 2, img->fmt.align_y));
+}
+
 // Display size derived from image size and pixel aspect ratio.
 void mp_image_params_get_dsize(const struct mp_image_params *p,
                                int *d_w, int *d_h)
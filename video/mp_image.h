@@ -141,7 +141,16 @@ struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align
                                       void (*free)(void *opaque, uint8_t *data));
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
+
+enum {
+    MP_HUGEPAGES_NO = 0,
+    MP_HUGEPAGES_TRANSPARENT,   // madvise(MADV_HUGEPAGE)
+    MP_HUGEPAGES_EXPLICIT,      // MAP_HUGETLB, fallback to transparent
+};
+struct mp_image *mp_image_alloc_hugepages(int fmt, int w, int h,
+                                          int stride_align, int mode);
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
@@ -154,6 +163,7 @@ void mp_image_clear(struct mp_image *mpi, int x0, int y0, int x1, int y1);
 void mp_image_crop(struct mp_image *img, int x0, int y0, int x1, int y1);
 void mp_image_crop_rc(struct mp_image *img, struct mp_rect rc);
 void mp_image_vflip(struct mp_image *img);
+void mp_image_select_field(struct mp_image *img, bool bottom);
 
 void mp_image_set_size(struct mp_image *mpi, int w, int h);
 int mp_image_plane_w(struct mp_image *mpi, int plane);
@@ -29,6 +29,7 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "misc/thread_pool.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
@@ -42,17 +43,45 @@ static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 // can be referenced and unreferenced from other threads. (As long as the image
 // destructors are thread-safe.)
 
-struct mp_image_pool {
+// All images with the same format and size.
+struct bucket {
+    int fmt, w, h;
     struct mp_image **images;
     int num_images;
+};
 
-    int fmt, w, h;
+struct mp_image_pool {
+    struct bucket **buckets;
+    int num_buckets;
+
+    // Size of all images owned by the pool, and the limit (0 if unlimited).
+    int64_t total_bytes, max_bytes;
 
     mp_image_allocator allocator;
     void *allocator_ctx;
 
     bool use_lru;
     unsigned int lru_counter;
+
+    int hugepages;          // MP_HUGEPAGES_*
+
+    // For mp_image_hw_download().
+    struct copy_threads *copy_threads;
+};
+
+struct copy_job {
+    struct copy_threads *t;
+    struct mp_image dst, src;
+};
+
+struct copy_threads {
+    struct mp_thread_pool *pool;
+    int num_threads;            // including the caller's thread
+    struct copy_job *jobs;      // num_threads entries
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;                // number of running copy_worker() calls
 };
 
 // Used to gracefully handle the case when the pool is freed while image
@@ -64,10 +93,23 @@ struct image_flags {
     unsigned int order;         // for LRU allocation (basically a timestamp)
 };
 
+static void free_copy_threads(struct mp_image_pool *pool)
+{
+    struct copy_threads *t = pool->copy_threads;
+    if (!t)
+        return;
+    talloc_free(t->pool);
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+    talloc_free(t);
+    pool->copy_threads = NULL;
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
     mp_image_pool_clear(pool);
+    free_copy_threads(pool);
 }
 
 // If tparent!=NULL, set it as talloc parent for the pool.
@@ -79,21 +121,117 @@ struct mp_image_pool *mp_image_pool_new(void *tparent)
     return pool;
 }
 
+static int64_t image_bytes(struct mp_image *img)
+{
+    int64_t size = 0;
+    for (int n = 0; n < MP_MAX_PLANES && img->bufs[n]; n++)
+        size += img->bufs[n]->size;
+    return size;
+}
+
+static struct bucket *find_bucket(struct mp_image_pool *pool, int fmt,
+                                  int w, int h)
+{
+    for (int n = 0; n < pool->num_buckets; n++) {
+        struct bucket *b = pool->buckets[n];
+        if (b->fmt == fmt && b->w == w && b->h == h)
+            return b;
+    }
+    return NULL;
+}
+
+// Remove the image from the pool. It's freed once it's unreferenced.
+static void drop_image(struct mp_image_pool *pool, struct bucket *b, int index)
+{
+    struct mp_image *img = b->images[index];
+    struct image_flags *it = img->priv;
+    pool->total_bytes -= image_bytes(img);
+    bool referenced;
+    pool_lock();
+    assert(it->pool_alive);
+    it->pool_alive = false;
+    referenced = it->referenced;
+    pool_unlock();
+    if (!referenced)
+        talloc_free(img);
+    MP_TARRAY_REMOVE_AT(b->images, b->num_images, index);
+}
+
+static void drop_bucket(struct mp_image_pool *pool, int index)
+{
+    struct bucket *b = pool->buckets[index];
+    while (b->num_images)
+        drop_image(pool, b, b->num_images - 1);
+    talloc_free(b);
+    MP_TARRAY_REMOVE_AT(pool->buckets, pool->num_buckets, index);
+}
+
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *it = img->priv;
-        bool referenced;
+    while (pool->num_buckets)
+        drop_bucket(pool, pool->num_buckets - 1);
+    assert(!pool->total_bytes);
+}
+
+// Free unreferenced images, least recently used first, until the pool size
+// plus new_bytes is within the limit.
+static void evict_images(struct mp_image_pool *pool, int64_t new_bytes)
+{
+    while (pool->total_bytes + new_bytes > pool->max_bytes) {
+        struct bucket *best_b = NULL;
+        int best_index = -1;
+        unsigned int best_order = 0;
+
         pool_lock();
-        assert(it->pool_alive);
-        it->pool_alive = false;
-        referenced = it->referenced;
+        for (int n = 0; n < pool->num_buckets; n++) {
+            struct bucket *b = pool->buckets[n];
+            for (int i = 0; i < b->num_images; i++) {
+                struct image_flags *it = b->images[i]->priv;
+                if (!it->referenced && (!best_b || it->order < best_order)) {
+                    best_b = b;
+                    best_index = i;
+                    best_order = it->order;
+                }
+            }
+        }
         pool_unlock();
-        if (!referenced)
-            talloc_free(img);
+
+        if (!best_b)
+            break; // everything in use; allow exceeding the limit
+
+        drop_image(pool, best_b, best_index);
+        if (!best_b->num_images) {
+            for (int n = 0; n < pool->num_buckets; n++) {
+                if (pool->buckets[n] == best_b) {
+                    drop_bucket(pool, n);
+                    break;
+                }
+            }
+        }
     }
-    pool->num_images = 0;
+}
+
+// Free all images that are currently not referenced. The pool can still be used
+// normally, new images are allocated on demand.
+void mp_image_pool_trim(struct mp_image_pool *pool)
+{
+    int64_t max_bytes = pool->max_bytes;
+    pool->max_bytes = 0;
+    evict_images(pool, 0);
+    pool->max_bytes = max_bytes;
+}
+
+// Limit the total size of the images owned by the pool. If this is set,
+// images of other formats and sizes are kept for reuse (e.g. for streams that
+// switch resolutions), and the least recently used unreferenced images are
+// freed when a new image would exceed the limit. (Images still in use are
+// never freed, so the limit can be exceeded temporarily.) If 0 (default), all
+// images of other formats/sizes are dropped when allocating a new image.
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, int64_t bytes)
+{
+    pool->max_bytes = bytes;
+    if (bytes)
+        evict_images(pool, 0);
 }
 
 // This is the only function that is allowed to run in a different thread.
@@ -117,22 +255,24 @@ static void unref_image(void *opaque, uint8_t *data)
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
+    struct bucket *b = find_bucket(pool, fmt, w, h);
+    if (!b)
+        return NULL;
+
     struct mp_image *new = NULL;
     pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
+    for (int n = 0; n < b->num_images; n++) {
+        struct mp_image *img = b->images[n];
         struct image_flags *img_it = img->priv;
         assert(img_it->pool_alive);
         if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
+            if (pool->use_lru) {
+                struct image_flags *new_it = new ? new->priv : NULL;
+                if (!new_it || new_it->order > img_it->order)
                     new = img;
-                    break;
-                }
+            } else {
+                new = img;
+                break;
             }
         }
     }
@@ -171,7 +311,15 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
     struct image_flags *it = talloc_ptrtype(new, it);
     *it = (struct image_flags) { .pool_alive = true };
     new->priv = it;
-    MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+
+    struct bucket *b = find_bucket(pool, new->imgfmt, new->w, new->h);
+    if (!b) {
+        b = talloc_ptrtype(pool, b);
+        *b = (struct bucket){ .fmt = new->imgfmt, .w = new->w, .h = new->h };
+        MP_TARRAY_APPEND(pool, pool->buckets, pool->num_buckets, b);
+    }
+    MP_TARRAY_APPEND(b, b->images, b->num_images, new);
+    pool->total_bytes += image_bytes(new);
 }
 
 // Return a new image of given format/size. The only difference to
@@ -187,18 +335,24 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
         return mp_image_alloc(fmt, w, h);
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     if (!new) {
-        if (fmt != pool->fmt || w != pool->w || h != pool->h)
-            mp_image_pool_clear(pool);
-        pool->fmt = fmt;
-        pool->w = w;
-        pool->h = h;
+        if (!pool->max_bytes) {
+            for (int n = pool->num_buckets - 1; n >= 0; n--) {
+                struct bucket *b = pool->buckets[n];
+                if (b->fmt != fmt || b->w != w || b->h != h)
+                    drop_bucket(pool, n);
+            }
+        }
         if (pool->allocator) {
             new = pool->allocator(pool->allocator_ctx, fmt, w, h);
         } else {
-            new = mp_image_alloc(fmt, w, h);
+            new = mp_image_alloc_hugepages(fmt, w, h, 0, pool->hugepages);
+            if (!new)
+                new = mp_image_alloc(fmt, w, h);
         }
         if (!new)
             return NULL;
+        if (pool->max_bytes)
+            evict_images(pool, image_bytes(new));
         mp_image_pool_add(pool, new);
         new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     }
@@ -253,6 +407,130 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
     pool->use_lru = true;
 }
 
+// Allocate new images with huge pages (mode is a MP_HUGEPAGES_* value), if the
+// image is large enough. Not used with mp_image_pool_set_allocator().
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, int mode)
+{
+    pool->hugepages = mode;
+}
+
+// Use the given number of threads to copy images in mp_image_hw_download(),
+// if it downloads into this pool. threads<=1 disables threading.
+void mp_image_pool_set_copy_threads(struct mp_image_pool *pool, int threads)
+{
+    if (pool->copy_threads && pool->copy_threads->num_threads == threads)
+        return;
+
+    free_copy_threads(pool);
+    if (threads <= 1)
+        return;
+
+    struct copy_threads *t = talloc_zero(pool, struct copy_threads);
+    t->num_threads = threads;
+    t->jobs = talloc_zero_array(t, struct copy_job, threads);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    pool->copy_threads = t;
+
+    t->pool = mp_thread_pool_create(t, threads - 1);
+    if (!t->pool)
+        free_copy_threads(pool);
+}
+
+static void copy_worker(void *p)
+{
+    struct copy_job *job = p;
+    struct copy_threads *t = job->t;
+
+    mp_image_copy_gpu(&job->dst, &job->src);
+
+    pthread_mutex_lock(&t->lock);
+    t->pending -= 1;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Copy the image in horizontal slices, one per thread.
+static void copy_threaded(struct copy_threads *t, struct mp_image *dst,
+                          struct mp_image *src)
+{
+    int align = src->fmt.align_y;
+    int num = MPMIN(t->num_threads, src->h / MPMAX(align, 16));
+    if (num < 2) {
+        mp_image_copy_gpu(dst, src);
+        return;
+    }
+
+    for (int n = 0; n < num; n++) {
+        struct copy_job *job = &t->jobs[n];
+        int y0 = (src->h * n / num) & ~(align - 1);
+        int y1 = (src->h * (n + 1) / num) & ~(align - 1);
+        if (n == num - 1)
+            y1 = src->h;
+        job->t = t;
+        job->src = *src;
+        mp_image_crop(&job->src, 0, y0, src->w, y1);
+        job->dst = *dst;
+        mp_image_crop(&job->dst, 0, y0, dst->w, y1);
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->pending = num - 1;
+    pthread_mutex_unlock(&t->lock);
+
+    for (int n = 1; n < num; n++)
+        mp_thread_pool_queue(t->pool, copy_worker, &t->jobs[n]);
+
+    mp_image_copy_gpu(&t->jobs[0].dst, &t->jobs[0].src);
+
+    pthread_mutex_lock(&t->lock);
+    while (t->pending)
+        pthread_cond_wait(&t->wakeup, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Map the HW surface and copy it into a new image. This avoids the plain
+// memcpy() libavutil uses to read the (usually uncacheable) mapped memory.
+static struct mp_image *hw_download_mapped(struct mp_image *src,
+                                           struct mp_image_pool *swpool)
+{
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    AVFrame *mapped = av_frame_alloc();
+    struct mp_image *mapped_img = NULL;
+    struct mp_image *dst = NULL;
+    if (!srcav || !mapped)
+        goto done;
+
+    mapped->format = AV_PIX_FMT_NONE;
+    if (av_hwframe_map(mapped, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    mapped_img = mp_image_from_av_frame(mapped);
+    if (!mapped_img || !mapped_img->imgfmt ||
+        (mapped_img->fmt.flags & (MP_IMGFLAG_HWACCEL | MP_IMGFLAG_PAL)))
+        goto done;
+
+    dst = mp_image_pool_get(swpool, mapped_img->imgfmt,
+                            mapped_img->w, mapped_img->h);
+    if (!dst)
+        goto done;
+
+    if (swpool && swpool->copy_threads) {
+        copy_threaded(swpool->copy_threads, dst, mapped_img);
+    } else {
+        mp_image_copy_gpu(dst, mapped_img);
+    }
+
+    mp_image_set_size(dst, src->w, src->h);
+    mp_image_copy_attributes(dst, src);
+
+done:
+    talloc_free(mapped_img);
+    av_frame_free(&mapped);
+    av_frame_free(&srcav);
+    return dst;
+}
+
 
 // Copies the contents of the HW surface img to system memory and retuns it.
 // If swpool is not NULL, it's used to allocate the target image.
@@ -266,6 +544,10 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
         return NULL;
     AVHWFramesContext *fctx = (void *)src->hwctx->data;
 
+    struct mp_image *mapped = hw_download_mapped(src, swpool);
+    if (mapped)
+        return mapped;
+
     // Try to find the first format which we can apparently use.
     int imgfmt = 0;
     enum AVPixelFormat *fmts;
@@ -2,6 +2,7 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -11,8 +12,12 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
 // the reference to "new" is transferred to the pool
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new);
 void mp_image_pool_clear(struct mp_image_pool *pool);
+void mp_image_pool_trim(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, int64_t bytes);
+void mp_image_pool_set_copy_threads(struct mp_image_pool *pool, int threads);
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, int mode);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
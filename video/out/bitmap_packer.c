@@ -197,3 +197,172 @@ void packer_set_size(struct bitmap_packer *packer, int size)
     packer->scratch = talloc_array_ptrtype(packer, packer->scratch,
                                            packer->asize + 16);
 }
+
+struct inc_packer_node {
+    int x, y, w;
+};
+
+void inc_packer_reset(struct inc_packer *packer)
+{
+    int pad = packer->padding;
+    packer->num_skyline = 0;
+    packer->num_free_rects = 0;
+    MP_TARRAY_APPEND(packer, packer->skyline, packer->num_skyline,
+                     (struct inc_packer_node){pad, pad, packer->w - pad});
+}
+
+static void add_free_rect(struct inc_packer *packer, struct mp_rect rc)
+{
+    if (rc.x1 > rc.x0 && rc.y1 > rc.y0)
+        MP_TARRAY_APPEND(packer, packer->free_rects, packer->num_free_rects, rc);
+}
+
+// Merge free rectangles which share a complete edge.
+static void merge_free_rects(struct inc_packer *packer)
+{
+    struct mp_rect *r = packer->free_rects;
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < packer->num_free_rects && !merged; i++) {
+            for (int j = i + 1; j < packer->num_free_rects; j++) {
+                struct mp_rect a = r[i], b = r[j];
+                bool vert = a.x0 == b.x0 && a.x1 == b.x1 &&
+                            (a.y1 == b.y0 || b.y1 == a.y0);
+                bool horiz = a.y0 == b.y0 && a.y1 == b.y1 &&
+                             (a.x1 == b.x0 || b.x1 == a.x0);
+                if (vert || horiz) {
+                    mp_rect_union(&r[i], &b);
+                    MP_TARRAY_REMOVE_AT(r, packer->num_free_rects, j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Best short side fit among the free rectangles.
+static bool insert_free(struct inc_packer *packer, int w, int h,
+                        struct pos *out)
+{
+    int best = -1, best_score = INT_MAX;
+    for (int n = 0; n < packer->num_free_rects; n++) {
+        struct mp_rect *rc = &packer->free_rects[n];
+        int fw = mp_rect_w(*rc), fh = mp_rect_h(*rc);
+        if (fw < w || fh < h)
+            continue;
+        int score = FFMIN(fw - w, fh - h);
+        if (score < best_score) {
+            best = n;
+            best_score = score;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    struct mp_rect rc = packer->free_rects[best];
+    MP_TARRAY_REMOVE_AT(packer->free_rects, packer->num_free_rects, best);
+
+    // Split along the shorter leftover axis, which keeps the larger of the
+    // two remaining rectangles as big as possible.
+    struct mp_rect right, bottom;
+    if (mp_rect_w(rc) - w < mp_rect_h(rc) - h) {
+        right = (struct mp_rect){rc.x0 + w, rc.y0, rc.x1, rc.y0 + h};
+        bottom = (struct mp_rect){rc.x0, rc.y0 + h, rc.x1, rc.y1};
+    } else {
+        right = (struct mp_rect){rc.x0 + w, rc.y0, rc.x1, rc.y1};
+        bottom = (struct mp_rect){rc.x0, rc.y0 + h, rc.x0 + w, rc.y1};
+    }
+    add_free_rect(packer, right);
+    add_free_rect(packer, bottom);
+
+    *out = (struct pos){rc.x0, rc.y0};
+    return true;
+}
+
+// Return the y coordinate at which a w*h rectangle starting at skyline node i
+// can be placed, or -1 if it doesn't fit.
+static int skyline_fit(struct inc_packer *packer, int i, int w, int h)
+{
+    if (packer->skyline[i].x + w > packer->w)
+        return -1;
+    int y = 0;
+    for (int left = w; left > 0; i++) {
+        assert(i < packer->num_skyline);
+        y = FFMAX(y, packer->skyline[i].y);
+        if (y + h > packer->h)
+            return -1;
+        left -= packer->skyline[i].w;
+    }
+    return y;
+}
+
+static bool insert_skyline(struct inc_packer *packer, int w, int h,
+                           struct pos *out)
+{
+    struct inc_packer_node *sl = packer->skyline;
+    int best = -1, best_y = 0, best_bottom = INT_MAX, best_w = INT_MAX;
+    for (int n = 0; n < packer->num_skyline; n++) {
+        int y = skyline_fit(packer, n, w, h);
+        if (y < 0)
+            continue;
+        if (y + h < best_bottom || (y + h == best_bottom && sl[n].w < best_w)) {
+            best = n;
+            best_y = y;
+            best_bottom = y + h;
+            best_w = sl[n].w;
+        }
+    }
+    if (best < 0)
+        return false;
+
+    int x = sl[best].x, right = x + w;
+
+    // Remove the covered nodes. The space between them and the new rectangle
+    // can't be reached from the skyline anymore.
+    while (best < packer->num_skyline && sl[best].x < right) {
+        struct inc_packer_node *node = &sl[best];
+        int end = node->x + node->w;
+        add_free_rect(packer, (struct mp_rect){node->x, node->y,
+                                               FFMIN(end, right), best_y});
+        if (end > right) {
+            node->w = end - right;
+            node->x = right;
+            break;
+        }
+        MP_TARRAY_REMOVE_AT(sl, packer->num_skyline, best);
+    }
+    MP_TARRAY_INSERT_AT(packer, packer->skyline, packer->num_skyline, best,
+                        (struct inc_packer_node){x, best_y + h, w});
+    sl = packer->skyline;
+
+    // Merge neighbours with the same height.
+    for (int n = packer->num_skyline - 1; n > 0; n--) {
+        if (sl[n - 1].y == sl[n].y) {
+            sl[n - 1].w += sl[n].w;
+            MP_TARRAY_REMOVE_AT(sl, packer->num_skyline, n);
+        }
+    }
+
+    *out = (struct pos){x, best_y};
+    return true;
+}
+
+bool inc_packer_insert(struct inc_packer *packer, int w, int h,
+                       struct pos *out)
+{
+    w += packer->padding;
+    h += packer->padding;
+    if (w <= packer->padding || h <= packer->padding)
+        return false;
+    return insert_free(packer, w, h, out) || insert_skyline(packer, w, h, out);
+}
+
+void inc_packer_remove(struct inc_packer *packer, struct pos pos, int w, int h)
+{
+    add_free_rect(packer, (struct mp_rect){pos.x, pos.y,
+                                           pos.x + w + packer->padding,
+                                           pos.y + h + packer->padding});
+    merge_free_rects(packer);
+}
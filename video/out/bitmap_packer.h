@@ -1,6 +1,10 @@
 #ifndef MPLAYER_PACK_RECTANGLES_H
 #define MPLAYER_PACK_RECTANGLES_H
 
+#include <stdbool.h>
+
+struct mp_rect;
+
 struct pos {
     int x;
     int y;
@@ -48,4 +52,34 @@ void packer_set_size(struct bitmap_packer *packer, int size);
  */
 int packer_pack(struct bitmap_packer *packer);
 
+/* Incremental packer: rectangles are inserted and removed one by one, and the
+ * position of a rectangle never changes while it's in use. New rectangles are
+ * placed with a bottom-left skyline heuristic. Space below the skyline which
+ * can't be reached anymore, and the space of removed rectangles, is kept as a
+ * list of free rectangles, which are split guillotine-style when reused.
+ * Set w, h and padding, then call inc_packer_reset() before use.
+ */
+struct inc_packer {
+    int w;
+    int h;
+    int padding;    // empty space kept between rectangles and the border
+
+    // internal
+    struct inc_packer_node *skyline;
+    int num_skyline;
+    struct mp_rect *free_rects;
+    int num_free_rects;
+};
+
+// Remove all rectangles. Must be called after changing w, h or padding.
+void inc_packer_reset(struct inc_packer *packer);
+
+// Find space for a w*h rectangle, and write its position to *out.
+// Return false if there is not enough space left.
+bool inc_packer_insert(struct inc_packer *packer, int w, int h,
+                       struct pos *out);
+
+// Release a rectangle returned by inc_packer_insert(), with the same size.
+void inc_packer_remove(struct inc_packer *packer, struct pos pos, int w, int h);
+
 #endif
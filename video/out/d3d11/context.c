@@ -17,6 +17,7 @@
 
 #include "common/msg.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 #include "osdep/windows_utils.h"
 
 #include "video/out/gpu/context.h"
@@ -30,6 +31,7 @@ struct d3d11_opts {
     int warp;
     int flip;
     int sync_interval;
+    int deferred;
 };
 
 #define OPT_BASE_STRUCT struct d3d11_opts
@@ -51,6 +53,7 @@ const struct m_sub_options d3d11_conf = {
                     {"9_1", D3D_FEATURE_LEVEL_9_1})),
         OPT_FLAG("d3d11-flip", flip, 0),
         OPT_INTRANGE("d3d11-sync-interval", sync_interval, 0, 0, 4),
+        OPT_FLAG("d3d11-deferred-context", deferred, 0),
         {0}
     },
     .defaults = &(const struct d3d11_opts) {
@@ -68,6 +71,11 @@ struct priv {
     struct ra_tex *backbuffer;
     ID3D11Device *device;
     IDXGISwapChain *swapchain;
+
+    int64_t perf_freq;
+    unsigned last_sync_refresh_count;
+    int64_t last_sync_qpc_time;
+    int64_t vsync_duration_qpc;
 };
 
 static struct ra_tex *get_backbuffer(struct ra_ctx *ctx)
@@ -147,6 +155,72 @@ static void d3d11_swap_buffers(struct ra_swapchain *sw)
     IDXGISwapChain_Present(p->swapchain, p->opts->sync_interval, 0);
 }
 
+static int64_t qpc_to_us(struct ra_swapchain *sw, int64_t qpc)
+{
+    struct priv *p = sw->priv;
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    int64_t delta = now.QuadPart - qpc;
+    return mp_time_us() - delta * INT64_C(1000000) / p->perf_freq;
+}
+
+static void d3d11_get_vsync(struct ra_swapchain *sw, struct vo_vsync_info *info)
+{
+    struct priv *p = sw->priv;
+    HRESULT hr;
+
+    if (!p->opts->sync_interval)
+        return;
+
+    // Sequential ID of the frame submitted by the last Present() call
+    UINT submit_count;
+    hr = IDXGISwapChain_GetLastPresentCount(p->swapchain, &submit_count);
+    if (FAILED(hr))
+        return;
+
+    // (PresentCount, PresentRefreshCount) relates a present ID to the vsync it
+    // was displayed on, (SyncRefreshCount, SyncQPCTime) relates a vsync to a
+    // QueryPerformanceCounter() timestamp.
+    DXGI_FRAME_STATISTICS stats;
+    hr = IDXGISwapChain_GetFrameStatistics(p->swapchain, &stats);
+    if (hr == DXGI_ERROR_FRAME_STATISTICS_DISJOINT) {
+        p->last_sync_refresh_count = 0;
+        p->last_sync_qpc_time = 0;
+        p->vsync_duration_qpc = 0;
+    }
+    if (FAILED(hr))
+        return;
+
+    // Some drivers return S_OK with all members set to 0.
+    if (p->last_sync_refresh_count && p->last_sync_qpc_time &&
+        stats.SyncRefreshCount > p->last_sync_refresh_count &&
+        stats.SyncQPCTime.QuadPart > p->last_sync_qpc_time)
+    {
+        int64_t vsyncs = stats.SyncRefreshCount - p->last_sync_refresh_count;
+        int64_t duration = stats.SyncQPCTime.QuadPart - p->last_sync_qpc_time;
+        int64_t cur = duration / vsyncs;
+        // Smooth out the jitter of single measurements.
+        p->vsync_duration_qpc = p->vsync_duration_qpc
+                              ? (p->vsync_duration_qpc * 7 + cur) / 8 : cur;
+    }
+    p->last_sync_refresh_count = stats.SyncRefreshCount;
+    p->last_sync_qpc_time = stats.SyncQPCTime.QuadPart;
+
+    if (!p->vsync_duration_qpc || !stats.PresentCount ||
+        submit_count < stats.PresentCount)
+        return;
+
+    // Frames queued after the last displayed one are assumed to show up on
+    // every sync_interval-th vsync following it.
+    int64_t vsyncs = stats.SyncRefreshCount - stats.PresentRefreshCount;
+    int64_t queued = (int64_t)(submit_count - stats.PresentCount) *
+                     p->opts->sync_interval;
+    int64_t qpc = stats.SyncQPCTime.QuadPart +
+                  (queued - vsyncs) * p->vsync_duration_qpc;
+    info->last_queue_display_time = qpc_to_us(sw, qpc);
+}
+
 static int d3d11_control(struct ra_ctx *ctx, int *events, int request, void *arg)
 {
     int ret = vo_w32_control(ctx->vo, events, request, arg);
@@ -176,6 +250,7 @@ static const struct ra_swapchain_fns d3d11_swapchain = {
     .start_frame  = d3d11_start_frame,
     .submit_frame = d3d11_submit_frame,
     .swap_buffers = d3d11_swap_buffers,
+    .get_vsync    = d3d11_get_vsync,
 };
 
 static bool d3d11_init(struct ra_ctx *ctx)
@@ -183,6 +258,10 @@ static bool d3d11_init(struct ra_ctx *ctx)
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
     p->opts = mp_get_config_group(ctx, ctx->global, &d3d11_conf);
 
+    LARGE_INTEGER perf_freq;
+    QueryPerformanceFrequency(&perf_freq);
+    p->perf_freq = perf_freq.QuadPart;
+
     struct ra_swapchain *sw = ctx->swapchain = talloc_zero(ctx, struct ra_swapchain);
     sw->priv = p;
     sw->ctx = ctx;
@@ -200,7 +279,8 @@ static bool d3d11_init(struct ra_ctx *ctx)
 
     if (!spirv_compiler_init(ctx))
         goto error;
-    ctx->ra = ra_d3d11_create(p->device, ctx->log, ctx->spirv);
+    ctx->ra = ra_d3d11_create(p->device, ctx->log, ctx->spirv,
+                              p->opts->deferred);
     if (!ctx->ra)
         goto error;
 
@@ -214,7 +294,9 @@ static bool d3d11_init(struct ra_ctx *ctx)
         .flip = p->opts->flip,
         // Add one frame for the backbuffer and one frame of "slack" to reduce
         // contention with the window manager when acquiring the backbuffer
-        .length = ctx->opts.swapchain_depth + 2,
+        // (except in low latency mode, where the slack frame is dropped)
+        .length = ctx->opts.swapchain_depth + 2 -
+                  (ctx->opts.swapchain_latency == SWAPCHAIN_LATENCY_LOW),
         .usage = DXGI_USAGE_RENDER_TARGET_OUTPUT,
     };
     if (!mp_d3d11_create_swapchain(p->device, ctx->log, &scopts, &p->swapchain))
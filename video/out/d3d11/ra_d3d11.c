@@ -32,8 +32,13 @@ struct ra_d3d11 {
 
     ID3D11Device *dev;
     ID3D11Device1 *dev1;
+    // All rendering is recorded on ctx. Normally this is the immediate
+    // context, but with deferred contexts enabled, it's a deferred context
+    // whose command list is executed on imm in ra_d3d11_flush().
     ID3D11DeviceContext *ctx;
     ID3D11DeviceContext1 *ctx1;
+    ID3D11DeviceContext *imm;
+    bool deferred;
     pD3DCompile D3DCompile;
 
     struct dll_version d3d_compiler_ver;
@@ -48,10 +53,14 @@ struct ra_d3d11 {
     bool has_timestamp_queries;
     int max_uavs;
 
+    // The rasterizer state never changes, but command lists don't inherit it
+    ID3D11RasterizerState *rstate;
+
     // Streaming dynamic vertex buffer, which is used for all renderpasses
     ID3D11Buffer *vbuf;
     size_t vbuf_size;
     size_t vbuf_used;
+    bool vbuf_discard; // The next map must discard (e.g. new command list)
 
     // clear() renderpass resources (only used when has_clear_view is false)
     ID3D11PixelShader *clear_ps;
@@ -675,6 +684,31 @@ static bool tex_upload(struct ra *ra, const struct ra_tex_upload_params *params)
     return true;
 }
 
+// Execute everything recorded on the deferred context so far (if any)
+static void execute_deferred(struct ra *ra)
+{
+    struct ra_d3d11 *p = ra->priv;
+    HRESULT hr;
+
+    if (!p->deferred)
+        return;
+
+    ID3D11CommandList *list = NULL;
+    hr = ID3D11DeviceContext_FinishCommandList(p->ctx, FALSE, &list);
+    if (FAILED(hr)) {
+        MP_ERR(ra, "Failed to finish command list: %s\n",
+               mp_HRESULT_to_str(hr));
+        return;
+    }
+    ID3D11DeviceContext_ExecuteCommandList(p->imm, list, FALSE);
+    SAFE_RELEASE(list);
+
+    // FinishCommandList() reset the deferred context state, and the first
+    // map of a dynamic resource in a command list must discard it
+    ID3D11DeviceContext_RSSetState(p->ctx, p->rstate);
+    p->vbuf_discard = true;
+}
+
 static bool tex_download(struct ra *ra, struct ra_tex_download_params *params)
 {
     struct ra_d3d11 *p = ra->priv;
@@ -685,11 +719,15 @@ static bool tex_download(struct ra *ra, struct ra_tex_download_params *params)
     if (!tex_p->staging)
         return false;
 
-    ID3D11DeviceContext_CopyResource(p->ctx, (ID3D11Resource*)tex_p->staging,
+    // Reading back is only possible on the immediate context, so the
+    // rendering that produced the texture contents has to be executed first
+    execute_deferred(ra);
+
+    ID3D11DeviceContext_CopyResource(p->imm, (ID3D11Resource*)tex_p->staging,
         tex_p->res);
 
     D3D11_MAPPED_SUBRESOURCE lock;
-    hr = ID3D11DeviceContext_Map(p->ctx, (ID3D11Resource*)tex_p->staging, 0,
+    hr = ID3D11DeviceContext_Map(p->imm, (ID3D11Resource*)tex_p->staging, 0,
                                  D3D11_MAP_READ, 0, &lock);
     if (FAILED(hr)) {
         MP_ERR(ra, "Failed to map staging texture: %s\n", mp_HRESULT_to_str(hr));
@@ -703,7 +741,7 @@ static bool tex_download(struct ra *ra, struct ra_tex_download_params *params)
                MPMIN(params->stride, lock.RowPitch));
     }
 
-    ID3D11DeviceContext_Unmap(p->ctx, (ID3D11Resource*)tex_p->staging, 0);
+    ID3D11DeviceContext_Unmap(p->imm, (ID3D11Resource*)tex_p->staging, 0);
 
     return true;
 }
@@ -1393,7 +1431,7 @@ static size_t vbuf_upload(struct ra *ra, void *data, size_t size)
 
     bool discard = false;
     size_t offset = p->vbuf_used;
-    if (offset + size > p->vbuf_size) {
+    if (offset + size > p->vbuf_size || p->vbuf_discard) {
         // We reached the end of the buffer, so discard and wrap around
         discard = true;
         offset = 0;
@@ -1414,6 +1452,7 @@ static size_t vbuf_upload(struct ra *ra, void *data, size_t size)
     ID3D11DeviceContext_Unmap(p->ctx, (ID3D11Resource *)p->vbuf, 0);
 
     p->vbuf_used = offset + size;
+    p->vbuf_discard = false;
     return offset;
 }
 
@@ -1956,17 +1995,17 @@ static uint64_t timer_get_result(struct ra *ra, ra_timer *ratimer)
     UINT64 start, end;
     D3D11_QUERY_DATA_TIMESTAMP_DISJOINT dj;
 
-    hr = ID3D11DeviceContext_GetData(p->ctx,
+    hr = ID3D11DeviceContext_GetData(p->imm,
         (ID3D11Asynchronous *)timer->ts_end, &end, sizeof(end),
         D3D11_ASYNC_GETDATA_DONOTFLUSH);
     if (FAILED(hr) || hr == S_FALSE)
         return 0;
-    hr = ID3D11DeviceContext_GetData(p->ctx,
+    hr = ID3D11DeviceContext_GetData(p->imm,
         (ID3D11Asynchronous *)timer->ts_start, &start, sizeof(start),
         D3D11_ASYNC_GETDATA_DONOTFLUSH);
     if (FAILED(hr) || hr == S_FALSE)
         return 0;
-    hr = ID3D11DeviceContext_GetData(p->ctx,
+    hr = ID3D11DeviceContext_GetData(p->imm,
         (ID3D11Asynchronous *)timer->disjoint, &dj, sizeof(dj),
         D3D11_ASYNC_GETDATA_DONOTFLUSH);
     if (FAILED(hr) || hr == S_FALSE || dj.Disjoint || !dj.Frequency)
@@ -2070,17 +2109,22 @@ static void destroy(struct ra *ra)
     SAFE_RELEASE(p->blit_vbuf);
     SAFE_RELEASE(p->blit_sampler);
     SAFE_RELEASE(p->vbuf);
+    SAFE_RELEASE(p->rstate);
     SAFE_RELEASE(p->ctx1);
     SAFE_RELEASE(p->dev1);
     SAFE_RELEASE(p->dev);
 
-    if (p->debug && p->ctx) {
+    if (p->deferred && p->ctx)
+        ID3D11DeviceContext_ClearState(p->ctx);
+    SAFE_RELEASE(p->ctx);
+
+    if (p->debug && p->imm) {
         // Destroy the device context synchronously so referenced objects don't
         // show up in the leak check
-        ID3D11DeviceContext_ClearState(p->ctx);
-        ID3D11DeviceContext_Flush(p->ctx);
+        ID3D11DeviceContext_ClearState(p->imm);
+        ID3D11DeviceContext_Flush(p->imm);
     }
-    SAFE_RELEASE(p->ctx);
+    SAFE_RELEASE(p->imm);
 
     if (p->debug) {
         // Report any leaked objects
@@ -2122,7 +2166,8 @@ static struct ra_fns ra_fns_d3d11 = {
 void ra_d3d11_flush(struct ra *ra)
 {
     struct ra_d3d11 *p = ra->priv;
-    ID3D11DeviceContext_Flush(p->ctx);
+    execute_deferred(ra);
+    ID3D11DeviceContext_Flush(p->imm);
 }
 
 static void init_debug_layer(struct ra *ra)
@@ -2259,7 +2304,7 @@ static void find_max_texture_dimension(struct ra *ra)
 }
 
 struct ra *ra_d3d11_create(ID3D11Device *dev, struct mp_log *log,
-                           struct spirv_compiler *spirv)
+                           struct spirv_compiler *spirv, bool deferred)
 {
     HRESULT hr;
 
@@ -2280,12 +2325,39 @@ struct ra *ra_d3d11_create(ID3D11Device *dev, struct mp_log *log,
     int minor = 0;
     ID3D11Device_AddRef(dev);
     p->dev = dev;
-    ID3D11Device_GetImmediateContext(p->dev, &p->ctx);
+    ID3D11Device_GetImmediateContext(p->dev, &p->imm);
+
+    if (deferred) {
+        // Without driver support, the runtime emulates command lists, which
+        // only adds CPU overhead
+        D3D11_FEATURE_DATA_THREADING topts = { 0 };
+        hr = ID3D11Device_CheckFeatureSupport(p->dev, D3D11_FEATURE_THREADING,
+                                              &topts, sizeof(topts));
+        if (FAILED(hr) || !topts.DriverCommandLists) {
+            MP_WARN(ra, "Driver doesn't support command lists, not using a "
+                    "deferred context\n");
+        } else {
+            hr = ID3D11Device_CreateDeferredContext(p->dev, 0, &p->ctx);
+            if (FAILED(hr)) {
+                MP_WARN(ra, "Failed to create deferred context: %s\n",
+                        mp_HRESULT_to_str(hr));
+            } else {
+                MP_VERBOSE(ra, "Using a deferred context for rendering\n");
+                p->deferred = true;
+            }
+        }
+    }
+    if (!p->deferred) {
+        p->ctx = p->imm;
+        ID3D11DeviceContext_AddRef(p->ctx);
+    }
+
     hr = ID3D11Device_QueryInterface(p->dev, &IID_ID3D11Device1,
                                      (void**)&p->dev1);
     if (SUCCEEDED(hr)) {
         minor = 1;
-        ID3D11Device1_GetImmediateContext1(p->dev1, &p->ctx1);
+        ID3D11DeviceContext_QueryInterface(p->ctx, &IID_ID3D11DeviceContext1,
+                                           (void**)&p->ctx1);
 
         D3D11_FEATURE_DATA_D3D11_OPTIONS fopts = { 0 };
         hr = ID3D11Device_CheckFeatureSupport(p->dev,
@@ -2352,7 +2424,6 @@ struct ra *ra_d3d11_create(ID3D11Device *dev, struct mp_log *log,
     setup_formats(ra);
 
     // The rasterizer state never changes, so set it up here
-    ID3D11RasterizerState *rstate;
     D3D11_RASTERIZER_DESC rdesc = {
         .FillMode = D3D11_FILL_SOLID,
         .CullMode = D3D11_CULL_NONE,
@@ -2360,13 +2431,12 @@ struct ra *ra_d3d11_create(ID3D11Device *dev, struct mp_log *log,
         .DepthClipEnable = TRUE, // Required for 10level9
         .ScissorEnable = TRUE,
     };
-    hr = ID3D11Device_CreateRasterizerState(p->dev, &rdesc, &rstate);
+    hr = ID3D11Device_CreateRasterizerState(p->dev, &rdesc, &p->rstate);
     if (FAILED(hr)) {
         MP_ERR(ra, "Failed to create rasterizer state: %s\n", mp_HRESULT_to_str(hr));
         goto error;
     }
-    ID3D11DeviceContext_RSSetState(p->ctx, rstate);
-    SAFE_RELEASE(rstate);
+    ID3D11DeviceContext_RSSetState(p->ctx, p->rstate);
 
     // If the device doesn't support ClearView, we have to set up a
     // shader-based clear() implementation
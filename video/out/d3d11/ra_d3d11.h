@@ -9,11 +9,14 @@
 #include "video/out/gpu/spirv.h"
 
 // Create an RA instance from a D3D11 device. This takes a reference to the
-// device, which is released when the RA instance is destroyed.
+// device, which is released when the RA instance is destroyed. If deferred is
+// set, rendering is recorded on a deferred context (if the driver supports
+// command lists), and only executed by ra_d3d11_flush().
 struct ra *ra_d3d11_create(ID3D11Device *device, struct mp_log *log,
-                           struct spirv_compiler *spirv);
+                           struct spirv_compiler *spirv, bool deferred);
 
-// Flush the immediate context of the wrapped D3D11 device
+// Execute pending rendering and flush the immediate context of the wrapped
+// D3D11 device
 void ra_d3d11_flush(struct ra *ra);
 
 // Create an RA texture from a D3D11 resource. This takes a reference to the
@@ -15,24 +15,58 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdbool.h>
 #include <unistd.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <drm_fourcc.h>
 
 #include "common/msg.h"
 #include "drm_common.h"
 #include "drm_prime.h"
 
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID ((1ULL << 56) - 1)
+#endif
+
+// Descriptors exported with one layer per plane (e.g. by VAAPI) describe a
+// multi-planar format as separate single-plane layers. Return the fourcc of
+// the combined format, or 0 if unknown.
+static uint32_t get_combined_format(AVDRMFrameDescriptor *descriptor)
+{
+    if (descriptor->nb_layers == 1)
+        return descriptor->layers[0].format;
+
+    if (descriptor->nb_layers == 2) {
+        uint32_t luma = descriptor->layers[0].format;
+        uint32_t chroma = descriptor->layers[1].format;
+        if (luma == DRM_FORMAT_R8 && chroma == DRM_FORMAT_GR88)
+            return DRM_FORMAT_NV12;
+#if defined(DRM_FORMAT_P010) && defined(DRM_FORMAT_R16) && defined(DRM_FORMAT_GR1616)
+        if (luma == DRM_FORMAT_R16 && chroma == DRM_FORMAT_GR1616)
+            return DRM_FORMAT_P010;
+#endif
+    }
+
+    return 0;
+}
+
 int drm_prime_create_framebuffer(struct mp_log *log, int fd, AVDRMFrameDescriptor *descriptor, int width, int height,
                                   struct  drm_prime_framebuffer *framebuffer)
 {
-    AVDRMLayerDescriptor *layer = NULL;
-    uint32_t pitches[4], offsets[4], handles[4];
-    int ret, layer_fd;
+    uint32_t pitches[4] = {0}, offsets[4] = {0}, handles[4] = {0};
+    uint64_t modifiers[4] = {0};
+    int ret, num_planes = 0;
 
     if (descriptor && descriptor->nb_layers) {
         *framebuffer = (struct drm_prime_framebuffer){0};
 
+        uint32_t format = get_combined_format(descriptor);
+        if (!format) {
+            mp_err(log, "Unsupported DRM layer configuration.\n");
+            goto fail;
+        }
+
         for (int object = 0; object < descriptor->nb_objects; object++) {
             ret = drmPrimeFDToHandle(fd, descriptor->objects[object].fd, &framebuffer->gem_handles[object]);
             if (ret < 0) {
@@ -41,25 +75,36 @@ int drm_prime_create_framebuffer(struct mp_log *log, int fd, AVDRMFrameDescripto
             }
         }
 
-        layer = &descriptor->layers[0];
-
-        for (int plane = 0; plane < AV_DRM_MAX_PLANES; plane++) {
-            layer_fd = framebuffer->gem_handles[layer->planes[plane].object_index];
-            if (layer_fd && layer->planes[plane].pitch) {
-                pitches[plane] = layer->planes[plane].pitch;
-                offsets[plane] = layer->planes[plane].offset;
-                handles[plane] = layer_fd;
-            } else {
-                pitches[plane] = 0;
-                offsets[plane] = 0;
-                handles[plane] = 0;
+        bool use_modifiers = false;
+        for (int l = 0; l < descriptor->nb_layers; l++) {
+            AVDRMLayerDescriptor *layer = &descriptor->layers[l];
+            for (int plane = 0; plane < layer->nb_planes; plane++) {
+                if (num_planes >= 4) {
+                    mp_err(log, "Too many planes in DRM frame.\n");
+                    goto fail;
+                }
+                AVDRMPlaneDescriptor *pd = &layer->planes[plane];
+                uint64_t mod = descriptor->objects[pd->object_index].format_modifier;
+                pitches[num_planes] = pd->pitch;
+                offsets[num_planes] = pd->offset;
+                handles[num_planes] = framebuffer->gem_handles[pd->object_index];
+                modifiers[num_planes] = mod;
+                use_modifiers |= mod && mod != DRM_FORMAT_MOD_INVALID;
+                num_planes++;
             }
         }
 
-        ret = drmModeAddFB2(fd, width, height, layer->format,
-                            handles, pitches, offsets, &framebuffer->fb_id, 0);
+        if (use_modifiers) {
+            ret = drmModeAddFB2WithModifiers(fd, width, height, format, handles,
+                                             pitches, offsets, modifiers,
+                                             &framebuffer->fb_id,
+                                             DRM_MODE_FB_MODIFIERS);
+        } else {
+            ret = drmModeAddFB2(fd, width, height, format,
+                                handles, pitches, offsets, &framebuffer->fb_id, 0);
+        }
         if (ret < 0) {
-            mp_err(log, "Failed to create framebuffer on layer %d.\n", 0);
+            mp_err(log, "Failed to create framebuffer (%d planes).\n", num_planes);
             goto fail;
         }
     }
@@ -67,7 +112,7 @@ int drm_prime_create_framebuffer(struct mp_log *log, int fd, AVDRMFrameDescripto
    return 0;
 
 fail:
-   memset(framebuffer, 0, sizeof(*framebuffer));
+   drm_prime_destroy_framebuffer(log, fd, framebuffer);
    return -1;
 }
 
@@ -129,16 +129,18 @@ static void mp_compute_weights(struct filter_kernel *filter, double f,
                                float *out_w)
 {
     assert(filter->size > 0);
+    double inv_scale = 1.0 / filter->filter_scale;
     double sum = 0;
     for (int n = 0; n < filter->size; n++) {
         double x = f - (n - filter->size / 2 + 1);
-        double w = sample_filter(filter, x / filter->filter_scale);
+        double w = sample_filter(filter, x * inv_scale);
         out_w[n] = w;
         sum += w;
     }
     // Normalize to preserve energy
+    double inv_sum = 1.0 / sum;
     for (int n = 0; n < filter->size; n++)
-        out_w[n] /= sum;
+        out_w[n] *= inv_sum;
 }
 
 // Fill the given array with weights for the range [0.0, 1.0]. The array is
@@ -165,10 +167,20 @@ void mp_compute_lut(struct filter_kernel *filter, int count, int stride,
                 filter->radius_cutoff = r;
         }
     } else {
-        // Compute a 2D array indexed by subpixel position
-        for (int n = 0; n < count; n++) {
-            mp_compute_weights(filter, n / (double)(count - 1),
-                               out_array + stride * n);
+        // Compute a 2D array indexed by subpixel position. All kernels are
+        // symmetric, so the weights for position 1-f are the weights for f in
+        // reverse order, and only half of the rows need to be evaluated.
+        int size = filter->size;
+        for (int n = 0; n < (count + 1) / 2; n++) {
+            float *row = out_array + stride * n;
+            mp_compute_weights(filter, n / (double)(count - 1), row);
+
+            int m = count - 1 - n;
+            if (m != n) {
+                float *mirror = out_array + stride * m;
+                for (int i = 0; i < size; i++)
+                    mirror[i] = row[size - 1 - i];
+            }
         }
     }
 }
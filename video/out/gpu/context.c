@@ -169,6 +169,13 @@ struct ra_ctx *ra_ctx_create(struct vo *vo, const char *context_type,
         opts.probing = true;
     }
 
+    // The backends only need to handle the present mode; the queue length is
+    // applied uniformly through swapchain_depth.
+    if (opts.swapchain_latency == SWAPCHAIN_LATENCY_LOW)
+        opts.swapchain_depth = 1;
+    if (opts.swapchain_latency == SWAPCHAIN_LATENCY_HIGH)
+        opts.swapchain_depth = MPMAX(opts.swapchain_depth, 4);
+
     // Hack to silence backend (X11/Wayland/etc.) errors. Kill it once backends
     // are separate from `struct vo`
     bool old_probing = vo->probing;
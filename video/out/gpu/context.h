@@ -5,12 +5,19 @@
 #include "config.h"
 #include "ra.h"
 
+enum {
+    SWAPCHAIN_LATENCY_AUTO = 0,
+    SWAPCHAIN_LATENCY_LOW,      // shortest queue, present as early as possible
+    SWAPCHAIN_LATENCY_HIGH,     // deeper queue, never discard frames
+};
+
 struct ra_ctx_opts {
     int allow_sw;        // allow software renderers
     int want_alpha;      // create an alpha framebuffer if possible
     int debug;           // enable debugging layers/callbacks etc.
     bool probing;        // the backend was auto-probed
     int swapchain_depth; // max number of images to render ahead
+    int swapchain_latency; // SWAPCHAIN_LATENCY_*
 };
 
 struct ra_ctx {
@@ -83,6 +90,9 @@ struct ra_swapchain_fns {
     // Performs a buffer swap. This blocks for as long as necessary to meet
     // params.swapchain_depth, or until the next vblank (for vsynced contexts)
     void (*swap_buffers)(struct ra_swapchain *sw);
+
+    // Optional. Called after swap_buffers, see vo_driver.get_vsync.
+    void (*get_vsync)(struct ra_swapchain *sw, struct vo_vsync_info *info);
 };
 
 // Create and destroy a ra_ctx. This also takes care of creating and destroying
@@ -17,6 +17,8 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "mpv_talloc.h"
 
@@ -25,12 +27,14 @@
 #include "stream/stream.h"
 #include "common/common.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/m_option.h"
 #include "options/path.h"
 #include "video/csputils.h"
 #include "lcms.h"
 
+#include "osdep/getpid.h"
 #include "osdep/io.h"
 
 #if HAVE_LCMS2
@@ -38,6 +42,12 @@
 #include <lcms2.h>
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
+#include <libavutil/cpu.h>
+
+// Upper bound for the number of threads used to compute a 3D LUT.
+#define LUT3D_MAX_THREADS 16
+
+struct lut3d_job;
 
 struct gl_lcms {
     void *icc_data;
@@ -49,11 +59,57 @@ struct gl_lcms {
     enum mp_csp_prim current_prim;
     enum mp_csp_trc current_trc;
 
+    struct mp_thread_pool *pool;
+    int pool_threads;
+    struct lut3d_job *job;      // LUT being generated for current_prim/trc
+    void (*lut3d_cb)(void *ctx);
+    void *lut3d_cb_ctx;
+
     struct mp_log *log;
     struct mpv_global *global;
     struct mp_icc_opts *opts;
 };
 
+// Generation of a 3D LUT on the thread pool. All parameters are copied, so
+// that gl_lcms can change (or be destroyed) while the job is running. The
+// cube is split into slabs along the b axis, which are transformed in
+// parallel.
+struct lut3d_job {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_thread_pool *pool;
+    int num_slabs;
+
+    void *icc_data;
+    size_t icc_size;
+    struct AVBufferRef *vid_profile;
+    bool use_embedded;
+    int intent;
+    int contrast;
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+    int size[3];
+    char *cache_file;           // NULL if caching is disabled or on cache hit
+
+    cmsContext cms;
+    cmsHTRANSFORM trafo;
+    uint16_t *output;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- the following fields are protected by lock
+    int slabs_pending;
+    bool done, success;
+    bool abandoned;             // owner lost interest; free on completion
+    void (*done_cb)(void *ctx);
+    void *done_cb_ctx;
+};
+
+struct lut3d_slab {
+    struct lut3d_job *job;
+    int b0, b1;
+};
+
 static bool parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
 {
     if (sscanf(arg, "%dx%dx%d", p1, p2, p3) != 3)
@@ -85,6 +141,7 @@ const struct m_sub_options mp_icc_conf = {
         OPT_INT("icc-intent", intent, 0),
         OPT_INTRANGE("icc-contrast", contrast, 0, 0, 1000000),
         OPT_STRING_VALIDATE("icc-3dlut-size", size_str, 0, validate_3dlut_size_opt),
+        OPT_FLAG("icc-3dlut-async", async, 0),
 
         OPT_REPLACED("3dlut-size", "icc-3dlut-size"),
         OPT_REMOVED("icc-cache", "see icc-cache-dir"),
@@ -93,6 +150,7 @@ const struct m_sub_options mp_icc_conf = {
     .size = sizeof(struct mp_icc_opts),
     .defaults = &(const struct mp_icc_opts) {
         .size_str = "64x64x64",
+        .async = true,
         .intent = INTENT_RELATIVE_COLORIMETRIC,
         .use_embedded = true,
     },
@@ -101,8 +159,8 @@ const struct m_sub_options mp_icc_conf = {
 static void lcms2_error_handler(cmsContext ctx, cmsUInt32Number code,
                                 const char *msg)
 {
-    struct gl_lcms *p = cmsGetContextUserData(ctx);
-    MP_ERR(p, "lcms2: %s\n", msg);
+    struct lut3d_job *job = cmsGetContextUserData(ctx);
+    MP_ERR(job, "lcms2: %s\n", msg);
 }
 
 static void load_profile(struct gl_lcms *p)
@@ -132,9 +190,14 @@ static void load_profile(struct gl_lcms *p)
     p->current_profile = talloc_strdup(p, p->opts->profile);
 }
 
+static void abandon_job(struct gl_lcms *p);
+
 static void gl_lcms_destructor(void *ptr)
 {
     struct gl_lcms *p = ptr;
+    abandon_job(p);
+    // Waits until abandoned jobs have finished (and freed themselves).
+    talloc_free(p->pool);
     av_buffer_unref(&p->vid_profile);
 }
 
@@ -222,11 +285,11 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return p->icc_size > 0;
 }
 
-static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
+static cmsHPROFILE get_vid_profile(struct lut3d_job *p, cmsContext cms,
                                    cmsHPROFILE disp_profile,
                                    enum mp_csp_prim prim, enum mp_csp_trc trc)
 {
-    if (p->opts->use_embedded && p->vid_profile) {
+    if (p->use_embedded && p->vid_profile) {
         // Try using the embedded ICC profile
         cmsHPROFILE prof = cmsOpenProfileFromMemTHR(cms, p->vid_profile->data,
                                                     p->vid_profile->size);
@@ -297,15 +360,15 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
         cmsDeleteTransform(xyz2src);
 
         // Contrast limiting
-        if (p->opts->contrast > 0) {
+        if (p->contrast > 0) {
             for (int i = 0; i < 3; i++)
-                src_black[i] = MPMAX(src_black[i], 1.0 / p->opts->contrast);
+                src_black[i] = MPMAX(src_black[i], 1.0 / p->contrast);
         }
 
         // Built-in contrast failsafe
         double contrast = 3.0 / (src_black[0] + src_black[1] + src_black[2]);
         MP_VERBOSE(p, "Detected ICC profile contrast: %f\n", contrast);
-        if (contrast > 100000 && !p->opts->contrast) {
+        if (contrast > 100000 && !p->contrast) {
             MP_WARN(p, "ICC profile detected contrast very high (>100000),"
                     " falling back to contrast 1000 for sanity. Set the"
                     " icc-contrast option to silence this warning.\n");
@@ -342,41 +405,256 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc,
-                       struct AVBufferRef *vid_profile)
+static void lut3d_job_destructor(void *ptr)
 {
-    int s_r, s_g, s_b;
-    bool result = false;
+    struct lut3d_job *job = ptr;
+    if (job->trafo)
+        cmsDeleteTransform(job->trafo);
+    if (job->cms)
+        cmsDeleteContext(job->cms);
+    av_buffer_unref(&job->vid_profile);
+    pthread_cond_destroy(&job->wakeup);
+    pthread_mutex_destroy(&job->lock);
+}
 
-    p->changed = false;
-    p->current_prim = prim;
-    p->current_trc = trc;
+// Called on a worker thread once all slabs are done (or on failure).
+static void lut3d_job_finish(struct lut3d_job *job, bool success)
+{
+    if (job->trafo)
+        cmsDeleteTransform(job->trafo);
+    job->trafo = NULL;
+
+    if (success && job->cache_file) {
+        // Other processes may read the cache at any time.
+        char *tmp_path = talloc_asprintf(NULL, "%s.%d.tmp", job->cache_file,
+                                         mp_getpid());
+        FILE *out = fopen(tmp_path, "wb");
+        bool ok = out && fwrite(job->output, talloc_get_size(job->output),
+                                1, out) == 1;
+        if (out)
+            ok = fclose(out) == 0 && ok;
+        if (!ok || rename(tmp_path, job->cache_file) != 0) {
+            mp_warn(job->log, "Failed to write 3D LUT cache '%s'.\n",
+                    job->cache_file);
+            unlink(tmp_path);
+        }
+        talloc_free(tmp_path);
+    }
 
-    // We need to hold on to a reference to the video's ICC profile for as long
-    // as we still need to perform equality checking, so generate a new
-    // reference here
-    av_buffer_unref(&p->vid_profile);
-    if (vid_profile) {
-        MP_VERBOSE(p, "Got an embedded ICC profile.\n");
-        p->vid_profile = av_buffer_ref(vid_profile);
-        if (!p->vid_profile)
-            abort();
+    pthread_mutex_lock(&job->lock);
+    job->done = true;
+    job->success = success;
+    bool abandoned = job->abandoned;
+    void (*cb)(void *ctx) = job->done_cb;
+    void *cb_ctx = job->done_cb_ctx;
+    pthread_cond_broadcast(&job->wakeup);
+    pthread_mutex_unlock(&job->lock);
+
+    // The owner can free the job as soon as the lock is released.
+    if (abandoned) {
+        talloc_free(job);
+    } else if (cb) {
+        cb(cb_ctx);
     }
+}
 
-    if (!parse_3dlut_size(p->opts->size_str, &s_r, &s_g, &s_b))
-        return false;
+static void lut3d_slab_fn(void *ctx)
+{
+    struct lut3d_slab *slab = ctx;
+    struct lut3d_job *job = slab->job;
+    int s_r = job->size[0], s_g = job->size[1], s_b = job->size[2];
 
-    if (!gl_lcms_has_profile(p))
-        return false;
+    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
+    uint16_t input[512 * 3];
+    for (int b = slab->b0; b < slab->b1; b++) {
+        for (int g = 0; g < s_g; g++) {
+            for (int r = 0; r < s_r; r++) {
+                input[r * 3 + 0] = r * 65535 / (s_r - 1);
+                input[r * 3 + 1] = g * 65535 / (s_g - 1);
+                input[r * 3 + 2] = b * 65535 / (s_b - 1);
+            }
+            size_t base = (b * s_r * s_g + g * s_r) * 4;
+            cmsDoTransform(job->trafo, input, job->output + base, s_r);
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    bool last = --job->slabs_pending == 0;
+    pthread_mutex_unlock(&job->lock);
+
+    if (last)
+        lut3d_job_finish(job, true);
+}
+
+static void lut3d_setup_fn(void *ctx)
+{
+    struct lut3d_job *job = ctx;
+
+    pthread_mutex_lock(&job->lock);
+    bool abandoned = job->abandoned;
+    pthread_mutex_unlock(&job->lock);
+    if (abandoned)
+        goto error_exit;
+
+    // check cache
+    if (job->cache_file && stat(job->cache_file, &(struct stat){0}) == 0) {
+        MP_VERBOSE(job, "Opening 3D LUT cache in file '%s'.\n", job->cache_file);
+        struct bstr cachedata = stream_read_file(job->cache_file, NULL,
+                                                 job->global,
+                                                 1000000000); // 1 GB
+        bool valid = cachedata.len == talloc_get_size(job->output);
+        if (valid)
+            memcpy(job->output, cachedata.start, cachedata.len);
+        talloc_free(cachedata.start);
+        if (valid) {
+            job->cache_file = NULL;
+            lut3d_job_finish(job, true);
+            return;
+        }
+        MP_WARN(job, "3D LUT cache invalid!\n");
+    }
+
+    job->cms = cmsCreateContext(NULL, job);
+    if (!job->cms)
+        goto error_exit;
+    cmsSetLogErrorHandlerTHR(job->cms, lcms2_error_handler);
+
+    cmsHPROFILE profile =
+        cmsOpenProfileFromMemTHR(job->cms, job->icc_data, job->icc_size);
+    if (!profile)
+        goto error_exit;
+
+    cmsHPROFILE vid_hprofile = get_vid_profile(job, job->cms, profile,
+                                               job->prim, job->trc);
+    if (!vid_hprofile) {
+        cmsCloseProfile(profile);
+        goto error_exit;
+    }
+
+    // cmsFLAGS_NOCACHE makes cmsDoTransform() safe to call concurrently on
+    // the same transform (the cache only helps with runs of equal pixels).
+    job->trafo = cmsCreateTransformTHR(job->cms, vid_hprofile, TYPE_RGB_16,
+                                       profile, TYPE_RGBA_16, job->intent,
+                                       cmsFLAGS_HIGHRESPRECALC |
+                                       cmsFLAGS_BLACKPOINTCOMPENSATION |
+                                       cmsFLAGS_NOCACHE);
+    cmsCloseProfile(profile);
+    cmsCloseProfile(vid_hprofile);
+
+    if (!job->trafo)
+        goto error_exit;
+
+    struct lut3d_slab *slabs = talloc_array(job, struct lut3d_slab,
+                                            job->num_slabs);
+    job->slabs_pending = job->num_slabs;
+    for (int n = 0; n < job->num_slabs; n++) {
+        slabs[n] = (struct lut3d_slab){
+            .job = job,
+            .b0 = n * job->size[2] / job->num_slabs,
+            .b1 = (n + 1) * job->size[2] / job->num_slabs,
+        };
+    }
+    // Run the first slab on this thread; queue the rest before that, so the
+    // job can't finish (and be freed) while slabs are still being queued.
+    // The slabs go before any newer setup jobs, as the renderer waits for them.
+    for (int n = 1; n < job->num_slabs; n++) {
+        mp_thread_pool_queue_prio(job->pool, MP_THREAD_POOL_PRIO_HIGH,
+                                  lut3d_slab_fn, &slabs[n]);
+    }
+    lut3d_slab_fn(&slabs[0]);
+    return;
+
+error_exit:
+    lut3d_job_finish(job, false);
+}
 
-    void *tmp = talloc_new(NULL);
-    uint16_t *output = talloc_array(tmp, uint16_t, s_r * s_g * s_b * 4);
-    struct lut3d *lut = NULL;
-    cmsContext cms = NULL;
+static bool lut3d_job_is_done(struct lut3d_job *job)
+{
+    pthread_mutex_lock(&job->lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&job->lock);
+    return done;
+}
+
+// Stop caring about the current job. It frees itself once it's done.
+static void abandon_job(struct gl_lcms *p)
+{
+    struct lut3d_job *job = p->job;
+    if (!job)
+        return;
+    p->job = NULL;
+
+    pthread_mutex_lock(&job->lock);
+    bool done = job->done;
+    job->abandoned = true;
+    pthread_mutex_unlock(&job->lock);
+
+    if (done)
+        talloc_free(job);
+}
+
+// Wait for the current job and return its result.
+static bool collect_job(struct gl_lcms *p, struct lut3d **result_lut3d)
+{
+    struct lut3d_job *job = p->job;
+    p->job = NULL;
+
+    pthread_mutex_lock(&job->lock);
+    while (!job->done)
+        pthread_cond_wait(&job->wakeup, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+
+    bool success = job->success;
+    if (success) {
+        struct lut3d *lut = talloc_ptrtype(NULL, lut);
+        *lut = (struct lut3d) {
+            .data = talloc_steal(lut, job->output),
+            .size = {job->size[0], job->size[1], job->size[2]},
+        };
+        *result_lut3d = lut;
+    } else {
+        MP_FATAL(p, "Error loading ICC profile.\n");
+    }
+
+    talloc_free(job);
+    return success;
+}
+
+static struct lut3d_job *create_job(struct gl_lcms *p, enum mp_csp_prim prim,
+                                    enum mp_csp_trc trc, int s_r, int s_g,
+                                    int s_b)
+{
+    struct lut3d_job *job = talloc_ptrtype(NULL, job);
+    talloc_set_destructor(job, lut3d_job_destructor);
+    *job = (struct lut3d_job) {
+        .log = p->log,
+        .global = p->global,
+        .pool = p->pool,
+        .num_slabs = MPMIN(p->pool_threads, s_b),
+        .icc_data = talloc_memdup(job, p->icc_data, p->icc_size),
+        .icc_size = p->icc_size,
+        .use_embedded = p->opts->use_embedded,
+        .intent = p->opts->intent,
+        .contrast = p->opts->contrast,
+        .prim = prim,
+        .trc = trc,
+        .size = {s_r, s_g, s_b},
+        .output = talloc_array(job, uint16_t, s_r * s_g * s_b * 4),
+        .done_cb = p->lut3d_cb,
+        .done_cb_ctx = p->lut3d_cb_ctx,
+    };
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->wakeup, NULL);
+
+    if (p->vid_profile) {
+        job->vid_profile = av_buffer_ref(p->vid_profile);
+        if (!job->vid_profile)
+            abort();
+    }
 
-    char *cache_file = NULL;
     if (p->opts->cache_dir && p->opts->cache_dir[0]) {
+        void *tmp = talloc_new(NULL);
+
         // Gamma is included in the header to help uniquely identify it,
         // because we may change the parameter in the future or make it
         // customizable, same for the primaries.
@@ -391,106 +669,89 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
             abort();
         av_sha_init(sha, 256);
         av_sha_update(sha, cache_info, strlen(cache_info));
-        if (vid_profile)
-            av_sha_update(sha, vid_profile->data, vid_profile->size);
+        if (p->vid_profile)
+            av_sha_update(sha, p->vid_profile->data, p->vid_profile->size);
         av_sha_update(sha, p->icc_data, p->icc_size);
         av_sha_final(sha, hash);
         av_free(sha);
 
         char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
-        cache_file = talloc_strdup(tmp, "");
+        char *cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
             cache_file = talloc_asprintf_append(cache_file, "%02X", hash[i]);
-        cache_file = mp_path_join(tmp, cache_dir, cache_file);
+        job->cache_file = mp_path_join(job, cache_dir, cache_file);
 
         mp_mkdirp(cache_dir);
+        talloc_free(tmp);
     }
 
-    // check cache
-    if (cache_file && stat(cache_file, &(struct stat){0}) == 0) {
-        MP_VERBOSE(p, "Opening 3D LUT cache in file '%s'.\n", cache_file);
-        struct bstr cachedata = stream_read_file(cache_file, tmp, p->global,
-                                                 1000000000); // 1 GB
-        if (cachedata.len == talloc_get_size(output)) {
-            memcpy(output, cachedata.start, cachedata.len);
-            goto done;
-        } else {
-            MP_WARN(p, "3D LUT cache invalid!\n");
-        }
-    }
+    return job;
+}
 
-    cms = cmsCreateContext(NULL, p);
-    if (!cms)
-        goto error_exit;
-    cmsSetLogErrorHandlerTHR(cms, lcms2_error_handler);
+// Set a callback which is called (from a worker thread) when an asynchronously
+// generated LUT becomes available via gl_lcms_get_lut3d().
+void gl_lcms_set_lut3d_cb(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
+{
+    p->lut3d_cb = cb;
+    p->lut3d_cb_ctx = ctx;
+}
 
-    cmsHPROFILE profile =
-        cmsOpenProfileFromMemTHR(cms, p->icc_data, p->icc_size);
-    if (!profile)
-        goto error_exit;
+// If --icc-3dlut-async is enabled, this can return true with *result_lut3d
+// set to NULL: the LUT is still being generated. Color management should be
+// skipped until a later call returns the LUT.
+bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
+                       enum mp_csp_prim prim, enum mp_csp_trc trc,
+                       struct AVBufferRef *vid_profile)
+{
+    int s_r, s_g, s_b;
 
-    cmsHPROFILE vid_hprofile = get_vid_profile(p, cms, profile, prim, trc);
-    if (!vid_hprofile) {
-        cmsCloseProfile(profile);
-        goto error_exit;
+    *result_lut3d = NULL;
+
+    if (p->job && !gl_lcms_has_changed(p, prim, trc, vid_profile)) {
+        if (p->opts->async && !lut3d_job_is_done(p->job))
+            return true;
+        return collect_job(p, result_lut3d);
     }
 
-    cmsHTRANSFORM trafo = cmsCreateTransformTHR(cms, vid_hprofile, TYPE_RGB_16,
-                                                profile, TYPE_RGBA_16,
-                                                p->opts->intent,
-                                                cmsFLAGS_HIGHRESPRECALC |
-                                                cmsFLAGS_BLACKPOINTCOMPENSATION);
-    cmsCloseProfile(profile);
-    cmsCloseProfile(vid_hprofile);
+    abandon_job(p);
 
-    if (!trafo)
-        goto error_exit;
+    p->changed = false;
+    p->current_prim = prim;
+    p->current_trc = trc;
 
-    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
-    uint16_t *input = talloc_array(tmp, uint16_t, s_r * 3);
-    for (int b = 0; b < s_b; b++) {
-        for (int g = 0; g < s_g; g++) {
-            for (int r = 0; r < s_r; r++) {
-                input[r * 3 + 0] = r * 65535 / (s_r - 1);
-                input[r * 3 + 1] = g * 65535 / (s_g - 1);
-                input[r * 3 + 2] = b * 65535 / (s_b - 1);
-            }
-            size_t base = (b * s_r * s_g + g * s_r) * 4;
-            cmsDoTransform(trafo, input, output + base, s_r);
-        }
+    // We need to hold on to a reference to the video's ICC profile for as long
+    // as we still need to perform equality checking, so generate a new
+    // reference here
+    av_buffer_unref(&p->vid_profile);
+    if (vid_profile) {
+        MP_VERBOSE(p, "Got an embedded ICC profile.\n");
+        p->vid_profile = av_buffer_ref(vid_profile);
+        if (!p->vid_profile)
+            abort();
     }
 
-    cmsDeleteTransform(trafo);
+    if (!parse_3dlut_size(p->opts->size_str, &s_r, &s_g, &s_b))
+        return false;
 
-    if (cache_file) {
-        FILE *out = fopen(cache_file, "wb");
-        if (out) {
-            fwrite(output, talloc_get_size(output), 1, out);
-            fclose(out);
+    if (!gl_lcms_has_profile(p))
+        return false;
+
+    if (!p->pool) {
+        p->pool_threads = MPCLAMP(av_cpu_count(), 1, LUT3D_MAX_THREADS);
+        p->pool = mp_thread_pool_create(p, p->pool_threads);
+        if (!p->pool) {
+            MP_FATAL(p, "Error loading ICC profile.\n");
+            return false;
         }
     }
 
-done: ;
+    p->job = create_job(p, prim, trc, s_r, s_g, s_b);
+    mp_thread_pool_queue(p->pool, lut3d_setup_fn, p->job);
 
-    lut = talloc_ptrtype(NULL, lut);
-    *lut = (struct lut3d) {
-        .data = talloc_steal(lut, output),
-        .size = {s_r, s_g, s_b},
-    };
-
-    *result_lut3d = lut;
-    result = true;
-
-error_exit:
-
-    if (cms)
-        cmsDeleteContext(cms);
-
-    if (!lut)
-        MP_FATAL(p, "Error loading ICC profile.\n");
+    if (p->opts->async)
+        return true;
 
-    talloc_free(tmp);
-    return result;
+    return collect_job(p, result_lut3d);
 }
 
 #else /* HAVE_LCMS2 */
@@ -522,6 +783,10 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return false;
 }
 
+void gl_lcms_set_lut3d_cb(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
+{
+}
+
 bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
                        enum mp_csp_prim prim, enum mp_csp_trc trc,
                        struct AVBufferRef *vid_profile)
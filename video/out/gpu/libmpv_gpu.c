@@ -188,6 +188,13 @@ static int render(struct render_backend *ctx, mpv_render_param *params,
     gl_video_render_frame(p->renderer, frame, target, RENDER_FRAME_DEF);
     p->context->fns->done_frame(p->context, frame->display_synced);
 
+    void **fence = get_mpv_render_param(params, MPV_RENDER_PARAM_OPENGL_FENCE,
+                                        NULL);
+    if (fence) {
+        *fence = p->context->fns->create_fence ?
+                 p->context->fns->create_fence(p->context) : NULL;
+    }
+
     return 0;
 }
 
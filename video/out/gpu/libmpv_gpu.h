@@ -33,6 +33,9 @@ struct libmpv_gpu_context_fns {
     // For certain backends, this might also be used to signal the end of
     // rendering (like OpenGL doing weird crap).
     void (*done_frame)(struct libmpv_gpu_context *ctx, bool ds);
+    // Optional. Return a fence for the rendering submitted by done_frame(),
+    // see MPV_RENDER_PARAM_OPENGL_FENCE. The caller owns the result.
+    void *(*create_fence)(struct libmpv_gpu_context *ctx);
     // Free all data in ctx->priv.
     void (*destroy)(struct libmpv_gpu_context *ctx);
 };
@@ -23,30 +23,46 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "sub/img_convert.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
+#include "video/out/bitmap_packer.h"
 #include "osd.h"
 
 #define GLSL(x) gl_sc_add(sc, #x "\n");
 
-// glBlendFuncSeparate() arguments
-static const int blend_factors[SUBBITMAP_COUNT][4] = {
-    [SUBBITMAP_LIBASS] = {RA_BLEND_SRC_ALPHA, RA_BLEND_ONE_MINUS_SRC_ALPHA,
-                          RA_BLEND_ONE,       RA_BLEND_ONE_MINUS_SRC_ALPHA},
-    [SUBBITMAP_RGBA] =   {RA_BLEND_ONE,       RA_BLEND_ONE_MINUS_SRC_ALPHA,
-                          RA_BLEND_ONE,       RA_BLEND_ONE_MINUS_SRC_ALPHA},
-};
-
 struct vertex {
     float position[2];
     float texcoord[2];
     uint8_t ass_color[4];
+    float osd_part;             // index into mpgl_osd.parts
 };
 
 static const struct ra_renderpass_input vertex_vao[] = {
     {"position",  RA_VARTYPE_FLOAT,      2, 1, offsetof(struct vertex, position)},
     {"texcoord" , RA_VARTYPE_FLOAT,      2, 1, offsetof(struct vertex, texcoord)},
     {"ass_color", RA_VARTYPE_BYTE_UNORM, 4, 1, offsetof(struct vertex, ass_color)},
+    {"osd_part",  RA_VARTYPE_FLOAT,      1, 1, offsetof(struct vertex, osd_part)},
+};
+
+// Transparent border around each bitmap in the texture, so that bilinear
+// scaling of RGBA bitmaps doesn't sample from neighbouring bitmaps.
+#define OSD_PADDING 1
+
+// Rows per unit of dirty region tracking.
+#define OSD_DIRTY_BAND 32
+
+// A bitmap stored in the OSD texture.
+struct osd_entry {
+    uint64_t hash;
+    int w, h;
+    struct pos pos;
+    unsigned last_used;
+};
+
+// Range of columns in a band of OSD_DIRTY_BAND rows that needs uploading.
+struct osd_dirty {
+    int x0, x1;                 // nothing to upload if x0 >= x1
 };
 
 struct mpgl_osd_part {
@@ -57,8 +73,20 @@ struct mpgl_osd_part {
     int num_subparts;
     int prev_num_subparts;
     struct sub_bitmap *subparts;
-    int num_vertices;
-    struct vertex *vertices;
+
+    // Bitmaps are kept in the texture across changes, so only new bitmaps
+    // need to be uploaded. shadow is a copy of the texture contents.
+    uint8_t *shadow;
+    int shadow_stride;
+    struct osd_entry *entries;
+    int num_entries;
+    struct inc_packer *packer;
+    struct osd_dirty *dirty;    // h / OSD_DIRTY_BAND entries (rounded up)
+    unsigned gen;
+    bool full_upload;
+    // Texture position of each bitmap in the current sub_bitmaps.
+    struct mp_rect *pos;
+    int num_pos;
 };
 
 struct mpgl_osd {
@@ -69,6 +97,9 @@ struct mpgl_osd {
     const struct ra_format *fmt_table[SUBBITMAP_COUNT];
     bool formats[SUBBITMAP_COUNT];
     bool change_flag; // for reporting to API user only
+    // All parts are drawn with a single renderpass
+    int num_vertices;
+    struct vertex *vertices;
     // temporary
     int stereo_mode;
     struct mp_osd_res osd_res;
@@ -120,64 +151,231 @@ static int next_pow2(int v)
     return INT_MAX;
 }
 
-static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
-                       struct sub_bitmaps *imgs)
+static int num_dirty_bands(struct mpgl_osd_part *osd)
 {
-    struct ra *ra = ctx->ra;
-    bool ok = false;
+    return (osd->h + OSD_DIRTY_BAND - 1) / OSD_DIRTY_BAND;
+}
 
-    assert(imgs->packed);
+static void reset_atlas(struct mpgl_osd_part *osd)
+{
+    osd->num_entries = 0;
+    inc_packer_reset(osd->packer);
+    memset(osd->shadow, 0, osd->shadow_stride * osd->h);
+    osd->full_upload = true;
+}
+
+static void mark_dirty(struct mpgl_osd_part *osd, struct pos pos, int w, int h)
+{
+    for (int y = pos.y / OSD_DIRTY_BAND; y * OSD_DIRTY_BAND < pos.y + h; y++) {
+        struct osd_dirty *d = &osd->dirty[y];
+        if (d->x0 >= d->x1) {
+            d->x0 = pos.x;
+            d->x1 = pos.x + w;
+        } else {
+            d->x0 = MPMIN(d->x0, pos.x);
+            d->x1 = MPMAX(d->x1, pos.x + w);
+        }
+    }
+}
 
-    int req_w = next_pow2(imgs->packed_w);
-    int req_h = next_pow2(imgs->packed_h);
+static bool entry_matches(struct mpgl_osd_part *osd, struct osd_entry *e,
+                          struct sub_bitmap *b, uint64_t hash, int bpp)
+{
+    if (e->hash != hash || e->w != b->w || e->h != b->h)
+        return false;
+    // The producer guarantees that equal IDs mean equal contents.
+    if (b->id)
+        return true;
+    for (int y = 0; y < b->h; y++) {
+        uint8_t *dst = osd->shadow + (e->pos.y + y) * osd->shadow_stride +
+                       e->pos.x * bpp;
+        if (memcmp(dst, (uint8_t *)b->bitmap + y * b->stride, b->w * bpp))
+            return false;
+    }
+    return true;
+}
 
-    const struct ra_format *fmt = ctx->fmt_table[imgs->format];
-    assert(fmt);
+// Drop all bitmaps which are not part of the current sub_bitmaps. Their area
+// is cleared, so the padding of bitmaps placed there later is transparent.
+static void evict_entries(struct mpgl_osd_part *osd, int bpp)
+{
+    int keep = 0;
+    for (int n = 0; n < osd->num_entries; n++) {
+        struct osd_entry *e = &osd->entries[n];
+        if (e->last_used == osd->gen) {
+            osd->entries[keep++] = *e;
+            continue;
+        }
+        uint8_t *dst = osd->shadow + e->pos.y * osd->shadow_stride +
+                       e->pos.x * bpp;
+        memset_pic(dst, 0, e->w * bpp, e->h, osd->shadow_stride);
+        mark_dirty(osd, e->pos, e->w, e->h);
+        inc_packer_remove(osd->packer, e->pos, e->w, e->h);
+    }
+    osd->num_entries = keep;
+}
 
-    if (!osd->texture || req_w > osd->w || req_h > osd->h ||
-        osd->format != imgs->format)
-    {
-        ra_tex_free(ra, &osd->texture);
+// Assign a texture position to each bitmap, and copy new bitmaps to the
+// shadow texture. Returns false if the texture is too small.
+static bool place_bitmaps(struct mpgl_osd_part *osd, struct sub_bitmaps *imgs,
+                          int bpp)
+{
+    osd->num_pos = 0;
+    MP_TARRAY_GROW(osd, osd->pos, imgs->num_parts);
+
+    for (int n = 0; n < imgs->num_parts; n++) {
+        struct sub_bitmap *b = &imgs->parts[n];
+        uint64_t hash = b->id ? b->id : mp_sub_bitmap_hash(b, bpp);
+
+        struct osd_entry *e = NULL;
+        for (int i = 0; i < osd->num_entries; i++) {
+            if (entry_matches(osd, &osd->entries[i], b, hash, bpp)) {
+                e = &osd->entries[i];
+                break;
+            }
+        }
+        if (!e) {
+            struct pos pos;
+            if (!inc_packer_insert(osd->packer, b->w, b->h, &pos)) {
+                evict_entries(osd, bpp);
+                if (!inc_packer_insert(osd->packer, b->w, b->h, &pos))
+                    return false;
+            }
+            uint8_t *dst = osd->shadow + pos.y * osd->shadow_stride + pos.x * bpp;
+            memcpy_pic(dst, b->bitmap, b->w * bpp, b->h, osd->shadow_stride,
+                       b->stride);
+            mark_dirty(osd, pos, b->w, b->h);
+            MP_TARRAY_APPEND(osd, osd->entries, osd->num_entries,
+                             (struct osd_entry){hash, b->w, b->h, pos});
+            e = &osd->entries[osd->num_entries - 1];
+        }
+        e->last_used = osd->gen;
 
-        osd->format = imgs->format;
-        osd->w = FFMAX(32, req_w);
-        osd->h = FFMAX(32, req_h);
+        osd->pos[osd->num_pos++] = (struct mp_rect){e->pos.x, e->pos.y,
+                                                    e->pos.x + b->w,
+                                                    e->pos.y + b->h};
+    }
+    return true;
+}
 
-        MP_VERBOSE(ctx, "Reallocating OSD texture to %dx%d.\n", osd->w, osd->h);
+static bool realloc_texture(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                            int w, int h)
+{
+    struct ra *ra = ctx->ra;
 
-        if (osd->w > ra->max_texture_wh || osd->h > ra->max_texture_wh) {
-            MP_ERR(ctx, "OSD bitmaps do not fit on a surface with the maximum "
-                   "supported size %dx%d.\n", ra->max_texture_wh,
-                   ra->max_texture_wh);
-            goto done;
-        }
+    ra_tex_free(ra, &osd->texture);
+    talloc_free(osd->shadow);
+    osd->shadow = NULL;
 
-        struct ra_tex_params params = {
-            .dimensions = 2,
-            .w = osd->w,
-            .h = osd->h,
-            .d = 1,
-            .format = fmt,
-            .render_src = true,
-            .src_linear = true,
-            .host_mutable = true,
-        };
-        osd->texture = ra_tex_create(ra, &params);
-        if (!osd->texture)
-            goto done;
+    osd->w = w;
+    osd->h = h;
+
+    MP_VERBOSE(ctx, "Reallocating OSD texture to %dx%d.\n", osd->w, osd->h);
+
+    if (osd->w > ra->max_texture_wh || osd->h > ra->max_texture_wh) {
+        MP_ERR(ctx, "OSD bitmaps do not fit on a surface with the maximum "
+               "supported size %dx%d.\n", ra->max_texture_wh,
+               ra->max_texture_wh);
+        return false;
     }
 
+    const struct ra_format *fmt = ctx->fmt_table[osd->format];
+    struct ra_tex_params params = {
+        .dimensions = 2,
+        .w = osd->w,
+        .h = osd->h,
+        .d = 1,
+        .format = fmt,
+        .render_src = true,
+        .src_linear = true,
+        .host_mutable = true,
+    };
+    osd->texture = ra_tex_create(ra, &params);
+    if (!osd->texture)
+        return false;
+
+    osd->shadow_stride = osd->w * fmt->pixel_size;
+    osd->shadow = talloc_zero_size(osd, osd->shadow_stride * osd->h);
+    talloc_free(osd->dirty);
+    osd->dirty = talloc_zero_array(osd, struct osd_dirty, num_dirty_bands(osd));
+    if (!osd->packer)
+        osd->packer = talloc_zero(osd, struct inc_packer);
+    osd->packer->w = osd->w;
+    osd->packer->h = osd->h;
+    osd->packer->padding = OSD_PADDING;
+    reset_atlas(osd);
+    return true;
+}
+
+static bool upload_rect(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                        struct mp_rect rc, bool invalidate)
+{
+    int bpp = ctx->fmt_table[osd->format]->pixel_size;
     struct ra_tex_upload_params params = {
         .tex = osd->texture,
-        .src = imgs->packed->planes[0],
-        .invalidate = true,
-        .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
-        .stride = imgs->packed->stride[0],
+        .src = osd->shadow + rc.y0 * osd->shadow_stride + rc.x0 * bpp,
+        .invalidate = invalidate,
+        .rc = &rc,
+        .stride = osd->shadow_stride,
     };
+    return ctx->ra->fns->tex_upload(ctx->ra, &params);
+}
+
+// Bitmaps which were already uploaded on previous changes are reused, and only
+// the new ones are uploaded. If the texture runs full, bitmaps which are not
+// visible anymore are removed. If that's not enough, it's repacked with only
+// the current bitmaps (and enlarged, if that's still not enough).
+static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
+                       struct sub_bitmaps *imgs)
+{
+    const struct ra_format *fmt = ctx->fmt_table[imgs->format];
+    assert(fmt);
+    int bpp = fmt->pixel_size;
+
+    osd->num_pos = 0;
+    osd->gen++;
+
+    if (!osd->texture || osd->format != imgs->format) {
+        osd->format = imgs->format;
+        int req_w = next_pow2(imgs->packed ? imgs->packed_w : 0);
+        int req_h = next_pow2(imgs->packed ? imgs->packed_h : 0);
+        if (!realloc_texture(ctx, osd, FFMAX(32, req_w), FFMAX(32, req_h)))
+            return false;
+    }
+
+    if (!place_bitmaps(osd, imgs, bpp)) {
+        reset_atlas(osd);
+        while (!place_bitmaps(osd, imgs, bpp)) {
+            int w = osd->w, h = osd->h;
+            if (w <= h) {
+                w *= 2;
+            } else {
+                h *= 2;
+            }
+            if (!realloc_texture(ctx, osd, w, h))
+                return false;
+        }
+    }
 
-    ok = ra->fns->tex_upload(ra, &params);
+    bool ok = true;
+    if (osd->full_upload) {
+        ok = upload_rect(ctx, osd, (struct mp_rect){0, 0, osd->w, osd->h}, true);
+    } else {
+        for (int n = 0; n < num_dirty_bands(osd); n++) {
+            struct osd_dirty *d = &osd->dirty[n];
+            if (d->x0 >= d->x1)
+                continue;
+            int y0 = n * OSD_DIRTY_BAND;
+            struct mp_rect rc = {d->x0, y0, d->x1,
+                                 MPMIN(y0 + OSD_DIRTY_BAND, osd->h)};
+            ok &= upload_rect(ctx, osd, rc, false);
+        }
+    }
+    osd->full_upload = !ok;
+    memset(osd->dirty, 0, num_dirty_bands(osd) * sizeof(osd->dirty[0]));
 
-done:
+    if (!ok)
+        osd->num_pos = 0;
     return ok;
 }
 
@@ -190,47 +388,65 @@ static void gen_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 
     struct mpgl_osd_part *osd = ctx->parts[imgs->render_index];
 
-    bool ok = true;
     if (imgs->change_id != osd->change_id) {
-        if (!upload_osd(ctx, osd, imgs))
-            ok = false;
+        upload_osd(ctx, osd, imgs);
 
         osd->change_id = imgs->change_id;
         ctx->change_flag = true;
     }
+    bool ok = osd->num_pos == imgs->num_parts;
     osd->num_subparts = ok ? imgs->num_parts : 0;
 
     MP_TARRAY_GROW(osd, osd->subparts, osd->num_subparts);
     memcpy(osd->subparts, imgs->parts,
            osd->num_subparts * sizeof(osd->subparts[0]));
+
+    for (int n = 0; n < osd->num_subparts; n++) {
+        osd->subparts[n].src_x = osd->pos[n].x0;
+        osd->subparts[n].src_y = osd->pos[n].y0;
+    }
 }
 
-bool mpgl_osd_draw_prepare(struct mpgl_osd *ctx, int index,
-                           struct gl_shader_cache *sc)
+static bool part_visible(struct mpgl_osd *ctx, int index)
 {
-    assert(index >= 0 && index < MAX_OSD_PARTS);
     struct mpgl_osd_part *part = ctx->parts[index];
+    return part->format && part->num_subparts;
+}
 
-    enum sub_bitmap_format fmt = part->format;
-    if (!fmt || !part->num_subparts)
-        return false;
+// Set up color for all visible parts. Every vertex carries the index of the
+// part it belongs to, which selects the texture and the way it's sampled.
+bool mpgl_osd_draw_prepare(struct mpgl_osd *ctx, struct gl_shader_cache *sc)
+{
+    bool any = false;
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        if (!part_visible(ctx, n))
+            continue;
+        struct mpgl_osd_part *part = ctx->parts[n];
 
-    gl_sc_uniform_texture(sc, "osdtex", part->texture);
-    switch (fmt) {
-    case SUBBITMAP_RGBA: {
-        GLSL(color = texture(osdtex, texcoord).bgra;)
-        break;
-    }
-    case SUBBITMAP_LIBASS: {
-        GLSL(color =
-            vec4(ass_color.rgb, ass_color.a * texture(osdtex, texcoord).r);)
-        break;
-    }
-    default:
-        abort();
+        if (!any)
+            GLSL(color = vec4(0.0);)
+        any = true;
+
+        // Sample outside of the non-uniform branch below, since implicit
+        // derivatives are undefined in there.
+        char *name = mp_tprintf(20, "osdtex%d", n);
+        gl_sc_uniform_texture(sc, name, part->texture);
+        gl_sc_addf(sc, "vec4 osd_tex%d = texture(%s, texcoord);\n", n, name);
+        gl_sc_addf(sc, "if (abs(osd_part - %d.0) < 0.5)\n", n);
+        switch (part->format) {
+        case SUBBITMAP_RGBA:
+            gl_sc_addf(sc, "    color = osd_tex%d.bgra;\n", n);
+            break;
+        case SUBBITMAP_LIBASS:
+            gl_sc_addf(sc, "    color = vec4(ass_color.rgb, "
+                           "ass_color.a * osd_tex%d.r);\n", n);
+            break;
+        default:
+            abort();
+        }
     }
 
-    return true;
+    return any;
 }
 
 static void write_quad(struct vertex *va, struct gl_transform t,
@@ -251,14 +467,17 @@ static void write_quad(struct vertex *va, struct gl_transform t,
 #undef COLOR_INIT
 }
 
-static void generate_verts(struct mpgl_osd_part *part, struct gl_transform t)
+static void generate_verts(struct mpgl_osd *ctx, int index,
+                           struct gl_transform t)
 {
-    MP_TARRAY_GROW(part, part->vertices,
-                   part->num_vertices + part->num_subparts * 6);
+    struct mpgl_osd_part *part = ctx->parts[index];
+
+    MP_TARRAY_GROW(ctx, ctx->vertices,
+                   ctx->num_vertices + part->num_subparts * 6);
 
     for (int n = 0; n < part->num_subparts; n++) {
         struct sub_bitmap *b = &part->subparts[n];
-        struct vertex *va = &part->vertices[part->num_vertices];
+        struct vertex *va = &ctx->vertices[ctx->num_vertices];
 
         // NOTE: the blend color is used with SUBBITMAP_LIBASS only, so it
         //       doesn't matter that we upload garbage for the other formats
@@ -270,8 +489,10 @@ static void generate_verts(struct mpgl_osd_part *part, struct gl_transform t)
                    b->x, b->y, b->x + b->dw, b->y + b->dh,
                    b->src_x, b->src_y, b->src_x + b->w, b->src_y + b->h,
                    part->w, part->h, color);
+        for (int i = 0; i < 6; i++)
+            va[i].osd_part = index;
 
-        part->num_vertices += 6;
+        ctx->num_vertices += 6;
     }
 }
 
@@ -287,35 +508,48 @@ static void get_3d_side_by_side(int stereo_mode, int div[2])
     }
 }
 
-void mpgl_osd_draw_finish(struct mpgl_osd *ctx, int index,
-                          struct gl_shader_cache *sc, struct ra_fbo fbo)
+// Draw all parts prepared by mpgl_osd_draw_prepare(). The parts are emitted
+// in order, and blending follows primitive order, so they stack the same way
+// as with separate draws.
+void mpgl_osd_draw_finish(struct mpgl_osd *ctx, struct gl_shader_cache *sc,
+                          struct ra_fbo fbo)
 {
-    struct mpgl_osd_part *part = ctx->parts[index];
-
     int div[2];
     get_3d_side_by_side(ctx->stereo_mode, div);
 
-    part->num_vertices = 0;
+    ctx->num_vertices = 0;
+
+    for (int n = 0; n < MAX_OSD_PARTS; n++) {
+        if (!part_visible(ctx, n))
+            continue;
+
+        // libass bitmaps are not premultiplied, but the parts share a blend
+        // mode, so premultiply them now (after any color management).
+        if (ctx->parts[n]->format == SUBBITMAP_LIBASS) {
+            gl_sc_addf(sc, "if (abs(osd_part - %d.0) < 0.5)\n"
+                           "    color.rgb *= color.a;\n", n);
+        }
 
-    for (int x = 0; x < div[0]; x++) {
-        for (int y = 0; y < div[1]; y++) {
-            struct gl_transform t;
-            gl_transform_ortho_fbo(&t, fbo);
+        for (int x = 0; x < div[0]; x++) {
+            for (int y = 0; y < div[1]; y++) {
+                struct gl_transform t;
+                gl_transform_ortho_fbo(&t, fbo);
 
-            float a_x = ctx->osd_res.w * x;
-            float a_y = ctx->osd_res.h * y;
-            t.t[0] += a_x * t.m[0][0] + a_y * t.m[1][0];
-            t.t[1] += a_x * t.m[0][1] + a_y * t.m[1][1];
+                float a_x = ctx->osd_res.w * x;
+                float a_y = ctx->osd_res.h * y;
+                t.t[0] += a_x * t.m[0][0] + a_y * t.m[1][0];
+                t.t[1] += a_x * t.m[0][1] + a_y * t.m[1][1];
 
-            generate_verts(part, t);
+                generate_verts(ctx, n, t);
+            }
         }
     }
 
-    const int *factors = &blend_factors[part->format][0];
-    gl_sc_blend(sc, factors[0], factors[1], factors[2], factors[3]);
+    gl_sc_blend(sc, RA_BLEND_ONE, RA_BLEND_ONE_MINUS_SRC_ALPHA,
+                    RA_BLEND_ONE, RA_BLEND_ONE_MINUS_SRC_ALPHA);
 
     gl_sc_dispatch_draw(sc, fbo.tex, false, vertex_vao, MP_ARRAY_SIZE(vertex_vao),
-                        sizeof(struct vertex), part->vertices, part->num_vertices);
+                        sizeof(struct vertex), ctx->vertices, ctx->num_vertices);
 }
 
 static void set_res(struct mpgl_osd *ctx, struct mp_osd_res res, int stereo_mode)
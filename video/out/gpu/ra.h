@@ -76,6 +76,9 @@ enum {
     RA_CAP_FRAGCOORD      = 1 << 10, // supports reading from gl_FragCoord
     RA_CAP_PARALLEL_COMPUTE  = 1 << 11, // supports parallel compute shaders
     RA_CAP_NUM_GROUPS     = 1 << 12, // supports gl_NumWorkGroups
+    RA_CAP_ASYNC_PASS     = 1 << 13, // renderpass_create can be called from
+                                     // another thread, concurrently with
+                                     // all other ra_fns
 };
 
 enum ra_ctype {
@@ -390,6 +393,8 @@ typedef void ra_timer;
 // Rendering API entrypoints. (Note: there are some additional hidden features
 // you need to take care of. For example, hwdec mapping will be provided
 // separately from ra, but might need to call into ra private code.)
+struct mp_gpu_mem_stats;
+
 struct ra_fns {
     void (*destroy)(struct ra *ra);
 
@@ -500,6 +505,9 @@ struct ra_fns {
     // Associates a marker with any past error messages, for debugging
     // purposes. Optional.
     void (*debug_marker)(struct ra *ra, const char *msg);
+
+    // Report statistics of the RA's own memory allocator. Optional.
+    void (*mem_stats)(struct ra *ra, struct mp_gpu_mem_stats *out);
 };
 
 struct ra_tex *ra_tex_create(struct ra *ra, const struct ra_tex_params *params);
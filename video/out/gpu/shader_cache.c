@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
@@ -11,13 +12,21 @@
 #include "osdep/io.h"
 
 #include "common/common.h"
+#include "misc/thread_pool.h"
 #include "options/path.h"
 #include "stream/stream.h"
 #include "shader_cache.h"
 #include "utils.h"
 
-// Force cache flush if more than this number of shaders is created.
-#define SC_MAX_ENTRIES 48
+// Default for the maximum number of cached shaders. If a new shader is created
+// while the cache is full, the least recently used one is dropped.
+#define SC_DEFAULT_MAX_ENTRIES 128
+
+// Number of hash table buckets for the cache (power of 2).
+#define SC_HASH_BUCKETS 256
+
+// Start of the disk cache files.
+#define SC_CACHE_HEADER "mpv shader cache v1\n"
 
 union uniform_val {
     float f[9];         // RA_VARTYPE_FLOAT
@@ -49,7 +58,20 @@ struct sc_cached_uniform {
     bool set; // whether the uniform has ever been set
 };
 
+// A renderpass being created on the compile thread.
+struct sc_compile_job {
+    struct gl_shader_cache *sc;
+    struct ra_renderpass_params *params;
+    char *cache_filename, *cache_dir;   // for writing the disk cache
+    // Protected by gl_shader_cache.compile_lock.
+    bool done;
+    struct ra_renderpass *pass;
+};
+
 struct sc_entry {
+    uint64_t hash;                  // of total
+    uint64_t last_used;             // gl_shader_cache.use_counter at last use
+    struct sc_entry *hash_next;     // next entry in the same hash bucket
     struct ra_renderpass *pass;
     struct sc_cached_uniform *cached_uniforms;
     int num_cached_uniforms;
@@ -57,7 +79,12 @@ struct sc_entry {
     struct timer_pool *timer;
     struct ra_buf *ubo;
     int ubo_index; // for ra_renderpass_input_val.index
+    // CPU copy of the UBO contents. Uniforms are written here, and the range
+    // [ubo_dirty_start, ubo_dirty_end) is uploaded with a single buf_update.
+    void *ubo_data;
+    size_t ubo_dirty_start, ubo_dirty_end;
     void *pushc;
+    struct sc_compile_job *job; // if non-NULL, pass is still being created
 };
 
 struct gl_shader_cache {
@@ -82,6 +109,15 @@ struct gl_shader_cache {
 
     struct sc_entry **entries;
     int num_entries;
+    int max_entries;
+    struct sc_entry *hash_buckets[SC_HASH_BUCKETS];
+    uint64_t use_counter;
+
+    // For gl_sc_set_async().
+    bool async;
+    struct mp_thread_pool *compile_thread;
+    pthread_mutex_t compile_lock;
+    int num_pending;            // number of entries with a job
 
     struct sc_entry *current_shader; // set by gl_sc_generate()
 
@@ -116,7 +152,9 @@ struct gl_shader_cache *gl_sc_create(struct ra *ra, struct mpv_global *global,
         .ra = ra,
         .global = global,
         .log = log,
+        .max_entries = SC_DEFAULT_MAX_ENTRIES,
     };
+    pthread_mutex_init(&sc->compile_lock, NULL);
     gl_sc_reset(sc);
     return sc;
 }
@@ -142,19 +180,99 @@ void gl_sc_reset(struct gl_shader_cache *sc)
     sc->needs_reset = false;
 }
 
+static void sc_free_entry(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    if (e->job) {
+        // Only happens on destruction, after the compile thread was stopped.
+        assert(e->job->done);
+        if (e->job->pass)
+            sc->ra->fns->renderpass_destroy(sc->ra, e->job->pass);
+        talloc_free(e->job);
+        sc->num_pending--;
+    }
+    ra_buf_free(sc->ra, &e->ubo);
+    if (e->pass)
+        sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
+    timer_pool_destroy(e->timer);
+    talloc_free(e);
+}
+
 static void sc_flush_cache(struct gl_shader_cache *sc)
 {
     MP_DBG(sc, "flushing shader cache\n");
 
+    for (int n = 0; n < sc->num_entries; n++)
+        sc_free_entry(sc, sc->entries[n]);
+    sc->num_entries = 0;
+    for (int n = 0; n < SC_HASH_BUCKETS; n++)
+        sc->hash_buckets[n] = NULL;
+}
+
+// Drop the least recently used shader. Returns false if there's none that can
+// be dropped (shaders still being compiled are skipped).
+static bool sc_evict_entry(struct gl_shader_cache *sc)
+{
+    int lru = -1;
     for (int n = 0; n < sc->num_entries; n++) {
         struct sc_entry *e = sc->entries[n];
-        ra_buf_free(sc->ra, &e->ubo);
-        if (e->pass)
-            sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
-        timer_pool_destroy(e->timer);
-        talloc_free(e);
+        if (!e->job && (lru < 0 || e->last_used < sc->entries[lru]->last_used))
+            lru = n;
     }
-    sc->num_entries = 0;
+    if (lru < 0)
+        return false;
+    struct sc_entry *e = sc->entries[lru];
+
+    struct sc_entry **link = &sc->hash_buckets[e->hash % SC_HASH_BUCKETS];
+    while (*link != e)
+        link = &(*link)->hash_next;
+    *link = e->hash_next;
+
+    MP_TARRAY_REMOVE_AT(sc->entries, sc->num_entries, lru);
+    MP_DBG(sc, "dropping least recently used shader\n");
+    sc_free_entry(sc, e);
+    return true;
+}
+
+// Set the maximum number of cached shaders.
+void gl_sc_set_max_entries(struct gl_shader_cache *sc, int max_entries)
+{
+    sc->max_entries = MPMAX(max_entries, 1);
+    while (sc->num_entries > sc->max_entries && sc_evict_entry(sc))
+        ;
+}
+
+// Drop all cached shaders (except those still being compiled). They're created
+// again when used, from the on-disk cache if enabled.
+void gl_sc_trim(struct gl_shader_cache *sc)
+{
+    while (sc_evict_entry(sc))
+        ;
+}
+
+// If enabled, and if the RA supports it (RA_CAP_ASYNC_PASS), new renderpasses
+// are created on a separate thread. Until they are ready, dispatching them does
+// nothing, and gl_sc_pending_compiles() returns a value larger than 0.
+void gl_sc_set_async(struct gl_shader_cache *sc, bool enable)
+{
+    sc->async = enable && (sc->ra->caps & RA_CAP_ASYNC_PASS);
+    if (sc->async && !sc->compile_thread) {
+        sc->compile_thread = mp_thread_pool_create(NULL, 1);
+        if (!sc->compile_thread) {
+            MP_WARN(sc, "failed to create shader compile thread\n");
+            sc->async = false;
+        }
+    }
+}
+
+// 64 bit FNV-1a
+static uint64_t sc_hash(bstr text)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t n = 0; n < text.len; n++) {
+        h ^= text.start[n];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
 }
 
 void gl_sc_destroy(struct gl_shader_cache *sc)
@@ -162,7 +280,11 @@ void gl_sc_destroy(struct gl_shader_cache *sc)
     if (!sc)
         return;
     gl_sc_reset(sc);
+    // Waits until all jobs are done.
+    talloc_free(sc->compile_thread);
     sc_flush_cache(sc);
+    assert(!sc->num_pending);
+    pthread_mutex_destroy(&sc->compile_lock);
     talloc_free(sc);
 }
 
@@ -470,18 +592,38 @@ static const char *vao_glsl_type(const struct ra_renderpass_input *e)
     }
 }
 
-static void update_ubo(struct ra *ra, struct ra_buf *ubo, struct sc_uniform *u)
+static void update_ubo(struct sc_entry *e, struct sc_uniform *u)
 {
     uintptr_t src = (uintptr_t) &u->v;
-    size_t dst = u->offset;
+    uintptr_t dst = (uintptr_t) e->ubo_data + (ptrdiff_t) u->offset;
     struct ra_layout src_layout = ra_renderpass_input_layout(&u->input);
     struct ra_layout dst_layout = u->layout;
 
     for (int i = 0; i < u->input.dim_m; i++) {
-        ra->fns->buf_update(ra, ubo, dst, (void *)src, src_layout.stride);
+        memcpy((void *)dst, (void *)src, src_layout.stride);
         src += src_layout.stride;
         dst += dst_layout.stride;
     }
+
+    size_t end = u->offset + u->layout.size;
+    if (e->ubo_dirty_start >= e->ubo_dirty_end) {
+        e->ubo_dirty_start = u->offset;
+        e->ubo_dirty_end = end;
+    } else {
+        e->ubo_dirty_start = MPMIN(e->ubo_dirty_start, u->offset);
+        e->ubo_dirty_end = MPMAX(e->ubo_dirty_end, end);
+    }
+}
+
+// Upload all UBO uniforms changed since the last call at once.
+static void flush_ubo(struct ra *ra, struct sc_entry *e)
+{
+    if (e->ubo_dirty_start >= e->ubo_dirty_end)
+        return;
+    size_t start = e->ubo_dirty_start;
+    ra->fns->buf_update(ra, e->ubo, start, (char *)e->ubo_data + start,
+                        e->ubo_dirty_end - start);
+    e->ubo_dirty_start = e->ubo_dirty_end = 0;
 }
 
 static void update_pushc(struct ra *ra, void *pushc, struct sc_uniform *u)
@@ -527,7 +669,7 @@ static void update_uniform(struct gl_shader_cache *sc, struct sc_entry *e,
     }
     case SC_UNIFORM_TYPE_UBO:
         assert(e->ubo);
-        update_ubo(sc->ra, e->ubo, u);
+        update_ubo(e, u);
         break;
     case SC_UNIFORM_TYPE_PUSHC:
         assert(e->pushc);
@@ -543,6 +685,76 @@ void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir)
     sc->cache_dir = talloc_strdup(sc, dir);
 }
 
+static void write_disk_cache(struct gl_shader_cache *sc,
+                             struct ra_renderpass_params *params,
+                             struct ra_renderpass *pass,
+                             const char *cache_filename, const char *cache_dir)
+{
+    bstr nc = pass->params.cached_program;
+    if (nc.len && !bstr_equals(params->cached_program, nc)) {
+        mp_mkdirp(cache_dir);
+
+        MP_DBG(sc, "Writing shader cache file: %s\n", cache_filename);
+        FILE *out = fopen(cache_filename, "wb");
+        if (out) {
+            fwrite(SC_CACHE_HEADER, strlen(SC_CACHE_HEADER), 1, out);
+            fwrite(nc.start, nc.len, 1, out);
+            fclose(out);
+        }
+    }
+}
+
+// Runs on the compile thread.
+static void compile_worker(void *ctx)
+{
+    struct sc_compile_job *job = ctx;
+    struct gl_shader_cache *sc = job->sc;
+
+    struct ra_renderpass *pass =
+        sc->ra->fns->renderpass_create(sc->ra, job->params);
+
+    pthread_mutex_lock(&sc->compile_lock);
+    job->pass = pass;
+    job->done = true;
+    pthread_mutex_unlock(&sc->compile_lock);
+}
+
+// Take over the renderpass if the entry's compile job is done.
+static void poll_compile_job(struct gl_shader_cache *sc, struct sc_entry *entry)
+{
+    struct sc_compile_job *job = entry->job;
+
+    pthread_mutex_lock(&sc->compile_lock);
+    bool done = job->done;
+    pthread_mutex_unlock(&sc->compile_lock);
+
+    if (!done)
+        return;
+
+    entry->pass = job->pass;
+    if (entry->pass) {
+        if (job->cache_filename) {
+            write_disk_cache(sc, job->params, entry->pass, job->cache_filename,
+                             job->cache_dir);
+        }
+    } else {
+        sc->error_state = true;
+    }
+    talloc_free(job);
+    entry->job = NULL;
+    sc->num_pending--;
+}
+
+// Return the number of renderpasses still being created in the background.
+int gl_sc_pending_compiles(struct gl_shader_cache *sc)
+{
+    for (int n = 0; n < sc->num_entries && sc->num_pending; n++) {
+        if (sc->entries[n]->job)
+            poll_compile_job(sc, sc->entries[n]);
+    }
+    return sc->num_pending;
+}
+
 static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
 {
     bool ret = false;
@@ -550,7 +762,6 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
     void *tmp = talloc_new(NULL);
     struct ra_renderpass_params params = sc->params;
 
-    const char *cache_header = "mpv shader cache v1\n";
     char *cache_filename = NULL;
     char *cache_dir = NULL;
 
@@ -577,7 +788,7 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
             MP_DBG(sc, "Trying to load shader from disk...\n");
             struct bstr cachedata =
                 stream_read_file(cache_filename, tmp, sc->global, 1000000000);
-            if (bstr_eatstart0(&cachedata, cache_header))
+            if (bstr_eatstart0(&cachedata, SC_CACHE_HEADER))
                 params.cached_program = cachedata;
         }
     }
@@ -613,25 +824,27 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
             MP_ERR(sc, "Failed creating uniform buffer!\n");
             goto error;
         }
+        entry->ubo_data = talloc_zero_size(entry, sc->ubo_size);
     }
 
-    entry->pass = sc->ra->fns->renderpass_create(sc->ra, &params);
-    if (!entry->pass)
-        goto error;
+    if (sc->async) {
+        struct sc_compile_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct sc_compile_job){
+            .sc = sc,
+            .params = ra_renderpass_params_copy(job, &params),
+            .cache_filename = talloc_strdup(job, cache_filename),
+            .cache_dir = talloc_strdup(job, cache_dir),
+        };
+        entry->job = job;
+        sc->num_pending++;
+        mp_thread_pool_queue(sc->compile_thread, compile_worker, job);
+    } else {
+        entry->pass = sc->ra->fns->renderpass_create(sc->ra, &params);
+        if (!entry->pass)
+            goto error;
 
-    if (entry->pass && cache_filename) {
-        bstr nc = entry->pass->params.cached_program;
-        if (nc.len && !bstr_equals(params.cached_program, nc)) {
-            mp_mkdirp(cache_dir);
-
-            MP_DBG(sc, "Writing shader cache file: %s\n", cache_filename);
-            FILE *out = fopen(cache_filename, "wb");
-            if (out) {
-                fwrite(cache_header, strlen(cache_header), 1, out);
-                fwrite(nc.start, nc.len, 1, out);
-                fclose(out);
-            }
-        }
+        if (cache_filename)
+            write_disk_cache(sc, &params, entry->pass, cache_filename, cache_dir);
     }
 
     ret = true;
@@ -890,22 +1103,27 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
     if (sc->params.target_format)
         ADD(hash_total, "format %s\n", sc->params.target_format->name);
 
+    uint64_t hash = sc_hash(*hash_total);
+    struct sc_entry **bucket = &sc->hash_buckets[hash % SC_HASH_BUCKETS];
+
     struct sc_entry *entry = NULL;
-    for (int n = 0; n < sc->num_entries; n++) {
-        struct sc_entry *cur = sc->entries[n];
-        if (bstr_equals(cur->total, *hash_total)) {
+    for (struct sc_entry *cur = *bucket; cur; cur = cur->hash_next) {
+        if (cur->hash == hash && bstr_equals(cur->total, *hash_total)) {
             entry = cur;
             break;
         }
     }
     if (!entry) {
-        if (sc->num_entries == SC_MAX_ENTRIES)
-            sc_flush_cache(sc);
+        while (sc->num_entries >= sc->max_entries && sc_evict_entry(sc))
+            ;
         entry = talloc_ptrtype(NULL, entry);
         *entry = (struct sc_entry){
+            .hash = hash,
+            .hash_next = *bucket,
             .total = bstrdup(entry, *hash_total),
             .timer = timer_pool_create(sc->ra),
         };
+        *bucket = entry;
 
         // The vertex shader uses mangled names for the vertex attributes, so
         // that the fragment shader can use the "real" names. But the shader is
@@ -935,6 +1153,11 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
         MP_TARRAY_APPEND(sc, sc->entries, sc->num_entries, entry);
     }
 
+    entry->last_used = ++sc->use_counter;
+
+    if (entry->job)
+        poll_compile_job(sc, entry);
+
     if (!entry->pass) {
         sc->current_shader = NULL;
         return;
@@ -948,6 +1171,7 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
 
     // If we're using a UBO, make sure to bind it as well
     if (sc->ubo_size) {
+        flush_ubo(sc->ra, entry);
         struct ra_renderpass_input_val ubo_val = {
             .index = entry->ubo_index,
             .data = &entry->ubo,
@@ -60,3 +60,7 @@ struct mp_pass_perf gl_sc_dispatch_compute(struct gl_shader_cache *sc,
 // is normally done implicitly by gl_sc_dispatch_*
 void gl_sc_reset(struct gl_shader_cache *sc);
 void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir);
+void gl_sc_set_max_entries(struct gl_shader_cache *sc, int max_entries);
+void gl_sc_trim(struct gl_shader_cache *sc);
+void gl_sc_set_async(struct gl_shader_cache *sc, bool enable);
+int gl_sc_pending_compiles(struct gl_shader_cache *sc);
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "common/msg.h"
 #include "video/out/vo.h"
 #include "utils.h"
@@ -45,7 +47,9 @@ void ra_buf_pool_uninit(struct ra *ra, struct ra_buf_pool *pool)
         ra_buf_free(ra, &pool->buffers[i]);
 
     talloc_free(pool->buffers);
-    *pool = (struct ra_buf_pool){0};
+    *pool = (struct ra_buf_pool){
+        .no_host_mapped = pool->no_host_mapped,
+    };
 }
 
 static bool ra_buf_params_compatible(const struct ra_buf_params *new,
@@ -113,14 +117,39 @@ bool ra_tex_upload_pbo(struct ra *ra, struct ra_buf_pool *pbo,
     struct ra_buf_params bufparams = {
         .type = RA_BUF_TYPE_TEX_UPLOAD,
         .size = row_size * height * tex->params.d,
-        .host_mutable = true,
     };
 
-    struct ra_buf *buf = ra_buf_pool_get(ra, pbo, &bufparams);
-    if (!buf)
-        return false;
+    // Prefer persistently mapped buffers: the data is copied into the mapping
+    // directly, and buf_poll() tracks when the GPU is done with a buffer, so
+    // the pool is made large enough that the copy never has to wait for the
+    // driver. Fall back to buf_update() if the RA can't map buffers.
+    struct ra_buf *buf = NULL;
+    if (!pbo->no_host_mapped) {
+        bufparams.host_mapped = true;
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
+        if (!buf && pbo->num_buffers) // all busy, and creating one failed
+            return false;
+        if (!buf) {
+            MP_VERBOSE(ra, "Mapped upload buffers unavailable, using "
+                       "buf_update() instead.\n");
+            pbo->no_host_mapped = true;
+            ra_buf_pool_uninit(ra, pbo);
+        }
+    }
+
+    if (!buf) {
+        bufparams.host_mapped = false;
+        bufparams.host_mutable = true;
+        buf = ra_buf_pool_get(ra, pbo, &bufparams);
+        if (!buf)
+            return false;
+    }
 
-    ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    if (buf->data) {
+        memcpy(buf->data, params->src, bufparams.size);
+    } else {
+        ra->fns->buf_update(ra, buf, 0, params->src, bufparams.size);
+    }
 
     struct ra_tex_upload_params newparams = *params;
     newparams.buf = buf;
@@ -71,6 +71,7 @@ struct ra_buf_pool {
     struct ra_buf **buffers;
     int num_buffers;
     int index;
+    bool no_host_mapped; // set by ra_tex_upload_pbo() if mapping failed
 };
 
 void ra_buf_pool_uninit(struct ra *ra, struct ra_buf_pool *pool);
@@ -16,11 +16,14 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lfg.h>
@@ -30,7 +33,12 @@
 #include "misc/bstr.h"
 #include "options/m_config.h"
 #include "common/global.h"
+#include "common/trace.h"
 #include "options/options.h"
+#include "options/path.h"
+#include "osdep/getpid.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
 #include "utils.h"
 #include "hwdec.h"
 #include "osd.h"
@@ -112,8 +120,21 @@ struct image {
 struct saved_img {
     const char *name;
     struct image img;
+    bool held; // img was returned to the renderer by pass_hook()
 };
 
+// Intermediate texture for hook passes. These are shared between passes: a
+// texture is released as soon as no saved image refers to it anymore, and can
+// then be reused by a later pass with the same size in the same frame.
+struct hook_tex {
+    struct ra_tex *tex;
+    bool in_use;
+    int unused_frames; // number of frames the texture was not used at all
+};
+
+// Free hook textures which were not used for this many frames.
+#define HOOK_TEX_MAX_UNUSED 10
+
 // A texture hook. This is some operation that transforms a named texture as
 // soon as it's generated
 struct tex_hook {
@@ -145,6 +166,23 @@ struct pass_info {
     struct mp_pass_perf perf;
 };
 
+// A scaler LUT texture, computed from the given kernel parameters. These are
+// cached, so that switching between scale factors (e.g. during zooming with
+// --correct-downscaling) or scaler units with the same kernel doesn't need to
+// recompute the weights.
+struct scaler_lut {
+    struct filter_kernel params; // kernel before mp_init_filter()
+    const int *sizes;
+    double scale_factor;
+    int lut_size;
+    struct filter_kernel kernel; // after mp_init_filter()
+    bool insufficient;
+    struct ra_tex *tex;
+    uint64_t last_used;
+};
+
+#define SCALER_LUT_CACHE_SIZE 16
+
 struct dr_buffer {
     struct ra_buf *buf;
     // The mpi reference will keep the data from being recycled (or from other
@@ -196,6 +234,7 @@ struct gl_video {
 
     bool dumb_mode;
     bool forced_dumb_mode;
+    bool in_warmup;
 
     // Cached vertex array, to avoid re-allocation per frame. For simplicity,
     // our vertex format is simply a list of `vertex_pt`s, since this greatly
@@ -213,13 +252,16 @@ struct gl_video {
     struct ra_tex *screen_tex;
     struct ra_tex *output_tex;
     struct ra_tex *vdpau_deinterleave_tex[2];
-    struct ra_tex **hook_textures;
+    struct hook_tex *hook_textures;
     int num_hook_textures;
-    int idx_hook_textures;
 
     struct ra_buf *hdr_peak_ssbo;
     struct surface surfaces[SURFACES_MAX];
 
+    struct scaler_lut *scaler_luts;
+    int num_scaler_luts;
+    uint64_t scaler_lut_counter;
+
     // user pass descriptions and textures
     struct tex_hook *tex_hooks;
     int num_tex_hooks;
@@ -257,6 +299,11 @@ struct gl_video {
     bool use_linear;
     float user_gamma;
 
+    // Last mp_get_csp_matrix() result, to avoid recomputing it on each frame
+    struct mp_csp_params cached_cparams;
+    struct mp_cmat cached_cmat;
+    bool cached_cmat_valid;
+
     // pass info / metrics
     struct pass_info pass_fresh[VO_PASS_PERF_MAX];
     struct pass_info pass_redraw[VO_PASS_PERF_MAX];
@@ -264,6 +311,13 @@ struct gl_video {
     int pass_idx;
     struct timer_pool *upload_timer;
     struct timer_pool *blit_timer;
+
+    // --gpu-trace-file
+    FILE *trace_file;
+    char *trace_path;
+    int64_t trace_start;        // mp_time_us() when the file was opened
+    int64_t trace_frame_start;  // mp_time_us() when rendering the frame began
+    int trace_events;
     struct timer_pool *osd_timer;
 
     int frames_uploaded;
@@ -317,6 +371,7 @@ static const struct gl_video_opts gl_video_opts_def = {
     .tone_mapping_param = NAN,
     .tone_mapping_desat = 0.5,
     .early_flush = -1,
+    .shader_cache_size = 128,
     .hwdec_interop = "auto",
 };
 
@@ -411,6 +466,10 @@ const struct m_sub_options gl_video_conf = {
         OPT_INTRANGE("gpu-tex-pad-y", tex_pad_y, 0, 0, 4096),
         OPT_SUBSTRUCT("", icc_opts, mp_icc_conf, 0),
         OPT_STRING("gpu-shader-cache-dir", shader_cache_dir, 0),
+        OPT_INTRANGE("gpu-shader-cache-size", shader_cache_size, 0, 1, 100000),
+        OPT_FLAG("gpu-shader-async", shader_async, 0),
+        OPT_FLAG("gpu-shader-warmup", shader_warmup, 0),
+        OPT_STRING("gpu-trace-file", trace_file, M_OPT_FILE),
         OPT_STRING_VALIDATE("gpu-hwdec-interop", hwdec_interop, 0,
                              ra_hwdec_validate_opt),
         OPT_REPLACED("opengl-hwdec-interop", "gpu-hwdec-interop"),
@@ -534,7 +593,7 @@ static void uninit_rendering(struct gl_video *p)
         ra_tex_free(p->ra, &p->surfaces[n].tex);
 
     for (int n = 0; n < p->num_hook_textures; n++)
-        ra_tex_free(p->ra, &p->hook_textures[n]);
+        ra_tex_free(p->ra, &p->hook_textures[n].tex);
 
     gl_video_reset_surfaces(p);
     gl_video_reset_hooks(p);
@@ -564,6 +623,13 @@ void gl_video_set_icc_profile(struct gl_video *p, bstr icc_data)
         reinit_from_options(p);
 }
 
+// cb is called from a worker thread when an ICC 3D LUT generated in the
+// background becomes available, i.e. when a redraw would apply it.
+void gl_video_set_lut3d_cb(struct gl_video *p, void (*cb)(void *ctx), void *ctx)
+{
+    gl_lcms_set_lut3d_cb(p->cms, cb, ctx);
+}
+
 bool gl_video_icc_auto_enabled(struct gl_video *p)
 {
     return p->opts.icc_opts ? p->opts.icc_opts->profile_auto : false;
@@ -592,13 +658,17 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
     }
 
     struct lut3d *lut3d = NULL;
-    if (!fmt || !gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc, icc) || !lut3d) {
+    if (!fmt || !gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc, icc)) {
         p->use_lut_3d = false;
         return false;
     }
 
     ra_tex_free(p->ra, &p->lut_3d_texture);
 
+    // Still being generated on another thread; render without it meanwhile.
+    if (!lut3d)
+        return false;
+
     struct ra_tex_params params = {
         .dimensions = 3,
         .w = lut3d->size[0],
@@ -1070,6 +1140,138 @@ static void pass_report_performance(struct gl_video *p)
     }
 }
 
+// Writes pass timings and present times as Chrome trace events ("JSON Array
+// Format", see chrome://tracing). Timestamps are in microseconds, relative to
+// when the file was opened. GPU passes are laid out back to back after the
+// start of rendering, since only their durations are known.
+enum {
+    TRACE_TID_FRAME = 1,
+    TRACE_TID_GPU,
+    TRACE_TID_PRESENT,
+};
+
+static void trace_write_str(FILE *f, bstr s)
+{
+    fputc('"', f);
+    for (size_t n = 0; n < s.len; n++) {
+        unsigned char c = s.start[n];
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void trace_begin_event(struct gl_video *p)
+{
+    fputs(p->trace_events++ ? ",\n" : "[\n", p->trace_file);
+}
+
+static void trace_name_thread(struct gl_video *p, int tid, const char *name)
+{
+    trace_begin_event(p);
+    fprintf(p->trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":", tid);
+    trace_write_str(p->trace_file, bstr0(name));
+    fputs("}}", p->trace_file);
+}
+
+// Ends with an open args object; caller must add fields and close it.
+static void trace_event(struct gl_video *p, int tid, bstr name, int64_t ts,
+                        int64_t dur)
+{
+    trace_begin_event(p);
+    fputs("{\"name\":", p->trace_file);
+    trace_write_str(p->trace_file, name);
+    fprintf(p->trace_file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%"PRId64",\"dur\":%"PRId64",\"args\":{",
+            tid, ts - p->trace_start, MPMAX(dur, 0));
+}
+
+static void trace_close(struct gl_video *p)
+{
+    if (p->trace_file) {
+        if (p->trace_events)
+            fputs("\n]\n", p->trace_file);
+        fclose(p->trace_file);
+        p->trace_file = NULL;
+    }
+    TA_FREEP(&p->trace_path);
+}
+
+static void trace_reinit(struct gl_video *p)
+{
+    const char *path = p->opts.trace_file;
+    if (path && !path[0])
+        path = NULL;
+    if (!path && !p->trace_path)
+        return;
+    if (path && p->trace_path && strcmp(path, p->trace_path) == 0)
+        return;
+
+    trace_close(p);
+    if (!path)
+        return;
+
+    p->trace_path = talloc_strdup(p, path);
+    char *fname = mp_get_user_path(NULL, p->global, path);
+    p->trace_file = fopen(fname, "wb");
+    if (!p->trace_file)
+        MP_ERR(p, "Could not open trace file '%s'.\n", fname);
+    talloc_free(fname);
+    if (!p->trace_file)
+        return;
+
+    p->trace_start = mp_time_us();
+    p->trace_events = 0;
+    trace_name_thread(p, TRACE_TID_FRAME, "frames (CPU)");
+    trace_name_thread(p, TRACE_TID_GPU, "passes (GPU)");
+    trace_name_thread(p, TRACE_TID_PRESENT, "present (CPU)");
+}
+
+// Write the passes recorded for the frame rendered last.
+static void trace_frame(struct gl_video *p, struct vo_frame *frame)
+{
+    if (!p->trace_file)
+        return;
+
+    int64_t now = mp_time_us();
+    bool redraw = p->pass == p->pass_redraw;
+    uint64_t gpu_total = 0;
+
+    int64_t ts = p->trace_frame_start;
+    for (int i = 0; p->pass && i < p->pass_idx; i++) {
+        struct pass_info *pass = &p->pass[i];
+        int64_t dur = pass->perf.last / 1000;
+        trace_event(p, TRACE_TID_GPU, pass->desc, ts, dur);
+        fprintf(p->trace_file, "\"avg_us\":%"PRIu64",\"peak_us\":%"PRIu64"}}",
+                pass->perf.avg / 1000, pass->perf.peak / 1000);
+        ts += dur;
+        gpu_total += pass->perf.last;
+    }
+
+    trace_event(p, TRACE_TID_FRAME, bstr0(redraw ? "redraw" : "frame"),
+                p->trace_frame_start, now - p->trace_frame_start);
+    fprintf(p->trace_file, "\"frame_id\":%"PRIu64",\"passes\":%d,"
+            "\"gpu_us\":%"PRIu64",\"vsyncs\":%d,\"interpolated\":%s}}",
+            frame->frame_id, p->pass_idx, gpu_total / 1000, frame->num_vsyncs,
+            p->is_interpolated ? "true" : "false");
+}
+
+// Record the time spent in the swapchain's swap_buffers(), i.e. waiting for
+// the presentation of the frame.
+void gl_video_trace_present(struct gl_video *p, int64_t start, int64_t end)
+{
+    if (!p->trace_file)
+        return;
+    trace_event(p, TRACE_TID_PRESENT, bstr0("present"), start, end - start);
+    fputs("}}", p->trace_file);
+}
+
 static void pass_prepare_src_tex(struct gl_video *p)
 {
     struct gl_shader_cache *sc = p->sc;
@@ -1241,6 +1443,30 @@ static void finish_pass_fbo(struct gl_video *p, struct ra_fbo fbo,
     cleanup_binds(p);
 }
 
+// Like finish_pass_fbo(), but for compute shaders, which write the dst
+// rectangle of fbo directly. Requires fbo.tex->params.storage_dst. Since the
+// shader may be dispatched with more invocations than pixels, stores outside
+// of dst are skipped. gl_FragCoord is emulated for the dither/alpha code.
+static void finish_pass_compute_fbo(struct gl_video *p, struct ra_fbo fbo,
+                                    const struct mp_rect *dst)
+{
+    int w = dst->x1 - dst->x0, h = dst->y1 - dst->y0;
+
+    gl_sc_uniform_vec2(p->sc, "out_offset", (float[2]){dst->x0, dst->y0});
+    gl_sc_uniform_vec2(p->sc, "out_size", (float[2]){w, h});
+    PRELUDE("#define gl_FragCoord vec4(vec2(gl_GlobalInvocationID.xy) + "
+            "out_offset + vec2(0.5), 0.0, 1.0)\n");
+
+    gl_sc_uniform_image2D_wo(p->sc, "out_image", fbo.tex);
+    GLSL(if (all(lessThan(vec2(gl_GlobalInvocationID.xy), out_size))))
+    GLSL(    imageStore(out_image, ivec2(gl_GlobalInvocationID) + ivec2(out_offset), color);)
+
+    dispatch_compute(p, w, h, p->pass_compute);
+    p->pass_compute = (struct compute_info){0};
+
+    debug_check_gl(p, "after dispatching compute shader");
+}
+
 // dst_fbo: this will be used for rendering; possibly reallocating the whole
 //          FBO, if the required parameters have changed
 // w, h: required FBO target dimension, and also defines the target rectangle
@@ -1318,11 +1544,18 @@ static void skip_unused(struct gl_video *p, int num_components)
 static void uninit_scaler(struct gl_video *p, struct scaler *scaler)
 {
     ra_tex_free(p->ra, &scaler->sep_fbo);
-    ra_tex_free(p->ra, &scaler->lut);
+    scaler->lut = NULL; // owned by p->scaler_luts
     scaler->kernel = NULL;
     scaler->initialized = false;
 }
 
+static void uninit_scaler_luts(struct gl_video *p)
+{
+    for (int n = 0; n < p->num_scaler_luts; n++)
+        ra_tex_free(p->ra, &p->scaler_luts[n].tex);
+    p->num_scaler_luts = 0;
+}
+
 static void hook_prelude(struct gl_video *p, const char *name, int id,
                          struct image img)
 {
@@ -1366,21 +1599,48 @@ static bool saved_img_find(struct gl_video *p, const char *name,
     return false;
 }
 
+// Mark tex as reusable by later hook passes, unless a saved image still refers
+// to it. Textures not allocated by next_hook_tex() are ignored.
+static void hook_tex_release(struct gl_video *p, struct ra_tex *tex)
+{
+    if (!tex)
+        return;
+
+    for (int i = 0; i < p->num_saved_imgs; i++) {
+        if (p->saved_imgs[i].img.tex == tex)
+            return;
+    }
+
+    for (int n = 0; n < p->num_hook_textures; n++) {
+        if (p->hook_textures[n].tex == tex)
+            p->hook_textures[n].in_use = false;
+    }
+}
+
+// held: see saved_img.held
 static void saved_img_store(struct gl_video *p, const char *name,
-                            struct image img)
+                            struct image img, bool held)
 {
     assert(name);
 
     for (int i = 0; i < p->num_saved_imgs; i++) {
-        if (strcmp(p->saved_imgs[i].name, name) == 0) {
-            p->saved_imgs[i].img = img;
+        struct saved_img *saved = &p->saved_imgs[i];
+        if (strcmp(saved->name, name) == 0) {
+            struct saved_img old = *saved;
+            saved->img = img;
+            saved->held = held;
+            // The old texture is unreachable now if the renderer doesn't
+            // use it anymore either.
+            if (!old.held && old.img.tex != img.tex)
+                hook_tex_release(p, old.img.tex);
             return;
         }
     }
 
     MP_TARRAY_APPEND(p, p->saved_imgs, p->num_saved_imgs, (struct saved_img) {
         .name = name,
-        .img = img
+        .img = img,
+        .held = held,
     });
 }
 
@@ -1429,12 +1689,44 @@ next_bind: ;
     return true;
 }
 
-static struct ra_tex **next_hook_tex(struct gl_video *p)
+// Return a texture for the output of a hook pass with the given size. This
+// prefers textures released earlier in the frame with the same size, so that
+// the allocations stay the same from frame to frame.
+static struct ra_tex **next_hook_tex(struct gl_video *p, int w, int h)
 {
-    if (p->idx_hook_textures == p->num_hook_textures)
-        MP_TARRAY_APPEND(p, p->hook_textures, p->num_hook_textures, NULL);
+    struct hook_tex *res = NULL;
+    for (int n = 0; n < p->num_hook_textures; n++) {
+        struct hook_tex *ht = &p->hook_textures[n];
+        if (ht->in_use)
+            continue;
+        if (ht->tex && ht->tex->params.w == w && ht->tex->params.h == h) {
+            res = ht;
+            break;
+        }
+        if (!ht->tex && !res)
+            res = ht;
+    }
 
-    return &p->hook_textures[p->idx_hook_textures++];
+    if (!res) {
+        MP_TARRAY_APPEND(p, p->hook_textures, p->num_hook_textures,
+                         (struct hook_tex){0});
+        res = &p->hook_textures[p->num_hook_textures - 1];
+    }
+
+    res->in_use = true;
+    res->unused_frames = -1; // incremented to 0 by the next hook_tex_reset()
+    return &res->tex;
+}
+
+// Called at the start of each frame.
+static void hook_tex_reset(struct gl_video *p)
+{
+    for (int n = 0; n < p->num_hook_textures; n++) {
+        struct hook_tex *ht = &p->hook_textures[n];
+        ht->in_use = false;
+        if (ht->tex && ++ht->unused_frames >= HOOK_TEX_MAX_UNUSED)
+            ra_tex_free(p->ra, &ht->tex);
+    }
 }
 
 // Process hooks for a plane, saving the result and returning a new image
@@ -1445,7 +1737,7 @@ static struct image pass_hook(struct gl_video *p, const char *name,
     if (!name)
         return img;
 
-    saved_img_store(p, name, img);
+    saved_img_store(p, name, img, true);
 
     MP_TRACE(p, "Running hooks for %s\n", name);
     for (int i = 0; i < p->num_tex_hooks; i++) {
@@ -1483,7 +1775,7 @@ found:
         int w = lroundf(fabs(sz.x1 - sz.x0));
         int h = lroundf(fabs(sz.y1 - sz.y0));
 
-        struct ra_tex **tex = next_hook_tex(p);
+        struct ra_tex **tex = next_hook_tex(p, w, h);
         finish_pass_tex(p, tex, w, h);
         const char *store_name = hook->save_tex ? hook->save_tex : name;
         struct image saved_img = image_wrap(*tex, img.type, comps);
@@ -1498,12 +1790,16 @@ found:
                 return img;
             }
 
+            struct image old = img;
             img = saved_img;
             if (trans)
                 gl_transform_trans(hook_off, trans);
-        }
 
-        saved_img_store(p, store_name, saved_img);
+            saved_img_store(p, store_name, saved_img, true);
+            hook_tex_release(p, old.tex);
+        } else {
+            saved_img_store(p, store_name, saved_img, false);
+        }
     }
 
     return img;
@@ -1538,7 +1834,7 @@ static void pass_opt_hook_point(struct gl_video *p, const char *name,
     return;
 
 found: ;
-    struct ra_tex **tex = next_hook_tex(p);
+    struct ra_tex **tex = next_hook_tex(p, p->texture_w, p->texture_h);
     finish_pass_tex(p, tex, p->texture_w, p->texture_h);
     struct image img = image_wrap(*tex, PLANE_RGB, p->components);
     img = pass_hook(p, name, img, tex_trans);
@@ -1599,6 +1895,119 @@ static bool scaler_conf_eq(struct scaler_config a, struct scaler_config b)
            a.clamp == b.clamp;
 }
 
+static bool filter_window_eq(const struct filter_window *a,
+                             const struct filter_window *b)
+{
+    return a->weight == b->weight &&
+           a->radius == b->radius &&
+           a->params[0] == b->params[0] &&
+           a->params[1] == b->params[1] &&
+           a->blur == b->blur &&
+           a->taper == b->taper;
+}
+
+static bool scaler_lut_matches(struct scaler_lut *lut,
+                               const struct filter_kernel *k,
+                               const int *sizes, double scale_factor,
+                               int lut_size)
+{
+    // (NaN parameters are replaced by the filter defaults before this.)
+    return filter_window_eq(&lut->params.f, &k->f) &&
+           filter_window_eq(&lut->params.w, &k->w) &&
+           lut->params.clamp == k->clamp &&
+           lut->params.value_cutoff == k->value_cutoff &&
+           lut->params.polar == k->polar &&
+           lut->sizes == sizes &&
+           lut->scale_factor == scale_factor &&
+           lut->lut_size == lut_size;
+}
+
+static bool scaler_lut_in_use(struct gl_video *p, struct scaler_lut *lut)
+{
+    for (int n = 0; n < SCALER_COUNT; n++) {
+        if (lut->tex && p->scaler[n].lut == lut->tex)
+            return true;
+    }
+    return false;
+}
+
+// Return a cache entry for the kernel, initialized by mp_init_filter(), and
+// with a LUT texture (if creating it succeeded).
+static struct scaler_lut *get_scaler_lut(struct gl_video *p,
+                                         const struct filter_kernel *kernel,
+                                         const int *sizes, double scale_factor,
+                                         int lut_size)
+{
+    struct scaler_lut *lut = NULL;
+    for (int n = 0; n < p->num_scaler_luts; n++) {
+        if (scaler_lut_matches(&p->scaler_luts[n], kernel, sizes,
+                               scale_factor, lut_size))
+        {
+            lut = &p->scaler_luts[n];
+            goto done;
+        }
+    }
+
+    if (p->num_scaler_luts < SCALER_LUT_CACHE_SIZE) {
+        MP_TARRAY_GROW(p, p->scaler_luts, p->num_scaler_luts);
+        lut = &p->scaler_luts[p->num_scaler_luts++];
+    } else {
+        // Evict the least recently used entry. At most SCALER_COUNT entries
+        // can be in use, so there is always one.
+        for (int n = 0; n < p->num_scaler_luts; n++) {
+            struct scaler_lut *e = &p->scaler_luts[n];
+            if (!scaler_lut_in_use(p, e) &&
+                (!lut || e->last_used < lut->last_used))
+                lut = e;
+        }
+        assert(lut);
+        ra_tex_free(p->ra, &lut->tex);
+    }
+
+    *lut = (struct scaler_lut){
+        .params = *kernel,
+        .sizes = sizes,
+        .scale_factor = scale_factor,
+        .lut_size = lut_size,
+        .kernel = *kernel,
+    };
+    lut->insufficient = !mp_init_filter(&lut->kernel, sizes, scale_factor);
+
+    int size = lut->kernel.size;
+    int num_components = size > 2 ? 4 : size;
+    const struct ra_format *fmt = ra_find_float16_format(p->ra, num_components);
+    assert(fmt);
+
+    int width = (size + num_components - 1) / num_components; // round up
+    int stride = width * num_components;
+    assert(size <= stride);
+
+    float *weights = talloc_array(NULL, float, lut_size * stride);
+    mp_compute_lut(&lut->kernel, lut_size, stride, weights);
+
+    bool use_1d = lut->kernel.polar && (p->ra->caps & RA_CAP_TEX_1D);
+
+    struct ra_tex_params lut_params = {
+        .dimensions = use_1d ? 1 : 2,
+        .w = use_1d ? lut_size : width,
+        .h = use_1d ? 1 : lut_size,
+        .d = 1,
+        .format = fmt,
+        .render_src = true,
+        .src_linear = true,
+        .initial_data = weights,
+    };
+    lut->tex = ra_tex_create(p->ra, &lut_params);
+
+    talloc_free(weights);
+
+    debug_check_gl(p, "after initializing scaler");
+
+done:
+    lut->last_used = ++p->scaler_lut_counter;
+    return lut;
+}
+
 static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
                           const struct scaler_config *conf,
                           double scale_factor,
@@ -1609,7 +2018,10 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
         scaler->initialized)
         return;
 
-    uninit_scaler(p, scaler);
+    // sep_fbo is kept; it's resized as needed when rendering.
+    scaler->lut = NULL;
+    scaler->kernel = NULL;
+    scaler->initialized = false;
 
     scaler->conf = *conf;
     bool is_tscale = scaler->index == SCALER_TSCALE;
@@ -1656,39 +2068,13 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
     scaler->kernel->clamp = conf->clamp;
     scaler->kernel->value_cutoff = conf->cutoff;
 
-    scaler->insufficient = !mp_init_filter(scaler->kernel, sizes, scale_factor);
-
-    int size = scaler->kernel->size;
-    int num_components = size > 2 ? 4 : size;
-    const struct ra_format *fmt = ra_find_float16_format(p->ra, num_components);
-    assert(fmt);
-
-    int width = (size + num_components - 1) / num_components; // round up
-    int stride = width * num_components;
-    assert(size <= stride);
-
     scaler->lut_size = 1 << p->opts.scaler_lut_size;
 
-    float *weights = talloc_array(NULL, float, scaler->lut_size * stride);
-    mp_compute_lut(scaler->kernel, scaler->lut_size, stride, weights);
-
-    bool use_1d = scaler->kernel->polar && (p->ra->caps & RA_CAP_TEX_1D);
-
-    struct ra_tex_params lut_params = {
-        .dimensions = use_1d ? 1 : 2,
-        .w = use_1d ? scaler->lut_size : width,
-        .h = use_1d ? 1 : scaler->lut_size,
-        .d = 1,
-        .format = fmt,
-        .render_src = true,
-        .src_linear = true,
-        .initial_data = weights,
-    };
-    scaler->lut = ra_tex_create(p->ra, &lut_params);
-
-    talloc_free(weights);
-
-    debug_check_gl(p, "after initializing scaler");
+    struct scaler_lut *lut = get_scaler_lut(p, scaler->kernel, sizes,
+                                            scale_factor, scaler->lut_size);
+    *scaler->kernel = lut->kernel;
+    scaler->insufficient = lut->insufficient;
+    scaler->lut = lut->tex;
 }
 
 // Special helper for sampling from two separated stages
@@ -2219,8 +2605,15 @@ static void pass_convert_yuv(struct gl_video *p)
 
     // Conversion to RGB. For RGB itself, this still applies e.g. brightness
     // and contrast controls, or expansion of e.g. LSB-packed 10 bit data.
-    struct mp_cmat m = {{{0}}};
-    mp_get_csp_matrix(&cparams, &m);
+    if (!p->cached_cmat_valid ||
+        !mp_csp_params_matrix_equal(&p->cached_cparams, &cparams))
+    {
+        p->cached_cmat = (struct mp_cmat){{{0}}};
+        mp_get_csp_matrix(&cparams, &p->cached_cmat);
+        p->cached_cparams = cparams;
+        p->cached_cmat_valid = true;
+    }
+    struct mp_cmat m = p->cached_cmat;
     gl_sc_uniform_mat3(sc, "colormatrix", true, &m.m[0][0]);
     gl_sc_uniform_vec3(sc, "colormatrix_c", m.c);
 
@@ -2414,6 +2807,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         .sig_peak = p->opts.target_peak / MP_REF_WHITE,
     };
 
+    bool use_lut_3d = false;
     if (p->use_lut_3d) {
         // The 3DLUT is always generated against the video's original source
         // space, *not* the reference space. (To avoid having to regenerate
@@ -2428,7 +2822,8 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         if (mp_trc_is_hdr(trc_orig))
             trc_orig = MP_CSP_TRC_GAMMA22;
 
-        if (gl_video_get_lut3d(p, prim_orig, trc_orig)) {
+        use_lut_3d = gl_video_get_lut3d(p, prim_orig, trc_orig);
+        if (use_lut_3d) {
             dst.primaries = prim_orig;
             dst.gamma = trc_orig;
             assert(dst.primaries && dst.gamma);
@@ -2481,6 +2876,8 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
             uint32_t frame_sum[PEAK_DETECT_FRAMES+1];
             uint32_t total_max;
             uint32_t total_sum;
+            uint32_t frame_hist[PEAK_DETECT_HIST_BINS];
+            uint32_t prev_hist[PEAK_DETECT_HIST_BINS];
         } peak_ssbo = {0};
 
         struct ra_buf_params params = {
@@ -2507,9 +2904,13 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
             "uint frame_max[%d];"
             "uint frame_avg[%d];"
             "uint total_max;"
-            "uint total_avg;",
+            "uint total_avg;"
+            "uint frame_hist[%d];"
+            "uint prev_hist[%d];",
             PEAK_DETECT_FRAMES + 1,
-            PEAK_DETECT_FRAMES + 1
+            PEAK_DETECT_FRAMES + 1,
+            PEAK_DETECT_HIST_BINS,
+            PEAK_DETECT_HIST_BINS
         );
     }
 
@@ -2518,7 +2919,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
                    p->opts.tone_mapping_param, p->opts.tone_mapping_desat,
                    detect_peak, p->opts.gamut_warning, p->use_linear && !osd);
 
-    if (p->use_lut_3d) {
+    if (use_lut_3d) {
         gl_sc_uniform_texture(p->sc, "lut_3d", p->lut_3d_texture);
         GLSL(vec3 cpos;)
         for (int i = 0; i < 3; i++)
@@ -2532,6 +2933,58 @@ void gl_video_set_fb_depth(struct gl_video *p, int fb_depth)
     p->fb_depth = fb_depth;
 }
 
+// The fruit dither matrix takes a while to generate for bigger sizes, so it's
+// stored in --gpu-shader-cache-dir if that is set. Bump the version in the
+// file name if the generated matrix changes.
+static char *dither_cache_file(struct gl_video *p, void *ta_ctx, int sizeb,
+                               char **out_dir)
+{
+    const char *dir = p->opts.shader_cache_dir;
+    if (!dir || !dir[0])
+        return NULL;
+    *out_dir = mp_get_user_path(ta_ctx, p->global, dir);
+    return mp_path_join(ta_ctx, *out_dir,
+                        mp_tprintf(40, "dither-fruit-v1-%d.bin", sizeb));
+}
+
+static void make_fruit_dither_matrix(struct gl_video *p, float *out, int sizeb)
+{
+    int size = 1 << sizeb;
+    size_t bytes = size * size * sizeof(float);
+    void *tmp = talloc_new(NULL);
+
+    char *dir = NULL;
+    char *file = dither_cache_file(p, tmp, sizeb, &dir);
+    if (file && stat(file, &(struct stat){0}) == 0) {
+        bstr data = stream_read_file(file, tmp, p->global, bytes + 1);
+        if (data.len == bytes) {
+            MP_VERBOSE(p, "Loaded dither matrix from '%s'.\n", file);
+            memcpy(out, data.start, bytes);
+            goto done;
+        }
+        MP_WARN(p, "Dither matrix cache file '%s' invalid.\n", file);
+    }
+
+    mp_make_fruit_dither_matrix(out, sizeb);
+
+    if (file) {
+        mp_mkdirp(dir);
+        // Other processes may read the cache at any time.
+        char *tmp_path = talloc_asprintf(tmp, "%s.%d.tmp", file, mp_getpid());
+        FILE *f = fopen(tmp_path, "wb");
+        bool ok = f && fwrite(out, bytes, 1, f) == 1;
+        if (f)
+            ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp_path, file) != 0) {
+            MP_WARN(p, "Failed to write dither matrix cache '%s'.\n", file);
+            unlink(tmp_path);
+        }
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static void pass_dither(struct gl_video *p)
 {
     // Assume 8 bits per component if unknown.
@@ -2557,7 +3010,7 @@ static void pass_dither(struct gl_video *p)
             if (p->last_dither_matrix_size != size) {
                 p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
                                                        float, size * size);
-                mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
+                make_fruit_dither_matrix(p, p->last_dither_matrix, sizeb);
                 p->last_dither_matrix_size = size;
             }
 
@@ -2648,10 +3101,9 @@ static void pass_draw_osd(struct gl_video *p, int draw_flags, double pts,
     mpgl_osd_generate(p->osd, rect, pts, p->image_params.stereo3d, draw_flags);
 
     timer_pool_start(p->osd_timer);
-    for (int n = 0; n < MAX_OSD_PARTS; n++) {
-        // (This returns false if this part is empty with nothing to draw.)
-        if (!mpgl_osd_draw_prepare(p->osd, n, p->sc))
-            continue;
+    // All OSD parts are drawn in one pass.
+    // (This returns false if the OSD is empty with nothing to draw.)
+    if (mpgl_osd_draw_prepare(p->osd, p->sc)) {
         // When subtitles need to be color managed, assume they're in sRGB
         // (for lack of anything saner to do)
         if (cms) {
@@ -2663,7 +3115,7 @@ static void pass_draw_osd(struct gl_video *p, int draw_flags, double pts,
 
             pass_colormanage(p, csp_srgb, true);
         }
-        mpgl_osd_draw_finish(p->osd, n, p->sc, fbo);
+        mpgl_osd_draw_finish(p->osd, p->sc, fbo);
     }
 
     timer_pool_stop(p->osd_timer);
@@ -2724,7 +3176,7 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi,
     p->texture_offset = identity_trans;
     p->components = 0;
     p->num_saved_imgs = 0;
-    p->idx_hook_textures = 0;
+    hook_tex_reset(p);
     p->use_linear = false;
 
     // try uploading the frame
@@ -2814,10 +3266,20 @@ static void pass_draw_to_screen(struct gl_video *p, struct ra_fbo fbo)
 
     pass_colormanage(p, p->image_params.color, false);
 
+    // If the main scaler is a compute shader, and the output can be written
+    // by it, finish the rest of the frame (colormanagement, dithering etc.) in
+    // the same dispatch, instead of completing the scaler pass into a full
+    // size intermediate texture first.
+    bool fused = p->pass_compute.active && !p->pass_compute.directly_writes &&
+                 fbo.tex->params.storage_dst && !fbo.flip &&
+                 p->dst_rect.x0 >= 0 && p->dst_rect.y0 >= 0 &&
+                 p->dst_rect.x1 <= fbo.tex->params.w &&
+                 p->dst_rect.y1 <= fbo.tex->params.h;
+
     // Since finish_pass_fbo doesn't work with compute shaders, and neither
     // does the checkerboard/dither code, we may need an indirection via
     // p->screen_tex here.
-    if (p->pass_compute.active) {
+    if (p->pass_compute.active && !fused) {
         int o_w = p->dst_rect.x1 - p->dst_rect.x0,
             o_h = p->dst_rect.y1 - p->dst_rect.y0;
         finish_pass_tex(p, &p->screen_tex, o_w, o_h);
@@ -2847,7 +3309,12 @@ static void pass_draw_to_screen(struct gl_video *p, struct ra_fbo fbo)
 
     pass_dither(p);
     pass_describe(p, "output to screen");
-    finish_pass_fbo(p, fbo, false, &p->dst_rect);
+    if (p->pass_compute.active) {
+        // Can still be active only if fused (hooks finish the pass otherwise).
+        finish_pass_compute_fbo(p, fbo, &p->dst_rect);
+    } else {
+        finish_pass_fbo(p, fbo, false, &p->dst_rect);
+    }
 }
 
 // flags: bit set of RENDER_FRAME_* flags
@@ -3049,11 +3516,100 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     p->frames_drawn += 1;
 }
 
+// Render the video frame (without OSD).
+static void render_video(struct gl_video *p, struct vo_frame *frame,
+                         struct ra_fbo fbo, int flags)
+{
+    bool interpolate = p->opts.interpolation && frame->display_synced &&
+                       !p->dumb_mode && (p->frames_drawn || !frame->still);
+    if (interpolate) {
+        double ratio = frame->ideal_frame_duration / frame->vsync_interval;
+        if (fabs(ratio - 1.0) < p->opts.interpolation_threshold)
+            interpolate = false;
+    }
+
+    if (interpolate) {
+        gl_video_interpolate_frame(p, frame, fbo, flags);
+    } else {
+        bool is_new = frame->frame_id != p->image.id;
+
+        // Redrawing a frame might update subtitles.
+        if (frame->still && p->opts.blend_subs)
+            is_new = true;
+
+        if (is_new || !p->output_tex_valid) {
+            p->output_tex_valid = false;
+
+            pass_info_reset(p, !is_new);
+            if (!pass_render_frame(p, frame->current, frame->frame_id, flags))
+                return;
+
+            // For the non-interpolation case, we draw to a single "cache"
+            // texture to speed up subsequent re-draws (if any exist). This
+            // includes redraws of still frames (e.g. OSD changes while
+            // paused), which then only need to blit the frame and draw OSD.
+            struct ra_fbo dest_fbo = fbo;
+            bool redraws = (frame->num_vsyncs > 1 && frame->display_synced) ||
+                           (frame->still && !p->opts.blend_subs);
+            bool can_blit = (p->ra->caps & RA_CAP_BLIT) &&
+                            fbo.tex->params.blit_dst;
+            // (Otherwise, it's copied with a trivial shader pass.)
+            if (redraws && !p->dumb_mode &&
+                (can_blit || fbo.tex->params.render_dst))
+            {
+                // Attempt to use the same format as the destination FBO
+                // if possible. Some RAs use a wrapped dummy format here,
+                // so fall back to the fbo_format in that case.
+                const struct ra_format *fmt = fbo.tex->params.format;
+                if (fmt->dummy_format)
+                    fmt = p->fbo_format;
+                bool r = ra_tex_resize(p->ra, p->log, &p->output_tex,
+                                       fbo.tex->params.w, fbo.tex->params.h,
+                                       fmt);
+                if (r) {
+                    dest_fbo = (struct ra_fbo) { p->output_tex };
+                    p->output_tex_valid = true;
+                }
+            }
+            pass_draw_to_screen(p, dest_fbo);
+        }
+
+        // "output tex valid" and "output tex needed" are equivalent
+        if (p->output_tex_valid) {
+            pass_info_reset(p, true);
+            pass_describe(p, "redraw cached frame");
+            if ((p->ra->caps & RA_CAP_BLIT) && fbo.tex->params.blit_dst) {
+                struct mp_rect src = p->dst_rect;
+                struct mp_rect dst = src;
+                if (fbo.flip) {
+                    dst.y0 = fbo.tex->params.h - src.y0;
+                    dst.y1 = fbo.tex->params.h - src.y1;
+                }
+                timer_pool_start(p->blit_timer);
+                p->ra->fns->blit(p->ra, fbo.tex, p->output_tex, &dst, &src);
+                timer_pool_stop(p->blit_timer);
+                pass_record(p, timer_pool_measure(p->blit_timer));
+            } else {
+                struct image img = image_wrap(p->output_tex, PLANE_RGB, 4);
+                img.w = mp_rect_w(p->dst_rect);
+                img.h = mp_rect_h(p->dst_rect);
+                img.transform.t[0] = p->dst_rect.x0;
+                img.transform.t[1] = p->dst_rect.y0;
+                copy_image(p, &(int){0}, img);
+                finish_pass_fbo(p, fbo, false, &p->dst_rect);
+            }
+        }
+    }
+}
+
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                            struct ra_fbo fbo, int flags)
 {
     gl_video_update_options(p);
 
+    int64_t trace = mp_trace_begin();
+    p->trace_frame_start = mp_time_us();
+
     struct mp_rect target_rc = {0, 0, fbo.tex->params.w, fbo.tex->params.h};
 
     p->broken_frame = false;
@@ -3084,74 +3640,27 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
     }
 
     if (has_frame) {
-        bool interpolate = p->opts.interpolation && frame->display_synced &&
-                           (p->frames_drawn || !frame->still);
-        if (interpolate) {
-            double ratio = frame->ideal_frame_duration / frame->vsync_interval;
-            if (fabs(ratio - 1.0) < p->opts.interpolation_threshold)
-                interpolate = false;
+        // With --gpu-shader-async, new shaders are created in the background.
+        // If any are missing, the frame is rendered with the dumb mode path
+        // instead (its few shaders are created synchronously).
+        bool async = p->opts.shader_async && !p->dumb_mode && !p->in_warmup;
+        bool fallback = async && gl_sc_pending_compiles(p->sc) > 0;
+        if (!fallback) {
+            gl_sc_set_async(p->sc, async);
+            render_video(p, frame, fbo, flags);
+            gl_sc_set_async(p->sc, false);
+            fallback = async && gl_sc_pending_compiles(p->sc) > 0;
         }
-
-        if (interpolate) {
-            gl_video_interpolate_frame(p, frame, fbo, flags);
-        } else {
-            bool is_new = frame->frame_id != p->image.id;
-
-            // Redrawing a frame might update subtitles.
-            if (frame->still && p->opts.blend_subs)
-                is_new = true;
-
-            if (is_new || !p->output_tex_valid) {
-                p->output_tex_valid = false;
-
-                pass_info_reset(p, !is_new);
-                if (!pass_render_frame(p, frame->current, frame->frame_id, flags))
-                    goto done;
-
-                // For the non-interpolation case, we draw to a single "cache"
-                // texture to speed up subsequent re-draws (if any exist)
-                struct ra_fbo dest_fbo = fbo;
-                if (frame->num_vsyncs > 1 && frame->display_synced &&
-                    !p->dumb_mode && (p->ra->caps & RA_CAP_BLIT) &&
-                    fbo.tex->params.blit_dst)
-                {
-                    // Attempt to use the same format as the destination FBO
-                    // if possible. Some RAs use a wrapped dummy format here,
-                    // so fall back to the fbo_format in that case.
-                    const struct ra_format *fmt = fbo.tex->params.format;
-                    if (fmt->dummy_format)
-                        fmt = p->fbo_format;
-                    bool r = ra_tex_resize(p->ra, p->log, &p->output_tex,
-                                           fbo.tex->params.w, fbo.tex->params.h,
-                                           fmt);
-                    if (r) {
-                        dest_fbo = (struct ra_fbo) { p->output_tex };
-                        p->output_tex_valid = true;
-                    }
-                }
-                pass_draw_to_screen(p, dest_fbo);
-            }
-
-            // "output tex valid" and "output tex needed" are equivalent
-            if (p->output_tex_valid && fbo.tex->params.blit_dst) {
-                pass_info_reset(p, true);
-                pass_describe(p, "redraw cached frame");
-                struct mp_rect src = p->dst_rect;
-                struct mp_rect dst = src;
-                if (fbo.flip) {
-                    dst.y0 = fbo.tex->params.h - src.y0;
-                    dst.y1 = fbo.tex->params.h - src.y1;
-                }
-                timer_pool_start(p->blit_timer);
-                p->ra->fns->blit(p->ra, fbo.tex, p->output_tex, &dst, &src);
-                timer_pool_stop(p->blit_timer);
-                pass_record(p, timer_pool_measure(p->blit_timer));
-            }
+        if (fallback) {
+            MP_DBG(p, "shaders not ready, rendering in dumb mode\n");
+            p->dumb_mode = true;
+            p->output_tex_valid = false;
+            render_video(p, frame, fbo, flags);
+            p->dumb_mode = false;
+            p->output_tex_valid = false;
         }
     }
 
-done:
-
     debug_check_gl(p, "after video rendering");
 
     if (p->osd && (flags & (RENDER_FRAME_SUBS | RENDER_FRAME_OSD))) {
@@ -3181,6 +3690,8 @@ done:
 
     p->frames_rendered++;
     pass_report_performance(p);
+    trace_frame(p, frame);
+    mp_trace_end("gl_video_render_frame", trace);
 }
 
 void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
@@ -3208,7 +3719,7 @@ void gl_video_screenshot(struct gl_video *p, struct vo_frame *frame,
         int w, h;
         mp_image_params_get_dsize(&p->image_params, &w, &h);
         if (w < 1 || h < 1)
-            return;
+            goto done;
 
         if (p->image_params.rotate % 180 == 90)
             MPSWAP(int, w, h);
@@ -3330,6 +3841,8 @@ void gl_video_perfdata(struct gl_video *p, struct voctrl_performance_data *out)
     *out = (struct voctrl_performance_data){0};
     frame_perf_data(p->pass_fresh,  &out->fresh);
     frame_perf_data(p->pass_redraw, &out->redraw);
+    if (p->ra->fns->mem_stats)
+        p->ra->fns->mem_stats(p->ra, &out->mem);
 }
 
 // This assumes nv12, with textures set to GL_NEAREST filtering.
@@ -3714,6 +4227,9 @@ void gl_video_uninit(struct gl_video *p)
     timer_pool_destroy(p->blit_timer);
     timer_pool_destroy(p->osd_timer);
 
+    trace_close(p);
+    uninit_scaler_luts(p);
+
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         talloc_free(p->pass_fresh[i].desc.start);
         talloc_free(p->pass_redraw[i].desc.start);
@@ -3731,6 +4247,38 @@ void gl_video_uninit(struct gl_video *p)
     talloc_free(p);
 }
 
+// Free textures and shaders that are recreated on demand when rendering the
+// next frame. The uploaded video frame and the user textures are kept, so that
+// redrawing doesn't need a new frame.
+void gl_video_trim(struct gl_video *p)
+{
+    for (int n = 0; n < SCALER_COUNT; n++)
+        ra_tex_free(p->ra, &p->scaler[n].sep_fbo);
+
+    for (int n = 0; n < 4; n++) {
+        ra_tex_free(p->ra, &p->merge_tex[n]);
+        ra_tex_free(p->ra, &p->scale_tex[n]);
+        ra_tex_free(p->ra, &p->integer_tex[n]);
+    }
+
+    ra_tex_free(p->ra, &p->indirect_tex);
+    ra_tex_free(p->ra, &p->blend_subs_tex);
+    ra_tex_free(p->ra, &p->screen_tex);
+    ra_tex_free(p->ra, &p->output_tex);
+
+    for (int n = 0; n < SURFACES_MAX; n++)
+        ra_tex_free(p->ra, &p->surfaces[n].tex);
+    gl_video_reset_surfaces(p);
+
+    for (int n = 0; n < p->num_hook_textures; n++)
+        ra_tex_free(p->ra, &p->hook_textures[n].tex);
+
+    reinit_osd(p);
+    gl_sc_trim(p->sc);
+
+    MP_VERBOSE(p, "Released intermediate textures and shaders.\n");
+}
+
 void gl_video_reset(struct gl_video *p)
 {
     gl_video_reset_surfaces(p);
@@ -3867,6 +4415,8 @@ static void reinit_from_options(struct gl_video *p)
     check_gl_features(p);
     uninit_rendering(p);
     gl_sc_set_cache_dir(p->sc, p->opts.shader_cache_dir);
+    gl_sc_set_max_entries(p->sc, p->opts.shader_cache_size);
+    trace_reinit(p);
     p->ra->use_pbo = p->opts.pbo;
     gl_video_setup_hooks(p);
     reinit_osd(p);
@@ -3905,6 +4455,116 @@ void gl_video_configure_queue(struct gl_video *p, struct vo *vo)
     vo_set_queue_params(vo, 0, queue_size);
 }
 
+// If --gpu-shader-warmup is enabled, render a few frames of common formats to
+// an offscreen texture, so that the shaders for the current options are
+// created (and written to the shader disk cache, if enabled) before playback
+// starts. Dummy frames are scaled up and down, and SDR and HDR colorspaces are
+// used. Must be called before the first gl_video_config().
+void gl_video_warmup(struct gl_video *p)
+{
+    gl_video_update_options(p);
+    if (!p->opts.shader_warmup)
+        return;
+
+    static const struct {
+        int imgfmt;
+        bool hdr;
+    } formats[] = {
+        {IMGFMT_420P},
+        {IMGFMT_NV12},
+        {IMGFMT_P010},
+        {IMGFMT_P010, .hdr = true},
+        {IMGFMT_RGB0},
+    };
+    // Source sizes; the target is 1920x1080.
+    static const int sizes[][2] = {{1280, 720}, {3840, 2160}};
+
+    struct ra_tex_params params = {
+        .dimensions = 2,
+        .w = 1920,
+        .h = 1080,
+        .d = 1,
+        .format = ra_find_unorm_format(p->ra, 1, 4),
+        .render_dst = true,
+    };
+    if (!params.format || !params.format->renderable)
+        return;
+    struct ra_tex *target = ra_tex_create(p->ra, &params);
+    if (!target)
+        return;
+
+    int64_t start = mp_time_us();
+    int num_frames = 1;
+    if (p->opts.interpolation)
+        num_frames = MPMIN(10, VO_MAX_REQ_FRAMES);
+    uint64_t frame_id = 1;
+
+    p->in_warmup = true;
+
+    for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+        if (!gl_video_check_format(p, formats[f].imgfmt))
+            continue;
+        for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+            struct mp_image *base =
+                mp_image_alloc(formats[f].imgfmt, sizes[s][0], sizes[s][1]);
+            if (!base)
+                continue;
+            mp_image_clear(base, 0, 0, base->w, base->h);
+            if (formats[f].hdr) {
+                base->params.color = (struct mp_colorspace){
+                    .space = MP_CSP_BT_2020_NC,
+                    .levels = MP_CSP_LEVELS_TV,
+                    .primaries = MP_CSP_PRIM_BT_2020,
+                    .gamma = MP_CSP_TRC_PQ,
+                };
+            }
+            mp_image_params_guess_csp(&base->params);
+
+            gl_video_config(p, &base->params);
+            struct mp_rect src = {0, 0, base->w, base->h};
+            struct mp_rect dst = {0, 0, params.w, params.h};
+            struct mp_osd_res osd = {.w = params.w, .h = params.h,
+                                     .display_par = 1.0};
+            gl_video_resize(p, &src, &dst, &osd);
+
+            // With interpolation, render enough frames to fill the queue, with
+            // a frame rate that does not match the display.
+            struct mp_image *imgs[VO_MAX_REQ_FRAMES * 2] = {0};
+            int num_imgs = num_frames * 2;
+            for (int n = 0; n < num_imgs; n++) {
+                imgs[n] = mp_image_new_ref(base);
+                if (imgs[n])
+                    imgs[n]->pts = n / 24.0;
+            }
+            for (int n = 0; n < num_frames && imgs[n]; n++) {
+                struct vo_frame frame = {
+                    .vsync_interval = 1e6 / 60,
+                    .ideal_frame_duration = 1e6 / 24,
+                    .num_vsyncs = 1,
+                    .display_synced = p->opts.interpolation,
+                    .current = imgs[n],
+                    .frame_id = frame_id++,
+                };
+                for (int i = 0; i < num_frames && imgs[n + i]; i++)
+                    frame.frames[frame.num_frames++] = imgs[n + i];
+                gl_video_render_frame(p, &frame, (struct ra_fbo){target}, 0);
+            }
+            for (int n = 0; n < num_imgs; n++)
+                talloc_free(imgs[n]);
+            talloc_free(base);
+        }
+    }
+
+    p->in_warmup = false;
+
+    gl_video_config(p, &(struct mp_image_params){0});
+    gl_video_reset_surfaces(p);
+    ra_tex_free(p->ra, &target);
+
+    MP_VERBOSE(p, "Shader warmup took %"PRId64" ms.\n",
+               (mp_time_us() - start) / 1000);
+}
+
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
                                struct bstr name, struct bstr param)
 {
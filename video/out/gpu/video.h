@@ -97,6 +97,8 @@ enum tone_mapping {
 
 // How many frames to average over for HDR peak detection
 #define PEAK_DETECT_FRAMES 63
+// Number of (log2 scale) bins of the HDR peak detection scene histogram
+#define PEAK_DETECT_HIST_BINS 16
 
 struct gl_video_opts {
     int dumb_mode;
@@ -140,6 +142,10 @@ struct gl_video_opts {
     struct mp_icc_opts *icc_opts;
     int early_flush;
     char *shader_cache_dir;
+    int shader_cache_size;
+    int shader_async;
+    int shader_warmup;
+    char *trace_file;
     char *hwdec_interop;
 };
 
@@ -181,10 +187,12 @@ float gl_video_scale_ambient_lux(float lmin, float lmax,
 void gl_video_set_ambient_lux(struct gl_video *p, int lux);
 void gl_video_set_icc_profile(struct gl_video *p, bstr icc_data);
 bool gl_video_icc_auto_enabled(struct gl_video *p);
+void gl_video_set_lut3d_cb(struct gl_video *p, void (*cb)(void *ctx), void *ctx);
 bool gl_video_gamma_auto_enabled(struct gl_video *p);
 struct mp_colorspace gl_video_get_output_colorspace(struct gl_video *p);
 
 void gl_video_reset(struct gl_video *p);
+void gl_video_trim(struct gl_video *p);
 bool gl_video_showing_interpolated_frame(struct gl_video *p);
 
 struct mp_hwdec_devices;
@@ -194,6 +202,8 @@ void gl_video_load_hwdecs_all(struct gl_video *p, struct mp_hwdec_devices *devs)
 
 struct vo;
 void gl_video_configure_queue(struct gl_video *p, struct vo *vo);
+void gl_video_warmup(struct gl_video *p);
+void gl_video_trace_present(struct gl_video *p, int64_t start, int64_t end);
 
 struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w, int h,
                                     int stride_align);
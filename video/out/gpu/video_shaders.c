@@ -571,26 +571,46 @@ static const float sdr_avg = 0.25;
 // a sign of a scene change.
 static const int scene_threshold = 0.2 * MP_REF_WHITE;
 
+// The threshold for the difference between the histograms of two frames to
+// be considered a scene change. The difference is in the range [0,2], where 1
+// means that half of the work groups moved to a different brightness octave.
+static const float scene_hist_threshold = 1.0;
+
 static void hdr_update_peak(struct gl_shader_cache *sc)
 {
-    // For performance, we want to do as few atomic operations on global
-    // memory as possible, so use an atomic in shmem for the work group.
-    GLSLH(shared uint wg_sum;);
-    GLSL(wg_sum = 0;)
-
-    // Have each thread update the work group sum with the local value
+    // For performance, we want to do as few atomic operations as possible,
+    // especially on global memory. So reduce the work group to its sum with a
+    // tree reduction in shmem (log2(threads) steps, no atomics), and then do
+    // the global atomics once per work group.
+    GLSLH(shared uint wg_sig[gl_WorkGroupSize.x * gl_WorkGroupSize.y];)
+    GLSL(uint wg_idx = gl_LocalInvocationIndex;)
+    GLSL(uint wg_size = gl_WorkGroupSize.x * gl_WorkGroupSize.y;)
+    GLSLF("wg_sig[wg_idx] = uint(sig * %f);\n", MP_REF_WHITE);
+    GLSL(memoryBarrierShared();)
     GLSL(barrier();)
-    GLSLF("atomicAdd(wg_sum, uint(sig * %f));\n", MP_REF_WHITE);
+
+    // Each step sums up the upper half into the lower half. This also works
+    // for work group sizes which are not a power of 2.
+    GLSL(for (uint n = wg_size; n > 1u;) {)
+    GLSL(    uint half_n = (n + 1u) / 2u;)
+    GLSL(    if (wg_idx < n - half_n))
+    GLSL(        wg_sig[wg_idx] += wg_sig[wg_idx + half_n];)
+    GLSL(    memoryBarrierShared();)
+    GLSL(    barrier();)
+    GLSL(    n = half_n;)
+    GLSL(})
 
     // Have one thread per work group update the global atomics. We use the
     // work group average even for the global sum, to make the values slightly
-    // more stable and smooth out tiny super-highlights.
-    GLSL(memoryBarrierShared();)
-    GLSL(barrier();)
-    GLSL(if (gl_LocalInvocationIndex == 0) {)
-    GLSL(    uint wg_avg = wg_sum / (gl_WorkGroupSize.x * gl_WorkGroupSize.y);)
+    // more stable and smooth out tiny super-highlights. The histogram of the
+    // work group averages is used for scene change detection.
+    GLSL(if (wg_idx == 0u) {)
+    GLSL(    uint wg_avg = wg_sig[0] / wg_size;)
     GLSL(    atomicMax(frame_max[frame_idx], wg_avg);)
     GLSL(    atomicAdd(frame_avg[frame_idx], wg_avg);)
+    GLSLF("  uint bin = uint(min(findMSB(max(wg_avg, 1u)), %d));\n",
+          PEAK_DETECT_HIST_BINS - 1);
+    GLSL(    atomicAdd(frame_hist[bin], 1u);)
     GLSL(})
 
     const float refi = 1.0 / MP_REF_WHITE;
@@ -616,9 +636,27 @@ static void hdr_update_peak(struct gl_shader_cache *sc)
     GLSL(    uint cur_max = frame_max[frame_idx];)
     GLSL(    uint cur_avg = frame_avg[frame_idx];)
 
-    // Scene change detection
+    // Compare the histogram against the previous frame's. Both are normalized,
+    // so that a changed number of work groups (resizing) doesn't matter.
+    GLSL(    uint prev_num = 0u;)
+    GLSLF("  for (uint i = 0u; i < %du; i++)\n", PEAK_DETECT_HIST_BINS);
+    GLSL(        prev_num += prev_hist[i];)
+    GLSL(    float hist_diff = 0.0;)
+    GLSLF("  for (uint i = 0u; i < %du; i++) {\n", PEAK_DETECT_HIST_BINS);
+    GLSL(        float cur_f = float(frame_hist[i]) / float(num_wg);)
+    GLSL(        float prev_f = float(prev_hist[i]) / float(max(prev_num, 1u));)
+    GLSL(        hist_diff += abs(cur_f - prev_f);)
+    GLSL(        prev_hist[i] = frame_hist[i];)
+    GLSL(        frame_hist[i] = 0u;)
+    GLSL(    })
+
+    // Scene change detection. The average catches global brightness changes,
+    // the histogram catches cuts between scenes with similar average, but a
+    // different distribution of the brightness.
     GLSL(    int diff = int(frame_num * cur_avg) - int(total_avg);)
-    GLSLF("  if (abs(diff) > frame_num * %d) {\n", scene_threshold);
+    GLSLF("  if (abs(diff) > frame_num * %d ||\n", scene_threshold);
+    GLSLF("      (frame_num > 0u && prev_num > 0u && hist_diff > %f)) {\n",
+          scene_hist_threshold);
     GLSL(        frame_num = 0;)
     GLSL(        total_max = total_avg = 0;)
     GLSLF("      for (uint i = 0; i < %d; i++)\n", PEAK_DETECT_FRAMES+1);
@@ -762,9 +800,9 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Some operations need access to the video's luma coefficients, so make
     // them available
     float rgb2xyz[3][3];
-    mp_get_rgb2xyz_matrix(mp_get_csp_primaries(src.primaries), rgb2xyz);
+    mp_get_csp_rgb2xyz_matrix(src.primaries, rgb2xyz);
     gl_sc_uniform_vec3(sc, "src_luma", rgb2xyz[1]);
-    mp_get_rgb2xyz_matrix(mp_get_csp_primaries(dst.primaries), rgb2xyz);
+    mp_get_csp_rgb2xyz_matrix(dst.primaries, rgb2xyz);
     gl_sc_uniform_vec3(sc, "dst_luma", rgb2xyz[1]);
 
     bool need_ootf = src.light != dst.light;
@@ -793,10 +831,9 @@ void pass_color_map(struct gl_shader_cache *sc,
 
     // Adapt to the right colorspace if necessary
     if (src.primaries != dst.primaries) {
-        struct mp_csp_primaries csp_src = mp_get_csp_primaries(src.primaries),
-                                csp_dst = mp_get_csp_primaries(dst.primaries);
-        float m[3][3] = {{0}};
-        mp_get_cms_matrix(csp_src, csp_dst, MP_INTENT_RELATIVE_COLORIMETRIC, m);
+        float m[3][3];
+        mp_get_csp_cms_matrix(src.primaries, dst.primaries,
+                              MP_INTENT_RELATIVE_COLORIMETRIC, m);
         gl_sc_uniform_mat3(sc, "cms_matrix", true, &m[0][0]);
         GLSL(color.rgb = cms_matrix * color.rgb;)
     }
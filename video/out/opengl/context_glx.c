@@ -37,6 +37,7 @@
 #define GLX_CONTEXT_ES2_PROFILE_BIT_EXT         0x00000004
 #endif
 
+#include "osdep/timer.h"
 #include "video/out/x11_common.h"
 #include "context.h"
 #include "utils.h"
@@ -46,6 +47,14 @@ struct priv {
     XVisualInfo *vinfo;
     GLXContext context;
     GLXFBConfig fbc;
+
+    // GLX_OML_sync_control
+    Bool (*XGetSyncValues)(Display*, GLXDrawable, int64_t*, int64_t*, int64_t*);
+    int64_t user_sbc;           // number of glXSwapBuffers() calls
+    int64_t last_ust, last_msc, last_sbc;
+    int64_t vsync_duration;     // us, 0 if unknown
+    int64_t skipped_vsyncs;
+    int64_t last_queue_display_time;
 };
 
 static void glx_uninit(struct ra_ctx *ctx)
@@ -208,9 +217,58 @@ static void set_glx_attrib(int *attribs, int name, int value)
     }
 }
 
+static void update_sync_values(struct ra_ctx *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    int64_t ust, msc, sbc;
+    if (!p->XGetSyncValues(ctx->vo->x11->display, ctx->vo->x11->window,
+                           &ust, &msc, &sbc))
+        return;
+
+    p->skipped_vsyncs = -1;
+    p->last_queue_display_time = -1;
+
+    // Only one swap completed since the last call: the MSC difference is the
+    // number of vsyncs the previous frame was displayed for.
+    if (p->last_sbc && sbc == p->last_sbc + 1 && msc > p->last_msc) {
+        p->skipped_vsyncs = msc - p->last_msc - 1;
+        if (p->skipped_vsyncs == 0)
+            p->vsync_duration = ust - p->last_ust;
+    }
+
+    // UST is in microseconds and uses CLOCK_MONOTONIC on all known drivers,
+    // like mp_time_us() (minus the offset). Frames that were queued but not
+    // displayed yet are assumed to show up on the following vsyncs.
+    if (ust > 0 && p->vsync_duration > 0 && p->user_sbc >= sbc) {
+        int64_t ust_now = mp_raw_time_us();
+        int64_t present = mp_time_us() - (ust_now - ust);
+        p->last_queue_display_time =
+            present + (p->user_sbc - sbc) * p->vsync_duration;
+    }
+
+    p->last_ust = ust;
+    p->last_msc = msc;
+    p->last_sbc = sbc;
+}
+
 static void glx_swap_buffers(struct ra_ctx *ctx)
 {
+    struct priv *p = ctx->priv;
+
     glXSwapBuffers(ctx->vo->x11->display, ctx->vo->x11->window);
+
+    if (p->XGetSyncValues) {
+        p->user_sbc += 1;
+        update_sync_values(ctx);
+    }
+}
+
+static void glx_get_vsync(struct ra_ctx *ctx, struct vo_vsync_info *info)
+{
+    struct priv *p = ctx->priv;
+    info->skipped_vsyncs = p->skipped_vsyncs;
+    info->last_queue_display_time = p->last_queue_display_time;
 }
 
 static bool glx_init(struct ra_ctx *ctx)
@@ -294,8 +352,18 @@ static bool glx_init(struct ra_ctx *ctx)
     if (!success)
         goto uninit;
 
+    const char *glxstr =
+        glXQueryExtensionsString(vo->x11->display, vo->x11->screen);
+    if (glxstr && gl_check_extension(glxstr, "GLX_OML_sync_control")) {
+        p->XGetSyncValues = (void *)glXGetProcAddressARB(
+            (const GLubyte *)"glXGetSyncValuesOML");
+    }
+    if (p->XGetSyncValues)
+        MP_VERBOSE(ctx, "Using GLX_OML_sync_control for vsync timing.\n");
+
     struct ra_gl_ctx_params params = {
         .swap_buffers = glx_swap_buffers,
+        .get_vsync    = p->XGetSyncValues ? glx_get_vsync : NULL,
     };
 
     if (!ra_gl_ctx_init(ctx, gl, params))
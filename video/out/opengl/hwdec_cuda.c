@@ -56,6 +56,7 @@ struct priv_owner {
 
     bool is_gl;
     bool is_vk;
+    bool async_copy;
 };
 
 struct ext_buf {
@@ -75,6 +76,9 @@ struct priv {
 
     CUcontext display_ctx;
 
+    // Used for the copies if async_copy is enabled, otherwise 0.
+    CUstream stream;
+
     struct ra_buf_params buf_params[4];
     struct ra_buf_pool buf_pool[4];
 };
@@ -258,6 +262,11 @@ static int cuda_init(struct ra_hwdec *hw)
     if (ret < 0)
         goto error;
 
+    int async_copy = 1;
+    mp_read_option_raw(hw->global, "cuda-async-copy", &m_option_type_flag,
+                       &async_copy);
+    p->async_copy = async_copy;
+
     p->hwctx = (struct mp_hwdec_ctx) {
         .driver_name = hw->driver->name,
         .av_device_ref = hw_device_ctx,
@@ -419,6 +428,14 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
     if (ret < 0)
         return ret;
 
+    if (p_owner->async_copy) {
+        // Default flags, so that it's ordered with the legacy default stream
+        // the decoder uses.
+        ret = CHECK_CU(cu->cuStreamCreate(&p->stream, CU_STREAM_DEFAULT));
+        if (ret < 0)
+            goto error;
+    }
+
     for (int n = 0; n < desc.num_planes; n++) {
         const struct ra_format *format = desc.planes[n];
 
@@ -449,6 +466,10 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
             if (ret < 0)
                 goto error;
 
+            // With async copies, the resources are mapped on every copy.
+            if (p->stream)
+                continue;
+
             ret = CHECK_CU(cu->cuGraphicsMapResources(1, &p->cu_res[n], 0));
             if (ret < 0)
                 goto error;
@@ -500,11 +521,26 @@ static void mapper_uninit(struct ra_hwdec_mapper *mapper)
         cuda_buf_pool_uninit(mapper, n);
 #endif
     }
+    if (p->stream)
+        CHECK_CU(cu->cuStreamDestroy(p->stream));
+    p->stream = 0;
     CHECK_CU(cu->cuCtxPopCurrent(&dummy));
 }
 
 static void mapper_unmap(struct ra_hwdec_mapper *mapper)
 {
+    struct priv *p = mapper->priv;
+    struct priv_owner *p_owner = mapper->owner->priv;
+    CudaFunctions *cu = p_owner->cu;
+    CUcontext dummy;
+
+    // The source surface is released after this, and might be reused by the
+    // decoder. Normally the copy has long finished at this point.
+    if (p->stream) {
+        CHECK_CU(cu->cuCtxPushCurrent(p->display_ctx));
+        CHECK_CU(cu->cuStreamSynchronize(p->stream));
+        CHECK_CU(cu->cuCtxPopCurrent(&dummy));
+    }
 }
 
 static int mapper_map(struct ra_hwdec_mapper *mapper)
@@ -516,14 +552,31 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
     int ret = 0, eret = 0;
     bool is_gl = p_owner->is_gl;
     bool is_vk = p_owner->is_vk;
+    int num_planes = p->layout.num_planes;
+    struct ra_buf *bufs[4] = {0};
+    bool resources_mapped = false;
 
     ret = CHECK_CU(cu->cuCtxPushCurrent(p->display_ctx));
     if (ret < 0)
         return ret;
 
-    for (int n = 0; n < p->layout.num_planes; n++) {
-        struct ra_buf *buf = NULL;
+    if (is_gl && p->stream) {
+        ret = CHECK_CU(cu->cuGraphicsMapResources(num_planes, p->cu_res,
+                                                  p->stream));
+        if (ret < 0)
+            goto error;
+        resources_mapped = true;
 
+        for (int n = 0; n < num_planes; n++) {
+            ret = CHECK_CU(cu->cuGraphicsSubResourceGetMappedArray(&p->cu_array[n],
+                                                                   p->cu_res[n],
+                                                                   0, 0));
+            if (ret < 0)
+                goto error;
+        }
+    }
+
+    for (int n = 0; n < num_planes; n++) {
         CUDA_MEMCPY2D cpy = {
             .srcMemoryType = CU_MEMORYTYPE_DEVICE,
             .srcDevice     = (CUdeviceptr)mapper->src->planes[n],
@@ -539,8 +592,8 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
             cpy.dstArray = p->cu_array[n];
         } else if (is_vk) {
 #if HAVE_VULKAN
-            buf = cuda_buf_pool_get(mapper, n);
-            struct ext_buf *ebuf = ra_vk_buf_get_user_data(buf);
+            bufs[n] = cuda_buf_pool_get(mapper, n);
+            struct ext_buf *ebuf = ra_vk_buf_get_user_data(bufs[n]);
 
             cpy.dstMemoryType = CU_MEMORYTYPE_DEVICE;
             cpy.dstDevice = ebuf->buf;
@@ -549,21 +602,50 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
 #endif
         }
 
-        ret = CHECK_CU(cu->cuMemcpy2D(&cpy));
+        if (p->stream) {
+            ret = CHECK_CU(cu->cuMemcpy2DAsync(&cpy, p->stream));
+        } else {
+            ret = CHECK_CU(cu->cuMemcpy2D(&cpy));
+        }
+        if (ret < 0)
+            goto error;
+    }
+
+    if (resources_mapped) {
+        // GL commands issued after this wait for the copies to finish, without
+        // blocking the CPU.
+        resources_mapped = false;
+        ret = CHECK_CU(cu->cuGraphicsUnmapResources(num_planes, p->cu_res,
+                                                    p->stream));
         if (ret < 0)
             goto error;
+    }
+
+    if (is_vk) {
+        // There is no way to make ra_vk wait for CUDA work, so wait for the
+        // copies of all planes at once.
+        if (p->stream) {
+            ret = CHECK_CU(cu->cuStreamSynchronize(p->stream));
+            if (ret < 0)
+                goto error;
+        }
 
-        if (is_vk) {
+        for (int n = 0; n < num_planes; n++) {
             struct ra_tex_upload_params params = {
                 .tex = mapper->tex[n],
                 .invalidate = true,
-                .buf = buf,
+                .buf = bufs[n],
             };
             mapper->ra->fns->tex_upload(mapper->ra, &params);
         }
     }
 
  error:
+   if (resources_mapped) {
+       CHECK_CU(cu->cuGraphicsUnmapResources(num_planes, p->cu_res, p->stream));
+       resources_mapped = false;
+   }
+
    eret = CHECK_CU(cu->cuCtxPopCurrent(&dummy));
    if (eret < 0)
        return eret;
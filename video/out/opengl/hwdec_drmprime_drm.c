@@ -23,8 +23,17 @@
 #include <math.h>
 #include <stdbool.h>
 
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_drm.h>
 
+#include "config.h"
+
+#if HAVE_VAAPI_DRM
+#include <va/va_drm.h>
+#include "video/vaapi.h"
+#endif
+
 #include "common.h"
 #include "video/hwdec.h"
 #include "common/msg.h"
@@ -53,6 +62,10 @@ struct priv {
     struct mp_rect src, dst;
 
     int display_w, display_h;
+
+#if HAVE_VAAPI_DRM
+    struct mp_vaapi_ctx *vaapi;
+#endif
 };
 
 static void set_current_frame(struct ra_hwdec *hw, struct drm_frame *frame)
@@ -135,6 +148,34 @@ static void disable_video_plane(struct ra_hwdec *hw)
     }
 }
 
+// Map a VAAPI surface to DRM PRIME, so that it can be put on the video plane
+// directly. The result references the source surface.
+static struct mp_image *map_vaapi_frame(struct ra_hwdec *hw,
+                                        struct mp_image *src)
+{
+    struct mp_image *res = NULL;
+    AVFrame *src_frame = mp_image_to_av_frame(src);
+    AVFrame *dst_frame = av_frame_alloc();
+    if (!src_frame || !dst_frame)
+        goto done;
+
+    dst_frame->format = AV_PIX_FMT_DRM_PRIME;
+    int err = av_hwframe_map(dst_frame, src_frame, AV_HWFRAME_MAP_READ);
+    if (err < 0) {
+        MP_ERR(hw, "Failed to map VAAPI surface to DRM PRIME (%d).\n", err);
+        goto done;
+    }
+
+    res = mp_image_from_av_frame(dst_frame);
+    if (res && res->imgfmt != IMGFMT_DRMPRIME)
+        TA_FREEP(&res);
+
+done:
+    av_frame_free(&src_frame);
+    av_frame_free(&dst_frame);
+    return res;
+}
+
 static int overlay_frame(struct ra_hwdec *hw, struct mp_image *hw_image,
                          struct mp_rect *src, struct mp_rect *dst, bool newframe)
 {
@@ -142,6 +183,7 @@ static int overlay_frame(struct ra_hwdec *hw, struct mp_image *hw_image,
     AVDRMFrameDescriptor *desc = NULL;
     drmModeAtomicReq *request = NULL;
     struct drm_frame next_frame = {0};
+    struct mp_image *mapped = NULL;
     int ret;
 
     // grab atomic request from native resources
@@ -172,6 +214,13 @@ static int overlay_frame(struct ra_hwdec *hw, struct mp_image *hw_image,
         }
         p->src = *src;
 
+        if (hw_image->imgfmt == IMGFMT_VAAPI) {
+            mapped = map_vaapi_frame(hw, hw_image);
+            if (!mapped)
+                return -1;
+            hw_image = mapped;
+        }
+
         next_frame.image = hw_image;
         desc = (AVDRMFrameDescriptor *)hw_image->planes[0];
 
@@ -217,10 +266,12 @@ static int overlay_frame(struct ra_hwdec *hw, struct mp_image *hw_image,
     }
 
     set_current_frame(hw, &next_frame);
+    talloc_free(mapped);
     return 0;
 
  fail:
     drm_prime_destroy_framebuffer(p->log, p->ctx->fd, &next_frame.fb);
+    talloc_free(mapped);
     return ret;
 }
 
@@ -231,6 +282,13 @@ static void uninit(struct ra_hwdec *hw)
     disable_video_plane(hw);
     set_current_frame(hw, NULL);
 
+#if HAVE_VAAPI_DRM
+    if (p->vaapi)
+        hwdec_devices_remove(hw->devs, &p->vaapi->hwctx);
+    va_destroy(p->vaapi);
+    p->vaapi = NULL;
+#endif
+
     if (p->ctx) {
         drm_atomic_destroy_context(p->ctx);
         p->ctx = NULL;
@@ -284,6 +342,29 @@ static int init(struct ra_hwdec *hw)
     }
 
     disable_video_plane(hw);
+
+#if HAVE_VAAPI_DRM
+    // Provide a VAAPI device for --hwdec=vaapi, whose surfaces can be scanned
+    // out directly. Only done if this interop was explicitly requested, since
+    // normally vaapi-egl should handle VAAPI (it supports GL filtering).
+    if (!hw->probing && drm_params->render_fd >= 0) {
+        VADisplay *display = vaGetDisplayDRM(drm_params->render_fd);
+        if (display) {
+            p->vaapi = va_initialize(display, p->log, true);
+            if (!p->vaapi)
+                vaTerminate(display);
+        }
+        if (p->vaapi && p->vaapi->av_device_ref) {
+            p->vaapi->hwctx.driver_name = hw->driver->name;
+            hwdec_devices_add(hw->devs, &p->vaapi->hwctx);
+            MP_VERBOSE(hw, "VAAPI frames will be put on the video plane.\n");
+        } else {
+            va_destroy(p->vaapi);
+            p->vaapi = NULL;
+        }
+    }
+#endif
+
     return 0;
 
 err:
@@ -294,7 +375,13 @@ err:
 const struct ra_hwdec_driver ra_hwdec_drmprime_drm = {
     .name = "drmprime-drm",
     .priv_size = sizeof(struct priv),
-    .imgfmts = {IMGFMT_DRMPRIME, 0},
+    .imgfmts = {
+        IMGFMT_DRMPRIME,
+#if HAVE_VAAPI_DRM
+        IMGFMT_VAAPI,
+#endif
+        0
+    },
     .init = init,
     .overlay_frame = overlay_frame,
     .uninit = uninit,
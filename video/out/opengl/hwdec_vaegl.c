@@ -122,6 +122,23 @@ struct priv_owner {
     bool probing_formats; // temporary during init
 };
 
+#if VA_CHECK_VERSION(1, 1, 0)
+// Textures for a surface exported with vaExportSurfaceHandle(). The EGLImages
+// reference the surface memory itself, so they stay valid as long as the
+// surface exists. Decoders cycle through a small surface pool, which means
+// they can be created once per surface instead of on every map.
+struct surface_cache_entry {
+    VASurfaceID id;
+    uint32_t fourcc;
+    EGLImageKHR images[4];
+    GLuint gl_textures[4];
+    struct ra_tex *tex[4];
+};
+
+// Should be larger than typical decoder surface pools.
+#define SURFACE_CACHE_SIZE 32
+#endif
+
 struct priv {
     int num_planes;
     struct ra_tex *tex[4];
@@ -132,7 +149,11 @@ struct priv {
 #if VA_CHECK_VERSION(1, 1, 0)
     bool esh_not_implemented;
     VADRMPRIMESurfaceDescriptor desc;
-    bool surface_acquired;
+    // Reference to the AVHWFramesContext the cached surfaces belong to. This
+    // keeps the surfaces (and their IDs) alive while they are cached.
+    AVBufferRef *cache_frames;
+    struct surface_cache_entry *cache;
+    int num_cache;
 #endif
 
     EGLImageKHR (EGLAPIENTRY *CreateImageKHR)(EGLDisplay, EGLContext,
@@ -216,14 +237,6 @@ static void mapper_unmap(struct ra_hwdec_mapper *mapper)
         p->images[n] = 0;
     }
 
-#if VA_CHECK_VERSION(1, 1, 0)
-    if (p->surface_acquired) {
-        for (int n = 0; n < p->desc.num_objects; n++)
-            close(p->desc.objects[n].fd);
-        p->surface_acquired = false;
-    }
-#endif
-
     if (p->buffer_acquired) {
         status = vaReleaseBufferHandle(display, p->current_image.buf);
         CHECK_VA_STATUS(mapper, "vaReleaseBufferHandle()");
@@ -236,11 +249,52 @@ static void mapper_unmap(struct ra_hwdec_mapper *mapper)
     }
 }
 
+static void init_texture(GL *gl, GLuint texture)
+{
+    gl->BindTexture(GL_TEXTURE_2D, texture);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+}
+
+#if VA_CHECK_VERSION(1, 1, 0)
+static void cache_entry_destroy(struct ra_hwdec_mapper *mapper,
+                                struct surface_cache_entry *e)
+{
+    struct priv *p = mapper->priv;
+    GL *gl = ra_gl_get(mapper->ra);
+
+    for (int n = 0; n < 4; n++) {
+        ra_tex_free(mapper->ra, &e->tex[n]);
+        if (e->images[n])
+            p->DestroyImageKHR(eglGetCurrentDisplay(), e->images[n]);
+        e->images[n] = 0;
+    }
+    gl->DeleteTextures(4, e->gl_textures);
+}
+
+static void cache_flush(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+
+    for (int n = 0; n < p->num_cache; n++)
+        cache_entry_destroy(mapper, &p->cache[n]);
+    p->num_cache = 0;
+    av_buffer_unref(&p->cache_frames);
+}
+#endif
+
 static void mapper_uninit(struct ra_hwdec_mapper *mapper)
 {
     struct priv *p = mapper->priv;
     GL *gl = ra_gl_get(mapper->ra);
 
+#if VA_CHECK_VERSION(1, 1, 0)
+    cache_flush(mapper);
+#endif
+
     gl->DeleteTextures(4, p->gl_textures);
     for (int n = 0; n < 4; n++) {
         p->gl_textures[n] = 0;
@@ -292,12 +346,7 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
 
     gl->GenTextures(4, p->gl_textures);
     for (int n = 0; n < desc.num_planes; n++) {
-        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        gl->BindTexture(GL_TEXTURE_2D, 0);
+        init_texture(gl, p->gl_textures[n]);
 
         struct ra_tex_params params = {
             .dimensions = 2,
@@ -336,20 +385,37 @@ static int mapper_init(struct ra_hwdec_mapper *mapper)
     attribs[num_attribs] = EGL_NONE;                    \
     } while(0)
 
-static int mapper_map(struct ra_hwdec_mapper *mapper)
+#if VA_CHECK_VERSION(1, 1, 0)
+// Return the cache entry for the mapped surface. If it's not cached yet, export
+// the surface and import it as EGLImages. Returns NULL on failure.
+static struct surface_cache_entry *map_cached_surface(
+                                            struct ra_hwdec_mapper *mapper)
 {
     struct priv_owner *p_owner = mapper->owner->priv;
     struct priv *p = mapper->priv;
     GL *gl = ra_gl_get(mapper->ra);
     VAStatus status;
-    VAImage *va_image = &p->current_image;
-    VADisplay *display = p_owner->display;
+    VASurfaceID id = va_surface_id(mapper->src);
+
+    // Surface IDs are only unique within a frames context.
+    AVBufferRef *frames = mapper->src->hwctx;
+    if (!frames || !p->cache_frames || p->cache_frames->data != frames->data) {
+        cache_flush(mapper);
+        if (frames)
+            p->cache_frames = av_buffer_ref(frames);
+    }
 
-#if VA_CHECK_VERSION(1, 1, 0)
-    if (p->esh_not_implemented)
-        goto esh_failed;
+    for (int n = 0; n < p->num_cache; n++) {
+        if (p->cache[n].id == id)
+            return &p->cache[n];
+    }
+
+    if (p->num_cache >= SURFACE_CACHE_SIZE) {
+        cache_entry_destroy(mapper, &p->cache[0]);
+        MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+    }
 
-    status = vaExportSurfaceHandle(display, va_surface_id(mapper->src),
+    status = vaExportSurfaceHandle(p_owner->display, id,
                                    VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
                                    VA_EXPORT_SURFACE_READ_ONLY |
                                    VA_EXPORT_SURFACE_SEPARATE_LAYERS,
@@ -357,10 +423,13 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
     if (!CHECK_VA_STATUS(mapper, "vaAcquireSurfaceHandle()")) {
         if (status == VA_STATUS_ERROR_UNIMPLEMENTED)
             p->esh_not_implemented = true;
-        goto esh_failed;
+        return NULL;
     }
-    p->surface_acquired = true;
 
+    struct surface_cache_entry e = {.id = id, .fourcc = p->desc.fourcc};
+    bool ok = true;
+
+    gl->GenTextures(4, e.gl_textures);
     for (int n = 0; n < p->num_planes; n++) {
         int attribs[20] = {EGL_NONE};
         int num_attribs = 0;
@@ -386,28 +455,59 @@ static int mapper_map(struct ra_hwdec_mapper *mapper)
         if (p->desc.layers[n].num_planes > 3)
             ADD_PLANE_ATTRIBS(3);
 
-        p->images[n] = p->CreateImageKHR(eglGetCurrentDisplay(),
+        e.images[n] = p->CreateImageKHR(eglGetCurrentDisplay(),
             EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
-        if (!p->images[n])
-            goto esh_failed;
+        if (!e.images[n]) {
+            ok = false;
+            break;
+        }
+
+        init_texture(gl, e.gl_textures[n]);
+        gl->BindTexture(GL_TEXTURE_2D, e.gl_textures[n]);
+        p->EGLImageTargetTexture2DOES(GL_TEXTURE_2D, e.images[n]);
+        gl->BindTexture(GL_TEXTURE_2D, 0);
 
-        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
-        p->EGLImageTargetTexture2DOES(GL_TEXTURE_2D, p->images[n]);
+        e.tex[n] = ra_create_wrapped_tex(mapper->ra, &p->tex[n]->params,
+                                         e.gl_textures[n]);
+        if (!e.tex[n]) {
+            ok = false;
+            break;
+        }
+    }
 
-        mapper->tex[n] = p->tex[n];
+    // The EGLImages hold their own references to the dma-bufs.
+    for (int n = 0; n < p->desc.num_objects; n++)
+        close(p->desc.objects[n].fd);
+
+    if (!ok) {
+        cache_entry_destroy(mapper, &e);
+        return NULL;
     }
-    gl->BindTexture(GL_TEXTURE_2D, 0);
 
-    if (p->desc.fourcc == VA_FOURCC_YV12)
-        MPSWAP(struct ra_tex*, mapper->tex[1], mapper->tex[2]);
+    MP_TARRAY_APPEND(p, p->cache, p->num_cache, e);
+    return &p->cache[p->num_cache - 1];
+}
+#endif
 
-    return 0;
+static int mapper_map(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+    GL *gl = ra_gl_get(mapper->ra);
+    VAStatus status;
+    VAImage *va_image = &p->current_image;
+    VADisplay *display = p_owner->display;
 
-esh_failed:
-    if (p->surface_acquired) {
-        for (int n = 0; n < p->desc.num_objects; n++)
-            close(p->desc.objects[n].fd);
-        p->surface_acquired = false;
+#if VA_CHECK_VERSION(1, 1, 0)
+    if (!p->esh_not_implemented) {
+        struct surface_cache_entry *e = map_cached_surface(mapper);
+        if (e) {
+            for (int n = 0; n < p->num_planes; n++)
+                mapper->tex[n] = e->tex[n];
+            if (e->fourcc == VA_FOURCC_YV12)
+                MPSWAP(struct ra_tex*, mapper->tex[1], mapper->tex[2]);
+            return 0;
+        }
     }
 #endif
 
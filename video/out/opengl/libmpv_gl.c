@@ -110,6 +110,19 @@ static void done_frame(struct libmpv_gpu_context *ctx, bool ds)
     ra_gl_ctx_submit_frame(sw, &dummy);
 }
 
+static void *create_fence(struct libmpv_gpu_context *ctx)
+{
+    struct priv *p = ctx->priv;
+    GL *gl = p->gl;
+
+    if (!gl->FenceSync)
+        return NULL;
+
+    GLsync fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    gl->Flush();
+    return fence;
+}
+
 static void destroy(struct libmpv_gpu_context *ctx)
 {
     struct priv *p = ctx->priv;
@@ -123,5 +136,6 @@ const struct libmpv_gpu_context_fns libmpv_gpu_context_gl = {
     .init = init,
     .wrap_fbo = wrap_fbo,
     .done_frame = done_frame,
+    .create_fence = create_fence,
     .destroy = destroy,
 };
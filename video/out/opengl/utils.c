@@ -115,10 +115,23 @@ bool gl_read_fbo_contents(GL *gl, int fbo, int dir, GLenum format, GLenum type,
     GLenum obj = fbo ? GL_COLOR_ATTACHMENT0 : GL_FRONT;
     gl->PixelStorei(GL_PACK_ALIGNMENT, 1);
     gl->ReadBuffer(obj);
-    // reading by line allows flipping, and avoids stride-related trouble
-    int y1 = dir > 0 ? 0 : h;
-    for (int y = 0; y < h; y++)
-        gl->ReadPixels(0, y, w, 1, format, type, dst + (y1 + dir * y) * dst_stride);
+    int bpp = gl_bytes_per_pixel(format, type);
+    bool row_length = bpp && dst_stride % bpp == 0 &&
+                      (gl->mpgl_caps & MPGL_CAP_ROW_LENGTH);
+    if (dir > 0 && (dst_stride == w * bpp || row_length)) {
+        // Reading everything at once is much faster than line by line, since
+        // every ReadPixels call stalls until the GPU has caught up
+        if (row_length)
+            gl->PixelStorei(GL_PACK_ROW_LENGTH, dst_stride / bpp);
+        gl->ReadPixels(0, 0, w, h, format, type, dst);
+        if (row_length)
+            gl->PixelStorei(GL_PACK_ROW_LENGTH, 0);
+    } else {
+        // reading by line allows flipping, and avoids stride-related trouble
+        int y1 = dir > 0 ? 0 : h;
+        for (int y = 0; y < h; y++)
+            gl->ReadPixels(0, y, w, 1, format, type, dst + (y1 + dir * y) * dst_stride);
+    }
     gl->PixelStorei(GL_PACK_ALIGNMENT, 4);
     gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
     return true;
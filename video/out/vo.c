@@ -31,6 +31,7 @@
 #include "osdep/threads.h"
 #include "misc/dispatch.h"
 #include "misc/rendezvous.h"
+#include "misc/thread_sched.h"
 #include "options/options.h"
 #include "misc/bstr.h"
 #include "vo.h"
@@ -105,6 +106,12 @@ const struct vo_driver *const video_out_drivers[] =
     NULL
 };
 
+// Last VO_LATENCY_SAMPLES latency measurements, in nanoseconds.
+struct latency_ring {
+    uint64_t samples[VO_LATENCY_SAMPLES];
+    int num, idx;
+};
+
 struct vo_internal {
     pthread_t thread;
     struct mp_dispatch_queue *dispatch;
@@ -120,6 +127,7 @@ struct vo_internal {
     bool hasframe;
     bool hasframe_rendered;
     bool request_redraw;            // redraw request from player to VO
+    int64_t last_redraw;            // mp_time_us() of the last do_redraw()
     bool want_redraw;               // redraw request from VO to player
     bool send_reset;                // send VOCTRL_RESET
     bool paused;
@@ -140,10 +148,27 @@ struct vo_internal {
     double estimated_vsync_interval;
     double estimated_vsync_jitter;
     bool expecting_vsync;
+    bool vsync_feedback;        // last vsync sample came from get_vsync
     int64_t num_successive_vsyncs;
 
+    // Present timing telemetry (see vo_get_timing_stats())
+    int64_t present_hist[VO_TIMING_BINS];
+    int64_t num_present_samples;
+    int64_t missed_vsyncs;
+    struct latency_ring render_latency;
+    struct latency_ring input_latency;
+    int64_t input_time;         // mp_time_us() of the oldest unrendered input
+
+    // Video wall: VOs that receive the same frames (owned by this VO), or
+    // set if this VO is one of them.
+    struct vo **mirrors;
+    int num_mirrors;
+    bool is_mirror;
+    bool wall_warned;
+
     int64_t flip_queue_offset; // queue flip events at most this much in advance
     int64_t timing_offset;     // same (but from options; not VO configured)
+    int queue_depth;           // max. frames handed to the VO but not shown
 
     int64_t delayed_count;
     int64_t drop_count;
@@ -154,7 +179,10 @@ struct vo_internal {
     int64_t wakeup_pts;             // time at which to pull frame from decoder
 
     bool rendering;                 // true if an image is being rendered
-    struct vo_frame *frame_queued;  // should be drawn next
+    // Frames to be drawn next, in order. More than 1 only for display-synced
+    // frames with --video-queue-depth > 1.
+    struct vo_frame *frame_queue[VO_MAX_QUEUE];
+    int num_frame_queue;
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
 
@@ -216,14 +244,26 @@ static void read_opts(struct vo *vo)
 
     pthread_mutex_lock(&in->lock);
     in->timing_offset = (uint64_t)(vo->opts->timing_offset * 1e6);
+    in->queue_depth = MPCLAMP(vo->opts->queue_depth, 1, VO_MAX_QUEUE);
     pthread_mutex_unlock(&in->lock);
 }
 
+// Re-apply per-VO overrides after the option cache was updated.
+static void apply_wall_opts(struct vo *vo)
+{
+    struct vo_wall_tile *t = &vo->extra.wall;
+    if (t->cols && t->fullscreen) {
+        vo->opts->fullscreen = true;
+        vo->opts->fsscreen_id = t->index;
+    }
+}
+
 static void update_opts(void *p)
 {
     struct vo *vo = p;
 
     if (m_config_cache_update(vo->opts_cache)) {
+        apply_wall_opts(vo);
         read_opts(vo);
 
         // "Legacy" update of video position related options.
@@ -296,6 +336,7 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
 
     vo->opts_cache = m_config_cache_alloc(NULL, global, &vo_sub_opts);
     vo->opts = vo->opts_cache->opts;
+    apply_wall_opts(vo);
 
     m_config_cache_set_dispatch_change_cb(vo->opts_cache, vo->in->dispatch,
                                           update_opts, vo);
@@ -369,6 +410,9 @@ static void terminate_vo(void *p)
 void vo_destroy(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
+    for (int n = 0; n < in->num_mirrors; n++)
+        vo_destroy(in->mirrors[n]);
+    in->num_mirrors = 0;
     mp_dispatch_run(in->dispatch, terminate_vo, vo);
     pthread_join(vo->in->thread, NULL);
     dealloc_vo(vo);
@@ -472,15 +516,66 @@ static void vsync_skip_detection(struct vo *vo)
 }
 
 // Always called locked.
-static void update_vsync_timing_after_swap(struct vo *vo)
+static void record_present_interval(struct vo *vo, int64_t interval)
 {
     struct vo_internal *in = vo->in;
 
-    int64_t now = mp_time_us();
+    if (in->vsync_interval <= 0)
+        return;
+
+    double vsyncs = interval / (double)in->vsync_interval;
+    int bin = MPCLAMP((int)(vsyncs / VO_TIMING_BIN_WIDTH), 0, VO_TIMING_BINS - 1);
+    in->present_hist[bin] += 1;
+    in->num_present_samples += 1;
+    in->missed_vsyncs += MPMAX(lrint(vsyncs) - 1, 0);
+}
+
+// Always called locked.
+static void record_latency(struct latency_ring *r, int64_t us)
+{
+    r->samples[r->idx] = MPMAX(us, 0) * 1000;
+    r->idx = (r->idx + 1) % VO_LATENCY_SAMPLES;
+    r->num = MPMIN(r->num + 1, VO_LATENCY_SAMPLES);
+}
+
+static void get_latency(struct latency_ring *r, uint64_t *last, uint64_t *avg,
+                        uint64_t *peak)
+{
+    *last = *avg = *peak = 0;
+    if (!r->num)
+        return;
+    *last = r->samples[(r->idx + VO_LATENCY_SAMPLES - 1) % VO_LATENCY_SAMPLES];
+    uint64_t sum = 0;
+    for (int n = 0; n < r->num; n++) {
+        sum += r->samples[n];
+        *peak = MPMAX(*peak, r->samples[n]);
+    }
+    *avg = sum / r->num;
+}
+
+// Always called locked.
+static void update_vsync_timing_after_swap(struct vo *vo,
+                                           struct vo_vsync_info *vsync)
+{
+    struct vo_internal *in = vo->in;
+
+    // If presentation feedback is available, use the actual display times,
+    // which are much less noisy than the flip_page return times.
+    bool feedback = vsync->last_queue_display_time > 0;
+    int64_t now = feedback ? vsync->last_queue_display_time : mp_time_us();
     int64_t prev_vsync = in->prev_vsync;
 
     in->prev_vsync = now;
 
+    // Samples from different time sources can't be mixed.
+    if (feedback != in->vsync_feedback) {
+        in->vsync_feedback = feedback;
+        MP_VERBOSE(vo, "%s presentation feedback for vsync timing.\n",
+                   feedback ? "Using" : "Not using");
+        in->num_vsync_samples = 0;
+        in->num_successive_vsyncs = 0;
+    }
+
     if (!in->expecting_vsync) {
         reset_vsync_timings(vo);
         return;
@@ -496,6 +591,7 @@ static void update_vsync_timing_after_swap(struct vo *vo)
                         now - prev_vsync);
     in->drop_point = MPMIN(in->drop_point + 1, in->num_vsync_samples);
     in->num_total_vsync_samples += 1;
+    record_present_interval(vo, now - prev_vsync);
     if (in->base_vsync) {
         in->base_vsync += in->vsync_interval;
     } else {
@@ -510,7 +606,15 @@ static void update_vsync_timing_after_swap(struct vo *vo)
         vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
 
     check_estimated_display_fps(vo);
-    vsync_skip_detection(vo);
+    if (vsync->skipped_vsyncs < 0) {
+        vsync_skip_detection(vo);
+    } else if (vsync->skipped_vsyncs > 0) {
+        // Reported by the windowing system, so there's no need to guess.
+        in->base_vsync = in->prev_vsync;
+        in->delayed_count += 1;
+        in->drop_point = 0;
+        MP_STATS(vo, "vo-delayed");
+    }
 
     MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
     MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
@@ -578,7 +682,8 @@ static void run_reconfig(void *p)
 
     MP_VERBOSE(vo, "reconfig to %s\n", mp_image_params_to_str(params));
 
-    m_config_cache_update(vo->opts_cache);
+    if (m_config_cache_update(vo->opts_cache))
+        apply_wall_opts(vo);
 
     mp_image_params_get_dsize(params, &vo->dwidth, &vo->dheight);
 
@@ -608,11 +713,52 @@ static void run_reconfig(void *p)
     update_display_fps(vo);
 }
 
+// Crop the image to the VO's video wall tile. Only changes the size if the
+// image has no data (params only). Returns false if this is not possible.
+static bool wall_crop_image(struct vo *vo, struct mp_image *img)
+{
+    struct vo_wall_tile *t = &vo->extra.wall;
+    if (!t->cols)
+        return true;
+    if (img->fmt.flags & MP_IMGFLAG_HWACCEL) {
+        if (!vo->in->wall_warned)
+            MP_WARN(vo, "Cannot crop hardware frames for the video wall.\n");
+        vo->in->wall_warned = true;
+        return false;
+    }
+    int c = t->index % t->cols, r = t->index / t->cols;
+    int ax = img->fmt.align_x, ay = img->fmt.align_y;
+    struct mp_rect rc = {
+        .x0 = MP_ALIGN_DOWN(img->w * c / t->cols, ax),
+        .y0 = MP_ALIGN_DOWN(img->h * r / t->rows, ay),
+        .x1 = c + 1 < t->cols ? MP_ALIGN_DOWN(img->w * (c + 1) / t->cols, ax)
+                              : img->w,
+        .y1 = r + 1 < t->rows ? MP_ALIGN_DOWN(img->h * (r + 1) / t->rows, ay)
+                              : img->h,
+    };
+    if (img->planes[0]) {
+        mp_image_crop_rc(img, rc);
+    } else {
+        mp_image_set_size(img, mp_rect_w(rc), mp_rect_h(rc));
+    }
+    return true;
+}
+
+static void wall_crop_frame(struct vo *vo, struct vo_frame *frame)
+{
+    for (int n = 0; n < frame->num_frames; n++)
+        wall_crop_image(vo, frame->frames[n]);
+}
+
 int vo_reconfig(struct vo *vo, struct mp_image_params *params)
 {
+    for (int n = 0; n < vo->in->num_mirrors; n++)
+        vo_reconfig(vo->in->mirrors[n], params);
+
     int ret;
     struct mp_image dummy = {0};
     mp_image_set_params(&dummy, params);
+    wall_crop_image(vo, &dummy);
     void *p[] = {vo, &dummy, &ret};
     mp_dispatch_run(vo->in->dispatch, run_reconfig, p);
     return ret;
@@ -620,9 +766,19 @@ int vo_reconfig(struct vo *vo, struct mp_image_params *params)
 
 int vo_reconfig2(struct vo *vo, struct mp_image *img)
 {
+    for (int n = 0; n < vo->in->num_mirrors; n++)
+        vo_reconfig2(vo->in->mirrors[n], img);
+
     int ret;
+    struct mp_image *ref = NULL;
+    if (vo->extra.wall.cols) {
+        ref = mp_image_new_ref(img);
+        if (ref && wall_crop_image(vo, ref))
+            img = ref;
+    }
     void *p[] = {vo, img, &ret};
     mp_dispatch_run(vo->in->dispatch, run_reconfig, p);
+    talloc_free(ref);
     return ret;
 }
 
@@ -632,7 +788,8 @@ static void run_control(void *p)
     struct vo *vo = pp[0];
     int request = (intptr_t)pp[1];
     void *data = pp[2];
-    m_config_cache_update(vo->opts_cache);
+    if (m_config_cache_update(vo->opts_cache))
+        apply_wall_opts(vo);
     int ret = vo->driver->control(vo, request, data);
     if (pp[3])
         *(int *)pp[3] = ret;
@@ -640,6 +797,15 @@ static void run_control(void *p)
 
 int vo_control(struct vo *vo, int request, void *data)
 {
+    switch (request) {
+    case VOCTRL_UPDATE_WINDOW_TITLE:
+    case VOCTRL_TRIM_MEMORY:
+    case VOCTRL_KILL_SCREENSAVER:
+    case VOCTRL_RESTORE_SCREENSAVER:
+        for (int n = 0; n < vo->in->num_mirrors; n++)
+            vo_control(vo->in->mirrors[n], request, data);
+    }
+
     int ret;
     void *p[] = {vo, (void *)(intptr_t)request, data, &ret};
     mp_dispatch_run(vo->in->dispatch, run_control, p);
@@ -650,6 +816,9 @@ int vo_control(struct vo *vo, int request, void *data)
 // (Only works for some VOCTRLs.)
 void vo_control_async(struct vo *vo, int request, void *data)
 {
+    for (int n = 0; n < vo->in->num_mirrors; n++)
+        vo_control_async(vo->in->mirrors[n], request, data);
+
     void *p[4] = {vo, (void *)(intptr_t)request, NULL, NULL};
     void **d = talloc_memdup(NULL, p, sizeof(p));
 
@@ -675,8 +844,9 @@ static void forget_frames(struct vo *vo)
     in->hasframe_rendered = false;
     in->drop_count = 0;
     in->delayed_count = 0;
-    talloc_free(in->frame_queued);
-    in->frame_queued = NULL;
+    for (int n = 0; n < in->num_frame_queue; n++)
+        talloc_free(in->frame_queue[n]);
+    in->num_frame_queue = 0;
     in->current_frame_id += VO_MAX_REQ_FRAMES + 1;
     // don't unref current_frame; we always want to be able to redraw it
     if (in->current_frame) {
@@ -744,14 +914,38 @@ void vo_wakeup(struct vo *vo)
 // callback once the time is right.
 // If next_pts is negative, disable any timing and draw the frame as fast as
 // possible.
+// Number of frames that were queued, and are still going to be displayed.
+// Must be called locked.
+static int pending_frames(struct vo_internal *in)
+{
+    bool cur = in->current_frame && in->current_frame->num_vsyncs >= 1;
+    return in->num_frame_queue + cur;
+}
+
+// Whether another frame can be queued. Only display-synced frames are queued
+// ahead (they are shown at a given vsync, not at a given time), so the
+// configured depth applies if the queued frames are display-synced as well.
+// Must be called locked.
+static bool can_queue_frame(struct vo_internal *in, bool display_synced)
+{
+    int depth = 1;
+    if (display_synced) {
+        struct vo_frame *last = in->num_frame_queue
+            ? in->frame_queue[in->num_frame_queue - 1] : in->current_frame;
+        if (!last || last->display_synced)
+            depth = in->queue_depth;
+    }
+    return pending_frames(in) < depth && in->num_frame_queue < VO_MAX_QUEUE;
+}
+
 bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
     bool blocked = vo->driver->initially_blocked &&
                    !(in->internal_events & VO_EVENT_INITIAL_UNBLOCK);
-    bool r = vo->config_ok && !in->frame_queued && !blocked &&
-             (!in->current_frame || in->current_frame->num_vsyncs < 1);
+    // next_pts < 0 means display-synced mode
+    bool r = vo->config_ok && !blocked && can_queue_frame(in, next_pts < 0);
     if (r && next_pts >= 0) {
         // Don't show the frame too early - it would basically freeze the
         // display by disallowing OSD redrawing or VO interaction.
@@ -779,12 +973,26 @@ bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
 void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct vo_internal *in = vo->in;
+
+    // The mirrors show the same frames at the same times. If one is lagging
+    // behind, it skips the frame instead of holding up the others.
+    for (int n = 0; n < in->num_mirrors; n++) {
+        struct vo *m = in->mirrors[n];
+        pthread_mutex_lock(&m->in->lock);
+        bool ready = m->config_ok && can_queue_frame(m->in, frame->display_synced);
+        if (!ready)
+            m->in->drop_count += 1;
+        pthread_mutex_unlock(&m->in->lock);
+        if (ready)
+            vo_queue_frame(m, vo_frame_ref(frame));
+    }
+    wall_crop_frame(vo, frame);
+
     pthread_mutex_lock(&in->lock);
-    assert(vo->config_ok && !in->frame_queued &&
-           (!in->current_frame || in->current_frame->num_vsyncs < 1));
+    assert(vo->config_ok && can_queue_frame(in, frame->display_synced));
     in->hasframe = true;
     frame->frame_id = ++(in->current_frame_id);
-    in->frame_queued = frame;
+    in->frame_queue[in->num_frame_queue++] = frame;
     in->wakeup_pts = frame->display_synced
                    ? 0 : frame->pts + MPMAX(frame->duration, 0);
     wakeup_locked(vo);
@@ -797,7 +1005,7 @@ void vo_wait_frame(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
-    while (in->frame_queued || in->rendering)
+    while (in->num_frame_queue || in->rendering)
         pthread_cond_wait(&in->wakeup, &in->lock);
     pthread_mutex_unlock(&in->lock);
 }
@@ -829,10 +1037,15 @@ bool vo_render_frame_external(struct vo *vo)
 
     pthread_mutex_lock(&in->lock);
 
-    if (in->frame_queued) {
+    // Queued frames replace the current one once it has been shown often
+    // enough.
+    if (in->num_frame_queue && (!in->current_frame ||
+                                !in->current_frame->display_synced ||
+                                in->current_frame->num_vsyncs < 1))
+    {
         talloc_free(in->current_frame);
-        in->current_frame = in->frame_queued;
-        in->frame_queued = NULL;
+        in->current_frame = in->frame_queue[0];
+        MP_TARRAY_REMOVE_AT(in->frame_queue, in->num_frame_queue, 0);
     } else if (in->paused || !in->current_frame || !in->hasframe ||
                (in->current_frame->display_synced && in->current_frame->num_vsyncs < 1) ||
                !in->current_frame->display_synced)
@@ -889,11 +1102,16 @@ bool vo_render_frame_external(struct vo *vo)
         in->rendering = true;
         in->hasframe_rendered = true;
         int64_t prev_drop_count = vo->in->drop_count;
+        // Input received after this point is shown by the next frame at best.
+        int64_t input_time = in->input_time;
+        in->input_time = 0;
         pthread_mutex_unlock(&in->lock);
         wakeup_core(vo); // core can queue new video now
 
         MP_STATS(vo, "start video-draw");
 
+        int64_t render_start = mp_time_us();
+
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
         } else {
@@ -902,19 +1120,41 @@ bool vo_render_frame_external(struct vo *vo)
 
         MP_STATS(vo, "end video-draw");
 
+        int64_t draw_end = mp_time_us();
+
         wait_until(vo, target);
 
         MP_STATS(vo, "start video-flip");
 
+        int64_t flip_start = mp_time_us();
+
         vo->driver->flip_page(vo);
 
+        struct vo_vsync_info vsync = {
+            .last_queue_display_time = -1,
+            .skipped_vsyncs = -1,
+        };
+        if (vo->driver->get_vsync)
+            vo->driver->get_vsync(vo, &vsync);
+
         MP_STATS(vo, "end video-flip");
 
+        int64_t render_end = mp_time_us();
+
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
 
-        update_vsync_timing_after_swap(vo);
+        // Don't count the time spent waiting for the target time.
+        record_latency(&in->render_latency, (draw_end - render_start) +
+                                            (render_end - flip_start));
+        if (input_time) {
+            int64_t display_time = vsync.last_queue_display_time > 0
+                                 ? vsync.last_queue_display_time : render_end;
+            record_latency(&in->input_latency, display_time - input_time);
+        }
+
+        update_vsync_timing_after_swap(vo, &vsync);
     }
 
     if (vo->driver->caps & VO_CAP_NORETAIN) {
@@ -938,7 +1178,8 @@ done:
     pthread_mutex_unlock(&in->lock);
     if (in->external_renderloop_drive)
         return flipped;
-    return got_frame || (in->frame_queued && in->frame_queued->display_synced);
+    return got_frame ||
+           (in->num_frame_queue && in->frame_queue[0]->display_synced);
 }
 
 static void do_redraw(struct vo *vo)
@@ -964,6 +1205,8 @@ static void do_redraw(struct vo *vo)
     frame->still = true;
     frame->pts = 0;
     frame->duration = -1;
+    int64_t input_time = in->input_time;
+    in->input_time = 0;
     pthread_mutex_unlock(&in->lock);
 
     if (vo->driver->draw_frame) {
@@ -976,6 +1219,16 @@ static void do_redraw(struct vo *vo)
 
     vo->driver->flip_page(vo);
 
+    pthread_mutex_lock(&in->lock);
+    in->last_redraw = mp_time_us();
+    pthread_mutex_unlock(&in->lock);
+
+    if (input_time) {
+        pthread_mutex_lock(&in->lock);
+        record_latency(&in->input_latency, mp_time_us() - input_time);
+        pthread_mutex_unlock(&in->lock);
+    }
+
     if (frame != &dummy)
         talloc_free(frame);
 }
@@ -986,16 +1239,17 @@ static void drop_unrendered_frame(struct vo *vo)
 
     pthread_mutex_lock(&in->lock);
 
-    if (!in->frame_queued)
+    if (in->num_frame_queue != 1)
         goto end;
 
-    if ((in->frame_queued->pts + in->frame_queued->duration) > mp_time_us())
+    struct vo_frame *frame = in->frame_queue[0];
+    if ((frame->pts + frame->duration) > mp_time_us())
         goto end;
 
-    MP_VERBOSE(vo, "Dropping unrendered frame (pts %"PRId64")\n", in->frame_queued->pts);
+    MP_VERBOSE(vo, "Dropping unrendered frame (pts %"PRId64")\n", frame->pts);
 
-    talloc_free(in->frame_queued);
-    in->frame_queued = NULL;
+    talloc_free(frame);
+    in->num_frame_queue = 0;
     in->hasframe = false;
     pthread_cond_broadcast(&in->wakeup);
     wakeup_core(vo);
@@ -1032,6 +1286,9 @@ static void *vo_thread(void *ptr)
     bool vo_paused = false;
 
     mpthread_set_name("vo");
+    mp_thread_sched_apply(vo->global, vo->log, "vo");
+    // Frame timing relies on waking up precisely at vsync deadlines.
+    mpthread_set_timer_slack(1);
 
     if (vo->driver->get_image)
         in->dr_helper = dr_helper_create(in->dispatch, get_image_vo, vo);
@@ -1069,10 +1326,22 @@ static void *vo_thread(void *ptr)
         }
         if (vo->want_redraw) {
             vo->want_redraw = false;
-            in->want_redraw = true;
-            wakeup_core(vo);
+            if (in->is_mirror) {
+                // The player only polls the primary VO.
+                in->request_redraw = true;
+            } else {
+                in->want_redraw = true;
+                wakeup_core(vo);
+            }
         }
         bool redraw = in->request_redraw;
+        // Coalesce redraw requests (e.g. OSD updates by scripts) to at most
+        // one per display refresh. If the refresh rate is unknown (the
+        // interval is set to 1 then), assume 60 Hz.
+        int64_t redraw_interval = in->vsync_interval > 1 ? in->vsync_interval
+                                                         : (int64_t)(1e6 / 60);
+        int64_t next_redraw =
+            in->last_redraw + MPMIN(redraw_interval, (int64_t)(1e6 / 20));
         bool send_reset = in->send_reset;
         in->send_reset = false;
         bool send_pause = in->paused != vo_paused;
@@ -1084,8 +1353,11 @@ static void *vo_thread(void *ptr)
         if (send_pause)
             vo->driver->control(vo, vo_paused ? VOCTRL_PAUSE : VOCTRL_RESUME, NULL);
         if (wait_until > now && redraw) {
-            do_redraw(vo); // now is a good time
-            continue;
+            if (next_redraw <= now) {
+                do_redraw(vo); // now is a good time
+                continue;
+            }
+            wait_until = MPMIN(wait_until, next_redraw);
         }
         if (vo->want_redraw) // might have been set by VOCTRLs
             wait_until = 0;
@@ -1104,6 +1376,8 @@ done:
 void vo_set_paused(struct vo *vo, bool paused)
 {
     struct vo_internal *in = vo->in;
+    for (int n = 0; n < in->num_mirrors; n++)
+        vo_set_paused(in->mirrors[n], paused);
     pthread_mutex_lock(&in->lock);
     if (in->paused != paused) {
         in->paused = paused;
@@ -1136,6 +1410,8 @@ void vo_increment_drop_count(struct vo *vo, int64_t n)
 void vo_redraw(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
+    for (int n = 0; n < in->num_mirrors; n++)
+        vo_redraw(in->mirrors[n]);
     pthread_mutex_lock(&in->lock);
     if (!in->request_redraw) {
         in->request_redraw = true;
@@ -1157,6 +1433,8 @@ bool vo_want_redraw(struct vo *vo)
 void vo_seek_reset(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
+    for (int n = 0; n < in->num_mirrors; n++)
+        vo_seek_reset(in->mirrors[n]);
     pthread_mutex_lock(&in->lock);
     forget_frames(vo);
     reset_vsync_timings(vo);
@@ -1178,7 +1456,7 @@ bool vo_still_displaying(struct vo *vo)
         if (in->current_frame->display_synced)
             frame_end = in->current_frame->num_vsyncs > 0 ? INT64_MAX : 0;
     }
-    bool working = now < frame_end || in->rendering || in->frame_queued;
+    bool working = now < frame_end || in->rendering || in->num_frame_queue;
     pthread_mutex_unlock(&vo->in->lock);
     return working && in->hasframe;
 }
@@ -1275,23 +1553,73 @@ double vo_get_estimated_vsync_jitter(struct vo *vo)
     return res;
 }
 
-// Get the time in seconds at after which the currently rendering frame will
-// end. Returns positive values if the frame is yet to be finished, negative
-// values if it already finished.
-// This can only be called while no new frame is queued (after
+// Return histogram of present intervals and related timing statistics. The
+// counters accumulate over the lifetime of the VO, except delayed_count and
+// drop_count, which are reset on seeks like vo_get_drop_count().
+void vo_get_timing_stats(struct vo *vo, struct vo_timing_stats *st)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    *st = (struct vo_timing_stats){
+        .vsync_interval = in->estimated_vsync_interval / 1e6,
+        .vsync_jitter = in->estimated_vsync_jitter,
+        .num_samples = in->num_present_samples,
+        .missed_vsyncs = in->missed_vsyncs,
+        .delayed_count = in->delayed_count,
+        .drop_count = in->drop_count,
+    };
+    for (int n = 0; n < VO_TIMING_BINS; n++)
+        st->hist[n] = in->present_hist[n];
+    get_latency(&in->render_latency, &st->latency_last, &st->latency_avg,
+                &st->latency_peak);
+    get_latency(&in->input_latency, &st->input_latency_last,
+                &st->input_latency_avg, &st->input_latency_peak);
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Make mirror receive all frames and state changes of vo, which takes ownership
+// of it (see --video-wall). mirror must have been created with a vo_wall_tile.
+void vo_add_mirror(struct vo *vo, struct vo *mirror)
+{
+    assert(!mirror->in->num_mirrors);
+    mirror->in->is_mirror = true;
+    MP_TARRAY_APPEND(vo, vo->in->mirrors, vo->in->num_mirrors, mirror);
+}
+
+// Called by the player when it handles an input event (such as a key press).
+// The time until the next rendered frame is displayed is measured, see
+// vo_timing_stats.input_latency_*.
+void vo_mark_input(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    if (!in->input_time)
+        in->input_time = mp_time_us();
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Get the time in seconds at after which the currently rendering frame (and
+// all frames queued after it) will end. Returns positive values if the frame
+// is yet to be finished, negative values if it already finished.
+// This can only be called if a new frame can be queued (after
 // vo_is_ready_for_frame). Returns 0 for non-display synced frames, or if the
 // deadline for continuous display was missed.
 double vo_get_delay(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
-    assert (!in->frame_queued);
     int64_t res = 0;
     if (in->base_vsync && in->vsync_interval > 1 && in->current_frame) {
         res = in->base_vsync;
         int extra = !!in->rendering;
-        res += (in->current_frame->num_vsyncs + extra) * in->vsync_interval;
-        if (!in->current_frame->display_synced)
+        int vsyncs = in->current_frame->num_vsyncs + extra;
+        bool synced = in->current_frame->display_synced;
+        for (int n = 0; n < in->num_frame_queue; n++) {
+            vsyncs += MPMAX(in->frame_queue[n]->num_vsyncs, 0);
+            synced &= in->frame_queue[n]->display_synced;
+        }
+        res += vsyncs * in->vsync_interval;
+        if (!synced)
             res = 0;
     }
     pthread_mutex_unlock(&in->lock);
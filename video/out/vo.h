@@ -125,6 +125,9 @@ enum mp_voctrl {
 
     VOCTRL_GET_PREF_DEINT,              // int*
 
+    // Release memory that is recreated on demand (e.g. intermediate textures).
+    VOCTRL_TRIM_MEMORY,
+
     /* private to vo_gpu */
     VOCTRL_EXTERNAL_RESIZE,
 };
@@ -179,8 +182,40 @@ struct mp_frame_perf {
     char *desc[VO_PASS_PERF_MAX];
 };
 
+// GPU memory allocator statistics (all 0 if the VO doesn't provide them)
+struct mp_gpu_mem_stats {
+    int num_slabs;          // number of device memory allocations
+    uint64_t allocated;     // bytes allocated from the device
+    uint64_t used;          // bytes of that in use
+    uint64_t largest_free;  // largest contiguous free region
+};
+
 struct voctrl_performance_data {
     struct mp_frame_perf fresh, redraw;
+    struct mp_gpu_mem_stats mem;
+};
+
+// Present interval histogram: bin n counts intervals between n and n + 1
+// times VO_TIMING_BIN_WIDTH vsyncs. The last bin also counts longer intervals.
+#define VO_TIMING_BINS 32
+#define VO_TIMING_BIN_WIDTH 0.125
+#define VO_LATENCY_SAMPLES 64
+
+// Returned by vo_get_timing_stats(). Only display-synced frames are measured.
+struct vo_timing_stats {
+    double vsync_interval;      // estimated vsync interval in seconds, or 0
+    double vsync_jitter;        // estimated jitter (relative to vsync_interval)
+    int64_t num_samples;        // number of measured present intervals
+    int64_t hist[VO_TIMING_BINS];
+    int64_t missed_vsyncs;      // vsyncs skipped by late presents
+    int64_t delayed_count, drop_count;
+    // Time from start of rendering until the swap returned, in nanoseconds,
+    // over the last VO_LATENCY_SAMPLES frames.
+    uint64_t latency_last, latency_avg, latency_peak;
+    // Time from handling an input event until the next rendered frame is
+    // (or is predicted to be) displayed, in nanoseconds, over the last
+    // VO_LATENCY_SAMPLES measurements. See vo_mark_input().
+    uint64_t input_latency_last, input_latency_avg, input_latency_peak;
 };
 
 struct voctrl_screenshot {
@@ -199,12 +234,23 @@ enum {
 
 #define VO_MAX_REQ_FRAMES 10
 
+// Maximum for --video-queue-depth
+#define VO_MAX_QUEUE 8
+
 struct vo;
 struct osd_state;
 struct mp_image;
 struct mp_image_params;
 
+// Video wall tile (see --video-wall): the VO shows only this part of the video.
+struct vo_wall_tile {
+    int cols, rows;     // grid size, 0 if disabled
+    int index;          // row-major tile index (0 is the primary VO)
+    bool fullscreen;    // force fullscreen on --fs-screen=index
+};
+
 struct vo_extra {
+    struct vo_wall_tile wall;
     struct input_ctx *input_ctx;
     struct osd_state *osd;
     struct encode_lavc_context *encode_lavc_ctx;
@@ -212,6 +258,16 @@ struct vo_extra {
     void *wakeup_ctx;
 };
 
+// Presentation feedback, see vo_driver.get_vsync.
+struct vo_vsync_info {
+    // mp_time_us() at which the last queued frame is or will be displayed, as
+    // reported or predicted from presentation feedback. -1 if unknown.
+    int64_t last_queue_display_time;
+    // Number of vsyncs which were skipped (showed no new frame) since the
+    // previous flip_page call. -1 if unknown.
+    int64_t skipped_vsyncs;
+};
+
 struct vo_frame {
     // If > 0, realtime when frame should be shown, in mp_time_us() units.
     // If 0, present immediately.
@@ -374,6 +430,14 @@ struct vo_driver {
      */
     void (*flip_page)(struct vo *vo);
 
+    /*
+     * Optional. Called after each flip_page. Fills in the fields of info that
+     * are known from presentation feedback of the windowing system. info is
+     * initialized to "unknown" values (see struct vo_vsync_info). The vsync
+     * estimation falls back to measuring flip_page return times otherwise.
+     */
+    void (*get_vsync)(struct vo *vo, struct vo_vsync_info *info);
+
     /* These optional callbacks can be provided if the GUI framework used by
      * the VO requires entering a message loop for receiving events and does
      * not call vo_wakeup() from a separate thread when there are new events.
@@ -487,6 +551,9 @@ int vo_get_num_req_frames(struct vo *vo);
 int64_t vo_get_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_jitter(struct vo *vo);
+void vo_get_timing_stats(struct vo *vo, struct vo_timing_stats *st);
+void vo_mark_input(struct vo *vo);
+void vo_add_mirror(struct vo *vo, struct vo *mirror);
 double vo_get_display_fps(struct vo *vo);
 double vo_get_delay(struct vo *vo);
 void vo_discard_timing_info(struct vo *vo);
@@ -39,7 +39,9 @@
 #define BYTES_PER_PIXEL 4
 #define BITS_PER_PIXEL 32
 #define USE_MASTER 0
-#define BUF_COUNT 2
+// One buffer is scanned out, one waits for the page flip, and the third one
+// can be drawn into meanwhile.
+#define BUF_COUNT 3
 
 // Modulo that works correctly for negative numbers
 #define MOD(a,b) ((((a)%(b))+(b))%(b))
@@ -147,12 +149,12 @@ err:
     return false;
 }
 
-static bool fb_setup_double_buffering(struct vo *vo)
+static bool fb_setup_buffers(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
     p->front_buf = 0;
-    for (unsigned int i = 0; i < 2; i++) {
+    for (unsigned int i = 0; i < BUF_COUNT; i++) {
         p->bufs[i].width = p->kms->mode.mode.hdisplay;
         p->bufs[i].height = p->kms->mode.mode.vdisplay;
     }
@@ -349,12 +351,42 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     }
 }
 
+static void wait_on_flip(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    // poll page flip finish event
+    while (p->pflip_happening) {
+        const int timeout_ms = 3000;
+        struct pollfd fds[1] = {
+            { .events = POLLIN, .fd = p->kms->fd },
+        };
+        poll(fds, 1, timeout_ms);
+        if (!(fds[0].revents & POLLIN)) {
+            MP_WARN(vo, "Timeout waiting for page flip.\n");
+            p->pflip_happening = false;
+            break;
+        }
+        int ret = drmHandleEvent(p->kms->fd, &p->ev);
+        if (ret != 0) {
+            MP_ERR(vo, "drmHandleEvent failed: %i\n", ret);
+            p->pflip_happening = false;
+            break;
+        }
+    }
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (!p->active || p->pflip_happening)
+    if (!p->active)
         return;
 
+    // Only one flip can be pending. Instead of waiting for it right after
+    // queuing it, wait here, so the next frame is converted while the
+    // previous flip is still in progress.
+    wait_on_flip(vo);
+
     int ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
                               p->bufs[p->front_buf].fb,
                               DRM_MODE_PAGE_FLIP_EVENT, p);
@@ -365,20 +397,6 @@ static void flip_page(struct vo *vo)
         p->front_buf %= BUF_COUNT;
         p->pflip_happening = true;
     }
-
-    // poll page flip finish event
-    const int timeout_ms = 3000;
-    struct pollfd fds[1] = {
-        { .events = POLLIN, .fd = p->kms->fd },
-    };
-    poll(fds, 1, timeout_ms);
-    if (fds[0].revents & POLLIN) {
-        ret = drmHandleEvent(p->kms->fd, &p->ev);
-        if (ret != 0) {
-            MP_ERR(vo, "drmHandleEvent failed: %i\n", ret);
-            return;
-        }
-    }
 }
 
 static void uninit(struct vo *vo)
@@ -427,8 +445,8 @@ static int preinit(struct vo *vo)
         goto err;
     }
 
-    if (!fb_setup_double_buffering(vo)) {
-        MP_ERR(vo, "Failed to set up double buffering.\n");
+    if (!fb_setup_buffers(vo)) {
+        MP_ERR(vo, "Failed to set up framebuffers.\n");
         goto err;
     }
 
@@ -34,6 +34,8 @@
 #include "common/msg.h"
 #include "common/global.h"
 #include "options/m_config.h"
+#include "osdep/atomic.h"
+#include "osdep/timer.h"
 #include "vo.h"
 #include "video/mp_image.h"
 #include "sub/osd.h"
@@ -52,6 +54,7 @@ struct gpu_priv {
     struct gl_video *renderer;
 
     int events;
+    atomic_bool lut3d_ready;
 };
 
 static void resize(struct vo *vo)
@@ -95,7 +98,17 @@ static void flip_page(struct vo *vo)
 {
     struct gpu_priv *p = vo->priv;
     struct ra_swapchain *sw = p->ctx->swapchain;
+    int64_t start = mp_time_us();
     sw->fns->swap_buffers(sw);
+    gl_video_trace_present(p->renderer, start, mp_time_us());
+}
+
+static void get_vsync(struct vo *vo, struct vo_vsync_info *info)
+{
+    struct gpu_priv *p = vo->priv;
+    struct ra_swapchain *sw = p->ctx->swapchain;
+    if (sw->fns->get_vsync)
+        sw->fns->get_vsync(sw, info);
 }
 
 static int query_format(struct vo *vo, int format)
@@ -202,12 +215,18 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_PERFORMANCE_DATA:
         gl_video_perfdata(p->renderer, (struct voctrl_performance_data *)data);
         return true;
+    case VOCTRL_TRIM_MEMORY:
+        gl_video_trim(p->renderer);
+        return true;
     case VOCTRL_EXTERNAL_RESIZE:
         p->ctx->fns->reconfig(p->ctx);
         resize(vo);
         return true;
     }
 
+    if (atomic_exchange(&p->lut3d_ready, false))
+        vo->want_redraw = true;
+
     int events = 0;
     int r = p->ctx->fns->control(p->ctx, &events, request, data);
     if (events & VO_EVENT_ICC_PROFILE_CHANGED) {
@@ -266,6 +285,14 @@ static void uninit(struct vo *vo)
     ra_ctx_destroy(&p->ctx);
 }
 
+static void lut3d_ready_cb(void *ctx)
+{
+    struct vo *vo = ctx;
+    struct gpu_priv *p = vo->priv;
+    atomic_store(&p->lut3d_ready, true);
+    vo_wakeup(vo);
+}
+
 static int preinit(struct vo *vo)
 {
     struct gpu_priv *p = vo->priv;
@@ -286,6 +313,7 @@ static int preinit(struct vo *vo)
     p->renderer = gl_video_init(p->ctx->ra, vo->log, vo->global);
     gl_video_set_osd_source(p->renderer, vo->osd);
     gl_video_configure_queue(p->renderer, vo);
+    gl_video_set_lut3d_cb(p->renderer, lut3d_ready_cb, vo);
 
     get_and_update_icc_profile(p);
 
@@ -294,6 +322,8 @@ static int preinit(struct vo *vo)
 
     gl_video_load_hwdecs(p->renderer, vo->hwdec_devs, false);
 
+    gl_video_warmup(p->renderer);
+
     return 0;
 
 err_out:
@@ -308,6 +338,10 @@ static const m_option_t options[] = {
     OPT_FLAG("gpu-debug", opts.debug, 0),
     OPT_FLAG("gpu-sw", opts.allow_sw, 0),
     OPT_INTRANGE("swapchain-depth", opts.swapchain_depth, 0, 1, 8),
+    OPT_CHOICE("swapchain-latency", opts.swapchain_latency, 0,
+               ({"auto", SWAPCHAIN_LATENCY_AUTO},
+                {"low", SWAPCHAIN_LATENCY_LOW},
+                {"high", SWAPCHAIN_LATENCY_HIGH})),
     {0}
 };
 
@@ -326,6 +360,7 @@ const struct vo_driver video_out_gpu = {
     .get_image = get_image,
     .draw_frame = draw_frame,
     .flip_page = flip_page,
+    .get_vsync = get_vsync,
     .wait_events = wait_events,
     .wakeup = wakeup,
     .uninit = uninit,
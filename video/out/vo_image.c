@@ -21,11 +21,14 @@
 #include <math.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
+#include <libavutil/cpu.h>
 #include <libswscale/swscale.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
@@ -63,11 +66,30 @@ static const struct m_sub_options vo_image_conf = {
     .size = sizeof(struct vo_image_opts),
 };
 
+// Upper bound for the number of encoder threads.
+#define MAX_THREADS 16
+
 struct priv {
     struct vo_image_opts *opts;
 
     struct mp_image *current;
     int frame;
+
+    // Images are encoded and written on the pool. At most max_pending images
+    // are queued or being written; flip_page() blocks if there are more.
+    struct mp_thread_pool *pool;
+    int max_pending;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int num_pending;            // protected by lock
+};
+
+struct write_item {
+    struct priv *p;
+    struct mp_log *log;
+    struct mp_image *img;
+    char *filename;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -104,6 +126,22 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, p->current);
 }
 
+static void write_item_fn(void *ctx)
+{
+    struct write_item *item = ctx;
+    struct priv *p = item->p;
+
+    mp_info(item->log, "Saving %s\n", item->filename);
+    write_image(item->img, p->opts->opts, item->filename, item->log);
+
+    pthread_mutex_lock(&p->lock);
+    p->num_pending -= 1;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    talloc_free(item);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -112,18 +150,32 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
+    // The file names are assigned here, so they follow the frame order, even
+    // if the files are written out of order.
+    struct write_item *item = talloc_zero(NULL, struct write_item);
+    item->p = p;
+    item->log = vo->log;
+    item->img = talloc_steal(item, p->current);
+    p->current = NULL;
+    item->filename = talloc_asprintf(item, "%08d.%s", p->frame,
                                      image_writer_file_ext(p->opts->opts));
 
     if (p->opts->outdir && strlen(p->opts->outdir))
-        filename = mp_path_join(t, p->opts->outdir, filename);
+        item->filename = mp_path_join(item, p->opts->outdir, item->filename);
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->log);
+    if (!p->pool) {
+        p->num_pending += 1; // decremented by write_item_fn()
+        write_item_fn(item);
+        return;
+    }
 
-    talloc_free(t);
-    mp_image_unrefp(&p->current);
+    pthread_mutex_lock(&p->lock);
+    while (p->num_pending >= p->max_pending)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    p->num_pending += 1;
+    pthread_mutex_unlock(&p->lock);
+
+    mp_thread_pool_queue(p->pool, write_item_fn, item);
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -137,15 +189,30 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    // Blocks until all queued images are written.
+    talloc_free(p->pool);
+    p->pool = NULL;
+
     mp_image_unrefp(&p->current);
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+
+    int threads = MPCLAMP(av_cpu_count(), 1, MAX_THREADS);
+    p->max_pending = threads * 2;
+    p->pool = mp_thread_pool_create(p, threads);
+    if (!p->pool)
+        MP_WARN(vo, "Failed to create encoder threads.\n");
     return 0;
 }
 
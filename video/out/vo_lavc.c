@@ -20,14 +20,23 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+
 #include "config.h"
 #include "common/common.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 #include "video/fmt-conversion.h"
+#include "video/hwdec.h"
 #include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "video/sws_utils.h"
 #include "mpv_talloc.h"
 #include "vo.h"
 
@@ -35,29 +44,195 @@
 
 #include "sub/osd.h"
 
+// Maximum number of frames queued for each encoder thread.
+#define RENDITION_QUEUE_SIZE 4
+
+// A video stream encoded on its own thread: the main stream, or an additional
+// --ovrenditions stream, which is encoded from scaled copies of the frames.
+struct rendition {
+    struct vo *vo;
+    struct encoder_context *enc;
+    int w, h;
+    struct mp_sws_context *sws;     // NULL for the main stream (no scaling)
+    struct mp_image_pool *pool;
+
+    pthread_t thread;
+    bool thread_valid;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    struct mp_image **queue;    // refs to the input frames (pts is the outpts)
+    int num_queue;
+    bool eof;                   // flush the encoder once the queue is empty
+    bool terminate;             // exit immediately
+};
+
 struct priv {
     struct encoder_context *enc;
 
+    // renditions[0] is the main stream (using enc).
+    struct rendition **renditions;
+    int num_renditions;
+
+    // Device for hardware encoders, which is also offered to the decoder and
+    // filters, so that hardware frames can be passed through.
+    struct mp_hwdec_ctx hwctx;
+    struct mp_hwdec_devices *hwdec_devs;
+
     bool shutdown;
 };
 
+static const struct {
+    enum AVPixelFormat pix_fmt;
+    enum AVHWDeviceType type;
+} hw_encoder_devices[] = {
+    {AV_PIX_FMT_VAAPI,  AV_HWDEVICE_TYPE_VAAPI},
+    {AV_PIX_FMT_CUDA,   AV_HWDEVICE_TYPE_CUDA},
+    {AV_PIX_FMT_NONE},
+};
+
+// If the encoder accepts hardware frames, create a device for it.
+static void init_hwdevice(struct vo *vo)
+{
+    struct priv *vc = vo->priv;
+    const enum AVPixelFormat *fmts = vc->enc->encoder->codec->pix_fmts;
+
+    for (int n = 0; fmts && fmts[n] != AV_PIX_FMT_NONE; n++) {
+        for (int i = 0; hw_encoder_devices[i].pix_fmt != AV_PIX_FMT_NONE; i++) {
+            if (hw_encoder_devices[i].pix_fmt != fmts[n])
+                continue;
+
+            enum AVHWDeviceType type = hw_encoder_devices[i].type;
+            const char *name = av_hwdevice_get_type_name(type);
+            if (av_hwdevice_ctx_create(&vc->hwctx.av_device_ref, type,
+                                       vc->enc->options->hwdevice, NULL, 0) < 0)
+            {
+                MP_WARN(vo, "Could not create %s device for the encoder.\n",
+                        name);
+                continue;
+            }
+
+            MP_VERBOSE(vo, "Using %s device for hardware frames.\n", name);
+            vc->hwctx.driver_name = name;
+            vc->hwctx.hw_imgfmt = pixfmt2imgfmt(fmts[n]);
+            vc->hwdec_devs = hwdec_devices_create();
+            hwdec_devices_add(vc->hwdec_devs, &vc->hwctx);
+            vo->hwdec_devs = vc->hwdec_devs;
+            return;
+        }
+    }
+}
+
+static void destroy_rendition(void *ptr)
+{
+    struct rendition *r = ptr;
+
+    assert(!r->thread_valid);
+    for (int n = 0; n < r->num_queue; n++)
+        talloc_free(r->queue[n]);
+    pthread_cond_destroy(&r->wakeup);
+    pthread_mutex_destroy(&r->lock);
+}
+
+static struct rendition *create_rendition(struct vo *vo,
+                                          struct encoder_context *enc)
+{
+    struct priv *vc = vo->priv;
+
+    struct rendition *r = talloc_zero(vc, struct rendition);
+    talloc_set_destructor(r, destroy_rendition);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wakeup, NULL);
+    r->vo = vo;
+    r->enc = talloc_steal(r, enc);
+    MP_TARRAY_APPEND(vc, vc->renditions, vc->num_renditions, r);
+    return r;
+}
+
+// Parse "<w>x<h>[@<bitrate>]".
+static bool add_rendition(struct vo *vo, const char *spec)
+{
+    struct priv *vc = vo->priv;
+
+    int w, h, len = 0;
+    if (sscanf(spec, "%dx%d%n", &w, &h, &len) != 2 || w < 2 || h < 2 ||
+        (spec[len] && spec[len] != '@'))
+    {
+        MP_FATAL(vo, "Invalid rendition '%s'.\n", spec);
+        return false;
+    }
+
+    struct encoder_context *enc =
+        encoder_context_alloc(vo->encode_lavc_ctx, STREAM_VIDEO, vo->log);
+    if (!enc)
+        return false;
+    enc->rendition = vc->num_renditions;
+
+    struct rendition *r = create_rendition(vo, enc);
+    r->w = w;
+    r->h = h;
+    if (spec[len] == '@') {
+        r->enc->extra_opts = talloc_array(r, char *, 3);
+        r->enc->extra_opts[0] = "b";
+        r->enc->extra_opts[1] = talloc_strdup(r, spec + len + 1);
+        r->enc->extra_opts[2] = NULL;
+    }
+
+    r->sws = mp_sws_alloc(r);
+    mp_sws_set_from_cmdline(r->sws, vo->global);
+    r->pool = mp_image_pool_new(r);
+    return true;
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
     vc->enc = encoder_context_alloc(vo->encode_lavc_ctx, STREAM_VIDEO, vo->log);
     if (!vc->enc)
         return -1;
-    talloc_steal(vc, vc->enc);
+    create_rendition(vo, vc->enc);
+
+    char **renditions = vc->enc->options->vrenditions;
+    for (int n = 0; renditions && renditions[n]; n++) {
+        if (!add_rendition(vo, renditions[n]))
+            return -1;
+    }
+
+    // The renditions are scaled in software, so hardware frames can't be
+    // passed through.
+    if (vc->num_renditions == 1)
+        init_hwdevice(vo);
     return 0;
 }
 
+static void stop_rendition(struct rendition *r, bool flush)
+{
+    if (!r->thread_valid)
+        return;
+    pthread_mutex_lock(&r->lock);
+    if (flush) {
+        r->eof = true;
+    } else {
+        r->terminate = true;
+    }
+    pthread_cond_broadcast(&r->wakeup);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    r->thread_valid = false;
+}
+
 static void uninit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
-    struct encoder_context *enc = vc->enc;
 
-    if (!vc->shutdown)
-        encoder_encode(enc, NULL); // finish encoding
+    for (int n = 0; n < vc->num_renditions; n++)
+        stop_rendition(vc->renditions[n], !vc->shutdown);
+
+    if (vc->hwdec_devs) {
+        hwdec_devices_remove(vc->hwdec_devs, &vc->hwctx);
+        hwdec_devices_destroy(vc->hwdec_devs);
+    }
+    av_buffer_unref(&vc->hwctx.av_device_ref);
 }
 
 static void on_ready(void *ptr)
@@ -67,6 +242,132 @@ static void on_ready(void *ptr)
     vo_event(vo, VO_EVENT_INITIAL_UNBLOCK);
 }
 
+static void encode_rendition_frame(struct rendition *r, struct mp_image *img)
+{
+    AVCodecContext *avc = r->enc->encoder;
+
+    AVFrame *frame;
+    if (r->sws) {
+        struct mp_image *dst =
+            mp_image_pool_get(r->pool, img->imgfmt, r->w, r->h);
+        if (!dst) {
+            MP_ERR(r->vo, "Could not allocate rendition frame.\n");
+            return;
+        }
+        mp_image_copy_attributes(dst, img);
+        dst->params.p_w = avc->sample_aspect_ratio.num;
+        dst->params.p_h = avc->sample_aspect_ratio.den;
+
+        if (mp_sws_scale(r->sws, dst, img) < 0) {
+            MP_ERR(r->vo, "Scaling rendition frame failed.\n");
+            talloc_free(dst);
+            return;
+        }
+
+        frame = mp_image_to_av_frame_and_unref(dst);
+    } else {
+        frame = mp_image_to_av_frame(img);
+    }
+    if (!frame)
+        abort();
+
+    frame->pts = rint(img->pts * av_q2d(av_inv_q(avc->time_base)));
+    frame->pict_type = 0; // keep this at unknown/undefined
+    frame->quality = avc->global_quality;
+    encoder_encode(r->enc, frame);
+    av_frame_free(&frame);
+}
+
+static void *rendition_thread(void *ptr)
+{
+    struct rendition *r = ptr;
+    mpthread_set_name(r->sws ? "lavc-rendition" : "lavc-encode");
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->terminate) {
+        if (r->num_queue) {
+            struct mp_image *img = r->queue[0];
+            MP_TARRAY_REMOVE_AT(r->queue, r->num_queue, 0);
+            int depth = r->num_queue;
+            pthread_cond_broadcast(&r->wakeup);
+            pthread_mutex_unlock(&r->lock);
+
+            encoder_set_queue_depth(r->enc, depth);
+            encode_rendition_frame(r, img);
+            talloc_free(img);
+
+            pthread_mutex_lock(&r->lock);
+            continue;
+        }
+        if (r->eof) {
+            pthread_mutex_unlock(&r->lock);
+            encoder_encode(r->enc, NULL); // finish encoding
+            pthread_mutex_lock(&r->lock);
+            break;
+        }
+        pthread_cond_wait(&r->wakeup, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+// Pass a new reference of the frame to the encoder thread. Blocks if the
+// thread is behind.
+static void queue_rendition_frame(struct rendition *r, struct mp_image *mpi,
+                                  double outpts)
+{
+    struct mp_image *img = mp_image_new_ref(mpi);
+    if (!img)
+        abort();
+    img->pts = outpts;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->num_queue >= RENDITION_QUEUE_SIZE)
+        pthread_cond_wait(&r->wakeup, &r->lock);
+    MP_TARRAY_APPEND(r, r->queue, r->num_queue, img);
+    int depth = r->num_queue;
+    pthread_cond_broadcast(&r->wakeup);
+    pthread_mutex_unlock(&r->lock);
+
+    encoder_set_queue_depth(r->enc, depth);
+}
+
+static bool start_rendition_thread(struct rendition *r)
+{
+    if (pthread_create(&r->thread, NULL, rendition_thread, r)) {
+        MP_FATAL(r->vo, "Could not create encoder thread.\n");
+        return false;
+    }
+    r->thread_valid = true;
+    return true;
+}
+
+// Open the encoder of a rendition (with the same settings as the main encoder,
+// but the rendition's size).
+static bool init_rendition(struct vo *vo, struct rendition *r)
+{
+    struct priv *vc = vo->priv;
+    AVCodecContext *src = vc->enc->encoder;
+    AVCodecContext *encoder = r->enc->encoder;
+
+    // Keep the display aspect ratio of the main stream.
+    AVRational aspect = src->sample_aspect_ratio;
+    if (!aspect.num || !aspect.den)
+        aspect = (AVRational){1, 1};
+    av_reduce(&encoder->sample_aspect_ratio.num,
+              &encoder->sample_aspect_ratio.den,
+              (int64_t)aspect.num * src->width * r->h,
+              (int64_t)aspect.den * src->height * r->w, INT_MAX);
+    encoder->width = r->w;
+    encoder->height = r->h;
+    encoder->pix_fmt = src->pix_fmt;
+    encoder->colorspace = src->colorspace;
+    encoder->color_range = src->color_range;
+    encoder->time_base = src->time_base;
+
+    return encoder_init_codec_and_muxer(r->enc, NULL, NULL);
+}
+
 static int reconfig2(struct vo *vo, struct mp_image *img)
 {
     struct priv *vc = vo->priv;
@@ -116,6 +417,20 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
     encoder->colorspace = mp_csp_to_avcol_spc(params->color.space);
     encoder->color_range = mp_csp_levels_to_avcol_range(params->color.levels);
 
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        // The encoder reads the surfaces from the frames' pool directly.
+        if (!img->hwctx) {
+            MP_FATAL(vo, "Hardware frames without frames context.\n");
+            goto error;
+        }
+        AVHWFramesContext *fctx = (void *)img->hwctx->data;
+        encoder->hw_frames_ctx = av_buffer_ref(img->hwctx);
+        if (!encoder->hw_frames_ctx)
+            goto error;
+        encoder->sw_pix_fmt = fctx->sw_format;
+    }
+
     AVRational tb;
 
     // we want to handle:
@@ -137,6 +452,16 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
     if (!encoder_init_codec_and_muxer(vc->enc, on_ready, vo))
         goto error;
 
+    for (int n = 1; n < vc->num_renditions; n++) {
+        if (!init_rendition(vo, vc->renditions[n]))
+            goto error;
+    }
+
+    for (int n = 0; n < vc->num_renditions; n++) {
+        if (!start_rendition_thread(vc->renditions[n]))
+            goto error;
+    }
+
     return 0;
 
 error:
@@ -148,6 +473,10 @@ static int query_format(struct vo *vo, int format)
 {
     struct priv *vc = vo->priv;
 
+    // Hardware frames are accepted only from our own device.
+    if (IMGFMT_IS_HWACCEL(format) && format != vc->hwctx.hw_imgfmt)
+        return 0;
+
     enum AVPixelFormat pix_fmt = imgfmt2pixfmt(format);
     const enum AVPixelFormat *p = vc->enc->encoder->codec->pix_fmts;
 
@@ -175,8 +504,11 @@ static void draw_frame(struct vo *vo, struct vo_frame *voframe)
 
     struct mp_image *mpi = voframe->frames[0];
 
-    struct mp_osd_res dim = osd_res_from_image_params(vo->params);
-    osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, mpi);
+    // Can't render subtitles into hardware surfaces.
+    if (!mpi->hwctx) {
+        struct mp_osd_res dim = osd_res_from_image_params(vo->params);
+        osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, mpi);
+    }
 
     if (vc->shutdown)
         return;
@@ -216,15 +548,8 @@ static void draw_frame(struct vo *vo, struct vo_frame *voframe)
 
     pthread_mutex_unlock(&ectx->lock);
 
-    AVFrame *frame = mp_image_to_av_frame(mpi);
-    if (!frame)
-        abort();
-
-    frame->pts = rint(outpts * av_q2d(av_inv_q(avc->time_base)));
-    frame->pict_type = 0; // keep this at unknown/undefined
-    frame->quality = avc->global_quality;
-    encoder_encode(enc, frame);
-    av_frame_free(&frame);
+    for (int n = 0; n < vc->num_renditions; n++)
+        queue_rendition_frame(vc->renditions[n], mpi, outpts);
 }
 
 static void flip_page(struct vo *vo)
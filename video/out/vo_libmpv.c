@@ -83,6 +83,7 @@ struct mpv_render_context {
     struct vo_frame *next_frame;    // next frame to draw
     int64_t present_count;          // incremented when next frame can be shown
     int64_t expected_flip_count;    // next vsync event for next_frame
+    int max_pending_swaps;          // MPV_RENDER_PARAM_MAX_PENDING_SWAPS
     bool redrawing;                 // next_frame was a redraw request
     int64_t flip_count;
     struct vo_frame *cur_frame;
@@ -108,6 +109,7 @@ struct mpv_render_context {
 
 const struct render_backend_fns *render_backends[] = {
     &render_backend_gpu,
+    &render_backend_sw,
     NULL
 };
 
@@ -174,6 +176,10 @@ int mpv_render_context_create(mpv_render_context **res, mpv_handle *mpv,
     ctx->vo_opts_cache = m_config_cache_alloc(ctx, ctx->global, &vo_sub_opts);
     ctx->vo_opts = ctx->vo_opts_cache->opts;
 
+    int pending = GET_MPV_RENDER_PARAM(params, MPV_RENDER_PARAM_MAX_PENDING_SWAPS,
+                                       int, 1);
+    ctx->max_pending_swaps = MPCLAMP(pending, 1, 8);
+
     if (GET_MPV_RENDER_PARAM(params, MPV_RENDER_PARAM_ADVANCED_CONTROL, int, 0)) {
         ctx->advanced_control = true;
         ctx->dispatch = mp_dispatch_create(ctx);
@@ -441,9 +447,67 @@ uint64_t mpv_render_context_update(mpv_render_context *ctx)
 int mpv_render_context_set_parameter(mpv_render_context *ctx,
                                      mpv_render_param param)
 {
+    if (param.type == MPV_RENDER_PARAM_MAX_PENDING_SWAPS) {
+        int v = *(int *)param.data;
+        if (v < 1 || v > 8)
+            return MPV_ERROR_INVALID_PARAMETER;
+        pthread_mutex_lock(&ctx->lock);
+        ctx->max_pending_swaps = v;
+        pthread_cond_broadcast(&ctx->video_wait);
+        pthread_mutex_unlock(&ctx->lock);
+        return 0;
+    }
+
     return ctx->renderer->fns->set_parameter(ctx->renderer, param);
 }
 
+static void get_frame_schedule(struct vo_frame *frame,
+                               mpv_render_frame_schedule *sched)
+{
+    *sched = (mpv_render_frame_schedule){0};
+    if (!frame)
+        return;
+
+    sched->vsync_interval = frame->vsync_interval > 0 ? frame->vsync_interval : 0;
+    sched->num_frames = 1;
+    sched->frames[0] = (mpv_render_frame_timing){
+        .target_time = frame->pts,
+        .duration = frame->duration,
+        .num_vsyncs = frame->display_synced ? frame->num_vsyncs : 0,
+    };
+
+    if (frame->redraw || !frame->current || frame->num_frames < 1)
+        return;
+
+    // Convert video timestamps to realtime with the ratio given by the
+    // duration of the current frame (which includes the playback speed).
+    double pts0 = frame->frames[0]->pts;
+    double scale = 0;
+    if (frame->num_frames > 1 && frame->duration > 0 &&
+        pts0 != MP_NOPTS_VALUE && frame->frames[1]->pts != MP_NOPTS_VALUE &&
+        frame->frames[1]->pts > pts0)
+        scale = frame->duration / (frame->frames[1]->pts - pts0);
+
+    int num = MPMIN(frame->num_frames, MPV_RENDER_FRAME_SCHEDULE_MAX);
+    for (int n = 0; n < num; n++) {
+        mpv_render_frame_timing *t = &sched->frames[n];
+        double pts = frame->frames[n]->pts;
+        if (pts != MP_NOPTS_VALUE)
+            t->pts = pts;
+        if (n == 0)
+            continue;
+        t->duration = -1;
+        if (scale > 0 && pts != MP_NOPTS_VALUE) {
+            if (frame->pts > 0)
+                t->target_time = frame->pts + llrint((pts - pts0) * scale);
+            if (n + 1 < frame->num_frames &&
+                frame->frames[n + 1]->pts != MP_NOPTS_VALUE)
+                t->duration = llrint((frame->frames[n + 1]->pts - pts) * scale);
+        }
+    }
+    sched->num_frames = num;
+}
+
 int mpv_render_context_get_info(mpv_render_context *ctx,
                                 mpv_render_param param)
 {
@@ -467,6 +531,10 @@ int mpv_render_context_get_info(mpv_render_context *ctx,
         res = 0;
         break;
     }
+    case MPV_RENDER_PARAM_FRAME_SCHEDULE:
+        get_frame_schedule(ctx->next_frame, param.data);
+        res = 0;
+        break;
     default:;
     }
 
@@ -482,7 +550,10 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     pthread_mutex_lock(&ctx->lock);
     assert(!ctx->next_frame);
     ctx->next_frame = vo_frame_ref(frame);
-    ctx->expected_flip_count = ctx->flip_count + 1;
+    // With max_pending_swaps > 1, flip_count can lag behind the frames
+    // rendered so far.
+    ctx->expected_flip_count = MPMAX(ctx->flip_count,
+                                     ctx->expected_flip_count) + 1;
     ctx->redrawing = frame->redraw || !frame->current;
     pthread_mutex_unlock(&ctx->lock);
 
@@ -515,14 +586,20 @@ static void flip_page(struct vo *vo)
     if (ctx->redrawing)
         goto done; // do not block for redrawing
 
-    // Wait until frame was presented
-    while (ctx->expected_flip_count > ctx->flip_count) {
+    // Wait until frame was presented (or enough of the previous frames, if
+    // the API user allows queuing more).
+    while (ctx->expected_flip_count >
+           ctx->flip_count + ctx->max_pending_swaps - 1)
+    {
         // mpv_render_report_swap() is declared as optional API.
         // Assume the user calls it consistently _if_ it's called at all.
         if (!ctx->flip_count)
             break;
         if (pthread_cond_timedwait(&ctx->video_wait, &ctx->lock, &ts)) {
             MP_VERBOSE(vo, "mpv_render_report_swap() not being called.\n");
+            // Resync, so the following frames don't wait for swaps that
+            // will never be reported.
+            ctx->expected_flip_count = ctx->flip_count;
             goto done;
         }
     }
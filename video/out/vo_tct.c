@@ -25,7 +25,9 @@
 
 #include <libswscale/swscale.h>
 
+#include "misc/bstr.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 #include "config.h"
 #include "vo.h"
 #include "sub/osd.h"
@@ -41,6 +43,7 @@
 #define ESC_CLEAR_SCREEN "\e[2J"
 #define ESC_CLEAR_COLORS "\e[0m"
 #define ESC_GOTOXY "\e[%d;%df"
+#define ESC_CURSOR_FORWARD "\e[%dC"
 #define ESC_COLOR_BG "\e[48;2;%d;%d;%dm"
 #define ESC_COLOR_FG "\e[38;2;%d;%d;%dm"
 #define ESC_COLOR256_BG "\e[48;5;%dm"
@@ -53,6 +56,7 @@ struct vo_tct_opts {
     int width;   // 0 -> default
     int height;  // 0 -> default
     int term256;  // 0 -> true color
+    double redraw_interval; // 0 -> only write changed cells
 };
 
 #define OPT_BASE_STRUCT struct vo_tct_opts
@@ -64,18 +68,30 @@ static const struct m_sub_options vo_tct_conf = {
         OPT_INT("vo-tct-width", width, 0),
         OPT_INT("vo-tct-height", height, 0),
         OPT_FLAG("vo-tct-256", term256, 0),
+        OPT_DOUBLE("vo-tct-redraw-interval", redraw_interval, M_OPT_MIN, .min = 0),
         {0}
     },
     .defaults = &(const struct vo_tct_opts) {
         .algo = ALGO_HALF_BLOCKS,
+        .redraw_interval = 5,
     },
     .size = sizeof(struct vo_tct_opts),
 };
 
+// One character on the terminal.
+struct cell {
+    uint32_t bg, fg;    // 0xRRGGBB, or the xterm-256 index with term256
+};
+
 struct priv {
     struct vo_tct_opts *opts;
-    size_t buffer_size;
-    char *buffer;
+    bstr out;                   // terminal output of the current frame
+    struct cell *cells;         // swidth * sheight, current frame
+    struct cell *prev_cells;    // what was last written to the terminal
+    bool prev_valid;
+    int64_t last_full_redraw;   // mp_time_us() of the last full redraw
+    uint8_t x256_ci[256];       // value -> nearest xterm-256 cube index
+    int x256_cerr[256];         // value -> square error of that cube index
     int swidth;
     int sheight;
     struct mp_image *frame;
@@ -90,89 +106,129 @@ struct priv {
 // input is the exact middle:
 // - The r/g/b channels and the gray value: the higher value output is chosen.
 // - If the gray and color have same distance from the input - color is chosen.
-static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
+// The per-channel part of the color cube distance is separable, and comes from
+// the tables set up by init_x256().
+static int rgb_to_x256(struct priv *p, uint8_t r, uint8_t g, uint8_t b)
 {
-    // Calculate the nearest 0-based color index at 16 .. 231
-#   define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
-    int ir = v2ci(r), ig = v2ci(g), ib = v2ci(b);   // 0..5 each
-#   define color_index() (36 * ir + 6 * ig + ib)  /* 0..215, lazy evaluation */
+    // Nearest 0-based color index at 16 .. 231, and its distance
+    int color_index = 36 * p->x256_ci[r] + 6 * p->x256_ci[g] + p->x256_ci[b];
+    int color_err = p->x256_cerr[r] + p->x256_cerr[g] + p->x256_cerr[b];
 
     // Calculate the nearest 0-based gray index at 232 .. 255
     int average = (r + g + b) / 3;
     int gray_index = average > 238 ? 23 : (average - 3) / 10;  // 0..23
-
-    // Calculate the represented colors back from the index
-    static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
-    int cr = i2cv[ir], cg = i2cv[ig], cb = i2cv[ib];  // r/g/b, 0..255 each
     int gv = 8 + 10 * gray_index;  // same value for r/g/b, 0..255
 
     // Return the one which is nearer to the original input rgb value
-#   define dist_square(A,B,C, a,b,c) ((A-a)*(A-a) + (B-b)*(B-b) + (C-c)*(C-c))
-    int color_err = dist_square(cr, cg, cb, r, g, b);
-    int gray_err  = dist_square(gv, gv, gv, r, g, b);
-    return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
+    int gray_err = (gv - r) * (gv - r) + (gv - g) * (gv - g) + (gv - b) * (gv - b);
+    return color_err <= gray_err ? 16 + color_index : 232 + gray_index;
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static void init_x256(struct priv *p)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
+    static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+    for (int v = 0; v < 256; v++) {
+        int ci = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40; // 0..5
+        p->x256_ci[v] = ci;
+        p->x256_cerr[v] = (i2cv[ci] - v) * (i2cv[ci] - v);
+    }
+}
+
+// Convert the frame to p->cells.
+static void fill_cells(struct priv *p)
+{
+    bool half_blocks = p->opts->algo != ALGO_PLAIN;
+    bool term256 = p->opts->term256;
+    // Adjacent pixels are often equal, so reuse the last conversion.
+    uint32_t last_rgb = 0;
+    int last_x256 = rgb_to_x256(p, 0, 0, 0);
+
+    for (int y = 0; y < p->sheight; y++) {
+        int src_y = half_blocks ? y * 2 : y;
+        const uint8_t *rows[2] = {
+            p->frame->planes[0] + src_y * p->frame->stride[0],
+            p->frame->planes[0] + (src_y + 1) * p->frame->stride[0],
+        };
+        struct cell *line = &p->cells[y * p->swidth];
+        for (int x = 0; x < p->swidth; x++) {
+            uint32_t c[2] = {0};
+            for (int n = 0; n < (half_blocks ? 2 : 1); n++) {
+                const uint8_t *px = rows[n] + x * 3;
+                uint32_t rgb = (px[2] << 16) | (px[1] << 8) | px[0];
+                if (term256) {
+                    if (rgb != last_rgb) {
+                        last_rgb = rgb;
+                        last_x256 = rgb_to_x256(p, px[2], px[1], px[0]);
+                    }
+                    rgb = last_x256;
+                }
+                c[n] = rgb;
             }
-            printf(" ");
+            line[x] = (struct cell){ .bg = c[0], .fg = c[1] };
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+static void append_color(struct priv *p, bool fg, uint32_t c)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
+    if (p->opts->term256) {
+        bstr_xappend_asprintf(p, &p->out, fg ? ESC_COLOR256_FG : ESC_COLOR256_BG,
+                              (int)c);
+    } else {
+        bstr_xappend_asprintf(p, &p->out, fg ? ESC_COLOR_FG : ESC_COLOR_BG,
+                              (int)(c >> 16), (int)((c >> 8) & 0xFF),
+                              (int)(c & 0xFF));
+    }
+}
+
+// Write the cells which differ from what is on the terminal (p->prev_cells)
+// to p->out. Unchanged cells are skipped with cursor movement, and colors are
+// only set if they differ from the previously written cell.
+static void write_cells(struct vo *vo, bool full)
+{
+    struct priv *p = vo->priv;
+    bool half_blocks = p->opts->algo != ALGO_PLAIN;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+    int cur_x = -1, cur_y = -1;
+    bool have_color = false;
+    struct cell color = {0};
+
+    for (int y = 0; y < p->sheight; y++) {
+        for (int x = 0; x < p->swidth; x++) {
+            struct cell *c = &p->cells[y * p->swidth + x];
+            struct cell *prev = &p->prev_cells[y * p->swidth + x];
+            if (!full && c->bg == prev->bg && (!half_blocks || c->fg == prev->fg))
+                continue;
+            if (y != cur_y || x < cur_x) {
+                bstr_xappend_asprintf(p, &p->out, ESC_GOTOXY, ty + y, tx + x);
+            } else if (x > cur_x) {
+                bstr_xappend_asprintf(p, &p->out, ESC_CURSOR_FORWARD, x - cur_x);
+            }
+            if (!have_color || c->bg != color.bg)
+                append_color(p, false, c->bg);
+            if (half_blocks && (!have_color || c->fg != color.fg))
+                append_color(p, true, c->fg);
+            have_color = true;
+            color = *c;
+            if (half_blocks) {
+                // UTF8 bytes of U+2584 (lower half block)
+                bstr_xappend(p, &p->out, bstr0("\xe2\x96\x84"));
             } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
+                bstr_xappend(p, &p->out, bstr0(" "));
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            cur_x = x + 1;
+            cur_y = y;
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+
+    if (have_color) {
+        bstr_xappend(p, &p->out, bstr0(ESC_CLEAR_COLORS));
+        // Leave the cursor below the image, for the terminal status line.
+        bstr_xappend_asprintf(p, &p->out, ESC_GOTOXY, ty + p->sheight, 0);
+    }
+
+    MPSWAP(struct cell *, p->cells, p->prev_cells);
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -204,8 +260,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->swidth = p->dst.x1 - p->dst.x0;
     p->sheight = p->dst.y1 - p->dst.y0;
 
-    if (p->buffer)
-        free(p->buffer);
+    talloc_free(p->cells);
+    talloc_free(p->prev_cells);
+    p->cells = talloc_zero_array(p, struct cell, p->swidth * p->sheight);
+    p->prev_cells = talloc_zero_array(p, struct cell, p->swidth * p->sheight);
+    p->prev_valid = false;
 
     mp_sws_set_from_cmdline(p->sws, vo->global);
     p->sws->src = *params;
@@ -218,6 +277,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     };
 
     const int mul = (p->opts->algo == ALGO_PLAIN ? 1 : 2);
+    talloc_free(p->frame);
     p->frame = mp_image_alloc(IMGFMT, p->swidth, p->sheight * mul);
     if (!p->frame)
         return -1;
@@ -243,18 +303,24 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
+    fill_cells(p);
+
+    // Other terminal output (like log messages) can scroll or overwrite the
+    // image, so do a full redraw now and then.
+    int64_t now = mp_time_us();
+    double interval = p->opts->redraw_interval;
+    bool full = !p->prev_valid ||
+        (interval > 0 && now - p->last_full_redraw >= interval * 1e6);
+    if (full)
+        p->last_full_redraw = now;
+
+    p->out.len = 0;
+    write_cells(vo, full);
+    p->prev_valid = true;
+    if (p->out.len) {
+        fwrite(p->out.start, p->out.len, 1, stdout);
+        fflush(stdout);
     }
-    fflush(stdout);
 }
 
 static void uninit(struct vo *vo)
@@ -263,8 +329,7 @@ static void uninit(struct vo *vo)
     printf(ESC_CLEAR_SCREEN);
     printf(ESC_GOTOXY, 0, 0);
     struct priv *p = vo->priv;
-    if (p->buffer)
-        talloc_free(p->buffer);
+    talloc_free(p->frame);
     if (p->sws)
         talloc_free(p->sws);
 }
@@ -278,6 +343,7 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_tct_conf);
     p->sws = mp_sws_alloc(vo);
+    init_x256(p);
     return 0;
 }
 
@@ -33,6 +33,7 @@
 #include <X11/Xutil.h>
 
 #include <errno.h>
+#include <poll.h>
 
 #include "x11_common.h"
 
@@ -51,12 +52,16 @@
 #include "options/options.h"
 #include "osdep/timer.h"
 
+// Number of XImages. While the X server copies one image to the window, the
+// next frame can be rendered into another one.
+#define BUF_COUNT 3
+
 struct priv {
     struct vo *vo;
 
     struct mp_image *original_image;
 
-    XImage *myximage[2];
+    XImage *myximage[BUF_COUNT];
     int depth;
     GC gc;
 
@@ -77,11 +82,12 @@ struct priv {
     bool reset_view;
 
     int Shmem_Flag;
-    XShmSegmentInfo Shminfo[2];
+    XShmSegmentInfo Shminfo[BUF_COUNT];
     int Shm_Warned_Slow;
 };
 
 static bool resize(struct vo *vo);
+static void wait_for_completion(struct vo *vo, int max_outstanding);
 
 static bool getMyXImage(struct priv *p, int foo)
 {
@@ -199,7 +205,9 @@ static bool resize(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    for (int i = 0; i < 2; i++)
+    // The X server might still be reading from the images.
+    wait_for_completion(vo, 0);
+    for (int i = 0; i < BUF_COUNT; i++)
         freeMyXImage(p, i);
 
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
@@ -224,7 +232,7 @@ static bool resize(struct vo *vo)
     p->image_width = (p->dst_w + 7) & (~7);
     p->image_height = p->dst_h;
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < BUF_COUNT; i++) {
         if (!getMyXImage(p, i))
             return false;
     }
@@ -301,14 +309,18 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
     struct priv *ctx = vo->priv;
     struct vo_x11_state *x11 = vo->x11;
     if (ctx->Shmem_Flag) {
-        while (x11->ShmCompletionWaitCount > max_outstanding) {
-            if (!ctx->Shm_Warned_Slow) {
+        while (1) {
+            vo_x11_check_events(vo);
+            if (x11->ShmCompletionWaitCount <= max_outstanding)
+                break;
+            if (!ctx->Shm_Warned_Slow && max_outstanding > 0) {
                 MP_WARN(vo, "can't keep up! Waiting"
                             " for XShm completion events...\n");
                 ctx->Shm_Warned_Slow = 1;
             }
-            mp_sleep_us(1000);
-            vo_x11_check_events(vo);
+            // Block until the X server sends something, instead of polling.
+            struct pollfd fd = { .fd = x11->event_fd, .events = POLLIN };
+            poll(&fd, 1, 100);
         }
     }
 }
@@ -317,7 +329,8 @@ static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     Display_Image(p, p->myximage[p->current_buf]);
-    p->current_buf = (p->current_buf + 1) % 2;
+    XFlush(vo->x11->display);
+    p->current_buf = (p->current_buf + 1) % BUF_COUNT;
 }
 
 // Note: REDRAW_FRAME can call this with NULL.
@@ -325,7 +338,9 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    wait_for_completion(vo, 1);
+    // The buffer to render into is the oldest one, so this only blocks if the
+    // X server is behind by more than BUF_COUNT - 1 frames.
+    wait_for_completion(vo, BUF_COUNT - 1);
 
     struct mp_image img = get_x_buffer(p, p->current_buf);
 
@@ -359,10 +374,12 @@ static int query_format(struct vo *vo, int format)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->myximage[0])
-        freeMyXImage(p, 0);
-    if (p->myximage[1])
-        freeMyXImage(p, 1);
+    if (vo->x11)
+        wait_for_completion(vo, 0);
+    for (int i = 0; i < BUF_COUNT; i++) {
+        if (p->myximage[i])
+            freeMyXImage(p, i);
+    }
     if (p->gc)
         XFreeGC(vo->x11->display, p->gc);
 
@@ -16,9 +16,12 @@
  */
 
 #include "options/m_config.h"
+#include "options/path.h"
 #include "video/out/gpu/spirv.h"
+#include "video/out/gpu/video.h"
 
 #include "context.h"
+#include "malloc.h"
 #include "ra_vk.h"
 #include "utils.h"
 
@@ -276,6 +279,23 @@ void ra_vk_ctx_uninit(struct ra_ctx *ctx)
 
 static const struct ra_swapchain_fns vulkan_swapchain;
 
+static bool mode_supported(struct mpvk_ctx *vk, VkPresentModeKHR mode)
+{
+    bool supported = false;
+    uint32_t num_modes = 0;
+    VkResult res = vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physd,
+                                                     vk->surf, &num_modes, NULL);
+    if (res != VK_SUCCESS)
+        return false;
+    VkPresentModeKHR *modes = talloc_array(NULL, VkPresentModeKHR, num_modes);
+    res = vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physd, vk->surf,
+                                                    &num_modes, modes);
+    for (int i = 0; res == VK_SUCCESS && i < num_modes; i++)
+        supported |= modes[i] == mode;
+    talloc_free(modes);
+    return supported;
+}
+
 bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
                     VkPresentModeKHR preferred_mode)
 {
@@ -297,7 +317,16 @@ bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
     if (!mpvk_device_init(vk, p->opts->dev_opts))
         goto error;
 
-    ctx->ra = ra_create_vk(vk, ctx->log);
+    // The pipeline cache is stored next to the shader cache.
+    struct gl_video_opts *gl_opts =
+        mp_get_config_group(NULL, ctx->global, &gl_video_conf);
+    char *cache_dir = NULL;
+    if (gl_opts->shader_cache_dir && gl_opts->shader_cache_dir[0]) {
+        cache_dir = mp_get_user_path(gl_opts, ctx->global,
+                                     gl_opts->shader_cache_dir);
+    }
+    ctx->ra = ra_create_vk(vk, ctx->log, cache_dir);
+    talloc_free(gl_opts);
     if (!ctx->ra)
         goto error;
 
@@ -308,6 +337,18 @@ bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
         [SWAP_IMMEDIATE]    = VK_PRESENT_MODE_IMMEDIATE_KHR,
     };
 
+    switch (ctx->opts.swapchain_latency) {
+    case SWAPCHAIN_LATENCY_LOW:
+        // Replaces queued images instead of waiting for a vsync to free up
+        // one; falls back to the backend's default if unsupported.
+        if (mode_supported(vk, VK_PRESENT_MODE_MAILBOX_KHR))
+            preferred_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+        break;
+    case SWAPCHAIN_LATENCY_HIGH:
+        preferred_mode = VK_PRESENT_MODE_FIFO_KHR; // always supported
+        break;
+    }
+
     p->protoInfo = (VkSwapchainCreateInfoKHR) {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = vk->surf,
@@ -322,18 +363,7 @@ bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
     };
 
     // Make sure the swapchain present mode is supported
-    int num_modes;
-    VK(vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physd, vk->surf,
-                                                 &num_modes, NULL));
-    VkPresentModeKHR *modes = talloc_array(NULL, VkPresentModeKHR, num_modes);
-    VK(vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physd, vk->surf,
-                                                 &num_modes, modes));
-    bool supported = false;
-    for (int i = 0; i < num_modes; i++)
-        supported |= (modes[i] == p->protoInfo.presentMode);
-    talloc_free(modes);
-
-    if (!supported) {
+    if (!mode_supported(vk, p->protoInfo.presentMode)) {
         MP_ERR(ctx, "Requested swap mode unsupported by this device!\n");
         goto error;
     }
@@ -534,6 +564,8 @@ static bool submit_frame(struct ra_swapchain *sw, const struct vo_frame *frame)
     if (!mpvk_flush_commands(vk))
         return false;
 
+    vk_malloc_garbage_collect(vk);
+
     // Submit to the same queue that we were currently rendering to
     struct vk_cmdpool *pool_gfx = vk->pool_graphics;
     VkQueue queue = pool_gfx->queues[pool_gfx->idx_queues];
@@ -22,6 +22,11 @@
 // device. (Default: 512 MB)
 #define MPVK_HEAP_MAXIMUM_SLAB_SIZE (1 << 29)
 
+// Controls how long a slab must be completely unused before it's given back to
+// the device by vk_malloc_garbage_collect(). Keeping it around for a while
+// avoids reallocating it on e.g. every resize. (Default: 5 seconds)
+#define MPVK_HEAP_SLAB_GC_TIMEOUT (5 * 1000 * 1000)
+
 // Controls the minimum free region size, to reduce thrashing the free space
 // map with lots of small buffers during uninit. (Default: 1 KB)
 #define MPVK_HEAP_MINIMUM_REGION_SIZE (1 << 10)
@@ -45,6 +50,7 @@ struct vk_slab {
     size_t size;          // total size of `slab`
     size_t used;          // number of bytes actually in use (for GC accounting)
     bool dedicated;       // slab is allocated specifically for one object
+    int64_t unused_since; // mp_time_us() when `used` dropped to 0
     // free space map: a sorted list of memory regions that are available
     struct vk_region *regions;
     int num_regions;
@@ -72,6 +78,9 @@ struct vk_malloc {
     VkPhysicalDeviceMemoryProperties props;
     struct vk_heap *heaps;
     int num_heaps;
+    // dedicated slabs are not part of any heap
+    int num_dedicated;
+    size_t dedicated_size;
 };
 
 static void slab_free(struct mpvk_ctx *vk, struct vk_slab *slab)
@@ -302,7 +311,16 @@ void vk_free_memslice(struct mpvk_ctx *vk, struct vk_memslice slice)
     if (slab->dedicated) {
         // If the slab was purpose-allocated for this memslice, we can just
         // free it here
+        vk->alloc->num_dedicated--;
+        vk->alloc->dedicated_size -= slab->size;
         slab_free(vk, slab);
+    } else if (slab->used == 0) {
+        // Start over with a single region, which also recovers regions that
+        // were too small to be tracked
+        slab->num_regions = 0;
+        MP_TARRAY_APPEND(slab, slab->regions, slab->num_regions,
+                         (struct vk_region) { 0, slab->size });
+        slab->unused_since = mp_time_us();
     } else {
         // Return the allocation to the free space map
         insert_region(slab, (struct vk_region) {
@@ -362,9 +380,14 @@ static bool heap_get_region(struct mpvk_ctx *vk, struct vk_heap *heap,
     // with the heap
     if (size > MPVK_HEAP_MAXIMUM_SLAB_SIZE) {
         slab = slab_alloc(vk, heap, size);
+        if (!slab)
+            return false;
+        slab->dedicated = true;
+        vk->alloc->num_dedicated++;
+        vk->alloc->dedicated_size += slab->size;
         *out_slab = slab;
         *out_index = 0;
-        return !!slab;
+        return true;
     }
 
     for (int i = 0; i < heap->num_slabs; i++) {
@@ -390,6 +413,16 @@ static bool heap_get_region(struct mpvk_ctx *vk, struct vk_heap *heap,
         }
     }
 
+    // Give back unused slabs before asking for more memory, which makes it less
+    // likely to fail due to fragmentation of device memory.
+    for (int i = heap->num_slabs - 1; i >= 0; i--) {
+        if (heap->slabs[i]->used == 0 && heap->slabs[i]->size < size) {
+            slab_free(vk, heap->slabs[i]);
+            MP_TARRAY_REMOVE_AT(heap->slabs, heap->num_slabs, i);
+        }
+    }
+    slab = heap->num_slabs ? heap->slabs[heap->num_slabs - 1] : NULL;
+
     // Otherwise, allocate a new vk_slab and append it to the list.
     size_t cur_size = MPMAX(size, slab ? slab->size : 0);
     size_t slab_size = MPVK_HEAP_SLAB_GROWTH_RATE * cur_size;
@@ -469,3 +502,50 @@ bool vk_malloc_buffer(struct mpvk_ctx *vk, VkBufferUsageFlags bufFlags,
 
     return true;
 }
+
+// Free slabs which have not been used for a while. This is cheap, and meant
+// to be called once per frame.
+void vk_malloc_garbage_collect(struct mpvk_ctx *vk)
+{
+    struct vk_malloc *ma = vk->alloc;
+    int64_t now = mp_time_us();
+
+    for (int i = 0; i < ma->num_heaps; i++) {
+        struct vk_heap *heap = &ma->heaps[i];
+        for (int n = heap->num_slabs - 1; n >= 0; n--) {
+            struct vk_slab *slab = heap->slabs[n];
+            if (slab->used || now - slab->unused_since < MPVK_HEAP_SLAB_GC_TIMEOUT)
+                continue;
+            MP_VERBOSE(vk, "Freeing slab of size %zu after %d seconds of "
+                       "inactivity.\n", slab->size,
+                       (int)((now - slab->unused_since) / 1000000));
+            slab_free(vk, slab);
+            MP_TARRAY_REMOVE_AT(heap->slabs, heap->num_slabs, n);
+        }
+    }
+}
+
+void vk_malloc_stats(struct mpvk_ctx *vk, struct mp_gpu_mem_stats *out)
+{
+    struct vk_malloc *ma = vk->alloc;
+
+    *out = (struct mp_gpu_mem_stats) {
+        .num_slabs = ma->num_dedicated,
+        .allocated = ma->dedicated_size,
+        .used = ma->dedicated_size,
+    };
+
+    for (int i = 0; i < ma->num_heaps; i++) {
+        struct vk_heap *heap = &ma->heaps[i];
+        for (int n = 0; n < heap->num_slabs; n++) {
+            struct vk_slab *slab = heap->slabs[n];
+            out->num_slabs++;
+            out->allocated += slab->size;
+            out->used += slab->used;
+            for (int r = 0; r < slab->num_regions; r++) {
+                out->largest_free = MPMAX(out->largest_free,
+                                          region_len(slab->regions[r]));
+            }
+        }
+    }
+}
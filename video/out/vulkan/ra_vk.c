@@ -1,3 +1,10 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "options/path.h"
+#include "osdep/getpid.h"
+#include "osdep/io.h"
 #include "video/out/gpu/utils.h"
 #include "video/out/gpu/spirv.h"
 
@@ -21,6 +28,19 @@ struct ra_vk {
     struct mpvk_ctx *vk;
     struct ra_tex *clear_tex; // stupid hack for clear()
     struct vk_cmd *cmd;       // currently recording cmd
+
+    // Device-wide pipeline cache, shared by all renderpasses. Loaded from and
+    // saved to pipecache_file (if set). Creating pipelines with it is
+    // internally synchronized, but merging into it requires that nothing else
+    // uses it, so merging is deferred until it's saved on destruction.
+    VkPipelineCache pipecache;
+    // Per-pass caches from old cached_program entries, to be merged into
+    // pipecache. Protected by pipecache_lock.
+    VkPipelineCache *merge_caches;
+    int num_merge_caches;
+    pthread_mutex_t pipecache_lock;
+    char *pipecache_dir, *pipecache_file;
+    size_t pipecache_size;    // size of the data loaded from pipecache_file
 };
 
 struct mpvk_ctx *ra_vk_get(struct ra *ra)
@@ -38,8 +58,18 @@ static void vk_submit(struct ra *ra)
     struct mpvk_ctx *vk = ra_vk_get(ra);
 
     if (p->cmd) {
+        bool async = p->cmd->pool != vk->pool_graphics;
         vk_cmd_queue(vk, p->cmd);
         p->cmd = NULL;
+
+        // Work on the async transfer/compute queues is usually done before
+        // the graphics work that depends on it is recorded (e.g. texture
+        // uploads of the next frame), so submit it right away instead of at
+        // the end of the frame. This lets it run in parallel with rendering
+        // still in flight. Everything queued so far is submitted in order, so
+        // semaphores are signalled before they are waited on.
+        if (async)
+            mpvk_flush_commands(vk);
     }
 }
 
@@ -85,6 +115,155 @@ static struct vk_cmd *vk_require_cmd(struct ra *ra, enum queue_type type)
         }                                                   \
     }
 
+// Mirrors the header the Vulkan spec mandates for pipeline cache data
+// (VK_PIPELINE_CACHE_HEADER_VERSION_ONE).
+struct vk_pipecache_header {
+    uint32_t header_size;
+    uint32_t header_version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint8_t uuid[VK_UUID_SIZE];
+};
+
+// Returns whether data was produced by the driver we're running on. Drivers
+// are supposed to reject foreign data, but don't rely on it.
+static bool vk_pipecache_valid(VkPhysicalDeviceProperties *prop, bstr data)
+{
+    struct vk_pipecache_header hdr;
+    if (data.len < sizeof(hdr))
+        return false;
+    memcpy(&hdr, data.start, sizeof(hdr));
+    return hdr.header_size >= sizeof(hdr) && hdr.header_size <= data.len &&
+           hdr.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           hdr.vendor_id == prop->vendorID && hdr.device_id == prop->deviceID &&
+           memcmp(hdr.uuid, prop->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static bool vk_load_pipeline_cache(struct ra *ra, const char *cache_dir)
+{
+    struct ra_vk *p = ra->priv;
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+
+    VkPhysicalDeviceProperties prop;
+    vkGetPhysicalDeviceProperties(vk->physd, &prop);
+
+    void *tmp = talloc_new(NULL);
+    bstr data = {0};
+
+    if (cache_dir && cache_dir[0]) {
+        // The file name is keyed by the driver, so switching between GPUs or
+        // driver versions doesn't throw away the other caches.
+        char *name = talloc_asprintf(tmp, "vulkan-pipelines-%04x-%04x-",
+                                     (unsigned)prop.vendorID,
+                                     (unsigned)prop.deviceID);
+        for (int i = 0; i < VK_UUID_SIZE; i++)
+            name = talloc_asprintf_append(name, "%02x", prop.pipelineCacheUUID[i]);
+        name = talloc_strdup_append(name, ".bin");
+
+        p->pipecache_dir = talloc_strdup(p, cache_dir);
+        p->pipecache_file = mp_path_join(p, cache_dir, name);
+
+        FILE *f = fopen(p->pipecache_file, "rb");
+        if (f) {
+            if (fseek(f, 0, SEEK_END) == 0) {
+                long size = ftell(f);
+                if (size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+                    data.start = talloc_size(tmp, size);
+                    data.len = fread(data.start, 1, size, f);
+                }
+            }
+            fclose(f);
+        }
+
+        if (data.len && !vk_pipecache_valid(&prop, data)) {
+            MP_WARN(ra, "Ignoring invalid pipeline cache '%s'.\n",
+                    p->pipecache_file);
+            data.len = 0;
+        } else if (data.len) {
+            MP_VERBOSE(ra, "Loaded pipeline cache '%s' (%zu bytes).\n",
+                       p->pipecache_file, data.len);
+        }
+    }
+
+    VkPipelineCacheCreateInfo pcinfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pInitialData = data.start,
+        .initialDataSize = data.len,
+    };
+
+    VkResult res = vkCreatePipelineCache(vk->dev, &pcinfo, MPVK_ALLOCATOR,
+                                         &p->pipecache);
+    if (res != VK_SUCCESS && data.len) {
+        // Retry without the initial data, in case the driver choked on it
+        MP_WARN(ra, "Pipeline cache rejected: %s\n", vk_err(res));
+        pcinfo.pInitialData = NULL;
+        pcinfo.initialDataSize = data.len = 0;
+        res = vkCreatePipelineCache(vk->dev, &pcinfo, MPVK_ALLOCATOR,
+                                    &p->pipecache);
+    }
+    p->pipecache_size = data.len;
+
+    talloc_free(tmp);
+
+    if (res != VK_SUCCESS) {
+        MP_ERR(ra, "Failed creating pipeline cache: %s\n", vk_err(res));
+        p->pipecache = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void vk_save_pipeline_cache(struct ra *ra)
+{
+    struct ra_vk *p = ra->priv;
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+
+    // Nothing else uses pipecache anymore, which vkMergePipelineCaches requires.
+    pthread_mutex_lock(&p->pipecache_lock);
+    if (p->num_merge_caches) {
+        vkMergePipelineCaches(vk->dev, p->pipecache, p->num_merge_caches,
+                              p->merge_caches);
+    }
+    for (int n = 0; n < p->num_merge_caches; n++)
+        vkDestroyPipelineCache(vk->dev, p->merge_caches[n], MPVK_ALLOCATOR);
+    p->num_merge_caches = 0;
+    pthread_mutex_unlock(&p->pipecache_lock);
+
+    if (!p->pipecache_file)
+        return;
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(vk->dev, p->pipecache, &size, NULL) != VK_SUCCESS)
+        return;
+    // Pipelines only ever get added, so an unchanged size means no new ones.
+    if (!size || size == p->pipecache_size)
+        return;
+
+    void *data = talloc_size(NULL, size);
+    if (vkGetPipelineCacheData(vk->dev, p->pipecache, &size, data) != VK_SUCCESS)
+        goto done;
+
+    // Write a temporary file and rename it, so that other instances never
+    // read a partially written cache.
+    mp_mkdirp(p->pipecache_dir);
+    char *tmp_path = talloc_asprintf(data, "%s.%d.tmp", p->pipecache_file,
+                                     mp_getpid());
+    FILE *f = fopen(tmp_path, "wb");
+    bool ok = f && fwrite(data, size, 1, f) == 1;
+    if (f)
+        ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, p->pipecache_file) != 0) {
+        MP_WARN(ra, "Can't write pipeline cache '%s'.\n", p->pipecache_file);
+        unlink(tmp_path);
+        goto done;
+    }
+    MP_VERBOSE(ra, "Saved pipeline cache '%s' (%zu bytes).\n",
+               p->pipecache_file, size);
+
+done:
+    talloc_free(data);
+}
+
 static void vk_destroy_ra(struct ra *ra)
 {
     struct ra_vk *p = ra->priv;
@@ -95,6 +274,12 @@ static void vk_destroy_ra(struct ra *ra)
     mpvk_poll_commands(vk, UINT64_MAX);
     ra_tex_free(ra, &p->clear_tex);
 
+    if (p->pipecache) {
+        vk_save_pipeline_cache(ra);
+        vkDestroyPipelineCache(vk->dev, p->pipecache, MPVK_ALLOCATOR);
+    }
+    pthread_mutex_destroy(&p->pipecache_lock);
+
     talloc_free(ra);
 }
 
@@ -194,7 +379,8 @@ error:
 
 static struct ra_fns ra_fns_vk;
 
-struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
+struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log,
+                        const char *cache_dir)
 {
     assert(vk->dev);
     assert(vk->alloc);
@@ -205,6 +391,7 @@ struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
 
     struct ra_vk *p = ra->priv = talloc_zero(ra, struct ra_vk);
     p->vk = vk;
+    pthread_mutex_init(&p->pipecache_lock, NULL);
 
     ra->caps |= vk->spirv->ra_caps;
     ra->glsl_version = vk->spirv->glsl_version;
@@ -223,9 +410,15 @@ struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
     if (!vk_setup_formats(ra))
         goto error;
 
+    if (!vk_load_pipeline_cache(ra, cache_dir))
+        goto error;
+
     // UBO support is required
     ra->caps |= RA_CAP_BUF_RO | RA_CAP_FRAGCOORD;
 
+    // Creating pipelines only uses thread-safe device functions.
+    ra->caps |= RA_CAP_ASYNC_PASS;
+
     // textureGather requires the ImageGatherExtended capability
     if (vk->features.shaderImageGatherExtended)
         ra->caps |= RA_CAP_GATHER;
@@ -540,7 +733,7 @@ static struct ra_tex *vk_tex_create(struct ra *ra,
         usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     if (params->storage_dst)
         usage |= VK_IMAGE_USAGE_STORAGE_BIT;
-    if (params->blit_src)
+    if (params->blit_src || params->downloadable)
         usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     if (params->host_mutable || params->blit_dst || params->initial_data)
         usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
@@ -938,6 +1131,98 @@ error:
     return false;
 }
 
+static bool vk_tex_download(struct ra *ra,
+                            struct ra_tex_download_params *params)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct ra_tex *tex = params->tex;
+    struct ra_tex_vk *tex_vk = tex->priv;
+    bool ok = false;
+
+    assert(tex->params.downloadable && tex->params.dimensions == 2);
+
+    int pix_size = tex->params.format->pixel_size;
+    size_t row_size = tex->params.w * pix_size;
+    size_t size = row_size * tex->params.h;
+
+    // The buffer offset must be a multiple of the texel size as well
+    VkDeviceSize align = vk->limits.optimalBufferCopyOffsetAlignment * pix_size;
+
+    // Cached memory makes reading it back much faster, but not all devices
+    // have a memory type that is both cached and coherent
+    VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    struct vk_bufslice slice = {0};
+    if (!vk_malloc_buffer(vk, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          memFlags | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                          size, align, false, &slice) &&
+        !vk_malloc_buffer(vk, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memFlags,
+                          size, align, false, &slice))
+    {
+        return false;
+    }
+
+    // The texture was most likely just rendered to, so stay on that queue
+    struct vk_cmd *cmd = vk_require_cmd(ra, GRAPHICS);
+    if (!cmd)
+        goto error;
+
+    tex_barrier(ra, cmd, tex, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false);
+
+    VkBufferImageCopy region = {
+        .bufferOffset = slice.mem.offset,
+        .bufferRowLength = tex->params.w,
+        .bufferImageHeight = tex->params.h,
+        .imageSubresource = vk_layers,
+        .imageExtent = (VkExtent3D){tex->params.w, tex->params.h, 1},
+    };
+
+    vkCmdCopyImageToBuffer(cmd->buf, tex_vk->img, tex_vk->current_layout,
+                           slice.buf, 1, &region);
+
+    VkBufferMemoryBarrier buffBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = slice.buf,
+        .offset = region.bufferOffset,
+        .size = size,
+    };
+
+    vkCmdPipelineBarrier(cmd->buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL,
+                         1, &buffBarrier, 0, NULL);
+
+    tex_signal(ra, cmd, tex, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    // Downloads are synchronous, so wait for the copy to finish
+    vk_submit(ra);
+    if (!mpvk_flush_commands(vk))
+        goto error;
+    mpvk_poll_commands(vk, UINT64_MAX);
+
+    const uint8_t *src = slice.data;
+    uint8_t *dst = params->dst;
+    if (params->stride == row_size) {
+        memcpy(dst, src, size);
+    } else {
+        for (int y = 0; y < tex->params.h; y++) {
+            memcpy(dst + y * params->stride, src + y * row_size,
+                   MPMIN(row_size, params->stride));
+        }
+    }
+
+    ok = true;
+
+error:
+    vk_free_memslice(vk, slice.mem);
+    return ok;
+}
+
 static bool ra_vk_mem_get_external_info(struct ra *ra, struct vk_memslice *mem, struct vk_external_mem *ret)
 {
     struct mpvk_ctx *vk = ra_vk_get(ra);
@@ -1165,6 +1450,7 @@ static const VkShaderStageFlags stageFlags[] = {
 static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
                                     const struct ra_renderpass_params *params)
 {
+    struct ra_vk *p = ra->priv;
     struct mpvk_ctx *vk = ra_vk_get(ra);
     bool success = false;
     assert(vk->spirv);
@@ -1177,7 +1463,7 @@ static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
 
     // temporary allocations/objects
     void *tmp = talloc_new(NULL);
-    VkPipelineCache pipeCache = NULL;
+    VkPipelineCache pipeCache = p->pipecache;
     VkShaderModule vert_shader = NULL;
     VkShaderModule frag_shader = NULL;
     VkShaderModule comp_shader = NULL;
@@ -1294,13 +1580,26 @@ static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
         }
     }
 
-    VkPipelineCacheCreateInfo pcinfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
-        .pInitialData = pipecache.start,
-        .initialDataSize = pipecache.len,
-    };
+    // Entries written by older versions carry their own pipeline cache data.
+    // Create this pass's pipeline with it, and fold it into the device-wide
+    // cache (which gets persisted as a whole) when that is saved.
+    if (pipecache.len) {
+        VkPipelineCacheCreateInfo pcinfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .pInitialData = pipecache.start,
+            .initialDataSize = pipecache.len,
+        };
 
-    VK(vkCreatePipelineCache(vk->dev, &pcinfo, MPVK_ALLOCATOR, &pipeCache));
+        VkPipelineCache passCache;
+        if (vkCreatePipelineCache(vk->dev, &pcinfo, MPVK_ALLOCATOR,
+                                  &passCache) == VK_SUCCESS)
+        {
+            pipeCache = passCache;
+            pthread_mutex_lock(&p->pipecache_lock);
+            MP_TARRAY_APPEND(p, p->merge_caches, p->num_merge_caches, passCache);
+            pthread_mutex_unlock(&p->pipecache_lock);
+        }
+    }
 
     VkShaderModuleCreateInfo sinfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -1463,11 +1762,9 @@ static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
     }
     }
 
-    // Update params->cached_program
+    // Update params->cached_program. The pipeline itself lives in the
+    // device-wide cache, so only the SPIR-V is stored here.
     struct bstr cache = {0};
-    VK(vkGetPipelineCacheData(vk->dev, pipeCache, &cache.len, NULL));
-    cache.start = talloc_size(tmp, cache.len);
-    VK(vkGetPipelineCacheData(vk->dev, pipeCache, &cache.len, cache.start));
 
     struct vk_cache_header header = {
         .cache_version = vk_cache_version,
@@ -1501,7 +1798,6 @@ error:
     vkDestroyShaderModule(vk->dev, vert_shader, MPVK_ALLOCATOR);
     vkDestroyShaderModule(vk->dev, frag_shader, MPVK_ALLOCATOR);
     vkDestroyShaderModule(vk->dev, comp_shader, MPVK_ALLOCATOR);
-    vkDestroyPipelineCache(vk->dev, pipeCache, MPVK_ALLOCATOR);
     talloc_free(tmp);
     return pass;
 }
@@ -1940,11 +2236,17 @@ static uint64_t vk_timer_stop(struct ra *ra, ra_timer *ratimer)
     return timer->result;
 }
 
+static void vk_mem_stats(struct ra *ra, struct mp_gpu_mem_stats *out)
+{
+    vk_malloc_stats(ra_vk_get(ra), out);
+}
+
 static struct ra_fns ra_fns_vk = {
     .destroy                = vk_destroy_ra,
     .tex_create             = vk_tex_create,
     .tex_destroy            = vk_tex_destroy_lazy,
     .tex_upload             = vk_tex_upload,
+    .tex_download           = vk_tex_download,
     .buf_create             = vk_buf_create,
     .buf_destroy            = vk_buf_destroy_lazy,
     .buf_update             = vk_buf_update,
@@ -1961,6 +2263,7 @@ static struct ra_fns ra_fns_vk = {
     .timer_destroy          = vk_timer_destroy_lazy,
     .timer_start            = vk_timer_start,
     .timer_stop             = vk_timer_stop,
+    .mem_stats              = vk_mem_stats,
 };
 
 struct vk_cmd *ra_vk_submit(struct ra *ra, struct ra_tex *tex)
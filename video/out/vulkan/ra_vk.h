@@ -5,7 +5,9 @@
 #include "common.h"
 #include "utils.h"
 
-struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log);
+// cache_dir is where the VkPipelineCache is persisted (may be NULL).
+struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log,
+                        const char *cache_dir);
 
 // Access to the VkDevice is needed for swapchain creation
 VkDevice ra_vk_get_dev(struct ra *ra);
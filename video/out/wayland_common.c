@@ -16,6 +16,7 @@
  */
 
 #include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/input.h>
 #include "common/msg.h"
@@ -35,6 +36,9 @@
 // Generated from xdg-decoration-unstable-v1.xml
 #include "video/out/wayland/xdg-decoration-v1.h"
 
+// Generated from presentation-time.xml
+#include "video/out/wayland/presentation-time.h"
+
 static void xdg_shell_ping(void *data, struct xdg_wm_base *shell, uint32_t serial)
 {
     xdg_wm_base_pong(shell, serial);
@@ -776,6 +780,62 @@ static const struct wl_callback_listener frame_listener = {
     frame_callback,
 };
 
+static void pres_set_clockid(void *data, struct wp_presentation *pres,
+                             uint32_t clockid)
+{
+    struct vo_wayland_state *wl = data;
+    wl->presentation_clock = clockid;
+}
+
+static const struct wp_presentation_listener pres_listener = {
+    pres_set_clockid,
+};
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *fback,
+                                 struct wl_output *output)
+{
+}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *fback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                               uint32_t tv_nsec, uint32_t refresh_nsec,
+                               uint32_t seq_hi, uint32_t seq_lo,
+                               uint32_t flags)
+{
+    struct vo_wayland_state *wl = data;
+    wp_presentation_feedback_destroy(fback);
+    wl->feedback_pending = MPMAX(wl->feedback_pending - 1, 0);
+
+    // Translate the timestamp from the compositor's clock to mp_time_us().
+    struct timespec now;
+    if (clock_gettime(wl->presentation_clock, &now))
+        return;
+    int64_t ts = (((uint64_t)tv_sec_hi << 32) + tv_sec_lo) * INT64_C(1000000)
+                 + tv_nsec / 1000;
+    int64_t now_us = now.tv_sec * INT64_C(1000000) + now.tv_nsec / 1000;
+    wl->last_present_time = mp_time_us() - (now_us - ts);
+    wl->present_refresh = refresh_nsec / 1000;
+
+    // The MSC is only meaningful if the compositor reported it.
+    uint64_t msc = ((uint64_t)seq_hi << 32) + seq_lo;
+    if (msc && wl->last_msc && msc > wl->last_msc)
+        wl->skipped_vsyncs += msc - wl->last_msc - 1;
+    wl->last_msc = msc;
+}
+
+static void feedback_discarded(void *data, struct wp_presentation_feedback *fback)
+{
+    struct vo_wayland_state *wl = data;
+    wp_presentation_feedback_destroy(fback);
+    wl->feedback_pending = MPMAX(wl->feedback_pending - 1, 0);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    feedback_sync_output,
+    feedback_presented,
+    feedback_discarded,
+};
+
 static void registry_handle_add(void *data, struct wl_registry *reg, uint32_t id,
                                 const char *interface, uint32_t ver)
 {
@@ -831,6 +891,11 @@ static void registry_handle_add(void *data, struct wl_registry *reg, uint32_t id
         wl->idle_inhibit_manager = wl_registry_bind(reg, id, &zwp_idle_inhibit_manager_v1_interface, 1);
     }
 
+    if (!strcmp(interface, wp_presentation_interface.name) && found++) {
+        wl->presentation = wl_registry_bind(reg, id, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(wl->presentation, &pres_listener, wl);
+    }
+
     if (found > 1)
         MP_VERBOSE(wl, "Registered for protocol %s\n", interface);
 }
@@ -1049,6 +1114,10 @@ int vo_wayland_init(struct vo *vo)
         MP_VERBOSE(wl, "Compositor doesn't support the %s protocol!\n",
                    zwp_idle_inhibit_manager_v1_interface.name);
 
+    if (!wl->presentation)
+        MP_VERBOSE(wl, "Compositor doesn't support the %s protocol!\n",
+                   wp_presentation_interface.name);
+
     wl->display_fd = wl_display_get_fd(wl->display);
     mp_make_wakeup_pipe(wl->wakeup_pipe);
 
@@ -1078,6 +1147,9 @@ void vo_wayland_uninit(struct vo *vo)
     if (wl->idle_inhibit_manager)
         zwp_idle_inhibit_manager_v1_destroy(wl->idle_inhibit_manager);
 
+    if (wl->presentation)
+        wp_presentation_destroy(wl->presentation);
+
     if (wl->shell)
         xdg_wm_base_destroy(wl->shell);
 
@@ -1399,3 +1471,30 @@ void vo_wayland_wait_events(struct vo *vo, int64_t until_time_us)
     if (fds[1].revents & POLLIN)
         mp_flush_wakeup_pipe(wl->wakeup_pipe[0]);
 }
+
+// Must be called before the surface commit of a new frame (i.e. the swap).
+void vo_wayland_request_feedback(struct vo_wayland_state *wl)
+{
+    if (!wl->presentation)
+        return;
+    struct wp_presentation_feedback *fback =
+        wp_presentation_feedback(wl->presentation, wl->surface);
+    wp_presentation_feedback_add_listener(fback, &feedback_listener, wl);
+    wl->feedback_pending++;
+}
+
+void vo_wayland_get_vsync(struct vo_wayland_state *wl, struct vo_vsync_info *info)
+{
+    // Dispatch already received presentation events without blocking.
+    wl_display_dispatch_pending(wl->display);
+
+    if (!wl->presentation || !wl->last_present_time || !wl->present_refresh)
+        return;
+
+    // Frames which weren't presented yet are assumed to show up on the
+    // following vsyncs.
+    info->last_queue_display_time = wl->last_present_time +
+                                    wl->feedback_pending * wl->present_refresh;
+    info->skipped_vsyncs = wl->skipped_vsyncs;
+    wl->skipped_vsyncs = 0;
+}
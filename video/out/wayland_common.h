@@ -18,6 +18,7 @@
 #ifndef MPLAYER_WAYLAND_COMMON_H
 #define MPLAYER_WAYLAND_COMMON_H
 
+#include <time.h>
 #include <wayland-client.h>
 #include <wayland-cursor.h>
 #include <xkbcommon/xkbcommon.h>
@@ -78,6 +79,15 @@ struct vo_wayland_state {
     struct zwp_idle_inhibit_manager_v1 *idle_inhibit_manager;
     struct zwp_idle_inhibitor_v1 *idle_inhibitor;
 
+    /* Presentation feedback */
+    struct wp_presentation *presentation;
+    clockid_t presentation_clock;
+    int64_t last_present_time;  // mp_time_us() of the last presented frame, 0 if unknown
+    int64_t present_refresh;    // us, 0 if unknown
+    uint64_t last_msc;
+    int64_t skipped_vsyncs;     // accumulated since the last vo_wayland_get_vsync()
+    int feedback_pending;
+
     /* Input */
     struct wl_seat     *seat;
     struct wl_pointer  *pointer;
@@ -110,5 +120,7 @@ void vo_wayland_check_events(struct vo *vo);
 void vo_wayland_uninit(struct vo *vo);
 void vo_wayland_wakeup(struct vo *vo);
 void vo_wayland_wait_events(struct vo *vo, int64_t until_time_us);
+void vo_wayland_request_feedback(struct vo_wayland_state *wl);
+void vo_wayland_get_vsync(struct vo_wayland_state *wl, struct vo_vsync_info *info);
 
 #endif /* MPLAYER_WAYLAND_COMMON_H */
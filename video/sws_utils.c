@@ -16,6 +16,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -34,8 +35,12 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
+// Minimum number of lines per slice when threading.
+#define MIN_SLICE_LINES 32
+
 //global sws_flags from the command line
 struct sws_opts {
     int scaler;
@@ -45,6 +50,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +74,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_INTRANGE("threads", threads, 0, 1, 64),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -98,6 +106,8 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct mpv_global *g)
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
 
+    ctx->threads = opts->threads;
+
     talloc_free(opts);
 }
 
@@ -129,9 +139,168 @@ static bool cache_valid(struct mp_sws_context *ctx)
            ctx->saturation == old->saturation;
 }
 
+struct slice_job {
+    struct mp_sws_slices *s;
+    struct mp_sws_context *ctx;
+    struct mp_image dst, src;
+    int res;
+};
+
+struct mp_sws_slices {
+    struct mp_thread_pool *pool;
+    int num_threads;            // including the caller's thread
+    struct slice_job *jobs;     // num_threads entries
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;                // number of running slice_worker() calls
+};
+
+static void free_slices(struct mp_sws_context *ctx)
+{
+    struct mp_sws_slices *s = ctx->slices;
+    if (!s)
+        return;
+
+    talloc_free(s->pool);
+    // The filters are owned by ctx.
+    for (int n = 0; n < s->num_threads; n++) {
+        s->jobs[n].ctx->src_filter = NULL;
+        s->jobs[n].ctx->dst_filter = NULL;
+    }
+    pthread_cond_destroy(&s->wakeup);
+    pthread_mutex_destroy(&s->lock);
+    talloc_free(s);
+    ctx->slices = NULL;
+}
+
+static bool init_slices(struct mp_sws_context *ctx)
+{
+    if (ctx->slices && ctx->slices->num_threads == ctx->threads)
+        return true;
+
+    free_slices(ctx);
+
+    struct mp_sws_slices *s = talloc_zero(ctx, struct mp_sws_slices);
+    s->num_threads = ctx->threads;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wakeup, NULL);
+    ctx->slices = s;
+
+    s->pool = mp_thread_pool_create(s, s->num_threads - 1);
+    s->jobs = talloc_zero_array(s, struct slice_job, s->num_threads);
+    for (int n = 0; n < s->num_threads; n++) {
+        s->jobs[n].s = s;
+        s->jobs[n].ctx = mp_sws_alloc(s);
+    }
+
+    if (!s->pool) {
+        MP_WARN(ctx, "Could not create threads, not using slice threading.\n");
+        free_slices(ctx);
+        ctx->threads = 0;
+        return false;
+    }
+
+    return true;
+}
+
+static bool has_vertical_filter(struct SwsFilter *f)
+{
+    return f && ((f->lumV && f->lumV->length > 1) ||
+                 (f->chrV && f->chrV->length > 1));
+}
+
+// Slices are converted as separate images, which works only if each output
+// line depends on the input line at the same position only. Vertical chroma
+// resampling (e.g. yuv420p -> rgb, or different chroma locations) would clamp
+// the filter taps at the slice borders, and leave visible seams.
+static bool can_slice(struct mp_sws_context *ctx, struct mp_image *dst,
+                      struct mp_image *src)
+{
+    int bad_flags = MP_IMGFLAG_PAL | MP_IMGFLAG_HWACCEL;
+    return ctx->threads > 1 && src->h == dst->h &&
+           !((src->fmt.flags | dst->fmt.flags) & bad_flags) &&
+           src->fmt.chroma_ys == dst->fmt.chroma_ys &&
+           src->params.chroma_location == dst->params.chroma_location &&
+           !has_vertical_filter(ctx->src_filter) &&
+           !has_vertical_filter(ctx->dst_filter);
+}
+
+static void slice_worker(void *p)
+{
+    struct slice_job *job = p;
+    struct mp_sws_slices *s = job->s;
+
+    job->res = mp_sws_scale(job->ctx, &job->dst, &job->src);
+
+    pthread_mutex_lock(&s->lock);
+    s->pending -= 1;
+    pthread_cond_broadcast(&s->wakeup);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Convert the image in slices on the worker threads and the caller's thread.
+// Returns <0 if the image can't be sliced, or on errors.
+static int scale_sliced(struct mp_sws_context *ctx, struct mp_image *dst,
+                        struct mp_image *src)
+{
+    struct mp_sws_slices *s = ctx->slices;
+
+    int align = MPMAX(src->fmt.align_y, dst->fmt.align_y);
+    int num = MPMIN(s->num_threads, src->h / MPMAX(MIN_SLICE_LINES, align));
+    if (num < 2)
+        return -1;
+
+    for (int n = 0; n < num; n++) {
+        struct slice_job *job = &s->jobs[n];
+        struct mp_sws_context *sctx = job->ctx;
+
+        sctx->log = ctx->log;
+        sctx->flags = ctx->flags;
+        sctx->brightness = ctx->brightness;
+        sctx->contrast = ctx->contrast;
+        sctx->saturation = ctx->saturation;
+        sctx->src_filter = ctx->src_filter;
+        sctx->dst_filter = ctx->dst_filter;
+        sctx->params[0] = ctx->params[0];
+        sctx->params[1] = ctx->params[1];
+
+        int y0 = (src->h * n / num) & ~(align - 1);
+        int y1 = (src->h * (n + 1) / num) & ~(align - 1);
+        if (n == num - 1)
+            y1 = src->h;
+        job->src = *src;
+        mp_image_crop(&job->src, 0, y0, src->w, y1);
+        job->dst = *dst;
+        mp_image_crop(&job->dst, 0, y0, dst->w, y1);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->pending = num - 1;
+    pthread_mutex_unlock(&s->lock);
+
+    for (int n = 1; n < num; n++)
+        mp_thread_pool_queue(s->pool, slice_worker, &s->jobs[n]);
+
+    struct slice_job *job = &s->jobs[0];
+    job->res = mp_sws_scale(job->ctx, &job->dst, &job->src);
+
+    pthread_mutex_lock(&s->lock);
+    while (s->pending)
+        pthread_cond_wait(&s->wakeup, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int n = 0; n < num; n++) {
+        if (s->jobs[n].res < 0)
+            return -1;
+    }
+    return 0;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    free_slices(ctx);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -246,6 +415,10 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
         return -1;
 
+    // The slice contexts might use the old filters.
+    for (int n = 0; ctx->slices && n < ctx->slices->num_threads; n++)
+        ctx->slices->jobs[n].ctx->force_reload = true;
+
     ctx->force_reload = false;
     *ctx->cached = *ctx;
     return 1;
@@ -266,6 +439,10 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    if (can_slice(ctx, dst, src) && init_slices(ctx) &&
+        scale_sliced(ctx, dst, src) >= 0)
+        return 0;
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
@@ -32,6 +32,9 @@ struct mp_sws_context {
     int flags;
     int brightness, contrast, saturation;
     bool force_reload;
+    // Number of threads converting horizontal slices of the image in parallel
+    // (0 or 1: no threading). Only used if there is no vertical scaling.
+    int threads;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -48,6 +51,9 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // Per-slice contexts and worker threads (if threads > 1)
+    struct mp_sws_slices *slices;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
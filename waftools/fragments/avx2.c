@@ -0,0 +1,14 @@
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+float *a_ptr;
+
+int main(void)
+{
+    __m256 ymm0 = _mm256_loadu_ps(a_ptr);
+    __m256i ymm1 = _mm256_abs_epi32(_mm256_castps_si256(ymm0));
+    _mm256_storeu_ps(a_ptr, _mm256_castsi256_ps(ymm1));
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#include <arm_neon.h>
+
+float *a_ptr;
+
+int main(void)
+{
+    float32x4_t q0 = vld1q_f32(a_ptr);
+    q0 = vminq_f32(vmulq_n_f32(q0, 0.5f), vdupq_n_f32(1.0f));
+    vst1q_f32(a_ptr, q0);
+
+    return 0;
+}
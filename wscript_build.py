@@ -135,6 +135,12 @@ def build(ctx):
         ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
             protocol  = "unstable/xdg-decoration/xdg-decoration-unstable-v1",
             target    = "video/out/wayland/xdg-decoration-v1.h")
+        ctx.wayland_protocol_code(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.c")
+        ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.h")
 
     ctx(features = "ebml_header", target = "ebml_types.h")
     ctx(features = "ebml_definitions", target = "ebml_defs.c")
@@ -267,9 +273,11 @@ def build(ctx):
         ( "common/playlist.c" ),
         ( "common/recorder.c" ),
         ( "common/tags.c" ),
+        ( "common/trace.c" ),
         ( "common/version.c" ),
 
         ## Demuxers
+        ( "demux/cache.c" ),
         ( "demux/codec_tags.c" ),
         ( "demux/cue.c" ),
         ( "demux/demux.c" ),
@@ -288,9 +296,12 @@ def build(ctx):
         ( "demux/demux_timeline.c" ),
         ( "demux/demux_tv.c",                    "tv" ),
         ( "demux/ebml.c" ),
+        ( "demux/hls_prefetch.c" ),
         ( "demux/packet.c" ),
+        ( "demux/probe_cache.c" ),
         ( "demux/timeline.c" ),
 
+        ( "filters/f_async_queue.c" ),
         ( "filters/f_autoconvert.c" ),
         ( "filters/f_auto_filters.c" ),
         ( "filters/f_decoder_wrapper.c" ),
@@ -319,10 +330,12 @@ def build(ctx):
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/json.c" ),
+        ( "misc/msgpack.c" ),
         ( "misc/node.c" ),
         ( "misc/rendezvous.c" ),
         ( "misc/ring.c" ),
         ( "misc/thread_pool.c" ),
+        ( "misc/thread_sched.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -335,6 +348,7 @@ def build(ctx):
 
         ## Player
         ( "player/audio.c" ),
+        ( "player/benchmark.c" ),
         ( "player/client.c" ),
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
@@ -358,6 +372,7 @@ def build(ctx):
         ( "stream/audio_in.c",                   "audio-input" ),
         ( "stream/cache.c" ),
         ( "stream/cache_file.c" ),
+        ( "stream/cache_shm.c",                  "posix-shm" ),
         ( "stream/cookies.c" ),
         ( "stream/dvb_tune.c",                   "dvbin" ),
         ( "stream/frequencies.c",                "tv" ),
@@ -401,6 +416,7 @@ def build(ctx):
         ## Video
         ( "video/csputils.c" ),
         ( "video/d3d.c",                         "d3d-hwaccel" ),
+        ( "video/decode/hwdec_cache.c" ),
         ( "video/decode/vd_lavc.c" ),
         ( "video/filter/refqueue.c" ),
         ( "video/filter/vf_d3d11vpp.c",          "d3d-hwaccel" ),
@@ -446,6 +462,7 @@ def build(ctx):
         ( "video/out/gpu/utils.c" ),
         ( "video/out/gpu/video.c" ),
         ( "video/out/gpu/video_shaders.c" ),
+        ( "video/out/libmpv_sw.c" ),
         ( "video/out/opengl/angle_dynamic.c",    "egl-angle" ),
         ( "video/out/opengl/common.c",           "gl" ),
         ( "video/out/opengl/context.c",          "gl" ),
@@ -504,6 +521,7 @@ def build(ctx):
         ( "video/out/vulkan/utils.c",            "vulkan" ),
         ( "video/out/w32_common.c",              "win32-desktop" ),
         ( "video/out/wayland/idle-inhibit-v1.c", "wayland" ),
+        ( "video/out/wayland/presentation-time.c", "wayland" ),
         ( "video/out/wayland/xdg-decoration-v1.c", "wayland" ),
         ( "video/out/wayland/xdg-shell.c",       "wayland" ),
         ( "video/out/wayland_common.c",          "wayland" ),
@@ -577,7 +595,8 @@ def build(ctx):
                 ctx.path.find_node('osdep/mpv.rc'),
                 version)
 
-    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test'):
+    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test') \
+            or ctx.dependency_satisfied('bench'):
         ctx(
             target       = "objects",
             source       = ctx.filtered_sources(sources),
@@ -631,6 +650,26 @@ def build(ctx):
                 install_path = None,
             )
 
+    if ctx.dependency_satisfied('bench'):
+        bench_programs = [
+            ( "bench", ["bench.c", "audio.c", "misc.c", "video.c"] ),
+            ( "demux_seek", ["demux_seek.c"] ),
+        ]
+        # Offscreen rendering needs a surfaceless EGL context.
+        if ctx.dependency_satisfied('egl-helpers') \
+                and ctx.dependency_satisfied('gl'):
+            bench_programs.append(( "gpu", ["gpu.c"] ))
+        for name, sources in bench_programs:
+            ctx(
+                target       = "test/bench/" + name,
+                source       = ["test/bench/" + s
+                                for s in sources + ["env.c"]],
+                use          = ctx.dependencies_use() + ['objects'],
+                includes     = _all_includes(ctx),
+                features     = "c cprogram",
+                install_path = None,
+            )
+
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')
     if build_shared or build_static: